@@ -17,6 +17,30 @@
 #pragma once
 #include "lib/sim_common_structs.h"
 
+//
+// cbp_hooks
+//
+// The notifications the contestant's code consumes, as a mask of CBP_HOOK_* bits, defined next to the hooks.
+// Optional: CBP_HOOK_ALL by default (lib/default_hooks.cc).
+// The simulator does not call the notify_* hooks left out of the mask, and skips the bookkeeping that only serves
+// them. get_cond_dir_prediction() and spec_update() are always called.
+// Without CBP_HOOK_VALUES, the output register values are skipped over when reading the trace, unless value prediction
+// needs them (VP_ENABLE): ExecuteInfo::dst_reg_value then holds 0.
+//
+enum : uint32_t
+{
+    CBP_HOOK_FETCH = (1 << 0),      // notify_instr_fetch
+    CBP_HOOK_DECODE = (1 << 1),     // notify_instr_decode
+    CBP_HOOK_AGEN = (1 << 2),       // notify_agen_complete
+    CBP_HOOK_EXECUTE = (1 << 3),    // notify_instr_execute_resolve
+    CBP_HOOK_COMMIT = (1 << 4),     // notify_instr_commit
+    CBP_HOOK_ALL = 0x1f,            // all the per-event hooks
+    CBP_HOOK_BATCH = (1 << 5),      // notify_batch
+    CBP_HOOK_VALUES = (1 << 6),     // ExecuteInfo::dst_reg_value is read
+    CBP_HOOK_STATIC_ID = (1 << 7)   // notify_static_id
+};
+extern const uint32_t cbp_hooks;
+
 //
 // beginCondDirPredictor()
 // 
@@ -52,6 +76,17 @@ extern bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc,
 //
 extern void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, const bool resolve_dir, const bool pred_dir, const uint64_t next_pc);
 
+//
+// notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+//
+// Optional, called only if cbp_hooks has CBP_HOOK_STATIC_ID, for every branch right before its get_cond_dir_prediction()
+// (conditional branches) and spec_update(): static_id is a dense id of pc, 0 for the first PC of the trace and one
+// more for each new PC, so that per-PC state can be a flat array indexed by it, grown as new ids come, instead of a
+// table hashed by PC. Branch traces (convert_trace -b) only number the PCs of their branches.
+// DecodeInfo::static_id holds the same id for every instruction. A no-op by default (lib/default_hooks.cc).
+//
+extern void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id);
+
 //
 // notify_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& _decode_info, const uint64_t decode_cycle)
 // 
@@ -85,6 +120,80 @@ extern void notify_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_
 extern void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, const bool pred_dir, const ExecuteInfo& _exec_info, const uint64_t commit_cycle);
 
 
+//
+// notify_batch(const cbp_batch_t& batch)
+//
+// Optional batched form of the notify_* hooks, called only if cbp_hooks has CBP_HOOK_BATCH. It can be used alongside
+// the per-event hooks or instead of them. A no-op by default (lib/default_hooks.cc).
+// The simulator calls it once per simulated cycle in which any instruction is decoded, completes agen, executes or
+// commits, with the records of those events and of the instructions fetched since the previous batch, each in
+// program order. The records and the ExecuteInfo they point to are only valid for the duration of the call.
+// Instructions fetched after the last such cycle of the simulation are not delivered.
+//
+struct cbp_record_t
+{
+    uint64_t seq_no;
+    uint8_t piece;
+    uint64_t pc;
+    bool pred_dir;
+    uint64_t cycle;                 // cycle of the event
+    const ExecuteInfo *exec_info;   // only exec_info->dec_info is meaningful before the instruction executes
+};
+
+struct cbp_span_t
+{
+    const cbp_record_t *data;
+    size_t size;
+
+    const cbp_record_t *begin() const { return data; }
+    const cbp_record_t *end() const { return data + size; }
+    bool empty() const { return size == 0; }
+};
+
+struct cbp_batch_t
+{
+    uint64_t cycle;
+    cbp_span_t fetched;
+    cbp_span_t decoded;
+    cbp_span_t agen_completed;
+    cbp_span_t resolved;
+    cbp_span_t committed;
+};
+
+extern void notify_batch(const cbp_batch_t& batch);
+
+//
+// snapshot_cond_dir_predictor(snapshot_t& s)
+//
+// This function is called by the simulator to save the predictor state into a warmup snapshot (-S), or to restore it
+// from one (-s) right after beginCondDirPredictor(). Every member that predictions depend on is passed to s.io(), in
+// the same order in both cases (see lib/snapshot.h); s.loading() tells which case it is.
+// Optional: by default (lib/default_hooks.cc), -S, -s and -e stop with an error.
+//
+class snapshot_t;
+extern void snapshot_cond_dir_predictor(snapshot_t& s);
+
+//
+// dump_cond_dir_predictor(snapshot_t& s)
+//
+// This function is called by the simulator to write the canonical form of the predictor state, which the lockstep
+// validation (-l) compares with that of a reference implementation: what the predictions and the training depend on,
+// passed to s.io() in a fixed order whatever the layout of the tables in memory, without the checkpoints in flight or
+// the statistics. Optional: by default (lib/default_hooks.cc), the snapshot (snapshot_cond_dir_predictor()) is compared.
+//
+extern void dump_cond_dir_predictor(snapshot_t& s);
+
+//
+// freeze_cond_dir_predictor()
+//
+// This function is called by the simulator for inference-only evaluation (-e), once the trained state has been
+// restored from a snapshot with snapshot_cond_dir_predictor(), before beginCondDirPredictor() and any simulation.
+// From then on the predictor must no longer write its tables, only its histories and checkpoints: its updates become
+// no-ops. The checkpoints restored with the state are of another run, and have to be dropped.
+// Returns false if the predictor does not support it, as by default (lib/default_hooks.cc).
+//
+extern bool freeze_cond_dir_predictor();
+
 //
 // endCondDirPredictor()
 //
@@ -10,7 +10,20 @@
 #include <unordered_map>
 #include <vector>
 #include <array>
+#include <type_traits>
 #include <iostream>
+#include "lib/checkpoint_ring.h"
+#include "lib/log_ring.h"
+#include "lib/branch_profile.h"
+#include "lib/branch_dataset.h"
+#include "lib/local_history.h"
+#include "lib/event_trace.h"
+#include "lib/table_heatmap.h"
+#include "lib/huge_arena.h"
+#include "lib/sparse_table.h"
+#include "lib/parameters.h"
+#include "lib/simd_dispatch.h"
+#include "cbp_global_history.h"
 
 
 //parameters of the loop predictor
@@ -25,94 +38,87 @@
 //To get the predictor storage budget on stderr  uncomment the next line
 //#define PRINTSIZE
 
-#define SC          // 8.2 % if TAGE alone
-#define IMLI            // 0.2 %
-#define LOCALH
-
-#ifdef LOCALH           // 2.7 %
-#define LOOPPREDICTOR   //loop predictor enable
-#define LOCALS          //enable the 2nd local history
-#define LOCALT          //enables the 3rd local history
-#endif
-
+// Components and sizing of a TAGE-SC-L configuration, given as the template argument of CBP2016_TAGE_SC_L.
+// The default is the CBP2016 submission; a variant derives from it and overrides some of the members, so that
+// several variants can be compiled into the same binary.
+struct tage_sc_l_config_t
+{
+    static constexpr bool SC = true;                // 8.2 % if TAGE alone
+    static constexpr bool IMLI = true;              // 0.2 %
+    static constexpr bool LOCALH = true;            // 2.7 %
+    // only with LOCALH
+    static constexpr bool LOOPPREDICTOR = true;     //loop predictor enable
+    static constexpr bool LOCALS = true;            //enable the 2nd local history
+    static constexpr bool LOCALT = true;            //enables the 3rd local history
+
+    //use geometric history length
+    static constexpr int NHIST = 36;                // twice the number of different histories
+    static constexpr int NBANKLOW = 10;             // number of banks in the shared bank-interleaved for the low history lengths
+    static constexpr int NBANKHIGH = 20;            // number of banks in the shared bank-interleaved for the  history lengths
+    static constexpr int BORN = 13;                 // below BORN in the table for low history lengths, >= BORN in the table for high history lengths,
+    // we use 2-way associativity for the medium history lengths
+    static constexpr int BORNINFASSOC = 9;          //2 -way assoc for those banks 0.4 %
+    static constexpr int BORNSUPASSOC = 23;
+    /*in practice 2 bits or 3 bits par branch: around 1200 cond. branchs*/
+    static constexpr int MINHIST = 6;               //not optimized so far
+    static constexpr int MAXHIST = 3000;
+    static constexpr int LOGG = 10;                 /* logsize of the  banks in the  tagged TAGE tables */
+    static constexpr int TBITS = 8;                 //minimum width of the tags  (low history lengths), +4 for high history lengths
+    static constexpr int LOGB = 13;                 // log of number of entries in bimodal predictor
+    static constexpr bool PACKED_TAGE = true;       // packed_gentry/packed_bentry tables instead of gentry/bentry
+    static constexpr bool PREFETCH = false;         // prefetch() hints the tables from the fetch of each instruction
+    static constexpr bool SPARSE_TAGE = false;      // tagged tables in a sparse_table_t, touched pages only (limit studies)
+    // 0: each checkpoint holds the TAGE indices and tags of its branch. n: one checkpoint of the folded histories per n
+    // predicted branches, the indices of the others rebuilt at update from it and the history bits pushed since.
+    static constexpr int CKPT_GROUP = 0;
+
+    // Bias filter in front of TAGE-SC-L: a tagged table of the branches seen going the same direction (1 << BFCWIDTH) - 1
+    // times in a row, which it predicts alone, with neither a TAGE, SC nor loop lookup nor their training.
+    static constexpr bool BIAS_FILTER = false;
+    static constexpr int LOGBF = 10;                // log of number of entries in the bias filter
+    static constexpr int BFTBITS = 10;              // tag width in the bias filter
+    static constexpr int BFCWIDTH = 5;              // streak counter width in the bias filter
+
+    //The three BIAS tables in the SC component
+    //We play with the TAGE  confidence here, with the number of the hitting bank
+    static constexpr int LOGBIAS = 8;
+
+    //In all th GEHL components, the two tables with the shortest history lengths have only half of the entries.
+
+    // IMLI-SIC -> Micro 2015  paper: a big disappointment on  CBP2016 traces
+    static constexpr int LOGINB = 8;                // 128-entry
+    static constexpr int INB = 1;
+    static constexpr int LOGIMNB = 9;               // 2* 256 -entry
+    static constexpr int IMNB = 2;
+
+    //global branch GEHL
+    static constexpr int LOGGNB = 10;               // 1 1K + 2 * 512-entry tables
+    static constexpr int GNB = 3;
+
+    //variation on global branch history
+    static constexpr int PNB = 3;
+    static constexpr int LOGPNB = 9;                // 1 1K + 2 * 512-entry tables
+
+    //first local history
+    static constexpr int LOGLNB = 10;               // 1 1K + 2 * 512-entry tables
+    static constexpr int LNB = 3;
+    static constexpr int LOGLOCAL = 8;
+
+    // second local history
+    static constexpr int LOGSNB = 9;                // 1 1K + 2 * 512-entry tables
+    static constexpr int SNB = 3;
+    static constexpr int LOGSECLOCAL = 4;
+
+    //third local history
+    static constexpr int LOGTNB = 10;               // 2 * 512-entry tables
+    static constexpr int TNB = 2;
+    static constexpr int NTLOCAL = 16;
+};
 
 
 //The statistical corrector components
 
 #define PERCWIDTH 6     //Statistical corrector  counter width 5 -> 6 : 0.6 %
-//The three BIAS tables in the SC component
-//We play with the TAGE  confidence here, with the number of the hitting bank
-#define LOGBIAS 8
-int8_t Bias[(1 << LOGBIAS)];
-int8_t BiasSK[(1 << LOGBIAS)];
-int8_t BiasBank[(1 << LOGBIAS)];
-
-//In all th GEHL components, the two tables with the shortest history lengths have only half of the entries.
-
-// IMLI-SIC -> Micro 2015  paper: a big disappointment on  CBP2016 traces
-#ifdef IMLI
-#define LOGINB 8        // 128-entry
-#define INB 1
-int Im[INB] = { 8 };
-int8_t IGEHLA[INB][(1 << LOGINB)] = { {0} };
-
-int8_t *IGEHL[INB];
-
-#define LOGIMNB 9       // 2* 256 -entry
-#define IMNB 2
-
-int IMm[IMNB] = { 10, 4 };
-int8_t IMGEHLA[IMNB][(1 << LOGIMNB)] = { {0} };
-
-int8_t *IMGEHL[IMNB];
-
-#endif
-
-//global branch GEHL
-#define LOGGNB 10       // 1 1K + 2 * 512-entry tables
-#define GNB 3
-int Gm[GNB] = { 40, 24, 10 };
-int8_t GGEHLA[GNB][(1 << LOGGNB)] = { {0} };
-
-int8_t *GGEHL[GNB];
-
-//variation on global branch history
-#define PNB 3
-#define LOGPNB 9        // 1 1K + 2 * 512-entry tables
-int Pm[PNB] = { 25, 16, 9 };
-int8_t PGEHLA[PNB][(1 << LOGPNB)] = { {0} };
-
-int8_t *PGEHL[PNB];
-
-//first local history
-#define LOGLNB  10      // 1 1K + 2 * 512-entry tables
-#define LNB 3
-int Lm[LNB] = { 11, 6, 3 };
-int8_t LGEHLA[LNB][(1 << LOGLNB)] = { {0} };
-
-int8_t *LGEHL[LNB];
-#define  LOGLOCAL 8
-#define NLOCAL (1<<LOGLOCAL)
-
-// second local history
-#define LOGSNB 9        // 1 1K + 2 * 512-entry tables
-#define SNB 3
-int Sm[SNB] = { 16, 11, 6 };
-int8_t SGEHLA[SNB][(1 << LOGSNB)] = { {0} };
-
-int8_t *SGEHL[SNB];
-#define LOGSECLOCAL 4
-#define NSECLOCAL (1<<LOGSECLOCAL)  //Number of second local histories
-
-//third local history
-#define LOGTNB 10       // 2 * 512-entry tables
-#define TNB 2
-int Tm[TNB] = { 9, 4 };
-int8_t TGEHLA[TNB][(1 << LOGTNB)] = { {0} };
-
-int8_t *TGEHL[TNB];
-#define NTLOCAL 16
-
 
 // playing with putting more weights (x2)  on some of the SC components
 // playing on using different update thresholds on SC
@@ -126,24 +132,9 @@ int8_t *TGEHL[TNB];
 #define LOGSIZEUP 0
 #endif
 #define LOGSIZEUPS  (LOGSIZEUP/2)
-int updatethreshold;
-int Pupdatethreshold[(1 << LOGSIZEUP)]; //size is fixed by LOGSIZEUP
 #define INDUPD (PC ^ (PC >>2)) & ((1 << LOGSIZEUP) - 1)
 #define INDUPDS ((PC ^ (PC >>2)) & ((1 << (LOGSIZEUPS)) - 1))
-int8_t WG[(1 << LOGSIZEUPS)];
-int8_t WL[(1 << LOGSIZEUPS)];
-int8_t WS[(1 << LOGSIZEUPS)];
-int8_t WT[(1 << LOGSIZEUPS)];
-int8_t WP[(1 << LOGSIZEUPS)];
-int8_t WI[(1 << LOGSIZEUPS)];
-int8_t WIM[(1 << LOGSIZEUPS)];
-int8_t WB[(1 << LOGSIZEUPS)];
 #define EWIDTH 6
-int LSUM;
-
-// The two counters used to choose between TAGE and SC on Low Conf SC
-int8_t FirstH, SecondH;
-bool MedConf;           // is the TAGE prediction medium confidence
 
 
 #define CONFWIDTH 7     //for the counters in the choser
@@ -187,57 +178,52 @@ class gentry            // TAGE global table entry
 };
 
 #define  POWER
-//use geometric history length
-
-#define NHIST 36        // twice the number of different histories
-
-#define NBANKLOW 10     // number of banks in the shared bank-interleaved for the low history lengths
-#define NBANKHIGH 20        // number of banks in the shared bank-interleaved for the  history lengths
-
-int SizeTable[NHIST + 1];
-
-
-#define BORN 13         // below BORN in the table for low history lengths, >= BORN in the table for high history lengths,
-
-// we use 2-way associativity for the medium history lengths
-#define BORNINFASSOC 9      //2 -way assoc for those banks 0.4 %
-#define BORNSUPASSOC 23
-
-/*in practice 2 bits or 3 bits par branch: around 1200 cond. branchs*/
-
-#define MINHIST 6       //not optimized so far
-#define MAXHIST 3000
-
-
-#define LOGG 10         /* logsize of the  banks in the  tagged TAGE tables */
-#define TBITS 8         //minimum width of the tags  (low history lengths), +4 for high history lengths
-
-
-bool NOSKIP[NHIST + 1];     // to manage the associativity for different history lengths
-
-
 
 #define NNN 1           // number of extra entries allocated on a TAGE misprediction (1+NNN)
 #define HYSTSHIFT 2     // bimodal hysteresis shared by 4 entries
-#define LOGB 13         // log of number of entries in bimodal predictor
 
 
 #define PHISTWIDTH 27       // width of the path history used in TAGE
 #define UWIDTH 1        // u counter width on TAGE (2 bits not worth the effort for a 512 Kbits predictor 0.2 %)
 #define CWIDTH 3        // predictor counter width on the TAGE tagged tables
+#define UCHUNKLOG 6     // entries per u aging chunk, log2
+
+// Packed layouts of the TAGE entries, selected by PACKED_TAGE in the configuration: the fields are the same as in
+// gentry and bentry, cut down to their widths, so that the tables take 6x less host cache for identical predictions.
+#define PACKEDTAGBITS 12        // tag field of packed_gentry, at least the widest tag (TBITS + 4)
+class packed_gentry     // TAGE global table entry, 16 bits
+{
+    public:
+        uint16_t tag : PACKEDTAGBITS;
+        uint16_t u : UWIDTH;
+        int16_t ctr : CWIDTH;
+
+        packed_gentry ()
+        : tag (0), u (0), ctr (0)
+        {
+        }
+};
+static_assert (sizeof (packed_gentry) == sizeof (uint16_t), "packed_gentry fields must fit in 16 bits");
+
+class packed_bentry     // TAGE bimodal table entry, 8 bits
+{
+    public:
+        uint8_t hyst : 1;
+        uint8_t pred : 1;
+
+        packed_bentry ()
+        : hyst (1), pred (0)
+        {
+        }
+};
 
 
 //the counter(s) to chose between longest match and alternate prediction on TAGE when weak counters
 #define LOGSIZEUSEALT 4
-bool AltConf;           // Confidence on the alternate prediction
 #define ALTWIDTH 5
 #define SIZEUSEALT  (1<<(LOGSIZEUSEALT))
 #define INDUSEALT (((((HitBank-1)/8)<<1)+AltConf) % (SIZEUSEALT-1))
-int8_t use_alt_on_na[SIZEUSEALT];
-//very marginal benefit
-int8_t BIM;
 
-int TICK;           // for the reset of the u counter
 //uint8_t ghist[HISTBUFFERLENGTH];
 //int ptghist;
 //uint64_t phist;      //path history
@@ -256,6 +242,17 @@ class lentry            //loop predictor entry
         bool dir;           // 1 bit
 
         //39 bits per entry    
+        // field by field: the padding byte is not state
+        void snapshot (snapshot_t& s)
+        {
+            s.io (NbIter);
+            s.io (confid);
+            s.io (CurrentIter);
+            s.io (TAG);
+            s.io (age);
+            s.io (dir);
+        }
+
         lentry ()
         {
             confid = 0;
@@ -267,180 +264,132 @@ class lentry            //loop predictor entry
         }
 };
 
-//For the TAGE predictor
-bentry *btable;         //bimodal TAGE table
-gentry *gtable[NHIST + 1];  // tagged TAGE tables
 //lentry *ltable;
-int m[NHIST + 1];
-int TB[NHIST + 1];
-int logg[NHIST + 1];
-
-uint64_t Seed;           // for the pseudo-random number generator
 
-
-class folded_history
+class bfentry           // bias filter entry
 {
     public:
-        unsigned comp;
-        int CLENGTH;
-        int OLENGTH;
-        int OUTPOINT;
+        uint16_t tag;           // BFTBITS bits
+        uint8_t streak;         // BFCWIDTH bits: outcomes in dir in a row, saturating
+        bool dir;               // 1 bit
 
-        folded_history ()
+        bfentry ()
+        : tag (0), streak (0), dir (false)
         {
         }
-
-        void init (int original_length, int compressed_length)
-        {
-            comp = 0;
-            OLENGTH = original_length;
-            CLENGTH = compressed_length;
-            OUTPOINT = OLENGTH % CLENGTH;
-
-        }
-
-        void update (std::array<uint8_t, HISTBUFFERLENGTH>&h, int PT)
-        {
-            comp = (comp << 1) ^ h[PT & (HISTBUFFERLENGTH - 1)];
-            comp ^= h[(PT + OLENGTH) & (HISTBUFFERLENGTH - 1)] << OUTPOINT;
-            comp ^= (comp >> CLENGTH);
-            comp = (comp) & ((1 << CLENGTH) - 1);
-        }
 };
-using tage_index_t = std::array<folded_history, NHIST+1>;
-using tage_tag_t = std::array<folded_history, NHIST+1>;
-
 
-struct cbp_hist_t
+// The geometry of the tagged tables only depends on the configuration, so it is computed at compile time.
+// pow is not constexpr: x^y is evaluated as exp(y * log(x)) in long double, close enough to the libm pow for the
+// history lengths to round the same way.
+constexpr long double tage_const_log (long double x)
 {
-      // Begin Conventional Histories
-      uint64_t GHIST;
-      std::array<uint8_t, HISTBUFFERLENGTH> ghist;
-      uint64_t phist;      //path history
-      int ptghist;
-      tage_index_t ch_i;
-      std::array<tage_tag_t, 2> ch_t;
-
-      std::array<uint64_t, NLOCAL> L_shist;
-      std::array<uint64_t, NSECLOCAL> S_slhist;
-      std::array<uint64_t, NTLOCAL> T_slhist;
-
-      std::array<uint64_t, 256> IMHIST;
-      uint64_t IMLIcount;      // use to monitor the iteration number
-#ifdef LOOPPREDICTOR
-      std::vector<lentry> ltable;
-      int8_t WITHLOOP;
-#endif
-      cbp_hist_t()
-      {
-#ifdef LOOPPREDICTOR
-          ltable.resize(1 << (LOGL));
-          WITHLOOP = -1;
-#endif
-      }
-};
-
-
+    // x = 2^k * f with f in [1, 2), and log(f) = 2 * atanh((f - 1) / (f + 1))
+    int k = 0;
+    for (; x >= 2; k++)
+        x /= 2;
+    for (; x < 1; k--)
+        x *= 2;
+    const long double z = (x - 1) / (x + 1);
+    long double term = z;
+    long double sum = 0;
+    for (int n = 1; n < 64; n += 2)
+    {
+        sum += term / n;
+        term *= z * z;
+    }
+    return 2 * sum + k * 0.693147180559945309417232121458176568L;
+}
 
-int predictorsize ()
+constexpr long double tage_const_exp (long double x)
 {
-    int STORAGESIZE = 0;
-    int inter = 0;
-
-
-
-    STORAGESIZE +=
-        NBANKHIGH * (1 << (logg[BORN])) * (CWIDTH + UWIDTH + TB[BORN]);
-    STORAGESIZE += NBANKLOW * (1 << (logg[1])) * (CWIDTH + UWIDTH + TB[1]);
-
-    STORAGESIZE += (SIZEUSEALT) * ALTWIDTH;
-    STORAGESIZE += (1 << LOGB) + (1 << (LOGB - HYSTSHIFT));
-    STORAGESIZE += m[NHIST];
-    STORAGESIZE += PHISTWIDTH;
-    STORAGESIZE += 10;      //the TICK counter
-
-    fprintf (stderr, " (TAGE %d) ", STORAGESIZE);
-#ifdef SC
-#ifdef LOOPPREDICTOR
-
-    inter = (1 << LOGL) * (2 * WIDTHNBITERLOOP + LOOPTAG + 4 + 4 + 1);
-    fprintf (stderr, " (LOOP %d) ", inter);
-    STORAGESIZE += inter;
-#endif
-
-    inter += WIDTHRES;
-    inter = WIDTHRESP * ((1 << LOGSIZEUP)); //the update threshold counters
-    inter += 3 * EWIDTH * (1 << LOGSIZEUPS);    // the extra weight of the partial sums
-    inter += (PERCWIDTH) * 3 * (1 << (LOGBIAS));
-
-    inter +=
-        (GNB - 2) * (1 << (LOGGNB)) * (PERCWIDTH) +
-        (1 << (LOGGNB - 1)) * (2 * PERCWIDTH);
-    inter += Gm[0];     //global histories for SC
-    inter += (PNB - 2) * (1 << (LOGPNB)) * (PERCWIDTH) +
-        (1 << (LOGPNB - 1)) * (2 * PERCWIDTH);
-    //we use phist already counted for these tables
-
-#ifdef LOCALH
-    inter +=
-        (LNB - 2) * (1 << (LOGLNB)) * (PERCWIDTH) +
-        (1 << (LOGLNB - 1)) * (2 * PERCWIDTH);
-    inter += NLOCAL * Lm[0];
-    inter += EWIDTH * (1 << LOGSIZEUPS);
-#ifdef LOCALS
-    inter +=
-        (SNB - 2) * (1 << (LOGSNB)) * (PERCWIDTH) +
-        (1 << (LOGSNB - 1)) * (2 * PERCWIDTH);
-    inter += NSECLOCAL * (Sm[0]);
-    inter += EWIDTH * (1 << LOGSIZEUPS);
-
-#endif
-#ifdef LOCALT
-    inter +=
-        (TNB - 2) * (1 << (LOGTNB)) * (PERCWIDTH) +
-        (1 << (LOGTNB - 1)) * (2 * PERCWIDTH);
-    inter += NTLOCAL * Tm[0];
-    inter += EWIDTH * (1 << LOGSIZEUPS);
-#endif
-
-
-
-
-
-
-
-
-
-#endif
-
-
-
-#ifdef IMLI
-
-    inter += (1 << (LOGINB - 1)) * PERCWIDTH;
-    inter += Im[0];
+    // x = k * log(2) + r with |r| <= log(2) / 2
+    const long double LN2 = 0.693147180559945309417232121458176568L;
+    int k = (int) (x / LN2 + (x >= 0 ? 0.5L : -0.5L));
+    const long double r = x - k * LN2;
+    long double term = 1;
+    long double sum = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        term *= r / n;
+        sum += term;
+    }
+    for (; k > 0; k--)
+        sum *= 2;
+    for (; k < 0; k++)
+        sum /= 2;
+    return sum;
+}
 
-    inter += IMNB * (1 << (LOGIMNB - 1)) * PERCWIDTH;
-    inter += 2 * EWIDTH * (1 << LOGSIZEUPS);    // the extra weight of the partial sums
-    inter += 256 * IMm[0];
-#endif
-    inter += 2 * CONFWIDTH; //the 2 counters in the choser
-    STORAGESIZE += inter;
+// geometric history lengths, each shared by two banks
+template <class CFG>
+constexpr std::array<int, CFG::NHIST + 1> tage_history_lengths ()
+{
+    constexpr int NHIST = CFG::NHIST;
+    std::array<int, NHIST + 1> m = {};
+    m[1] = CFG::MINHIST;
+    m[NHIST / 2] = CFG::MAXHIST;
+    const long double LOGRATIO = tage_const_log ((long double) CFG::MAXHIST / (long double) CFG::MINHIST);
+    for (int i = 2; i <= NHIST / 2; i++)
+    {
+        m[i] =
+            (int) (((double) CFG::MINHIST *
+                        (double) tage_const_exp (LOGRATIO * (i - 1) / (((NHIST / 2) - 1)))) +
+                    0.5);
+    }
+    for (int i = NHIST; i > 1; i--)
+    {
+        m[i] = m[(i + 1) / 2];
+    }
+    return m;
+}
 
+template <class CFG>
+constexpr std::array<bool, CFG::NHIST + 1> tage_noskip ()
+{
+    constexpr int NHIST = CFG::NHIST;
+    std::array<bool, NHIST + 1> NOSKIP = {};
+    for (int i = 1; i <= NHIST; i++)
+    {
+        NOSKIP[i] = ((i - 1) & 1)
+            || ((i >= CFG::BORNINFASSOC) & (i < CFG::BORNSUPASSOC));
+    }
+    NOSKIP[4] = 0;
+    NOSKIP[NHIST - 2] = 0;
+    NOSKIP[8] = 0;
+    NOSKIP[NHIST - 6] = 0;
+    // just eliminate some extra tables (very very marginal)
+    return NOSKIP;
+}
 
-    fprintf (stderr, " (SC %d) ", inter);
-#endif
-#ifdef PRINTSIZE
-    fprintf (stderr, " (TOTAL %d bits %d Kbits) ", STORAGESIZE,
-            STORAGESIZE / 1024);
-    fprintf (stdout, " (TOTAL %d bits %d Kbits) ", STORAGESIZE,
-            STORAGESIZE / 1024);
-#endif
+template <size_t N>
+constexpr uint64_t tage_bank_mask (const std::array<bool, N>& banks)
+{
+    uint64_t mask = 0;
+    for (size_t i = 1; i < N; i++)
+        mask |= (uint64_t) banks[i] << i;
+    return mask;
+}
 
+template <class CFG>
+constexpr std::array<int, CFG::NHIST + 1> tage_tag_widths ()
+{
+    std::array<int, CFG::NHIST + 1> TB = {};
+    for (int i = 1; i <= CFG::NHIST; i++)
+        TB[i] = CFG::TBITS + 4 * (i >= CFG::BORN);
+    return TB;
+}
 
-    return (STORAGESIZE);
+template <class CFG>
+constexpr std::array<int, CFG::NHIST + 1> tage_bank_logsizes ()
+{
+    std::array<int, CFG::NHIST + 1> logg = {};
+    for (int i = 1; i <= CFG::NHIST; i++)
+        logg[i] = CFG::LOGG;
+    return logg;
 }
 
+
 // The interface to the simulator is defined in cond_branch_predictor_interface.cc
 // This predictor is a modified version of CBP2016 Tage.
 // The CBP Tage predicted and updated the predictor right away.
@@ -449,18 +398,210 @@ int predictorsize ()
 // * spec_update -> This is used for updating the history. It provides the actual direction of the branch. This is invoked for all branches.
 // * notify_instr_execute_resolve -> This hook is used to update the predictor. This is invoked for all the instructions and provides all information available at execute.
 //    * Note: The history at update is different than history at predict. To ensure that the predictor is getting trained correctly, 
-//    at predict, we checkpoint the history in an unordered_map(pred_time_histories) using unique identifying id of the instruction. 
+//    at predict, we checkpoint the history in a checkpoint_ring_t(pred_time_histories) indexed by the sequence number of the instruction. 
 //    When updating the predicor, we recover the prediction time history.
 // There are a couple of other hooks that aren't used in the current implementation, but are available to exploit:
 // * notify_instr_decode 
 // * notify_instr_commit
+template <class CFG = tage_sc_l_config_t>
 class CBP2016_TAGE_SC_L
 {
     public:
+        // components and sizing
+        static constexpr bool SC = CFG::SC;
+        static constexpr bool IMLI = CFG::IMLI;
+        static constexpr bool LOCALH = CFG::LOCALH;
+        static constexpr bool LOOPPREDICTOR = CFG::LOCALH && CFG::LOOPPREDICTOR;
+        static constexpr bool LOCALS = CFG::LOCALH && CFG::LOCALS;
+        static constexpr bool LOCALT = CFG::LOCALH && CFG::LOCALT;
+
+        static constexpr int NHIST = CFG::NHIST;
+        static constexpr int NBANKLOW = CFG::NBANKLOW;
+        static constexpr int NBANKHIGH = CFG::NBANKHIGH;
+        static constexpr int BORN = CFG::BORN;
+        static constexpr int LOGG = CFG::LOGG;
+        static constexpr int LOGB = CFG::LOGB;
+        static constexpr int LOGBF = CFG::LOGBF;
+        static constexpr int CKPT_GROUP = CFG::CKPT_GROUP;
+        static constexpr int BFMAX = (1 << CFG::BFCWIDTH) - 1;     // streak from which the bias filter predicts
+        static_assert (CFG::BFTBITS <= 16 && CFG::BFCWIDTH <= 8, "the bias filter fields must fit in bfentry");
+        static_assert (!CFG::PACKED_TAGE || CFG::TBITS + 4 <= PACKEDTAGBITS, "the tags must fit in packed_gentry");
+        static_assert (NHIST < 64, "the bank hit mask holds one bit per bank");
+        static_assert (LOGG >= UCHUNKLOG, "the u aging chunks must not straddle two banks");
+        static_assert (CFG::MAXHIST < HISTBUFFERLENGTH, "the history buffer must hold the longest history");
+
+        static constexpr int LOGBIAS = CFG::LOGBIAS;
+        static constexpr int LOGINB = CFG::LOGINB;
+        static constexpr int INB = CFG::INB;
+        static constexpr int LOGIMNB = CFG::LOGIMNB;
+        static constexpr int IMNB = CFG::IMNB;
+        static constexpr int LOGGNB = CFG::LOGGNB;
+        static constexpr int GNB = CFG::GNB;
+        static constexpr int PNB = CFG::PNB;
+        static constexpr int LOGPNB = CFG::LOGPNB;
+        static constexpr int LOGLNB = CFG::LOGLNB;
+        static constexpr int LNB = CFG::LNB;
+        static constexpr int NLOCAL = 1 << CFG::LOGLOCAL;
+        static constexpr int LOGSNB = CFG::LOGSNB;
+        static constexpr int SNB = CFG::SNB;
+        static constexpr int NSECLOCAL = 1 << CFG::LOGSECLOCAL;  //Number of second local histories
+        static constexpr int LOGTNB = CFG::LOGTNB;
+        static constexpr int TNB = CFG::TNB;
+        static constexpr int NTLOCAL = CFG::NTLOCAL;
+
+        // geometry of the tagged tables
+        static constexpr std::array<int, NHIST + 1> m = tage_history_lengths<CFG> ();
+        static constexpr std::array<bool, NHIST + 1> NOSKIP = tage_noskip<CFG> ();  // to manage the associativity for different history lengths
+        static constexpr uint64_t NOSKIPMASK = tage_bank_mask (NOSKIP);             // NOSKIP as a bitmask over the banks
+        static constexpr std::array<int, NHIST + 1> TB = tage_tag_widths<CFG> ();
+        static constexpr std::array<int, NHIST + 1> logg = tage_bank_logsizes<CFG> ();
+
+        static_assert (cbp_global_history_t::BUFFER_LENGTH == HISTBUFFERLENGTH, "TAGE-SC-L reads the shared history buffer");
+        static_assert (cbp_global_history_t::PATH_WIDTH == PHISTWIDTH, "TAGE-SC-L reads the shared path history");
+        using loop_table_t = std::array<lentry, LOOPPREDICTOR ? (1 << LOGL) : 0>;
+
+
+        struct cbp_hist_t
+        {
+            // Begin Conventional Histories
+            // the global, path and folded histories are those of the shared global_hist
+            uint64_t GHIST;
+
+            local_history_table_t<NLOCAL, 2> L_shist;
+            local_history_table_t<NSECLOCAL, 5> S_slhist;
+            local_history_table_t<NTLOCAL, LOGTNB> T_slhist;   // different hash for the history
+
+            std::array<uint64_t, 256> IMHIST;
+            uint64_t IMLIcount;      // use to monitor the iteration number
+            int8_t WITHLOOP;
+            cbp_hist_t()
+            {
+                WITHLOOP = -1;
+            }
+        };
+
+        // With CKPT_GROUP, what the TAGE indices and tags of a checkpoint are rebuilt from: the folded histories of
+        // base FBASE, brought up to the prediction by the history bits pushed up to FPOS, and the path history.
+        struct fold_ref_t
+        {
+            uint64_t FBASE;
+            uint64_t FPOS;
+            uint32_t PHIST;
+        };
+
+        // Prediction-time checkpoint of cbp_hist_t.
+        // Only the state read back by predict_using_given_hist() and update() is kept. The table indices and tags only depend
+        // on the PC and the history, so they are computed once at predict from the running history and stored here instead
+        // of the histories they hash (folded histories, path and local histories), for update to reuse. What depends on the
+        // table contents (hits, counters, sums) is still looked up again at update, as other branches may have trained the
+        // tables since.
+        struct cbp_checkpoint_t
+        {
+            uint64_t GHIST;      // the global SC component also hashes pred_inter, so it is indexed at each lookup
+
+            std::array<int, CKPT_GROUP ? 0 : NHIST + 1> GI;      // TAGE table indices
+            std::array<uint, CKPT_GROUP ? 0 : NHIST + 1> GTAG;   // TAGE partial tags
+            int BI;                             // bimodal index
+            std::array<fold_ref_t, CKPT_GROUP ? 1 : 0> FREF;
+
+            // indices of the other SC components
+            std::array<uint16_t, PNB> PGI;
+            std::array<uint16_t, LNB> LGI;
+            std::array<uint16_t, SNB> SGI;
+            std::array<uint16_t, TNB> TGI;
+            std::array<uint16_t, IMLI ? IMNB : 0> IMGI;
+            std::array<uint16_t, IMLI ? INB : 0> IGI;
+
+            // the loop table itself is not copied: LPOS is the position of the repair log when the checkpoint was
+            // taken, from which the table is rolled back on a misprediction
+            uint64_t LPOS;
+            bool predloop;      // loop prediction at predict time
+            int LHIT;
+            bool LVALID;
+            int8_t WITHLOOP;
+
+            // for the misprediction profile
+            branch_provider_t provider;
+            uint8_t hit_bank;
+
+            bool filtered;      // predicted by the bias filter: nothing else above was set
+        };
+
+        // repair log record: the value of a loop table entry before a speculative update overwrote it
+        struct loop_undo_t
+        {
+            uint8_t index;
+            lentry old;
+
+            void snapshot (snapshot_t& s)
+            {
+                s.io (index);
+                s.io (old);
+            }
+        };
+
+        // With CKPT_GROUP, the folded histories of TAGE at the prediction that started a group of checkpoints, and the
+        // position of the next pushed history bit then.
+        struct fold_base_t
+        {
+            std::array<std::array<unsigned, NHIST + 1>, 3> comp;
+            uint64_t PUSHPOS;
+
+            void snapshot (snapshot_t& s)
+            {
+                s.io (comp);
+                s.io (PUSHPOS);
+            }
+        };
+
+        // a history bit pushed into the global history: the bit, and the bit leaving each history length m[i] (bit i)
+        struct fold_push_t
+        {
+            uint64_t out;
+            uint8_t in;
+
+            void snapshot (snapshot_t& s)
+            {
+                s.io (out);
+                s.io (in);
+            }
+        };
+
+        // a checkpoint that still refers to a base, in prediction order
+        struct fold_ckpt_ref_t
+        {
+            uint64_t seq_no;
+            uint8_t piece;
+            uint64_t FBASE;
+
+            void snapshot (snapshot_t& s)
+            {
+                s.io (seq_no);
+                s.io (piece);
+                s.io (FBASE);
+            }
+        };
+
+        // a checkpoint that still refers to the repair log, in prediction order
+        struct loop_ckpt_ref_t
+        {
+            uint64_t seq_no;
+            uint8_t piece;
+            uint64_t LPOS;
+
+            void snapshot (snapshot_t& s)
+            {
+                s.io (seq_no);
+                s.io (piece);
+                s.io (LPOS);
+            }
+        };
+
         //state set by predict
         int GI[NHIST + 1];      // indexes to the different tables are computed only once  
         uint GTAG[NHIST + 1];   // tags for the different tables are computed only once  
         int BI;             // index of the bimodal table
+        uint16_t GGI[GNB];  // indices of the global SC component
 
         //
         int THRES;
@@ -480,104 +621,548 @@ class CBP2016_TAGE_SC_L
         bool LongestMatchPred;
         int HitBank;            // longest matching bank
         int AltBank;            // alternate matching bank
+        bool UseAlt;            // tage_pred is the alternate prediction, HitBank being newly allocated
         bool pred_inter;
 
         bool LowConf;
         bool HighConf;
 
+        // Tables and global state of the predictor. They are members rather than file-scope globals, so that instances
+        // are independent of each other.
+
+        // The statistical corrector components
+        int8_t Bias[(1 << LOGBIAS)] = {};
+        int8_t BiasSK[(1 << LOGBIAS)] = {};
+        int8_t BiasBank[(1 << LOGBIAS)] = {};
+
+        int Im[INB] = { 8 };
+        int8_t IGEHLA[INB][(1 << LOGINB)] = { {0} };
+        int8_t *IGEHL[INB] = {};
+        int IMm[IMNB] = { 10, 4 };
+        int8_t IMGEHLA[IMNB][(1 << LOGIMNB)] = { {0} };
+        int8_t *IMGEHL[IMNB] = {};
+
+        int Gm[GNB] = { 40, 24, 10 };
+        int8_t GGEHLA[GNB][(1 << LOGGNB)] = { {0} };
+        int8_t *GGEHL[GNB] = {};
+        int Pm[PNB] = { 25, 16, 9 };
+        int8_t PGEHLA[PNB][(1 << LOGPNB)] = { {0} };
+        int8_t *PGEHL[PNB] = {};
+        int Lm[LNB] = { 11, 6, 3 };
+        int8_t LGEHLA[LNB][(1 << LOGLNB)] = { {0} };
+        int8_t *LGEHL[LNB] = {};
+        int Sm[SNB] = { 16, 11, 6 };
+        int8_t SGEHLA[SNB][(1 << LOGSNB)] = { {0} };
+        int8_t *SGEHL[SNB] = {};
+        int Tm[TNB] = { 9, 4 };
+        int8_t TGEHLA[TNB][(1 << LOGTNB)] = { {0} };
+        int8_t *TGEHL[TNB] = {};
+
+        //update threshold for the statistical corrector
+        int updatethreshold = 0;
+        int Pupdatethreshold[(1 << LOGSIZEUP)] = {};  //size is fixed by LOGSIZEUP
+        int8_t WG[(1 << LOGSIZEUPS)] = {};
+        int8_t WL[(1 << LOGSIZEUPS)] = {};
+        int8_t WS[(1 << LOGSIZEUPS)] = {};
+        int8_t WT[(1 << LOGSIZEUPS)] = {};
+        int8_t WP[(1 << LOGSIZEUPS)] = {};
+        int8_t WI[(1 << LOGSIZEUPS)] = {};
+        int8_t WIM[(1 << LOGSIZEUPS)] = {};
+        int8_t WB[(1 << LOGSIZEUPS)] = {};
+        int LSUM = 0;
+
+        // The two counters used to choose between TAGE and SC on Low Conf SC
+        int8_t FirstH = 0;
+        int8_t SecondH = 0;
+        bool MedConf = false;  // is the TAGE prediction medium confidence
+
+        //For the TAGE predictor
+        using gentry_t = std::conditional_t<CFG::PACKED_TAGE, packed_gentry, gentry>;
+        using bentry_t = std::conditional_t<CFG::PACKED_TAGE, packed_bentry, bentry>;
+        // With SPARSE_TAGE, pages of one u aging chunk, so that age_u() walks a chunk in place.
+        using gtable_t = std::conditional_t<CFG::SPARSE_TAGE, sparse_table_t<gentry_t, UCHUNKLOG>, gentry_t *>;
+        bentry_t *btable = nullptr;  //bimodal TAGE table
+        gtable_t gtable[NHIST + 1] = {};  // tagged TAGE tables
+        int SizeTable[NHIST + 1] = {};
+        bool AltConf = false;  // Confidence on the alternate prediction
+        int8_t use_alt_on_na[SIZEUSEALT] = {};
+        int8_t BIM = 0;  //very marginal benefit
+        int TICK = 0;  // for the reset of the u counter
+        // Lazy aging of the u counters: a reset halves the u counters of every tagged entry, a pass over the whole of
+        // gtable. Resets only count in UEpoch instead, and each chunk of 1 << UCHUNKLOG entries records the UEpoch it
+        // last caught up with in UStamp (aliased per bank like gtable). Only the update reads or writes u, after
+        // age_u() applies the resets its chunk missed, so the counters read exactly as with the eager resets.
+        uint32_t UEpoch = 0;
+        uint32_t *UStamp[NHIST + 1] = {};
+        uint64_t Seed = 0;  // for the pseudo-random number generator
+
         // checkpointed in history
         //int8_t WITHLOOP;    // counter to monitor whether or not loop prediction is beneficial
 
+        // The loop table is updated speculatively and only its repair log is checkpointed: every entry written by
+        // loopupdate() is logged first, and records are released once no live checkpoint is older than them.
+        loop_table_t ltable;
+        log_ring_t<loop_undo_t> loop_log;
+        log_ring_t<loop_ckpt_ref_t> loop_ckpts;
+        // The bias filter (BIAS_FILTER), with its conditional branch lookups, those it predicted and those it
+        // mispredicted, reported at terminate().
+        std::array<bfentry, CFG::BIAS_FILTER ? (1 << LOGBF) : 0> bftable;
+        uint64_t bf_lookups = 0;
+        uint64_t bf_served = 0;
+        uint64_t bf_mispredicted = 0;
+
+        // global history shared with the other predictors, advanced by its owner after history_update()
+        // utility for computing TAGE indices (register 0) and tags (registers 1 and 2): folded rows fold_row + bank
+        const cbp_global_history_t& global_hist;
+        int fold_row;
+
         cbp_hist_t active_hist; // running history always updated accurately
         // checkpointed history. Can be accesed using the inst-id(seq_no/piece)
-        std::unordered_map<uint64_t/*key*/, cbp_hist_t/*val*/> pred_time_histories;
-
-        CBP2016_TAGE_SC_L (void)
+        checkpoint_ring_t<cbp_checkpoint_t> pred_time_histories;
+        // CKPT_GROUP: the bases of the checkpoint groups and the history bits pushed since the oldest, released like the
+        // loop repair log (fold_ckpts refers to the bases), and the folded histories the indices are rebuilt in.
+        // fold_pt is the position in the global history buffer up to which the pushed bits are logged.
+        log_ring_t<fold_base_t> fold_bases;
+        log_ring_t<fold_push_t> fold_pushes;
+        log_ring_t<fold_ckpt_ref_t> fold_ckpts;
+        folded_history_set_t<CKPT_GROUP ? NHIST + 1 : 1, 3> fold_replay;
+        int fold_pt = 0;
+        int fold_group = 0;         // branches predicted in the current group
+        uint64_t fold_num_ckpts = 0, fold_num_bases = 0, fold_num_pushes = 0;
+        // executions and mispredictions of each conditional branch, by provider, written at terminate() (-H)
+        branch_profile_t profile;
+        // every conditional branch with its outcome, its provider and its history, for offline training (-x)
+        branch_dataset_t dataset;
+        // inference only (-e), after freeze(): the tables are no longer written
+        bool frozen = false;
+        // sampled lookups of the tables (CBP_TABLE_HEATMAP), with the ids of the tables in it: the tagged banks by bank,
+        // the SC tables from hm_sc on, in the order heatmap_lookups() visits them
+        table_heatmap_t heatmap;
+        int hm_bank[NHIST + 1] = {};
+        int hm_btable = 0, hm_ltable = 0, hm_sc = 0;
+
+        CBP2016_TAGE_SC_L (cbp_global_history_t& shared_hist)
+        : global_hist (shared_hist)
         {
+            fold_row = shared_hist.reserve_folded (NHIST + 1);
+            for (int i = 1; i <= NHIST; i++)
+            {
+                shared_hist.folded.init (fold_row + i, 0, m[i], (logg[i]));
+                shared_hist.folded.init (fold_row + i, 1, m[i], TB[i]);
+                shared_hist.folded.init (fold_row + i, 2, m[i], TB[i] - 1);
+                if constexpr (CKPT_GROUP)
+                {
+                    fold_replay.init (i, 0, m[i], (logg[i]));
+                    fold_replay.init (i, 1, m[i], TB[i]);
+                    fold_replay.init (i, 2, m[i], TB[i] - 1);
+                }
+            }
+            fold_pt = shared_hist.ptghist;
             init_histories (active_hist);
 #ifdef PRINTSIZE
             predictorsize ();
 #endif
         }
 
-        void setup()
+        ~CBP2016_TAGE_SC_L ()
         {
+            if constexpr (CFG::SPARSE_TAGE)
+            {
+                sparse_delete_table (gtable[1], SizeTable[1]);
+                sparse_delete_table (gtable[BORN], SizeTable[BORN]);
+            }
+            else
+            {
+                huge_delete_array (gtable[1], SizeTable[1]);
+                huge_delete_array (gtable[BORN], SizeTable[BORN]);
+            }
+            huge_delete_array (UStamp[1], SizeTable[1] >> UCHUNKLOG);
+            huge_delete_array (UStamp[BORN], SizeTable[BORN] >> UCHUNKLOG);
+            huge_delete_array (btable, 1 << LOGB);
         }
 
-        void terminate()
+        // The *GEHL pointers point into the instance's own tables.
+        CBP2016_TAGE_SC_L (const CBP2016_TAGE_SC_L&) = delete;
+        CBP2016_TAGE_SC_L& operator= (const CBP2016_TAGE_SC_L&) = delete;
+
+        int predictorsize ()
         {
+            int STORAGESIZE = 0;
+            int inter = 0;
+
+
+
+            STORAGESIZE +=
+                NBANKHIGH * (1 << (logg[BORN])) * (CWIDTH + UWIDTH + TB[BORN]);
+            STORAGESIZE += NBANKLOW * (1 << (logg[1])) * (CWIDTH + UWIDTH + TB[1]);
+
+            STORAGESIZE += (SIZEUSEALT) * ALTWIDTH;
+            STORAGESIZE += (1 << LOGB) + (1 << (LOGB - HYSTSHIFT));
+            STORAGESIZE += m[NHIST];
+            STORAGESIZE += PHISTWIDTH;
+            STORAGESIZE += 10;      //the TICK counter
+
+            fprintf (stderr, " (TAGE %d) ", STORAGESIZE);
+            if constexpr (SC)
+            {
+                if constexpr (LOOPPREDICTOR)
+                {
+
+                    inter = (1 << LOGL) * (2 * WIDTHNBITERLOOP + LOOPTAG + 4 + 4 + 1);
+                    fprintf (stderr, " (LOOP %d) ", inter);
+                    STORAGESIZE += inter;
+                }
+
+                inter += WIDTHRES;
+                inter = WIDTHRESP * ((1 << LOGSIZEUP)); //the update threshold counters
+                inter += 3 * EWIDTH * (1 << LOGSIZEUPS);    // the extra weight of the partial sums
+                inter += (PERCWIDTH) * 3 * (1 << (LOGBIAS));
+
+                inter +=
+                    (GNB - 2) * (1 << (LOGGNB)) * (PERCWIDTH) +
+                    (1 << (LOGGNB - 1)) * (2 * PERCWIDTH);
+                inter += Gm[0];     //global histories for SC
+                inter += (PNB - 2) * (1 << (LOGPNB)) * (PERCWIDTH) +
+                    (1 << (LOGPNB - 1)) * (2 * PERCWIDTH);
+                //we use phist already counted for these tables
+
+                if constexpr (LOCALH)
+                {
+                    inter +=
+                        (LNB - 2) * (1 << (LOGLNB)) * (PERCWIDTH) +
+                        (1 << (LOGLNB - 1)) * (2 * PERCWIDTH);
+                    inter += NLOCAL * Lm[0];
+                    inter += EWIDTH * (1 << LOGSIZEUPS);
+                    if constexpr (LOCALS)
+                    {
+                        inter +=
+                            (SNB - 2) * (1 << (LOGSNB)) * (PERCWIDTH) +
+                            (1 << (LOGSNB - 1)) * (2 * PERCWIDTH);
+                        inter += NSECLOCAL * (Sm[0]);
+                        inter += EWIDTH * (1 << LOGSIZEUPS);
+
+                    }
+                    if constexpr (LOCALT)
+                    {
+                        inter +=
+                            (TNB - 2) * (1 << (LOGTNB)) * (PERCWIDTH) +
+                            (1 << (LOGTNB - 1)) * (2 * PERCWIDTH);
+                        inter += NTLOCAL * Tm[0];
+                        inter += EWIDTH * (1 << LOGSIZEUPS);
+                    }
+
+
+
+
+
+
+
+
+
+                }
+
+
+
+                if constexpr (IMLI)
+                {
+
+                    inter += (1 << (LOGINB - 1)) * PERCWIDTH;
+                    inter += Im[0];
+
+                    inter += IMNB * (1 << (LOGIMNB - 1)) * PERCWIDTH;
+                    inter += 2 * EWIDTH * (1 << LOGSIZEUPS);    // the extra weight of the partial sums
+                    inter += 256 * IMm[0];
+                }
+                inter += 2 * CONFWIDTH; //the 2 counters in the choser
+                STORAGESIZE += inter;
+
+
+                fprintf (stderr, " (SC %d) ", inter);
+            }
+            if constexpr (CFG::BIAS_FILTER)
+            {
+                inter = (1 << LOGBF) * (CFG::BFTBITS + CFG::BFCWIDTH + 1);
+                STORAGESIZE += inter;
+                fprintf (stderr, " (FILTER %d) ", inter);
+            }
+        #ifdef PRINTSIZE
+            fprintf (stderr, " (TOTAL %d bits %d Kbits) ", STORAGESIZE,
+                    STORAGESIZE / 1024);
+            fprintf (stdout, " (TOTAL %d bits %d Kbits) ", STORAGESIZE,
+                    STORAGESIZE / 1024);
+        #endif
+
+
+            return (STORAGESIZE);
         }
 
-        uint64_t get_unique_inst_id(uint64_t seq_no, uint8_t piece) const
+        // Starts the event trace (-V), the branch dataset (-x) and the table heatmaps (CBP_TABLE_HEATMAP), if asked for.
+        void setup()
         {
-            assert(piece < 16);
-            return (seq_no << 4) | (piece & 0x000F);
+            if (TABLE_HEATMAP_FILE)
+                heatmap_setup ();
+            if (EVENT_TRACE_FILE && !event_trace.open(EVENT_TRACE_FILE, EVENT_TRACE_ONE_IN_N))
+            {
+                fprintf(stderr, "Unable to write the event trace %s\n", EVENT_TRACE_FILE);
+                exit(1);
+            }
+            if (BRANCH_DATASET_FILE && !dataset.open(BRANCH_DATASET_FILE, BRANCH_DATASET_HISTORY_BITS))
+            {
+                fprintf(stderr, "Unable to write the branch dataset %s\n", BRANCH_DATASET_FILE);
+                exit(1);
+            }
         }
 
-        void init_histories (cbp_hist_t& current_hist)
+        // Writes the misprediction profile, if asked for (-H), and completes the event trace (-V), the branch
+        // dataset (-x) and the table heatmaps.
+        void terminate()
         {
-            m[1] = MINHIST;
-            m[NHIST / 2] = MAXHIST;
-            for (int i = 2; i <= NHIST / 2; i++)
+            if (heatmap.enabled() && !heatmap.close())
+                fprintf(stderr, "Unable to write the table heatmaps %s\n", TABLE_HEATMAP_FILE);
+            if (BRANCH_PROFILE_CSV && !profile.write_csv(BRANCH_PROFILE_CSV, BRANCH_PROFILE_TOP_N))
+                fprintf(stderr, "Unable to write the branch profile %s\n", BRANCH_PROFILE_CSV);
+            if (dataset.enabled())
             {
-                m[i] =
-                    (int) (((double) MINHIST *
-                                pow ((double) (MAXHIST) / (double) MINHIST,
-                                    (double) (i - 1) / (double) (((NHIST / 2) - 1)))) +
-                            0.5);
-                //      fprintf(stderr, "(%d %d)", m[i],i);
-
+                const uint64_t num_rows = dataset.get_num_rows();
+                if (dataset.close())
+                    printf("Branch dataset: %lu branches written to %s\n", num_rows, BRANCH_DATASET_FILE);
+                else
+                    fprintf(stderr, "Unable to write the branch dataset %s\n", BRANCH_DATASET_FILE);
             }
-            for (int i = 1; i <= NHIST; i++)
+            if (EVENT_TRACE_FILE)
             {
-                NOSKIP[i] = ((i - 1) & 1)
-                    || ((i >= BORNINFASSOC) & (i < BORNSUPASSOC));
+                const uint64_t num_records = event_trace.num_records();
+                const uint64_t dropped = event_trace.close();
+                printf("Event trace: %lu records written to %s, %lu dropped\n", num_records, EVENT_TRACE_FILE, dropped);
+            }
+            if constexpr (CKPT_GROUP)
+                printf("History checkpoints: %lu bases of %lu checkpoints, %lu history bits logged, %.1f bytes per checkpoint instead of %zu\n",
+                       fold_num_bases, fold_num_ckpts, fold_num_pushes,
+                       fold_num_ckpts ? (double)(fold_num_bases*sizeof(fold_base_t) + fold_num_pushes*sizeof(fold_push_t))/fold_num_ckpts
+                                        + sizeof(cbp_checkpoint_t) : 0.0,
+                       sizeof(cbp_checkpoint_t) + 2*(NHIST + 1)*sizeof(int));
+            if constexpr (CFG::BIAS_FILTER)
+                printf("Bias filter: %lu of %lu conditional branches predicted (%.2f%%), %lu mispredicted, %d bits\n", bf_served,
+                       bf_lookups, bf_lookups ? 100.0*bf_served/bf_lookups : 0.0, bf_mispredicted,
+                       (1 << LOGBF) * (CFG::BFTBITS + CFG::BFCWIDTH + 1));
+        }
 
+        // Saves or restores the tables, the speculative state and the checkpoints. The geometry, the history lengths and
+        // the *GEHL pointers are fixed at construction, and the shared global history is saved by the caller.
+        void snapshot (snapshot_t& s)
+        {
+            s.io (GI);
+            s.io (GTAG);
+            s.io (BI);
+            s.io (GGI);
+            s.io (THRES);
+            s.io (predloop);
+            s.io (LIB);
+            s.io (LI);
+            s.io (LHIT);
+            s.io (LTAG);
+            s.io (LVALID);
+            s.io (tage_pred);
+            s.io (alttaken);
+            s.io (LongestMatchPred);
+            s.io (HitBank);
+            s.io (AltBank);
+            s.io (UseAlt);
+            s.io (pred_inter);
+            s.io (LowConf);
+            s.io (HighConf);
+
+            s.io (Bias);
+            s.io (BiasSK);
+            s.io (BiasBank);
+            s.io (IGEHLA);
+            s.io (IMGEHLA);
+            s.io (GGEHLA);
+            s.io (PGEHLA);
+            s.io (LGEHLA);
+            s.io (SGEHLA);
+            s.io (TGEHLA);
+            s.io (updatethreshold);
+            s.io (Pupdatethreshold);
+            s.io (WG);
+            s.io (WL);
+            s.io (WS);
+            s.io (WT);
+            s.io (WP);
+            s.io (WI);
+            s.io (WIM);
+            s.io (WB);
+            s.io (LSUM);
+            s.io (FirstH);
+            s.io (SecondH);
+            s.io (MedConf);
+
+            s.io (btable, 1 << LOGB);
+            if constexpr (CFG::SPARSE_TAGE)
+            {
+                gtable[1].snapshot (s, SizeTable[1]);
+                gtable[BORN].snapshot (s, SizeTable[BORN]);
             }
+            else
+            {
+                s.io (gtable[1], SizeTable[1]);
+                s.io (gtable[BORN], SizeTable[BORN]);
+            }
+            s.io (AltConf);
+            s.io (use_alt_on_na);
+            s.io (BIM);
+            s.io (TICK);
+            s.io (UEpoch);
+            s.io (UStamp[1], SizeTable[1] >> UCHUNKLOG);
+            s.io (UStamp[BORN], SizeTable[BORN] >> UCHUNKLOG);
+            s.io (Seed);
+
+            s.io (ltable.data (), ltable.size ());
+            s.io (bftable.data (), bftable.size ());
+            s.io (fold_bases);
+            s.io (fold_pushes);
+            s.io (fold_ckpts);
+            s.io (fold_pt);
+            s.io (fold_group);
+            s.io (fold_num_ckpts);
+            s.io (fold_num_bases);
+            s.io (fold_num_pushes);
+            s.io (bf_lookups);
+            s.io (bf_served);
+            s.io (bf_mispredicted);
+            s.io (loop_log);
+            s.io (loop_ckpts);
+            s.io (active_hist);
+            s.io (pred_time_histories);
+            s.io (profile);
+        }
 
-            NOSKIP[4] = 0;
-            NOSKIP[NHIST - 2] = 0;
-            NOSKIP[8] = 0;
-            NOSKIP[NHIST - 6] = 0;
-            // just eliminate some extra tables (very very marginal)
+        // The canonical form of the state, for the lockstep validation (-l): what the predictions and the training depend
+        // on, decoded in a fixed order whatever the layout of the tables (PACKED_TAGE, SPARSE_TAGE) and of the checkpoints
+        // (CKPT_GROUP). The tagged entries as (tag, ctr, u), u with the resets its chunk missed applied as age_u() would,
+        // then the bimodal entries, SC, the loop predictor and the bias filter, the thresholds and the counters that steer
+        // TAGE, and the running histories. Neither the checkpoints in flight, the state of the last lookup, nor the
+        // counters of the reports.
+        void dump (snapshot_t& s)
+        {
+            for (int i : {1, BORN})
+                for (int j = 0; j < SizeTable[i]; j++)
+                {
+                    gentry_t entry;
+                    if constexpr (CFG::SPARSE_TAGE)
+                        entry = gtable[i].peek (j);
+                    else
+                        entry = gtable[i][j];
+                    const uint32_t age = UEpoch - UStamp[i][j >> UCHUNKLOG];
+                    uint32_t tag = entry.tag;
+                    int8_t ctr = entry.ctr;
+                    int8_t u = (age >= UWIDTH) ? 0 : (entry.u >> age);
+                    s.io (tag);
+                    s.io (ctr);
+                    s.io (u);
+                }
+            for (int j = 0; j < (1 << LOGB); j++)
+            {
+                int8_t pred = btable[j].pred;
+                int8_t hyst = btable[j].hyst;
+                s.io (pred);
+                s.io (hyst);
+            }
 
-            for (int i = NHIST; i > 1; i--)
+            s.io (Bias);
+            s.io (BiasSK);
+            s.io (BiasBank);
+            s.io (IGEHLA);
+            s.io (IMGEHLA);
+            s.io (GGEHLA);
+            s.io (PGEHLA);
+            s.io (LGEHLA);
+            s.io (SGEHLA);
+            s.io (TGEHLA);
+            s.io (WG);
+            s.io (WL);
+            s.io (WS);
+            s.io (WT);
+            s.io (WP);
+            s.io (WI);
+            s.io (WIM);
+            s.io (WB);
+            s.io (FirstH);
+            s.io (SecondH);
+
+            s.io (ltable.data (), ltable.size ());
+            for (bfentry& entry : bftable)
             {
-                m[i] = m[(i + 1) / 2];
+                s.io (entry.tag);
+                s.io (entry.streak);
+                s.io (entry.dir);
+            }
 
+            s.io (updatethreshold);
+            s.io (Pupdatethreshold);
+            s.io (use_alt_on_na);
+            s.io (TICK);
+            s.io (Seed);
 
-            }
-            for (int i = 1; i <= NHIST; i++)
-            {
-                TB[i] = TBITS + 4 * (i >= BORN);
-                logg[i] = LOGG;
+            s.io (active_hist);
+        }
 
-            }
+        // Inference-only evaluation (-e) of the state restored from a snapshot of another run: from now on update() only
+        // releases the checkpoint of the branch, and the loop predictor is not updated speculatively either, so that
+        // only the histories, the checkpoints and the state of the last lookup are written. The tables stay as trained,
+        // and their pages shared by the forked workers of a batch. The checkpoints still in flight in the snapshot, and
+        // its profile, are of the other run: they are dropped. The histories carry over, as after a context switch.
+        void freeze ()
+        {
+            frozen = true;
+            pred_time_histories.clear ();
+            loop_ckpts.clear ();
+            loop_log.clear ();
+            fold_ckpts.clear ();
+            fold_bases.clear ();
+            fold_pushes.clear ();
+            fold_group = 0;
+            profile = branch_profile_t ();
+        }
 
+        uint64_t get_unique_inst_id(uint64_t seq_no, uint8_t piece) const
+        {
+            assert(piece < 16);
+            return (seq_no << 4) | (piece & 0x000F);
+        }
 
+        void init_histories (cbp_hist_t& current_hist)
+        {
 //#ifdef LOOPPREDICTOR
 //            ltable = new lentry[1 << (LOGL)];
 //#endif
 
-            gtable[1] = new gentry[NBANKLOW * (1 << LOGG)];
+            // the entries start all zero, as gentry_t() makes them: their pages are faulted in as they are used
             SizeTable[1] = NBANKLOW * (1 << LOGG);
-
-            gtable[BORN] = new gentry[NBANKHIGH * (1 << LOGG)];
             SizeTable[BORN] = NBANKHIGH * (1 << LOGG);
+            if constexpr (CFG::SPARSE_TAGE)
+            {
+                gtable[1] = sparse_new_table<gentry_t, UCHUNKLOG> (SizeTable[1]);
+                gtable[BORN] = sparse_new_table<gentry_t, UCHUNKLOG> (SizeTable[BORN]);
+            }
+            else
+            {
+                gtable[1] = huge_new_zeroed_array<gentry_t> (SizeTable[1]);
+                gtable[BORN] = huge_new_zeroed_array<gentry_t> (SizeTable[BORN]);
+            }
 
             for (int i = BORN + 1; i <= NHIST; i++)
                 gtable[i] = gtable[BORN];
             for (int i = 2; i <= BORN - 1; i++)
                 gtable[i] = gtable[1];
-            btable = new bentry[1 << LOGB];
 
-            for (int i = 1; i <= NHIST; i++)
-            {
-                current_hist.ch_i[i].init (m[i], (logg[i]));
-                current_hist.ch_t[0][i].init (current_hist.ch_i[i].OLENGTH, TB[i]);
-                current_hist.ch_t[1][i].init (current_hist.ch_i[i].OLENGTH, TB[i] - 1);
-
-            }
+            UStamp[1] = huge_new_zeroed_array<uint32_t> (SizeTable[1] >> UCHUNKLOG);
+            UStamp[BORN] = huge_new_zeroed_array<uint32_t> (SizeTable[BORN] >> UCHUNKLOG);
+            for (int i = BORN + 1; i <= NHIST; i++)
+                UStamp[i] = UStamp[BORN];
+            for (int i = 2; i <= BORN - 1; i++)
+                UStamp[i] = UStamp[1];
+            btable = huge_new_array<bentry_t> (1 << LOGB);
 
 // LOOPPREDICTOR state
             LVALID = false;
@@ -585,12 +1170,8 @@ class CBP2016_TAGE_SC_L
             Seed = 0;
 
             TICK = 0;
-            current_hist.phist = 0;
             Seed = 0;
 
-            for (int i = 0; i < HISTBUFFERLENGTH; i++)
-                current_hist.ghist[i] = 0;
-            current_hist.ptghist = 0;
             updatethreshold=35<<3;
 
             for (int i = 0; i < (1 << LOGSIZEUP); i++)
@@ -625,45 +1206,46 @@ class CBP2016_TAGE_SC_L
                 TGEHL[i] = &TGEHLA[i][0];
             for (int i = 0; i < PNB; i++)
                 PGEHL[i] = &PGEHLA[i][0];
-#ifdef IMLI
+            if constexpr (IMLI)
+            {
 #ifdef IMLIOH
-            for (int i = 0; i < FNB; i++)
-                FGEHL[i] = &FGEHLA[i][0];
+                for (int i = 0; i < FNB; i++)
+                    FGEHL[i] = &FGEHLA[i][0];
 
-            for (int i = 0; i < FNB; i++)
-                for (int j = 0; j < ((1 << LOGFNB) - 1); j++)
-                {
-                    if (!(j & 1))
+                for (int i = 0; i < FNB; i++)
+                    for (int j = 0; j < ((1 << LOGFNB) - 1); j++)
                     {
-                        FGEHL[i][j] = -1;
+                        if (!(j & 1))
+                        {
+                            FGEHL[i][j] = -1;
 
+                        }
                     }
-                }
 #endif
-            for (int i = 0; i < INB; i++)
-                IGEHL[i] = &IGEHLA[i][0];
-            for (int i = 0; i < INB; i++)
-                for (int j = 0; j < ((1 << LOGINB) - 1); j++)
-                {
-                    if (!(j & 1))
+                for (int i = 0; i < INB; i++)
+                    IGEHL[i] = &IGEHLA[i][0];
+                for (int i = 0; i < INB; i++)
+                    for (int j = 0; j < ((1 << LOGINB) - 1); j++)
                     {
-                        IGEHL[i][j] = -1;
+                        if (!(j & 1))
+                        {
+                            IGEHL[i][j] = -1;
 
+                        }
                     }
-                }
-            for (int i = 0; i < IMNB; i++)
-                IMGEHL[i] = &IMGEHLA[i][0];
-            for (int i = 0; i < IMNB; i++)
-                for (int j = 0; j < ((1 << LOGIMNB) - 1); j++)
-                {
-                    if (!(j & 1))
+                for (int i = 0; i < IMNB; i++)
+                    IMGEHL[i] = &IMGEHLA[i][0];
+                for (int i = 0; i < IMNB; i++)
+                    for (int j = 0; j < ((1 << LOGIMNB) - 1); j++)
                     {
-                        IMGEHL[i][j] = -1;
+                        if (!(j & 1))
+                        {
+                            IMGEHL[i][j] = -1;
 
+                        }
                     }
-                }
 
-#endif
+            }
             for (int i = 0; i < SNB; i++)
                 for (int j = 0; j < ((1 << LOGSNB) - 1); j++)
                 {
@@ -775,18 +1357,9 @@ class CBP2016_TAGE_SC_L
                 WB[i] = 4;
             }
             TICK = 0;
-            for (int i = 0; i < NLOCAL; i++)
-            {
-                current_hist.L_shist[i] = 0;
-            }
-            for (int i = 0; i < NSECLOCAL; i++)
-            {
-                current_hist.S_slhist[i] = 3;
-
-            }
+            current_hist.L_shist.fill(0);
+            current_hist.S_slhist.fill(3);
             current_hist.GHIST = 0;
-            current_hist.ptghist = 0;
-            current_hist.phist = 0;
         }// end init_histories
 
 
@@ -821,19 +1394,19 @@ class CBP2016_TAGE_SC_L
 
         // gindex computes a full hash of PC, ghist and phist
         //int gindex (unsigned int PC, int bank, uint64_t hist, const folded_history * ch_i) const
-        int gindex (unsigned int PC, int bank, uint64_t hist, const tage_index_t& ch_i) const
+        int gindex (unsigned int PC, int bank, uint64_t hist, const unsigned * ch_i) const
         {
             int index;
             int M = (m[bank] > PHISTWIDTH) ? PHISTWIDTH : m[bank];
-            index = PC ^ (PC >> (abs (logg[bank] - bank) + 1)) ^ ch_i[bank].comp ^ F (hist, M, bank);
+            index = PC ^ (PC >> (abs (logg[bank] - bank) + 1)) ^ ch_i[bank] ^ F (hist, M, bank);
 
             return (index & ((1 << (logg[bank])) - 1));
         }
 
         //  tag computation
-        uint16_t gtag (unsigned int PC, int bank, const tage_tag_t& tag_0_array, const tage_tag_t& tag_1_array) const
+        uint16_t gtag (unsigned int PC, int bank, const unsigned * tag_0_array, const unsigned * tag_1_array) const
         {
-            int tag = (PC) ^ tag_0_array[bank].comp ^ (tag_1_array[bank].comp << 1);
+            int tag = (PC) ^ tag_0_array[bank] ^ (tag_1_array[bank] << 1);
             return (tag & ((1 << (TB[bank])) - 1));
         }
 
@@ -853,6 +1426,27 @@ class CBP2016_TAGE_SC_L
         }
 
 
+        // ctrupdate on the prediction counter of a tagged entry, which may be a bit-field
+        void tagectrupdate (gentry_t & entry, bool taken)
+        {
+            int8_t ctr = entry.ctr;
+            ctrupdate (ctr, taken, CWIDTH);
+            entry.ctr = ctr;
+        }
+
+        // Brings the u counters of the chunk of gtable[i][GI[i]] up to date with the resets since it was last aged.
+        void age_u (int i)
+        {
+            uint32_t & stamp = UStamp[i][GI[i] >> UCHUNKLOG];
+            if (stamp == UEpoch)
+                return;
+            const uint32_t age = UEpoch - stamp;
+            gentry_t *chunk = &gtable[i][GI[i] & ~((1 << UCHUNKLOG) - 1)];
+            for (int j = 0; j < (1 << UCHUNKLOG); j++)
+                chunk[j].u = (age >= UWIDTH) ? 0 : (chunk[j].u >> age);
+            stamp = UEpoch;
+        }
+
         bool getbim ()
         {
             BIM = (btable[BI].pred << 1) + (btable[BI >> HYSTSHIFT].hyst);
@@ -882,27 +1476,36 @@ class CBP2016_TAGE_SC_L
         int MYRANDOM ()
         {
             Seed++;
-            Seed ^= active_hist.phist;
+            Seed ^= global_hist.phist;
             Seed = (Seed >> 21) + (Seed << 11);
-            Seed ^= (int64_t)active_hist.ptghist;
+            Seed ^= (int64_t)global_hist.ptghist;
             Seed = (Seed >> 10) + (Seed << 22);
             return (Seed & 0xFFFFFFFF);
         };
 
 
-        //  TAGE PREDICTION: same code at fetch or retire time but the index and tags must recomputed
-        void Tagepred (UINT64 PC, const cbp_hist_t& hist_to_use)
+        //  TAGE table indices and tags, computed once at fetch time and checkpointed for retire time; the hashes of all the
+        //  banks vectorize, and are built for the host ISA (lib/simd_dispatch.h)
+        void Tageindex (UINT64 PC, std::array<int, NHIST + 1>& GI, std::array<uint, NHIST + 1>& GTAG, int& BI) const
+        {
+            Tageindex (PC, global_hist.phist, global_hist.folded.comp[0].data () + fold_row, global_hist.folded.comp[1].data () + fold_row,
+                       global_hist.folded.comp[2].data () + fold_row, GI, GTAG, BI);
+        }
+
+        // same from the given path history and folded histories
+        CBP_SIMD_KERNEL void Tageindex (UINT64 PC, uint64_t phist, const unsigned * ch_i, const unsigned * ch_t0, const unsigned * ch_t1,
+                                        std::array<int, NHIST + 1>& GI, std::array<uint, NHIST + 1>& GTAG, int& BI) const
         {
-            HitBank = 0;
-            AltBank = 0;
             for (int i = 1; i <= NHIST; i += 2)
             {
-                GI[i] = gindex (PC, i, hist_to_use.phist, hist_to_use.ch_i);
-                GTAG[i] = gtag (PC, i, hist_to_use.ch_t[0], hist_to_use.ch_t[1]);
+                GI[i] = gindex (PC, i, phist, ch_i);
+                GTAG[i] = gtag (PC, i, ch_t0, ch_t1);
                 GTAG[i + 1] = GTAG[i];
                 GI[i + 1] = GI[i] ^ (GTAG[i] & ((1 << LOGG) - 1));
             }
-            int T = (PC ^ (hist_to_use.phist & ((1ULL << m[BORN]) - 1))) % NBANKHIGH;
+            // long geometries (explore_space.h) can have m[BORN] >= 64: then the whole path history
+            constexpr uint64_t BORN_PHIST_MASK = (m[BORN] >= 64) ? ~0ULL : (1ULL << m[BORN]) - 1;
+            int T = (PC ^ (phist & BORN_PHIST_MASK)) % NBANKHIGH;
             //int T = (PC ^ phist) % NBANKHIGH;
             for (int i = BORN; i <= NHIST; i++)
                 if (NOSKIP[i])
@@ -912,7 +1515,7 @@ class CBP2016_TAGE_SC_L
                     T = T % NBANKHIGH;
 
                 }
-            T = (PC ^ (hist_to_use.phist & ((1 << m[1]) - 1))) % NBANKLOW;
+            T = (PC ^ (phist & ((1 << m[1]) - 1))) % NBANKLOW;
 
             for (int i = 1; i <= BORN - 1; i++)
                 if (NOSKIP[i])
@@ -924,35 +1527,122 @@ class CBP2016_TAGE_SC_L
                 }
             //just do not forget most address are aligned on 4 bytes
             BI = (PC ^ (PC >> 2)) & ((1 << LOGB) - 1);
+        }
+
+        // Logs the history bits pushed into the global history since the last call. Called before its owner pushes the
+        // bits of each branch, so that the bits leaving the longest history are still in the buffer.
+        void fold_log_pushes ()
+        {
+            for (; fold_pt > global_hist.ptghist; fold_pt--)
+            {
+                const int pt = fold_pt - 1;
+                uint64_t out = 0;
+                for (int i = 1; i <= NHIST; i++)
+                    out |= (uint64_t) global_hist.ghist[(pt + m[i]) & (HISTBUFFERLENGTH - 1)] << i;
+                fold_pushes.push_back ({out, global_hist.ghist[pt & (HISTBUFFERLENGTH - 1)]});
+                fold_num_pushes++;
+            }
+        }
+
+        // CKPT_GROUP: refers the checkpoint to the base of the current group, starting a new one every CKPT_GROUP
+        // predictions or once the base has been released.
+        void fold_checkpoint (uint64_t seq_no, uint8_t piece, cbp_checkpoint_t& ckpt)
+        {
+            fold_log_pushes ();
+            if ((fold_group == 0) || (fold_bases.begin () == fold_bases.end ()))
+            {
+                fold_base_t base;
+                for (int r = 0; r < 3; r++)
+                    for (int i = 0; i <= NHIST; i++)
+                        base.comp[r][i] = global_hist.folded.comp[r][fold_row + i];
+                base.PUSHPOS = fold_pushes.end ();
+                fold_bases.push_back (base);
+                fold_num_bases++;
+                fold_group = 0;
+            }
+            fold_group = (fold_group + 1) % CKPT_GROUP;
+            ckpt.FREF[0] = {fold_bases.end () - 1, fold_pushes.end (), (uint32_t) global_hist.phist};
+            fold_ckpts.push_back ({seq_no, piece, ckpt.FREF[0].FBASE});
+            fold_num_ckpts++;
+        }
+
+        // CKPT_GROUP: the TAGE indices and tags of a checkpoint, from the folded histories of its base replayed up to its
+        // prediction
+        void fold_rebuild (UINT64 PC, const cbp_checkpoint_t& ckpt, std::array<int, NHIST + 1>& GI, std::array<uint, NHIST + 1>& GTAG, int& BI)
+        {
+            const fold_ref_t& ref = ckpt.FREF[0];
+            const fold_base_t& base = fold_bases[ref.FBASE];
+            fold_replay.comp = base.comp;
+            std::array<unsigned, NHIST + 1> out;
+            for (uint64_t p = base.PUSHPOS; p < ref.FPOS; p++)
+            {
+                const fold_push_t& push = fold_pushes[p];
+                for (int i = 0; i <= NHIST; i++)
+                    out[i] = (push.out >> i) & 1;
+                fold_replay.update (push.in, out);
+            }
+            Tageindex (PC, ref.PHIST, fold_replay.comp[0].data (), fold_replay.comp[1].data (), fold_replay.comp[2].data (), GI, GTAG, BI);
+        }
 
+        // releases the bases, and the pushed bits, that no live checkpoint refers to
+        void release_fold_log ()
+        {
+            while (fold_ckpts.begin () != fold_ckpts.end ())
             {
-                alttaken = getbim ();
-                tage_pred = alttaken;
-                LongestMatchPred = alttaken;
+                const fold_ckpt_ref_t& ref = fold_ckpts[fold_ckpts.begin ()];
+                if (pred_time_histories.contains (ref.seq_no, ref.piece))
+                    break;
+                fold_ckpts.release (fold_ckpts.begin () + 1);
             }
+            const uint64_t oldest = (fold_ckpts.begin () != fold_ckpts.end ()) ? fold_ckpts[fold_ckpts.begin ()].FBASE : fold_bases.end ();
+            fold_pushes.release ((oldest != fold_bases.end ()) ? fold_bases[oldest].PUSHPOS : fold_pushes.end ());
+            fold_bases.release (oldest);
+        }
 
-            //Look for the bank with longest matching history
-            for (int i = NHIST; i > 0; i--)
+        //  TAGE PREDICTION: same code at fetch or retire time, on the checkpointed indices and tags, or with CKPT_GROUP
+        //  on those computed at fetch time and rebuilt at retire time
+        void Tagepred (UINT64 PC, const cbp_checkpoint_t& hist_to_use, bool pred_time_predict)
+        {
+            HitBank = 0;
+            AltBank = 0;
+            UseAlt = false;
+            if constexpr (CKPT_GROUP)
             {
-                if (NOSKIP[i])
-                    if (gtable[i][GI[i]].tag == GTAG[i])
-                    {
-                        HitBank = i;
-                        LongestMatchPred = (gtable[HitBank][GI[HitBank]].ctr >= 0);
-                        break;
-                    }
+                std::array<int, NHIST + 1> gi;
+                std::array<uint, NHIST + 1> gtag;
+                if (pred_time_predict)
+                    Tageindex (PC, gi, gtag, BI);
+                else
+                    fold_rebuild (PC, hist_to_use, gi, gtag, BI);
+                memcpy (GI, gi.data (), sizeof (GI));
+                memcpy (GTAG, gtag.data (), sizeof (GTAG));
+            }
+            else
+            {
+                memcpy (GI, hist_to_use.GI.data (), sizeof (GI));
+                memcpy (GTAG, hist_to_use.GTAG.data (), sizeof (GTAG));
+                BI = hist_to_use.BI;
             }
 
-            //Look for the alternate bank
-            for (int i = HitBank - 1; i > 0; i--)
             {
-                if (NOSKIP[i])
-                    if (gtable[i][GI[i]].tag == GTAG[i])
-                    {
+                alttaken = getbim ();
+                tage_pred = alttaken;
+                LongestMatchPred = alttaken;
+            }
 
-                        AltBank = i;
-                        break;
-                    }
+            //Tag match on all banks at once, without early exits: the bank with the longest matching history
+            //is the highest bit of the hit mask and the alternate bank the next one
+            uint64_t hits = 0;
+            for (int i = 1; i <= NHIST; i++)
+                hits |= (uint64_t) (gtable[i][GI[i]].tag == GTAG[i]) << i;
+            hits &= NOSKIPMASK;
+            if (hits)
+            {
+                HitBank = 63 - __builtin_clzll (hits);
+                LongestMatchPred = (gtable[HitBank][GI[HitBank]].ctr >= 0);
+                hits &= ~(1ULL << HitBank);
+                if (hits)
+                    AltBank = 63 - __builtin_clzll (hits);
             }
             //computes the prediction and the alternate prediction
 
@@ -975,7 +1665,10 @@ class CBP2016_TAGE_SC_L
                         || (abs (2 * gtable[HitBank][GI[HitBank]].ctr + 1) > 1))
                     tage_pred = LongestMatchPred;
                 else
+                {
                     tage_pred = alttaken;
+                    UseAlt = true;
+                }
 
                 HighConf =
                     (abs (2 * gtable[HitBank][GI[HitBank]].ctr + 1) >=
@@ -986,21 +1679,6 @@ class CBP2016_TAGE_SC_L
             }
         }
 
-        uint64_t get_local_index(uint64_t PC) const
-        {
-            return ((PC ^ (PC >>2)) & (NLOCAL-1));
-        }
-
-        uint64_t get_second_local_index(uint64_t PC) const
-        {
-            return (((PC ^ (PC >>5))) & (NSECLOCAL-1));
-        }
-
-        uint64_t get_third_local_index(uint64_t PC) const
-        {
-            return  (((PC ^ (PC >>(LOGTNB)))) & (NTLOCAL-1)); // different hash for the history
-        }
-
         uint64_t get_bias_index(uint64_t PC) const
         {
             return (((((PC ^(PC >>2))<<1)  ^  (LowConf &(LongestMatchPred!=alttaken))) <<1) +  pred_inter) & ((1<<LOGBIAS) -1);
@@ -1016,27 +1694,247 @@ class CBP2016_TAGE_SC_L
             return (pred_inter + (((HitBank+1)/4)<<4) + (HighConf<<1) + (LowConf <<2) +((AltBank!=0)<<3)+ ((PC^(PC>>2))<<7)) & ((1<<LOGBIAS) -1);
         }
 
+        // captures the part of the running history that a prediction for PC will read, as table indices where possible
+        void checkpoint_hist (UINT64 PC, const cbp_hist_t& hist, cbp_checkpoint_t& ckpt) const
+        {
+            ckpt.GHIST = hist.GHIST;
+            if constexpr (!CKPT_GROUP)
+                Tageindex (PC, ckpt.GI, ckpt.GTAG, ckpt.BI);
+            Gindex (PC, global_hist.phist, Pm, PNB, LOGPNB, ckpt.PGI.data ());
+            Gindex (PC, hist.L_shist.read(PC), Lm, LNB, LOGLNB, ckpt.LGI.data ());
+            Gindex (PC, hist.S_slhist.read(PC), Sm, SNB, LOGSNB, ckpt.SGI.data ());
+            Gindex (PC, hist.T_slhist.read(PC), Tm, TNB, LOGTNB, ckpt.TGI.data ());
+            if constexpr (IMLI)
+            {
+                Gindex (PC, hist.IMHIST[hist.IMLIcount], IMm, IMNB, LOGIMNB, ckpt.IMGI.data ());
+                Gindex (PC, hist.IMLIcount, Im, INB, LOGINB, ckpt.IGI.data ());
+            }
+            if constexpr (LOOPPREDICTOR)
+            {
+                ckpt.LPOS = loop_log.end ();
+                ckpt.WITHLOOP = hist.WITHLOOP;
+            }
+        }
+
+        // Called at the fetch of any instruction, before it is predicted: prefetches the TAGE entries that a prediction
+        // for PC reads with the running history, to hide the host memory latency. No-op unless the configuration sets
+        // PREFETCH, as the indices are computed for every fetched instruction, branch or not.
+        void prefetch (UINT64 PC) const
+        {
+            if constexpr (CFG::PREFETCH)
+            {
+                std::array<int, NHIST + 1> GI;
+                std::array<uint, NHIST + 1> GTAG;
+                int BI;
+                Tageindex (PC, GI, GTAG, BI);
+                __builtin_prefetch (&btable[BI]);
+                __builtin_prefetch (&btable[BI >> HYSTSHIFT]);
+                for (int i = 1; i <= NHIST; i++)
+                    if (NOSKIP[i])
+                        __builtin_prefetch (&gtable[i][GI[i]]);
+            }
+        }
+
         bool predict (uint64_t seq_no, uint8_t piece, UINT64 PC)
         {
             // checkpoint current hist
-            pred_time_histories.emplace(get_unique_inst_id(seq_no, piece), active_hist);
-            const bool pred_taken = predict_using_given_hist(seq_no, piece, PC, active_hist, true/*pred_time_predict*/);
+            auto& pred_time_history = pred_time_histories.emplace(seq_no, piece);
+            pred_time_history.filtered = false;
+            if constexpr (CKPT_GROUP)
+                fold_log_pushes ();
+            if constexpr (CFG::BIAS_FILTER)
+            {
+                bf_lookups++;
+                const bfentry& bf = bftable[bf_index (PC)];
+                if ((bf.tag == bf_tag (PC)) && (bf.streak == BFMAX))
+                {
+                    bf_served++;
+                    pred_time_history.filtered = true;
+                    pred_time_history.provider = PROVIDER_FILTER;
+                    pred_time_history.hit_bank = 0;
+                    TRACE_BEGIN (seq_no, piece, PC);
+                    TRACE_EVENT (EVENT_PROVIDER, 0, PROVIDER_FILTER, 0, bf.dir);
+                    return bf.dir;
+                }
+            }
+            if constexpr (CKPT_GROUP)
+                fold_checkpoint (seq_no, piece, pred_time_history);
+            checkpoint_hist(PC, active_hist, pred_time_history);
+            const bool pred_taken = predict_using_given_hist(seq_no, piece, PC, pred_time_history, true/*pred_time_predict*/);
+            if constexpr (LOOPPREDICTOR)
+            {
+                // the loop table may have changed by update time: keep what was read from it
+                pred_time_history.predloop = predloop;
+                pred_time_history.LHIT = LHIT;
+                pred_time_history.LVALID = LVALID;
+                loop_ckpts.push_back ({seq_no, piece, pred_time_history.LPOS});
+            }
+            pred_time_history.provider = get_provider (pred_taken, pred_time_history);
+            pred_time_history.hit_bank = HitBank;
+            if (heatmap.enabled())
+                heatmap_lookups (seq_no, piece, PC, pred_time_history);
+
+            TRACE_BEGIN (seq_no, piece, PC);
+            TRACE_EVENT (EVENT_PROVIDER, HitBank, pred_time_history.provider, AltBank, pred_taken);
+            if (pred_time_history.provider == PROVIDER_SC)
+                TRACE_EVENT (EVENT_SC_OVERRIDE, HitBank, pred_taken, LSUM, THRES);
+            if (LOOPPREDICTOR && SC && (pred_time_history.WITHLOOP >= 0) && LVALID)
+                TRACE_EVENT (EVENT_LOOP_HIT, 0, predloop, pred_time_history.WITHLOOP, 0);
             return pred_taken;
         }
 
-        bool predict_using_given_hist (uint64_t seq_no, uint8_t piece, UINT64 PC, const cbp_hist_t& hist_to_use, const bool pred_time_predict)
+        int bf_index (UINT64 PC) const
+        {
+            return (PC ^ (PC >> 2) ^ (PC >> (LOGBF + 2))) & ((1 << LOGBF) - 1);
+        }
+
+        uint16_t bf_tag (UINT64 PC) const
+        {
+            return ((PC >> LOGBF) ^ (PC >> (LOGBF + CFG::BFTBITS))) & ((1 << CFG::BFTBITS) - 1);
+        }
+
+        // Trains the bias filter on the outcome of a conditional branch: an entry predicts once its branch went the
+        // same direction BFMAX times in a row, and is replaced only once decayed by the branches it conflicts with.
+        void bf_update (UINT64 PC, bool taken)
+        {
+            bfentry& bf = bftable[bf_index (PC)];
+            const uint16_t tag = bf_tag (PC);
+            if (bf.tag == tag)
+            {
+                if (bf.dir == taken)
+                    bf.streak += (bf.streak < BFMAX);
+                else
+                {
+                    bf.dir = taken;
+                    bf.streak = 0;
+                }
+            }
+            else if (bf.streak == 0)
+            {
+                bf.tag = tag;
+                bf.dir = taken;
+                bf.streak = 1;
+            }
+            else
+                bf.streak--;
+        }
+
+        // Component that gave pred_taken, from the state of the last predict_using_given_hist().
+        branch_provider_t get_provider (bool pred_taken, const cbp_checkpoint_t& hist_to_use) const
+        {
+            if (SC && (pred_taken != pred_inter))
+                return PROVIDER_SC;
+            if (LOOPPREDICTOR && SC && (hist_to_use.WITHLOOP >= 0) && LVALID)
+                return PROVIDER_LOOP;
+            if (HitBank == 0)
+                return PROVIDER_BIMODAL;
+            if (UseAlt)
+                return (AltBank > 0) ? PROVIDER_ALT : PROVIDER_BIMODAL;
+            return PROVIDER_TAGE;
+        }
+
+        // Adds the tables to the heatmaps: the tagged banks, each over the whole of the table it shares, the bimodal
+        // table, the loop table and the SC tables, those of the enabled components only.
+        void heatmap_setup ()
+        {
+            heatmap.open (TABLE_HEATMAP_FILE, TABLE_HEATMAP_ONE_IN_N, TABLE_HEATMAP_REGIONS);
+            for (int i = 1; i <= NHIST; i++)
+                if (NOSKIP[i])
+                    hm_bank[i] = heatmap.add_table ("gtable." + std::to_string (i), SizeTable[(i < BORN) ? 1 : BORN], true);
+            hm_btable = heatmap.add_table ("btable", 1 << LOGB, false);
+            if constexpr (!SC)
+                return;
+            if constexpr (LOOPPREDICTOR)
+                hm_ltable = heatmap.add_table ("ltable", ltable.size (), true);
+            hm_sc = heatmap.add_table ("sc.bias", 1 << LOGBIAS, false);
+            heatmap.add_table ("sc.biassk", 1 << LOGBIAS, false);
+            heatmap.add_table ("sc.biasbank", 1 << LOGBIAS, false);
+            auto gehl = [this] (const char * name, int nb, int logs) {
+                for (int i = 0; i < nb; i++)
+                    heatmap.add_table (std::string ("sc.") + name + std::to_string (i), 1 << logs, false);
+            };
+            gehl ("g", GNB, LOGGNB);
+            gehl ("p", PNB, LOGPNB);
+            if constexpr (LOCALH)
+            {
+                gehl ("l", LNB, LOGLNB);
+                if constexpr (LOCALS)
+                    gehl ("s", SNB, LOGSNB);
+                if constexpr (LOCALT)
+                    gehl ("t", TNB, LOGTNB);
+            }
+            if constexpr (IMLI)
+            {
+                gehl ("im", IMNB, LOGIMNB);
+                gehl ("i", INB, LOGINB);
+            }
+        }
+
+        // Records the table lookups of the prediction just made, from the state it left.
+        void heatmap_lookups (uint64_t seq_no, uint8_t piece, UINT64 PC, const cbp_checkpoint_t& hist)
+        {
+            heatmap.begin (seq_no, piece);
+            for (int i = 1; i <= NHIST; i++)
+                if (NOSKIP[i])
+                    heatmap.lookup (hm_bank[i], GI[i], &gtable[i][GI[i]], gtable[i][GI[i]].tag == GTAG[i]);
+            heatmap.lookup (hm_btable, BI, &btable[BI]);
+            if constexpr (!SC)
+                return;
+            if constexpr (LOOPPREDICTOR)
+            {
+                const int way = std::max (LHIT, 0);
+                const int index = (LI ^ ((LIB >> way) << 2)) + way;
+                heatmap.lookup (hm_ltable, index, &ltable[index], LHIT >= 0);
+            }
+            int id = hm_sc;
+            heatmap.lookup (id++, get_bias_index (PC), &Bias[get_bias_index (PC)]);
+            heatmap.lookup (id++, get_biassk_index (PC), &BiasSK[get_biassk_index (PC)]);
+            heatmap.lookup (id++, get_biasbank_index (PC), &BiasBank[get_biasbank_index (PC)]);
+            auto gehl = [this, &id] (const uint16_t * index, int8_t ** tab, int nb) {
+                for (int i = 0; i < nb; i++)
+                    heatmap.lookup (id++, index[i], &tab[i][index[i]]);
+            };
+            gehl (GGI, GGEHL, GNB);
+            gehl (hist.PGI.data (), PGEHL, PNB);
+            if constexpr (LOCALH)
+            {
+                gehl (hist.LGI.data (), LGEHL, LNB);
+                if constexpr (LOCALS)
+                    gehl (hist.SGI.data (), SGEHL, SNB);
+                if constexpr (LOCALT)
+                    gehl (hist.TGI.data (), TGEHL, TNB);
+            }
+            if constexpr (IMLI)
+            {
+                gehl (hist.IMGI.data (), IMGEHL, IMNB);
+                gehl (hist.IGI.data (), IGEHL, INB);
+            }
+        }
+
+        bool predict_using_given_hist (uint64_t seq_no, uint8_t piece, UINT64 PC, const cbp_checkpoint_t& hist_to_use, const bool pred_time_predict)
         {
             // computes the TAGE table addresses and the partial tags
-            Tagepred (PC, hist_to_use);
+            Tagepred (PC, hist_to_use, pred_time_predict);
             bool pred_taken = tage_pred;
-#ifndef SC
-            return (tage_pred);
-#endif
+            if constexpr (!SC)
+            {
+                return (tage_pred);
+            }
 
-#ifdef LOOPPREDICTOR
-            predloop = getloop (PC, hist_to_use);   // loop prediction
-            pred_taken = ((hist_to_use.WITHLOOP >= 0) && (LVALID)) ? predloop : pred_taken;
-#endif
+            if constexpr (LOOPPREDICTOR)
+            {
+                if (pred_time_predict)
+                    predloop = getloop (PC);   // loop prediction
+                else
+                {
+                    // same loop prediction as at predict time, from the table as it was then
+                    loopindex (PC);
+                    predloop = hist_to_use.predloop;
+                    LHIT = hist_to_use.LHIT;
+                    LVALID = hist_to_use.LVALID;
+                }
+                pred_taken = ((hist_to_use.WITHLOOP >= 0) && (LVALID)) ? predloop : pred_taken;
+            }
             pred_inter = pred_taken;
 
             //Compute the SC prediction
@@ -1055,34 +1953,35 @@ class CBP2016_TAGE_SC_L
             LSUM = (1 + (WB[INDUPDS] >= 0)) * LSUM;
 #endif
             //integrate the GEHL predictions
-            LSUM += Gpredict ((PC << 1) + pred_inter, hist_to_use.GHIST, Gm, GGEHL, GNB, LOGGNB, WG);
-            LSUM += Gpredict (PC, hist_to_use.phist, Pm, PGEHL, PNB, LOGPNB, WP);
-#ifdef LOCALH
-            LSUM += Gpredict (PC, hist_to_use.L_shist[get_local_index(PC)], Lm, LGEHL, LNB, LOGLNB, WL);
-#ifdef LOCALS
-            LSUM += Gpredict (PC, hist_to_use.S_slhist[get_second_local_index(PC)], Sm, SGEHL, SNB, LOGSNB, WS);
-#endif
-#ifdef LOCALT
-            LSUM += Gpredict (PC, hist_to_use.T_slhist[get_third_local_index(PC)], Tm, TGEHL, TNB, LOGTNB, WT);
-#endif
-#endif
+            Gindex ((PC << 1) + pred_inter, hist_to_use.GHIST, Gm, GNB, LOGGNB, GGI);
+            LSUM += Gpredict ((PC << 1) + pred_inter, GGI, GGEHL, GNB, WG);
+            LSUM += Gpredict (PC, hist_to_use.PGI.data (), PGEHL, PNB, WP);
+            if constexpr (LOCALH)
+            {
+                LSUM += Gpredict (PC, hist_to_use.LGI.data (), LGEHL, LNB, WL);
+                if constexpr (LOCALS)
+                {
+                    LSUM += Gpredict (PC, hist_to_use.SGI.data (), SGEHL, SNB, WS);
+                }
+                if constexpr (LOCALT)
+                {
+                    LSUM += Gpredict (PC, hist_to_use.TGI.data (), TGEHL, TNB, WT);
+                }
+            }
 
-#ifdef IMLI
-            LSUM += Gpredict (PC, hist_to_use.IMHIST[(hist_to_use.IMLIcount)], IMm, IMGEHL, IMNB, LOGIMNB, WIM);
-            LSUM += Gpredict (PC, hist_to_use.IMLIcount, Im, IGEHL, INB, LOGINB, WI);
-#endif
+            if constexpr (IMLI)
+            {
+                LSUM += Gpredict (PC, hist_to_use.IMGI.data (), IMGEHL, IMNB, WIM);
+                LSUM += Gpredict (PC, hist_to_use.IGI.data (), IGEHL, INB, WI);
+            }
             bool SCPRED = (LSUM >= 0);
             //just  an heuristic if the respective contribution of component groups can be multiplied by 2 or not
             THRES = (updatethreshold>>3)+Pupdatethreshold[INDUPD]
 #ifdef VARTHRES
                 + 12 * ((WB[INDUPDS] >= 0) + (WP[INDUPDS] >= 0)
-#ifdef LOCALH
-                        + (WS[INDUPDS] >= 0) + (WT[INDUPDS] >= 0) + (WL[INDUPDS] >= 0)
-#endif
+                        + (LOCALH ? (WS[INDUPDS] >= 0) + (WT[INDUPDS] >= 0) + (WL[INDUPDS] >= 0) : 0)
                         + (WG[INDUPDS] >= 0)
-#ifdef IMLI
-                        + (WI[INDUPDS] >= 0)
-#endif
+                        + (IMLI ? (WI[INDUPDS] >= 0) : 0)
                        )
 #endif
                 ;
@@ -1121,110 +2020,71 @@ class CBP2016_TAGE_SC_L
         void history_update (uint64_t seq_no, uint8_t piece, UINT64 PC, int brtype, bool pred_taken, bool taken, UINT64 nextPC)
         {
             //HistoryUpdate (PC, brtype, taken, nextPC, active_hist.phist, active_hist.ptghist, active_hist.ch_i, active_hist.ch_t[0], active_hist.ch_t[1]);
-            HistoryUpdate (PC, brtype, pred_taken, taken, nextPC);
-        }
-
-        void TrackOtherInst (UINT64 PC, int brtype, bool pred_taken, bool taken, UINT64 nextPC)
-        {
-            HistoryUpdate (PC, brtype, pred_taken, taken, nextPC);
+            if ((brtype & 1) && dataset.enabled())
+            {
+                const auto& pred_time_history = pred_time_histories.at(seq_no, piece);
+                dataset.record(PC, taken, pred_taken, pred_time_history.provider, pred_time_history.hit_bank);
+            }
+            // a branch predicted by the bias filter read nothing of the loop predictor, for it to update speculatively
+            const bool filtered = CFG::BIAS_FILTER && (brtype & 1) && pred_time_histories.at(seq_no, piece).filtered;
+            if constexpr (CKPT_GROUP)
+                fold_log_pushes ();
+            HistoryUpdate (PC, brtype, pred_taken, taken, nextPC, filtered);
         }
 
-        void HistoryUpdate (UINT64 PC, int brtype, bool pred_taken, bool taken, UINT64 nextPC)
+        // Updates the histories private to TAGE-SC-L. Only conditional branches have any: the global and path
+        // histories are advanced by global_hist's owner, after this call as the loop predictor update reads them.
+        void HistoryUpdate (UINT64 PC, int brtype, bool pred_taken, bool taken, UINT64 nextPC, bool filtered)
         {
-
-            auto& X = active_hist.phist;
-            auto& Y = active_hist.ptghist;
-
-            auto& H = active_hist.ch_i;
-            auto& G = active_hist.ch_t[0];
-            auto& J = active_hist.ch_t[1];
-
-            //special treatment for indirect  branchs;
-            int maxt = 2;
-            if (brtype & 1)   // conditional
-                maxt = 2;
-            else if ((brtype & 2) )
-                maxt = 3;
-
-#ifdef IMLI
-            if (brtype & 1)   // conditional
+            if constexpr (IMLI)
             {
-#ifdef IMLI
-                active_hist.IMHIST[active_hist.IMLIcount] = (active_hist.IMHIST[active_hist.IMLIcount] << 1) + taken;
-#endif
-
-#ifdef LOOPPREDICTOR
-                // only for conditional branch
-                if (LVALID)
+                if (brtype & 1)   // conditional
                 {
-                    if (pred_taken != predloop)
-                        ctrupdate (active_hist.WITHLOOP, (predloop == pred_taken), 7);
-                }
-
-                loopupdate(PC, pred_taken, false/*alloc*/, active_hist.ltable);
-#endif
-                if (nextPC < PC)
+                    active_hist.IMHIST[active_hist.IMLIcount] = (active_hist.IMHIST[active_hist.IMLIcount] << 1) + taken;
 
-                {
-                    //This branch corresponds to a loop
-                    if (!taken)
+                    if (LOOPPREDICTOR && !frozen && !filtered)
                     {
-                        //exit of the "loop"
-                        active_hist.IMLIcount = 0;
+                        // only for conditional branch
+                        if (LVALID)
+                        {
+                            if (pred_taken != predloop)
+                                ctrupdate (active_hist.WITHLOOP, (predloop == pred_taken), 7);
+                        }
 
+                        loopupdate(PC, pred_taken, false/*alloc*/);
                     }
-                    if (taken)
+                    if (nextPC < PC)
+
                     {
+                        //This branch corresponds to a loop
+                        if (!taken)
+                        {
+                            //exit of the "loop"
+                            active_hist.IMLIcount = 0;
 
-                        if (active_hist.IMLIcount < ((1ULL << Im[0]) - 1))
-                            active_hist.IMLIcount++;
+                        }
+                        if (taken)
+                        {
+
+                            if (active_hist.IMLIcount < ((1ULL << Im[0]) - 1))
+                                active_hist.IMLIcount++;
+                        }
                     }
                 }
-            }
 
 
-#endif
+            }
 
             if (brtype & 1)
             {
                 active_hist.GHIST = (active_hist.GHIST << 1) + (taken & (nextPC < PC));
-                active_hist.L_shist[get_local_index(PC)] = (active_hist.L_shist[get_local_index(PC)] << 1) + (taken);
-                active_hist.S_slhist[get_second_local_index(PC)] = ((active_hist.S_slhist[get_second_local_index(PC)] << 1) + taken) ^ (PC & 15);
-                active_hist.T_slhist[get_third_local_index(PC)] = (active_hist.T_slhist[get_third_local_index(PC)] << 1) + taken;
-            }
-
-
-            int T = ((PC ^ (PC >> 2))) ^ taken;
-            int PATH = PC ^ (PC >> 2) ^ (PC >> 4);
-            if ((brtype == 3) & taken)
-            {
-                T = (T ^ (nextPC >> 2));
-                PATH = PATH ^ (nextPC >> 2) ^ (nextPC >> 4);
-            }
-
-            for (int t = 0; t < maxt; t++)
-            {
-                bool DIR = (T & 1);
-                T >>= 1;
-                int PATHBIT = (PATH & 127);
-                PATH >>= 1;
-                //update  history
-                Y--;  //ptghist
-                active_hist.ghist[Y & (HISTBUFFERLENGTH - 1)] = DIR;
-                X = (X << 1) ^ PATHBIT; //phist
-
-
-                // updates to folded histories
-                for (int i = 1; i <= NHIST; i++)
-                {
-                    H[i].update (active_hist.ghist, Y);
-                    G[i].update (active_hist.ghist, Y);
-                    J[i].update (active_hist.ghist, Y);
-                }
+                uint64_t& L = active_hist.L_shist.write(PC);
+                L = (L << 1) + (taken);
+                uint64_t& S = active_hist.S_slhist.write(PC);
+                S = ((S << 1) + taken) ^ (PC & 15);
+                uint64_t& T = active_hist.T_slhist.write(PC);
+                T = (T << 1) + taken;
             }
-
-            X = (X & ((1<<PHISTWIDTH)-1));
-
         }//END UPDATE  HISTORIES
 
         // PREDICTOR UPDATE
@@ -1232,134 +2092,151 @@ class CBP2016_TAGE_SC_L
         //void update (UINT64 PC, int brtype, bool resolveDir, bool predDir, UINT64 nextPC)
         void update (uint64_t seq_no, uint8_t piece, UINT64 PC, bool resolveDir, bool predDir, UINT64 nextPC)
         {
-            const auto pred_hist_key = get_unique_inst_id(seq_no, piece);
-            const auto& pred_time_history = pred_time_histories.at(pred_hist_key);
-            const bool pred_taken = predict_using_given_hist(seq_no, piece, PC, pred_time_history, false/*pred_time_predict*/);
-            //if(pred_taken != predDir)
-            //{
-            //    std::cout<<"id:"<<seq_no<<" PC:0x"<<std::hex<<PC<<std::dec<<" resolveDir:"<<resolveDir<<" pred_dir_at_pred:"<<predDir<<" pred_dir_at_update:"<<pred_taken<<std::endl;
-            //    assert(false);
-            //} 
+            const auto& pred_time_history = pred_time_histories.at(seq_no, piece);
+            if constexpr (CFG::BIAS_FILTER)
+            {
+                bf_mispredicted += pred_time_history.filtered && (predDir != resolveDir);
+                if (!frozen)
+                    bf_update (PC, resolveDir);
+            }
+            if (!frozen && !pred_time_history.filtered)
+            {
+                const bool pred_taken = predict_using_given_hist(seq_no, piece, PC, pred_time_history, false/*pred_time_predict*/);
+                //if(pred_taken != predDir)
+                //{
+                //    std::cout<<"id:"<<seq_no<<" PC:0x"<<std::hex<<PC<<std::dec<<" resolveDir:"<<resolveDir<<" pred_dir_at_pred:"<<predDir<<" pred_dir_at_update:"<<pred_taken<<std::endl;
+                //    assert(false);
+                //} 
+                TRACE_BEGIN (seq_no, piece, PC);
+                if (heatmap.enabled())
+                    heatmap.begin_update (seq_no, piece);
+                update(PC, resolveDir, pred_taken, nextPC, pred_time_history);
+            }
             // remove checkpointed hist
-            update(PC, resolveDir, pred_taken, nextPC, pred_time_history);
-            pred_time_histories.erase(pred_hist_key);
+            profile.record(PC, pred_time_history.provider, pred_time_history.hit_bank, predDir != resolveDir);
+            pred_time_histories.erase(seq_no, piece);
+            if constexpr (LOOPPREDICTOR)
+                release_loop_log ();
+            if constexpr (CKPT_GROUP)
+                release_fold_log ();
         }
 
-        void update (UINT64 PC, bool resolveDir, bool pred_taken, UINT64 nextPC, const cbp_hist_t& hist_to_use)
+        void update (UINT64 PC, bool resolveDir, bool pred_taken, UINT64 nextPC, const cbp_checkpoint_t& hist_to_use)
         {
-#ifdef SC
-#ifdef LOOPPREDICTOR
-            if(pred_taken != resolveDir)  // incorrect loophhist updates in spec_update
+            if constexpr (SC)
             {
-                // fix active hist.ltable and active_hist.WITHLOOP
-                active_hist.ltable = hist_to_use.ltable;
-                active_hist.WITHLOOP = hist_to_use.WITHLOOP;
-                if (LVALID)
+                if constexpr (LOOPPREDICTOR)
                 {
-                    if (pred_taken != predloop)
-                        ctrupdate (active_hist.WITHLOOP, (predloop == resolveDir), 7);
+                    if(pred_taken != resolveDir)  // incorrect loophhist updates in spec_update
+                    {
+                        // fix ltable and active_hist.WITHLOOP
+                        loop_rollback (hist_to_use.LPOS);
+                        active_hist.WITHLOOP = hist_to_use.WITHLOOP;
+                        if (LVALID)
+                        {
+                            if (pred_taken != predloop)
+                                ctrupdate (active_hist.WITHLOOP, (predloop == resolveDir), 7);
+                        }
+                        loopupdate (PC, resolveDir, (pred_taken != resolveDir));
+                    }
                 }
-                loopupdate (PC, resolveDir, (pred_taken != resolveDir), active_hist.ltable);
-            }
-#endif
 
-            bool SCPRED = (LSUM >= 0);
-            if (pred_inter != SCPRED)
-            {
-                if ((abs (LSUM) < THRES))
-                    if ((HighConf))
-                    {
+                bool SCPRED = (LSUM >= 0);
+                if (pred_inter != SCPRED)
+                {
+                    if ((abs (LSUM) < THRES))
+                        if ((HighConf))
+                        {
 
 
-                        if ((abs (LSUM) < THRES / 2))
-                            if ((abs (LSUM) >= THRES / 4))
-                                ctrupdate (SecondH, (pred_inter == resolveDir), CONFWIDTH);
-                    }
-                if ((MedConf))
-                    if ((abs (LSUM) < THRES / 4))
-                    {
-                        ctrupdate (FirstH, (pred_inter == resolveDir), CONFWIDTH);
-                    }
-            }
+                            if ((abs (LSUM) < THRES / 2))
+                                if ((abs (LSUM) >= THRES / 4))
+                                    ctrupdate (SecondH, (pred_inter == resolveDir), CONFWIDTH);
+                        }
+                    if ((MedConf))
+                        if ((abs (LSUM) < THRES / 4))
+                        {
+                            ctrupdate (FirstH, (pred_inter == resolveDir), CONFWIDTH);
+                        }
+                }
 
-            if ((SCPRED != resolveDir) || ((abs (LSUM) < THRES)))
-            {
+                if ((SCPRED != resolveDir) || ((abs (LSUM) < THRES)))
                 {
-                    if (SCPRED != resolveDir)
                     {
-                        Pupdatethreshold[INDUPD] += 1;
-                        updatethreshold+=1;
-                    }
+                        if (SCPRED != resolveDir)
+                        {
+                            Pupdatethreshold[INDUPD] += 1;
+                            updatethreshold+=1;
+                        }
 
-                    else
-                    {
-                        Pupdatethreshold[INDUPD] -= 1;
-                        updatethreshold -= 1;
-                    }
+                        else
+                        {
+                            Pupdatethreshold[INDUPD] -= 1;
+                            updatethreshold -= 1;
+                        }
 
 
-                    if (Pupdatethreshold[INDUPD] >= (1 << (WIDTHRESP - 1)))
-                        Pupdatethreshold[INDUPD] = (1 << (WIDTHRESP - 1)) - 1;
-                    //Pupdatethreshold[INDUPD] could be negative
-                    if (Pupdatethreshold[INDUPD] < -(1 << (WIDTHRESP - 1)))
-                        Pupdatethreshold[INDUPD] = -(1 << (WIDTHRESP - 1));
-                    if (updatethreshold >= (1 << (WIDTHRES - 1)))
-                    {
-                        updatethreshold = (1 << (WIDTHRES - 1)) - 1;
+                        if (Pupdatethreshold[INDUPD] >= (1 << (WIDTHRESP - 1)))
+                            Pupdatethreshold[INDUPD] = (1 << (WIDTHRESP - 1)) - 1;
+                        //Pupdatethreshold[INDUPD] could be negative
+                        if (Pupdatethreshold[INDUPD] < -(1 << (WIDTHRESP - 1)))
+                            Pupdatethreshold[INDUPD] = -(1 << (WIDTHRESP - 1));
+                        if (updatethreshold >= (1 << (WIDTHRES - 1)))
+                        {
+                            updatethreshold = (1 << (WIDTHRES - 1)) - 1;
+                        }
+                        //updatethreshold could be negative
+                        if (updatethreshold < -(1 << (WIDTHRES - 1)))
+                        {
+                            updatethreshold = -(1 << (WIDTHRES - 1));
+                        }
                     }
-                    //updatethreshold could be negative
-                    if (updatethreshold < -(1 << (WIDTHRES - 1)))
+#ifdef VARTHRES
                     {
-                        updatethreshold = -(1 << (WIDTHRES - 1));
+                        int XSUM =
+                            LSUM - ((WB[INDUPDS] >= 0) * ((2 * Bias[get_bias_index(PC)] + 1) +
+                                        (2 * BiasSK[get_biassk_index(PC)] + 1) +
+                                        (2 * BiasBank[get_biasbank_index(PC)] + 1)));
+                        if ((XSUM +
+                                    ((2 * Bias[get_bias_index(PC)] + 1) + (2 * BiasSK[get_biassk_index(PC)] + 1) +
+                                     (2 * BiasBank[get_biasbank_index(PC)] + 1)) >= 0) != (XSUM >= 0))
+                            ctrupdate (WB[INDUPDS],
+                                    (((2 * Bias[get_bias_index(PC)] + 1) +
+                                      (2 * BiasSK[get_biassk_index(PC)] + 1) +
+                                      (2 * BiasBank[get_biasbank_index(PC)] + 1) >= 0) == resolveDir),
+                                    EWIDTH);
                     }
-                }
-#ifdef VARTHRES
-                {
-                    int XSUM =
-                        LSUM - ((WB[INDUPDS] >= 0) * ((2 * Bias[get_bias_index(PC)] + 1) +
-                                    (2 * BiasSK[get_biassk_index(PC)] + 1) +
-                                    (2 * BiasBank[get_biasbank_index(PC)] + 1)));
-                    if ((XSUM +
-                                ((2 * Bias[get_bias_index(PC)] + 1) + (2 * BiasSK[get_biassk_index(PC)] + 1) +
-                                 (2 * BiasBank[get_biasbank_index(PC)] + 1)) >= 0) != (XSUM >= 0))
-                        ctrupdate (WB[INDUPDS],
-                                (((2 * Bias[get_bias_index(PC)] + 1) +
-                                  (2 * BiasSK[get_biassk_index(PC)] + 1) +
-                                  (2 * BiasBank[get_biasbank_index(PC)] + 1) >= 0) == resolveDir),
-                                EWIDTH);
-                }
-#endif
-                ctrupdate (Bias[get_bias_index(PC)], resolveDir, PERCWIDTH);
-                ctrupdate (BiasSK[get_biassk_index(PC)], resolveDir, PERCWIDTH);
-                ctrupdate (BiasBank[get_biasbank_index(PC)], resolveDir, PERCWIDTH);
-                Gupdate ((PC << 1) + pred_inter, resolveDir,
-                        hist_to_use.GHIST, Gm, GGEHL, GNB, LOGGNB, WG);
-                Gupdate (PC, resolveDir, hist_to_use.phist, Pm, PGEHL, PNB, LOGPNB, WP);
-#ifdef LOCALH
-                Gupdate (PC, resolveDir, hist_to_use.L_shist[get_local_index(PC)], Lm, LGEHL, LNB, LOGLNB,
-                        WL);
-#ifdef LOCALS
-                Gupdate (PC, resolveDir, hist_to_use.S_slhist[get_second_local_index(PC)], Sm,
-                        SGEHL, SNB, LOGSNB, WS);
 #endif
-#ifdef LOCALT
+                    ctrupdate (Bias[get_bias_index(PC)], resolveDir, PERCWIDTH);
+                    ctrupdate (BiasSK[get_biassk_index(PC)], resolveDir, PERCWIDTH);
+                    ctrupdate (BiasBank[get_biasbank_index(PC)], resolveDir, PERCWIDTH);
+                    Gupdate ((PC << 1) + pred_inter, resolveDir, GGI, GGEHL, GNB, WG);
+                    Gupdate (PC, resolveDir, hist_to_use.PGI.data (), PGEHL, PNB, WP);
+                    if constexpr (LOCALH)
+                    {
+                        Gupdate (PC, resolveDir, hist_to_use.LGI.data (), LGEHL, LNB, WL);
+                        if constexpr (LOCALS)
+                        {
+                            Gupdate (PC, resolveDir, hist_to_use.SGI.data (), SGEHL, SNB, WS);
+                        }
+                        if constexpr (LOCALT)
+                        {
 
-                Gupdate (PC, resolveDir, hist_to_use.T_slhist[get_third_local_index(PC)], Tm, TGEHL, TNB, LOGTNB,
-                        WT);
-#endif
-#endif
+                            Gupdate (PC, resolveDir, hist_to_use.TGI.data (), TGEHL, TNB, WT);
+                        }
+                    }
 
 
-#ifdef IMLI
-                Gupdate (PC, resolveDir, hist_to_use.IMHIST[(hist_to_use.IMLIcount)], IMm, IMGEHL, IMNB,
-                        LOGIMNB, WIM);
-                Gupdate (PC, resolveDir, hist_to_use.IMLIcount, Im, IGEHL, INB, LOGINB, WI);
-#endif
+                    if constexpr (IMLI)
+                    {
+                        Gupdate (PC, resolveDir, hist_to_use.IMGI.data (), IMGEHL, IMNB, WIM);
+                        Gupdate (PC, resolveDir, hist_to_use.IGI.data (), IGEHL, INB, WI);
+                    }
 
 
 
+                }
             }
-#endif
 
             //TAGE UPDATE
             bool ALLOC = ((tage_pred != resolveDir) & (HitBank < NHIST));
@@ -1419,6 +2296,7 @@ class CBP2016_TAGE_SC_L
                     bool Done = false;
                     if (NOSKIP[i])
                     {
+                        age_u (i);
                         if (gtable[i][GI[i]].u == 0)
 
                         {
@@ -1430,6 +2308,9 @@ class CBP2016_TAGE_SC_L
                             {
                                 gtable[i][GI[i]].tag = GTAG[i];
                                 gtable[i][GI[i]].ctr = (resolveDir) ? 0 : -1;
+                                TRACE_EVENT (EVENT_ALLOC, i, resolveDir, TICK, 0);
+                                if (heatmap.enabled())
+                                    heatmap.alloc (hm_bank[i], GI[i]);
                                 NA++;
                                 if (T <= 0)
                                 {
@@ -1466,6 +2347,7 @@ class CBP2016_TAGE_SC_L
                         if (NOSKIP[i])
                         {
 
+                            age_u (i);
                             if (gtable[i][GI[i]].u == 0)
                             {
 #ifdef OPTREMP
@@ -1475,6 +2357,9 @@ class CBP2016_TAGE_SC_L
                                 {
                                     gtable[i][GI[i]].tag = GTAG[i];
                                     gtable[i][GI[i]].ctr = (resolveDir) ? 0 : -1;
+                                    TRACE_EVENT (EVENT_ALLOC, i, resolveDir, TICK, 0);
+                                    if (heatmap.enabled())
+                                        heatmap.alloc (hm_bank[i], GI[i]);
                                     NA++;
                                     if (T <= 0)
                                     {
@@ -1514,10 +2399,10 @@ class CBP2016_TAGE_SC_L
                     TICK = 0;
                 if (TICK >= BORNTICK)
                 {
+                    TRACE_EVENT (EVENT_U_RESET, 0, 0, TICK, 0);
 
-                    for (int i = 1; i <= BORN; i += BORN - 1)
-                        for (int j = 0; j < SizeTable[i]; j++)
-                            gtable[i][j].u >>= 1;
+                    // the u counters are halved as their chunks are next updated
+                    UEpoch++;
                     TICK = 0;
 
 
@@ -1527,20 +2412,20 @@ class CBP2016_TAGE_SC_L
             //update predictions
             if (HitBank > 0)
             {
+                age_u (HitBank);
                 if (abs (2 * gtable[HitBank][GI[HitBank]].ctr + 1) == 1)
                     if (LongestMatchPred != resolveDir)
 
                     {           // acts as a protection 
                         if (AltBank > 0)
                         {
-                            ctrupdate (gtable[AltBank][GI[AltBank]].ctr,
-                                    resolveDir, CWIDTH);
+                            tagectrupdate (gtable[AltBank][GI[AltBank]], resolveDir);
                         }
                         if (AltBank == 0)
                             baseupdate (resolveDir);
 
                     }
-                ctrupdate (gtable[HitBank][GI[HitBank]].ctr, resolveDir, CWIDTH);
+                tagectrupdate (gtable[HitBank][GI[HitBank]], resolveDir);
                 //sign changes: no way it can have been useful
                 if (abs (2 * gtable[HitBank][GI[HitBank]].ctr + 1) == 1)
                     gtable[HitBank][GI[HitBank]].u = 0;
@@ -1571,36 +2456,43 @@ class CBP2016_TAGE_SC_L
         }//END PREDICTOR UPDATE
 
 #define GINDEX (((uint64_t) PC) ^ bhist ^ (bhist >> (8 - i)) ^ (bhist >> (16 - 2 * i)) ^ (bhist >> (24 - 3 * i)) ^ (bhist >> (32 - 3 * i)) ^ (bhist >> (40 - 4 * i))) & ((1 << (logs - (i >= (NBR - 2)))) - 1)
-        int Gpredict (UINT64 PC, uint64_t BHIST, int *length, int8_t ** tab, int NBR, int logs, int8_t * W)
+        void Gindex (UINT64 PC, uint64_t BHIST, const int *length, int NBR, int logs, uint16_t * index) const
         {
-            int PERCSUM = 0;
             for (int i = 0; i < NBR; i++)
             {
                 uint64_t bhist = BHIST & ((uint64_t) ((1ULL << length[i]) - 1));
-                uint64_t index = GINDEX;
-
-                int8_t ctr = tab[i][index];
-
-                PERCSUM += (2 * ctr + 1);
+                index[i] = GINDEX;
             }
+        }
+        // sum of the centered counters (2 * ctr + 1) of the NBR tables, with the indices computed beforehand
+        static int Gsum (const uint16_t * index, int8_t ** tab, int NBR)
+        {
+            int SUM = 0;
+            for (int i = 0; i < NBR; i++)
+                SUM += tab[i][index[i]];
+            return 2 * SUM + NBR;
+        }
+        int Gpredict (UINT64 PC, const uint16_t * index, int8_t ** tab, int NBR, int8_t * W)
+        {
+            int PERCSUM = Gsum (index, tab, NBR);
 #ifdef VARTHRES
             PERCSUM = (1 + (W[INDUPDS] >= 0)) * PERCSUM;
 #endif
             return ((PERCSUM));
         }
-        void Gupdate (UINT64 PC, bool taken, uint64_t BHIST, int *length,
-                int8_t ** tab, int NBR, int logs, int8_t * W)
+        void Gupdate (UINT64 PC, bool taken, const uint16_t * index,
+                int8_t ** tab, int NBR, int8_t * W)
         {
 
-            int PERCSUM = 0;
+            int PERCSUM = Gsum (index, tab, NBR);
 
+            // saturating update of all the counters, without branches
+            const int8_t CTRMAX = (1 << (PERCWIDTH - 1)) - 1;
+            const int8_t CTRMIN = -(1 << (PERCWIDTH - 1));
             for (int i = 0; i < NBR; i++)
             {
-                uint64_t bhist = BHIST & ((uint64_t) ((1ULL << length[i]) - 1));
-                uint64_t index = GINDEX;
-
-                PERCSUM += (2 * tab[i][index] + 1);
-                ctrupdate (tab[i][index], taken, PERCWIDTH);
+                int8_t& ctr = tab[i][index[i]];
+                ctr += taken ? (ctr < CTRMAX) : -(ctr > CTRMIN);
             }
 #ifdef VARTHRES
             {
@@ -1613,7 +2505,7 @@ class CBP2016_TAGE_SC_L
 
 
 
-#ifdef LOOPPREDICTOR
+        // loop predictor, only used if LOOPPREDICTOR
         int lindex (UINT64 PC)
         {
             return (((PC ^ (PC >> 2)) & ((1 << (LOGL - 2)) - 1)) << 2);
@@ -1624,16 +2516,20 @@ class CBP2016_TAGE_SC_L
         //skewed associative 4-way
         //At fetch time: speculative
 #define CONFLOOP 15
-        bool getloop (UINT64 PC, const cbp_hist_t& hist_to_use)
+        void loopindex (UINT64 PC)
         {
-            const auto& ltable = hist_to_use.ltable;
-            LHIT = -1;
-
             LI = lindex (PC);
             LIB = ((PC >> (LOGL - 2)) & ((1 << (LOGL - 2)) - 1));
             LTAG = (PC >> (LOGL - 2)) & ((1 << 2 * LOOPTAG) - 1);
             LTAG ^= (LTAG >> LOOPTAG);
             LTAG = (LTAG & ((1 << LOOPTAG) - 1));
+        }
+
+        bool getloop (UINT64 PC)
+        {
+            LHIT = -1;
+
+            loopindex (PC);
 
             for (int i = 0; i < 4; i++)
             {
@@ -1659,70 +2555,113 @@ class CBP2016_TAGE_SC_L
 
 
 
-        void loopupdate (UINT64 PC, bool Taken, bool ALLOC, std::vector<lentry>& ltable)
+        // logs the current value of ltable[index] before it is written
+        lentry& loop_entry_for_write (int index)
+        {
+            loop_log.push_back ({(uint8_t) index, ltable[index]});
+            return ltable[index];
+        }
+
+        // rolls ltable back to its state at repair log position pos. The rollback is itself logged, so that the
+        // state at any position after pos can still be rebuilt for the younger checkpoints.
+        void loop_rollback (uint64_t pos)
+        {
+            static_assert ((1 << LOGL) <= 64, "the rollback tracks the touched entries in a 64-bit mask");
+            loop_undo_t redo[64];
+            int nredo = 0;
+            uint64_t touched = 0;
+            for (uint64_t p = loop_log.end (); p-- > pos;)
+            {
+                const loop_undo_t& rec = loop_log[p];
+                if (!((touched >> rec.index) & 1))
+                {
+                    touched |= (uint64_t) 1 << rec.index;
+                    redo[nredo++] = {rec.index, ltable[rec.index]};
+                }
+                ltable[rec.index] = rec.old;
+            }
+            for (int i = 0; i < nredo; i++)
+                loop_log.push_back (redo[i]);
+        }
+
+        // releases the repair log records that no live checkpoint can roll back past
+        void release_loop_log ()
+        {
+            while (loop_ckpts.begin () != loop_ckpts.end ())
+            {
+                const loop_ckpt_ref_t& ref = loop_ckpts[loop_ckpts.begin ()];
+                if (pred_time_histories.contains (ref.seq_no, ref.piece))
+                    break;
+                loop_ckpts.release (loop_ckpts.begin () + 1);
+            }
+            loop_log.release ((loop_ckpts.begin () != loop_ckpts.end ()) ? loop_ckpts[loop_ckpts.begin ()].LPOS : loop_log.end ());
+        }
+
+        void loopupdate (UINT64 PC, bool Taken, bool ALLOC)
         {
             if (LHIT >= 0)
             {
                 int index = (LI ^ ((LIB >> LHIT) << 2)) + LHIT;
+                lentry& entry = loop_entry_for_write (index);
                 //already a hit 
                 if (LVALID)
                 {
                     if (Taken != predloop)
                     {
                         // free the entry
-                        ltable[index].NbIter = 0;
-                        ltable[index].age = 0;
-                        ltable[index].confid = 0;
-                        ltable[index].CurrentIter = 0;
+                        entry.NbIter = 0;
+                        entry.age = 0;
+                        entry.confid = 0;
+                        entry.CurrentIter = 0;
                         return;
 
                     }
                     else if ((predloop != tage_pred) || ((MYRANDOM () & 7) == 0))
-                        if (ltable[index].age < CONFLOOP)
-                            ltable[index].age++;
+                        if (entry.age < CONFLOOP)
+                            entry.age++;
                 }
 
-                ltable[index].CurrentIter++;
-                ltable[index].CurrentIter &= ((1 << WIDTHNBITERLOOP) - 1);
+                entry.CurrentIter++;
+                entry.CurrentIter &= ((1 << WIDTHNBITERLOOP) - 1);
                 //loop with more than 2** WIDTHNBITERLOOP iterations are not treated correctly; but who cares :-)
-                if (ltable[index].CurrentIter > ltable[index].NbIter)
+                if (entry.CurrentIter > entry.NbIter)
                 {
-                    ltable[index].confid = 0;
-                    ltable[index].NbIter = 0;
+                    entry.confid = 0;
+                    entry.NbIter = 0;
                     //treat like the 1st encounter of the loop 
                 }
-                if (Taken != ltable[index].dir)
+                if (Taken != entry.dir)
                 {
-                    if (ltable[index].CurrentIter == ltable[index].NbIter)
+                    if (entry.CurrentIter == entry.NbIter)
                     {
-                        if (ltable[index].confid < CONFLOOP)
-                            ltable[index].confid++;
-                        if (ltable[index].NbIter < 3)
+                        if (entry.confid < CONFLOOP)
+                            entry.confid++;
+                        if (entry.NbIter < 3)
                             //just do not predict when the loop count is 1 or 2     
                         {
                             // free the entry
-                            ltable[index].dir = Taken;
-                            ltable[index].NbIter = 0;
-                            ltable[index].age = 0;
-                            ltable[index].confid = 0;
+                            entry.dir = Taken;
+                            entry.NbIter = 0;
+                            entry.age = 0;
+                            entry.confid = 0;
                         }
                     }
                     else
                     {
-                        if (ltable[index].NbIter == 0)
+                        if (entry.NbIter == 0)
                         {
                             // first complete nest;
-                            ltable[index].confid = 0;
-                            ltable[index].NbIter = ltable[index].CurrentIter;
+                            entry.confid = 0;
+                            entry.NbIter = entry.CurrentIter;
                         }
                         else
                         {
                             //not the same number of iterations as last time: free the entry
-                            ltable[index].NbIter = 0;
-                            ltable[index].confid = 0;
+                            entry.NbIter = 0;
+                            entry.confid = 0;
                         }
                     }
-                    ltable[index].CurrentIter = 0;
+                    entry.CurrentIter = 0;
                 }
 
             }
@@ -1736,25 +2675,27 @@ class CBP2016_TAGE_SC_L
                     {
                         int loop_hit_way_loc = (X + i) & 3;
                         int index = (LI ^ ((LIB >> loop_hit_way_loc) << 2)) + loop_hit_way_loc;
-                        if (ltable[index].age == 0)
+                        lentry& entry = loop_entry_for_write (index);
+                        if (entry.age == 0)
                         {
-                            ltable[index].dir = !Taken;
+                            entry.dir = !Taken;
                             // most of mispredictions are on last iterations
-                            ltable[index].TAG = LTAG;
-                            ltable[index].NbIter = 0;
-                            ltable[index].age = 7;
-                            ltable[index].confid = 0;
-                            ltable[index].CurrentIter = 0;
+                            entry.TAG = LTAG;
+                            entry.NbIter = 0;
+                            entry.age = 7;
+                            entry.confid = 0;
+                            entry.CurrentIter = 0;
+                            if (heatmap.enabled())
+                                heatmap.alloc (hm_ltable, index);
                             break;
 
                         }
                         else
-                            ltable[index].age--;
+                            entry.age--;
                         break;
                     }
             }
         }
-#endif    // LOOPPREDICTOR
 };
 // =================
 // Predictor End
@@ -1764,4 +2705,4 @@ class CBP2016_TAGE_SC_L
 #undef UINT64
 
 #endif
-static CBP2016_TAGE_SC_L cbp2016_tage_sc_l;
+static CBP2016_TAGE_SC_L<> cbp2016_tage_sc_l(cbp_global_history);
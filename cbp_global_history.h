@@ -0,0 +1,10 @@
+#pragma once
+
+#include "lib/global_history.h"
+
+// The global history of the conditional branch predictors, advanced once per branch in spec_update().
+// TAGE-SC-L folds its history lengths into 37 rows of index and tag registers; the spare rows are left for the other
+// predictors.
+using cbp_global_history_t = global_history_t<40, 3, 4096, 27>;
+
+static cbp_global_history_t cbp_global_history;
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "cbp.h"
+
+//
+// Predictor plugins
+//
+// A predictor built as a shared object and loaded by the simulator at runtime (cbp -p <plugin.so>[,<args>]), instead
+// of being linked into cbp: several of them can be simulated side by side by the batch driver (-B) and the fan-out
+// modes (-N, -u), each in its worker process, without rebuilding the simulator.
+//
+// A plugin exports one symbol, cbp_plugin_entry(), which returns the table of its hooks: the cbp.h hooks, each with
+// the handle of the predictor instance it is called on, as returned by create(). The simulator creates one instance
+// per process that simulates the plugin, then calls begin(), the per-event hooks and end() on it as it would call
+// beginCondDirPredictor() and the others.
+//
+// The table is of C++ function pointers taking the structures of lib/sim_common_structs.h and cbp.h by reference, so
+// a plugin has to be built with the same compiler and the same sources of those structures as the simulator (make
+// plugin). CBP_PLUGIN_ABI_VERSION changes with the table, and the sizes of DecodeInfo and ExecuteInfo are checked as
+// well, which catches the structures drifting in between: the simulator refuses a plugin that does not match either.
+//
+// The symbols of cbp are visible to the plugin (cbp is linked with -rdynamic), so that a predictor built from the
+// repository's headers finds the parameters (PREDICTOR_CONFIG, BRANCH_PROFILE_CSV...) and the huge page arena of the
+// simulator, while its own symbols stay local to it (-fvisibility=hidden -Bsymbolic).
+//
+
+#define CBP_PLUGIN_ABI_VERSION 5
+#define CBP_PLUGIN_ENTRY "cbp_plugin_entry"
+
+struct cbp_plugin_t
+{
+    uint32_t abi_version;           // CBP_PLUGIN_ABI_VERSION
+    uint32_t decode_info_size;      // sizeof(DecodeInfo)
+    uint32_t exec_info_size;        // sizeof(ExecuteInfo)
+    uint32_t hooks;                 // as cbp_hooks: the notify_* hooks to call
+    const char *name;
+
+    // A new instance, configured by the arguments of -p (an empty string without). nullptr if it cannot be created.
+    // It lives as long as the process, as the globals of a linked predictor do.
+    void *(*create)(const char *args);
+
+    void (*begin)(void *self);
+    void (*end)(void *self);
+    bool (*get_cond_dir_prediction)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle);
+    void (*spec_update)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc);
+
+    // Only those of hooks need to be set: the others may be nullptr.
+    void (*notify_instr_fetch)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t fetch_cycle);
+    void (*notify_instr_decode)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& decode_info, uint64_t decode_cycle);
+    void (*notify_agen_complete)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& decode_info, uint64_t mem_va, uint64_t mem_sz, uint64_t agen_cycle);
+    void (*notify_instr_execute_resolve)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& exec_info, uint64_t execute_cycle);
+    void (*notify_instr_commit)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& exec_info, uint64_t commit_cycle);
+    void (*notify_batch)(void *self, const cbp_batch_t& batch);
+    void (*notify_static_id)(void *self, uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id);
+
+    // Optional, nullptr if the plugin does not support snapshots (-S, -s) and frozen evaluation (-e).
+    void (*snapshot)(void *self, snapshot_t& s);
+    bool (*freeze)(void *self);
+    // Optional, nullptr to compare the snapshots instead: the canonical form of the state that the lockstep validation
+    // (-l) compares, as dump_cond_dir_predictor() writes it.
+    void (*dump)(void *self, snapshot_t& s);
+
+    // Optional, nullptr if the plugin has nothing to prefetch: the next get_cond_dir_prediction() of self will be for
+    // pc, so start loading what it reads (__builtin_prefetch), without waiting for it. Called by the interleaved
+    // fan-out (CBP_FANOUT_GROUP, lib/fanout.h) before it moves on to the other instances of the worker.
+    void (*prefetch)(void *self, uint64_t pc);
+
+    // True if the instances share global state, as those of a predictor built from the cbp.h hooks (make plugin), so
+    // that a process can only have one: the interleaved fan-out (CBP_FANOUT_GROUP) then runs one per worker.
+    bool single_instance;
+};
+
+// The entry point of a plugin: its table, or nullptr if it was not built for abi_version, the simulator's.
+extern "C" const cbp_plugin_t *cbp_plugin_entry(uint32_t abi_version);
+typedef const cbp_plugin_t *(*cbp_plugin_entry_t)(uint32_t abi_version);
+
+//
+// CBP_PLUGIN(P, name, hooks)
+//
+// Defines the entry point of a plugin whose instances are objects of class P, constructed from the arguments of -p,
+// with the members begin(), end(), get_cond_dir_prediction(), spec_update() and notify_*() of the signatures of the
+// cbp.h hooks, and snapshot(), freeze(), dump() and prefetch() if it supports them. Those left out of hooks need not be
+// defined.
+//
+template <class P, uint32_t HOOKS>
+struct cbp_plugin_adapter
+{
+    template <class T, class = void>
+    struct has_snapshot : std::false_type {};
+    template <class T>
+    struct has_snapshot<T, std::void_t<decltype(std::declval<T&>().snapshot(std::declval<snapshot_t&>()))>> : std::true_type {};
+    template <class T, class = void>
+    struct has_freeze : std::false_type {};
+    template <class T>
+    struct has_freeze<T, std::void_t<decltype(std::declval<T&>().freeze())>> : std::true_type {};
+    template <class T, class = void>
+    struct has_dump : std::false_type {};
+    template <class T>
+    struct has_dump<T, std::void_t<decltype(std::declval<T&>().dump(std::declval<snapshot_t&>()))>> : std::true_type {};
+    template <class T, class = void>
+    struct has_prefetch : std::false_type {};
+    template <class T>
+    struct has_prefetch<T, std::void_t<decltype(std::declval<T&>().prefetch(uint64_t()))>> : std::true_type {};
+
+    static P& self(void *p) { return *static_cast<P *>(p); }
+
+    static cbp_plugin_t table(const char *name)
+    {
+        cbp_plugin_t t = {CBP_PLUGIN_ABI_VERSION, sizeof(DecodeInfo), sizeof(ExecuteInfo), HOOKS, name};
+        t.create = [](const char *args) -> void * { return new P(args); };
+        t.begin = [](void *p) { self(p).begin(); };
+        t.end = [](void *p) { self(p).end(); };
+        t.get_cond_dir_prediction = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle) {
+            return self(p).get_cond_dir_prediction(seq_no, piece, pc, cycle);
+        };
+        t.spec_update = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc) {
+            self(p).spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+        };
+        if constexpr ((HOOKS & CBP_HOOK_FETCH) != 0)
+            t.notify_instr_fetch = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle) {
+                self(p).notify_instr_fetch(seq_no, piece, pc, cycle);
+            };
+        if constexpr ((HOOKS & CBP_HOOK_DECODE) != 0)
+            t.notify_instr_decode = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& info, uint64_t cycle) {
+                self(p).notify_instr_decode(seq_no, piece, pc, info, cycle);
+            };
+        if constexpr ((HOOKS & CBP_HOOK_AGEN) != 0)
+            t.notify_agen_complete = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle) {
+                self(p).notify_agen_complete(seq_no, piece, pc, info, mem_va, mem_sz, cycle);
+            };
+        if constexpr ((HOOKS & CBP_HOOK_EXECUTE) != 0)
+            t.notify_instr_execute_resolve = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle) {
+                self(p).notify_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+            };
+        if constexpr ((HOOKS & CBP_HOOK_COMMIT) != 0)
+            t.notify_instr_commit = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle) {
+                self(p).notify_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+            };
+        if constexpr ((HOOKS & CBP_HOOK_BATCH) != 0)
+            t.notify_batch = [](void *p, const cbp_batch_t& batch) { self(p).notify_batch(batch); };
+        if constexpr ((HOOKS & CBP_HOOK_STATIC_ID) != 0)
+            t.notify_static_id = [](void *p, uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id) {
+                self(p).notify_static_id(seq_no, piece, pc, static_id);
+            };
+        if constexpr (has_snapshot<P>::value)
+            t.snapshot = [](void *p, snapshot_t& s) { self(p).snapshot(s); };
+        if constexpr (has_freeze<P>::value)
+            t.freeze = [](void *p) { return self(p).freeze(); };
+        if constexpr (has_dump<P>::value)
+            t.dump = [](void *p, snapshot_t& s) { self(p).dump(s); };
+        if constexpr (has_prefetch<P>::value)
+            t.prefetch = [](void *p, uint64_t pc) { self(p).prefetch(pc); };
+        return t;
+    }
+};
+
+#define CBP_PLUGIN(P, name, hooks)                                                              \
+    extern "C" __attribute__((visibility("default"))) const cbp_plugin_t *cbp_plugin_entry(uint32_t abi_version) \
+    {                                                                                           \
+        static const cbp_plugin_t table = cbp_plugin_adapter<P, (hooks)>::table(name);          \
+        return (abi_version == CBP_PLUGIN_ABI_VERSION) ? &table : nullptr;                      \
+    }
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Hybrid conditional branch predictor assembled at compile time from existing predictor instances.
+//
+// Every call is fanned out to the components in order, with no virtual dispatch. A component that takes the
+// prediction made so far as a 4th predict() argument is given the previous component's prediction (false for the
+// first), as the sample predictor is given that of TAGE-SC-L, so cascades need no extra plumbing. The chooser policy
+// then turns the components' predictions into the final one.
+//
+// Components provide predict(), update() and either history_update(seq_no, piece, pc, br_type, pred_dir,
+// resolve_dir, next_pc) or history_update(seq_no, piece, pc, resolve_dir, next_pc); setup(), terminate() and
+// prefetch(pc) are optional, and so are snapshot(snapshot_t&), without which a snapshot of the composite fails,
+// freeze(), without which it cannot be evaluated with frozen tables (-e), and dump(snapshot_t&), the canonical form of
+// the state compared by the lockstep validation (-l), which is the snapshot without it.
+
+// The last component decides: the others are only consulted through the cascade.
+struct choose_last_t
+{
+    template <size_t N>
+    static bool choose(const std::array<bool, N>& preds)
+    {
+        return preds[N - 1];
+    }
+};
+
+struct choose_majority_t
+{
+    template <size_t N>
+    static bool choose(const std::array<bool, N>& preds)
+    {
+        size_t taken = 0;
+        for (bool p : preds)
+            taken += p;
+        return 2 * taken > N;
+    }
+};
+
+namespace composite_detail {
+
+template <class C, class = void>
+struct takes_prev_pred : std::false_type {};
+template <class C>
+struct takes_prev_pred<C, std::void_t<decltype(std::declval<C&>().predict(uint64_t(), uint8_t(), uint64_t(), bool()))>> : std::true_type {};
+
+template <class C, class = void>
+struct takes_br_type : std::false_type {};
+template <class C>
+struct takes_br_type<C, std::void_t<decltype(std::declval<C&>().history_update(uint64_t(), uint8_t(), uint64_t(), int(), bool(), bool(), uint64_t()))>> : std::true_type {};
+
+template <class C, class = void>
+struct has_setup : std::false_type {};
+template <class C>
+struct has_setup<C, std::void_t<decltype(std::declval<C&>().setup())>> : std::true_type {};
+
+template <class C, class = void>
+struct has_terminate : std::false_type {};
+template <class C>
+struct has_terminate<C, std::void_t<decltype(std::declval<C&>().terminate())>> : std::true_type {};
+
+template <class C, class = void>
+struct has_prefetch : std::false_type {};
+template <class C>
+struct has_prefetch<C, std::void_t<decltype(std::declval<const C&>().prefetch(uint64_t()))>> : std::true_type {};
+
+template <class C, class = void>
+struct has_freeze : std::false_type {};
+template <class C>
+struct has_freeze<C, std::void_t<decltype(std::declval<C&>().freeze())>> : std::true_type {};
+
+template <class C, class S, class = void>
+struct has_snapshot : std::false_type {};
+template <class C, class S>
+struct has_snapshot<C, S, std::void_t<decltype(std::declval<C&>().snapshot(std::declval<S&>()))>> : std::true_type {};
+
+template <class C, class S, class = void>
+struct has_dump : std::false_type {};
+template <class C, class S>
+struct has_dump<C, S, std::void_t<decltype(std::declval<C&>().dump(std::declval<S&>()))>> : std::true_type {};
+
+} // namespace composite_detail
+
+template <class Chooser, class... Components>
+class CompositePredictor
+{
+    static_assert(sizeof...(Components) > 0, "a composite predictor needs at least one component");
+
+    private:
+        static constexpr size_t N = sizeof...(Components);
+        std::tuple<Components&...> components;
+
+        template <size_t... I>
+        bool predict(uint64_t seq_no, uint8_t piece, uint64_t pc, std::index_sequence<I...>)
+        {
+            std::array<bool, N> preds = {};
+            bool prev_pred = false;
+            ((preds[I] = prev_pred = component_predict(std::get<I>(components), seq_no, piece, pc, prev_pred)), ...);
+            return Chooser::choose(preds);
+        }
+
+        template <class C>
+        static bool component_predict(C& c, uint64_t seq_no, uint8_t piece, uint64_t pc, bool prev_pred)
+        {
+            if constexpr (composite_detail::takes_prev_pred<C>::value)
+                return c.predict(seq_no, piece, pc, prev_pred);
+            else
+                return c.predict(seq_no, piece, pc);
+        }
+
+        template <class C>
+        static void component_history_update(C& c, uint64_t seq_no, uint8_t piece, uint64_t pc, int br_type, bool pred_dir, bool resolve_dir, uint64_t next_pc)
+        {
+            if constexpr (composite_detail::takes_br_type<C>::value)
+                c.history_update(seq_no, piece, pc, br_type, pred_dir, resolve_dir, next_pc);
+            else
+                c.history_update(seq_no, piece, pc, resolve_dir, next_pc);
+        }
+
+        template <class C>
+        static void component_setup(C& c)
+        {
+            if constexpr (composite_detail::has_setup<C>::value)
+                c.setup();
+        }
+
+        template <class C>
+        static void component_terminate(C& c)
+        {
+            if constexpr (composite_detail::has_terminate<C>::value)
+                c.terminate();
+        }
+
+        template <class C>
+        static void component_prefetch(const C& c, uint64_t pc)
+        {
+            if constexpr (composite_detail::has_prefetch<C>::value)
+                c.prefetch(pc);
+        }
+
+        template <class C>
+        static bool component_freeze(C& c)
+        {
+            if constexpr (composite_detail::has_freeze<C>::value)
+            {
+                c.freeze();
+                return true;
+            }
+            else
+                return false;
+        }
+
+        template <class C, class S>
+        static void component_snapshot(C& c, S& s)
+        {
+            if constexpr (composite_detail::has_snapshot<C, S>::value)
+                c.snapshot(s);
+            else
+                s.unsupported("a predictor component has no snapshot()");
+        }
+
+        template <class C, class S>
+        static void component_dump(C& c, S& s)
+        {
+            if constexpr (composite_detail::has_dump<C, S>::value)
+                c.dump(s);
+            else
+                component_snapshot(c, s);
+        }
+
+    public:
+        CompositePredictor(Components&... c)
+        : components(c...)
+        {
+        }
+
+        void setup()
+        {
+            std::apply([](auto&... c) { (component_setup(c), ...); }, components);
+        }
+
+        void terminate()
+        {
+            std::apply([](auto&... c) { (component_terminate(c), ...); }, components);
+        }
+
+        template <class S>
+        void snapshot(S& s)
+        {
+            std::apply([&s](auto&... c) { (component_snapshot(c, s), ...); }, components);
+        }
+
+        template <class S>
+        void dump(S& s)
+        {
+            std::apply([&s](auto&... c) { (component_dump(c, s), ...); }, components);
+        }
+
+        // Freezes every component for inference only. Returns false if one of them cannot be frozen, which the caller
+        // must not go on after: the others are frozen already.
+        bool freeze()
+        {
+            return std::apply([](auto&... c) { return (component_freeze(c) & ...); }, components);
+        }
+
+        // Called at the fetch of any instruction.
+        void prefetch(uint64_t pc) const
+        {
+            std::apply([pc](auto&... c) { (component_prefetch(c, pc), ...); }, components);
+        }
+
+        bool predict(uint64_t seq_no, uint8_t piece, uint64_t pc)
+        {
+            return predict(seq_no, piece, pc, std::make_index_sequence<N>());
+        }
+
+        // Speculative update, for conditional branches only.
+        void history_update(uint64_t seq_no, uint8_t piece, uint64_t pc, int br_type, bool pred_dir, bool resolve_dir, uint64_t next_pc)
+        {
+            std::apply([&](auto&... c) { (component_history_update(c, seq_no, piece, pc, br_type, pred_dir, resolve_dir, next_pc), ...); }, components);
+        }
+
+        void update(uint64_t seq_no, uint8_t piece, uint64_t pc, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+        {
+            std::apply([&](auto&... c) { (c.update(seq_no, piece, pc, resolve_dir, pred_dir, next_pc), ...); }, components);
+        }
+};
@@ -17,10 +17,19 @@
 // This file provides a sample predictor integration based on the interface provided.
 
 #include "lib/sim_common_structs.h"
+#include "cbp.h"
 #include "cbp2016_tage_sc_l.h"
 #include "my_cond_branch_predictor.h"
+#include "composite_predictor.h"
+#include "lib/snapshot.h"
 #include <cassert>
 
+// TAGE-SC-L, whose prediction is handed to the contestant predictor, which makes the final one.
+static CompositePredictor<choose_last_t, CBP2016_TAGE_SC_L<>, SampleCondPredictor> cond_predictor(cbp2016_tage_sc_l, cond_predictor_impl);
+
+// The sample predictor updates at execute, and prefetches its tables at fetch; decode, agen and commit are unused.
+extern const uint32_t cbp_hooks = (CBP_HOOK_FETCH | CBP_HOOK_EXECUTE);
+
 //
 // beginCondDirPredictor()
 // 
@@ -30,8 +39,7 @@
 void beginCondDirPredictor()
 {
     // setup sample_predictor
-    cbp2016_tage_sc_l.setup();
-    cond_predictor_impl.setup();
+    cond_predictor.setup();
 }
 
 //
@@ -42,6 +50,8 @@ void beginCondDirPredictor()
 //
 void notify_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, const uint64_t fetch_cycle)
 {
+    // no-op unless PREFETCH is set in the tage-sc-l configuration
+    cond_predictor.prefetch(pc);
 }
 
 //
@@ -53,9 +63,7 @@ void notify_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, const uint6
 //
 bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, const uint64_t pred_cycle)
 {
-    const bool tage_sc_l_pred =  cbp2016_tage_sc_l.predict(seq_no, piece, pc);
-    const bool my_prediction = cond_predictor_impl.predict(seq_no, piece, pc, tage_sc_l_pred);
-    return my_prediction;
+    return cond_predictor.predict(seq_no, piece, pc);
 }
 
 //
@@ -96,13 +104,10 @@ void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_cla
 
     if(inst_class == InstClass::condBranchInstClass)
     {
-        cbp2016_tage_sc_l.history_update(seq_no, piece, pc, br_type, pred_dir, resolve_dir, next_pc);
-        cond_predictor_impl.history_update(seq_no, piece, pc, resolve_dir, next_pc);
-    }
-    else
-    {
-        cbp2016_tage_sc_l.TrackOtherInst(pc, br_type, pred_dir, resolve_dir, next_pc);
+        cond_predictor.history_update(seq_no, piece, pc, br_type, pred_dir, resolve_dir, next_pc);
     }
+    // the shared global history is advanced last, once for all the predictors
+    cbp_global_history.update(pc, br_type, resolve_dir, next_pc);
 
 }
 
@@ -144,8 +149,7 @@ void notify_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, c
         {
             const bool _resolve_dir = _exec_info.taken.value();
             const uint64_t _next_pc = _exec_info.next_pc;
-            cbp2016_tage_sc_l.update(seq_no, piece, pc, _resolve_dir, pred_dir, _next_pc);
-            cond_predictor_impl.update(seq_no, piece, pc, _resolve_dir, pred_dir, _next_pc);
+            cond_predictor.update(seq_no, piece, pc, _resolve_dir, pred_dir, _next_pc);
         }
         else
         {
@@ -165,6 +169,59 @@ void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, const bool
 {
 }
 
+//
+// notify_batch(const cbp_batch_t& batch)
+//
+// Batched form of the notify_* hooks, called once per simulated cycle with spans of records if cbp_hooks has
+// CBP_HOOK_BATCH.
+//
+// For the sample predictor implementation, we do not use batched notifications
+void notify_batch(const cbp_batch_t& batch)
+{
+}
+
+//
+// notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+//
+// Dense id of the pc of a branch, before its prediction, called if cbp_hooks has CBP_HOOK_STATIC_ID.
+//
+// For the sample predictor implementation, we do not use static ids
+void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+{
+}
+
+//
+// snapshot_cond_dir_predictor(snapshot_t& s)
+//
+// Saves or restores the predictor state, for warmup snapshots (-S/-s).
+//
+void snapshot_cond_dir_predictor(snapshot_t& s)
+{
+    cond_predictor.snapshot(s);
+    s.io(cbp_global_history);
+}
+
+//
+// dump_cond_dir_predictor(snapshot_t& s)
+//
+// Writes the canonical form of the predictor state, for the lockstep validation (-l).
+//
+void dump_cond_dir_predictor(snapshot_t& s)
+{
+    cond_predictor.dump(s);
+    s.io(cbp_global_history);
+}
+
+//
+// freeze_cond_dir_predictor()
+//
+// Makes the restored predictor inference-only, for evaluation with frozen tables (-e).
+//
+bool freeze_cond_dir_predictor()
+{
+    return cond_predictor.freeze();
+}
+
 //
 // endCondDirPredictor()
 //
@@ -173,6 +230,5 @@ void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, const bool
 //
 void endCondDirPredictor ()
 {
-    cbp2016_tage_sc_l.terminate();
-    cond_predictor_impl.terminate();
+    cond_predictor.terminate();
 }
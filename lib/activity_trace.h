@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "sim_common_structs.h"
+#include "trace_db.h"
+
+// Pipeline activity of the timing simulation: the Fetched, AGEN, Executed and Retired events of uarchsim_t, traced when
+// LOG_LEVEL != 0 or to a file (-y <activity.bin>[,<first_cycle>,<last_cycle>]).
+//
+// Each event is a fixed-size binary record, gathered by the step that produced it and kept if the step's fetch cycle
+// falls in [LOG_START_CYCLE, LOG_END_CYCLE]. Only then are the records of a step formatted, to stdout with LOG_LEVEL,
+// while with -y they are handed to a single-producer/single-consumer ring, written to the file by a background thread
+// as the time series of -q is (time_series.h), and never formatted at all. Like its rows, records are never dropped:
+// the simulation waits for room in the ring when the writer falls behind.
+//
+// A Fetched record is followed by an ACTIVITY_INST record, the micro-op fetched. The file is a header
+// (activity_trace_header_t) followed by the records, printed by tools/print_activity.cc in the text of LOG_LEVEL.
+
+enum activity_event_t : uint8_t
+{
+    ACTIVITY_FETCHED = 0,
+    ACTIVITY_AGEN,
+    ACTIVITY_EXECUTED,
+    ACTIVITY_RETIRED,
+    ACTIVITY_INST,          // the micro-op of the Fetched record before it
+    NUM_ACTIVITY_EVENTS
+};
+
+static constexpr const char * activity_event_names[NUM_ACTIVITY_EVENTS] = {"Fetched", "AGEN", "Executed", "Retired", "Inst"};
+
+// flags of the window records
+static constexpr uint8_t ACTIVITY_TAKEN_POPULATED = 1;
+static constexpr uint8_t ACTIVITY_TAKEN = 2;
+
+struct activity_record_t
+{
+    uint64_t cycle;
+    uint8_t type;               // activity_event_t
+    uint8_t piece;
+    uint8_t insn_class;
+    uint8_t flags;              // window: ACTIVITY_TAKEN_*; inst: bit k operand k (A, B, C, D) valid, bit 4 + k is_int
+    uint8_t num_src_regs;
+    uint8_t reserved[3];
+    uint64_t seq_no;
+    uint64_t pc;
+    union
+    {
+        // The window entry, the optional fields all ones when not set, as they are printed.
+        struct
+        {
+            uint64_t fetch_cycle;
+            uint64_t decode_cycle;
+            uint64_t exec_cycle;
+            uint64_t retire_cycle;
+            uint64_t dst_reg;
+            uint64_t mem_va;
+            uint64_t mem_sz;
+            uint64_t dst_reg_value;
+        } window;
+        // The micro-op: logical registers are bytes in the traces.
+        struct
+        {
+            uint64_t next_pc;
+            uint64_t addr;
+            uint64_t size;
+            uint64_t value[4];
+            uint8_t log_reg[4];
+            uint8_t is_taken;
+            uint8_t is_load;
+            uint8_t is_store;
+            uint8_t is_last_piece;
+        } inst;
+    };
+};
+static_assert(sizeof(activity_record_t) == 96, "activity records are 96 bytes");
+
+struct activity_trace_header_t
+{
+    char magic[8];              // "CBPACT1"
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t first_cycle;       // LOG_START_CYCLE
+    uint64_t last_cycle;        // LOG_END_CYCLE
+};
+
+// The text of a window entry (window_t), the one of LOG_LEVEL.
+inline void print_window_entry(std::ostream& os, uint64_t seq_no, uint8_t piece, uint64_t pc, const ExecuteInfo& exec_info, uint64_t fetch_cycle,
+                               uint64_t decode_cycle, uint64_t exec_cycle, uint64_t retire_cycle)
+{
+    os<<"{";
+    os<<" ["<<seq_no<<","<<(uint64_t)piece<<"]";
+    os<<" PC:0x"<<std::hex<<pc<<std::dec;
+    os<<" Class:"<<cInfo[static_cast<uint8_t>(exec_info.dec_info.insn_class)];
+    os<<" TakenPopulated:"<<exec_info.taken.has_value();
+    os<<" TakenVal:"<<exec_info.taken.value_or(false);
+    os<<" fetch_cycle:"<<fetch_cycle;
+    os<<" decode_cycle:"<<decode_cycle;
+    os<<" exec_cycle:"<<exec_cycle;
+    os<<" ExecInfo:"<<exec_info;
+    os<<" retire_cycle:"<<retire_cycle;
+    os<<"}";
+}
+
+inline activity_record_t activity_window_record(activity_event_t type, uint64_t cycle, uint64_t seq_no, uint8_t piece, uint64_t pc, const ExecuteInfo& exec_info,
+                                                uint64_t fetch_cycle, uint64_t decode_cycle, uint64_t exec_cycle, uint64_t retire_cycle)
+{
+    activity_record_t r = {};
+    r.cycle = cycle;
+    r.type = type;
+    r.piece = piece;
+    r.insn_class = static_cast<uint8_t>(exec_info.dec_info.insn_class);
+    r.flags = (exec_info.taken.has_value() ? ACTIVITY_TAKEN_POPULATED : 0) | (exec_info.taken.value_or(false) ? ACTIVITY_TAKEN : 0);
+    r.num_src_regs = exec_info.dec_info.src_reg_info.size();
+    r.seq_no = seq_no;
+    r.pc = pc;
+    r.window.fetch_cycle = fetch_cycle;
+    r.window.decode_cycle = decode_cycle;
+    r.window.exec_cycle = exec_cycle;
+    r.window.retire_cycle = retire_cycle;
+    r.window.dst_reg = exec_info.dec_info.dst_reg_info.value_or(0xFFFFFFFFFFFFFFFF);
+    r.window.mem_va = exec_info.mem_va.value_or(0xFFFFFFFFFFFFFFFF);
+    r.window.mem_sz = exec_info.mem_sz.value_or(0xFFFFFFFFFFFFFFFF);
+    r.window.dst_reg_value = exec_info.dst_reg_value.value_or(0xFFFFFFFFFFFFFFFF);
+    return r;
+}
+
+inline activity_record_t activity_inst_record(uint64_t cycle, uint64_t seq_no, uint8_t piece, const db_t& inst)
+{
+    activity_record_t r = {};
+    r.cycle = cycle;
+    r.type = ACTIVITY_INST;
+    r.piece = piece;
+    r.insn_class = static_cast<uint8_t>(inst.insn_class);
+    r.seq_no = seq_no;
+    r.pc = inst.pc;
+    r.inst.next_pc = inst.next_pc;
+    r.inst.addr = inst.addr;
+    r.inst.size = inst.size;
+    const db_operand_t * operands[4] = {&inst.A, &inst.B, &inst.C, &inst.D};
+    for (int k = 0; k < 4; k++)
+    {
+        r.flags |= (operands[k]->valid << k) | (operands[k]->is_int << (4 + k));
+        r.inst.log_reg[k] = operands[k]->log_reg;
+        r.inst.value[k] = operands[k]->value;
+    }
+    r.inst.is_taken = inst.is_taken;
+    r.inst.is_load = inst.is_load;
+    r.inst.is_store = inst.is_store;
+    r.inst.is_last_piece = inst.is_last_piece;
+    return r;
+}
+
+// Prints a record as the line of LOG_LEVEL, a Fetched one with inst, the ACTIVITY_INST record that follows it.
+inline void print_activity(std::ostream& os, const activity_record_t& r, const activity_record_t * inst)
+{
+    ExecuteInfo exec_info;
+    exec_info.dec_info.insn_class = static_cast<InstClass>(r.insn_class);
+    for (unsigned k = 0; k < r.num_src_regs; k++)
+        exec_info.dec_info.src_reg_info.push_back(0);
+    if (r.window.dst_reg != 0xFFFFFFFFFFFFFFFF)
+        exec_info.dec_info.dst_reg_info = r.window.dst_reg;
+    if (r.flags & ACTIVITY_TAKEN_POPULATED)
+        exec_info.taken = (r.flags & ACTIVITY_TAKEN) != 0;
+    if (r.window.mem_va != 0xFFFFFFFFFFFFFFFF)
+        exec_info.mem_va = r.window.mem_va;
+    if (r.window.mem_sz != 0xFFFFFFFFFFFFFFFF)
+        exec_info.mem_sz = r.window.mem_sz;
+    if (r.window.dst_reg_value != 0xFFFFFFFFFFFFFFFF)
+        exec_info.dst_reg_value = r.window.dst_reg_value;
+
+    os<<r.cycle<<"::"<<activity_event_names[r.type]<<":";
+    print_window_entry(os, r.seq_no, r.piece, r.pc, exec_info, r.window.fetch_cycle, r.window.decode_cycle, r.window.exec_cycle, r.window.retire_cycle);
+    if (inst)
+    {
+        db_t db = {};
+        db.insn_class = static_cast<InstClass>(inst->insn_class);
+        db.pc = inst->pc;
+        db.is_taken = inst->inst.is_taken;
+        db.next_pc = inst->inst.next_pc;
+        db_operand_t * operands[4] = {&db.A, &db.B, &db.C, &db.D};
+        for (int k = 0; k < 4; k++)
+            *operands[k] = {((inst->flags >> k) & 1) != 0, ((inst->flags >> (4 + k)) & 1) != 0, inst->inst.log_reg[k], inst->inst.value[k]};
+        db.is_load = inst->inst.is_load;
+        db.is_store = inst->inst.is_store;
+        db.addr = inst->inst.addr;
+        db.size = inst->inst.size;
+        db.is_last_piece = inst->inst.is_last_piece;
+        os<<" Inst:"<<db;
+    }
+    os<<"\n";
+}
+
+// Prints the records of a step, each Fetched one with the ACTIVITY_INST record after it.
+inline void print_activity(std::ostream& os, const std::vector<activity_record_t>& records)
+{
+    for (size_t k = 0; k < records.size(); k++)
+    {
+        const bool fetched = (records[k].type == ACTIVITY_FETCHED) && (k + 1 < records.size());
+        print_activity(os, records[k], fetched ? &records[k + 1] : nullptr);
+        k += fetched;
+    }
+}
+
+class activity_recorder_t
+{
+    private:
+        static constexpr uint64_t RING_SIZE = 1 << 16;
+
+        std::vector<activity_record_t> ring;
+        // Records pushed by the simulation thread / written by the writer thread, each on its own line.
+        alignas(64) std::atomic<uint64_t> pushed{0};
+        alignas(64) std::atomic<uint64_t> written{0};
+        std::atomic<bool> stop{false};
+
+        FILE * file = nullptr;
+        std::thread writer;
+
+        void drain()
+        {
+            for (;;)
+            {
+                const uint64_t end = pushed.load(std::memory_order_acquire);
+                uint64_t begin = written.load(std::memory_order_relaxed);
+                if (begin == end)
+                {
+                    if (stop.load(std::memory_order_acquire) && (pushed.load(std::memory_order_acquire) == begin))
+                        return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                while (begin != end)
+                {
+                    // up to the end of the ring at most, in one write
+                    const uint64_t slot = begin % RING_SIZE;
+                    const uint64_t n = std::min(end - begin, RING_SIZE - slot);
+                    fwrite(&ring[slot], sizeof(activity_record_t), n, file);
+                    begin += n;
+                    written.store(begin, std::memory_order_release);
+                }
+            }
+        }
+
+    public:
+        activity_recorder_t() = default;
+        activity_recorder_t(const activity_recorder_t&) = delete;
+        activity_recorder_t& operator=(const activity_recorder_t&) = delete;
+
+        ~activity_recorder_t()
+        {
+            close();
+        }
+
+        // Starts recording the steps of fetch cycles [first_cycle, last_cycle] to path. Returns false if it cannot be
+        // written.
+        bool open(const char * path, uint64_t first_cycle, uint64_t last_cycle)
+        {
+            file = fopen(path, "wb");
+            if (!file)
+                return false;
+            pushed.store(0);
+            written.store(0);
+            stop.store(false);
+            const activity_trace_header_t header = {"CBPACT1", sizeof(activity_record_t), 0, first_cycle, last_cycle};
+            fwrite(&header, sizeof(header), 1, file);
+            ring.resize(RING_SIZE);
+            writer = std::thread(&activity_recorder_t::drain, this);
+            return true;
+        }
+
+        // Writes the records left in the ring and closes the file.
+        void close()
+        {
+            if (!file)
+                return;
+            stop.store(true, std::memory_order_release);
+            writer.join();
+            fclose(file);
+            file = nullptr;
+        }
+
+        bool enabled() const
+        {
+            return file != nullptr;
+        }
+
+        uint64_t num_records() const
+        {
+            return pushed.load(std::memory_order_relaxed);
+        }
+
+        // Hands the records of a step to the writer, waiting for room in the ring as needed.
+        void write(const std::vector<activity_record_t>& records)
+        {
+            uint64_t p = pushed.load(std::memory_order_relaxed);
+            for (const activity_record_t& r : records)
+            {
+                while (p - written.load(std::memory_order_acquire) == RING_SIZE)
+                {
+                    pushed.store(p, std::memory_order_release);
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                ring[p % RING_SIZE] = r;
+                p++;
+            }
+            pushed.store(p, std::memory_order_release);
+        }
+};
+
+// Process-wide, like the time series: opened by parseargs, fed by uarchsim_t.
+inline activity_recorder_t activity_recorder;
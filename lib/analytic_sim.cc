@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <algorithm>
+#include "cache.h"
+#include "bp.h"
+#include "cbp.h"
+#include "resource_schedule.h"
+#include "analytic_sim.h"
+#include "parameters.h"
+#include "snapshot.h"
+#include "phase_timer.h"
+#include "predictor_thread.h"
+#include "stats.h"
+#include "progress_stream.h"
+#include "time_series.h"
+#include "invariant.h"
+
+analytic_sim_t::analytic_sim_t(const sim_config_t& _cfg)
+   : cfg(_cfg)
+   , L3(cfg.L3_SIZE, cfg.L3_ASSOC, cfg.L3_BLOCKSIZE, cfg.L3_LATENCY, NULL, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU, cfg.CACHE_SET_SAMPLING)
+   , L2(cfg.L2_SIZE, cfg.L2_ASSOC, cfg.L2_BLOCKSIZE, cfg.L2_LATENCY, &L3, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU, cfg.CACHE_SET_SAMPLING)
+   , L1(cfg.L1_SIZE, cfg.L1_ASSOC, cfg.L1_BLOCKSIZE, cfg.L1_LATENCY, &L2, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU)
+   , data_caches(L1)
+   , IC(cfg.IC_SIZE, cfg.IC_ASSOC, cfg.IC_BLOCKSIZE, 0, &L2, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU)
+   , BP(cfg)
+   , retire_cycles(cfg.WINDOW_SIZE, 0)
+   , stores(NUM_STORE_WORDS, store_word_t{UINT64_MAX, 0, 0, 0})
+   , last_retire_cycle(0)
+   , piece(UINT8_MAX)
+   , num_fetched(0)
+   , num_fetched_branch(0)
+   , fetch_cycle(0)
+   , previous_fetch_cycle(0)
+   , cycle(0)
+   , num_inst(0)
+   , num_uop(0)
+   , cycles_on_wrong_path(0)
+   , stat_pfs_issued_to_mem(0)
+   , last_epoch_end_cycle(0)
+{
+   CBP_CHECK(cfg.WINDOW_SIZE != 0);
+   if (cfg.PREFETCHER_ENABLE)
+      L1.track_prefetches(NUM_RPT_ENTRIES);
+   for (int i = 0; i < RFSIZE; i++)
+      RF[i] = 0;
+   BP.notify_begin_new_epoch();
+}
+
+void analytic_sim_t::resolve_until(uint64_t cycle)
+{
+   while (!pending.empty() && (pending.front().exec_cycle <= cycle))
+   {
+      std::pop_heap(pending.begin(), pending.end());
+      const pending_branch_t& br = pending.back();
+      resolve_info.dec_info.insn_class = br.insn_class;
+      resolve_info.dec_info.static_id = br.static_id;
+      resolve_info.taken = br.taken;
+      resolve_info.next_pc = br.next_pc;
+      {
+         PHASE_SCOPE(PHASE_HOOKS);
+         call_instr_execute_resolve(br.seq_no, br.piece, br.pc, br.pred_taken, resolve_info, br.exec_cycle);
+      }
+      pending.pop_back();
+   }
+}
+
+// Mask of the bytes of word that [addr, addr + size) covers.
+static uint8_t word_bytes(uint64_t word, uint64_t addr, uint64_t size)
+{
+   const uint64_t first = std::max(addr, word << 3);
+   const uint64_t last = std::min(addr + size, (word + 1) << 3);
+   return (uint8_t)(((1u << (last - first)) - 1) << (first & 7));
+}
+
+uint64_t analytic_sim_t::forward(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t data_cache_cycle) const
+{
+   uint64_t cycle = 0;
+   for (uint64_t word = addr >> 3; word <= ((addr + size - 1) >> 3); word++)
+   {
+      const store_word_t& w = stores[word & (NUM_STORE_WORDS - 1)];
+      const uint8_t bytes = word_bytes(word, addr, size);
+      // SQ hit for the bytes the store wrote, the L1$ for the others
+      if ((w.word == word) && (w.bytes & bytes) && (exec_cycle < w.ret_cycle))
+         cycle = std::max(cycle, std::max(exec_cycle, w.exec_cycle));
+      if ((w.word != word) || (bytes & ~w.bytes) || (exec_cycle >= w.ret_cycle))
+         cycle = std::max(cycle, data_cache_cycle);
+   }
+   return cycle;
+}
+
+void analytic_sim_t::record_store(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t ret_cycle)
+{
+   for (uint64_t word = addr >> 3; word <= ((addr + size - 1) >> 3); word++)
+   {
+      store_word_t& w = stores[word & (NUM_STORE_WORDS - 1)];
+      const uint8_t bytes = word_bytes(word, addr, size);
+      // the bytes an older store to the word wrote stay with its timestamps, approximated by the younger store's
+      if ((w.word == word) && (exec_cycle < w.ret_cycle))
+         w = {word, (uint8_t)(w.bytes | bytes), exec_cycle, ret_cycle};
+      else
+         w = {word, bytes, exec_cycle, ret_cycle};
+   }
+}
+
+// As uarchsim_t::step drains the prefetch queue, but with a load/store lane always free: every prefetch generated by
+// the fetch cycle goes to the L1$ at once.
+void analytic_sim_t::issue_prefetches()
+{
+   Prefetch p;
+   while (prefetcher.issue(p, fetch_cycle))
+   {
+      L1.access(std::max(previous_fetch_cycle, p.cycle_generated), true, p.address, true, p.source);
+      ++stat_pfs_issued_to_mem;
+   }
+}
+
+void analytic_sim_t::report_progress() const
+{
+   if (progress_stream.enabled())
+   {
+      const epoch_log_t& epochs = BP.epochs();
+      const branch_totals_t& e = epochs.current.br;
+      progress_stream.epoch(epochs.size() - 1, epochs.current.insts, epochs.current.cycles, e.conddir_n, e.conddir_m, e.cycles_wp);
+   }
+}
+
+void analytic_sim_t::end_current_begin_new_epoch(uint64_t epoch_end_cycle)
+{
+   BP.epochs().current.cycles = epoch_end_cycle - last_epoch_end_cycle;
+   last_epoch_end_cycle = epoch_end_cycle;
+   report_progress();
+   if (BP.epochs().size() == 1)
+      alloc_stats_steady(num_uop);
+   BP.notify_begin_new_epoch();
+}
+
+void analytic_sim_t::step(db_t *inst)
+{
+   PHASE_SCOPE(PHASE_STEP);
+   // Same piece numbering as uarchsim_t::step.
+   piece = (piece == UINT8_MAX) ? 0 : (piece + 1);
+   const uint64_t seq_no = num_uop++;
+   staged.decode(inst, 1, cfg);
+
+   if (cfg.FETCH_MODEL_ICACHE)
+      fetch_cycle = IC.access(fetch_cycle, true/*read*/, inst->pc);
+   resolve_until(fetch_cycle);
+
+   uint64_t exec_cycle = fetch_cycle + cfg.PIPELINE_FILL_LATENCY;
+   if (staged.src_a[0] != uop_batch_t::NO_REG)
+      exec_cycle = std::max(exec_cycle, RF[staged.src_a[0]]);
+   if (staged.src_b[0] != uop_batch_t::NO_REG)
+      exec_cycle = std::max(exec_cycle, RF[staged.src_b[0]]);
+   if (staged.src_c[0] != uop_batch_t::NO_REG)
+      exec_cycle = std::max(exec_cycle, RF[staged.src_c[0]]);
+
+   if (inst->is_load)
+   {
+      // AGEN, then the D$ levels, then the search of the in-flight stores a cycle after AGEN.
+      exec_cycle++;
+      uint64_t data_cache_cycle;
+      if (cfg.PERFECT_CACHE)
+         data_cache_cycle = exec_cycle + cfg.L1_LATENCY;
+      else
+      {
+         const cache_lookup_t found = data_caches.lookup(exec_cycle, inst->addr);
+         if (cfg.PREFETCHER_ENABLE)
+         {
+            prefetcher.lookahead((inst->pc >> 2), fetch_cycle);
+            prefetcher.train(PrefetchTrainingInfo{inst->pc >> 2, inst->addr, 0, found.level == 1});
+         }
+         data_cache_cycle = data_caches.access(found, exec_cycle, inst->addr);
+      }
+      exec_cycle = forward(inst->addr, inst->size, exec_cycle + 1, data_cache_cycle);
+   }
+   else
+      exec_cycle += staged.latency[0];
+
+   if (cfg.PREFETCHER_ENABLE)
+      issue_prefetches();
+
+   cycle = std::max(cycle, exec_cycle);
+   if (staged.dst[0] != uop_batch_t::NO_REG)
+      RF[staged.dst[0]] = exec_cycle;
+   const uint64_t retire_cycle = std::max(exec_cycle, last_retire_cycle);
+   if (inst->is_store)
+   {
+      const uint64_t data_cache_cycle = (cfg.WRITE_ALLOCATE && !cfg.PERFECT_CACHE) ? L1.access(exec_cycle, true, inst->addr) : exec_cycle;
+      record_store(inst->addr, inst->size, exec_cycle, std::max(data_cache_cycle, retire_cycle));
+   }
+
+   last_retire_cycle = retire_cycle;
+   retire_cycles[seq_no % cfg.WINDOW_SIZE] = last_retire_cycle;
+
+   if (predictor_hooks & CBP_HOOK_FETCH)
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      call_instr_fetch(seq_no, piece, inst->pc, fetch_cycle);
+   }
+
+   // Fetch bundle and window constraints, as in uarchsim_t::step.
+   const uint64_t predict_cycle = fetch_cycle;
+   previous_fetch_cycle = fetch_cycle;
+   const bool is_branch = is_br(inst->insn_class);
+   const uint64_t oldest_retire_cycle = (seq_no + 1 >= cfg.WINDOW_SIZE) ? retire_cycles[(seq_no + 1) % cfg.WINDOW_SIZE] : 0;
+   if (fetch_cycle < oldest_retire_cycle)
+   {
+      num_fetched = 0;
+      fetch_cycle = oldest_retire_cycle;
+   }
+   else
+   {
+      bool stop = false;
+      if (cfg.FETCH_WIDTH > 0)
+      {
+         num_fetched += inst->is_last_piece;
+         stop |= (num_fetched == cfg.FETCH_WIDTH);
+      }
+      if ((cfg.FETCH_NUM_BRANCH > 0) && is_branch)
+      {
+         num_fetched_branch++;
+         stop |= (num_fetched_branch == cfg.FETCH_NUM_BRANCH);
+      }
+      stop |= cfg.FETCH_STOP_AT_INDIRECT && is_uncond_ind_br(inst->insn_class);
+      stop |= cfg.FETCH_STOP_AT_TAKEN && inst->is_taken;
+      if (stop)
+      {
+         num_fetched = 0;
+         num_fetched_branch = 0;
+         fetch_cycle++;
+      }
+   }
+
+   if (!cfg.PERFECT_BRANCH_PRED)
+   {
+      checkpoint_oldest_inflight = (seq_no + 1 > cfg.WINDOW_SIZE) ? (seq_no + 1 - cfg.WINDOW_SIZE) : 0;
+      const bool misp = BP.predict(seq_no, piece, inst->insn_class, inst->pc, inst->next_pc, predict_cycle, inst->static_id);
+      if (misp)
+      {
+         num_fetched = 0;
+         num_fetched_branch = 0;
+         fetch_cycle = std::max(fetch_cycle, exec_cycle);
+         cycles_on_wrong_path += (fetch_cycle - predict_cycle);
+         BP.update_cycles_on_wrong_path(fetch_cycle - predict_cycle);
+      }
+      if (is_branch)
+      {
+         const bool taken = is_cond_br(inst->insn_class) ? (inst->next_pc != (inst->pc + 4)) : true;
+         const bool pred_taken = is_cond_br(inst->insn_class) ? (misp ? !taken : taken) : true;
+         pending.push_back({exec_cycle, seq_no, piece, inst->pc, pred_taken, inst->insn_class, taken, inst->next_pc, inst->static_id});
+         std::push_heap(pending.begin(), pending.end());
+      }
+   }
+
+   if (inst->is_last_piece)
+   {
+      piece = UINT8_MAX;
+      num_inst++;
+      uint64_t& epoch_insts = BP.epochs().current.insts;
+      epoch_insts++;
+      if (time_series.enabled() && time_series.tick())
+         time_series.end_epoch(predict_cycle, BP.totals());
+      if (epoch_insts == cfg.EPOCH_SIZE_INSTS)
+         end_current_begin_new_epoch(predict_cycle);
+   }
+}
+
+void analytic_sim_t::output()
+{
+   resolve_until(UINT64_MAX);
+   BP.epochs().current.cycles = cycle - last_epoch_end_cycle;
+   if (BP.epochs().current.insts > 0)
+      report_progress();
+   time_series.end(cycle, BP.totals());
+
+   printf("ANALYTIC MODE: interval model, no window entries, execution lanes or store queue\n");
+   printf("WINDOW_SIZE = %lu\n", cfg.WINDOW_SIZE);
+   printf("FETCH_WIDTH = %lu\n", cfg.FETCH_WIDTH);
+   printf("FETCH_NUM_BRANCH = %lu\n", cfg.FETCH_NUM_BRANCH);
+   printf("FETCH_STOP_AT_INDIRECT = %s\n", (cfg.FETCH_STOP_AT_INDIRECT ? "1" : "0"));
+   printf("FETCH_STOP_AT_TAKEN = %s\n", (cfg.FETCH_STOP_AT_TAKEN ? "1" : "0"));
+   printf("FETCH_MODEL_ICACHE = %s\n", (cfg.FETCH_MODEL_ICACHE ? "1" : "0"));
+   printf("PERFECT_BRANCH_PRED = %s\n", (cfg.PERFECT_BRANCH_PRED ? "1" : "0"));
+   printf("PERFECT_INDIRECT_PRED = %s\n", (cfg.PERFECT_INDIRECT_PRED ? "1" : "0"));
+   printf("PIPELINE_FILL_LATENCY = %lu\n", cfg.PIPELINE_FILL_LATENCY);
+   printf("STRIDE Prefetcher = %s\n", cfg.PREFETCHER_ENABLE ? "1" : "0");
+   printf("PERFECT_CACHE = %s\n", (cfg.PERFECT_CACHE ? "1" : "0"));
+   printf("WRITE_ALLOCATE = %s\n", (cfg.WRITE_ALLOCATE ? "1" : "0"));
+   if (cfg.CACHE_SET_SAMPLING > 1)
+      printf("L2$ and L3$ set sampling: 1 in %lu sets\n", cfg.CACHE_SET_SAMPLING);
+   printf("Number of PFs issued to the memory system %lu\n", stat_pfs_issued_to_mem);
+   printf("------------------------MEMORY HIERARCHY MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)-------------------------\n");
+   if (cfg.FETCH_MODEL_ICACHE) {
+      printf("I$:\n"); IC.stats();
+   }
+   printf("L1$:\n"); L1.stats();
+   printf("L2$:\n"); L2.stats();
+   printf("L3$:\n"); L3.stats();
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+   printf("\n-------------------------------ILP LIMIT STUDY (Full Simulation i.e. Counts Not Reset When Warmup Ends)--------------------------------\n");
+   printf("instructions = %lu\n", num_inst);
+   printf("cycles       = %lu\n", cycle);
+   printf("CycWP        = %lu\n", cycles_on_wrong_path);
+   printf("IPC          = %.4f\n", ((double)num_inst/(double)cycle));
+   printf("\n---------------------------------------------------------------------------------------------------------------------------------------\n");
+   BP.output(num_inst);
+   BP.output_periodic_info();
+   phase_timers_report(num_uop, BP.num_branches());
+   checkpoint_stragglers_report();
+}
+
+void analytic_sim_t::register_stats(stats_t& st) const
+{
+   st.group("config")
+     .add("window_size", cfg.WINDOW_SIZE)
+     .add("fetch_width", cfg.FETCH_WIDTH)
+     .add("fetch_num_branch", cfg.FETCH_NUM_BRANCH)
+     .add("pipeline_fill_latency", cfg.PIPELINE_FILL_LATENCY)
+     .add("perfect_branch_pred", (uint64_t)cfg.PERFECT_BRANCH_PRED)
+     .add("perfect_indirect_pred", (uint64_t)cfg.PERFECT_INDIRECT_PRED)
+     .add("epoch_size_insts", cfg.EPOCH_SIZE_INSTS)
+     .add("analytic", (uint64_t)1);
+   st.group("core")
+     .add("instr", num_inst)
+     .add("uops", num_uop)
+     .add("cycles", cycle)
+     .add("ipc", (double)num_inst/(double)cycle)
+     .add("cycles_wp", cycles_on_wrong_path)
+     .add("pfs_issued_to_mem", stat_pfs_issued_to_mem);
+   if (cfg.FETCH_MODEL_ICACHE)
+      IC.register_stats(st, "IC");
+   L1.register_stats(st, "L1");
+   L2.register_stats(st, "L2");
+   L3.register_stats(st, "L3");
+   data_caches.register_stats(st, "loads");
+   prefetcher.register_stats(st, L1.prefetch_usage(), L1.demand_misses());
+   BP.register_stats(st);
+}
+
+void analytic_sim_t::snapshot(snapshot_t& s)
+{
+   s.io(L3);
+   s.io(L2);
+   s.io(L1);
+   s.io(data_caches);
+   s.io(IC);
+   s.io(prefetcher);
+   s.io(BP);
+   s.io(RF);
+   s.io(retire_cycles);
+   s.io(last_retire_cycle);
+   s.io(stores);
+   s.io(pending);
+   s.io(piece);
+   s.io(num_fetched);
+   s.io(num_fetched_branch);
+   s.io(fetch_cycle);
+   s.io(previous_fetch_cycle);
+   s.io(cycle);
+   s.io(num_inst);
+   s.io(num_uop);
+   s.io(cycles_on_wrong_path);
+   s.io(stat_pfs_issued_to_mem);
+   s.io(last_epoch_end_cycle);
+}
+
+conddir_stats_t analytic_sim_t::get_conddir_stats(const uint64_t target_instr_count) const
+{
+   return BP.conddir_stats(target_instr_count);
+}
+
+uint64_t analytic_sim_t::get_epoch_insts() const
+{
+   return BP.epochs().totals().insts;
+}
+
+void analytic_sim_t::start_in_epoch(const uint64_t num_insts)
+{
+   CBP_CHECK((BP.epochs().size() == 1) && (BP.epochs().current.insts == 0) && (num_insts < cfg.EPOCH_SIZE_INSTS));
+   BP.epochs().current.insts = num_insts;
+}
+
+void analytic_sim_t::keep_epochs()
+{
+   BP.epochs().keep();
+}
+
+epoch_stats_t analytic_sim_t::get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const
+{
+   return BP.get_epoch_stats(first_epoch, num_epochs);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "sim_common_structs.h"
+#include "trace_db.h"
+#include "bp.h"
+#include "cache.h"
+#include "parameters.h"
+// after resource_schedule.h, as everywhere uarchsim.h is included
+#include "uarchsim.h"
+
+// Analytic timing engine for quick IPC estimates (-n).
+//
+// Times each micro-op from the register timestamps of its producers, as uarchsim_t::step does, but leaves out all of
+// the per-cycle machinery: there is no window of entries, no execution lanes, no byte-exact store queue and no event queue
+// replaying the pipeline. What remains is the first-order model of interval analysis:
+//  - dispatch: fetch bundles of cfg.FETCH_WIDTH instructions, cut by the branch, indirect and taken-branch limits,
+//    and stalled by the I$ and by a full window, the window being only the retire cycles of the last WINDOW_SIZE uops;
+//  - mispredictions: fetch resumes when the branch executes, so the penalty is the resolution distance its dependency
+//    chain gives it, not a fixed number of cycles;
+//  - long-latency loads: the same L1$/L2$/L3$ hierarchy and stride prefetcher as uarchsim_t, the prefetches issued
+//    as soon as they are generated, and loads wait for the data of the in-flight stores they read (store_word_t).
+// The predictor sees predict, fetch and execute/resolve, the latter in execution order once the fetch cycle has
+// reached it. It is not told of decode, agen or commit, as in branch-only mode.
+class analytic_sim_t {
+   private:
+      struct pending_branch_t {
+         uint64_t exec_cycle;
+         uint64_t seq_no;
+         uint8_t piece;
+         uint64_t pc;
+         bool pred_taken;
+         InstClass insn_class;
+         bool taken;
+         uint64_t next_pc;
+         uint32_t static_id;
+         // Heap order: the earliest execution first, then program order.
+         bool operator<(const pending_branch_t& other) const
+         {
+            return (exec_cycle != other.exec_cycle) ? (exec_cycle > other.exec_cycle) : (seq_no > other.seq_no);
+         }
+      };
+
+      // The youngest store to each aligned 8-byte word, direct-mapped on the word: the store queue reduced to what a
+      // load needs of it. A store evicted by a younger one to another word is forgotten, as if committed.
+      struct store_word_t {
+         uint64_t word;
+         uint8_t bytes;          // mask of the bytes written
+         uint64_t exec_cycle;
+         uint64_t ret_cycle;
+      };
+      static constexpr uint64_t NUM_STORE_WORDS = 4096;
+
+      const sim_config_t cfg;
+      cache_t L3;
+      cache_t L2;
+      cache_t L1;
+      cache_hierarchy_t data_caches;
+      cache_t IC;
+      StridePrefetcher prefetcher;
+      bp_t BP;
+
+      uop_batch_t staged;
+      uint64_t RF[RFSIZE];
+      // Retire cycle of uop seq_no at seq_no % WINDOW_SIZE: the oldest uop still in the window is the next to be overwritten.
+      std::vector<uint64_t> retire_cycles;
+      uint64_t last_retire_cycle;
+      std::vector<store_word_t> stores;
+
+      // Branches fetched and not resolved yet, a heap (pending_branch_t::operator<).
+      std::vector<pending_branch_t> pending;
+      ExecuteInfo resolve_info;
+
+      uint8_t piece;
+      uint64_t num_fetched;
+      uint64_t num_fetched_branch;
+      uint64_t fetch_cycle;
+      uint64_t previous_fetch_cycle;
+      uint64_t cycle;
+      uint64_t num_inst;
+      uint64_t num_uop;
+      uint64_t cycles_on_wrong_path;
+      uint64_t stat_pfs_issued_to_mem;
+
+      uint64_t last_epoch_end_cycle;
+
+      // Resolves the pending branches that have executed by cycle.
+      void resolve_until(uint64_t cycle);
+      // Cycle a load searching the stores at exec_cycle has its size bytes at addr, getting those no store in flight
+      // wrote from the L1$ at data_cache_cycle, as store_queue_t::load does.
+      uint64_t forward(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t data_cache_cycle) const;
+      void record_store(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t ret_cycle);
+      void issue_prefetches();
+      void report_progress() const;
+      void end_current_begin_new_epoch(uint64_t epoch_end_cycle);
+
+   public:
+      analytic_sim_t(const sim_config_t& _cfg);
+
+      void step(db_t *inst);
+      void output();
+      // Registers the measurements of output() (valid after it) for the stats record (-J).
+      void register_stats(stats_t& st) const;
+      // Saves or restores the caches, the timestamps and the measurements between two steps (-S/-s).
+      void snapshot(snapshot_t& s);
+      conddir_stats_t get_conddir_stats(const uint64_t target_instr_count) const;
+      uint64_t get_epoch_insts() const;
+      // Starts the first epoch num_insts instructions in, so that the epochs line up with those of the whole trace when
+      // the run starts in the middle of it (-K).
+      void start_in_epoch(const uint64_t num_insts);
+      // Keeps the measurements of each epoch from the current one on, for get_epoch_stats() and the stats record (-J).
+      void keep_epochs();
+      // Measurements of epochs [first_epoch, first_epoch + num_epochs), at most up to the last epoch begun.
+      epoch_stats_t get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const;
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Read-ahead of a file that is read in order: the compressed bytes of a .gz trace, which gz_block_reader_t inflates.
+//
+// The file is cut into chunks of BUFFER_SIZE bytes, read ahead into a ring of NUM_BUFFERS buffers. Each buffer is
+// handed to the consumer once its read completes, so inflating a chunk overlaps the reads of the next ones. Only a
+// consumer that inflates faster than the storage delivers has to wait. The reads are issued through io_uring, or by a
+// small pool of reader threads where io_uring is not available, as chosen by the CBP_TRACE_IO environment variable,
+// since TraceReader is constructed in many places that have no options to pass:
+//
+//   uring    (default) io_uring, falling back to threads when the kernel does not allow it
+//   threads  reader threads
+//   off      a blocking read of each chunk when the consumer needs it
+class async_file_reader_t
+{
+    public:
+        static constexpr size_t BUFFER_SIZE = 1 << 20;
+        static constexpr unsigned NUM_BUFFERS = 4;
+        static constexpr unsigned NUM_THREADS = 2;
+
+        enum backend_t
+        {
+            BACKEND_OFF,
+            BACKEND_THREADS,
+            BACKEND_URING
+        };
+
+    private:
+        struct buffer_t
+        {
+            std::vector<uint8_t> data;
+            uint64_t chunk = UINT64_MAX;    // chunk held, or being read
+            size_t size = 0;                // bytes of the chunk
+            size_t filled = 0;              // bytes read so far
+            bool ready = false;
+            bool in_flight = false;
+        };
+
+        // Rings of an io_uring instance, set up by hand from the kernel interface (there is no liburing to link).
+        struct uring_t
+        {
+            int fd = -1;
+            void * sq_ring = MAP_FAILED;
+            void * cq_ring = MAP_FAILED;
+            size_t sq_ring_size = 0;
+            size_t cq_ring_size = 0;
+            io_uring_sqe * sqes = (io_uring_sqe *)MAP_FAILED;
+            size_t sqes_size = 0;
+            unsigned * sq_tail = nullptr;
+            unsigned * sq_mask = nullptr;
+            unsigned * sq_array = nullptr;
+            unsigned * cq_head = nullptr;
+            unsigned * cq_tail = nullptr;
+            unsigned * cq_mask = nullptr;
+            io_uring_cqe * cqes = nullptr;
+        };
+
+        int mFd;
+        uint64_t mFileSize = 0;
+        uint64_t mStart = 0;        // offset of chunk 0
+        uint64_t mNumChunks = 0;
+        uint64_t mCurrent = 0;      // next chunk for the consumer
+        std::vector<buffer_t> mBuffers;
+        backend_t mBackend;
+        uring_t mUring;
+        unsigned mInFlight = 0;     // io_uring reads submitted and not completed
+
+        // Threads backend
+        std::mutex mLock;
+        std::condition_variable mReadyCv;
+        std::condition_variable mFreeCv;
+        uint64_t mNextClaim = 0;
+        uint64_t mReleased = 0;     // chunks the consumer is done with
+        bool mStop = false;
+        std::vector<std::thread> mWorkers;
+
+        uint64_t chunk_offset(uint64_t chunk) const
+        {
+            return mStart + chunk * BUFFER_SIZE;
+        }
+
+        size_t chunk_size(uint64_t chunk) const
+        {
+            return std::min<uint64_t>(BUFFER_SIZE, mFileSize - chunk_offset(chunk));
+        }
+
+        [[noreturn]] static void fail(const char * what)
+        {
+            fprintf(stderr, "Unable to read the trace: %s\n", what);
+            exit(1);
+        }
+
+        // Reads chunk in full into buffer b, in the calling thread.
+        void read_chunk(buffer_t& b, uint64_t chunk)
+        {
+            b.size = chunk_size(chunk);
+            b.filled = 0;
+            while (b.filled < b.size)
+            {
+                const ssize_t num = pread(mFd, b.data.data() + b.filled, b.size - b.filled, chunk_offset(chunk) + b.filled);
+                if (num <= 0)
+                    fail("read error");
+                b.filled += num;
+            }
+        }
+
+        bool uring_setup()
+        {
+            io_uring_params p = {};
+            mUring.fd = syscall(__NR_io_uring_setup, NUM_BUFFERS, &p);
+            if (mUring.fd < 0)
+                return false;
+            mUring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            mUring.cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap)
+                mUring.sq_ring_size = mUring.cq_ring_size = std::max(mUring.sq_ring_size, mUring.cq_ring_size);
+            mUring.sq_ring = mmap(nullptr, mUring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mUring.fd, IORING_OFF_SQ_RING);
+            if (mUring.sq_ring == MAP_FAILED)
+                return false;
+            if (single_mmap)
+                mUring.cq_ring = mUring.sq_ring;
+            else
+            {
+                mUring.cq_ring = mmap(nullptr, mUring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mUring.fd, IORING_OFF_CQ_RING);
+                if (mUring.cq_ring == MAP_FAILED)
+                    return false;
+            }
+            mUring.sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            mUring.sqes = (io_uring_sqe *)mmap(nullptr, mUring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mUring.fd, IORING_OFF_SQES);
+            if (mUring.sqes == MAP_FAILED)
+                return false;
+            char * sq = (char *)mUring.sq_ring;
+            char * cq = (char *)mUring.cq_ring;
+            mUring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+            mUring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+            mUring.sq_array = (unsigned *)(sq + p.sq_off.array);
+            mUring.cq_head = (unsigned *)(cq + p.cq_off.head);
+            mUring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+            mUring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+            mUring.cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+            return true;
+        }
+
+        void uring_teardown()
+        {
+            if (mUring.sqes != MAP_FAILED)
+                munmap(mUring.sqes, mUring.sqes_size);
+            if ((mUring.cq_ring != MAP_FAILED) && (mUring.cq_ring != mUring.sq_ring))
+                munmap(mUring.cq_ring, mUring.cq_ring_size);
+            if (mUring.sq_ring != MAP_FAILED)
+                munmap(mUring.sq_ring, mUring.sq_ring_size);
+            if (mUring.fd >= 0)
+                close(mUring.fd);
+            mUring = uring_t();
+        }
+
+        // Submits the read of the rest of the chunk of buffer b.
+        void uring_submit(buffer_t& b)
+        {
+            const unsigned tail = *mUring.sq_tail;
+            const unsigned index = tail & *mUring.sq_mask;
+            io_uring_sqe& sqe = mUring.sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = mFd;
+            sqe.addr = (uint64_t)(b.data.data() + b.filled);
+            sqe.len = b.size - b.filled;
+            sqe.off = chunk_offset(b.chunk) + b.filled;
+            sqe.user_data = b.chunk;
+            mUring.sq_array[index] = index;
+            __atomic_store_n(mUring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+            if (syscall(__NR_io_uring_enter, mUring.fd, 1, 0, 0, nullptr, 0) != 1)
+                fail("io_uring submission failed");
+            b.in_flight = true;
+            mInFlight++;
+        }
+
+        // Waits for at least one completion, and handles all those there are.
+        void uring_reap()
+        {
+            if (syscall(__NR_io_uring_enter, mUring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+                fail("io_uring wait failed");
+            unsigned head = *mUring.cq_head;
+            const unsigned tail = __atomic_load_n(mUring.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++)
+            {
+                const io_uring_cqe& cqe = mUring.cqes[head & *mUring.cq_mask];
+                buffer_t& b = mBuffers[cqe.user_data % NUM_BUFFERS];
+                b.in_flight = false;
+                mInFlight--;
+                if (cqe.res <= 0)
+                    fail("read error");
+                b.filled += cqe.res;
+                // a short read goes on where it stopped
+                if (b.filled < b.size)
+                    uring_submit(b);
+                else
+                    b.ready = true;
+            }
+            __atomic_store_n(mUring.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            while (!mStop)
+            {
+                if ((mNextClaim == mNumChunks) || (mNextClaim >= mReleased + NUM_BUFFERS))
+                {
+                    mFreeCv.wait(lock);
+                    continue;
+                }
+                const uint64_t chunk = mNextClaim++;
+                buffer_t& b = mBuffers[chunk % NUM_BUFFERS];
+                lock.unlock();
+                read_chunk(b, chunk);
+                lock.lock();
+                b.chunk = chunk;
+                b.ready = true;
+                mReadyCv.notify_all();
+            }
+        }
+
+        // Starts reading ahead at chunk 0, once nothing is in flight.
+        void start()
+        {
+            mCurrent = 0;
+            mNumChunks = (mFileSize > mStart) ? (mFileSize - mStart + BUFFER_SIZE - 1) / BUFFER_SIZE : 0;
+            for (buffer_t& b : mBuffers)
+            {
+                b.chunk = UINT64_MAX;
+                b.ready = false;
+            }
+            if (mBackend == BACKEND_URING)
+            {
+                for (uint64_t chunk = 0; chunk < std::min<uint64_t>(NUM_BUFFERS, mNumChunks); chunk++)
+                {
+                    buffer_t& b = mBuffers[chunk];
+                    b.chunk = chunk;
+                    b.size = chunk_size(chunk);
+                    b.filled = 0;
+                    uring_submit(b);
+                }
+            }
+            else if (mBackend == BACKEND_THREADS)
+            {
+                mNextClaim = mReleased = 0;
+                mStop = false;
+                for (unsigned t = 0; t < NUM_THREADS; t++)
+                    mWorkers.emplace_back(&async_file_reader_t::work, this);
+            }
+        }
+
+        void stop()
+        {
+            if (mBackend == BACKEND_URING)
+            {
+                while (mInFlight > 0)
+                    uring_reap();
+            }
+            else if (mBackend == BACKEND_THREADS)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mStop = true;
+                }
+                mFreeCv.notify_all();
+                for (std::thread& t : mWorkers)
+                    t.join();
+                mWorkers.clear();
+            }
+        }
+
+    public:
+        async_file_reader_t(const char * path)
+        : mBuffers(NUM_BUFFERS)
+        {
+            mFd = open(path, O_RDONLY);
+            struct stat st;
+            if ((mFd >= 0) && (fstat(mFd, &st) == 0))
+                mFileSize = st.st_size;
+            for (buffer_t& b : mBuffers)
+                b.data.resize(BUFFER_SIZE);
+
+            const char * io = getenv("CBP_TRACE_IO");
+            mBackend = BACKEND_URING;
+            if (io && !strcmp(io, "off"))
+                mBackend = BACKEND_OFF;
+            else if (io && !strcmp(io, "threads"))
+                mBackend = BACKEND_THREADS;
+            if ((mBackend == BACKEND_URING) && !uring_setup())
+            {
+                uring_teardown();
+                mBackend = BACKEND_THREADS;
+            }
+            // sequential reads: ask the kernel to read ahead of the chunks as well
+            if (mFd >= 0)
+                posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            start();
+        }
+
+        ~async_file_reader_t()
+        {
+            stop();
+            uring_teardown();
+            if (mFd >= 0)
+                close(mFd);
+        }
+
+        async_file_reader_t(const async_file_reader_t&) = delete;
+        async_file_reader_t& operator=(const async_file_reader_t&) = delete;
+
+        bool good() const
+        {
+            return mFd >= 0;
+        }
+
+        backend_t backend() const
+        {
+            return mBackend;
+        }
+
+        // The next bytes of the file, in [data, data + size): valid until the next call. Returns false at the end of
+        // the file.
+        bool next(const uint8_t *& data, size_t& size)
+        {
+            if (mCurrent > 0)
+            {
+                // the buffer of the previous chunk is free again: it goes on to the chunk NUM_BUFFERS ahead
+                const uint64_t freed = mCurrent - 1;
+                buffer_t& b = mBuffers[freed % NUM_BUFFERS];
+                if (mBackend == BACKEND_URING)
+                {
+                    b.ready = false;
+                    if (freed + NUM_BUFFERS < mNumChunks)
+                    {
+                        b.chunk = freed + NUM_BUFFERS;
+                        b.size = chunk_size(b.chunk);
+                        b.filled = 0;
+                        uring_submit(b);
+                    }
+                }
+                else if (mBackend == BACKEND_THREADS)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mLock);
+                        b.ready = false;
+                        mReleased = mCurrent;
+                    }
+                    mFreeCv.notify_all();
+                }
+            }
+            if (mCurrent >= mNumChunks)
+                return false;
+
+            const uint64_t chunk = mCurrent++;
+            buffer_t& b = mBuffers[chunk % NUM_BUFFERS];
+            if (mBackend == BACKEND_URING)
+            {
+                while (!b.ready)
+                    uring_reap();
+            }
+            else if (mBackend == BACKEND_THREADS)
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mReadyCv.wait(lock, [&]() { return b.ready && (b.chunk == chunk); });
+            }
+            else
+                read_chunk(b, chunk);
+            data = b.data.data();
+            size = b.size;
+            return true;
+        }
+
+        // Restarts reading ahead from offset.
+        void seek(uint64_t offset)
+        {
+            stop();
+            mStart = offset;
+            start();
+        }
+
+        // Starts bringing the file at path into the page cache, without waiting for it: for a trace that is to be
+        // read soon.
+        static void prefetch(const char * path)
+        {
+            const int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                return;
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+// Periodic autosave (-a), for runs that may be killed before they end: every interval instructions, a snapshot of the
+// full state (as -S saves it) replaces the previous one, and a run started again with the same arguments resumes from
+// it instead of from the start of the trace.
+//
+// A snapshot is written by a child forked for it, from its copy-on-write image of the simulator, so the simulation
+// goes on while it is written: it only waits for the fork. The child writes to <path>.tmp and renames it over path
+// once complete, so path always holds a whole snapshot. At most one child writes at a time: an autosave that comes
+// while the previous one is still being written is skipped. Autosaves are tagged with a key of the arguments, checked
+// on resume, and path is removed when the run completes.
+class autosave_t
+{
+    private:
+        std::string path;
+        std::string tmp_path;
+        uint64_t interval;
+        uint64_t key;
+        pid_t writer = -1;
+        uint64_t num_saved = 0;
+        uint64_t num_skipped = 0;
+
+        // Collects the child writing, if any: waits for it, or only checks if it is done.
+        void reap(bool wait)
+        {
+            if (writer < 0)
+                return;
+            int status;
+            const pid_t pid = waitpid(writer, &status, wait ? 0 : WNOHANG);
+            if (pid == 0)
+                return;
+            writer = -1;
+            if ((pid < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+                fprintf(stderr, "Autosave to %s failed: the previous one is kept\n", path.c_str());
+            else
+                num_saved++;
+        }
+
+    public:
+        autosave_t(const char * _path, uint64_t _interval, uint64_t _key)
+        : path(_path), tmp_path(std::string(_path) + ".tmp"), interval(_interval), key(_key)
+        {
+        }
+
+        autosave_t(const autosave_t&) = delete;
+        autosave_t& operator=(const autosave_t&) = delete;
+
+        ~autosave_t()
+        {
+            reap(true);
+        }
+
+        const char * get_path() const
+        {
+            return path.c_str();
+        }
+
+        // Whether an earlier run left an autosave to resume from.
+        bool exists() const
+        {
+            return access(path.c_str(), F_OK) == 0;
+        }
+
+        bool due(uint64_t num_instr) const
+        {
+            return (num_instr % interval) == 0;
+        }
+
+        // Saves or checks the key of the arguments, first in an autosave.
+        void check_key(snapshot_t& snap) const
+        {
+            snap.check(key, "it was saved by a run with other arguments or another trace");
+        }
+
+        // Starts writing a snapshot, write(snap) saving the state into it, unless the previous one is still being
+        // written. The state must be complete when called: nothing is left to other threads.
+        template <class F>
+        void save(F write)
+        {
+            reap(false);
+            if (writer >= 0)
+            {
+                num_skipped++;
+                return;
+            }
+            fflush(stdout);
+            fflush(stderr);
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                // Only this thread lives on in the child: it writes the snapshot and leaves, without any of the
+                // parent's exit handlers (the predictor's output files are the parent's to complete).
+                {
+                    snapshot_t snap(tmp_path.c_str(), false/*restoring*/, true/*forked*/);
+                    check_key(snap);
+                    write(snap);
+                }
+                _exit((rename(tmp_path.c_str(), path.c_str()) == 0) ? 0 : 1);
+            }
+            if (pid < 0)
+            {
+                perror("fork");
+                num_skipped++;
+                return;
+            }
+            writer = pid;
+        }
+
+        // The run completed: waits for the last autosave and removes it, so that the next run starts over.
+        void finish()
+        {
+            reap(true);
+            unlink(path.c_str());
+            printf("Autosave: %lu snapshots written to %s, %lu skipped while the previous one was written\n", num_saved, path.c_str(), num_skipped);
+        }
+};
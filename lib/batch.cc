@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "batch.h"
+#include "trace_summary.h"
+#include "result_cache.h"
+#include "cpu_topology.h"
+#include "footprint.h"
+#include "async_file.h"
+#include "plugin.h"
+#include "interval.h"
+#include "cost_model.h"
+
+namespace {
+
+struct batch_job_t {
+    const char * trace;
+    std::string workload;   // parent directory of the trace
+    std::string run;        // trace file name without its extension, @ the label of the plugin if any
+    predictor_plugin_t * plugin = nullptr;
+    double trace_size_mb;
+    uint64_t num_uops;      // from the trace summary (<trace>.sum), 0 without one
+    double cost = 0.0;      // estimated by the cost model, in its seconds
+    bool pass = false;
+    bool cached = false;
+    double exec_time = 0.0;
+    batch_result_t result;
+    uint64_t num_instrs = 0;                // from the seek index with slicing, 0 without one: never sliced
+    std::vector<epoch_stats_t> slices;      // the measurements of its slices, once sliced
+    uint64_t slices_left = 0;
+    std::chrono::steady_clock::time_point begin;    // of its first worker
+};
+
+// What a worker simulates: a whole trace, or a slice of one (tail slicing).
+struct batch_task_t {
+    uint64_t job_index;
+    int64_t slice = -1;         // -1 for the whole trace
+    uint64_t warmup_begin = 0;
+    uint64_t begin = 0;
+    uint64_t end = 0;           // UINT64_MAX for the last slice
+};
+
+// What a worker sends back to the parent.
+struct worker_result_t {
+    batch_result_t result;
+    bool cached;
+    double exec_time;       // stored in the cache, for a cached result
+    uint64_t peak_rss;      // of the worker, in bytes
+};
+
+struct running_job_t {
+    batch_task_t task;
+    int cpu;                // index in the topology the worker is pinned to, -1 if not pinned
+    int result_fd;          // a pipe for a whole trace, an unlinked file for a slice
+    std::chrono::steady_clock::time_point begin;
+};
+
+// Same naming as trace_exec_training_list.py: <workload>/<run>.gz
+void name_job(batch_job_t& job)
+{
+    const std::string path(job.trace);
+    const size_t slash = path.find_last_of('/');
+    const std::string file = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    const size_t dot = file.find_last_of('.');
+    job.run = (dot == std::string::npos) ? file : file.substr(0, dot);
+    if (job.plugin)
+        job.run += "@" + job.plugin->get_label();
+    if (slash == std::string::npos)
+        job.workload = ".";
+    else
+    {
+        const size_t prev_slash = path.find_last_of('/', slash - 1);
+        job.workload = path.substr((prev_slash == std::string::npos) ? 0 : prev_slash + 1, slash - ((prev_slash == std::string::npos) ? 0 : prev_slash + 1));
+    }
+
+    struct stat st;
+    job.trace_size_mb = (stat(job.trace, &st) == 0) ? (double)st.st_size/(1024 * 1024) : 0.0;
+
+    trace_summary_t summary;
+    job.num_uops = summary.load(job.trace) ? summary.num_uops : 0;
+}
+
+// Worker stdout goes to <log_dir>/<name>.log, or is discarded without a log_dir.
+void redirect_stdout(const char * log_dir, const std::string& name)
+{
+    const std::string log_path = log_dir ? (std::string(log_dir) + "/" + name + ".log") : std::string("/dev/null");
+    const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0)
+    {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+}
+
+// Runs in the forked worker: never returns.
+void run_worker(const batch_job_t& job, const char * log_dir, int result_fd, batch_result_t (*simulate_fn)(const char *), const result_cache_t * cache)
+{
+    redirect_stdout(log_dir, job.run);
+    if (job.plugin)
+        job.plugin->activate();
+    worker_result_t result = {};
+    uint64_t key = 0;
+    const bool keyed = cache && (active_plugin ? cache->key(job.trace, key, active_plugin->get_path().c_str(), active_plugin->get_args())
+                                               : cache->key(job.trace, key));
+    if (keyed && cache->load(key, result.result, result.exec_time))
+    {
+        result.cached = true;
+        printf("Cached result %016lx of %s\n", key, job.trace);
+    }
+    else
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        result.result = simulate_fn(job.trace);
+        result.exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (keyed && !cache->store(key, result.result, result.exec_time))
+            fprintf(stderr, "Unable to store the result of %s in the result cache\n", job.trace);
+    }
+    result.peak_rss = peak_rss_bytes();
+    fflush(stdout);
+    std::cout.flush();
+
+    const bool written = write(result_fd, &result, sizeof(result)) == sizeof(result);
+    close(result_fd);
+    _exit(written ? 0 : 1);
+}
+
+// The measurements of a slice can be larger than a pipe holds, and the parent only reads them once the worker is done:
+// they go through an unlinked temporary file instead, fds[1] for the worker and fds[0] for the parent.
+bool slice_result_file(int fds[2])
+{
+    char path[] = "/tmp/cbp_slice_XXXXXX";
+    fds[0] = mkstemp(path);
+    if (fds[0] < 0)
+        return false;
+    unlink(path);
+    fds[1] = dup(fds[0]);
+    if (fds[1] < 0)
+        close(fds[0]);
+    return fds[1] >= 0;
+}
+
+// Runs in the forked worker of a slice of job: never returns.
+void run_slice_worker(const batch_job_t& job, const batch_task_t& task, const char * log_dir, int result_fd, const batch_slicing_t& slicing)
+{
+    redirect_stdout(log_dir, job.run + ".slice" + std::to_string(task.slice));
+    if (job.plugin)
+        job.plugin->activate();
+    epoch_stats_t stats = slicing.simulate_fn(job.trace, task.warmup_begin, task.begin, task.end);
+    fflush(stdout);
+    std::cout.flush();
+    _exit(send_epoch_stats(result_fd, stats) ? 0 : 1);
+}
+
+// The rows of the trace from the merged measurements of its slices.
+batch_result_t merge_slices(batch_job_t& job, const sim_config_t& sim_config)
+{
+    epoch_stats_t merged;
+    for (epoch_stats_t& slice : job.slices)
+        append_epoch_stats(merged, slice);
+    const uint64_t total_instr = std::accumulate(merged.insts.begin(), merged.insts.end(), (uint64_t)0);
+    bp_t bp(sim_config);
+    bp.set_epoch_stats(merged);
+    batch_result_t result;
+    result.full = bp.conddir_stats(total_instr);
+    result.half = bp.conddir_stats(total_instr/2);
+    return result;
+}
+
+void print_stats_columns(FILE * csv, const conddir_stats_t& stats)
+{
+    if (!stats.timed())
+    {
+        // branch-only jobs (-X) have no cycles to divide by
+        fprintf(csv, ",%lu,n/a,n/a,%lu,%lu,n/a,n/a,%.4f%%,%.4f,n/a,n/a,n/a", stats.instr, stats.br, stats.br_mispred, stats.mr(), stats.mpki());
+        return;
+    }
+    fprintf(csv, ",%lu,%lu,%.4f,%lu,%lu,%.4f,%.4f,%.4f%%,%.4f,%lu,%.4f,%.4f",
+            stats.instr, stats.cycles, stats.ipc(), stats.br, stats.br_mispred, stats.br_per_cyc(), stats.mispred_per_cyc(),
+            stats.mr(), stats.mpki(), stats.cycles_wp, stats.cyc_wp_avg(), stats.cyc_wp_pki());
+}
+
+} // namespace
+
+int run_batch(const std::vector<const char *>& traces, const char * csv_path, unsigned jobs, unsigned workers_per_llc, const char * log_dir,
+              batch_result_t (*simulate_fn)(const char *), const result_cache_t * cache, const std::vector<predictor_plugin_t *>& plugins,
+              const batch_slicing_t * slicing, cost_model_t * model)
+{
+    const cpu_topology_t topology = cpu_topology_t::load();
+    if (jobs == 0)
+        jobs = std::max(1u, topology.cpus.empty() ? std::thread::hardware_concurrency() : (unsigned)topology.cpus.size());
+    // One worker per CPU at most: more workers than CPUs run unpinned, as do all of them without a known topology.
+    const bool pinned = !topology.cpus.empty() && jobs <= topology.cpus.size();
+    std::vector<bool> cpu_busy(topology.cpus.size(), false);
+    std::vector<unsigned> llc_workers(topology.llcs.size(), 0);
+    if (pinned)
+    {
+        printf("Pinning %u workers to %lu CPUs in %lu LLC domains of %lu KB", jobs, topology.cpus.size(), topology.llcs.size(), topology.llcs[0].size / 1024);
+        if (workers_per_llc)
+            printf(", at most %u per domain", workers_per_llc);
+        printf("\n");
+    }
+    else if (workers_per_llc)
+        printf("Not pinning the workers (more workers than CPUs, or unknown topology): no limit of workers per LLC domain\n");
+
+    // A free CPU in the LLC domain with the fewest workers, where one more is allowed, -1 if none.
+    auto pick_cpu = [&]() {
+        int best = -1;
+        for (uint64_t k = 0; k < topology.cpus.size(); k++)
+        {
+            const unsigned llc = topology.cpus[k].llc;
+            if (cpu_busy[k] || (workers_per_llc && llc_workers[llc] >= workers_per_llc))
+                continue;
+            if (best < 0 || llc_workers[llc] < llc_workers[topology.cpus[best].llc])
+                best = k;
+        }
+        return best;
+    };
+    if (log_dir)
+        mkdir(log_dir, 0755);
+
+    const uint64_t runs_per_trace = plugins.empty() ? 1 : plugins.size();
+    std::vector<batch_job_t> batch(traces.size() * runs_per_trace);
+    for (uint64_t i = 0; i < batch.size(); i++)
+    {
+        batch[i].trace = traces[i / runs_per_trace];
+        batch[i].plugin = plugins.empty() ? nullptr : plugins[i % runs_per_trace];
+        name_job(batch[i]);
+        if (slicing)
+            batch[i].num_instrs = indexed_trace_length(batch[i].trace);
+    }
+
+    // Longest traces first, so that they do not end up alone at the tail of the run: by the cost model if any, else by
+    // uops if all the traces have a summary (convert_trace -s), by file size otherwise, which compression ratios make a
+    // rougher estimate.
+    std::vector<uint64_t> order(batch.size());
+    for (uint64_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    if (model)
+        for (batch_job_t& job : batch)
+            job.cost = model->estimate(job.workload, job.run, job.trace_size_mb, job.num_uops);
+    const bool by_uops = std::all_of(batch.begin(), batch.end(), [](const batch_job_t& job) { return job.num_uops > 0; });
+    std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+        if (model)
+            return batch[a].cost > batch[b].cost;
+        return by_uops ? (batch[a].num_uops > batch[b].num_uops) : (batch[a].trace_size_mb > batch[b].trace_size_mb);
+    });
+
+    std::deque<batch_task_t> queue;
+    for (uint64_t i : order)
+        queue.push_back({i});
+    const uint64_t epoch_size = slicing ? slicing->sim_config.EPOCH_SIZE_INSTS : 0;
+
+    std::unordered_map<pid_t, running_job_t> running;
+    uint64_t num_finished = 0;
+    // Learns from a run once finished, and estimates the time left from the runs still running and queued.
+    auto report_progress = [&](const batch_job_t& job) {
+        num_finished++;
+        if (!model)
+            return;
+        if (job.pass && !job.cached && job.slices.empty() && !job.result.truncated)
+            model->update(job.workload, job.run, job.trace_size_mb, job.result.full.instr, job.cost, job.exec_time);
+        const auto now = std::chrono::steady_clock::now();
+        std::vector<double> left, queued;
+        for (const auto& r : running)
+        {
+            const batch_job_t& other = batch[r.second.task.job_index];
+            const double share = (r.second.task.slice < 0) ? 1.0 : 1.0/other.slices.size();
+            const double elapsed = std::chrono::duration<double>(now - r.second.begin).count();
+            left.push_back(std::max(0.0, model->calibrated(other.cost*share) - elapsed));
+        }
+        for (const batch_task_t& task : queue)
+            queued.push_back(model->calibrated(batch[task.job_index].cost) / ((task.slice < 0) ? 1 : batch[task.job_index].slices.size()));
+        printf("%lu/%lu runs done, about %s left\n", num_finished, batch.size(), cost_model_t::format_time(cost_model_t::makespan(left, queued, jobs)).c_str());
+    };
+    while (!queue.empty() || !running.empty())
+    {
+        // As the queue drains, the largest queued trace is cut into slices for the workers that would otherwise stay
+        // idle until the end of the batch. Slices are whole epochs of the trace, as for -K.
+        while (slicing && (queue.size() < jobs - running.size()))
+        {
+            const auto it = std::find_if(queue.begin(), queue.end(), [&](const batch_task_t& task) {
+                return (task.slice < 0) && (batch[task.job_index].num_instrs >= 2*epoch_size);
+            });
+            if (it == queue.end())
+                break;
+            const uint64_t job_index = it->job_index;
+            batch_job_t& job = batch[job_index];
+            const uint64_t num_epochs = (job.num_instrs + epoch_size - 1)/epoch_size;
+            const uint64_t num_slices = std::min<uint64_t>({slicing->max_slices, jobs - running.size() - queue.size() + 1, num_epochs});
+            if (num_slices < 2)
+                break;
+            queue.erase(it);
+            std::vector<batch_task_t> slices(num_slices);
+            for (uint64_t k = 0; k < num_slices; k++)
+            {
+                batch_task_t& slice = slices[k];
+                slice.job_index = job_index;
+                slice.slice = k;
+                slice.begin = (k*num_epochs/num_slices)*epoch_size;
+                slice.end = (k + 1 < num_slices) ? ((k + 1)*num_epochs/num_slices)*epoch_size : UINT64_MAX;
+                slice.warmup_begin = (slice.begin > slicing->warmup_instrs) ? slice.begin - slicing->warmup_instrs : 0;
+            }
+            queue.insert(queue.begin(), slices.begin(), slices.end());
+            job.slices.resize(num_slices);
+            job.slices_left = num_slices;
+            job.pass = true;
+            printf("Slicing run:%s/%s into %lu slices\n", job.workload.c_str(), job.run.c_str(), num_slices);
+        }
+
+        while (!queue.empty() && running.size() < jobs)
+        {
+            const int cpu = pinned ? pick_cpu() : -1;
+            if (pinned && cpu < 0)
+                break;
+            const batch_task_t task = queue.front();
+            batch_job_t& job = batch[task.job_index];
+            int fds[2];
+            if (task.slice < 0 ? (pipe(fds) != 0) : !slice_result_file(fds))
+            {
+                perror(task.slice < 0 ? "pipe" : "slice result file");
+                return batch.size();
+            }
+            if (task.slice < 0)
+                printf("Begin processing run:%s/%s\n", job.workload.c_str(), job.run.c_str());
+            else
+                printf("Begin processing run:%s/%s slice %ld from instruction %lu\n", job.workload.c_str(), job.run.c_str(), task.slice, task.begin);
+            fflush(stdout);
+            std::cout.flush();
+
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[0]);
+                if (cpu >= 0)
+                    cpu_topology_t::pin(topology.cpus[cpu]);
+                if (task.slice < 0)
+                    run_worker(job, log_dir, fds[1], simulate_fn, cache);
+                run_slice_worker(job, task, log_dir, fds[1], *slicing);
+            }
+            close(fds[1]);
+            if (pid < 0)
+            {
+                perror("fork");
+                close(fds[0]);
+                return batch.size();
+            }
+            if (cpu >= 0)
+            {
+                cpu_busy[cpu] = true;
+                llc_workers[topology.cpus[cpu].llc]++;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (task.slice <= 0)
+                job.begin = now;
+            running[pid] = {task, cpu, fds[0], now};
+            queue.pop_front();
+            // the trace of the next job starts coming into the page cache while this one simulates
+            if (!queue.empty() && (queue.front().job_index != task.job_index))
+                async_file_reader_t::prefetch(batch[queue.front().job_index].trace);
+        }
+
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        const auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+
+        const batch_task_t task = it->second.task;
+        const int result_fd = it->second.result_fd;
+        batch_job_t& job = batch[task.job_index];
+        const bool exited = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (it->second.cpu >= 0)
+        {
+            cpu_busy[it->second.cpu] = false;
+            llc_workers[topology.cpus[it->second.cpu].llc]--;
+        }
+        running.erase(it);
+
+        if (task.slice >= 0)
+        {
+            epoch_stats_t& stats = job.slices[task.slice];
+            const bool received = (lseek(result_fd, 0, SEEK_SET) == 0) && receive_epoch_stats(result_fd, stats);
+            // all but the last slice end on an epoch boundary
+            const bool pass = exited && received && ((task.end == UINT64_MAX) || (stats.insts.size() == (task.end - task.begin)/epoch_size));
+            if (!pass)
+                printf("Failed run:%s/%s slice %ld\n", job.workload.c_str(), job.run.c_str(), task.slice);
+            job.pass = job.pass && pass;
+            if (--job.slices_left > 0)
+                continue;
+            job.exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.begin).count();
+            if (job.pass)
+                job.result = merge_slices(job, slicing->sim_config);
+            printf("%s run:%s/%s (%.2fs, %lu slices)\n", job.pass ? "Finished" : "Failed", job.workload.c_str(), job.run.c_str(), job.exec_time, job.slices.size());
+            report_progress(job);
+            continue;
+        }
+
+        job.exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.begin).count();
+        worker_result_t result;
+        job.pass = exited && read(result_fd, &result, sizeof(result)) == sizeof(result);
+        close(result_fd);
+        if (job.pass)
+        {
+            job.result = result.result;
+            job.cached = result.cached;
+            // the time it took to simulate, not to look up the cache
+            if (job.cached)
+                job.exec_time = result.exec_time;
+        }
+        if (job.pass && !job.cached)
+            printf("Finished run:%s/%s (%.2fs, peak RSS %lu MB)\n", job.workload.c_str(), job.run.c_str(), job.exec_time, result.peak_rss >> 20);
+        else
+            printf("%s run:%s/%s (%.2fs)\n", job.pass ? "Cached" : "Failed", job.workload.c_str(), job.run.c_str(), job.exec_time);
+        report_progress(job);
+    }
+
+    FILE * csv = fopen(csv_path, "w");
+    if (!csv)
+    {
+        perror(csv_path);
+        return batch.size();
+    }
+    fprintf(csv, "Workload,Run,TraceSize,Status,ExecTime,"
+                 "Instr,Cycles,IPC,NumBr,MispBr,BrPerCyc,MispBrPerCyc,MR,MPKI,CycWP,CycWPAvg,CycWPPKI,"
+                 "50PercInstr,50PercCycles,50PercIPC,50PercNumBr,50PercMispBr,50PercBrPerCyc,50PercMispBrPerCyc,50PercMR,50PercMPKI,50PercCycWP,50PercCycWPAvg,50PercCycWPPKI\n");
+    int num_failed = 0;
+    for (const batch_job_t& job : batch)
+    {
+        fprintf(csv, "%s,%s,%f,%s,%f", job.workload.c_str(), job.run.c_str(), job.trace_size_mb, !job.pass ? "Fail" : (job.result.truncated ? "Truncated" : (job.slices.empty() ? "Pass" : "Sliced")), job.exec_time);
+        if (job.pass)
+        {
+            print_stats_columns(csv, job.result.full);
+            print_stats_columns(csv, job.result.half);
+        }
+        else
+        {
+            for (int col = 0; col < 24; col++)
+                fprintf(csv, ",0");
+            num_failed++;
+        }
+        fprintf(csv, "\n");
+    }
+    fclose(csv);
+
+    const uint64_t num_cached = std::count_if(batch.begin(), batch.end(), [](const batch_job_t& job) { return job.cached; });
+    const uint64_t num_sliced = std::count_if(batch.begin(), batch.end(), [](const batch_job_t& job) { return !job.slices.empty(); });
+    printf("Wrote %lu results to %s (%d failed, %lu from the result cache, %lu sliced)\n", batch.size(), csv_path, num_failed, num_cached, num_sliced);
+    return num_failed;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "bp.h"
+#include "parameters.h"
+
+class result_cache_t;
+class predictor_plugin_t;
+class cost_model_t;
+
+// Measurements the batch driver collects from each trace, i.e. the CSV columns of scripts/trace_exec_training_list.py.
+struct batch_result_t {
+    conddir_stats_t full;       // Full Simulation section
+    conddir_stats_t half;       // 50 Perc instructions section
+    bool truncated = false;     // stopped before the end of the trace, once converged (-c)
+};
+
+// Tail slicing (-B with -K <max_slices>,<warmup_instrs>): as the queue of traces drains, the largest queued trace is cut
+// into up to max_slices slices of whole epochs, each warmed up over the warmup_instrs instructions before it, as in
+// interval simulation (interval.h), so that the workers that would otherwise stay idle at the tail of the batch share
+// it. simulate_fn(trace, warmup_begin, begin, end) simulates a slice in its worker; the measurements of the slices are
+// merged into the row of the trace, whose status is then Sliced, as they are an estimate. Only indexed traces
+// (convert_trace -i) can be sliced.
+struct batch_slicing_t {
+    uint64_t max_slices;
+    uint64_t warmup_instrs;
+    sim_config_t sim_config;    // epoch size, and the sections of the merged measurements
+    epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t);
+};
+
+// Simulates every trace with simulate_fn on a pool of at most jobs workers, largest traces first, and writes one CSV row
+// per trace to csv_path. Each worker is a forked process, so it gets its own simulator and predictor instance out of the
+// global state. Worker stdout goes to <log_dir>/<run>.log if log_dir is given, and is discarded otherwise.
+// Workers are pinned to CPUs (cpu_topology.h), at most workers_per_llc (0: no limit) in each last-level cache domain,
+// unless there are more workers than CPUs.
+// With a result cache (result_cache.h), a worker whose run is in the cache returns the stored measurements and
+// execution time instead of simulating, and stores those of the runs it simulates.
+// With predictor plugins (plugin.h), every trace is simulated once per plugin, each run activating its plugin in its
+// worker, and named <run>@<plugin label>.
+// With slicing, traces are cut into slices at the tail of the batch (see batch_slicing_t).
+// With a cost model (cost_model.h), runs are ordered by their estimated time instead, each finished run updates the
+// model, and the time left for the batch is printed as runs finish.
+// Returns the number of failed runs.
+int run_batch(const std::vector<const char *>& traces, const char * csv_path, unsigned jobs, unsigned workers_per_llc, const char * log_dir,
+              batch_result_t (*simulate_fn)(const char *), const result_cache_t * cache = nullptr,
+              const std::vector<predictor_plugin_t *>& plugins = {}, const batch_slicing_t * slicing = nullptr,
+              cost_model_t * model = nullptr);
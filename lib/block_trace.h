@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+#include "trace_index.h"
+#include "remote_file.h"
+
+// Block trace container: the inflated stream of a .gz trace, cut every few trace instructions into blocks that are
+// compressed independently, so that several threads can decompress one trace (convert_trace -c writes them).
+//
+// A single gzip stream can only be inflated in order, which caps the decode of a trace at one core. The blocks of a
+// block trace instead are handed out to a pool of decompression threads, and delivered in order to TraceReader as the
+// same byte stream the .gz trace inflates to. Blocks start on trace instruction boundaries, so the footer index
+// doubles as the seek index of the trace: no sidecar .idx is needed.
+//
+// Layout : block_trace_header_t
+//          num_blocks x compressed block
+//          num_blocks x block_trace_entry_t (the index)
+//          block_trace_footer_t
+//
+// Codecs: deflate (zlib), or stored for hosts where the disk is faster than inflating.
+//
+// A block trace can also be read by URL from object storage (remote_file.h), through a node-local cache of its chunks.
+
+static constexpr char BLOCK_TRACE_MAGIC[8] = {'C', 'B', 'P', 'B', 'L', 'K', '1', '\0'};
+static constexpr uint32_t BLOCK_TRACE_VERSION = 1;
+
+enum block_trace_codec_t : uint32_t
+{
+    BLOCK_CODEC_STORED = 0,
+    BLOCK_CODEC_DEFLATE = 1
+};
+
+struct block_trace_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t codec;
+    uint64_t instrs_per_block;
+};
+
+struct block_trace_entry_t
+{
+    uint64_t in;                // offset of the compressed block in the file
+    uint64_t size;              // compressed bytes
+    uint64_t raw_size;          // inflated bytes
+    trace_index_mark_t mark;    // the block starts at mark.out of the inflated stream, after mark.num_instrs instructions
+};
+
+struct block_trace_footer_t
+{
+    uint64_t index_offset;
+    uint64_t num_blocks;
+    uint64_t num_instrs;
+    uint64_t num_pieces;
+    char magic[8];
+};
+
+class block_trace_writer_t
+{
+    private:
+        FILE * mFile;
+        block_trace_header_t mHeader;
+        std::vector<block_trace_entry_t> mIndex;
+        std::vector<uint8_t> mOut;
+        uint64_t mOffset;
+        uint64_t mRawOffset = 0;
+
+    public:
+        block_trace_writer_t(const char * path, block_trace_codec_t codec, uint64_t instrs_per_block)
+        {
+            memset(&mHeader, 0, sizeof(mHeader));
+            memcpy(mHeader.magic, BLOCK_TRACE_MAGIC, sizeof(mHeader.magic));
+            mHeader.version = BLOCK_TRACE_VERSION;
+            mHeader.codec = codec;
+            mHeader.instrs_per_block = instrs_per_block;
+
+            mFile = fopen(path, "wb");
+            if (mFile)
+                fwrite(&mHeader, sizeof(mHeader), 1, mFile);
+            mOffset = sizeof(mHeader);
+        }
+
+        ~block_trace_writer_t()
+        {
+            if (mFile)
+                fclose(mFile);
+        }
+
+        bool good() const
+        {
+            return mFile != nullptr;
+        }
+
+        uint64_t num_blocks() const
+        {
+            return mIndex.size();
+        }
+
+        // Appends the block of the raw trace bytes [data, data + size), which starts after num_instrs instructions
+        // cracked into num_pieces pieces.
+        bool append(const char * data, uint64_t size, uint64_t num_instrs, uint64_t num_pieces)
+        {
+            const uint8_t * block = (const uint8_t *)data;
+            uLongf packed = size;
+            if (mHeader.codec == BLOCK_CODEC_DEFLATE)
+            {
+                mOut.resize(compressBound(size));
+                packed = mOut.size();
+                if (compress2(mOut.data(), &packed, block, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+                    return false;
+                block = mOut.data();
+            }
+            mIndex.push_back({mOffset, packed, size, {mRawOffset, num_instrs, num_pieces}});
+            mOffset += packed;
+            mRawOffset += size;
+            return fwrite(block, 1, packed, mFile) == packed;
+        }
+
+        // Writes the index and the footer.
+        bool close(uint64_t num_instrs, uint64_t num_pieces)
+        {
+            block_trace_footer_t footer = {mOffset, mIndex.size(), num_instrs, num_pieces, {}};
+            memcpy(footer.magic, BLOCK_TRACE_MAGIC, sizeof(footer.magic));
+            bool ok = (fwrite(mIndex.data(), sizeof(block_trace_entry_t), mIndex.size(), mFile) == mIndex.size())
+                      && (fwrite(&footer, sizeof(footer), 1, mFile) == 1);
+            ok = (fclose(mFile) == 0) && ok;
+            mFile = nullptr;
+            return ok;
+        }
+};
+
+// Delivers the inflated stream of a block trace, in order, from a pool of decompression threads.
+//
+// The threads claim the blocks in order, each into a slot of a ring of inflated blocks, as long as the slot is not
+// that of a block the consumer has yet to finish. The number of threads is CBP_TRACE_THREADS from the environment,
+// by default one per core up to 4, since TraceReader is constructed in many places that have no options to pass.
+class block_trace_reader_t
+{
+    private:
+        struct slot_t
+        {
+            std::vector<char> data;
+            uint64_t block = UINT64_MAX;    // inflated block held, once ready
+            bool ready = false;
+        };
+
+        int mFd = -1;
+        remote_file_t * mRemote = nullptr;
+        uint32_t mCodec;
+        std::vector<block_trace_entry_t> mIndex;
+        std::vector<slot_t> mSlots;
+
+        std::mutex mLock;
+        std::condition_variable mReadyCv;   // a block is ready
+        std::condition_variable mFreeCv;    // a slot was released
+        uint64_t mNextClaim = 0;
+        uint64_t mCurrent = 0;              // block being consumed
+        bool mStop = false;
+        std::vector<std::thread> mWorkers;
+        unsigned mNumThreads;
+
+        // Consumer-side state
+        bool mHeld = false;                 // the slot of mCurrent is known to be ready
+        size_t mPos = 0;
+
+        void inflate_block(uint64_t b, std::vector<char>& in, std::vector<char>& out)
+        {
+            const block_trace_entry_t& e = mIndex[b];
+            out.resize(e.raw_size);
+            std::vector<char>& dst = (mCodec == BLOCK_CODEC_STORED) ? out : in;
+            dst.resize(e.size);
+            bool ok = read_at(dst.data(), e.size, e.in);
+            if (ok && (mCodec == BLOCK_CODEC_DEFLATE))
+            {
+                uLongf size = e.raw_size;
+                ok = (uncompress((Bytef *)out.data(), &size, (const Bytef *)in.data(), e.size) == Z_OK) && (size == e.raw_size);
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "Corrupt block %lu of the block trace\n", b);
+                exit(1);
+            }
+        }
+
+        bool read_at(void * dst, size_t n, uint64_t offset)
+        {
+            return mRemote ? mRemote->pread(dst, n, offset) : (pread(mFd, dst, n, offset) == (ssize_t)n);
+        }
+
+        void work()
+        {
+            std::vector<char> in;
+            std::unique_lock<std::mutex> lock(mLock);
+            while (!mStop)
+            {
+                if ((mNextClaim == mIndex.size()) || (mNextClaim - mCurrent >= mSlots.size()))
+                {
+                    mFreeCv.wait(lock);
+                    continue;
+                }
+                const uint64_t b = mNextClaim++;
+                slot_t& s = mSlots[b % mSlots.size()];
+                lock.unlock();
+                inflate_block(b, in, s.data);
+                lock.lock();
+                s.block = b;
+                s.ready = true;
+                mReadyCv.notify_all();
+            }
+        }
+
+        void start(uint64_t first_block)
+        {
+            mNextClaim = mCurrent = first_block;
+            mHeld = false;
+            mPos = 0;
+            mStop = false;
+            for (slot_t& s : mSlots)
+                s.ready = false;
+            for (unsigned t = 0; t < mNumThreads; t++)
+                mWorkers.emplace_back(&block_trace_reader_t::work, this);
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mStop = true;
+            }
+            mFreeCv.notify_all();
+            for (std::thread& t : mWorkers)
+                t.join();
+            mWorkers.clear();
+        }
+
+    public:
+        // Returns true if the file at path starts with the block trace magic.
+        static bool is_block_trace(const char * path)
+        {
+            char magic[sizeof(BLOCK_TRACE_MAGIC)];
+            if (remote_file_t::is_remote(path))
+            {
+                remote_file_t remote(path);
+                return remote.pread(magic, sizeof(magic), 0) && !memcmp(magic, BLOCK_TRACE_MAGIC, sizeof(magic));
+            }
+            FILE * f = fopen(path, "rb");
+            if (!f)
+                return false;
+            const bool match = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, BLOCK_TRACE_MAGIC, sizeof(magic));
+            fclose(f);
+            return match;
+        }
+
+        // Trace instructions in the block trace at path, as its footer tells, or 0.
+        static uint64_t num_instrs(const char * path)
+        {
+            block_trace_footer_t footer;
+            if (remote_file_t::is_remote(path))
+            {
+                remote_file_t remote(path);
+                const bool ok = (remote.size() >= sizeof(footer)) && remote.pread(&footer, sizeof(footer), remote.size() - sizeof(footer))
+                                && !memcmp(footer.magic, BLOCK_TRACE_MAGIC, sizeof(footer.magic));
+                return ok ? footer.num_instrs : 0;
+            }
+            FILE * f = fopen(path, "rb");
+            if (!f)
+                return 0;
+            const bool ok = (fseeko(f, -(off_t)sizeof(footer), SEEK_END) == 0) && (fread(&footer, sizeof(footer), 1, f) == 1)
+                            && !memcmp(footer.magic, BLOCK_TRACE_MAGIC, sizeof(footer.magic));
+            fclose(f);
+            return ok ? footer.num_instrs : 0;
+        }
+
+        block_trace_reader_t(const char * path)
+        {
+            block_trace_header_t header;
+            block_trace_footer_t footer;
+            off_t end;
+            if (remote_file_t::is_remote(path))
+            {
+                mRemote = new remote_file_t(path);
+                end = mRemote->size();
+            }
+            else
+            {
+                mFd = open(path, O_RDONLY);
+                end = (mFd >= 0) ? lseek(mFd, 0, SEEK_END) : -1;
+            }
+            bool ok = (end >= (off_t)(sizeof(header) + sizeof(footer)))
+                      && read_at(&header, sizeof(header), 0)
+                      && read_at(&footer, sizeof(footer), end - sizeof(footer))
+                      && (header.version == BLOCK_TRACE_VERSION) && (header.codec <= BLOCK_CODEC_DEFLATE)
+                      && !memcmp(footer.magic, BLOCK_TRACE_MAGIC, sizeof(footer.magic))
+                      && (footer.index_offset + footer.num_blocks * sizeof(block_trace_entry_t) + sizeof(footer) == (uint64_t)end);
+            if (ok)
+            {
+                mIndex.resize(footer.num_blocks);
+                const ssize_t size = mIndex.size() * sizeof(block_trace_entry_t);
+                ok = read_at(mIndex.data(), size, footer.index_offset);
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "Unable to open block trace %s\n", path);
+                exit(1);
+            }
+            mCodec = header.codec;
+
+            const char * threads = getenv("CBP_TRACE_THREADS");
+            mNumThreads = threads ? std::max(1, atoi(threads)) : std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+            // one block ahead per thread, and the one being consumed
+            mSlots.resize(mNumThreads + 2);
+            start(0);
+        }
+
+        ~block_trace_reader_t()
+        {
+            stop();
+            if (mFd >= 0)
+                close(mFd);
+            delete mRemote;
+        }
+
+        block_trace_reader_t(const block_trace_reader_t&) = delete;
+        block_trace_reader_t& operator=(const block_trace_reader_t&) = delete;
+
+        // Copies up to n bytes of the inflated stream to dst: a short count means the end of the trace.
+        size_t read(char * dst, size_t n)
+        {
+            size_t done = 0;
+            while ((done < n) && (mCurrent < mIndex.size()))
+            {
+                slot_t& s = mSlots[mCurrent % mSlots.size()];
+                if (!mHeld)
+                {
+                    std::unique_lock<std::mutex> lock(mLock);
+                    mReadyCv.wait(lock, [&]() { return s.ready && (s.block == mCurrent); });
+                    mHeld = true;
+                }
+                const size_t num = std::min(n - done, s.data.size() - mPos);
+                memcpy(dst + done, s.data.data() + mPos, num);
+                done += num;
+                mPos += num;
+                if (mPos == s.data.size())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mLock);
+                        s.ready = false;
+                        mCurrent++;
+                    }
+                    mFreeCv.notify_all();
+                    mHeld = false;
+                    mPos = 0;
+                }
+            }
+            return done;
+        }
+
+        // Restarts from the last block starting at or before instruction num_instrs, and returns where it starts.
+        trace_index_mark_t seek(uint64_t num_instrs)
+        {
+            uint64_t b = 0;
+            while ((b + 1 < mIndex.size()) && (mIndex[b + 1].mark.num_instrs <= num_instrs))
+                b++;
+            stop();
+            start(b);
+            return mIndex.empty() ? trace_index_mark_t{0, 0, 0} : mIndex[b].mark;
+        }
+};
@@ -24,22 +24,33 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
 #include <assert.h>
 #include <iostream>
-#include <numeric>
 #include <cstdlib>
 #include "sim_common_structs.h"
 #include "bp.h"
+#include "bp_impl.h"
+#include "branch_outcomes.h"
 #include "cbp.h"
+#include "phase_timer.h"
+#include "predictor_thread.h"
+#include "stats.h"
 #include "parameters.h"
+#include "usdt.h"
 
 #include "parameters.h"
 
-bp_t::bp_t()
+bp_base_t::bp_base_t(const sim_config_t& _cfg)
+   : cfg(_cfg), epoch_log(_cfg.EPOCH_SIZE_INSTS)
 {
-   if(!PERFECT_INDIRECT_PRED)
+   if(!cfg.PERFECT_INDIRECT_PRED)
    {
-       ITTAGE = new IPREDICTOR();
+       ITTAGE.reset(new IPREDICTOR());
+   }
+   if(cfg.RAS_SIZE > 0)
+   {
+       RAS.reset(new ras_t(cfg.RAS_SIZE));
    }
 
    // Initialize measurements.
@@ -53,176 +64,116 @@ bp_t::bp_t()
    //meas_notctrl_n = 0;
    //meas_notctrl_m = 0;
 
-   meas_conddir_n_per_epoch.clear();
-   meas_conddir_m_per_epoch.clear();
-   meas_jumpdir_n_per_epoch.clear();
-   meas_jumpind_n_per_epoch.clear();
-   meas_jumpind_m_per_epoch.clear();
-   meas_jumpret_n_per_epoch.clear();
-   meas_jumpret_m_per_epoch.clear();
-   meas_notctrl_n_per_epoch.clear();
-   meas_notctrl_m_per_epoch.clear();
-   meas_cycles_on_wrong_path_per_epoch.clear();
+   // the per-epoch measurements are reported
+   if (cfg.PRINT_PER_EPOCH_STATS)
+      epoch_log.keep();
 }
 
-bp_t::~bp_t() {
+void bp_base_t::reset() {
+   if (ITTAGE)
+      ITTAGE->reinit();
+   if (RAS)
+      RAS->reset();
+   mispred_correction_seed = 0;
+   epoch_log.reset();
 }
 
-// Returns true if instruction is a mispredicted branch.
-// Also updates all branch predictor structures as applicable.
-bool bp_t::predict(uint64_t seq_no, uint8_t piece, InstClass inst_class, uint64_t pc, uint64_t next_pc, const uint64_t pred_cycle)
-{
-   bool taken = false;
-   bool pred_taken = false;
-   uint64_t pred_target;
-   bool misp;
+// The conditional branch predictor is saved separately, through snapshot_cond_dir_predictor().
+void bp_base_t::snapshot(snapshot_t& s) {
+   s.check((ITTAGE != nullptr), "the indirect predictor was enabled or disabled");
+   if (ITTAGE)
+      s.io(*ITTAGE);
+   s.check((RAS != nullptr), "the return address stack was enabled or disabled");
+   if (RAS)
+      RAS->snapshot(s);
+   s.io(mispred_correction_seed);
+   s.io(epoch_log);
+}
 
-   if (inst_class == InstClass::condBranchInstClass)
+// Branch of predict() with a recorded outcome (-z replay): the same measurements, without the predictors.
+bool bp_base_t::replay(InstClass inst_class)
+{
+   if (inst_class == InstClass::uncondDirectBranchInstClass || inst_class == InstClass::callDirectInstClass)
    {
-      // CONDITIONAL BRANCH
-
-      // Determine the actual taken/not-taken outcome.
-      taken = (next_pc != (pc + 4));
-
-      // Make prediction.
-      //pred_taken= TAGESCL->GetPrediction (pc);
-      pred_taken = get_cond_dir_prediction (seq_no, piece, pc, pred_cycle);
-      
-      // Determine if mispredicted or not.
-      misp = (pred_taken != taken);
-      
-      if(MISP_REDUCTION_PERC != 0 && misp)
-      {
-          const bool flip_mispred = (MISP_REDUCTION_PERC == 100) ? true : (static_cast<uint64_t>(rand_r(&mispred_correction_seed)%100) < MISP_REDUCTION_PERC);
-          if(flip_mispred)
-          {
-              misp = false;
-              pred_taken =  taken;
-          }
-      }
-      
-      /* A. Seznec: uodate TAGE-SC-L*/
-      //TAGESCL-> UpdatePredictor (pc , 1,  taken, pred_taken, next_pc);
-      //UpdateCondDirPredictor (pc , 1,  taken, pred_taken, next_pc);
- 
-      //// InOrder Update Option
-      //spec_update(seq_no, piece, pc, inst_class, taken, pred_taken, next_pc);
-      //temp_predictor_update_hook(seq_no, piece, pc, taken,pred_taken, next_pc);
-      // OOO Update Option
-      spec_update(seq_no, piece, pc, inst_class, taken, pred_taken, next_pc);
-      // Update measurements.
-      meas_conddir_n_per_epoch.back()++;
-      meas_conddir_m_per_epoch.back() += misp;
+      epoch_log.current.br.jumpdir_n++;
+      return false;
    }
-   else if (inst_class == InstClass::uncondDirectBranchInstClass || inst_class == InstClass::callDirectInstClass) {
-      // CALL OR JUMP DIRECT
-
-      // Target of JAL or J (rd=x0) will be available in either the fetch stage (BTB hit)
-      // or the pre-decode/decode stage (BTB miss), so these are not predicted.
-      // Never mispredicted.
-      misp = false;
-      
-      /* A. Seznec: update branch  histories for TAGE-SC-L and ITTAGE */
-      //TAGESCL->TrackOtherInst(pc , 0,  true,next_pc);
-      //TrackOtherInst(pc , 0,  true,next_pc);
-      spec_update(seq_no, piece, pc, inst_class, true/*taken*/, true/*pred_taken*/, next_pc);
-      if(!PERFECT_INDIRECT_PRED)
-      {
-          ITTAGE->TrackOtherInst(pc , next_pc);
-      }
-
-      // Update measurements.
-      meas_jumpdir_n_per_epoch.back()++;
+   const bool misp = branch_outcomes.next();
+   if (inst_class == InstClass::condBranchInstClass)
+   {
+      epoch_log.current.br.conddir_n++;
+      epoch_log.current.br.conddir_m += misp;
    }
-   else if (inst_class == InstClass::uncondIndirectBranchInstClass || inst_class == InstClass::callIndirectInstClass || inst_class==InstClass::ReturnInstClass) 
+   else if (inst_class == InstClass::ReturnInstClass)
    {
-      const bool is_ret = (inst_class == InstClass::ReturnInstClass);
-      const bool ind_not_ret = !is_ret;
-      meas_jumpind_n_per_epoch.back() += ind_not_ret;
-      meas_jumpret_n_per_epoch.back() += is_ret;
-      if (PERFECT_INDIRECT_PRED)
-      {
-          misp = false;
-         // Update measurements.
-      }
-      else
-      {
-         // Make prediction.
-         pred_target= ITTAGE->GetPrediction (pc);
-
-         // Determine if mispredicted or not.
-         misp = (pred_target != next_pc);
-      
-         /* A. Seznec: update ITTAGE*/
-         ITTAGE-> UpdatePredictor (pc , next_pc);
-      
-         // Update measurements.
-         meas_jumpind_m_per_epoch.back() += !is_ret && misp;
-         meas_jumpret_m_per_epoch.back() += is_ret && misp;
-      }
-
-      spec_update(seq_no, piece, pc, inst_class, true/*taken*/, true/*pred_taken*/, next_pc);
-      /* A. Seznec: update history for TAGE-SC-L */
-      //TAGESCL->TrackOtherInst(pc , 2,  true,next_pc);
-      //TrackOtherInst(pc , 2,  true,next_pc);
+      epoch_log.current.br.jumpret_n++;
+      epoch_log.current.br.jumpret_m += misp;
    }
    else
    {
-      // not a control-transfer instruction
-      misp = (next_pc != pc + 4);
-
-      // Update measurements.
-      meas_notctrl_n_per_epoch.back()++;
-      meas_notctrl_m_per_epoch.back()+=misp;
+      epoch_log.current.br.jumpind_n++;
+      epoch_log.current.br.jumpind_m += misp;
    }
-
-   return(misp);
+   return misp;
 }
 
-void bp_t::notify_begin_new_epoch()
+void bp_base_t::notify_begin_new_epoch()
 {
-    meas_conddir_n_per_epoch.emplace_back(0);   // # conditional branches
-    meas_conddir_m_per_epoch.emplace_back(0);   // # mispredicted conditional branches
+    epoch_log.begin();
+}
 
-    meas_jumpdir_n_per_epoch.emplace_back(0);   // # jumps, direct
+epoch_stats_t bp_base_t::get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const
+{
+   epoch_stats_t stats;
+   epoch_log.get(stats, first_epoch, num_epochs);
+   return stats;
+}
 
-    meas_jumpind_n_per_epoch.emplace_back(0);   // # jumps, indirect
-    meas_jumpind_m_per_epoch.emplace_back(0);   // # mispredicted jumps, indirect
+branch_totals_t bp_base_t::current_epoch() const
+{
+   return epoch_log.current.br;
+}
 
-    meas_jumpret_n_per_epoch.emplace_back(0);   // # jumps, return
-    meas_jumpret_m_per_epoch.emplace_back(0);   // # mispredicted jumps, return
+branch_totals_t bp_base_t::totals() const
+{
+   return epoch_log.totals().br;
+}
 
-    meas_notctrl_n_per_epoch.emplace_back(0);   // # non-control transfer instructions
-    meas_notctrl_m_per_epoch.emplace_back(0);   // # non-control transfer instructions for which: next_pc != pc + 4
+uint64_t bp_base_t::num_branches() const
+{
+   const branch_totals_t t = totals();
+   return t.conddir_n + t.jumpdir_n + t.jumpind_n + t.jumpret_n;
+}
 
-    meas_cycles_on_wrong_path_per_epoch.emplace_back(0);    // cycles_on_wrong_path
+void bp_base_t::set_epoch_stats(const epoch_stats_t& stats)
+{
+   epoch_log.set(stats);
 }
 
-void bp_t::update_cycles_on_wrong_path(const uint64_t cycles_on_wrong_path)
+void bp_base_t::update_cycles_on_wrong_path(const uint64_t cycles_on_wrong_path)
 {
-    meas_cycles_on_wrong_path_per_epoch.back() += cycles_on_wrong_path;
+    epoch_log.current.br.cycles_wp += cycles_on_wrong_path;
 }
 
 #define BP_OUTPUT(str, n, m, i) \
     printf("%s%10ld %10ld %8.4lf%% %8.4lf\n", (str), (n), (m), 100.0*((double)(m)/(double)(n)), 1000.0*((double)(m)/(double)(i)))
 
-void bp_t::output(const uint64_t num_inst)
+void bp_base_t::output(const uint64_t num_inst)
 {
-   const uint64_t meas_conddir_n = std::accumulate(meas_conddir_n_per_epoch.begin(), meas_conddir_n_per_epoch.end(), 0);    // # conditional branches
-   const uint64_t meas_conddir_m = std::accumulate(meas_conddir_m_per_epoch.begin(), meas_conddir_m_per_epoch.end(), 0);    // # mispredicted conditional branches
-                                   
-   const uint64_t meas_jumpdir_n = std::accumulate(meas_jumpdir_n_per_epoch.begin(), meas_jumpdir_n_per_epoch.end(), 0);    // # jumps, direct
-                                   
-   const uint64_t meas_jumpind_n = std::accumulate(meas_jumpind_n_per_epoch.begin(), meas_jumpind_n_per_epoch.end(), 0);    // # jumps, indirect
-   const uint64_t meas_jumpind_m = std::accumulate(meas_jumpind_m_per_epoch.begin(), meas_jumpind_m_per_epoch.end(), 0);    // # mispredicted jumps, indirect
-                                   
-   const uint64_t meas_jumpret_n = std::accumulate(meas_jumpret_n_per_epoch.begin(), meas_jumpret_n_per_epoch.end(), 0);    // # jumps, return
-   const uint64_t meas_jumpret_m = std::accumulate(meas_jumpret_m_per_epoch.begin(), meas_jumpret_m_per_epoch.end(), 0);    // # mispredicted jumps, return
-                                   
-   const uint64_t meas_notctrl_n = std::accumulate(meas_notctrl_n_per_epoch.begin(), meas_notctrl_n_per_epoch.end(), 0);    // # non-control transfer instructions
-   const uint64_t meas_notctrl_m = std::accumulate(meas_notctrl_m_per_epoch.begin(), meas_notctrl_m_per_epoch.end(), 0);    // # non-control transfer instructions for which: next_pc != pc + 4
-
-   //const uint64_t meas_cycles_on_wrong_path = std::accumulate(meas_cycles_on_wrong_path_per_epoch.begin(), meas_cycles_on_wrong_path_per_epoch.end(), 0);
+   const branch_totals_t t = totals();
+   const uint64_t meas_conddir_n = t.conddir_n;    // # conditional branches
+   const uint64_t meas_conddir_m = t.conddir_m;    // # mispredicted conditional branches
+
+   const uint64_t meas_jumpdir_n = t.jumpdir_n;    // # jumps, direct
+
+   const uint64_t meas_jumpind_n = t.jumpind_n;    // # jumps, indirect
+   const uint64_t meas_jumpind_m = t.jumpind_m;    // # mispredicted jumps, indirect
+
+   const uint64_t meas_jumpret_n = t.jumpret_n;    // # jumps, return
+   const uint64_t meas_jumpret_m = t.jumpret_m;    // # mispredicted jumps, return
+
+   const uint64_t meas_notctrl_n = t.notctrl_n;    // # non-control transfer instructions
+   const uint64_t meas_notctrl_m = t.notctrl_m;    // # non-control transfer instructions for which: next_pc != pc + 4
 
    //uint64_t num_misp = (meas_conddir_m + meas_jumpind_m + meas_jumpret_m + meas_notctrl_m);
    printf("\n-----------------------------------------------BRANCH PREDICTION MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)----------------------------------------------\n");
@@ -236,137 +187,151 @@ void bp_t::output(const uint64_t num_inst)
    printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
 }
 
-void bp_t::output_periodic_info(const std::vector<uint64_t>&num_insts_per_epoch, const std::vector<uint64_t>&num_cycles_per_epoch)
+conddir_stats_t bp_base_t::conddir_stats(const uint64_t target_instr_count) const
 {
-   assert(num_insts_per_epoch.size() == num_cycles_per_epoch.size());
+   const epoch_row_t r = epoch_log.last(target_instr_count);
+   conddir_stats_t stats;
+   stats.instr = r.insts;
+   stats.cycles = r.cycles;
+   stats.br = r.br.conddir_n;
+   stats.br_mispred = r.br.conddir_m;
+   stats.cycles_wp = r.br.cycles_wp;
+   return stats;
+}
 
-   {
-      const uint64_t target_instr_count = 10000000;
-      printf("\n------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Last 10M instructions)-----------------------------------------------------\n");
-      printf("       Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI\n");
-      uint64_t my_instr_count = 0;
-      uint64_t my_cycle_count = 0;
-      uint64_t my_br_count = 0;
-      uint64_t my_br_mispred_count = 0;
-      uint64_t my_wpc_count = 0;
-      for(int epoch_index = num_insts_per_epoch.size() -1; epoch_index >= 0; epoch_index--)
-      {
-           my_instr_count       += num_insts_per_epoch.at(epoch_index);
-           my_cycle_count       += num_cycles_per_epoch.at(epoch_index);
-           my_br_count          += meas_conddir_n_per_epoch.at(epoch_index);
-           my_br_mispred_count  += meas_conddir_m_per_epoch.at(epoch_index);
-           my_wpc_count         += meas_cycles_on_wrong_path_per_epoch.at(epoch_index);
-           if(my_instr_count > target_instr_count)
-           {
-               break;
-           }
-      }
-      const double cyc_wp_avg =  (my_br_mispred_count == 0) ? 0.00 : (double)my_wpc_count/(double)my_br_mispred_count;
-      const double cyc_wp_pki =  (double)my_wpc_count*1000/(double)my_instr_count;
-      printf("%12ld %12ld %8.4f %10ld %10ld %8.4lf %12.4lf %8.4lf%% %8.4lf %10ld %10.4lf %10.4lf\n", my_instr_count, my_cycle_count, (double)my_instr_count/(double)my_cycle_count, my_br_count, my_br_mispred_count, (double)(my_br_count)/(double)(my_cycle_count), (double)(my_br_mispred_count)/(double)(my_cycle_count), 100.0*((double)(my_br_mispred_count)/(double)(my_br_count)), 1000.0*((double)(my_br_mispred_count)/(double)(my_instr_count)), my_wpc_count, cyc_wp_avg, cyc_wp_pki);
-      printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
-   }
+// The columns of a row that measure cycles (Cycles, IPC, BrPerCyc, MispBrPerCyc, CycWP, CycWPAvg and CycWPPKI),
+// n/a without cycles.
+struct per_cycle_columns_t {
+   char cycles[24], ipc[16], br_per_cyc[16], mispred_per_cyc[16], cycles_wp[24], cyc_wp_avg[16], cyc_wp_pki[16];
 
+   per_cycle_columns_t(const conddir_stats_t& row)
    {
-      const uint64_t target_instr_count = 25000000;
-      printf("\n------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Last 25M instructions)-----------------------------------------------------\n");
-      printf("       Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI\n");
-      uint64_t my_instr_count = 0;
-      uint64_t my_cycle_count = 0;
-      uint64_t my_br_count = 0;
-      uint64_t my_br_mispred_count = 0;
-      uint64_t my_wpc_count = 0;
-      for(int epoch_index = num_insts_per_epoch.size() -1; epoch_index >= 0; epoch_index--)
+      if (!row.timed())
       {
-           my_instr_count       += num_insts_per_epoch.at(epoch_index);
-           my_cycle_count       += num_cycles_per_epoch.at(epoch_index);
-           my_br_count          += meas_conddir_n_per_epoch.at(epoch_index);
-           my_br_mispred_count  += meas_conddir_m_per_epoch.at(epoch_index);
-           my_wpc_count         += meas_cycles_on_wrong_path_per_epoch.at(epoch_index);
-           if(my_instr_count > target_instr_count)
-           {
-               break;
-           }
+         for (char * column : {cycles, ipc, br_per_cyc, mispred_per_cyc, cycles_wp, cyc_wp_avg, cyc_wp_pki})
+            strcpy(column, "n/a");
+         return;
       }
-      const double cyc_wp_avg =  (my_br_mispred_count == 0) ? 0.00 : (double)my_wpc_count/(double)my_br_mispred_count;
-      const double cyc_wp_pki =  (double)my_wpc_count*1000/(double)my_instr_count;
-      printf("%12ld %12ld %8.4f %10ld %10ld %8.4lf %12.4lf %8.4lf%% %8.4lf %10ld %10.4lf %10.4lf\n", my_instr_count, my_cycle_count, (double)my_instr_count/(double)my_cycle_count, my_br_count, my_br_mispred_count, (double)(my_br_count)/(double)(my_cycle_count), (double)(my_br_mispred_count)/(double)(my_cycle_count), 100.0*((double)(my_br_mispred_count)/(double)(my_br_count)), 1000.0*((double)(my_br_mispred_count)/(double)(my_instr_count)), my_wpc_count, cyc_wp_avg, cyc_wp_pki);
-      printf("-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+      snprintf(cycles, sizeof(cycles), "%ld", row.cycles);
+      snprintf(ipc, sizeof(ipc), "%.4f", row.ipc());
+      snprintf(br_per_cyc, sizeof(br_per_cyc), "%.4lf", row.br_per_cyc());
+      snprintf(mispred_per_cyc, sizeof(mispred_per_cyc), "%.4lf", row.mispred_per_cyc());
+      snprintf(cycles_wp, sizeof(cycles_wp), "%ld", row.cycles_wp);
+      snprintf(cyc_wp_avg, sizeof(cyc_wp_avg), "%.4lf", row.cyc_wp_avg());
+      snprintf(cyc_wp_pki, sizeof(cyc_wp_pki), "%.4lf", row.cyc_wp_pki());
    }
+};
 
-   const uint64_t total_instr = std::accumulate(num_insts_per_epoch.begin(), num_insts_per_epoch.end(), 0); // # mispredicted jumps, return
-   {
-      const uint64_t target_instr_count = total_instr/2;
-      printf("\n---------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (50 Perc instructions)---------------------------------------------------\n");
-      printf("       Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI\n");
-      uint64_t my_instr_count = 0;
-      uint64_t my_cycle_count = 0;
-      uint64_t my_br_count = 0;
-      uint64_t my_br_mispred_count = 0;
-      uint64_t my_wpc_count = 0;
-      for(int epoch_index = num_insts_per_epoch.size() -1; epoch_index >= 0; epoch_index--)
-      {
-           my_instr_count       += num_insts_per_epoch.at(epoch_index);
-           my_cycle_count       += num_cycles_per_epoch.at(epoch_index);
-           my_br_count          += meas_conddir_n_per_epoch.at(epoch_index);
-           my_br_mispred_count  += meas_conddir_m_per_epoch.at(epoch_index);
-           my_wpc_count         += meas_cycles_on_wrong_path_per_epoch.at(epoch_index);
-           if(my_instr_count > target_instr_count)
-           {
-               break;
-           }
-      }
-      const double cyc_wp_avg =  (my_br_mispred_count == 0) ? 0.00 : (double)my_wpc_count/(double)my_br_mispred_count;
-      const double cyc_wp_pki =  (double)my_wpc_count*1000/(double)my_instr_count;
-      printf("%12ld %12ld %8.4f %10ld %10ld %8.4lf %12.4lf %8.4lf%% %8.4lf %10ld %10.4lf %10.4lf\n", my_instr_count, my_cycle_count, (double)my_instr_count/(double)my_cycle_count, my_br_count, my_br_mispred_count, (double)(my_br_count)/(double)(my_cycle_count), (double)(my_br_mispred_count)/(double)(my_cycle_count), 100.0*((double)(my_br_mispred_count)/(double)(my_br_count)), 1000.0*((double)(my_br_mispred_count)/(double)(my_instr_count)), my_wpc_count, cyc_wp_avg, cyc_wp_pki);
-      printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
-   }
+void conddir_stats_t::print_row() const
+{
+   const per_cycle_columns_t c(*this);
+   printf("%12ld %12s %8s %10ld %10ld %8s %12s %8.4lf%% %8.4lf %10s %10s %10s\n", instr, c.cycles, c.ipc, br, br_mispred, c.br_per_cyc, c.mispred_per_cyc, mr(), mpki(), c.cycles_wp, c.cyc_wp_avg, c.cyc_wp_pki);
+}
+
+void conddir_stats_t::register_stats(stats_t& st, const char * name) const
+{
+   stats_t& group = st.group(name)
+     .add("instr", instr);
+   // left out in branch-only mode (-X), which simulates no cycles
+   if (timed())
+      group.add("cycles", cycles)
+        .add("ipc", ipc());
+   group.add("br", br)
+     .add("br_mispred", br_mispred);
+   if (timed())
+      group.add("br_per_cyc", br_per_cyc())
+        .add("mispred_per_cyc", mispred_per_cyc());
+   group.add("mr", mr())
+     .add("mpki", mpki());
+   if (timed())
+      group.add("cycles_wp", cycles_wp)
+        .add("cyc_wp_avg", cyc_wp_avg())
+        .add("cyc_wp_pki", cyc_wp_pki());
+}
 
+void bp_base_t::register_stats(stats_t& st) const
+{
+   const branch_totals_t t = totals();
+   st.group("branches")
+     .add("conddir_n", t.conddir_n)
+     .add("conddir_m", t.conddir_m)
+     .add("jumpdir_n", t.jumpdir_n)
+     .add("jumpind_n", t.jumpind_n)
+     .add("jumpind_m", t.jumpind_m)
+     .add("jumpret_n", t.jumpret_n)
+     .add("jumpret_m", t.jumpret_m)
+     .add("notctrl_n", t.notctrl_n)
+     .add("notctrl_m", t.notctrl_m);
+
+   // the sections of output_periodic_info()
+   const uint64_t total_instr = epoch_log.totals().insts;
+   conddir_stats(10000000).register_stats(st, "conddir_last_10M");
+   conddir_stats(25000000).register_stats(st, "conddir_last_25M");
+   conddir_stats(total_instr/2).register_stats(st, "conddir_50perc");
+   conddir_stats(total_instr).register_stats(st, "conddir_full");
+
+   if (!epoch_log.kept())
+      return;
+   const epoch_stats_t e = get_epoch_stats(epoch_log.first_kept(), UINT64_MAX);
+   st.group("epochs")
+     .add("insts", e.insts)
+     .add("cycles", e.cycles)
+     .add("conddir_n", e.conddir_n)
+     .add("conddir_m", e.conddir_m)
+     .add("jumpdir_n", e.jumpdir_n)
+     .add("jumpind_n", e.jumpind_n)
+     .add("jumpind_m", e.jumpind_m)
+     .add("jumpret_n", e.jumpret_n)
+     .add("jumpret_m", e.jumpret_m)
+     .add("notctrl_n", e.notctrl_n)
+     .add("notctrl_m", e.notctrl_m)
+     .add("cycles_wp", e.cycles_on_wrong_path);
+}
+
+void bp_base_t::output_periodic_info()
+{
+   const uint64_t total_instr = epoch_log.totals().insts;
+   const uint64_t section_targets[] = {10000000, 25000000, total_instr/2, total_instr};
+   const char * section_titles[] = {
+      "\n------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Last 10M instructions)-----------------------------------------------------\n",
+      "\n------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Last 25M instructions)-----------------------------------------------------\n",
+      "\n---------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (50 Perc instructions)---------------------------------------------------\n",
+      "\n-------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)-------------------------------------\n"
+   };
+   const char * section_footers[] = {
+      "------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n",
+      "-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n",
+      "------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n",
+      "------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n"
+   };
+
+   for(int section = 0; section < 4; section++)
    {
-      const uint64_t total_instr = std::accumulate(num_insts_per_epoch.begin(), num_insts_per_epoch.end(), 0);  // # mispredicted jumps, return
-      const uint64_t target_instr_count = total_instr;
-      printf("\n-------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)-------------------------------------\n");
+      printf("%s", section_titles[section]);
       printf("       Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI\n");
-      uint64_t my_instr_count = 0;
-      uint64_t my_cycle_count = 0;
-      uint64_t my_br_count = 0;
-      uint64_t my_br_mispred_count = 0;
-      uint64_t my_wpc_count = 0;
-      for(int epoch_index = num_insts_per_epoch.size() -1; epoch_index >= 0; epoch_index--)
-      {
-           my_instr_count       += num_insts_per_epoch.at(epoch_index);
-           my_cycle_count       += num_cycles_per_epoch.at(epoch_index);
-           my_br_count          += meas_conddir_n_per_epoch.at(epoch_index);
-           my_br_mispred_count  += meas_conddir_m_per_epoch.at(epoch_index);
-           my_wpc_count         += meas_cycles_on_wrong_path_per_epoch.at(epoch_index);
-           if(my_instr_count > target_instr_count)
-           {
-               break;
-           }
-      }
-      const double cyc_wp_avg =  (my_br_mispred_count == 0) ? 0.00 : (double)my_wpc_count/(double)my_br_mispred_count;
-      const double cyc_wp_pki =  (double)my_wpc_count*1000/(double)my_instr_count;
-      printf("%12ld %12ld %8.4f %10ld %10ld %8.4lf %12.4lf %8.4lf%% %8.4lf %10ld %10.4lf %10.4lf\n", my_instr_count, my_cycle_count, (double)my_instr_count/(double)my_cycle_count, my_br_count, my_br_mispred_count, (double)(my_br_count)/(double)(my_cycle_count), (double)(my_br_mispred_count)/(double)(my_cycle_count), 100.0*((double)(my_br_mispred_count)/(double)(my_br_count)), 1000.0*((double)(my_br_mispred_count)/(double)(my_instr_count)), my_wpc_count, cyc_wp_avg, cyc_wp_pki);
-      printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+      conddir_stats(section_targets[section]).print_row();
+      printf("%s", section_footers[section]);
    }
 
-
-   if(PRINT_PER_EPOCH_STATS)
+   if(cfg.PRINT_PER_EPOCH_STATS)
    {
-      printf("EPOCH COUNT  = %lu\n", num_insts_per_epoch.size());
+      printf("EPOCH COUNT  = %lu\n", epoch_log.size());
       printf("\n-------------------------------------------------------------DIRECT CONDITIONAL BRANCH PREDICTION PER EPOCH MEASUREMENTS------------------------------------------------------------\n");
       printf("EPOCH       Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI\n");
-      for(uint64_t epoch_index = 0; epoch_index < num_insts_per_epoch.size(); epoch_index++)
+      for(uint64_t epoch_index = epoch_log.first_kept(); epoch_index < epoch_log.size(); epoch_index++)
       {
-           const uint64_t my_instr_count = num_insts_per_epoch.at(epoch_index);
-           const uint64_t my_cycle_count = num_cycles_per_epoch.at(epoch_index);
-           const uint64_t my_br_count = meas_conddir_n_per_epoch.at(epoch_index);
-           const uint64_t my_br_mispred_count = meas_conddir_m_per_epoch.at(epoch_index);
-           const uint64_t my_wpc_count = meas_cycles_on_wrong_path_per_epoch.at(epoch_index);
-           const double cyc_wp_avg =  (my_br_mispred_count == 0) ? 0.00 : (double)my_wpc_count/(double)my_br_mispred_count;
-           const double cyc_wp_pki =  (double)my_wpc_count*1000/(double)my_instr_count;
-           printf("%5ld %12ld %12ld %8.4f %10ld %10ld %8.4lf %12.4lf %8.4lf%% %8.4lf %10ld %10.4lf %10.4lf\n", epoch_index, my_instr_count, my_cycle_count, (double)my_instr_count/(double)my_cycle_count, my_br_count, my_br_mispred_count, (double)(my_br_count)/(double)(my_cycle_count), (double)(my_br_mispred_count)/(double)(my_cycle_count), 100.0*((double)(my_br_mispred_count)/(double)(my_br_count)), 1000.0*((double)(my_br_mispred_count)/(double)(my_instr_count)), my_wpc_count, cyc_wp_avg, cyc_wp_pki);
+           const epoch_row_t& epoch = epoch_log.epoch(epoch_index);
+           conddir_stats_t row;
+           row.instr = epoch.insts;
+           row.cycles = epoch.cycles;
+           row.br = epoch.br.conddir_n;
+           row.br_mispred = epoch.br.conddir_m;
+           row.cycles_wp = epoch.br.cycles_wp;
+           const per_cycle_columns_t c(row);
+           printf("%5ld %12ld %12s %8s %10ld %10ld %8s %12s %8.4lf%% %8.4lf %10s %10s %10s\n", epoch_index, row.instr, c.cycles, c.ipc, row.br, row.br_mispred, c.br_per_cyc, c.mispred_per_cyc, row.mr(), row.mpki(), c.cycles_wp, c.cyc_wp_avg, c.cyc_wp_pki);
       }
       printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
    }
 }
+
+template class basic_bp_t<cbp_hooks_t>;
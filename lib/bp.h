@@ -1,3 +1,4 @@
+#pragma once
 /*
 
 Copyright (c) 2019, North Carolina State University
@@ -22,48 +23,93 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 // Modified by A. Seznec (andre.seznec@inria.fr) to include TAGE-SC-L predictor and the ITTAGE indirect branch predictor
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "sim_common_structs.h"
+#include "parameters.h"
 #include "ittage.h"
+#include "snapshot.h"
+#include "epoch_log.h"
 
+class stats_t;
+
+// Return address stack: calls push the address after them, returns pop their predicted target. A full stack overwrites
+// its oldest entry. Branches are predicted in trace order, on the correct path only, so the stack is never corrupted
+// by wrong-path calls and returns and needs no repair on mispredictions.
 class ras_t {
 private:
-    uint64_t *ras;
-    uint64_t size;
+    std::vector<uint64_t> ras;
     uint64_t tos;
 
 public:
     ras_t(uint64_t size) {
-       this->size = ((size > 0) ? size : 1);
-       ras = new uint64_t[this->size];
+       ras.assign((size > 0) ? size : 1, 0);
        tos = 0;
     }
 
-    ~ras_t() {
-    }
-
     inline void push(uint64_t x) {
-           ras[tos] = x;
+       ras[tos] = x;
        tos++;
-       if (tos == size)
+       if (tos == ras.size())
           tos = 0;
     }
 
     inline uint64_t pop() {
-       tos = ((tos > 0) ? (tos - 1) : (size - 1));
+       tos = ((tos > 0) ? (tos - 1) : (ras.size() - 1));
        return(ras[tos]);
     }
+
+    void reset() {
+       std::fill(ras.begin(), ras.end(), 0);
+       tos = 0;
+    }
+
+    void snapshot(snapshot_t& s) {
+       s.io(ras);
+       s.io(tos);
+    }
 };
 
-class bp_t {
-private:
+// Conditional branch measurements summed over the most recent epochs covering a target instruction count,
+// i.e. one row of the DIRECT CONDITIONAL BRANCH PREDICTION MEASUREMENTS sections.
+struct conddir_stats_t {
+    uint64_t instr = 0;
+    uint64_t cycles = 0;
+    uint64_t br = 0;
+    uint64_t br_mispred = 0;
+    uint64_t cycles_wp = 0;
+
+    // false in branch-only mode (-X), which simulates no cycles: Cycles, IPC, BrPerCyc, MispBrPerCyc and the CycWP
+    // columns are then n/a
+    bool timed() const { return cycles != 0; }
+    double ipc() const { return (double)instr/(double)cycles; }
+    double br_per_cyc() const { return (double)br/(double)cycles; }
+    double mispred_per_cyc() const { return (double)br_mispred/(double)cycles; }
+    double mr() const { return 100.0*((double)br_mispred/(double)br); }
+    double mpki() const { return 1000.0*((double)br_mispred/(double)instr); }
+    double cyc_wp_avg() const { return (br_mispred == 0) ? 0.00 : (double)cycles_wp/(double)br_mispred; }
+    double cyc_wp_pki() const { return (double)cycles_wp*1000/(double)instr; }
+
+    void print_row() const;
+    // Registers the row in its own group, named name (-J).
+    void register_stats(stats_t& st, const char * name) const;
+};
+
+// The branch predictors of the timing model, less the conditional branch predictor, which is P of basic_bp_t<P>.
+class bp_base_t {
+protected:
+    const sim_config_t cfg;
+
     //// Conditional branch predictor based on CBP-5 TAGE-SC-L
     //PREDICTOR *TAGESCL;
 
     // Indirect target predictor based on ITTAGE
-    IPREDICTOR *ITTAGE = nullptr;
+    std::unique_ptr<IPREDICTOR> ITTAGE;
+
+    // Return address stack for predicting return targets (RAS_SIZE > 0).
+    std::unique_ptr<ras_t> RAS;
 
-    // Return address stack for predicting return targets.
-    //ras_t ras;
-    //
     unsigned mispred_correction_seed = 0;
 
     //// Measurements.
@@ -81,35 +127,59 @@ private:
     //uint64_t meas_notctrl_n;  // # non-control transfer instructions
     //uint64_t meas_notctrl_m;  // # non-control transfer instructions for which: next_pc != pc + 4
 
-    // Per Epoch Measurements.
-    std::vector<uint64_t> meas_conddir_n_per_epoch; // # conditional branches
-    std::vector<uint64_t> meas_conddir_m_per_epoch; // # mispredicted conditional branches
-
-    std::vector<uint64_t> meas_jumpdir_n_per_epoch; // # jumps, direct
-
-    std::vector<uint64_t> meas_jumpind_n_per_epoch; // # jumps, indirect
-    std::vector<uint64_t> meas_jumpind_m_per_epoch; // # mispredicted jumps, indirect
+    // Per Epoch Measurements: instructions and cycles are counted by the simulators.
+    epoch_log_t epoch_log;
 
-    std::vector<uint64_t> meas_jumpret_n_per_epoch; // # jumps, return
-    std::vector<uint64_t> meas_jumpret_m_per_epoch; // # mispredicted jumps, return
-
-    std::vector<uint64_t> meas_notctrl_n_per_epoch; // # non-control transfer instructions
-    std::vector<uint64_t> meas_notctrl_m_per_epoch; // # non-control transfer instructions for which: next_pc != pc + 4
-
-    std::vector<uint64_t> meas_cycles_on_wrong_path_per_epoch;
+    // predict() of a branch whose outcome is replayed (-z replay, branch_outcomes.h).
+    bool replay(InstClass inst_class);
 
 public:
-    bp_t();
-    ~bp_t();
+    bp_base_t(const sim_config_t& _cfg);
+    // Back to the state of a new bp_t, in the tables already allocated. The conditional branch predictor is not part
+    // of it: its state is the contestant's.
+    void reset();
 
-    // Returns true if instruction is a mispredicted branch.
-    // Also updates all branch predictor structures as applicable.
-    bool predict(uint64_t seq_no, uint8_t piece, InstClass insn, uint64_t pc, uint64_t next_pc, const uint64_t pred_cycle);
+    // Same measurements as predict() on n non-control-transfer instructions that fall through (next_pc == pc + 4).
+    void count_not_ctrl(const uint64_t n) { epoch_log.current.br.notctrl_n += n; }
 
     // Output all branch prediction measurements.
     void output(const uint64_t num_inst);
-    void output_periodic_info(const std::vector<uint64_t>&num_insts_per_epoch, const std::vector<uint64_t>&num_cycles_per_epoch);
+    void output_periodic_info();
+    // Registers the measurements of output() and output_periodic_info(), and the per-epoch ones if kept (-J).
+    void register_stats(stats_t& st) const;
+    conddir_stats_t conddir_stats(const uint64_t target_instr_count) const;
     void notify_begin_new_epoch();
+    // The epochs of the run, whose instructions and cycles the simulators count.
+    epoch_log_t& epochs() { return epoch_log; }
+    const epoch_log_t& epochs() const { return epoch_log; }
     void update_cycles_on_wrong_path(const uint64_t cycles_on_wrong_path);
+    void snapshot(snapshot_t& s);
+    // Measurements of epochs [first_epoch, first_epoch + num_epochs), at most up to the last epoch begun.
+    epoch_stats_t get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const;
+    // Branches of all types measured so far.
+    uint64_t num_branches() const;
+    // All the measurements so far, and those of the current epoch.
+    branch_totals_t totals() const;
+    branch_totals_t current_epoch() const;
+    // Replaces the branch measurements with those of stats, to report merged measurements.
+    void set_epoch_stats(const epoch_stats_t& stats);
+};
+
+// bp_base_t with P, a predictor type of cbp_predictor.h, as the conditional branch predictor. predict() is defined in
+// bp_impl.h.
+template <class P>
+class basic_bp_t : public bp_base_t {
+public:
+    using bp_base_t::bp_base_t;
+
+    // Returns true if instruction is a mispredicted branch.
+    // Also updates all branch predictor structures as applicable. static_id, the dense id of pc, is first handed to
+    // notify_static_id() for a branch, with CBP_HOOK_STATIC_ID.
+    bool predict(uint64_t seq_no, uint8_t piece, InstClass insn, uint64_t pc, uint64_t next_pc, const uint64_t pred_cycle, uint32_t static_id);
 };
 
+// The predictor of cbp: the hooks of cbp.h, through the plugin and thread dispatch (cbp_predictor.h), instantiated in
+// bp.cc.
+struct cbp_hooks_t;
+using bp_t = basic_bp_t<cbp_hooks_t>;
+extern template class basic_bp_t<cbp_hooks_t>;
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdlib>
+#include "bp.h"
+#include "branch_outcomes.h"
+#include "cbp_predictor.h"
+#include "phase_timer.h"
+#include "usdt.h"
+
+// basic_bp_t<P>::predict(), for the translation units instantiating basic_bp_t: bp.cc for bp_t, uarchsim_impl.h for
+// the other predictor types.
+
+// Returns true if instruction is a mispredicted branch.
+// Also updates all branch predictor structures as applicable.
+template <class P>
+bool basic_bp_t<P>::predict(uint64_t seq_no, uint8_t piece, InstClass inst_class, uint64_t pc, uint64_t next_pc, const uint64_t pred_cycle, uint32_t static_id)
+{
+   static_assert(is_cbp_predictor<P>::value, "P lacks a hook of cbp_predictor.h");
+   PHASE_SCOPE(PHASE_PREDICT);
+   if ((P::hooks() & CBP_HOOK_STATIC_ID) && is_br(inst_class))
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      P::notify_static_id(seq_no, piece, pc, static_id);
+   }
+   if (branch_outcomes.replaying() && is_br(inst_class))
+      return replay(inst_class);
+   bool taken = false;
+   bool pred_taken = false;
+   uint64_t pred_target;
+   bool misp;
+
+   if (inst_class == InstClass::condBranchInstClass)
+   {
+      // CONDITIONAL BRANCH
+
+      // Determine the actual taken/not-taken outcome.
+      taken = (next_pc != (pc + 4));
+
+      // Make prediction.
+      //pred_taken= TAGESCL->GetPrediction (pc);
+      pred_taken = P::get_cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+      
+      // Determine if mispredicted or not.
+      misp = (pred_taken != taken);
+      
+      if(cfg.MISP_REDUCTION_PERC != 0 && misp)
+      {
+          const bool flip_mispred = (cfg.MISP_REDUCTION_PERC == 100) ? true : (static_cast<uint64_t>(rand_r(&mispred_correction_seed)%100) < cfg.MISP_REDUCTION_PERC);
+          if(flip_mispred)
+          {
+              misp = false;
+              pred_taken =  taken;
+          }
+      }
+      
+      /* A. Seznec: uodate TAGE-SC-L*/
+      //TAGESCL-> UpdatePredictor (pc , 1,  taken, pred_taken, next_pc);
+      //UpdateCondDirPredictor (pc , 1,  taken, pred_taken, next_pc);
+ 
+      //// InOrder Update Option
+      //spec_update(seq_no, piece, pc, inst_class, taken, pred_taken, next_pc);
+      //temp_predictor_update_hook(seq_no, piece, pc, taken,pred_taken, next_pc);
+      // OOO Update Option
+      {
+         PHASE_SCOPE(PHASE_SPEC_UPDATE);
+         P::spec_update(seq_no, piece, pc, inst_class, taken, pred_taken, next_pc);
+      }
+      // Update measurements.
+      epoch_log.current.br.conddir_n++;
+      epoch_log.current.br.conddir_m += misp;
+   }
+   else if (inst_class == InstClass::uncondDirectBranchInstClass || inst_class == InstClass::callDirectInstClass) {
+      // CALL OR JUMP DIRECT
+
+      // Target of JAL or J (rd=x0) will be available in either the fetch stage (BTB hit)
+      // or the pre-decode/decode stage (BTB miss), so these are not predicted.
+      // Never mispredicted.
+      misp = false;
+      
+      /* A. Seznec: update branch  histories for TAGE-SC-L and ITTAGE */
+      //TAGESCL->TrackOtherInst(pc , 0,  true,next_pc);
+      //TrackOtherInst(pc , 0,  true,next_pc);
+      {
+         PHASE_SCOPE(PHASE_SPEC_UPDATE);
+         P::spec_update(seq_no, piece, pc, inst_class, true/*taken*/, true/*pred_taken*/, next_pc);
+      }
+      if(!cfg.PERFECT_INDIRECT_PRED)
+      {
+          ITTAGE->TrackOtherInst(pc , next_pc);
+      }
+      if(RAS && inst_class == InstClass::callDirectInstClass)
+      {
+          RAS->push(pc + 4);
+      }
+
+      // Update measurements.
+      epoch_log.current.br.jumpdir_n++;
+   }
+   else if (inst_class == InstClass::uncondIndirectBranchInstClass || inst_class == InstClass::callIndirectInstClass || inst_class==InstClass::ReturnInstClass) 
+   {
+      const bool is_ret = (inst_class == InstClass::ReturnInstClass);
+      const bool ind_not_ret = !is_ret;
+      epoch_log.current.br.jumpind_n += ind_not_ret;
+      epoch_log.current.br.jumpret_n += is_ret;
+      if (is_ret && RAS)
+      {
+         // Returns are predicted by the RAS alone: ITTAGE only tracks them in its history.
+         misp = (RAS->pop() != next_pc);
+         if (!cfg.PERFECT_INDIRECT_PRED)
+            ITTAGE->TrackOtherInst(pc , next_pc);
+         epoch_log.current.br.jumpret_m += misp;
+      }
+      else if (cfg.PERFECT_INDIRECT_PRED)
+      {
+          misp = false;
+         // Update measurements.
+      }
+      else
+      {
+         // Make prediction.
+         pred_target= ITTAGE->GetPrediction (pc);
+
+         // Determine if mispredicted or not.
+         misp = (pred_target != next_pc);
+      
+         /* A. Seznec: update ITTAGE*/
+         ITTAGE-> UpdatePredictor (pc , next_pc);
+      
+         // Update measurements.
+         epoch_log.current.br.jumpind_m += !is_ret && misp;
+         epoch_log.current.br.jumpret_m += is_ret && misp;
+      }
+      if (RAS && inst_class == InstClass::callIndirectInstClass)
+         RAS->push(pc + 4);
+
+      {
+         PHASE_SCOPE(PHASE_SPEC_UPDATE);
+         P::spec_update(seq_no, piece, pc, inst_class, true/*taken*/, true/*pred_taken*/, next_pc);
+      }
+      /* A. Seznec: update history for TAGE-SC-L */
+      //TAGESCL->TrackOtherInst(pc , 2,  true,next_pc);
+      //TrackOtherInst(pc , 2,  true,next_pc);
+   }
+   else
+   {
+      // not a control-transfer instruction
+      misp = (next_pc != pc + 4);
+
+      // Update measurements.
+      epoch_log.current.br.notctrl_n++;
+      epoch_log.current.br.notctrl_m += misp;
+   }
+
+   if (branch_outcomes.recording() && branch_outcomes_t::predicted(inst_class))
+      branch_outcomes.push(misp);
+   if (misp)
+      CBP_PROBE5(mispredict, seq_no, piece, pc, inst_class, next_pc);
+   return(misp);
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <algorithm>
+#include "bp_only_sim.h"
+#include "cbp.h"
+#include "parameters.h"
+#include "snapshot.h"
+#include "phase_timer.h"
+#include "predictor_thread.h"
+#include "stats.h"
+#include "footprint.h"
+#include "progress_stream.h"
+#include "time_series.h"
+#include "usdt.h"
+#include "invariant.h"
+
+bp_only_sim_t::bp_only_sim_t(const sim_config_t& _cfg)
+   : cfg(_cfg)
+   , BP(cfg)
+   , resolve_delay(cfg.BRANCH_ONLY_RESOLVE_DELAY)
+   , piece(UINT8_MAX)
+   , num_inst(0)
+   , num_uop(0)
+{
+   BP.notify_begin_new_epoch();
+}
+
+void bp_only_sim_t::resolve_front()
+{
+   const pending_branch_t& br = pending.front();
+   resolve_info.dec_info.insn_class = br.insn_class;
+   resolve_info.dec_info.static_id = br.static_id;
+   resolve_info.taken = br.taken;
+   resolve_info.next_pc = br.next_pc;
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      call_instr_execute_resolve(br.seq_no, br.piece, br.pc, br.pred_taken, resolve_info, num_uop);
+   }
+   pending.pop_front();
+}
+
+void bp_only_sim_t::report_progress() const
+{
+   const epoch_log_t& epochs = BP.epochs();
+   const branch_totals_t& e = epochs.current.br;
+   if (progress_stream.enabled())
+      progress_stream.epoch(epochs.size() - 1, epochs.current.insts, 0, e.conddir_n, e.conddir_m, 0);
+   CBP_PROBE5(epoch, epochs.size() - 1, epochs.current.insts, 0, e.conddir_n, e.conddir_m);
+}
+
+void bp_only_sim_t::end_current_begin_new_epoch()
+{
+   report_progress();
+   if (BP.epochs().size() == 1)
+      alloc_stats_steady(num_uop);
+   BP.notify_begin_new_epoch();
+}
+
+void bp_only_sim_t::step(db_t *inst)
+{
+   PHASE_SCOPE(PHASE_STEP);
+   // Same piece numbering as uarchsim_t::step.
+   piece = (piece == UINT8_MAX) ? 0 : (piece + 1);
+   const uint64_t seq_no = num_uop++;
+
+   while (!pending.empty() && pending.front().seq_no + resolve_delay < seq_no)
+      resolve_front();
+
+   if (!cfg.PERFECT_BRANCH_PRED)
+   {
+      checkpoint_oldest_inflight = pending.empty() ? seq_no : pending.front().seq_no;
+      const bool misp = BP.predict(seq_no, piece, inst->insn_class, inst->pc, inst->next_pc, seq_no, inst->static_id);
+      if (is_br(inst->insn_class))
+      {
+         const bool taken = is_cond_br(inst->insn_class) ? (inst->next_pc != (inst->pc + 4)) : true;
+         const bool pred_taken = is_cond_br(inst->insn_class) ? (misp ? !taken : taken) : true;
+         pending.push_back({seq_no, piece, inst->pc, pred_taken, inst->insn_class, taken, inst->next_pc, inst->static_id});
+      }
+   }
+
+   if (inst->is_last_piece)
+   {
+      piece = UINT8_MAX;
+      num_inst++;
+      uint64_t& epoch_insts = BP.epochs().current.insts;
+      epoch_insts++;
+      if (time_series.enabled() && time_series.tick())
+         time_series.end_epoch(0, BP.totals());
+      if (epoch_insts == cfg.EPOCH_SIZE_INSTS)
+         end_current_begin_new_epoch();
+   }
+}
+
+void bp_only_sim_t::skip(uint64_t num_uops, uint64_t num_insts)
+{
+   // Branches are never cracked, so the skipped run always ends on an instruction boundary.
+   piece = UINT8_MAX;
+   num_uop += num_uops;
+   if (!cfg.PERFECT_BRANCH_PRED)
+      BP.count_not_ctrl(num_uops);
+   if (time_series.enabled())
+      time_series.skip(num_insts, 0, BP.totals());
+
+   while (num_insts)
+   {
+      uint64_t& epoch_insts = BP.epochs().current.insts;
+      const uint64_t n = std::min(num_insts, cfg.EPOCH_SIZE_INSTS - epoch_insts);
+      num_inst += n;
+      epoch_insts += n;
+      num_insts -= n;
+      if (epoch_insts == cfg.EPOCH_SIZE_INSTS)
+         end_current_begin_new_epoch();
+   }
+}
+
+void bp_only_sim_t::replay(const branch_record_t& rec)
+{
+   skip(rec.uop_delta, rec.instr_delta);
+
+   db_t inst;
+   inst.insn_class = rec.insn_class;
+   inst.pc = rec.pc;
+   inst.next_pc = rec.next_pc;
+   inst.is_taken = rec.is_taken;
+   inst.is_last_piece = true;
+   inst.static_id = replay_ids.id(rec.pc);
+   step(&inst);
+}
+
+void bp_only_sim_t::output()
+{
+   while (!pending.empty())
+      resolve_front();
+   if (BP.epochs().current.insts > 0)
+      report_progress();
+   time_series.end(0, BP.totals());
+
+   printf("BRANCH-ONLY MODE: no timing model, resolve delay = %lu uops (Cycles, IPC and CycWP are not simulated)\n", resolve_delay);
+   printf("PERFECT_BRANCH_PRED = %s\n", (cfg.PERFECT_BRANCH_PRED ? "1" : "0"));
+   printf("PERFECT_INDIRECT_PRED = %s\n", (cfg.PERFECT_INDIRECT_PRED ? "1" : "0"));
+   printf("instructions = %lu\n", num_inst);
+   BP.output(num_inst);
+   BP.output_periodic_info();
+   phase_timers_report(num_uop, BP.num_branches());
+   checkpoint_stragglers_report();
+}
+
+void bp_only_sim_t::register_stats(stats_t& st) const
+{
+   st.group("core")
+     .add("instr", num_inst)
+     .add("uops", num_uop)
+     .add("resolve_delay", resolve_delay);
+   BP.register_stats(st);
+}
+
+void bp_only_sim_t::snapshot(snapshot_t& s)
+{
+   s.io(BP);
+   s.io(pending);
+   s.io(replay_ids);
+   s.io(piece);
+   s.io(num_inst);
+   s.io(num_uop);
+}
+
+conddir_stats_t bp_only_sim_t::get_conddir_stats(const uint64_t target_instr_count) const
+{
+   return BP.conddir_stats(target_instr_count);
+}
+
+uint64_t bp_only_sim_t::get_epoch_insts() const
+{
+   return BP.epochs().totals().insts;
+}
+
+void bp_only_sim_t::start_in_epoch(const uint64_t num_insts)
+{
+   CBP_CHECK((BP.epochs().size() == 1) && (BP.epochs().current.insts == 0) && (num_insts < cfg.EPOCH_SIZE_INSTS));
+   BP.epochs().current.insts = num_insts;
+}
+
+void bp_only_sim_t::keep_epochs()
+{
+   BP.epochs().keep();
+}
+
+epoch_stats_t bp_only_sim_t::get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const
+{
+   return BP.get_epoch_stats(first_epoch, num_epochs);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "sim_common_structs.h"
+#include "trace_db.h"
+#include "bp.h"
+#include "parameters.h"
+#include "branch_trace.h"
+#include "static_ids.h"
+
+// Branch-only simulator for MPKI sweeps (-X).
+//
+// Drives the predictor hooks in trace order without any of uarchsim_t's timing structures (window, caches, execution
+// lanes, prefetcher): every branch is predicted through bp_t::predict as it is fetched, and resolved
+// (notify_instr_execute_resolve) once cfg.BRANCH_ONLY_RESOLVE_DELAY further micro-ops have been fetched.
+// It can also replay a branch trace (lib/branch_trace.h), where the non-branch micro-ops in between are only counted.
+// There is no notion of cycles, so the reported Cycles/IPC/CycWP columns are not meaningful in this mode.
+class bp_only_sim_t {
+   private:
+      struct pending_branch_t {
+         uint64_t seq_no;
+         uint8_t piece;
+         uint64_t pc;
+         bool pred_taken;
+         InstClass insn_class;
+         bool taken;
+         uint64_t next_pc;
+         uint32_t static_id;
+      };
+
+      const sim_config_t cfg;
+      bp_t BP;
+      const uint64_t resolve_delay;
+
+      std::deque<pending_branch_t> pending;
+      ExecuteInfo resolve_info;
+      // Static ids of the branches replayed, as a branch trace only has those (replay())
+      static_ids_t replay_ids;
+
+      uint8_t piece;
+      uint64_t num_inst;
+      uint64_t num_uop;
+
+      void resolve_front();
+      // Reports the current epoch to the progress stream (-Y), now complete.
+      void report_progress() const;
+      void end_current_begin_new_epoch();
+
+   public:
+      bp_only_sim_t(const sim_config_t& _cfg);
+
+      void step(db_t *inst);
+      // Accounts for num_uops non-branch micro-ops (num_insts instructions) without stepping them, for branch traces.
+      void skip(uint64_t num_uops, uint64_t num_insts);
+      // skip() over the record's non-branch micro-ops, then step() its branch.
+      void replay(const branch_record_t& rec);
+      void output();
+      // Registers the measurements of output() (valid after it) for the stats record (-J).
+      void register_stats(stats_t& st) const;
+      // Saves or restores the branches awaiting resolution and the measurements between two steps (-S/-s).
+      void snapshot(snapshot_t& s);
+      conddir_stats_t get_conddir_stats(const uint64_t target_instr_count) const;
+      uint64_t get_epoch_insts() const;
+      // Starts the first epoch num_insts instructions in, so that the epochs line up with those of the whole trace when
+      // the run starts in the middle of it (-K).
+      void start_in_epoch(const uint64_t num_insts);
+      // Keeps the measurements of each epoch from the current one on, for get_epoch_stats() and the stats record (-J).
+      void keep_epochs();
+      // Measurements of epochs [first_epoch, first_epoch + num_epochs), at most up to the last epoch begun.
+      epoch_stats_t get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "branch_profile.h"
+
+// Branch outcome dataset (-x), for training predictors offline: one row per conditional branch, as the predictor
+// sees it in spec_update(), right after its prediction. So the history of a row is the one the branch was predicted
+// with, the outcomes of the conditional branches before it, the newest in bit 0.
+//
+// The file is columnar, of fixed-width columns, so that a reader maps each column of a block to an array without
+// parsing (scripts/branch_dataset.py reads them into numpy arrays):
+//
+//   branch_dataset_header_t
+//   num_columns x branch_dataset_column_t
+//   blocks, each: uint64_t rows, then the rows values of each column in turn, width bytes per value
+//
+// Rows are gathered in a block per column, and a full block is written in one fwrite(), so recording a row is a few
+// stores. num_rows in the header is written at close(): a file without it (0) was not completed.
+struct branch_dataset_header_t
+{
+    char magic[8];              // "CBPDSET"
+    uint32_t num_columns;
+    uint32_t history_bits;
+    uint64_t block_rows;        // rows of every block but the last
+    uint64_t num_rows;
+};
+
+struct branch_dataset_column_t
+{
+    char name[24];
+    uint64_t width;             // bytes per value, little-endian
+};
+
+class branch_dataset_t
+{
+    public:
+        static constexpr uint64_t BLOCK_ROWS = 1 << 16;
+        static constexpr uint32_t MAX_HISTORY_BITS = 4096;
+
+    private:
+        enum column_t { COL_PC, COL_TAKEN, COL_PREDICTED, COL_PROVIDER, COL_HIT_BANK, COL_HISTORY, NUM_COLUMNS };
+
+        FILE * file = nullptr;
+        uint64_t num_rows = 0;
+        uint64_t block_rows = 0;
+        uint32_t history_bits = 0;
+        uint64_t history_bytes = 0;
+
+        // the history window, the newest outcome in bit 0 of word 0, the bits beyond history_bits kept at 0
+        std::vector<uint64_t> history;
+        uint64_t top_mask = 0;
+
+        std::vector<uint64_t> pcs;
+        std::vector<uint8_t> taken;
+        std::vector<uint8_t> predicted;
+        std::vector<uint8_t> providers;
+        std::vector<uint8_t> hit_banks;
+        std::vector<uint8_t> histories;
+
+        void write_block()
+        {
+            const uint64_t rows = block_rows;
+            fwrite(&rows, sizeof(rows), 1, file);
+            fwrite(pcs.data(), sizeof(uint64_t), rows, file);
+            fwrite(taken.data(), 1, rows, file);
+            fwrite(predicted.data(), 1, rows, file);
+            fwrite(providers.data(), 1, rows, file);
+            fwrite(hit_banks.data(), 1, rows, file);
+            fwrite(histories.data(), history_bytes, rows, file);
+            block_rows = 0;
+        }
+
+    public:
+        branch_dataset_t() = default;
+        branch_dataset_t(const branch_dataset_t&) = delete;
+        branch_dataset_t& operator=(const branch_dataset_t&) = delete;
+
+        ~branch_dataset_t()
+        {
+            close();
+        }
+
+        // Starts the dataset at path, with a history window of bits outcomes (1 to MAX_HISTORY_BITS). Returns false if
+        // it cannot be written.
+        bool open(const char * path, uint32_t bits)
+        {
+            if ((bits == 0) || (bits > MAX_HISTORY_BITS))
+                return false;
+            file = fopen(path, "wb");
+            if (!file)
+                return false;
+            num_rows = 0;
+            block_rows = 0;
+            history_bits = bits;
+            history_bytes = (bits + 7) / 8;
+            history.assign((bits + 63) / 64, 0);
+            top_mask = (bits % 64) ? ((1ull << (bits % 64)) - 1) : ~0ull;
+
+            pcs.resize(BLOCK_ROWS);
+            taken.resize(BLOCK_ROWS);
+            predicted.resize(BLOCK_ROWS);
+            providers.resize(BLOCK_ROWS);
+            hit_banks.resize(BLOCK_ROWS);
+            histories.resize(BLOCK_ROWS * history_bytes);
+
+            const branch_dataset_header_t header = {"CBPDSET", NUM_COLUMNS, history_bits, BLOCK_ROWS, 0};
+            const branch_dataset_column_t columns[NUM_COLUMNS] = {
+                {"pc", 8}, {"taken", 1}, {"predicted", 1}, {"provider", 1}, {"hit_bank", 1}, {"history", history_bytes}};
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(columns, sizeof(columns), 1, file);
+            return true;
+        }
+
+        bool enabled() const
+        {
+            return file != nullptr;
+        }
+
+        // A conditional branch at pc, predicted pred_dir by the predictor and provider (hit_bank its longest matching
+        // TAGE bank), that went resolve_dir. Its outcome then enters the history of the next ones.
+        void record(uint64_t pc, bool resolve_dir, bool pred_dir, branch_provider_t provider, uint8_t hit_bank)
+        {
+            const uint64_t row = block_rows;
+            pcs[row] = pc;
+            taken[row] = resolve_dir;
+            predicted[row] = pred_dir;
+            providers[row] = provider;
+            hit_banks[row] = hit_bank;
+            memcpy(&histories[row * history_bytes], history.data(), history_bytes);
+            num_rows++;
+            if (++block_rows == BLOCK_ROWS)
+                write_block();
+
+            for (size_t w = history.size() - 1; w > 0; w--)
+                history[w] = (history[w] << 1) | (history[w - 1] >> 63);
+            history[0] = (history[0] << 1) | resolve_dir;
+            history.back() &= top_mask;
+        }
+
+        // Writes the last block and the row count, and closes the file. Returns false if a write failed.
+        bool close()
+        {
+            if (!file)
+                return true;
+            if (block_rows)
+                write_block();
+            fseek(file, offsetof(branch_dataset_header_t, num_rows), SEEK_SET);
+            fwrite(&num_rows, sizeof(num_rows), 1, file);
+            const bool ok = !ferror(file) & (fclose(file) == 0);
+            file = nullptr;
+            return ok;
+        }
+
+        uint64_t get_num_rows() const
+        {
+            return num_rows;
+        }
+};
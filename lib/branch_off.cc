@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "branch_off.h"
+#include "parameters.h"
+
+namespace {
+
+struct variant_worker_t {
+    pid_t pid = -1;
+    int result_fd = -1;         // worker -> parent: conddir_stats_t
+    bool pass = false;
+    conddir_stats_t result;
+};
+
+bool write_all(int fd, const void * buf, size_t size)
+{
+    const char * p = static_cast<const char *>(buf);
+    while (size)
+    {
+        const ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void * buf, size_t size)
+{
+    char * p = static_cast<char *>(buf);
+    while (size)
+    {
+        const ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Runs in the forked worker: never returns. The worker leaves with _exit(), so that none of the state it shares with
+// the parent (the trace reader's threads, notably) is torn down.
+void run_worker(uint64_t k, const std::function<conddir_stats_t(uint64_t)>& run_variant, const char * log_dir, int result_fd)
+{
+    const std::string log_path = log_dir ? (std::string(log_dir) + "/variant" + std::to_string(k) + ".log") : std::string("/dev/null");
+    const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0)
+    {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    PREDICTOR_CONFIG = k;
+    const conddir_stats_t result = run_variant(k);
+    fflush(stdout);
+    std::cout.flush();
+    const bool written = write_all(result_fd, &result, sizeof(result));
+    close(result_fd);
+    _exit(written ? 0 : 1);
+}
+
+} // namespace
+
+int run_branch_off(const std::function<conddir_stats_t(uint64_t)>& run_variant, const std::vector<std::string>& labels,
+                   const std::vector<const char *>& modes, uint64_t branch_instr, const char * log_dir)
+{
+    if (log_dir)
+        mkdir(log_dir, 0755);
+    fflush(stdout);
+    std::cout.flush();
+
+    std::vector<variant_worker_t> workers(labels.size());
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        int result_fds[2];
+        if (pipe(result_fds) != 0)
+        {
+            perror("pipe");
+            return workers.size();
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(result_fds[0]);
+            run_worker(k, run_variant, log_dir, result_fds[1]);
+        }
+        close(result_fds[1]);
+        if (pid < 0)
+        {
+            perror("fork");
+            return workers.size();
+        }
+        workers[k].pid = pid;
+        workers[k].result_fd = result_fds[0];
+    }
+
+    int num_failed = 0;
+    for (variant_worker_t& w : workers)
+    {
+        w.pass = read_all(w.result_fd, &w.result, sizeof(w.result));
+        close(w.result_fd);
+        int status;
+        w.pass = (waitpid(w.pid, &status, 0) == w.pid) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && w.pass;
+        num_failed += !w.pass;
+    }
+
+    printf("BRANCH-OFF MODE: %lu variants from instruction %lu, warmed up once (measurements after the branch-off point)\n",
+           workers.size(), branch_instr);
+    printf("%7s %12s %12s %8s %12s %12s %10s %10s %7s  %s\n", "Variant", "Instr", "Cycles", "IPC", "NumBr", "MispBr", "MPKI", "CycWpPKI",
+           "Warm", "Options");
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        const variant_worker_t& w = workers[k];
+        if (!w.pass)
+        {
+            printf("%7lu %12s %12s %8s %12s %12s %10s %10s %7s  %s\n", k, "Fail", "", "", "", "", "", "", modes[k], labels[k].c_str());
+            continue;
+        }
+        printf("%7lu %12lu %12lu %8.4f %12lu %12lu %10.4f %10.4f %7s  %s\n", k, w.result.instr, w.result.cycles, w.result.ipc(),
+               w.result.br, w.result.br_mispred, w.result.mpki(), w.result.cyc_wp_pki(), modes[k], labels[k].c_str());
+    }
+    return num_failed;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "bp.h"
+
+// Branch-off mode (-g): simulates the trace once up to a branch-off point, then forks one worker per variant, each of
+// which carries on from the warm state of the parent, shared copy-on-write until its pages diverge.
+//
+// run_variant(k) runs in the k-th forked worker, with PREDICTOR_CONFIG = k, for predictor code that selects a variant
+// (an update policy, say) from it. It simulates the rest of the trace and returns the measurements of that rest only.
+// Worker reports go to <log_dir>/variant<k>.log if log_dir is given, and are discarded otherwise. The parent prints the
+// measurements of the variants side by side, labelled labels[k], after the per-variant mode in modes[k].
+// Returns the number of failed variants.
+int run_branch_off(const std::function<conddir_stats_t(uint64_t)>& run_variant, const std::vector<std::string>& labels,
+                   const std::vector<const char *>& modes, uint64_t branch_instr, const char * log_dir);
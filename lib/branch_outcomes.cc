@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "branch_outcomes.h"
+#include "interval.h"
+#include "plugin.h"
+
+branch_outcomes_t branch_outcomes;
+
+namespace {
+
+// File: magic, the number of outcomes, then the words of bits.
+constexpr char MAGIC[8] = {'C', 'B', 'P', 'O', 'U', 'T', 'C', '1'};
+
+}
+
+void branch_outcomes_t::record(const char * file)
+{
+    mode = RECORDING;
+    path = file;
+}
+
+void branch_outcomes_t::replay(const char * file, uint64_t sample_instrs)
+{
+    FILE * f = fopen(file, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open branch outcomes %s\n", file);
+        exit(1);
+    }
+    char magic[sizeof(MAGIC)];
+    uint64_t n;
+    if ((fread(magic, sizeof(magic), 1, f) != 1) || memcmp(magic, MAGIC, sizeof(MAGIC)) || (fread(&n, sizeof(n), 1, f) != 1))
+    {
+        fprintf(stderr, "%s is not a recording of branch outcomes (-z record)\n", file);
+        exit(1);
+    }
+    bits.resize((n + 63) / 64);
+    if (fread(bits.data(), sizeof(uint64_t), bits.size(), f) != bits.size())
+    {
+        fprintf(stderr, "Truncated recording of branch outcomes %s\n", file);
+        exit(1);
+    }
+    fclose(f);
+    mode = REPLAYING;
+    path = file;
+    num_outcomes = n;
+    pos = 0;
+    sample = sample_instrs;
+}
+
+void branch_outcomes_t::exhausted() const
+{
+    fprintf(stderr, "The %" PRIu64 " branch outcomes of %s are exhausted: it is a recording of another trace, or of a shorter run\n", num_outcomes, path);
+    exit(1);
+}
+
+void branch_outcomes_t::finish()
+{
+    if (mode == REPLAYING)
+    {
+        if (pos != num_outcomes)
+            fprintf(stderr, "Warning: %" PRIu64 " of the %" PRIu64 " branch outcomes of %s were replayed: it is a recording of another trace, or of a longer run\n", pos, num_outcomes, path);
+        return;
+    }
+    if (mode != RECORDING)
+        return;
+    FILE * f = fopen(path, "wb");
+    if (!f || (fwrite(MAGIC, sizeof(MAGIC), 1, f) != 1) || (fwrite(&num_outcomes, sizeof(num_outcomes), 1, f) != 1) ||
+        (fwrite(bits.data(), sizeof(uint64_t), bits.size(), f) != bits.size()) || fclose(f))
+    {
+        fprintf(stderr, "Cannot write branch outcomes %s\n", path);
+        exit(1);
+    }
+}
+
+bool branch_outcomes_t::simulate_sample(const char * trace_name, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t), epoch_stats_t& stats) const
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    std::cout.flush();
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        const int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0)
+        {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        branch_outcomes.stop();
+        predictor_hooks = cbp_hooks;
+        epoch_stats_t sample_stats = simulate_fn(trace_name, 0, 0, sample);
+        fflush(stdout);
+        std::cout.flush();
+        _exit(send_epoch_stats(fds[1], sample_stats) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[0]);
+        return false;
+    }
+    const bool received = receive_epoch_stats(fds[0], stats);
+    int status;
+    return (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0) && received;
+}
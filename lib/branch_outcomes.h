@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "sim_common_structs.h"
+#include "bp.h"
+
+// Recorded predictor outcomes (-z record,<file> and -z replay,<file>[,<sample_instrs>]), for sweeps of the timing
+// model that leave the predictor alone.
+//
+// A recording run is an ordinary run that also keeps, for every branch bp_t::predict predicts (conditional, indirect,
+// call indirect and return), whether it was mispredicted, one bit each in trace order, and writes them to the file at
+// the end of the trace. A replaying run takes those bits back in place of the predictions: bp_t::predict calls neither
+// the predictor of cbp.h nor ITTAGE or the RAS, and the predictor is told nothing of fetch, decode, agen, execute or
+// commit.
+//
+// The replay is APPROXIMATE. The bits are those of the recording's configuration, and a predictor whose updates depend
+// on timing (the resolve order and delay of its branches, the cycles of its hooks) predicts differently under another
+// one. So replay is for sweeps of the core and caches around a given predictor, not for predictor studies, and its
+// report says so. With a sample, the first sample_instrs instructions are also simulated with the predictor, in a
+// worker, and the relative error of the replay on them is printed.
+class branch_outcomes_t
+{
+    private:
+        enum mode_t { OFF, RECORDING, REPLAYING };
+
+        mode_t mode = OFF;
+        const char * path = nullptr;
+        std::vector<uint64_t> bits;     // outcome k at bit k % 64 of word k / 64
+        uint64_t num_outcomes = 0;      // recorded so far, or in the file replayed
+        uint64_t pos = 0;               // next outcome replayed
+        uint64_t sample = 0;
+
+        [[noreturn]] void exhausted() const;
+
+    public:
+        // Whether bp_t::predict predicts branches of class c, and so has an outcome of theirs on the recording.
+        static bool predicted(InstClass c)
+        {
+            return (c == InstClass::condBranchInstClass) || (c == InstClass::uncondIndirectBranchInstClass) ||
+                   (c == InstClass::callIndirectInstClass) || (c == InstClass::ReturnInstClass);
+        }
+
+        // Records to file.
+        void record(const char * file);
+        // Loads file to replay; exits if it cannot be read or is not a recording. sample_instrs is 0 for no sample.
+        void replay(const char * file, uint64_t sample_instrs);
+        // Back to predicting, in the worker simulating the sample with the predictor.
+        void stop() { mode = OFF; }
+
+        bool recording() const { return mode == RECORDING; }
+        bool replaying() const { return mode == REPLAYING; }
+        uint64_t sample_instrs() const { return sample; }
+
+        void push(bool misp)
+        {
+            if ((num_outcomes & 63) == 0)
+                bits.push_back(0);
+            bits.back() |= uint64_t(misp) << (num_outcomes & 63);
+            num_outcomes++;
+        }
+        bool next()
+        {
+            if (pos == num_outcomes)
+                exhausted();
+            const bool misp = (bits[pos >> 6] >> (pos & 63)) & 1;
+            pos++;
+            return misp;
+        }
+
+        // Simulates the sample, instructions [0, sample_instrs()) of trace_name, with the predictor, in a forked worker
+        // whose report is discarded: simulate_fn(trace, warmup_begin, begin, end) as for interval simulation (interval.h).
+        // False if the worker failed.
+        bool simulate_sample(const char * trace_name, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t), epoch_stats_t& stats) const;
+
+        // End of the trace: writes the recording (exits if it cannot), or warns if the replay left outcomes unused,
+        // the recording being of another trace or a longer run.
+        void finish();
+};
+
+// Process-wide, like the predictor hooks of cbp.h: set up by parseargs, fed and read by bp_t::predict.
+extern branch_outcomes_t branch_outcomes;
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "snapshot.h"
+
+// Which component of the predictor gave a conditional branch its prediction.
+enum branch_provider_t : uint8_t
+{
+    PROVIDER_BIMODAL = 0,   // no tagged hit, or the alternate prediction came from the bimodal table
+    PROVIDER_TAGE,          // longest matching tagged bank (HitBank)
+    PROVIDER_ALT,           // alternate tagged bank, used instead of a newly allocated HitBank entry
+    PROVIDER_LOOP,          // loop predictor
+    PROVIDER_SC,            // statistical corrector, overriding the TAGE (or loop) prediction
+    PROVIDER_FILTER,        // bias filter in front of TAGE-SC-L (BIAS_FILTER)
+    NUM_PROVIDERS
+};
+
+// Per-static-branch misprediction profile: executions and mispredictions of each conditional branch PC, split by the
+// component that provided the prediction, and the sum of its longest matching TAGE banks.
+//
+// Open addressing with linear probing in a power-of-two table of one-cache-line entries, kept at most half full by
+// doubling, so that it ends up sized to the static branch count of the trace and a lookup is about one line fill.
+// PC 0 marks a free slot. Meant to be always on: recording does no allocation outside of the (rare) growth.
+class branch_profile_t
+{
+    public:
+        struct entry_t
+        {
+            uint64_t pc = 0;
+            uint32_t execs = 0;
+            uint32_t mispreds = 0;
+            uint32_t provided[NUM_PROVIDERS] = {};
+            uint32_t mispredicted[NUM_PROVIDERS] = {};
+            uint64_t hit_bank_sum = 0;
+        };
+
+    private:
+        static constexpr uint64_t INITIAL_CAPACITY = 4096;
+        static constexpr const char * PROVIDER_NAMES[NUM_PROVIDERS] = {"Bimodal", "Tage", "Alt", "Loop", "SC", "Filter"};
+
+        std::vector<entry_t> table;
+        uint64_t mask = 0;
+        uint64_t num_used = 0;
+
+        static uint64_t hash(uint64_t pc)
+        {
+            return (pc ^ (pc >> 17)) * 0x9E3779B97F4A7C15ull;
+        }
+
+        entry_t& find(uint64_t pc)
+        {
+            uint64_t i = (hash(pc) >> 20) & mask;
+            while ((table[i].pc != pc) && (table[i].pc != 0))
+                i = (i + 1) & mask;
+            return table[i];
+        }
+
+        void grow()
+        {
+            std::vector<entry_t> old;
+            old.swap(table);
+            table.resize(old.empty() ? INITIAL_CAPACITY : 2 * old.size());
+            mask = table.size() - 1;
+            for (const entry_t& e : old)
+                if (e.pc != 0)
+                    find(e.pc) = e;
+        }
+
+    public:
+        void record(uint64_t pc, branch_provider_t provider, uint8_t hit_bank, bool mispredicted)
+        {
+            if (2 * (num_used + 1) > table.size())
+                grow();
+            entry_t& e = find(pc);
+            if (e.pc == 0)
+            {
+                e.pc = pc;
+                num_used++;
+            }
+            e.execs++;
+            e.mispreds += mispredicted;
+            e.provided[provider]++;
+            e.mispredicted[provider] += mispredicted;
+            e.hit_bank_sum += hit_bank;
+        }
+
+        uint64_t num_branches() const
+        {
+            return num_used;
+        }
+
+        // The top_n entries with the most mispredictions, most first (all of them for top_n 0).
+        std::vector<entry_t> top(uint64_t top_n) const
+        {
+            std::vector<entry_t> entries;
+            entries.reserve(num_used);
+            for (const entry_t& e : table)
+                if (e.pc != 0)
+                    entries.push_back(e);
+            const uint64_t n = (top_n == 0) ? entries.size() : std::min<uint64_t>(top_n, entries.size());
+            std::partial_sort(entries.begin(), entries.begin() + n, entries.end(), [](const entry_t& a, const entry_t& b) {
+                return (a.mispreds != b.mispreds) ? (a.mispreds > b.mispreds) : (a.pc < b.pc);
+            });
+            entries.resize(n);
+            return entries;
+        }
+
+        // Writes the top_n branches to a CSV file. Returns false if it cannot be written.
+        bool write_csv(const char * path, uint64_t top_n) const
+        {
+            FILE * f = fopen(path, "w");
+            if (!f)
+                return false;
+            uint64_t total_mispreds = 0;
+            for (const entry_t& e : table)
+                total_mispreds += e.mispreds;
+
+            fprintf(f, "PC,Execs,Mispreds,MR,MispShare,MeanHitBank");
+            for (const char * name : PROVIDER_NAMES)
+                fprintf(f, ",%s,%sMispreds", name, name);
+            fprintf(f, "\n");
+            for (const entry_t& e : top(top_n))
+            {
+                fprintf(f, "0x%lx,%u,%u,%.4f%%,%.4f%%,%.2f", e.pc, e.execs, e.mispreds, 100.0*e.mispreds/e.execs,
+                        total_mispreds ? 100.0*e.mispreds/total_mispreds : 0.0, (double)e.hit_bank_sum/e.execs);
+                for (int p = 0; p < NUM_PROVIDERS; p++)
+                    fprintf(f, ",%u,%u", e.provided[p], e.mispredicted[p]);
+                fprintf(f, "\n");
+            }
+            return fclose(f) == 0;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.io(table);
+            s.io(mask);
+            s.io(num_used);
+        }
+};
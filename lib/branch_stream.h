@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "branch_trace.h"
+#include "trace_reader.h"
+
+// Compressed in-memory branch stream, for tools that replay the branches of a trace many times over (the
+// design-space exploration of tools/explore.cc keeps one per trace, for every geometry it evaluates).
+//
+// A plain array of branch records (branch_trace.h) is 40 bytes per branch, so the streams of a few long traces
+// already outgrow the host's caches and every replay is bound by memory bandwidth. The stream is instead encoded as
+// in the branch trace format, but cut into blocks of BLOCK branches whose fields are laid out one after the other:
+//
+// Block : BLOCK header bytes (class | taken << 7)
+//         BLOCK varint uop deltas
+//         BLOCK varint instr deltas
+//         zigzag varints of next_pc - pc, of the taken branches only
+//         BLOCK zigzag varints of pc - prev next_pc
+//
+// Most records shrink to 4 or 5 bytes. decode_block() decodes a block a field at a time, each in a short loop whose
+// varints are mostly single bytes, into a block_t the replay loop reads back; the block index keeps where each block
+// starts, along with the instructions and the next_pc before it, so any block decodes on its own and prefixes are
+// found by binary search.
+class branch_stream_t
+{
+    public:
+        static constexpr uint64_t BLOCK = 256;
+
+        // A decoded block, field by field.
+        struct block_t
+        {
+            uint64_t count;
+            uint8_t head[BLOCK];
+            uint64_t uop_delta[BLOCK];
+            uint64_t instr_delta[BLOCK];
+            uint64_t pc[BLOCK];
+            uint64_t next_pc[BLOCK];
+
+            InstClass insn_class(uint64_t i) const
+            {
+                return static_cast<InstClass>(head[i] & 0x7F);
+            }
+
+            bool is_taken(uint64_t i) const
+            {
+                return head[i] >> 7;
+            }
+        };
+
+    private:
+        struct index_t
+        {
+            uint64_t offset;        // of the block in mData
+            uint64_t instrs;        // instructions up to and including the last branch before the block
+            uint64_t prev_next_pc;  // next_pc of the last branch before the block
+        };
+
+        std::vector<uint8_t> mData;
+        std::vector<index_t> mIndex;
+        std::vector<branch_record_t> mPending;  // branches of the block being filled
+        uint64_t mNumBranches = 0;
+        uint64_t mNumInstrs = 0;
+        uint64_t mPrevNextPc = 0;
+
+        void put_varint(uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                mData.push_back((v & 0x7F) | 0x80);
+                v >>= 7;
+            }
+            mData.push_back(v);
+        }
+
+        void put_svarint(int64_t v)
+        {
+            put_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+        }
+
+        static uint64_t get_varint(const uint8_t *& p)
+        {
+            uint64_t v = *p++;
+            if (v < 0x80)
+                return v;
+            v &= 0x7F;
+            for (int shift = 7;; shift += 7)
+            {
+                const uint8_t b = *p++;
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                    return v;
+            }
+        }
+
+        static int64_t get_svarint(const uint8_t *& p)
+        {
+            const uint64_t v = get_varint(p);
+            return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        }
+
+        void flush()
+        {
+            if (mPending.empty())
+                return;
+            const index_t& start = mIndex.back();
+            for (const branch_record_t& rec : mPending)
+                mData.push_back(static_cast<uint8_t>(rec.insn_class) | (rec.is_taken << 7));
+            for (const branch_record_t& rec : mPending)
+                put_varint(rec.uop_delta);
+            for (const branch_record_t& rec : mPending)
+                put_varint(rec.instr_delta);
+            for (const branch_record_t& rec : mPending)
+                if (rec.is_taken)
+                    put_svarint((int64_t)(rec.next_pc - rec.pc));
+                else
+                    assert(rec.next_pc == rec.pc + 4);
+            uint64_t prev_next_pc = start.prev_next_pc;
+            for (const branch_record_t& rec : mPending)
+            {
+                put_svarint((int64_t)(rec.pc - prev_next_pc));
+                prev_next_pc = rec.next_pc;
+            }
+            mPending.clear();
+        }
+
+    public:
+        // Appends the next branch of the trace.
+        void append(const branch_record_t& rec)
+        {
+            if (mPending.empty())
+                mIndex.push_back({mData.size(), mNumInstrs, mPrevNextPc});
+            mPending.push_back(rec);
+            mNumBranches++;
+            mNumInstrs += rec.instr_delta + 1;
+            mPrevNextPc = rec.next_pc;
+            if (mPending.size() == BLOCK)
+                flush();
+        }
+
+        // Encodes the last, partial block: to be called once the last branch is appended.
+        void finish()
+        {
+            flush();
+            mData.shrink_to_fit();
+            mIndex.shrink_to_fit();
+        }
+
+        uint64_t num_branches() const
+        {
+            return mNumBranches;
+        }
+
+        // Instructions up to and including the last branch.
+        uint64_t num_instrs() const
+        {
+            return mNumInstrs;
+        }
+
+        uint64_t num_blocks() const
+        {
+            return mIndex.size();
+        }
+
+        // Memory held by the encoded stream.
+        uint64_t bytes() const
+        {
+            return mData.size() + mIndex.size() * sizeof(index_t);
+        }
+
+        void decode_block(uint64_t b, block_t& out) const
+        {
+            assert(mPending.empty() && (b < mIndex.size()));
+            const index_t& start = mIndex[b];
+            const uint64_t n = out.count = std::min(BLOCK, mNumBranches - b * BLOCK);
+            const uint8_t * p = mData.data() + start.offset;
+            std::copy(p, p + n, out.head);
+            p += n;
+            for (uint64_t i = 0; i < n; i++)
+                out.uop_delta[i] = get_varint(p);
+            for (uint64_t i = 0; i < n; i++)
+                out.instr_delta[i] = get_varint(p);
+            // the targets come first, so that each PC follows from the next_pc before it in a single pass
+            for (uint64_t i = 0; i < n; i++)
+                out.next_pc[i] = (out.head[i] >> 7) ? get_svarint(p) : 4;
+            uint64_t prev_next_pc = start.prev_next_pc;
+            for (uint64_t i = 0; i < n; i++)
+            {
+                out.pc[i] = prev_next_pc + get_svarint(p);
+                prev_next_pc = out.next_pc[i] += out.pc[i];
+            }
+        }
+
+        // Branches in the first num_instrs instructions.
+        uint64_t prefix(uint64_t num_instrs) const
+        {
+            if (num_instrs >= mNumInstrs)
+                return mNumBranches;
+            // the last block starting at or before num_instrs, then its branches within
+            const auto it = std::upper_bound(mIndex.begin(), mIndex.end(), num_instrs,
+                                             [](uint64_t n, const index_t& e) { return n < e.instrs; });
+            const uint64_t b = it - mIndex.begin() - 1;
+            block_t block;
+            decode_block(b, block);
+            uint64_t instrs = mIndex[b].instrs, i = 0;
+            while ((i < block.count) && ((instrs += block.instr_delta[i] + 1) <= num_instrs))
+                i++;
+            return b * BLOCK + i;
+        }
+
+        // Instructions up to and including the last of the first num_branches branches.
+        uint64_t instrs_before(uint64_t num_branches) const
+        {
+            if (num_branches == 0)
+                return 0;
+            if (num_branches >= mNumBranches)
+                return mNumInstrs;
+            const uint64_t b = (num_branches - 1) / BLOCK;
+            block_t block;
+            decode_block(b, block);
+            uint64_t instrs = mIndex[b].instrs;
+            for (uint64_t i = b * BLOCK; i < num_branches; i++)
+                instrs += block.instr_delta[i - b * BLOCK] + 1;
+            return instrs;
+        }
+};
+
+// The branch stream of the first max_instrs instructions of a trace: an instruction trace (.gz or native) or a branch
+// trace (convert_trace -b).
+inline branch_stream_t load_branch_stream(const char * trace_name, uint64_t max_instrs)
+{
+    branch_stream_t s;
+    uint64_t num_instrs = 0;
+    auto push = [&](const branch_record_t& rec) {
+        num_instrs += rec.instr_delta + 1;
+        if (num_instrs > max_instrs)
+            return false;
+        s.append(rec);
+        return true;
+    };
+    branch_record_t rec;
+    if (branch_trace_reader_t::is_branch_trace(trace_name))
+    {
+        branch_trace_reader_t reader(trace_name);
+        while (reader.next(rec) && push(rec))
+            ;
+    }
+    else
+    {
+        TraceReader reader(trace_name);
+        branch_extractor_t extractor;
+        db_t inst;
+        while (reader.next(inst))
+            if (extractor.push(inst.insn_class, inst.pc, inst.next_pc, inst.is_taken, inst.is_last_piece, rec) && !push(rec))
+                break;
+    }
+    s.finish();
+    return s;
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+#include <zlib.h>
+#include "sim_common_structs.h"
+#include "gz_block_reader.h"
+
+// Compact branch-only trace format, replayed by the branch-only mode (bp_only_sim_t).
+//
+// Only branches are kept, along with how many micro-ops and instructions were skipped since the previous one, so that
+// sequence numbers, instruction counts and epochs come out as with the full trace. Records are varint encoded, with
+// PCs as deltas from the previous branch's next_pc, and the stream is gzipped.
+//
+// Layout : magic (8 bytes)
+//          records : class | taken << 7 (1 byte), uop delta, instr delta, zigzag(pc - prev next_pc), [zigzag(next_pc - pc) if taken]
+//          end     : BRANCH_TRACE_END (1 byte), trailing uop delta, trailing instr delta
+
+static constexpr char BRANCH_TRACE_MAGIC[8] = {'C', 'B', 'P', 'B', 'R', 'T', 'R', '\0'};
+static constexpr uint8_t BRANCH_TRACE_END = 0x7F;
+
+struct branch_record_t
+{
+    uint64_t uop_delta;     // non-branch micro-ops since the previous branch
+    uint64_t instr_delta;   // non-branch instructions since the previous branch
+    InstClass insn_class;
+    bool is_taken;
+    uint64_t pc;
+    uint64_t next_pc;
+};
+
+// Folds the micro-ops of a full trace into branch records, in trace order.
+class branch_extractor_t
+{
+    private:
+        uint64_t mUopDelta;
+        uint64_t mInstrDelta;
+
+    public:
+        branch_extractor_t()
+        : mUopDelta(0), mInstrDelta(0)
+        {
+        }
+
+        // Non-branch micro-ops and instructions since the last branch.
+        uint64_t pending_uops() const
+        {
+            return mUopDelta;
+        }
+
+        uint64_t pending_instrs() const
+        {
+            return mInstrDelta;
+        }
+
+        // Returns true, with rec filled in, if this micro-op is a branch.
+        bool push(InstClass insn_class, uint64_t pc, uint64_t next_pc, bool is_taken, bool is_last_piece, branch_record_t& rec)
+        {
+            if (!is_br(insn_class))
+            {
+                mUopDelta++;
+                mInstrDelta += is_last_piece;
+                return false;
+            }
+
+            // Branches are never cracked.
+            assert(is_last_piece);
+            rec.uop_delta = mUopDelta;
+            rec.instr_delta = mInstrDelta;
+            rec.insn_class = insn_class;
+            rec.is_taken = is_taken;
+            rec.pc = pc;
+            rec.next_pc = next_pc;
+            mUopDelta = 0;
+            mInstrDelta = 0;
+            return true;
+        }
+};
+
+class branch_trace_writer_t
+{
+    private:
+        gzFile mFile;
+        branch_extractor_t mExtractor;
+        uint64_t mPrevNextPc;
+        uint64_t mNumBranches;
+
+        void put_byte(uint8_t b)
+        {
+            gzputc(mFile, b);
+        }
+
+        void put_varint(uint64_t v)
+        {
+            uint8_t buf[10];
+            int n = 0;
+            while (v >= 0x80)
+            {
+                buf[n++] = (v & 0x7F) | 0x80;
+                v >>= 7;
+            }
+            buf[n++] = v;
+            gzwrite(mFile, buf, n);
+        }
+
+        void put_svarint(int64_t v)
+        {
+            put_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+        }
+
+    public:
+        branch_trace_writer_t(const char * path)
+        : mPrevNextPc(0), mNumBranches(0)
+        {
+            mFile = gzopen(path, "wb9");
+            if (mFile)
+                gzwrite(mFile, BRANCH_TRACE_MAGIC, sizeof(BRANCH_TRACE_MAGIC));
+        }
+
+        ~branch_trace_writer_t()
+        {
+            close();
+        }
+
+        bool good() const
+        {
+            return mFile != nullptr;
+        }
+
+        uint64_t num_branches() const
+        {
+            return mNumBranches;
+        }
+
+        // Records one micro-op of the full trace (only branches are written out).
+        void append(InstClass insn_class, uint64_t pc, uint64_t next_pc, bool is_taken, bool is_last_piece)
+        {
+            branch_record_t rec;
+            if (!mExtractor.push(insn_class, pc, next_pc, is_taken, is_last_piece, rec))
+                return;
+
+            put_byte(static_cast<uint8_t>(rec.insn_class) | (rec.is_taken << 7));
+            put_varint(rec.uop_delta);
+            put_varint(rec.instr_delta);
+            put_svarint((int64_t)(rec.pc - mPrevNextPc));
+            if (rec.is_taken)
+                put_svarint((int64_t)(rec.next_pc - rec.pc));
+            else
+                assert(rec.next_pc == rec.pc + 4);
+
+            mPrevNextPc = rec.next_pc;
+            mNumBranches++;
+        }
+
+        void close()
+        {
+            if (!mFile)
+                return;
+            put_byte(BRANCH_TRACE_END);
+            put_varint(mExtractor.pending_uops());
+            put_varint(mExtractor.pending_instrs());
+            gzclose(mFile);
+            mFile = nullptr;
+        }
+};
+
+class branch_trace_reader_t
+{
+    private:
+        gz_block_reader_t mInput;
+        uint64_t mPrevNextPc;
+        bool mDone;
+
+        uint8_t get_byte()
+        {
+            uint8_t b = BRANCH_TRACE_END;
+            mInput.read((char *)&b, 1);
+            return b;
+        }
+
+        uint64_t get_varint()
+        {
+            uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                const uint8_t b = get_byte();
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80) || mInput.eof())
+                    break;
+            }
+            return v;
+        }
+
+        int64_t get_svarint()
+        {
+            const uint64_t v = get_varint();
+            return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        }
+
+    public:
+        // Micro-ops and instructions after the last branch, valid once next() returned false.
+        uint64_t trailing_uops;
+        uint64_t trailing_instrs;
+
+        // Returns true if the file at path is a (gzipped) branch trace.
+        static bool is_branch_trace(const char * path)
+        {
+            char magic[sizeof(BRANCH_TRACE_MAGIC)];
+            gz_block_reader_t input(path);
+            return input.read(magic, sizeof(magic)) && !memcmp(magic, BRANCH_TRACE_MAGIC, sizeof(magic));
+        }
+
+        branch_trace_reader_t(const char * path)
+        : mInput(path), mPrevNextPc(0), mDone(false), trailing_uops(0), trailing_instrs(0)
+        {
+            char magic[sizeof(BRANCH_TRACE_MAGIC)];
+            mDone = !mInput.read(magic, sizeof(magic)) || memcmp(magic, BRANCH_TRACE_MAGIC, sizeof(magic));
+        }
+
+        bool next(branch_record_t& rec)
+        {
+            if (mDone)
+                return false;
+
+            const uint8_t head = get_byte();
+            if (head == BRANCH_TRACE_END || mInput.eof())
+            {
+                trailing_uops = get_varint();
+                trailing_instrs = get_varint();
+                mDone = true;
+                return false;
+            }
+
+            rec.insn_class = static_cast<InstClass>(head & 0x7F);
+            rec.is_taken = head >> 7;
+            rec.uop_delta = get_varint();
+            rec.instr_delta = get_varint();
+            rec.pc = mPrevNextPc + get_svarint();
+            rec.next_pc = rec.is_taken ? rec.pc + get_svarint() : rec.pc + 4;
+            mPrevNextPc = rec.next_pc;
+            return true;
+        }
+};
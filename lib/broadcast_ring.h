@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Broadcast ring of batches from one producer to consumers that each go at their own pace: the fan-out modes (-N, -u)
+// decode the trace once into it, and their forked workers read the batches in place, without a copy per worker.
+//
+// The ring lives in memory shared by the processes (create()), with lock-free atomic counters. Batch b goes to slot
+// b % SLOTS. When the producer publishes a batch, the slot's reference count is set to the number of attached
+// consumers. Each consumer drops its reference once done with the batch (release()), which also moves its cursor to
+// the next batch. The items of a published batch are immutable until all the references are dropped. The producer
+// only waits when the slowest consumer is max_lag batches behind (at most SLOTS, the default): it then waits for it to
+// release the batch max_lag back, and with it the slot it is about to fill. A consumer that dies is detached by the
+// producer (detach()), which drops the references the consumer still held.
+//
+// A batch holds up to BATCH items and is flagged last or not: the last one ends the stream.
+template <class T, uint64_t BATCH, uint64_t SLOTS, uint64_t MAX_CONSUMERS>
+class broadcast_ring_t
+{
+    private:
+        struct alignas(64) counter_t
+        {
+            std::atomic<uint64_t> value{0};
+        };
+
+        struct alignas(64) slot_t
+        {
+            // signed: a consumer that dies between dropping its reference and moving its cursor has it dropped twice
+            std::atomic<int64_t> refs{0};
+            uint64_t count = 0;
+            bool last = false;
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+                      "the ring counters are shared between processes");
+
+        counter_t produced;                     // batches published, only advanced by the producer
+        counter_t cursor[MAX_CONSUMERS];        // batches released by each consumer, only advanced by it
+        slot_t slots[SLOTS];
+        // the producer's own
+        uint64_t max_lag;
+        uint64_t num_attached;
+        bool attached[MAX_CONSUMERS] = {};
+        T items[SLOTS][BATCH];
+
+        broadcast_ring_t(uint64_t num_consumers, uint64_t _max_lag)
+        : max_lag((_max_lag && _max_lag < SLOTS) ? _max_lag : SLOTS), num_attached(num_consumers)
+        {
+            for (uint64_t k = 0; k < num_consumers; k++)
+                attached[k] = true;
+        }
+
+    public:
+        // One step of a wait on the other processes: a spin at first, then a yield, then a nap, so that the waits cost
+        // little when there are more processes than cores.
+        static void backoff(unsigned& spins)
+        {
+            spins++;
+            if (spins < 256)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            else if (spins < 4096)
+                std::this_thread::yield();
+            else
+                usleep(50);
+        }
+
+        // A ring for consumers 0 to num_consumers - 1 (at most MAX_CONSUMERS), in memory that the processes forked
+        // after it share. nullptr if it cannot be mapped.
+        static broadcast_ring_t * create(uint64_t num_consumers, uint64_t max_lag = SLOTS)
+        {
+            if (num_consumers > MAX_CONSUMERS)
+                return nullptr;
+            void * mapping = mmap(nullptr, sizeof(broadcast_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED)
+                return nullptr;
+            return new (mapping) broadcast_ring_t(num_consumers, max_lag);
+        }
+
+        static void destroy(broadcast_ring_t * ring)
+        {
+            ring->~broadcast_ring_t();
+            munmap(ring, sizeof(broadcast_ring_t));
+        }
+
+        // Producer: the items of the next batch to fill, once the consumers let it. poll() is called while waiting,
+        // e.g. to detach the consumers that died.
+        template <class F>
+        T * next_batch(F&& poll)
+        {
+            const uint64_t b = produced.value.load(std::memory_order_relaxed);
+            if (b >= max_lag)
+            {
+                const slot_t& oldest = slots[(b - max_lag) % SLOTS];
+                unsigned spins = 0;
+                while (oldest.refs.load(std::memory_order_acquire) > 0)
+                {
+                    poll();
+                    backoff(spins);
+                }
+            }
+            return items[b % SLOTS];
+        }
+
+        // Producer: publishes the next batch, its first count items filled.
+        void publish(uint64_t count, bool last)
+        {
+            const uint64_t b = produced.value.load(std::memory_order_relaxed);
+            slot_t& slot = slots[b % SLOTS];
+            slot.count = count;
+            slot.last = last;
+            slot.refs.store(num_attached, std::memory_order_relaxed);
+            produced.value.store(b + 1, std::memory_order_release);
+        }
+
+        // Producer: stops counting on consumer k, which died, and drops the references it held.
+        void detach(uint64_t k)
+        {
+            if (!attached[k])
+                return;
+            attached[k] = false;
+            num_attached--;
+            const uint64_t end = produced.value.load(std::memory_order_relaxed);
+            for (uint64_t b = cursor[k].value.load(std::memory_order_acquire); b < end; b++)
+                slots[b % SLOTS].refs.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        // Consumer k: waits for its next batch, and returns its items, count of them, last if it ends the stream.
+        const T * acquire(uint64_t k, uint64_t& count, bool& last) const
+        {
+            const uint64_t b = cursor[k].value.load(std::memory_order_relaxed);
+            unsigned spins = 0;
+            while (produced.value.load(std::memory_order_acquire) == b)
+                backoff(spins);
+            const slot_t& slot = slots[b % SLOTS];
+            count = slot.count;
+            last = slot.last;
+            return items[b % SLOTS];
+        }
+
+        // Consumer k: done with the batch it acquired.
+        void release(uint64_t k)
+        {
+            const uint64_t b = cursor[k].value.load(std::memory_order_relaxed);
+            slots[b % SLOTS].refs.fetch_sub(1, std::memory_order_acq_rel);
+            cursor[k].value.store(b + 1, std::memory_order_release);
+        }
+};
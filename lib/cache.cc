@@ -22,122 +22,324 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
 
+#include <algorithm>
 #include <math.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
-#include "parameters.h"
 #include "cache.h"
+#include "simd_dispatch.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "phase_timer.h"
+#include "invariant.h"
+#include "usdt.h"
 
 
-cache_t::cache_t(uint64_t size, uint64_t assoc, uint64_t blocksize, uint64_t latency, cache_t *next_level) {
+cache_t::cache_t(uint64_t size, uint64_t assoc, uint64_t blocksize, uint64_t latency, cache_t *next_level, uint64_t main_memory_latency, bool tree_plru,
+                 uint64_t set_sampling) {
    uint64_t num_sets;
 
-   assert(IsPow2(blocksize));
+   CBP_CHECK(IsPow2(blocksize));
+   CBP_CHECK(blocksize > 1);
    this->num_offset_bits = log2(blocksize);
 
    num_sets = size/(assoc*blocksize);
-   assert(IsPow2(num_sets));
+   CBP_CHECK(IsPow2(num_sets));
    this->num_index_bits = log2(num_sets);
    this->index_mask = (num_sets - 1);
 
+   // only the sets numbered below num_sets / set_sampling are stored
+   CBP_CHECK(IsPow2(set_sampling) && (set_sampling <= num_sets));
+   this->set_sampling = set_sampling;
+   num_sampled_sets = num_sets / set_sampling;
+   index_mult = ((set_sampling > 1) ? 0x9E3779B97F4A7C15lu : 1);
+
+   // way masks are 64 bits, LRU ranks are bytes
+   CBP_CHECK(assoc > 0 && assoc <= 64);
    this->assoc = assoc;
 
-   C = new block_t *[num_sets];
-   for (uint64_t i = 0; i < num_sets; i++) {
-      C[i] = new block_t[assoc];
-      for (uint64_t j = 0; j < assoc; j++) {
-         C[i][j].valid = false;
-     C[i][j].lru = j;
-      }
+   this->tree_plru = tree_plru;
+   num_levels = 0;
+   if (tree_plru) {
+      CBP_CHECK(IsPow2(assoc));
+      num_levels = log2(assoc);
+      plru.resize(num_sampled_sets);
    }
+   else
+      lru.resize(num_sampled_sets * assoc);
+   // the arena's memory is zero, which is the initial state of every array: resize() leaves it untouched
+   tags.resize(num_sampled_sets * assoc + ((set_sampling > 1) ? RECENT_BLOCKS : 0));
+   timestamps.resize(tags.size());
+   last_block = NO_BLOCK;
+   last_slot = 0;
 
    this->latency = latency;
    this->next_level = next_level;
+   this->main_memory_latency = main_memory_latency;
+
+   accesses = 0;
+   pf_accesses = 0;
+   misses = 0;
+   pf_misses = 0;
+   sampled_accesses[0] = sampled_accesses[1] = 0;
+   sampled_misses[0] = sampled_misses[1] = 0;
+   unsampled_accesses = 0;
+}
+
+void cache_t::reset() {
+   std::fill(tags.begin(), tags.end(), INVALID_TAG);
+   std::fill(timestamps.begin(), timestamps.end(), 0);
+   std::fill(lru.begin(), lru.end(), 0);
+   std::fill(plru.begin(), plru.end(), 0);
+   std::fill(pf_sources.begin(), pf_sources.end(), 0);
+   std::fill(pf_usage.begin(), pf_usage.end(), prefetch_usage_t());
+   last_block = NO_BLOCK;
+   last_slot = 0;
 
    accesses = 0;
+   pf_accesses = 0;
    misses = 0;
+   pf_misses = 0;
+   sampled_accesses[0] = sampled_accesses[1] = 0;
+   sampled_misses[0] = sampled_misses[1] = 0;
+   unsampled_accesses = 0;
+}
+
+// Returns the way holding tag in set index, or assoc on a miss.
+// All the ways are compared, without an early exit, so that the compiler can vectorize the loop.
+CBP_SIMD_KERNEL uint64_t cache_t::find_way(uint64_t index, uint64_t tag) const {
+   const uint64_t *set_tags = &tags[index * assoc];
+   uint64_t hits = 0;
+   for (uint64_t way = 0; way < assoc; way++)
+      hits |= (uint64_t)(set_tags[way] == tag) << way;
+   return (hits ? __builtin_ctzl(hits) : assoc);
+}
+
+uint64_t cache_t::find_victim(uint64_t index) const {
+   if (tree_plru) {
+      // an invalid block first, else follow the tree bits to the pseudo-LRU block
+      const uint64_t way = find_way(index, INVALID_TAG);
+      if (way < assoc)
+         return way;
+      const uint64_t bits = plru[index];
+      uint64_t node = 1;
+      for (uint64_t level = 0; level < num_levels; level++)
+         node = 2 * node + ((bits >> node) & 1);
+      return (node - assoc);
+   }
+
+   // the LRU block, ranked last
+   const uint8_t *set_lru = &lru[index * assoc];
+   uint64_t victims = 0;
+   for (uint64_t way = 0; way < assoc; way++)
+      victims |= (uint64_t)((set_lru[way] ^ way) == (assoc - 1)) << way;
+   assert(victims);
+   return __builtin_ctzl(victims);
+}
+
+// A miss with the miss ratio of the sampled sets, all misses before their first access. The draw hashes the block with
+// the number of accesses to the other sets, so that it only changes with an access.
+bool cache_t::unsampled_hit(uint64_t addr, bool pf) const {
+   if (sampled_accesses[pf] == 0)
+      return false;
+   uint64_t x = (addr >> num_offset_bits) ^ (unsampled_accesses * 0x9E3779B97F4A7C15lu);
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9lu;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111eblu;
+   x ^= (x >> 31);
+   return ((double)(x >> 11) * 0x1p-53 * (double)sampled_accesses[pf] >= (double)sampled_misses[pf]);
 }
 
-cache_t::~cache_t() {
+uint64_t cache_t::unsampled_find(uint64_t cycle, uint64_t addr, bool pf) const {
+   const uint64_t slot = recent_slot(addr);
+   if ((tags[slot] == (addr >> num_offset_bits) + 1) && (timestamps[slot] > cycle + latency))
+      return slot;
+   return (unsampled_hit(addr, pf) ? UNSAMPLED_HIT : NO_SLOT);
 }
 
 bool cache_t::is_hit(uint64_t cycle, uint64_t addr) const {
    uint64_t tag = TAG(addr);
-   uint64_t index = INDEX(addr);
+   uint64_t index = set_of(addr);
+   if (index >= num_sampled_sets) {
+      const uint64_t slot = unsampled_find(cycle, addr, false);
+      return ((slot != NO_SLOT) && (cycle + latency >= arrival(slot)));
+   }
 
-   for (uint64_t way = 0; way < assoc; way++) {
-      if (C[index][way].valid && (C[index][way].tag == tag)) {
-         auto avail = ((C[index][way].timestamp > (cycle + latency)) ? C[index][way].timestamp : (cycle + latency));
-         return (cycle + latency >= avail);
-      }
+   const uint64_t way = find_way(index, tag);
+   if (way < assoc) {
+      const uint64_t timestamp = timestamps[index * assoc + way];
+      auto avail = ((timestamp > (cycle + latency)) ? timestamp : (cycle + latency));
+      return (cycle + latency >= avail);
    }
 
    return false;
 }
 
-uint64_t cache_t::access(uint64_t cycle, bool read, uint64_t addr, bool pf) {
+uint64_t cache_t::find(uint64_t cycle, uint64_t addr) const {
+   if ((addr >> num_offset_bits) == last_block)
+      return last_slot;
+   const uint64_t index = set_of(addr);
+   if (index >= num_sampled_sets)
+      return unsampled_find(cycle, addr, false);
+   const uint64_t way = find_way(index, TAG(addr));
+   return ((way < assoc) ? (index * assoc + way) : NO_SLOT);
+}
+
+void cache_t::track_prefetches(uint64_t num_sources) {
+   CBP_CHECK(num_sources < UINT16_MAX);
+   pf_sources.resize(tags.size());
+   pf_usage.assign(num_sources, prefetch_usage_t());
+}
+
+// A demand access hit the block of slot, still marked as prefetched: the prefetch was useful, and late if the block
+// is not there yet.
+void cache_t::demand_hit_prefetched(uint64_t slot, uint64_t cycle) {
+   prefetch_usage_t& usage = pf_usage[pf_sources[slot] - 1];
+   usage.useful++;
+   usage.late += (timestamps[slot] > cycle + latency);
+   pf_sources[slot] = 0;
+}
+
+uint64_t cache_t::access(uint64_t cycle, bool read, uint64_t addr, bool pf, uint64_t pf_source, const uint64_t *slots) {
+   PHASE_SCOPE(PHASE_CACHE);
    uint64_t avail;      // return value: cycle that requested block is available
    uint64_t tag = TAG(addr);
-   uint64_t index = INDEX(addr);
-   bool hit = false;
-   uint64_t way;        // if hit, this is the corresponding way
-   uint64_t max_lru_ctr = 0;    // for finding lru block
-   uint64_t victim_way;     // if miss, this is the lru/victim way
+   uint64_t index = set_of(addr);
 
    accesses+=!pf;
    pf_accesses += pf;
 
-   for (way = 0; way < assoc; way++)
-   {
-      if (C[index][way].valid && (C[index][way].tag == tag))
-      {
-         hit = true;
-         break;
-      }
-      else if (C[index][way].lru >= max_lru_ctr)
-      {
-         max_lru_ctr = C[index][way].lru;
-         victim_way = way;
+   if (index >= num_sampled_sets) {
+      // a set that is not sampled: a recent block or the outcome of the draw, a missing block only filled in the table
+      const uint64_t slot = (slots ? slots[0] : unsampled_find(cycle, addr, pf));
+      CBP_CHECK_EXPENSIVE(slot == unsampled_find(cycle, addr, pf));
+      unsampled_accesses++;
+      if (slot != NO_SLOT) {
+         const uint64_t timestamp = arrival(slot);
+         return ((timestamp > (cycle + latency)) ? timestamp : (cycle + latency));
       }
+      misses += !pf;
+      pf_misses += pf;
+      CBP_PROBE5(cache_miss, this, latency, addr, cycle, pf);
+      avail = (next_level ? next_level->access((cycle + latency), read, addr, pf, 0, slots ? (slots + 1) : nullptr) : (cycle + latency + main_memory_latency));
+      const uint64_t recent = recent_slot(addr);
+      tags[recent] = (addr >> num_offset_bits) + 1;
+      timestamps[recent] = avail;
+      return avail;
    }
+   sampled_accesses[pf]++;
+
+   if ((addr >> num_offset_bits) == last_block) {
+      if (!pf && !pf_sources.empty() && pf_sources[last_slot])
+         demand_hit_prefetched(last_slot, cycle);
+      const uint64_t timestamp = timestamps[last_slot];
+      return ((timestamp > (cycle + latency)) ? timestamp : (cycle + latency));
+   }
+
+   // if hit, this is the corresponding way
+   uint64_t way = slots ? ((slots[0] == NO_SLOT) ? assoc : (slots[0] - index * assoc)) : find_way(index, tag);
+   CBP_CHECK_EXPENSIVE(way == find_way(index, tag));
 
-   if (hit) {   // hit
+   if (way < assoc) {   // hit
       // determine when the requested block will be available
-      avail = ((C[index][way].timestamp > (cycle + latency)) ? C[index][way].timestamp : (cycle + latency));
+      const uint64_t timestamp = timestamps[index * assoc + way];
+      avail = ((timestamp > (cycle + latency)) ? timestamp : (cycle + latency));
+      if (!pf && !pf_sources.empty() && pf_sources[index * assoc + way])
+         demand_hit_prefetched(index * assoc + way, cycle);
 
       update_lru(index, way);   // make "way" the MRU way
    }
    else {   // miss
       misses+= !pf;
       pf_misses += pf;
+      sampled_misses[pf]++;
+      CBP_PROBE5(cache_miss, this, latency, addr, cycle, pf);
 
-      assert(max_lru_ctr == (assoc - 1));
-      assert(victim_way < assoc);
+      const uint64_t victim_way = find_victim(index);     // the lru/victim way
+      CBP_CHECK(victim_way < assoc);
       
       // TO DO: model writebacks (evictions of dirty blocks)
 
       // determine when the requested block will be available
-      avail = (next_level ? next_level->access((cycle + latency), read, addr, pf) : (cycle + latency + MAIN_MEMORY_LATENCY));
+      avail = (next_level ? next_level->access((cycle + latency), read, addr, pf, 0, slots ? (slots + 1) : nullptr) : (cycle + latency + main_memory_latency));
 
       // replace the victim block with the requested block
-      C[index][victim_way].valid = true;
-      C[index][victim_way].tag = tag;
-      C[index][victim_way].timestamp = avail;
+      tags[index * assoc + victim_way] = tag;
+      timestamps[index * assoc + victim_way] = avail;
+      if (!pf_sources.empty()) {
+         uint16_t& source = pf_sources[index * assoc + victim_way];
+         if (source)
+            pf_usage[source - 1].useless++;
+         source = pf ? (pf_source + 1) : 0;
+         if (pf)
+            pf_usage[pf_source].fills++;
+      }
       update_lru(index, victim_way);  // make "victim_way" the MRU way
+      way = victim_way;
    }
 
+   last_block = (addr >> num_offset_bits);
+   last_slot = index * assoc + way;
+   CBP_CHECK_EXPENSIVE(set_consistent(index));
    return(avail);
 }
 
-void cache_t::update_lru(uint64_t index, uint64_t mru_way) {
+// Whether set index holds each valid tag once, and its LRU ranks are a permutation of the ways.
+bool cache_t::set_consistent(uint64_t index) const {
+   const uint64_t *set_tags = &tags[index * assoc];
+   uint64_t ranks = 0;
    for (uint64_t way = 0; way < assoc; way++) {
-      if (C[index][way].lru < C[index][mru_way].lru) {
-         C[index][way].lru++;
-         assert(C[index][way].lru < assoc);
+      for (uint64_t other = way + 1; other < assoc; other++)
+         if (set_tags[way] != INVALID_TAG && set_tags[way] == set_tags[other])
+            return false;
+      if (!tree_plru)
+         ranks |= 1lu << (lru[index * assoc + way] ^ way);
+   }
+   return tree_plru || (ranks == ((assoc == 64) ? ~0lu : ((1lu << assoc) - 1)));
+}
+
+void cache_t::update_lru(uint64_t index, uint64_t mru_way) {
+   if (tree_plru) {
+      // point every node on the path away from mru_way
+      uint64_t bits = plru[index];
+      uint64_t node = 1;
+      for (uint64_t level = num_levels; level-- > 0;) {
+         const uint64_t right = (mru_way >> level) & 1;
+         bits = (bits & ~(1lu << node)) | ((right ^ 1) << node);
+         node = 2 * node + right;
       }
+      plru[index] = bits;
+      return;
    }
-   C[index][mru_way].lru = 0;
+
+   // the blocks more recently used than mru_way age by one
+   uint8_t *set_lru = &lru[index * assoc];
+   const uint8_t mru_rank = set_lru[mru_way] ^ mru_way;
+   for (uint64_t way = 0; way < assoc; way++) {
+      const uint8_t rank = set_lru[way] ^ way;
+      set_lru[way] = (rank + (rank < mru_rank)) ^ way;
+   }
+   set_lru[mru_way] = mru_way;
+}
+
+// The geometry is fixed by the configuration, only the contents and the statistics are saved.
+void cache_t::snapshot(snapshot_t& s) {
+   s.check(tags.size(), "cache size");
+   s.io(tags);
+   s.io(timestamps);
+   s.io(lru);
+   s.io(plru);
+   s.io(last_block);
+   s.io(last_slot);
+   s.io(pf_sources);
+   s.io(pf_usage);
+   s.io(accesses);
+   s.io(pf_accesses);
+   s.io(misses);
+   s.io(pf_misses);
+   s.io(sampled_accesses);
+   s.io(sampled_misses);
+   s.io(unsampled_accesses);
 }
 
 void cache_t::stats() {
@@ -147,4 +349,87 @@ void cache_t::stats() {
    printf("\tpf accesses   = %lu\n", pf_accesses);
    printf("\tpf misses     = %lu\n", pf_misses);
    printf("\tpf miss ratio = %.2f%%\n", 100.0*((double)pf_misses/(double)pf_accesses));
+   if (set_sampling > 1) {
+      // binomial confidence interval of the demand miss ratio of the sampled sets, that of the others
+      const double ratio = (double)sampled_misses[0]/(double)sampled_accesses[0];
+      printf("\tsampled sets  = 1 in %lu (%lu accesses to them, %lu to the others)\n", set_sampling, sampled_accesses[0] + sampled_accesses[1], unsampled_accesses);
+      printf("\tsampled miss ratio = %.2f%% +- %.2f%% (95%% confidence)\n", 100.0*ratio, 100.0*1.96*sqrt(ratio*(1.0 - ratio)/(double)sampled_accesses[0]));
+   }
+}
+
+void cache_t::register_stats(stats_t& st, const char * name) const {
+   st.group(name)
+     .add("accesses", accesses)
+     .add("misses", misses)
+     .add("miss_ratio", (double)misses/(double)accesses)
+     .add("pf_accesses", pf_accesses)
+     .add("pf_misses", pf_misses)
+     .add("pf_miss_ratio", (double)pf_misses/(double)pf_accesses);
+   if (set_sampling > 1)
+      st.add("set_sampling", set_sampling)
+        .add("sampled_accesses", sampled_accesses[0])
+        .add("sampled_miss_ratio", (double)sampled_misses[0]/(double)sampled_accesses[0]);
+}
+
+cache_hierarchy_t::cache_hierarchy_t(cache_t &top) {
+   num_levels = 0;
+   for (cache_t *c = &top; c; c = c->get_next_level()) {
+      CBP_CHECK(num_levels < cache_lookup_t::MAX_LEVELS);
+      levels[num_levels++] = c;
+   }
+   main_memory_latency = levels[num_levels - 1]->get_main_memory_latency();
+}
+
+void cache_hierarchy_t::reset() {
+   std::fill(std::begin(served), std::end(served), 0);
+}
+
+cache_lookup_t cache_hierarchy_t::lookup(uint64_t cycle, uint64_t addr) const {
+   cache_lookup_t found;
+   found.level = num_levels + 1;
+   for (uint64_t &slot : found.slots)
+      slot = cache_t::NO_SLOT;
+
+   // The access stops at the first level holding the block, even if it is still on its way there: that level gives
+   // the availability. The hit level is the first one where the block is there by its search.
+   bool held = false;
+   uint64_t search = cycle;
+   for (unsigned k = 0; k < num_levels; k++) {
+      const cache_t &c = *levels[k];
+      const uint64_t slot = c.find(search, addr);
+      found.slots[k] = slot;
+      const uint64_t ready = search + c.get_latency();
+      if (slot != cache_t::NO_SLOT) {
+         const uint64_t arrival = c.arrival(slot);
+         if (!held)
+            found.avail = ((arrival > ready) ? arrival : ready);
+         held = true;
+         if (arrival <= ready) {
+            found.level = k + 1;
+            return found;
+         }
+      }
+      search = ready;
+   }
+   if (!held)
+      found.avail = search + main_memory_latency;
+   return found;
+}
+
+uint64_t cache_hierarchy_t::access(const cache_lookup_t &found, uint64_t cycle, uint64_t addr) {
+   served[found.level - 1]++;
+   const uint64_t avail = levels[0]->access(cycle, true/*read*/, addr, false, 0, found.slots);
+   CBP_CHECK_EXPENSIVE(avail == found.avail);
+   return avail;
+}
+
+void cache_hierarchy_t::register_stats(stats_t &st, const char *name) const {
+   st.group(name);
+   for (unsigned k = 0; k < num_levels; k++)
+      st.add("served_L" + std::to_string(k + 1), served[k]);
+   st.add("served_memory", served[num_levels]);
+}
+
+void cache_hierarchy_t::snapshot(snapshot_t &s) {
+   s.io(served);
 }
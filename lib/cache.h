@@ -21,46 +21,174 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
+#pragma once
 
-struct block_t {
-    bool valid;
-    //bool dirty;   // TO DO
-    uint64_t tag;
-    uint64_t timestamp;
-    uint64_t lru;
+#include <vector>
+#include "huge_arena.h"
+
+class snapshot_t;
+class stats_t;
+
+// Fate of the blocks a prefetch brought into a cache, counted per prefetch source (track_prefetches()).
+struct prefetch_usage_t {
+    uint64_t fills = 0;     // blocks brought in by a prefetch
+    uint64_t useful = 0;    // prefetched blocks a demand access then hit
+    uint64_t late = 0;      // useful prefetches the demand access found still in flight
+    uint64_t useless = 0;   // prefetched blocks evicted before any demand access
 };
 
 #define IsPow2(x)   (((x) & (x-1)) == 0)
 
-#define TAG(addr)   ((addr) >> (num_index_bits + num_offset_bits))
+#define TAG(addr)   (((addr) >> (num_index_bits + num_offset_bits)) + 1)   // from 1, 0 is INVALID_TAG
 #define INDEX(addr) (((addr) >> num_offset_bits) & index_mask)
 
+// Set-associative cache, stored as structure of arrays: the tags, timestamps and replacement state of all the sets
+// are contiguous, the ways of a set side by side, so that a lookup compares all the ways of a set in one pass.
+// Replacement is true LRU, kept as one rank byte per way (0: MRU, assoc - 1: LRU), or tree pseudo-LRU, kept as
+// assoc - 1 bits per set. Every array starts all zero, invalid blocks in their initial LRU order, so that the cache
+// is built without writing them and their pages are only faulted in by the sets a run touches.
+//
+// Set sampling (-m <one_in_n>): only 1 in set_sampling of the sets are modelled, and stored. The sets are numbered by
+// a permutation of their index (a multiplication by an odd constant), the sampled ones being the first, so that the
+// sample is spread over the index space and strided streams do not fall all in or all out of it. An access to any
+// other set hits or misses by a draw, from the block and the number of such accesses, against the miss ratio of the
+// sampled sets so far, that of the demand accesses or of the prefetches, and a miss goes on to the next level. The draw is the same for find() and the access() that
+// follows it, as cache_hierarchy_t needs. The blocks these misses bring in are only kept in a direct-mapped table of
+// RECENT_BLOCKS, after the sets in the arrays, so that the accesses that follow a miss to the same block while it is on
+// its way wait for it, as they would in the full cache, rather than draw.
 class cache_t {
 private:
-    block_t **C;
+    static constexpr uint64_t INVALID_TAG = 0;
+    static constexpr uint64_t NO_BLOCK = ~0lu;      // block numbers never get that large, as there are offset bits
+
+    huge_vector_t<uint64_t> tags;         // [set * assoc + way], INVALID_TAG for an invalid block
+    huge_vector_t<uint64_t> timestamps;   // cycle at which the block is available
+    huge_vector_t<uint8_t> lru;           // LRU rank of each block, xor its way (way w of a new set has rank w)
+    huge_vector_t<uint64_t> plru;         // tree pseudo-LRU bits of each set, node n (from 1, in heap order) at bit n
+    bool tree_plru;
+    uint64_t num_levels;                // depth of the pseudo-LRU tree
+
+    // Last block accessed, and its slot. It is the MRU block of its set, so accessing it again changes nothing but
+    // the measurements: access() then skips the lookup. Sequential fetch hits the same I$ block many times in a row.
+    uint64_t last_block;
+    uint64_t last_slot;
+
     uint64_t num_index_bits;
     uint64_t num_offset_bits;
     uint64_t index_mask;
     uint64_t assoc;
 
+    // Set sampling: the sets numbered below num_sampled_sets are modelled, the number of a set being its index times
+    // index_mult (1 without sampling).
+    uint64_t set_sampling;
+    uint64_t num_sampled_sets;
+    uint64_t index_mult;
+    uint64_t sampled_accesses[2];       // demand [0] and prefetch [1] accesses to the sampled sets, and their misses
+    uint64_t sampled_misses[2];
+    uint64_t unsampled_accesses;        // to the other sets
+    static constexpr uint64_t RECENT_BLOCKS = 4096;
+
     // latency to search this cache for requested block
     uint64_t latency;
 
     // pointer to next cache level if applicable
     cache_t *next_level;
 
+    // latency of main memory, below the last level
+    uint64_t main_memory_latency;
+
+    // Prefetch source of each block while no demand access has hit it, from 1 (0: none), and the usage of each
+    // source, only when tracked.
+    huge_vector_t<uint16_t> pf_sources;
+    std::vector<prefetch_usage_t> pf_usage;
+
     // measurements
     uint64_t accesses;
     uint64_t pf_accesses;
     uint64_t misses;
     uint64_t pf_misses;
 
+    uint64_t find_way(uint64_t index, uint64_t tag) const;
+    uint64_t find_victim(uint64_t index) const;
     void update_lru(uint64_t index, uint64_t mru_way);
+    bool set_consistent(uint64_t index) const;
+    // The number of the set of addr.
+    uint64_t set_of(uint64_t addr) const { return (INDEX(addr) * index_mult) & index_mask; }
+    // Whether an access of addr (a prefetch if pf) to a set that is not sampled hits, by the draw.
+    bool unsampled_hit(uint64_t addr, bool pf) const;
+    // The slot of the block of addr in the table of recent blocks, whether it holds it or not (block number + 1).
+    uint64_t recent_slot(uint64_t addr) const { return num_sampled_sets * assoc + ((addr >> num_offset_bits) & (RECENT_BLOCKS - 1)); }
+    // find() for a set that is not sampled.
+    uint64_t unsampled_find(uint64_t cycle, uint64_t addr, bool pf) const;
+    void demand_hit_prefetched(uint64_t slot, uint64_t cycle);
 
 public:
-    cache_t(uint64_t size, uint64_t assoc, uint64_t blocksize, uint64_t latency, cache_t *next_level);
-    ~cache_t();
-    uint64_t access(uint64_t cycle, bool read, uint64_t addr, bool pf = false);
+    static constexpr uint64_t NO_SLOT = ~0lu;
+    // The slot find() returns for a drawn hit in a set that is not sampled, whose block is there.
+    static constexpr uint64_t UNSAMPLED_HIT = ~1lu;
+
+    cache_t(uint64_t size, uint64_t assoc, uint64_t blocksize, uint64_t latency, cache_t *next_level, uint64_t main_memory_latency, bool tree_plru = false,
+            uint64_t set_sampling = 1);
+    // Back to the state of a new cache, in the arrays already allocated (and faulted in), prefetch tracking included.
+    void reset();
+    // pf_source: the source of a prefetch (pf), when they are tracked.
+    // slots: the slots of the block in this level and those below it, as find() returned them since the last change
+    // to these caches, so that the access searches none of their sets again.
+    uint64_t access(uint64_t cycle, bool read, uint64_t addr, bool pf = false, uint64_t pf_source = 0, const uint64_t *slots = nullptr);
     bool is_hit(uint64_t cycle, uint64_t addr) const;
+    // The slot (set * assoc + way) holding the block of addr, NO_SLOT if none: the search of access() at cycle, which
+    // it leaves to be done, and which changes nothing.
+    uint64_t find(uint64_t cycle, uint64_t addr) const;
+    // Cycle the block of slot arrives at.
+    uint64_t arrival(uint64_t slot) const { return (slot == UNSAMPLED_HIT) ? 0 : timestamps[slot]; }
+    uint64_t get_latency() const { return latency; }
+    cache_t *get_next_level() const { return next_level; }
+    uint64_t get_main_memory_latency() const { return main_memory_latency; }
+    // Tracks what becomes of the blocks prefetches bring into this cache, by source: [0, num_sources).
+    void track_prefetches(uint64_t num_sources);
+    const std::vector<prefetch_usage_t>& prefetch_usage() const { return pf_usage; }
+    uint64_t demand_misses() const { return misses; }
     void stats();
+    // Registers the measurements in their own group, named name (-J).
+    void register_stats(stats_t& st, const char * name) const;
+    void snapshot(snapshot_t& s);
+};
+
+// Where cache_hierarchy_t::lookup() found a block.
+struct cache_lookup_t {
+    static constexpr unsigned MAX_LEVELS = 3;
+
+    // First level holding the block by the cycle that level is searched (is_hit() there), from 1, or the number of
+    // levels + 1 for main memory.
+    unsigned level;
+    // Cycle a read access would have the block at, as access() returns it.
+    uint64_t avail;
+    // Slot of the block in each level searched, cache_t::NO_SLOT where it is missing.
+    uint64_t slots[MAX_LEVELS];
+};
+
+// The data cache levels below a load, from the top one (L1$) down its next levels, searched once per access: lookup()
+// walks the levels as an access would, each at the cycle it is searched, and tells where the block is and when it
+// arrives, without changing anything. access() then commits it as the top level's access() would, from the slots the
+// lookup found, searching no set again. In between, nothing may access those caches.
+// Commits are counted by the level that served them.
+class cache_hierarchy_t {
+private:
+    cache_t *levels[cache_lookup_t::MAX_LEVELS];
+    unsigned num_levels;
+    uint64_t main_memory_latency;
+
+    uint64_t served[cache_lookup_t::MAX_LEVELS + 1] = {};
+
+public:
+    explicit cache_hierarchy_t(cache_t &top);
+    // Clears the counts: the levels are reset on their own.
+    void reset();
+
+    cache_lookup_t lookup(uint64_t cycle, uint64_t addr) const;
+    // A demand read of addr at cycle, found by lookup(cycle, addr). Returns the cycle the block is available.
+    uint64_t access(const cache_lookup_t &found, uint64_t cycle, uint64_t addr);
+    // Registers the commits per serving level, as the group name (-J).
+    void register_stats(stats_t &st, const char *name) const;
+    void snapshot(snapshot_t &s);
 };
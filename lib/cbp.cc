@@ -27,16 +27,144 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <inttypes.h>
 #include <assert.h>
 #include <string.h>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <type_traits>
 #include "cbp.h"
 #include "trace_reader.h"
+#include "trace_pipeline.h"
 #include "fifo.h"
 #include "cache.h"
 #include "bp.h"
 #include "resource_schedule.h"
 #include "uarchsim.h"
 #include "parameters.h"
+#include "batch.h"
+#include "bp_only_sim.h"
+#include "analytic_sim.h"
+#include "branch_trace.h"
+#include "fanout.h"
+#include "uarch_fanout.h"
+#include "branch_off.h"
+#include "snapshot.h"
+#include "interval.h"
+#include "simpoint.h"
+#include "stats.h"
+#include "event_trace.h"
+#include "branch_dataset.h"
+#include "trace_summary.h"
+#include "result_cache.h"
+#include "snapshot_catalog.h"
+#include "cost_model.h"
+#include "sweep.h"
+#include "daemon.h"
+#include "trace_cache.h"
+#include "indirect_study.h"
+#include "progress_stream.h"
+#include "time_series.h"
+#include "activity_trace.h"
+#include "predictor_thread.h"
+#include "plugin.h"
+#include "autosave.h"
+#include "branch_outcomes.h"
 
-uarchsim_t *sim;
+// Knobs of the simulations run by this process, set by parseargs.
+static sim_config_t config;
+
+// Batch mode (-B): simulate every trace argument and write a CSV summary instead of the usual report.
+static const char * batch_csv = nullptr;
+static const char * batch_log_dir = nullptr;
+static unsigned batch_jobs = 0;
+static unsigned batch_workers_per_llc = 0;
+// Result cache of the batch runs (-C), lib/result_cache.h.
+static const char * result_cache_dir = nullptr;
+
+// Node-local cache of decoded traces (-Z), lib/trace_cache.h.
+static const char * trace_cache_dir = nullptr;
+
+// Whether traces are read with their output register values: only for the hooks that read them (CBP_HOOK_VALUES)
+// and for value prediction. Otherwise TraceReader skips over them.
+static bool read_values = true;
+
+// Indirect-prediction study (-O): only ITTAGE, on the unconditional branches of the trace, lib/indirect_study.h.
+static bool indirect_study = false;
+
+// Distributed sweep (lib/sweep.h): -Q serves the jobs of sweep_jobs on sweep_port, -W runs those served at
+// sweep_host:sweep_port, -j at a time.
+static uint16_t sweep_port = 0;
+static const char * sweep_jobs = nullptr;
+static const char * sweep_stats = nullptr;
+static const char * sweep_host = nullptr;
+
+// Cost model of the batch and sweep runs (-v, lib/cost_model.h), seeded from cost_model_seed if it does not exist.
+static const char * cost_model_path = nullptr;
+static const char * cost_model_seed = nullptr;
+
+// Simulation daemon (-i, lib/daemon.h): serves jobs on daemon_socket, -j at a time, with its state in daemon_dir.
+static const char * daemon_socket = nullptr;
+static const char * daemon_dir = "/dev/shm/cbp-daemon";
+
+// Stops the simulation after stop_instr instructions (-f), 0 for the whole trace.
+static uint64_t stop_instr = 0;
+
+// Fan-out mode (-N): one branch-only predictor instance per resolve delay, fed from a single decode of the trace.
+static std::vector<uint64_t> fanout_delays;
+// Microarchitecture fan-out (-u): one timing simulator per line of timing options of uarch_configs, fed from a single
+// decode of the trace.
+static const char * uarch_configs = nullptr;
+// Branch-off mode (-g): the trace is simulated once up to instruction branch_off_instr, then on from there once per
+// line of options of branch_off_variants, in forked workers.
+static uint64_t branch_off_instr = 0;
+static const char * branch_off_variants = nullptr;
+
+// Warmup snapshots: -S saves the state after snapshot_save_instr instructions and goes on, -s resumes from a snapshot.
+static uint64_t snapshot_save_instr = 0;
+static const char * snapshot_save_file = nullptr;
+static const char * snapshot_restore_file = nullptr;
+// Catalog of warmup snapshots (CBP_SNAPSHOT_CATALOG, lib/snapshot_catalog.h), with the key of the snapshot of -S and
+// the trace it is of.
+static std::unique_ptr<snapshot_catalog_t> snapshot_catalog;
+static uint64_t snapshot_catalog_key = 0;
+static const char * snapshot_catalog_trace = nullptr;
+// Inference-only evaluation (-e): the predictor of this snapshot, frozen, for every trace.
+static const char * frozen_snapshot = nullptr;
+// Periodic autosave (-a): the state every autosave_interval instructions, resumed from by the same run started again.
+static uint64_t autosave_interval = 0;
+static const char * autosave_file = nullptr;
+static std::unique_ptr<autosave_t> autosave;
+// Lockstep validation (-l): the reference plugin that follows the predictor, its state compared every
+// lockstep_interval calls.
+static uint64_t lockstep_interval = 0;
+static std::unique_ptr<predictor_plugin_t> lockstep_reference;
+// Shadow predictors (-o): plugins that get the calls of the predictor without driving the timing.
+static std::vector<std::unique_ptr<predictor_plugin_t>> shadow_plugins;
+
+// Interval simulation (-K): the trace is simulated as interval_slices slices side by side, each warmed up over the
+// interval_warmup instructions before it; interval_reference adds a serial run to measure the error.
+static uint64_t interval_slices = 0;
+static uint64_t interval_warmup = 0;
+static bool interval_reference = false;
+// With -K simpoints,...: the slices are the simulation points of <trace>.simpts (convert_trace -p), interval_slices
+// then being 1 only to select interval simulation.
+static bool interval_simpoints = false;
+// With -K slice,<warmup_begin>,<begin>,<end>: the one slice of a distributed sweep (lib/sweep.h) this run simulates,
+// interval_slices then staying 0; slice_snapshot_file, if set, holds the state at its first instruction, fetched from
+// the snapshot catalog, to restore instead of warming up.
+static bool interval_single_slice = false;
+static uint64_t slice_warmup_begin = 0, slice_begin = 0, slice_end = 0;
+static std::string slice_snapshot_file;
+
+// Stats record (-J): the measurements of each run are appended as one JSON line to stats_json (lib/stats.h).
+static const char * stats_json = nullptr;
+
+// Decoupled predictor (-t): the predictor runs on its own thread, at most predictor_thread_lag events behind the
+// timing model (lib/predictor_thread.h).
+static uint64_t predictor_thread_lag = 0;
+
+// Batched stepping (-k): the timing run steps the trace step_batch_uops pieces at a time (uarchsim_t::step_batch).
+static uint64_t step_batch_uops = 0;
 
 int parseargs(int argc, char ** argv) 
 {
@@ -47,12 +175,31 @@ int parseargs(int argc, char ** argv)
   {
      if (!strcmp(argv[i], "-d"))
      {
-        PERFECT_CACHE = true;
+        config.PERFECT_CACHE = true;
+        i++;
+     }
+     else if (!strcmp(argv[i], "-R"))
+     {
+        config.CACHE_TREE_PLRU = true;
+        i++;
+     }
+     else if (!strcmp(argv[i], "-m"))
+     {
         i++;
+        if (i < argc)
+        {
+           config.CACHE_SET_SAMPLING = strtoull(argv[i], nullptr, 10);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing set sampling: -m <one_in_n>.\n");
+           exit(0);
+        }
      }
      else if (!strcmp(argv[i], "-b"))
      {
-        PERFECT_BRANCH_PRED = true;
+        config.PERFECT_BRANCH_PRED = true;
         i++;
      }
      //else if (!strcmp(argv[i], "-i"))
@@ -60,9 +207,59 @@ int parseargs(int argc, char ** argv)
      //   PERFECT_INDIRECT_PRED = true;
      //   i++;
      //}
+     else if (!strcmp(argv[i], "-T"))
+     {
+        config.PIPELINED_TRACE_READ = true;
+        i++;
+     }
+     else if (!strcmp(argv[i], "-c"))
+     {
+        i++;
+        double rel_error_percent;
+        char ipc[4] = "";
+        const int n = (i < argc) ? sscanf(argv[i], "%lf,%lu,%lu,%3s", &rel_error_percent, &config.EARLY_STOP_EPOCHS, &config.EARLY_STOP_WARMUP_EPOCHS, ipc) : 0;
+        if ((n >= 3) && (rel_error_percent > 0.0) && (config.EARLY_STOP_EPOCHS > 0) && ((n == 3) || !strcmp(ipc, "ipc")))
+        {
+           config.EARLY_STOP_REL_ERROR = rel_error_percent / 100.0;
+           config.EARLY_STOP_IPC = (n == 4);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing early termination target: -c <rel_error_percent>,<consecutive_epochs>,<warmup_epochs>[,ipc].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-k"))
+     {
+        i++;
+        if ((i < argc) && (sscanf(argv[i], "%lu", &step_batch_uops) == 1) && (step_batch_uops > 0))
+           i++;
+        else
+        {
+           printf("Usage: missing batch size: -k <uops>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-t"))
+     {
+        i++;
+        if ((i < argc) && (sscanf(argv[i], "%lu", &predictor_thread_lag) == 1) && (predictor_thread_lag > 0))
+           i++;
+        else
+        {
+           printf("Usage: missing predictor thread lag: -t <events>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-O"))
+     {
+        indirect_study = true;
+        i++;
+     }
      else if (!strcmp(argv[i], "-P"))
      {
-        PREFETCHER_ENABLE = true;
+        config.PREFETCHER_ENABLE = true;
         i++;
      }
      //else if (!strcmp(argv[i], "-f"))
@@ -84,7 +281,7 @@ int parseargs(int argc, char ** argv)
         i++;
         if (i < argc)
         {
-           NUM_LDST_LANES = atoi(argv[i]);
+           config.NUM_LDST_LANES = atoi(argv[i]);
            i++;
         }
         else
@@ -98,7 +295,7 @@ int parseargs(int argc, char ** argv)
         i++;
         if (i < argc)
         {
-           NUM_ALU_LANES = atoi(argv[i]);
+           config.NUM_ALU_LANES = atoi(argv[i]);
            i++;
         }
         else
@@ -119,11 +316,11 @@ int parseargs(int argc, char ** argv)
            unsigned int temp1, temp2, temp3, temp4, temp5;
            if (sscanf(argv[i], "%u,%u,%u,%u,%u", &temp1, &temp2, &temp3, &temp4, &temp5) == 5)
            {
-              FETCH_WIDTH = (uint64_t)temp1;
-              FETCH_NUM_BRANCH = (uint64_t)temp2;
-              FETCH_STOP_AT_INDIRECT = (temp3 ? true : false);
-              FETCH_STOP_AT_TAKEN = (temp4 ? true : false);
-              FETCH_MODEL_ICACHE = (temp5 ? true : false);
+              config.FETCH_WIDTH = (uint64_t)temp1;
+              config.FETCH_NUM_BRANCH = (uint64_t)temp2;
+              config.FETCH_STOP_AT_INDIRECT = (temp3 ? true : false);
+              config.FETCH_STOP_AT_TAKEN = (temp4 ? true : false);
+              config.FETCH_MODEL_ICACHE = (temp5 ? true : false);
            }
            else
            {
@@ -146,9 +343,9 @@ int parseargs(int argc, char ** argv)
            unsigned int temp1, temp2, temp3;
            if (sscanf(argv[i], "%u,%u,%u", &temp1, &temp2, &temp3) == 3)
            {
-              IC_SIZE = (uint64_t)(1 << temp1);
-              IC_ASSOC = (uint64_t)temp2;
-              IC_BLOCKSIZE = (uint64_t)temp3;
+              config.IC_SIZE = (uint64_t)(1 << temp1);
+              config.IC_ASSOC = (uint64_t)temp2;
+              config.IC_BLOCKSIZE = (uint64_t)temp3;
            }
            else
            {
@@ -175,22 +372,22 @@ int parseargs(int argc, char ** argv)
                       &temp9, &temp10, &temp11, &temp12,
                       &temp13) == 13)
            {
-              L1_SIZE = (uint64_t)(1 << temp1);
-              L1_ASSOC = (uint64_t)temp2;
-              L1_BLOCKSIZE = (uint64_t)temp3;
-              L1_LATENCY = (uint64_t)temp4;
-
-              L2_SIZE = (uint64_t)(1 << temp5);
-              L2_ASSOC = (uint64_t)temp6;
-              L2_BLOCKSIZE = (uint64_t)temp7;
-              L2_LATENCY = (uint64_t)temp8;
-
-              L3_SIZE = (uint64_t)(1 << temp9);
-              L3_ASSOC = (uint64_t)temp10;
-              L3_BLOCKSIZE = (uint64_t)temp11;
-              L3_LATENCY = (uint64_t)temp12;
-
-              MAIN_MEMORY_LATENCY = (uint64_t)temp13;
+              config.L1_SIZE = (uint64_t)(1 << temp1);
+              config.L1_ASSOC = (uint64_t)temp2;
+              config.L1_BLOCKSIZE = (uint64_t)temp3;
+              config.L1_LATENCY = (uint64_t)temp4;
+
+              config.L2_SIZE = (uint64_t)(1 << temp5);
+              config.L2_ASSOC = (uint64_t)temp6;
+              config.L2_BLOCKSIZE = (uint64_t)temp7;
+              config.L2_LATENCY = (uint64_t)temp8;
+
+              config.L3_SIZE = (uint64_t)(1 << temp9);
+              config.L3_ASSOC = (uint64_t)temp10;
+              config.L3_BLOCKSIZE = (uint64_t)temp11;
+              config.L3_LATENCY = (uint64_t)temp12;
+
+              config.MAIN_MEMORY_LATENCY = (uint64_t)temp13;
            }
            else
            {
@@ -208,13 +405,13 @@ int parseargs(int argc, char ** argv)
      else if (!strcmp(argv[i], "-E"))
      {
         i++;
-        PRINT_PER_EPOCH_STATS = true;
+        config.PRINT_PER_EPOCH_STATS = true;
         if (i < argc)
         {
            uint64_t epoch_size_insts;
            if (sscanf(argv[i], "%lu", &epoch_size_insts) == 1)
            {
-              EPOCH_SIZE_INSTS = epoch_size_insts;
+              config.EPOCH_SIZE_INSTS = epoch_size_insts;
            }
            else
            {
@@ -229,99 +426,1850 @@ int parseargs(int argc, char ** argv)
            exit(0);
         }
      }
-     else if (!strcmp(argv[i], "-w"))
+     else if (!strcmp(argv[i], "-r"))
      {
         i++;
         if (i < argc)
         {
-           WINDOW_SIZE = atoi(argv[i]);
+           config.RAS_SIZE = atoi(argv[i]);
            i++;
         }
         else
         {
-           printf("Usage: missing window size: -w <window_size>.\n");
+           printf("Usage: missing # return address stack entries: -r <ras_size>.\n");
            exit(0);
         }
      }
-     else
+     else if (!strcmp(argv[i], "-n"))
      {
-        break;
+        config.ANALYTIC_MODE = true;
+        i++;
      }
-  }
-
-  if (i < argc) {
-     return(i);
-  }
-  else {
-     //printf("usage:\t%s\n[optional: -d to enable perfect data cache]\n\t[optional: -b to enable perfect branch prediction (all branch types)]\n\t[optional: -i to enable perfect indirect-branch prediction]\n\t[optional: -P to enable stride prefetcher in L1D]\n\t[optional: -f <pipeline_fill_latency>]\n\t[optional: -M <num_ldst_lanes>\n\t[optional: -A <num_alu_lanes>\n\t[optional: -F <fetch_width>,<fetch_num_branch>,<fetch_stop_at_indirect>,<fetch_stop_at_taken>,<fetch_model_icache>]\n\t[optional: -I <log2_ic_size>,<ic_assoc>,<ic_blocksize>]\n\t[optional: -D <log2_L1_size>,<L1_assoc>,<L1_blocksize>,<L1_latency>,<log2_L2_size>,<L2_assoc>,<L2_blocksize>,<L2_latency>,<log2_L3_size>,<L3_assoc>,<L3_blocksize>,<L3_latency>,<main_memory_latency>]\n\t[optional: -w <window_size>]\n\t[REQUIRED: .gz trace file]\n\t[optional: contestant's arguments]\n", argv[0]);
-     printf("usage:\t%s\n"
-             //"\t[optional: -v to enable value prediction]\n", 
-             //"\t[optional: -p to enable perfect value prediction (if -v also specified)]\n",
-             "\t[optional: -d to enable perfect data cache]\n"
-             "\t[optional: -b to enable perfect branch prediction (all branch types)]\n"
-             // "\t[optional: -i to enable perfect indirect-branch prediction]\n"
-             "\t[optional: -P to enable stride prefetcher in L1D]\n"
-             // "\t[optional: -f <pipeline_fill_latency>]\n"
-             "\t[optional: -M <num_ldst_lanes>\n"
-             "\t[optional: -A <num_alu_lanes>\n"
-             "\t[optional: -F <fetch_width>,<fetch_num_branch>,<fetch_stop_at_indirect>,<fetch_stop_at_taken>,<fetch_model_icache>]\n"
-             "\t[optional: -I <log2_ic_size>,<ic_assoc>,<ic_blocksize>]\n"
-             "\t[optional: -D <log2_L1_size>,<L1_assoc>,<L1_blocksize>,<L1_latency>,<log2_L2_size>,<L2_assoc>,<L2_blocksize>,<L2_latency>,<log2_L3_size>,<L3_assoc>,<L3_blocksize>,<L3_latency>,<main_memory_latency>]\n"
-             "\t[optional: -w <window_size>]\n"
-             "\t[optional: -E <epoch_size_insts> to enable dumping per-epoch conditional branch info\n"
-             "\t[REQUIRED: .gz trace file]\n", argv[0]);
-     exit(0);
-  }
-}
-
-int main(int argc, char ** argv)
-{
-  int i = parseargs(argc, argv);
-  TraceReader reader(argv[i]);
-
-  // Need to create simulator after parsing arguments (for global parameters).
-  sim = new uarchsim_t;
- 
-  // Get to next (optional) argument after trace filename.
-  i++;
-  //if (i < argc)
-  //   beginPredictor((argc - i), &(argv[i]));
-  //else
-  //   beginPredictor(0, (char **)NULL);
-
-  //if (i < argc)
-  //   beginCondDirPredictor((argc - i), &(argv[i]));
-  //else
-  //   beginCondDirPredictor(0, (char **)NULL);
-  beginCondDirPredictor();
-
-  db_t *inst = reader.get_inst(); 
-
-  //bool dump_activity = true;
-  //uint64_t current_fetch_cycle = 0;
-  while (inst != nullptr) 
-  {
-      //const bool logging_activated = (LOG_LEVEL != 0) && (current_fetch_cycle>= LOG_START_CYCLE) && (current_fetch_cycle<=LOG_END_CYCLE);
-      //if(logging_activated && dump_activity)
-      //{
-      //    std::cout<<"======================================================= Begin "<<current_fetch_cycle<<"=======================================================\n";
-      //    dump_activity = false;
-      //}
-
-      sim->step(inst);
-
-      //const uint64_t next_fetch_cycle = sim->get_current_fetch_cycle();
-      //if(logging_activated && next_fetch_cycle != current_fetch_cycle)
-      //{
-      //    dump_activity = true;
-      //    std::cout<<"======================================================= End "<<current_fetch_cycle<<"->"<<next_fetch_cycle<<"=======================================================\n";
-      //}
-      //current_fetch_cycle = next_fetch_cycle;
-      delete inst;
-      inst = reader.get_inst();
-  }
-
-  endPredictor();
-  endCondDirPredictor();
-  sim->output();
+     else if (!strcmp(argv[i], "-X"))
+     {
+        i++;
+        if (i < argc)
+        {
+           config.BRANCH_ONLY_MODE = true;
+           config.BRANCH_ONLY_RESOLVE_DELAY = atoi(argv[i]);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing resolve delay: -X <resolve_delay_uops>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-B"))
+     {
+        i++;
+        if (i < argc)
+        {
+           batch_csv = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing results csv: -B <results.csv>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-j"))
+     {
+        i++;
+        if (i < argc)
+        {
+           batch_jobs = atoi(argv[i]);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing # batch workers: -j <jobs>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-N"))
+     {
+        i++;
+        if (i < argc)
+        {
+           char * p = argv[i];
+           fanout_delays.push_back(strtoul(p, &p, 10));
+           while (*p == ',')
+              fanout_delays.push_back(strtoul(p + 1, &p, 10));
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing resolve delays: -N <resolve_delay_uops>[,<resolve_delay_uops>...].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-u"))
+     {
+        i++;
+        if (i < argc)
+        {
+           uarch_configs = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing microarchitecture configurations: -u <configs.txt>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-g"))
+     {
+        i++;
+        char * p = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        if (p && (p[1] != '\0'))
+        {
+           branch_off_instr = strtoul(argv[i], nullptr, 10);
+           branch_off_variants = p + 1;
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing branch-off point: -g <instr_count>,<variants.txt>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-L"))
+     {
+        i++;
+        if (i < argc)
+        {
+           batch_log_dir = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing batch log directory: -L <log_dir>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-Q"))
+     {
+        i++;
+        char * jobs = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        char * stats = jobs ? strchr(jobs + 1, ',') : nullptr;
+        if (stats && (jobs != argv[i]) && (stats != jobs + 1) && stats[1])
+        {
+           *jobs = '\0';
+           *stats = '\0';
+           sweep_port = atoi(argv[i]);
+           sweep_jobs = jobs + 1;
+           sweep_stats = stats + 1;
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing sweep coordinator parameters: -Q <port>,<jobs.txt>,<stats.jsonl>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-W"))
+     {
+        i++;
+        char * p = (i < argc) ? strrchr(argv[i], ':') : nullptr;
+        if (p && (p != argv[i]) && p[1])
+        {
+           *p = '\0';
+           sweep_host = argv[i];
+           sweep_port = atoi(p + 1);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing sweep coordinator address: -W <host>:<port>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-i"))
+     {
+        i++;
+        if (i < argc)
+        {
+           char * p = strchr(argv[i], ',');
+           if (p && p[1])
+           {
+              *p = '\0';
+              daemon_dir = p + 1;
+           }
+           daemon_socket = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing daemon socket: -i <socket>[,<state_dir>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-v"))
+     {
+        i++;
+        if (i < argc)
+        {
+           char * p = strchr(argv[i], ',');
+           if (p && p[1])
+           {
+              *p = '\0';
+              cost_model_seed = p + 1;
+           }
+           cost_model_path = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing cost model: -v <model.csv>[,<seed.csv>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-f"))
+     {
+        i++;
+        if ((i < argc) && (sscanf(argv[i], "%lu", &stop_instr) == 1) && (stop_instr > 0))
+           i++;
+        else
+        {
+           printf("Usage: missing instruction count: -f <instr_count>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-G"))
+     {
+        i++;
+        if (i < argc)
+        {
+           batch_workers_per_llc = atoi(argv[i]);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing # batch workers per LLC domain: -G <workers_per_llc>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-Y"))
+     {
+        i++;
+        if (i < argc)
+        {
+           progress_stream.open(argv[i]);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing progress stream: -Y <progress.jsonl> or -Y unix:<socket>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-Z"))
+     {
+        i++;
+        if (i < argc)
+        {
+           trace_cache_dir = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing trace cache directory: -Z <cache_dir>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-C"))
+     {
+        i++;
+        if (i < argc)
+        {
+           result_cache_dir = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing result cache directory: -C <cache_dir>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-S"))
+     {
+        i++;
+        char * p = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        if (p && (p[1] != '\0'))
+        {
+           snapshot_save_instr = strtoul(argv[i], nullptr, 10);
+           snapshot_save_file = p + 1;
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing snapshot point: -S <instr_count>,<snapshot_file>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-s"))
+     {
+        i++;
+        if (i < argc)
+        {
+           snapshot_restore_file = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing snapshot file: -s <snapshot_file>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-a"))
+     {
+        i++;
+        char * p = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        if (p && (p[1] != '\0') && (strtoul(argv[i], nullptr, 10) > 0))
+        {
+           autosave_interval = strtoul(argv[i], nullptr, 10);
+           autosave_file = p + 1;
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing autosave interval: -a <instr_interval>,<snapshot_file>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-e"))
+     {
+        i++;
+        if (i < argc)
+        {
+           frozen_snapshot = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing snapshot file: -e <snapshot_file>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-p"))
+     {
+        i++;
+        if (i < argc)
+        {
+           predictor_plugins.emplace_back(new predictor_plugin_t(argv[i]));
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing predictor plugin: -p <plugin.so>[,<args>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-l"))
+     {
+        i++;
+        char * p = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        if (p && (p[1] != '\0') && (strtoul(argv[i], nullptr, 10) > 0))
+        {
+           lockstep_interval = strtoul(argv[i], nullptr, 10);
+           lockstep_reference.reset(new predictor_plugin_t(p + 1));
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing lockstep interval: -l <call_interval>,<reference.so>[,<args>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-o"))
+     {
+        i++;
+        if (i < argc)
+        {
+           shadow_plugins.emplace_back(new predictor_plugin_t(argv[i]));
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing shadow predictor plugin: -o <shadow.so>[,<args>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-K"))
+     {
+        i++;
+        char reference[8] = "";
+        interval_simpoints = (i < argc) && !strncmp(argv[i], "simpoints,", 10);
+        interval_single_slice = (i < argc) && !strncmp(argv[i], "slice,", 6);
+        if (interval_simpoints)
+           interval_slices = 1;
+        if (interval_single_slice)
+        {
+           if (sscanf(argv[i] + 6, "%lu,%lu,%lu", &slice_warmup_begin, &slice_begin, &slice_end) != 3)
+           {
+              printf("Usage: missing slice parameters: -K slice,<warmup_begin>,<begin>,<end>.\n");
+              exit(0);
+           }
+           i++;
+        }
+        else if ((i < argc) && (interval_simpoints ? sscanf(argv[i] + 10, "%lu,%7s", &interval_warmup, reference) >= 1
+                                             : sscanf(argv[i], "%lu,%lu,%7s", &interval_slices, &interval_warmup, reference) >= 2)
+            && (interval_slices > 0) && (!reference[0] || !strcmp(reference, "ref")))
+        {
+           interval_reference = reference[0];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing interval simulation parameters: -K <slices>,<warmup_instrs>[,ref], -K simpoints,<warmup_instrs>[,ref] or -K slice,<warmup_begin>,<begin>,<end>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-U"))
+     {
+        i++;
+        double threshold_percent = 100.0 * config.SAMPLE_PHASE_THRESHOLD;
+        int n;
+        if ((i < argc) && !strncmp(argv[i], "phase,", 6))
+        {
+           // an interval is a period whose unit is all of it but the detailed warmup
+           n = sscanf(argv[i] + 6, "%lu,%lu,%lf", &config.SAMPLE_PERIOD_INSTS, &config.SAMPLE_WARMUP_INSTS, &threshold_percent);
+           config.SAMPLE_PHASES = true;
+           config.SAMPLE_PHASE_THRESHOLD = threshold_percent / 100.0;
+           config.SAMPLE_UNIT_INSTS = (n >= 2) && (config.SAMPLE_WARMUP_INSTS < config.SAMPLE_PERIOD_INSTS) ? (config.SAMPLE_PERIOD_INSTS - config.SAMPLE_WARMUP_INSTS) : 0;
+           if ((n < 2) || !config.SAMPLE_UNIT_INSTS || (threshold_percent < 0.0) || (threshold_percent > 100.0))
+           {
+              printf("Usage: missing phase-adaptive sampling parameters: -U phase,<interval_instrs>,<detailed_warmup_instrs>[,<threshold_percent>], with warmup < interval.\n");
+              exit(0);
+           }
+           i++;
+        }
+        else if ((i < argc) && (sscanf(argv[i], "%lu,%lu,%lu", &config.SAMPLE_UNIT_INSTS, &config.SAMPLE_PERIOD_INSTS, &config.SAMPLE_WARMUP_INSTS) == 3)
+            && (config.SAMPLE_UNIT_INSTS > 0) && (config.SAMPLE_UNIT_INSTS + config.SAMPLE_WARMUP_INSTS <= config.SAMPLE_PERIOD_INSTS))
+        {
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing sampling parameters: -U <unit_instrs>,<period_instrs>,<detailed_warmup_instrs>, with unit + warmup <= period.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-H"))
+     {
+        i++;
+        if ((i < argc) && (argv[i][0] != ','))
+        {
+           char * p = strchr(argv[i], ',');
+           if (p)
+           {
+              BRANCH_PROFILE_TOP_N = strtoul(p + 1, nullptr, 10);
+              *p = '\0';
+           }
+           BRANCH_PROFILE_CSV = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing branch profile csv: -H <profile.csv>[,<top_n>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-V"))
+     {
+        i++;
+        if ((i < argc) && (argv[i][0] != ','))
+        {
+           char * p = strchr(argv[i], ',');
+           if (p)
+           {
+              EVENT_TRACE_ONE_IN_N = strtoul(p + 1, nullptr, 10);
+              *p = '\0';
+           }
+           EVENT_TRACE_FILE = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing event trace file: -V <events.bin>[,<one_in_n>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-x"))
+     {
+        i++;
+        if ((i < argc) && (argv[i][0] != ','))
+        {
+           char * p = strchr(argv[i], ',');
+           if (p)
+           {
+              BRANCH_DATASET_HISTORY_BITS = strtoul(p + 1, nullptr, 10);
+              *p = '\0';
+           }
+           BRANCH_DATASET_FILE = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing branch dataset file: -x <dataset.bin>[,<history_bits>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-q"))
+     {
+        i++;
+        if ((i < argc) && (argv[i][0] != ','))
+        {
+           uint64_t series_epoch_insts = 10000;
+           char * p = strchr(argv[i], ',');
+           if (p)
+           {
+              series_epoch_insts = strtoull(p + 1, nullptr, 10);
+              *p = '\0';
+           }
+           if (series_epoch_insts == 0)
+           {
+              printf("Usage: the time series epochs are of at least one instruction: -q <series.bin>[,<epoch_insts>].\n");
+              exit(0);
+           }
+           if (!time_series.open(argv[i], series_epoch_insts))
+           {
+              fprintf(stderr, "Cannot open the time series file %s\n", argv[i]);
+              exit(1);
+           }
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing time series file: -q <series.bin>[,<epoch_insts>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-y"))
+     {
+        i++;
+        if ((i < argc) && (argv[i][0] != ','))
+        {
+           config.LOG_START_CYCLE = 0;
+           config.LOG_END_CYCLE = UINT64_MAX;
+           char * p = strchr(argv[i], ',');
+           if (p)
+           {
+              if (sscanf(p + 1, "%lu,%lu", &config.LOG_START_CYCLE, &config.LOG_END_CYCLE) != 2)
+              {
+                 printf("Usage: the cycles to record are a range: -y <activity.bin>[,<first_cycle>,<last_cycle>].\n");
+                 exit(0);
+              }
+              *p = '\0';
+           }
+           if (!activity_recorder.open(argv[i], config.LOG_START_CYCLE, config.LOG_END_CYCLE))
+           {
+              fprintf(stderr, "Cannot open the activity trace file %s\n", argv[i]);
+              exit(1);
+           }
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing activity trace file: -y <activity.bin>[,<first_cycle>,<last_cycle>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-z"))
+     {
+        i++;
+        char * file = (i < argc) ? strchr(argv[i], ',') : nullptr;
+        if (file && (file[1] != '\0') && (file[1] != ','))
+        {
+           *file++ = '\0';
+           char * p = strchr(file, ',');
+           if (p)
+              *p++ = '\0';
+           if (!strcmp(argv[i], "record") && !p)
+              branch_outcomes.record(file);
+           else if (!strcmp(argv[i], "replay"))
+              branch_outcomes.replay(file, p ? strtoull(p, nullptr, 10) : 0);
+           else
+           {
+              printf("Usage: -z record,<outcomes.bin> or -z replay,<outcomes.bin>[,<sample_instrs>].\n");
+              exit(0);
+           }
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing outcomes file: -z record,<outcomes.bin> or -z replay,<outcomes.bin>[,<sample_instrs>].\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-J"))
+     {
+        i++;
+        if (i < argc)
+        {
+           stats_json = argv[i];
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing stats file: -J <stats.jsonl>.\n");
+           exit(0);
+        }
+     }
+     else if (!strcmp(argv[i], "-w"))
+     {
+        i++;
+        if (i < argc)
+        {
+           config.WINDOW_SIZE = atoi(argv[i]);
+           i++;
+        }
+        else
+        {
+           printf("Usage: missing window size: -w <window_size>.\n");
+           exit(0);
+        }
+     }
+     else
+     {
+        break;
+     }
+  }
+
+  if ((i < argc) || sweep_jobs || sweep_host || daemon_socket) {
+     return(i);
+  }
+  else {
+     //printf("usage:\t%s\n[optional: -d to enable perfect data cache]\n\t[optional: -b to enable perfect branch prediction (all branch types)]\n\t[optional: -i to enable perfect indirect-branch prediction]\n\t[optional: -P to enable stride prefetcher in L1D]\n\t[optional: -f <pipeline_fill_latency>]\n\t[optional: -M <num_ldst_lanes>\n\t[optional: -A <num_alu_lanes>\n\t[optional: -F <fetch_width>,<fetch_num_branch>,<fetch_stop_at_indirect>,<fetch_stop_at_taken>,<fetch_model_icache>]\n\t[optional: -I <log2_ic_size>,<ic_assoc>,<ic_blocksize>]\n\t[optional: -D <log2_L1_size>,<L1_assoc>,<L1_blocksize>,<L1_latency>,<log2_L2_size>,<L2_assoc>,<L2_blocksize>,<L2_latency>,<log2_L3_size>,<L3_assoc>,<L3_blocksize>,<L3_latency>,<main_memory_latency>]\n\t[optional: -w <window_size>]\n\t[REQUIRED: .gz trace file]\n\t[optional: contestant's arguments]\n", argv[0]);
+     printf("usage:\t%s\n"
+             //"\t[optional: -v to enable value prediction]\n", 
+             //"\t[optional: -p to enable perfect value prediction (if -v also specified)]\n",
+             "\t[optional: -d to enable perfect data cache]\n"
+             "\t[optional: -R to use tree pseudo-LRU replacement in all caches]\n"
+             "\t[optional: -m <one_in_n> approximate L2$ and L3$: only 1 in <one_in_n> of their sets modelled, the others hitting at the miss ratio of those]\n"
+             "\t[optional: -b to enable perfect branch prediction (all branch types)]\n"
+             // "\t[optional: -i to enable perfect indirect-branch prediction]\n"
+             "\t[optional: -P to enable stride prefetcher in L1D]\n"
+             // "\t[optional: -f <pipeline_fill_latency>]\n"
+             "\t[optional: -M <num_ldst_lanes>\n"
+             "\t[optional: -A <num_alu_lanes>\n"
+             "\t[optional: -F <fetch_width>,<fetch_num_branch>,<fetch_stop_at_indirect>,<fetch_stop_at_taken>,<fetch_model_icache>]\n"
+             "\t[optional: -I <log2_ic_size>,<ic_assoc>,<ic_blocksize>]\n"
+             "\t[optional: -D <log2_L1_size>,<L1_assoc>,<L1_blocksize>,<L1_latency>,<log2_L2_size>,<L2_assoc>,<L2_blocksize>,<L2_latency>,<log2_L3_size>,<L3_assoc>,<L3_blocksize>,<L3_latency>,<main_memory_latency>]\n"
+             "\t[optional: -w <window_size>]\n"
+             "\t[optional: -E <epoch_size_insts> to enable dumping per-epoch conditional branch info\n"
+             "\t[optional: -T to decode the trace on a separate thread]\n"
+             "\t[optional: -c <rel_error_percent>,<consecutive_epochs>,<warmup_epochs>[,ipc] to stop once the 95%% confidence interval of the epoch MPKIs (and CPIs) is within <rel_error_percent> for <consecutive_epochs> epochs (-E) in a row]\n"
+             "\t[optional: -k <uops> to step the timing run <uops> pieces at a time, each stage over the whole batch]\n"
+             "\t[optional: -t <events> to run the predictor on a separate thread, at most <events> predictor calls behind (e.g. 4096)]\n"
+             "\t[optional: -X <resolve_delay_uops> branch-only mode: no timing model, branches resolve after the given number of uops]\n"
+             "\t[optional: -n analytic timing model: IPC estimated from dependences, fetch, window and cache misses, without the pipeline]\n"
+             "\t[optional: -B <results.csv> to simulate every trace given and write a csv summary]\n"
+             "\t[optional: -j <jobs> number of batch workers (default: one per core)]\n"
+             "\t[optional: -G <workers_per_llc> most batch workers pinned to the cores of one last-level cache (default: no limit)]\n"
+             "\t[optional: -N <resolve_delay_uops>[,<resolve_delay_uops>...] fan-out: one branch-only predictor instance per delay, trace decoded once]\n"
+             "\t[optional: -u <configs.txt> microarchitecture fan-out: one timing simulator per line of timing options (e.g. \"-w 256 -F 8,2,0,1,1\"), trace decoded once]\n"
+             "\t[optional: -g <instr_count>,<variants.txt> branch-off: warms up to <instr_count> once, then runs the rest once per line of options, each in a forked copy (predictor variant k: PREDICTOR_CONFIG = k)]\n"
+             "\t[optional: -L <log_dir> to keep the batch (or fan-out) workers' logs]\n"
+             "\t[optional: -Q <port>,<jobs.txt>,<stats.jsonl> sweep coordinator: leases the jobs (\"<trace> [<options>...]\" lines) to the -W workers, no trace argument]\n"
+             "\t[optional: -W <host>:<port> sweep worker: runs the jobs of the coordinator, -j at a time (default: one per core), no trace argument]\n"
+             "\t[optional: -i <socket>[,<state_dir>] simulation daemon: runs the jobs sent over a local socket, -j at a time, with the decoded traces and warmup snapshots kept in <state_dir> (default /dev/shm/cbp-daemon), no trace argument]\n"
+             "\t[optional: -f <instr_count> to stop the simulation after <instr_count> instructions]\n"
+             "\t[optional: -v <model.csv>[,<seed.csv>] cost model of the batch (-B) and sweep (-Q) runs: orders them by estimated time, learns from each and prints the time left, seeded from <seed.csv> (e.g. reference_results_training_set.csv) if <model.csv> does not exist]\n"
+             "\t[optional: -Z <cache_dir> to read .gz traces from a copy decoded once and shared by all the processes of the node (e.g. /dev/shm/cbp)]\n"
+             "\t[optional: -C <cache_dir> to reuse the batch results of the same trace, build and options]\n"
+             "\t[optional: -S <instr_count>,<snapshot_file> to save the simulator and predictor state after <instr_count> instructions]\n"
+             "\t[optional: -s <snapshot_file> to resume from a snapshot saved with the same options and trace]\n"
+             "\t[optional: -a <instr_interval>,<snapshot_file> to autosave the state every <instr_interval> instructions, and resume from it when started again with the same arguments]\n"
+             "\t[optional: -p <plugin.so>[,<args>] the predictor of a plugin (make plugin) instead of the linked one; repeated, each one side by side with -B, -N or -u]\n"
+             "\t[optional: -l <call_interval>,<reference.so>[,<args>] lockstep validation: the reference plugin gets every predictor call too, predictions and states compared every <call_interval> calls]\n"
+             "\t[optional: -o <shadow.so>[,<args>] shadow predictor, repeated: gets every predictor call too, without driving the timing, and reports its own MPKI]\n"
+             "\t[optional: -e <snapshot_file> inference only: the predictor of a snapshot saved by any run, frozen, on every trace (e.g. with -B)]\n"
+             "\t[optional: -U <unit_instrs>,<period_instrs>,<detailed_warmup_instrs> sampled simulation: one unit measured per period, the rest functionally warmed]\n"
+             "\t[optional: -U phase,<interval_instrs>,<detailed_warmup_instrs>[,<threshold_percent>] phase-adaptive sampling: only the intervals of new phases simulated in detail (default threshold 10)]\n"
+             "\t[optional: -H <profile.csv>[,<top_n>] to write the <top_n> (default 100, 0: all) most mispredicted conditional branches, by provider]\n"
+             "\t[optional: -V <events.bin>[,<one_in_n>] to trace the predictor events of 1 in <one_in_n> (default 1) conditional branches (make EVENT_TRACE=<mask>)]\n"
+             "\t[optional: -x <dataset.bin>[,<history_bits>] to write every conditional branch, its outcome, provider and <history_bits> (default 64) of global history, for offline training]\n"
+             "\t[optional: -q <series.bin>[,<epoch_insts>] to record the measurements of every <epoch_insts> (default 10000) instructions as a compressed time series]\n"
+             "\t[optional: -y <activity.bin>[,<first_cycle>,<last_cycle>] to record the pipeline activity of the fetch cycles [<first_cycle>, <last_cycle>] (default all), printed by print_activity]\n"
+             "\t[optional: -z record,<outcomes.bin> to record whether each predicted branch was mispredicted]\n"
+             "\t[optional: -z replay,<outcomes.bin>[,<sample_instrs>] APPROXIMATE: the recorded outcomes instead of the predictor, for timing sweeps; <sample_instrs> also simulated with the predictor to report the divergence]\n"
+             "\t[optional: -J <stats.jsonl> to append the measurements of each run as one JSON line]\n"
+             "\t[optional: -K <slices>,<warmup_instrs>[,ref] interval simulation: slices of an indexed trace simulated side by side, ref adds a serial run to measure the error; with -B, the largest traces left at the tail of the batch are cut into up to <slices> slices]\n"
+             "\t[optional: -K simpoints,<warmup_instrs>[,ref] SimPoint simulation: only the simulation points of an indexed trace (convert_trace -p), weighted]\n"
+             "\t[optional: -K slice,<warmup_begin>,<begin>,<end> one slice of an indexed trace, as the coordinator of a sliced sweep (-Q with -K) leases them; <end> 0 for the end of the trace]\n"
+             "\t[REQUIRED: .gz trace file (or trace files with -B); a branch trace from convert_trace -b is replayed in branch-only mode]\n", argv[0]);
+     exit(0);
+  }
+}
+
+// The predictor thread (-t), if any, for as long as this lives: from after beginCondDirPredictor() (and the restore of a
+// snapshot) to before endCondDirPredictor().
+class decoupled_predictor_t
+{
+   private:
+      std::unique_ptr<predictor_thread_t> thread;
+
+   public:
+      decoupled_predictor_t()
+      {
+         if (predictor_thread_lag)
+         {
+            thread.reset(new predictor_thread_t(predictor_thread_lag));
+            predictor_thread = thread.get();
+         }
+      }
+
+      ~decoupled_predictor_t()
+      {
+         stop();
+      }
+
+      // Waits until the predictor is up to date, e.g. to save its state.
+      void drain()
+      {
+         if (thread)
+            thread->drain();
+      }
+
+      void stop()
+      {
+         predictor_thread = nullptr;
+         thread.reset();
+      }
+};
+
+// Saves or restores the state of s and of the predictor, and the trace position as counts of records (pieces) and
+// instructions, along with the static ids of the reader. The options must be those of the run that saved it, except
+// for -T which does not affect the state.
+template <class sim_type>
+static void snapshot_state(snapshot_t& snap, TraceReader& reader, sim_type *s, uint64_t& num_records, uint64_t& num_instr)
+{
+  sim_config_t snap_config;
+  memcpy(&snap_config, &config, sizeof(config));
+  snap_config.PIPELINED_TRACE_READ = false;
+  snap.check(snap_config, "the simulator options differ");
+  snap.io(num_records);
+  snap.io(num_instr);
+  // the predictor comes first, for load_frozen_predictor()
+  predictor_snapshot(snap);
+  snap.io(reader.static_ids());
+  s->snapshot(snap);
+}
+
+// Restores only the predictor of a snapshot, saved by any run (-S), and freezes it for inference-only evaluation (-e).
+// Done once before simulating anything: the forked workers of a batch then share the pages of its tables, which are
+// never written again.
+static void load_frozen_predictor(const char * path)
+{
+  snapshot_t snap(path, true/*restoring*/);
+  sim_config_t snap_config;
+  uint64_t num_records, num_instr;
+  snap.io(snap_config);
+  snap.io(num_records);
+  snap.io(num_instr);
+  predictor_snapshot(snap);
+  if (!predictor_freeze())
+  {
+     fprintf(stderr, "The predictor does not support frozen evaluation (-e)\n");
+     exit(1);
+  }
+  printf("Frozen predictor of snapshot %s, trained over %lu instructions\n", path, num_instr);
+}
+
+// Key of the state at instruction instr of trace in the snapshot catalog (CBP_SNAPSHOT_CATALOG), that of the snapshot
+// -S saves there with the same options. Exits if the predictor plugin cannot be read.
+static uint64_t snapshot_catalog_key_of(const char * trace, uint64_t instr)
+{
+  // As for cached results, -T does not affect the state.
+  sim_config_t key_config;
+  memcpy(&key_config, &config, sizeof(config));
+  key_config.PIPELINED_TRACE_READ = false;
+  const predictor_plugin_t * plugin = predictor_plugins.empty() ? nullptr : predictor_plugins[0].get();
+  uint64_t key;
+  if (!snapshot_catalog_t::key(trace, result_cache_t::hash_bytes(&key_config, sizeof(key_config)), instr, plugin ? plugin->get_path().c_str() : nullptr,
+                               plugin ? plugin->get_args() : "", key))
+  {
+     fprintf(stderr, "Cannot read the predictor plugin %s for the snapshot catalog\n", plugin->get_path().c_str());
+     exit(1);
+  }
+  return key;
+}
+
+// Appends the measurements of s, after its output(), to the stats record (-J) if any.
+template <class sim_type>
+static void write_stats(const sim_type& s, const char * trace_name)
+{
+  if (!stats_json)
+     return;
+  stats_t st;
+  s.register_stats(st);
+  if (!st.append_json(stats_json, trace_name))
+  {
+     fprintf(stderr, "Cannot write the stats record to %s\n", stats_json);
+     exit(1);
+  }
+}
+
+// Whether a whole run keeps the measurements of each epoch: the stats record (-J) lists them, a snapshot (-S) carries
+// them for the runs restoring it, and the replay divergence (-z replay with a sample) sums those of the sample.
+static bool keep_epochs()
+{
+  return stats_json || snapshot_save_file || (branch_outcomes.replaying() && branch_outcomes.sample_instrs());
+}
+
+// Runs the whole trace through s (uarchsim_t, or bp_only_sim_t in branch-only mode) and the global predictor, prints
+// the report, and returns the measurements collected by the batch driver.
+template <class sim_type>
+static batch_result_t simulate(TraceReader& reader, sim_type *s)
+{
+  if (keep_epochs())
+     s->keep_epochs();
+
+  //if (i < argc)
+  //   beginPredictor((argc - i), &(argv[i]));
+  //else
+  //   beginPredictor(0, (char **)NULL);
+
+  //if (i < argc)
+  //   beginCondDirPredictor((argc - i), &(argv[i]));
+  //else
+  //   beginCondDirPredictor(0, (char **)NULL);
+  predictor_begin();
+
+  // Single reusable piece: the reader refills it in place, so the main loop never allocates.
+  // In pipelined mode, pieces are instead decoded ahead by a producer thread and handed over in batches.
+  db_t inst_buf;
+  db_t *inst = &inst_buf;
+  uint64_t num_records = 0;
+  uint64_t num_instr = 0;
+  uint64_t num_skipped = 0;
+  // an autosave left by an earlier run with the same arguments is resumed from as -s would
+  const bool resuming = autosave && autosave->exists();
+  const char * restore_file = resuming ? autosave->get_path() : snapshot_restore_file;
+  // a snapshot to save (-S) that is in the catalog already is fetched from there and restored from instead
+  if (!restore_file && snapshot_catalog && snapshot_catalog->fetch(snapshot_catalog_key, snapshot_save_file))
+  {
+     printf("Fetched the snapshot at instruction %lu from the catalog %s\n", snapshot_save_instr, snapshot_catalog->get_dir().c_str());
+     restore_file = snapshot_save_file;
+  }
+  if (restore_file)
+  {
+     snapshot_t snap(restore_file, true/*restoring*/);
+     if (resuming)
+        autosave->check_key(snap);
+     snapshot_state(snap, reader, s, num_records, num_instr);
+     // jumps close to where the snapshot was taken if the trace is indexed (convert_trace -i)
+     num_skipped = reader.seek(num_instr);
+  }
+
+  decoupled_predictor_t decoupled;
+  std::unique_ptr<trace_pipeline_t> pipeline;
+  if (config.PIPELINED_TRACE_READ)
+     pipeline.reset(new trace_pipeline_t(reader));
+  auto next_inst = [&]() { return pipeline ? pipeline->next(inst) : reader.next(inst_buf); };
+
+  if (restore_file)
+  {
+     // the trace is read up to where the snapshot was taken
+     for (uint64_t n = num_skipped; n < num_records; n++)
+        if (!next_inst())
+        {
+           fprintf(stderr, "Unable to restore snapshot %s: the trace is shorter than the snapshot point\n", restore_file);
+           exit(1);
+        }
+     printf("%s %s at instruction %lu\n", (resuming ? "Resumed from the autosave" : "Restored snapshot"), restore_file, num_instr);
+  }
+
+  auto save_snapshot = [&]() {
+     decoupled.drain();
+     {
+        snapshot_t snap(snapshot_save_file, false/*restoring*/);
+        snapshot_state(snap, reader, s, num_records, num_instr);
+     }
+     if (snapshot_catalog)
+        snapshot_catalog->publish(snapshot_catalog_key, snapshot_save_file, snapshot_save_instr, snapshot_catalog_trace);
+  };
+  auto save_autosave = [&]() {
+     decoupled.drain();
+     autosave->save([&](snapshot_t& snap) { snapshot_state(snap, reader, s, num_records, num_instr); });
+  };
+
+  // Batched stepping (-k): the pieces go to the simulator a batch at a time, the batch cut short after the
+  // instruction a snapshot is due at.
+  bool batched = false;
+  if constexpr (std::is_same_v<sim_type, uarchsim_t>)
+     if (step_batch_uops)
+     {
+        batched = true;
+        std::vector<db_t> staging(pipeline ? 0 : step_batch_uops);
+        db_t *batch = staging.data();
+        auto next_batch = [&]() -> size_t {
+           if (pipeline)
+              return pipeline->next(batch, step_batch_uops);
+           size_t n = 0;
+           while ((n < step_batch_uops) && reader.next(staging[n]))
+              n++;
+           return n;
+        };
+        bool stop = false;
+        for (size_t n = next_batch(); (n > 0) && !s->converged() && !stop; n = next_batch())
+           for (size_t first = 0, last = 0; first < n; first = last)
+           {
+              bool save = false;
+              bool autosave_due = false;
+              while ((last < n) && !save && !autosave_due && !stop)
+                 if (batch[last++].is_last_piece)
+                 {
+                    save = (++num_instr == snapshot_save_instr) && snapshot_save_file;
+                    autosave_due = autosave && autosave->due(num_instr);
+                    stop = (num_instr == stop_instr);
+                 }
+              const size_t stepped = s->step_batch(batch + first, last - first);
+              num_records += stepped;
+              if (s->converged())
+                 break;
+              if (save)
+                 save_snapshot();
+              if (autosave_due)
+                 save_autosave();
+              if (stop)
+                 break;
+           }
+     }
+
+  //bool dump_activity = true;
+  //uint64_t current_fetch_cycle = 0;
+  while (!batched && next_inst()) 
+  {
+      //const bool logging_activated = (LOG_LEVEL != 0) && (current_fetch_cycle>= LOG_START_CYCLE) && (current_fetch_cycle<=LOG_END_CYCLE);
+      //if(logging_activated && dump_activity)
+      //{
+      //    std::cout<<"======================================================= Begin "<<current_fetch_cycle<<"=======================================================\n";
+      //    dump_activity = false;
+      //}
+
+      s->step(inst);
+      num_records++;
+      if constexpr (std::is_same_v<sim_type, uarchsim_t>)
+         if (s->converged())
+            break;
+      if (inst->is_last_piece && (++num_instr == snapshot_save_instr) && snapshot_save_file)
+         save_snapshot();
+      if (autosave && inst->is_last_piece && autosave->due(num_instr))
+         save_autosave();
+      if (inst->is_last_piece && (num_instr == stop_instr))
+         break;
+
+      //const uint64_t next_fetch_cycle = sim->get_current_fetch_cycle();
+      //if(logging_activated && next_fetch_cycle != current_fetch_cycle)
+      //{
+      //    dump_activity = true;
+      //    std::cout<<"======================================================= End "<<current_fetch_cycle<<"->"<<next_fetch_cycle<<"=======================================================\n";
+      //}
+      //current_fetch_cycle = next_fetch_cycle;
+  }
+
+  decoupled.stop();
+  if constexpr (VALUE_PREDICTION)
+     endPredictor();
+  predictor_end();
+  s->output();
+  if (autosave)
+     autosave->finish();
+
+  const uint64_t total_instr = s->get_epoch_insts();
+  batch_result_t result = {s->get_conddir_stats(total_instr), s->get_conddir_stats(total_instr/2)};
+  if (shadow_predictors)
+     shadow_predictors->output(total_instr, result.full.br, result.full.br_mispred);
+  if (activity_recorder.enabled())
+  {
+     const uint64_t num_records = activity_recorder.num_records();
+     activity_recorder.close();
+     printf("Activity trace: %lu records written\n", num_records);
+  }
+  if constexpr (std::is_same_v<sim_type, uarchsim_t>)
+     result.truncated = s->converged();
+  return result;
+}
+
+// Sampled simulation (-U) of the whole trace, reported with confidence intervals: see uarchsim_t::step_sampled(). Or
+// phase-adaptive (-U phase,...), reported per phase: see uarchsim_t::step_phased().
+static void simulate_sampled(TraceReader& reader, uarchsim_t *s)
+{
+  predictor_begin();
+
+  db_t inst_buf;
+  db_t *inst = &inst_buf;
+  std::unique_ptr<trace_pipeline_t> pipeline;
+  if (config.PIPELINED_TRACE_READ)
+     pipeline.reset(new trace_pipeline_t(reader));
+  auto next_inst = [&]() { return pipeline ? pipeline->next(inst) : reader.next(inst_buf); };
+
+  decoupled_predictor_t decoupled;
+  if (config.SAMPLE_PHASES)
+     while (next_inst())
+        s->step_phased(inst);
+  else
+     while (next_inst())
+        s->step_sampled(inst);
+  decoupled.stop();
+
+  if constexpr (VALUE_PREDICTION)
+     endPredictor();
+  predictor_end();
+  if (config.SAMPLE_PHASES)
+     s->output_phased();
+  else
+     s->output_sampled();
+}
+
+// Replays a branch trace (convert_trace -b) into the predictor: always branch-only, as there is nothing to time.
+static batch_result_t replay_branch_trace(const char * trace_name)
+{
+  if (snapshot_save_file || snapshot_restore_file || autosave || stop_instr)
+  {
+     fprintf(stderr, "Snapshots and stops (-f) are not supported when replaying a branch trace: %s\n", trace_name);
+     exit(1);
+  }
+  predictor_begin();
+
+  branch_trace_reader_t reader(trace_name);
+  bp_only_sim_t bp_only_sim(config);
+  if (keep_epochs())
+     bp_only_sim.keep_epochs();
+  branch_record_t rec;
+  uint64_t num_branches = 0;
+  decoupled_predictor_t decoupled;
+  while (reader.next(rec))
+  {
+     bp_only_sim.replay(rec);
+     num_branches++;
+  }
+  bp_only_sim.skip(reader.trailing_uops, reader.trailing_instrs);
+  decoupled.stop();
+  printf("Replayed %lu branches from %s\n", num_branches, trace_name);
+
+  if constexpr (VALUE_PREDICTION)
+     endPredictor();
+  predictor_end();
+  bp_only_sim.output();
+  write_stats(bp_only_sim, trace_name);
+
+  const uint64_t total_instr = bp_only_sim.get_epoch_insts();
+  return {bp_only_sim.get_conddir_stats(total_instr), bp_only_sim.get_conddir_stats(total_instr/2)};
+}
+
+// The decoded copy of trace_name in the trace cache (-Z) to read it from, if any.
+static std::string decoded_trace(const char * trace_name)
+{
+  return trace_cache_dir ? trace_cache_t::get(trace_name, trace_cache_dir) : std::string();
+}
+
+static epoch_stats_t simulate_trace_slice(const char * trace_name, uint64_t warmup_begin, uint64_t begin, uint64_t end);
+
+// The measurements of the epochs of stats, summed.
+static conddir_stats_t sum_epochs(const epoch_stats_t& stats)
+{
+  conddir_stats_t sum;
+  for (uint64_t e = 0; e < stats.insts.size(); e++)
+  {
+     sum.instr += stats.insts[e];
+     sum.cycles += stats.cycles[e];
+     sum.br += stats.conddir_n[e];
+     sum.br_mispred += stats.conddir_m[e];
+     sum.cycles_wp += stats.cycles_on_wrong_path[e];
+  }
+  return sum;
+}
+
+// Replay of recorded outcomes (-z replay) with a sample: the error of the replay s over the sample, against the same
+// instructions simulated with the predictor.
+template <class sim_type>
+static void report_replay_divergence(const char * trace_name, const sim_type& s)
+{
+  const uint64_t sample = branch_outcomes.sample_instrs();
+  if (!branch_outcomes.replaying() || (sample == 0))
+     return;
+  const conddir_stats_t replayed = sum_epochs(s.get_epoch_stats(0, sample/config.EPOCH_SIZE_INSTS));
+  epoch_stats_t full_stats;
+  if (!branch_outcomes.simulate_sample(trace_name, simulate_trace_slice, full_stats))
+  {
+     printf("Failed the simulation of the replay sample with the predictor\n");
+     return;
+  }
+  const conddir_stats_t full = sum_epochs(full_stats);
+  auto rel_error = [](double estimate, double reference) { return 100.0*(estimate - reference)/reference; };
+  printf("Replay divergence (approximate run) over the first %lu instructions, against the predictor: IPC %+.4f%%, MPKI %+.4f%%, CycWPPKI %+.4f%%\n",
+         full.instr, rel_error(replayed.ipc(), full.ipc()), rel_error(replayed.mpki(), full.mpki()), rel_error(replayed.cyc_wp_pki(), full.cyc_wp_pki()));
+}
+
+static batch_result_t run_trace(const char * trace_name)
+{
+  if (branch_trace_reader_t::is_branch_trace(trace_name))
+     return replay_branch_trace(trace_name);
+
+  const std::string decoded = decoded_trace(trace_name);
+  TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+
+  if (config.BRANCH_ONLY_MODE)
+  {
+     bp_only_sim_t bp_only_sim(config);
+     const batch_result_t result = simulate(reader, &bp_only_sim);
+     write_stats(bp_only_sim, trace_name);
+     return result;
+  }
+  if (config.ANALYTIC_MODE)
+  {
+     analytic_sim_t analytic_sim(config);
+     const batch_result_t result = simulate(reader, &analytic_sim);
+     write_stats(analytic_sim, trace_name);
+     report_replay_divergence(trace_name, analytic_sim);
+     return result;
+  }
+
+  // Need to create simulator after parsing arguments (for the configuration).
+  uarchsim_t sim(config);
+  if (config.SAMPLE_UNIT_INSTS)
+  {
+     simulate_sampled(reader, &sim);
+     return {};
+  }
+  const batch_result_t result = simulate(reader, &sim);
+  write_stats(sim, trace_name);
+  report_replay_divergence(trace_name, sim);
+  return result;
+}
+
+static batch_result_t simulate_trace(const char * trace_name)
+{
+  progress_stream.begin(trace_name);
+  time_series.begin(trace_name);
+  const batch_result_t result = run_trace(trace_name);
+  branch_outcomes.finish();
+  progress_stream.end();
+  return result;
+}
+
+// Simulates instructions [begin, end) of the trace for interval simulation (-K), after warming up from instruction
+// warmup_begin, or from the last indexed instruction before it. begin and end are epoch boundaries of the whole trace,
+// end being UINT64_MAX for the last slice, which is the only one to drain the pipeline and print the usual report.
+// Returns the measurements of the epochs of [begin, end).
+template <class sim_type>
+static epoch_stats_t simulate_slice(TraceReader& reader, sim_type *s, uint64_t warmup_begin, uint64_t begin, uint64_t end)
+{
+  predictor_begin();
+  s->keep_epochs();
+
+  db_t inst;
+  uint64_t first_instr, num_instr;
+  if (!slice_snapshot_file.empty())
+  {
+     // the state at begin, saved by a run of the whole trace: its epochs are those of the whole trace
+     snapshot_t snap(slice_snapshot_file.c_str(), true/*restoring*/);
+     uint64_t num_records;
+     snapshot_state(snap, reader, s, num_records, num_instr);
+     for (uint64_t n = reader.seek(num_instr); n < num_records; n++)
+        if (!reader.next(inst))
+        {
+           fprintf(stderr, "Unable to restore snapshot %s: the trace is shorter than the snapshot point\n", slice_snapshot_file.c_str());
+           exit(1);
+        }
+     first_instr = 0;
+     printf("Slice [%lu, %lu) restored from the snapshot at instruction %lu\n", begin, end, num_instr);
+  }
+  else
+  {
+     reader.seek(warmup_begin);
+     first_instr = num_instr = reader.nInstr;
+     // epochs stay aligned with those of the whole trace
+     s->start_in_epoch(first_instr % config.EPOCH_SIZE_INSTS);
+     printf("Slice [%lu, %lu) warmed up from instruction %lu\n", begin, end, first_instr);
+  }
+
+  while ((num_instr < end) && reader.next(inst))
+  {
+     s->step(&inst);
+     num_instr += inst.is_last_piece;
+  }
+
+  if constexpr (VALUE_PREDICTION)
+     endPredictor();
+  predictor_end();
+  const bool last_slice = num_instr < end;
+  if (last_slice)
+     s->output();
+  const uint64_t first_epoch = begin/config.EPOCH_SIZE_INSTS - first_instr/config.EPOCH_SIZE_INSTS;
+  return s->get_epoch_stats(first_epoch, last_slice ? UINT64_MAX : (end - begin)/config.EPOCH_SIZE_INSTS);
+}
+
+static epoch_stats_t simulate_trace_slice(const char * trace_name, uint64_t warmup_begin, uint64_t begin, uint64_t end)
+{
+  const std::string decoded = decoded_trace(trace_name);
+  TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+
+  if (config.BRANCH_ONLY_MODE)
+  {
+     bp_only_sim_t bp_only_sim(config);
+     return simulate_slice(reader, &bp_only_sim, warmup_begin, begin, end);
+  }
+  if (config.ANALYTIC_MODE)
+  {
+     analytic_sim_t analytic_sim(config);
+     return simulate_slice(reader, &analytic_sim, warmup_begin, begin, end);
+  }
+
+  uarchsim_t sim(config);
+  return simulate_slice(reader, &sim, warmup_begin, begin, end);
+}
+
+// The plugins simulated side by side (-p given more than once), by -B, -N and -u: every run of theirs once per plugin.
+// A single plugin is active in the whole process instead, as the linked predictor would be.
+static std::vector<predictor_plugin_t *> side_by_side_plugins()
+{
+  std::vector<predictor_plugin_t *> plugins;
+  if (predictor_plugins.size() > 1)
+     for (const std::unique_ptr<predictor_plugin_t>& plugin : predictor_plugins)
+        plugins.push_back(plugin.get());
+  return plugins;
+}
+
+static int simulate_fanout(const char * trace_name)
+{
+  std::vector<uint64_t> delays = fanout_delays;
+  std::vector<predictor_plugin_t *> plugins;
+  const std::vector<predictor_plugin_t *> side_by_side = side_by_side_plugins();
+  if (!side_by_side.empty())
+  {
+     delays.clear();
+     for (predictor_plugin_t * plugin : side_by_side)
+        for (uint64_t delay : fanout_delays)
+        {
+           delays.push_back(delay);
+           plugins.push_back(plugin);
+        }
+  }
+
+  if (branch_trace_reader_t::is_branch_trace(trace_name))
+  {
+     branch_trace_reader_t reader(trace_name);
+     return run_fanout([&](branch_record_t& rec) {
+        if (reader.next(rec))
+           return true;
+        rec.uop_delta = reader.trailing_uops;
+        rec.instr_delta = reader.trailing_instrs;
+        return false;
+     }, config, delays, batch_log_dir, plugins);
+  }
+
+  const std::string decoded = decoded_trace(trace_name);
+  TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+  branch_extractor_t extractor;
+  db_t inst;
+  return run_fanout([&](branch_record_t& rec) {
+     while (reader.next(inst))
+        if (extractor.push(inst.insn_class, inst.pc, inst.next_pc, inst.is_taken, inst.is_last_piece, rec))
+           return true;
+     rec.uop_delta = extractor.pending_uops();
+     rec.instr_delta = extractor.pending_instrs();
+     return false;
+  }, config, delays, batch_log_dir, plugins);
+}
+
+// Reads the configurations of the microarchitecture fan-out (-u) or the variants of the branch-off mode (-g), one per
+// line of timing options applied on top of the command line's; empty lines and those starting with # are skipped.
+static void load_uarch_configs(const char * path, std::vector<sim_config_t>& configs, std::vector<std::string>& labels)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+     fprintf(stderr, "Unable to open the microarchitecture configurations %s\n", path);
+     exit(1);
+  }
+  const sim_config_t base = config;
+  // everything parseargs sets besides the timing knobs
+  auto others = [&]() {
+     return std::make_tuple(batch_csv, batch_log_dir, batch_jobs, batch_workers_per_llc, result_cache_dir, trace_cache_dir, indirect_study,
+                            sweep_jobs, sweep_host, fanout_delays, uarch_configs, branch_off_variants, snapshot_save_file, snapshot_restore_file, frozen_snapshot, autosave_file, lockstep_interval, interval_slices,
+                            stats_json, predictor_thread_lag, step_batch_uops, BRANCH_PROFILE_CSV, EVENT_TRACE_FILE, BRANCH_DATASET_FILE, progress_stream.enabled(), time_series.enabled(), activity_recorder.enabled(),
+                            predictor_plugins.size(), shadow_plugins.size());
+  };
+  const auto base_others = others();
+  std::string line;
+  for (uint64_t n = 1; std::getline(in, line); n++)
+  {
+     std::istringstream words(line);
+     std::vector<std::string> args{"cbp"};
+     std::string word;
+     while (words >> word)
+        args.push_back(word);
+     if ((args.size() == 1) || (args[1][0] == '#'))
+        continue;
+     // a trace name, so that parseargs returns
+     args.push_back("trace");
+     std::vector<char *> argv;
+     for (std::string& a : args)
+        argv.push_back(&a[0]);
+
+     config = base;
+     const int i = parseargs(argv.size(), argv.data());
+     if ((i != (int) argv.size() - 1) || (others() != base_others) || (config.BRANCH_ONLY_MODE != base.BRANCH_ONLY_MODE) || config.SAMPLE_UNIT_INSTS)
+     {
+        fprintf(stderr, "%s:%lu: only timing options in a microarchitecture configuration (not -X or -U): %s\n", path, n, line.c_str());
+        exit(1);
+     }
+     configs.push_back(config);
+     labels.push_back(line.substr(line.find_first_not_of(" \t")));
+  }
+  config = base;
+  if (configs.empty())
+  {
+     fprintf(stderr, "No microarchitecture configuration in %s\n", path);
+     exit(1);
+  }
+}
+
+static int simulate_uarch_fanout(const char * trace_name)
+{
+  std::vector<sim_config_t> configs;
+  std::vector<std::string> labels;
+  load_uarch_configs(uarch_configs, configs, labels);
+  std::vector<predictor_plugin_t *> plugins;
+  const std::vector<predictor_plugin_t *> side_by_side = side_by_side_plugins();
+  if (!side_by_side.empty())
+  {
+     const std::vector<sim_config_t> base_configs = configs;
+     const std::vector<std::string> base_labels = labels;
+     configs.clear();
+     labels.clear();
+     for (predictor_plugin_t * plugin : side_by_side)
+        for (uint64_t k = 0; k < base_configs.size(); k++)
+        {
+           configs.push_back(base_configs[k]);
+           labels.push_back(base_labels[k] + " @" + plugin->get_label());
+           plugins.push_back(plugin);
+        }
+  }
+
+  const std::string decoded = decoded_trace(trace_name);
+  TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+  return run_uarch_fanout([&](db_t& inst) { return reader.next(inst); }, configs, labels, batch_log_dir, plugins);
+}
+
+// Branch-off mode (-g) with s, a uarchsim_t or (-X) a bp_only_sim_t: s and the predictor are warmed up over the first
+// branch_off_instr instructions, then each variant goes on from there in a forked worker. A variant with the timing
+// options of the warm-up carries on with s; the others build a simulator of their own at the branch-off point, with
+// the warm predictor. Trace readers do not survive a fork (their threads and file offsets), so the reader of the
+// warm-up is closed before and each worker opens the trace again and seeks to the branch-off point, which is quick
+// on an indexed trace (convert_trace -i).
+template <class sim_type>
+static int branch_off(const char * trace_name, sim_type *s, const std::vector<sim_config_t>& configs, const std::vector<std::string>& labels)
+{
+  predictor_begin();
+  const std::string decoded = decoded_trace(trace_name);
+  uint64_t num_records = 0;
+  uint64_t num_instr = 0;
+  {
+     TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+     db_t inst;
+     while ((num_instr < branch_off_instr) && reader.next(inst))
+     {
+        s->step(&inst);
+        num_records++;
+        num_instr += inst.is_last_piece;
+     }
+  }
+  if (num_instr < branch_off_instr)
+  {
+     fprintf(stderr, "Branch-off mode (-g): %s has only %lu instructions\n", trace_name, num_instr);
+     exit(1);
+  }
+  printf("Warmed up over %lu instructions of %s\n", num_instr, trace_name);
+
+  std::vector<const char *> modes;
+  for (const sim_config_t& c : configs)
+     modes.push_back(memcmp(&c, &config, sizeof(config)) ? "pred" : "all");
+
+  auto run_variant = [&](uint64_t k) {
+     TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+     db_t inst;
+     for (uint64_t n = reader.seek(num_instr); n < num_records; n++)
+        if (!reader.next(inst))
+           _exit(1);
+     std::unique_ptr<sim_type> own;
+     sim_type *sim = s;
+     uint64_t first_epoch = num_instr / config.EPOCH_SIZE_INSTS;
+     if (memcmp(&configs[k], &config, sizeof(config)))
+     {
+        // epochs count from the branch-off point
+        own.reset(new sim_type(configs[k]));
+        sim = own.get();
+        first_epoch = 0;
+     }
+     // from the branch-off point on
+     sim->keep_epochs();
+     while (reader.next(inst))
+        sim->step(&inst);
+     if constexpr (VALUE_PREDICTION)
+        endPredictor();
+     predictor_end();
+     sim->output();
+     return sum_epochs(sim->get_epoch_stats(first_epoch, UINT64_MAX));
+  };
+  return run_branch_off(run_variant, labels, modes, num_instr, batch_log_dir);
+}
+
+static int simulate_branch_off(const char * trace_name)
+{
+  if (branch_off_instr % config.EPOCH_SIZE_INSTS)
+  {
+     fprintf(stderr, "Branch-off mode (-g): the branch-off point must be a whole number of epochs (-E %lu)\n", config.EPOCH_SIZE_INSTS);
+     exit(1);
+  }
+  std::vector<sim_config_t> configs;
+  std::vector<std::string> labels;
+  load_uarch_configs(branch_off_variants, configs, labels);
+
+  if (config.BRANCH_ONLY_MODE)
+  {
+     bp_only_sim_t bp_only_sim(config);
+     return branch_off(trace_name, &bp_only_sim, configs, labels);
+  }
+  uarchsim_t sim(config);
+  return branch_off(trace_name, &sim, configs, labels);
+}
+
+// Indirect-prediction study (-O) of a branch or instruction trace: its records are only fed to ITTAGE.
+static void study_indirect(const char * trace_name)
+{
+  indirect_study_t study(config.RAS_SIZE);
+  if (branch_trace_reader_t::is_branch_trace(trace_name))
+  {
+     branch_trace_reader_t reader(trace_name);
+     branch_record_t rec;
+     while (reader.next(rec))
+        study.replay(rec);
+     study.skip(reader.trailing_instrs);
+  }
+  else
+  {
+     const std::string decoded = decoded_trace(trace_name);
+     TraceReader reader(trace_name, decoded.empty() ? nullptr : decoded.c_str(), read_values);
+     branch_extractor_t extractor;
+     branch_record_t rec;
+     db_t inst;
+     while (reader.next(inst))
+        if (extractor.push(inst.insn_class, inst.pc, inst.next_pc, inst.is_taken, inst.is_last_piece, rec))
+           study.replay(rec);
+     study.skip(extractor.pending_instrs());
+  }
+  study.output();
+}
+
+int main(int argc, char ** argv)
+{
+  // the key of an autosave (-a): the arguments as given, which parseargs cuts up
+  uint64_t arguments_key = 0xcbf29ce484222325ull;
+  for (int k = 1; k < argc; k++)
+     arguments_key = result_cache_t::hash_bytes(argv[k], strlen(argv[k]) + 1, arguments_key);
+  int i = parseargs(argc, argv);
+  read_values = (all_predictor_hooks() & CBP_HOOK_VALUES) || config.VP_ENABLE;
+
+  if ((predictor_plugins.size() > 1) && !(batch_csv || !fanout_delays.empty() || uarch_configs))
+  {
+     fprintf(stderr, "Several predictor plugins (-p) are simulated side by side, one per worker: only with -B, -N or -u\n");
+     exit(1);
+  }
+  if (!predictor_plugins.empty() && (sweep_jobs || sweep_host || daemon_socket))
+  {
+     fprintf(stderr, "Predictor plugins (-p) are loaded by this process: not with -Q, -W or -i\n");
+     exit(1);
+  }
+  if ((predictor_plugins.size() > 1) && (snapshot_save_file || snapshot_restore_file || frozen_snapshot || autosave_file))
+  {
+     fprintf(stderr, "A snapshot (-S, -s, -e, -a) is of a single predictor: not with several plugins (-p)\n");
+     exit(1);
+  }
+  if ((predictor_plugins.size() == 1) && !predictor_plugins[0]->has_snapshots() && (snapshot_save_file || snapshot_restore_file || frozen_snapshot || autosave_file))
+  {
+     fprintf(stderr, "The predictor plugin %s does not support snapshots (-S, -s, -e, -a)\n", predictor_plugins[0]->get_path().c_str());
+     exit(1);
+  }
+  if (predictor_plugins.size() == 1)
+     predictor_plugins[0]->activate();
+
+  if (lockstep_reference)
+  {
+     if (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || snapshot_restore_file || frozen_snapshot
+         || autosave_file || result_cache_dir || sweep_jobs || sweep_host || (predictor_plugins.size() > 1))
+     {
+        fprintf(stderr, "The lockstep validation (-l) follows one predictor through one simulation: not with -B, -K, -N, -u, -g, -s, -e, -a, -C, -Q, -W or several -p\n");
+        exit(1);
+     }
+     if (!lockstep_reference->has_snapshots() || ((predictor_plugins.size() == 1) && !predictor_plugins[0]->has_snapshots()))
+     {
+        fprintf(stderr, "The lockstep validation (-l) compares the snapshots of the predictors: both have to support them\n");
+        exit(1);
+     }
+     if (lockstep_reference->hooks() != predictor_hooks)
+     {
+        fprintf(stderr, "The reference predictor %s declares other hooks (0x%x) than the predictor (0x%x)\n", lockstep_reference->get_path().c_str(),
+                lockstep_reference->hooks(), predictor_hooks);
+        exit(1);
+     }
+     lockstep = new lockstep_t(*lockstep_reference, lockstep_interval);
+  }
+
+  if (!shadow_plugins.empty())
+  {
+     if (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS || snapshot_save_file
+         || snapshot_restore_file || frozen_snapshot || autosave_file || result_cache_dir || sweep_jobs || sweep_host || (predictor_plugins.size() > 1))
+     {
+        fprintf(stderr, "The shadow predictors (-o) follow one predictor through one whole simulation: not with -B, -K, -N, -u, -g, -U, -S, -s, -e, -a, -C, -Q, -W or several -p\n");
+        exit(1);
+     }
+     for (const std::unique_ptr<predictor_plugin_t>& shadow : shadow_plugins)
+        if (shadow->hooks() & ~predictor_hooks)
+        {
+           fprintf(stderr, "The shadow predictor %s declares hooks (0x%x) that the predictor does not (0x%x): the simulator would not make their calls\n",
+                   shadow->get_path().c_str(), shadow->hooks(), predictor_hooks);
+           exit(1);
+        }
+     shadow_predictors = new shadow_predictors_t(shadow_plugins);
+  }
+
+  if (frozen_snapshot && (snapshot_save_file || snapshot_restore_file || branch_off_variants || result_cache_dir || sweep_jobs || sweep_host))
+  {
+     fprintf(stderr, "Frozen evaluation (-e) runs the predictor of a snapshot on other traces: not with -S, -s, -g, -C, -Q or -W\n");
+     exit(1);
+  }
+
+  if (autosave_file && (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS
+                        || snapshot_save_file || snapshot_restore_file || frozen_snapshot || indirect_study || sweep_jobs || sweep_host))
+  {
+     fprintf(stderr, "The autosave (-a) resumes one whole simulation: not with -B, -K, -N, -u, -g, -U, -S, -s, -e, -O, -Q or -W\n");
+     exit(1);
+  }
+  if (autosave_file)
+     autosave.reset(new autosave_t(autosave_file, autosave_interval, arguments_key));
+
+  if (sweep_jobs || sweep_host)
+  {
+     if ((i < argc) || (sweep_jobs && sweep_host))
+     {
+        fprintf(stderr, "A sweep coordinator (-Q) or worker (-W) takes no trace: the traces are in the jobs file\n");
+        exit(1);
+     }
+     if ((interval_slices && (sweep_host || interval_simpoints)) || interval_single_slice)
+     {
+        fprintf(stderr, "A sweep coordinator (-Q) cuts its jobs into slices with -K <slices>,<warmup_instrs>[,ref]: not simpoints or slice, nor on a worker (-W)\n");
+        exit(1);
+     }
+     if (sweep_jobs)
+     {
+        cost_model_t model;
+        if (cost_model_path)
+           model.load(cost_model_path, cost_model_seed);
+        const sweep_slicing_t slicing = {interval_slices, interval_warmup, interval_reference, config};
+        return run_sweep_coordinator(sweep_port, sweep_jobs, sweep_stats, cost_model_path ? &model : nullptr, interval_slices ? &slicing : nullptr) ? 1 : 0;
+     }
+     return run_sweep_worker(sweep_host, sweep_port, batch_jobs, batch_log_dir) ? 1 : 0;
+  }
+  if (daemon_socket)
+  {
+     if ((i < argc) || sweep_jobs || sweep_host)
+     {
+        fprintf(stderr, "The simulation daemon (-i) takes no trace: the traces are in its jobs\n");
+        exit(1);
+     }
+     return run_daemon(daemon_socket, daemon_dir, batch_jobs);
+  }
+
+  if (config.SAMPLE_UNIT_INSTS && (batch_csv || interval_slices || !fanout_delays.empty() || snapshot_save_file || snapshot_restore_file
+                                    || config.BRANCH_ONLY_MODE || branch_trace_reader_t::is_branch_trace(argv[i])))
+  {
+     fprintf(stderr, "Sampled simulation (-U) only runs alone, on an instruction trace and with the timing model\n");
+     exit(1);
+  }
+
+  if (BRANCH_PROFILE_CSV && (batch_csv || interval_slices || !fanout_delays.empty()))
+  {
+     fprintf(stderr, "The branch profile (-H) is of a single simulation: not with -B, -K or -N\n");
+     exit(1);
+  }
+
+  if (EVENT_TRACE_FILE && (EVENT_TRACE_MASK == 0))
+  {
+     fprintf(stderr, "The event trace (-V) needs a build with event types: make clean && make EVENT_TRACE=<mask>\n");
+     exit(1);
+  }
+
+  if (EVENT_TRACE_FILE && (batch_csv || interval_slices || !fanout_delays.empty()))
+  {
+     fprintf(stderr, "The event trace (-V) is of a single simulation: not with -B, -K or -N\n");
+     exit(1);
+  }
+
+  if (BRANCH_DATASET_FILE && ((BRANCH_DATASET_HISTORY_BITS == 0) || (BRANCH_DATASET_HISTORY_BITS > branch_dataset_t::MAX_HISTORY_BITS)))
+  {
+     fprintf(stderr, "The branch dataset (-x) keeps 1 to %u bits of history\n", branch_dataset_t::MAX_HISTORY_BITS);
+     exit(1);
+  }
+
+  if (BRANCH_DATASET_FILE && (batch_csv || interval_slices || !fanout_delays.empty()))
+  {
+     fprintf(stderr, "The branch dataset (-x) is of a single simulation: not with -B, -K or -N\n");
+     exit(1);
+  }
+
+  // CBP_TABLE_HEATMAP=<heatmap.csv>[,<one_in_n>[,<regions>]]
+  if (const char * env = getenv("CBP_TABLE_HEATMAP"))
+  {
+     static std::string heatmap_file;
+     heatmap_file = env;
+     const size_t comma = heatmap_file.find(',');
+     if (comma != std::string::npos)
+     {
+        if (sscanf(env + comma + 1, "%lu,%lu", &TABLE_HEATMAP_ONE_IN_N, &TABLE_HEATMAP_REGIONS) < 1)
+        {
+           fprintf(stderr, "CBP_TABLE_HEATMAP is <heatmap.csv>[,<one_in_n>[,<regions>]], not %s\n", env);
+           exit(1);
+        }
+        heatmap_file.resize(comma);
+     }
+     TABLE_HEATMAP_FILE = heatmap_file.c_str();
+     if (batch_csv || interval_slices || !fanout_delays.empty())
+     {
+        fprintf(stderr, "The table heatmaps (CBP_TABLE_HEATMAP) are of a single simulation: not with -B, -K or -N\n");
+        exit(1);
+     }
+  }
+
+  if (stats_json && (config.SAMPLE_UNIT_INSTS || interval_slices || !fanout_delays.empty()))
+  {
+     fprintf(stderr, "The stats record (-J) is of whole runs: not with -U, -K or -N\n");
+     exit(1);
+  }
+
+  if (progress_stream.enabled() && (interval_slices || !fanout_delays.empty()))
+  {
+     fprintf(stderr, "The progress stream (-Y) follows one whole simulation per trace: not with -K or -N\n");
+     exit(1);
+  }
+
+  if (time_series.enabled() && (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS
+                                || indirect_study || sweep_jobs || sweep_host))
+  {
+     fprintf(stderr, "The time series (-q) follows one whole simulation per trace, in this process: not with -B, -K, -N, -u, -g, -U, -O, -Q or -W\n");
+     exit(1);
+  }
+
+  const uint64_t sampled_cache_sets = std::min(config.L2_SIZE / (config.L2_ASSOC * config.L2_BLOCKSIZE), config.L3_SIZE / (config.L3_ASSOC * config.L3_BLOCKSIZE));
+  if ((config.CACHE_SET_SAMPLING == 0) || (config.CACHE_SET_SAMPLING & (config.CACHE_SET_SAMPLING - 1)) || (config.CACHE_SET_SAMPLING > sampled_cache_sets))
+  {
+     fprintf(stderr, "The set sampling (-m) is a power of two, at most the %lu sets of the smaller of the L2$ and L3$\n", sampled_cache_sets);
+     exit(1);
+  }
+
+  if (activity_recorder.enabled() && (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS
+                                      || indirect_study || sweep_jobs || sweep_host))
+  {
+     fprintf(stderr, "The activity trace (-y) is of one timing simulation, in this process: not with -B, -K, -N, -u, -g, -U, -O, -Q or -W\n");
+     exit(1);
+  }
+
+  if (result_cache_dir && (!batch_csv || stats_json || snapshot_save_file || snapshot_restore_file))
+  {
+     fprintf(stderr, "The result cache (-C) only keeps batch (-B) results: not without -B, nor with -J, -S or -s\n");
+     exit(1);
+  }
+
+  if (indirect_study && (batch_csv || interval_slices || !fanout_delays.empty() || config.SAMPLE_UNIT_INSTS || snapshot_save_file
+                         || snapshot_restore_file || stats_json || BRANCH_PROFILE_CSV || EVENT_TRACE_FILE || BRANCH_DATASET_FILE))
+  {
+     fprintf(stderr, "The indirect-prediction study (-O) only runs alone: not with -B, -K, -N, -U, -S, -s, -J, -H, -V or -x\n");
+     exit(1);
+  }
+  if (predictor_thread_lag && (interval_slices || !fanout_delays.empty() || (all_predictor_hooks() & CBP_HOOK_BATCH)))
+  {
+     fprintf(stderr, "The predictor thread (-t) serves one simulation and the per-event hooks: not with -K, -N or notify_batch\n");
+     exit(1);
+  }
+
+  if (config.ANALYTIC_MODE && (config.BRANCH_ONLY_MODE || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS
+                               || config.EARLY_STOP_EPOCHS || step_batch_uops || activity_recorder.enabled() || indirect_study
+                               || branch_trace_reader_t::is_branch_trace(argv[i])))
+  {
+     fprintf(stderr, "The analytic timing model (-n) replaces uarchsim_t on an instruction trace: not with -X, -N, -u, -g, -U, -c, -k, -y or -O\n");
+     exit(1);
+  }
+
+  if (config.EARLY_STOP_EPOCHS && (interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS || config.BRANCH_ONLY_MODE))
+  {
+     fprintf(stderr, "Early termination (-c) is for the timing run of uarchsim_t: not with -K, -N, -u, -g, -U or -X\n");
+     exit(1);
+  }
+  if (step_batch_uops && (interval_slices || !fanout_delays.empty() || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS || config.BRANCH_ONLY_MODE))
+  {
+     fprintf(stderr, "Batched stepping (-k) is for the timing run of uarchsim_t: not with -K, -N, -u, -g, -U or -X\n");
+     exit(1);
+  }
+
+  if (uarch_configs && (batch_csv || interval_slices || !fanout_delays.empty() || config.SAMPLE_UNIT_INSTS || config.BRANCH_ONLY_MODE
+                        || snapshot_save_file || snapshot_restore_file || stats_json || BRANCH_PROFILE_CSV || EVENT_TRACE_FILE || BRANCH_DATASET_FILE
+                        || progress_stream.enabled() || predictor_thread_lag || indirect_study || branch_trace_reader_t::is_branch_trace(argv[i])))
+  {
+     fprintf(stderr, "The microarchitecture fan-out (-u) only runs alone, on an instruction trace: not with -B, -K, -N, -U, -X, -S, -s, -J, -H, -V, -x, -Y, -t or -O\n");
+     exit(1);
+  }
+
+  if (branch_off_variants && (batch_csv || interval_slices || !fanout_delays.empty() || uarch_configs || config.SAMPLE_UNIT_INSTS
+                              || snapshot_save_file || snapshot_restore_file || stats_json || BRANCH_PROFILE_CSV || EVENT_TRACE_FILE || BRANCH_DATASET_FILE
+                              || progress_stream.enabled() || predictor_thread_lag || indirect_study || branch_trace_reader_t::is_branch_trace(argv[i])))
+  {
+     fprintf(stderr, "The branch-off mode (-g) only runs alone, on an instruction trace: not with -B, -K, -N, -u, -U, -S, -s, -J, -H, -V, -x, -Y, -t or -O\n");
+     exit(1);
+  }
+
+  if ((branch_outcomes.recording() || branch_outcomes.replaying())
+      && (batch_csv || interval_slices || !fanout_delays.empty() || branch_off_variants || config.SAMPLE_UNIT_INSTS || config.BRANCH_ONLY_MODE
+          || config.EARLY_STOP_EPOCHS || snapshot_save_file || snapshot_restore_file || frozen_snapshot || autosave_file || !predictor_plugins.empty()
+          || lockstep_reference || !shadow_plugins.empty() || predictor_thread_lag || indirect_study || branch_trace_reader_t::is_branch_trace(argv[i])))
+  {
+     fprintf(stderr, "Recorded outcomes (-z) are of one whole timing simulation of the linked predictor: not with -B, -K, -N, -g, -U, -X, -c, -S, -s, -e, -a, -p, -l, -o, -t or -O\n");
+     exit(1);
+  }
+  if (branch_outcomes.recording() && uarch_configs)
+  {
+     fprintf(stderr, "Recording outcomes (-z record) is of one timing simulation: not with -u\n");
+     exit(1);
+  }
+  if (branch_outcomes.sample_instrs() && (uarch_configs || (branch_outcomes.sample_instrs() % config.EPOCH_SIZE_INSTS)))
+  {
+     fprintf(stderr, "The replay sample (-z replay,<outcomes.bin>,<sample_instrs>) is whole epochs (-E) of a single simulation: not with -u\n");
+     exit(1);
+  }
+  // A replay makes none of the predictor's calls.
+  if (branch_outcomes.replaying())
+  {
+     predictor_hooks = 0;
+     printf("APPROXIMATE: predictor outcomes replayed (-z replay), the predictor is not simulated\n");
+  }
+
+  if (indirect_study)
+  {
+     study_indirect(argv[i]);
+     return 0;
+  }
+
+  if (frozen_snapshot)
+     load_frozen_predictor(frozen_snapshot);
+
+  // Without a summary of the trace (convert_trace -s), a sampled run too short for a unit only tells at the end.
+  trace_summary_t summary;
+  if (config.SAMPLE_UNIT_INSTS && summary.load(argv[i]))
+  {
+     if (summary.num_instrs < (config.SAMPLE_PHASES ? 2 : 1) * config.SAMPLE_PERIOD_INSTS)
+     {
+        fprintf(stderr, "Sampled simulation (-U): %s has %lu instructions, less than %s\n", argv[i], summary.num_instrs,
+                config.SAMPLE_PHASES ? "two intervals" : "one sampling period");
+        exit(1);
+     }
+     if (config.SAMPLE_PHASES)
+        printf("Detecting phases over %lu intervals from %lu instructions\n", (summary.num_instrs + config.SAMPLE_PERIOD_INSTS - 1)/config.SAMPLE_PERIOD_INSTS, summary.num_instrs);
+     else
+        printf("Sampling %lu units from %lu instructions\n", summary.num_instrs/config.SAMPLE_PERIOD_INSTS, summary.num_instrs);
+  }
+
+  // one slice of a distributed sweep (-Q with -K)
+  if (interval_single_slice)
+  {
+     if (batch_csv || branch_trace_reader_t::is_branch_trace(argv[i]) || snapshot_save_file || snapshot_restore_file || autosave_file || !fanout_delays.empty()
+         || uarch_configs || branch_off_variants || config.SAMPLE_UNIT_INSTS || lockstep_reference || !shadow_plugins.empty())
+     {
+        fprintf(stderr, "A slice (-K slice,...) is simulated alone, on an instruction trace: not with -B, -N, -u, -g, -U, -S, -s, -a, -l or -o\n");
+        exit(1);
+     }
+     // the state at the first instruction of the slice, if a run of the whole trace published it
+     if (slice_begin && getenv("CBP_SNAPSHOT_CATALOG"))
+     {
+        const snapshot_catalog_t catalog(getenv("CBP_SNAPSHOT_CATALOG"));
+        const std::string path = "/tmp/cbp-slice-" + std::to_string(getpid()) + ".snap";
+        if (catalog.fetch(snapshot_catalog_key_of(argv[i], slice_begin), path.c_str()))
+        {
+           printf("Fetched the snapshot at instruction %lu from the catalog %s\n", slice_begin, catalog.get_dir().c_str());
+           slice_snapshot_file = path;
+        }
+     }
+     // a restored slice is warmed up from the start of the trace
+     const int status = run_slice(argv[i], config, slice_snapshot_file.empty() ? slice_warmup_begin : 0, slice_begin, slice_end, stats_json,
+                                  simulate_trace_slice);
+     if (!slice_snapshot_file.empty())
+        unlink(slice_snapshot_file.c_str());
+     return status;
+  }
+
+  if (batch_csv)
+  {
+     const std::vector<const char *> traces(argv + i, argv + argc);
+     cost_model_t model;
+     if (cost_model_path)
+        model.load(cost_model_path, cost_model_seed);
+     cost_model_t * cost_model = cost_model_path ? &model : nullptr;
+     // tail slicing: -K cuts the last traces of the batch into slices
+     if (interval_slices)
+     {
+        if (interval_simpoints || interval_reference || result_cache_dir)
+        {
+           fprintf(stderr, "With -B, -K <slices>,<warmup_instrs> cuts the tail of the batch into slices: not simpoints, ref or -C\n");
+           exit(1);
+        }
+        const batch_slicing_t slicing = {interval_slices, interval_warmup, config, simulate_trace_slice};
+        return run_batch(traces, batch_csv, batch_jobs, batch_workers_per_llc, batch_log_dir, simulate_trace, nullptr, side_by_side_plugins(), &slicing, cost_model) ? 1 : 0;
+     }
+     if (!result_cache_dir)
+        return run_batch(traces, batch_csv, batch_jobs, batch_workers_per_llc, batch_log_dir, simulate_trace, nullptr, side_by_side_plugins(), nullptr, cost_model) ? 1 : 0;
+     // As for snapshots, -T does not affect the results.
+     sim_config_t key_config;
+     memcpy(&key_config, &config, sizeof(config));
+     key_config.PIPELINED_TRACE_READ = false;
+     const result_cache_t cache(result_cache_dir, result_cache_t::hash_bytes(&key_config, sizeof(key_config)));
+     return run_batch(traces, batch_csv, batch_jobs, batch_workers_per_llc, batch_log_dir, simulate_trace, &cache, side_by_side_plugins(), nullptr, cost_model) ? 1 : 0;
+  }
+
+  // Any argument after trace filename is ignored.
+  if (interval_slices)
+  {
+     if (branch_trace_reader_t::is_branch_trace(argv[i]) || snapshot_save_file || snapshot_restore_file || !fanout_delays.empty())
+     {
+        fprintf(stderr, "Interval simulation needs an instruction trace, and no snapshots or fan-out: %s\n", argv[i]);
+        exit(1);
+     }
+     if (interval_simpoints)
+     {
+        simpoint_profile_t profile;
+        if (!profile.load(argv[i]))
+        {
+           fprintf(stderr, "SimPoint simulation needs the simulation points of %s: run convert_trace -p %s first\n", argv[i], argv[i]);
+           exit(1);
+        }
+        return run_simpoints(argv[i], config, profile, interval_warmup, interval_reference, batch_log_dir, simulate_trace_slice) ? 1 : 0;
+     }
+     return run_intervals(argv[i], config, interval_slices, interval_warmup, interval_reference, batch_log_dir, simulate_trace_slice) ? 1 : 0;
+  }
+  if (!fanout_delays.empty())
+     return simulate_fanout(argv[i]) ? 1 : 0;
+  if (uarch_configs)
+     return simulate_uarch_fanout(argv[i]) ? 1 : 0;
+  if (branch_off_variants)
+     return simulate_branch_off(argv[i]) ? 1 : 0;
+  if (snapshot_save_file && !snapshot_restore_file && getenv("CBP_SNAPSHOT_CATALOG"))
+  {
+     snapshot_catalog_key = snapshot_catalog_key_of(argv[i], snapshot_save_instr);
+     snapshot_catalog.reset(new snapshot_catalog_t(getenv("CBP_SNAPSHOT_CATALOG")));
+     snapshot_catalog_trace = argv[i];
+  }
+  simulate_trace(argv[i]);
 }
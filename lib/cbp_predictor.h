@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "cbp.h"
+#include "predictor_thread.h"
+
+// The predictor of the timing model as a type: basic_uarchsim_t<P> and basic_bp_t<P> call the static member functions
+// of P where they would call the hooks of cbp.h, so that a P whose functions are visible where the model is
+// instantiated has its prediction and history update inlined into step().
+//
+// P has the hooks of cbp.h as static member functions, with the same names and arguments, and hooks(), the mask of
+// CBP_HOOK_* bits of the notifications it consumes:
+//
+//     struct my_predictor_t
+//     {
+//         static uint32_t hooks() { return CBP_HOOK_EXECUTE; }
+//         static bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle);
+//         static void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc);
+//         static void notify_static_id(...);          // and the other notify_* hooks, notify_batch included
+//     };
+//
+// uarchsim_t and bp_t are the instantiations over cbp_hooks_t, compiled into libcbp.a, which is what cbp runs. A driver
+// of its own instantiates the model over another P by including uarchsim_impl.h (tools/inline_sim.cc).
+
+template <class P, class = void>
+struct is_cbp_predictor : std::false_type {};
+
+template <class P>
+struct is_cbp_predictor<P, std::void_t<
+    decltype(uint32_t(P::hooks())),
+    decltype(bool(P::get_cond_dir_prediction(uint64_t(), uint8_t(), uint64_t(), uint64_t()))),
+    decltype(P::spec_update(uint64_t(), uint8_t(), uint64_t(), InstClass(), bool(), bool(), uint64_t())),
+    decltype(P::notify_static_id(uint64_t(), uint8_t(), uint64_t(), uint32_t())),
+    decltype(P::notify_instr_fetch(uint64_t(), uint8_t(), uint64_t(), uint64_t())),
+    decltype(P::notify_instr_decode(uint64_t(), uint8_t(), uint64_t(), std::declval<const DecodeInfo&>(), uint64_t())),
+    decltype(P::notify_agen_complete(uint64_t(), uint8_t(), uint64_t(), std::declval<const DecodeInfo&>(), uint64_t(), uint64_t(), uint64_t())),
+    decltype(P::notify_instr_execute_resolve(uint64_t(), uint8_t(), uint64_t(), bool(), std::declval<const ExecuteInfo&>(), uint64_t())),
+    decltype(P::notify_instr_commit(uint64_t(), uint8_t(), uint64_t(), bool(), std::declval<const ExecuteInfo&>(), uint64_t())),
+    decltype(P::notify_batch(std::declval<const cbp_batch_t&>()))>> : std::true_type {};
+
+// The hooks of cbp.h as cbp calls them: through the predictor thread (-t) if any, to the active plugin (-p) if any,
+// with the lockstep reference (-l) and the shadow predictors (-o) following (predictor_thread.h, plugin.h).
+struct cbp_hooks_t
+{
+    static uint32_t hooks() { return predictor_hooks; }
+
+    static bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+    {
+        return call_cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+    }
+
+    static void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+    {
+        call_spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    }
+
+    static void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+    {
+        call_static_id(seq_no, piece, pc, static_id);
+    }
+
+    static void notify_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+    {
+        call_instr_fetch(seq_no, piece, pc, cycle);
+    }
+
+    static void notify_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+    {
+        call_instr_decode(seq_no, piece, pc, dec_info, cycle);
+    }
+
+    static void notify_agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+    {
+        call_agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    }
+
+    static void notify_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        call_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+
+    static void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        call_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+
+    static void notify_batch(const cbp_batch_t& batch)
+    {
+        predictor_batch(batch);
+    }
+};
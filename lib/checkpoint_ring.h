@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "snapshot.h"
+#include "footprint.h"
+
+// Fixed-capacity table of prediction-time checkpoints, directly indexed by the dynamic sequence number.
+//
+// Every micro-op gets its own seq_no, and checkpoints are released when the branch executes, i.e. before it leaves
+// the window. Live checkpoints therefore span fewer than WINDOW_SIZE consecutive sequence numbers, and with a
+// power-of-two capacity of at least that size, slot (seq_no & mask) is never shared by two live entries.
+// The capacity is doubled on the (cold) path where that does not hold, e.g. when a larger window is configured,
+// so steady-state operation neither hashes nor allocates. A slot held by a checkpoint older than the oldest micro-op
+// in flight (checkpoint_oldest_inflight) is a straggler, whose update the predictor missed: it is reclaimed, and
+// counted, rather than grown around, so the capacity stays bounded by the window whatever the predictor leaks.
+// The checkpoints in flight and the storage are counted in checkpoint_footprint.
+template <class T>
+class checkpoint_ring_t
+{
+    private:
+        struct slot_t
+        {
+            uint64_t seq_no = UINT64_MAX;   // UINT64_MAX: free slot
+            uint8_t piece = UINT8_MAX;
+            T val;
+        };
+
+        std::vector<slot_t> slots;
+        uint64_t mask;
+
+        void grow()
+        {
+            std::vector<slot_t> old_slots;
+            old_slots.swap(slots);
+            checkpoint_footprint.bytes -= old_slots.size() * sizeof(slot_t);
+            uint64_t new_size = old_slots.size();
+            bool collision = true;
+            while (collision)
+            {
+                new_size *= 2;
+                slots.clear();
+                slots.resize(new_size);
+                mask = new_size - 1;
+                collision = false;
+                for (auto& s : old_slots)
+                {
+                    if ((s.seq_no == UINT64_MAX) || is_straggler(s))
+                        continue;
+                    slot_t& dst = slots[s.seq_no & mask];
+                    if (dst.seq_no != UINT64_MAX)
+                    {
+                        collision = true;
+                        break;
+                    }
+                    dst.seq_no = s.seq_no;
+                    dst.piece = s.piece;
+                    dst.val = s.val;
+                }
+            }
+            checkpoint_footprint.bytes += slots.size() * sizeof(slot_t);
+            for (auto& s : old_slots)
+                if ((s.seq_no != UINT64_MAX) && is_straggler(s))
+                    reclaim(s);
+        }
+
+        static bool is_straggler(const slot_t& s)
+        {
+            return s.seq_no < checkpoint_oldest_inflight;
+        }
+
+        static void reclaim(slot_t& s)
+        {
+            s.seq_no = UINT64_MAX;
+            s.piece = UINT8_MAX;
+            checkpoint_footprint.live--;
+            checkpoint_footprint.stragglers++;
+        }
+
+        // The checks below stay on in release builds: a lookup that lands on another checkpoint's slot would
+        // otherwise hand the predictor someone else's history and quietly skew the results.
+        [[noreturn]] __attribute__((cold, noinline))
+        static void fail(const char *what, uint64_t seq_no, uint8_t piece, const slot_t& s)
+        {
+            fprintf(stderr, "checkpoint_ring_t: checkpoint of seq_no %" PRIu64 " piece %u %s (slot holds seq_no %"
+                    PRIu64 " piece %u)\n", seq_no, piece, what, s.seq_no, s.piece);
+            abort();
+        }
+
+        void check(const slot_t& s, uint64_t seq_no, uint8_t piece) const
+        {
+            if (__builtin_expect((s.seq_no != seq_no) || (s.piece != piece), 0))
+                fail("not found", seq_no, piece, s);
+        }
+
+    public:
+        checkpoint_ring_t(uint64_t capacity = 1024)
+        {
+            uint64_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            slots.resize(size);
+            mask = size - 1;
+            checkpoint_footprint.bytes += slots.size() * sizeof(slot_t);
+        }
+
+        ~checkpoint_ring_t()
+        {
+            checkpoint_footprint.bytes -= slots.size() * sizeof(slot_t);
+            for (const slot_t& s : slots)
+                checkpoint_footprint.live -= (s.seq_no != UINT64_MAX);
+        }
+
+        checkpoint_ring_t(const checkpoint_ring_t&) = delete;
+        checkpoint_ring_t& operator=(const checkpoint_ring_t&) = delete;
+
+        // Claims the slot for (seq_no, piece) and returns it for the caller to fill.
+        T& emplace(uint64_t seq_no, uint8_t piece)
+        {
+            while (slots[seq_no & mask].seq_no != UINT64_MAX)
+            {
+                if (__builtin_expect(slots[seq_no & mask].seq_no == seq_no, 0))
+                    fail("already present", seq_no, piece, slots[seq_no & mask]);
+                if (is_straggler(slots[seq_no & mask]))
+                    reclaim(slots[seq_no & mask]);
+                else
+                    grow();
+            }
+            slot_t& s = slots[seq_no & mask];
+            s.seq_no = seq_no;
+            s.piece = piece;
+            checkpoint_footprint.live++;
+            return s.val;
+        }
+
+        T& at(uint64_t seq_no, uint8_t piece)
+        {
+            slot_t& s = slots[seq_no & mask];
+            check(s, seq_no, piece);
+            return s.val;
+        }
+
+        const T& at(uint64_t seq_no, uint8_t piece) const
+        {
+            const slot_t& s = slots[seq_no & mask];
+            check(s, seq_no, piece);
+            return s.val;
+        }
+
+        bool contains(uint64_t seq_no, uint8_t piece) const
+        {
+            const slot_t& s = slots[seq_no & mask];
+            return s.seq_no == seq_no && s.piece == piece;
+        }
+
+        void erase(uint64_t seq_no, uint8_t piece)
+        {
+            slot_t& s = slots[seq_no & mask];
+            check(s, seq_no, piece);
+            s.seq_no = UINT64_MAX;
+            s.piece = UINT8_MAX;
+            checkpoint_footprint.live--;
+        }
+
+        // Frees all the slots, e.g. for checkpoints restored from a snapshot of another run.
+        void clear()
+        {
+            for (slot_t& s : slots)
+                if (s.seq_no != UINT64_MAX)
+                {
+                    s.seq_no = UINT64_MAX;
+                    s.piece = UINT8_MAX;
+                    checkpoint_footprint.live--;
+                }
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            checkpoint_footprint.bytes -= slots.size() * sizeof(slot_t);
+            for (const slot_t& slot : slots)
+                checkpoint_footprint.live -= (slot.seq_no != UINT64_MAX);
+            s.io(slots);
+            s.io(mask);
+            checkpoint_footprint.bytes += slots.size() * sizeof(slot_t);
+            for (const slot_t& slot : slots)
+                checkpoint_footprint.live += (slot.seq_no != UINT64_MAX);
+        }
+
+        uint64_t capacity() const
+        {
+            return slots.size();
+        }
+};
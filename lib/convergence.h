@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include "parameters.h"
+#include "snapshot.h"
+
+// Early termination (-c): the run stops once its conditional MPKI has converged. The epochs after the first
+// EARLY_STOP_WARMUP_EPOCHS are the samples, and the mean of their MPKIs the estimate, with the half-width of its 95%
+// confidence interval under the normal approximation, as for sampled runs (-U). After each epoch, the estimate counts
+// as converged if the half-width is at most EARLY_STOP_REL_ERROR of the mean, and with EARLY_STOP_IPC that of the
+// epoch CPIs too (CPI rather than IPC is averaged, the epochs all having the same instructions). The run stops after
+// EARLY_STOP_EPOCHS converged epochs in a row.
+class convergence_t
+{
+    private:
+        const sim_config_t& cfg;
+
+        struct estimate_t
+        {
+            double sum = 0.0;
+            double sum_sq = 0.0;
+
+            void add(double v)
+            {
+                sum += v;
+                sum_sq += v * v;
+            }
+
+            double mean(uint64_t n) const
+            {
+                return sum / (double)n;
+            }
+
+            // Half-width of the 95% confidence interval relative to the mean, 0 if both are 0.
+            double rel_half_width(uint64_t n) const
+            {
+                const double m = mean(n);
+                const double variance = std::fmax(0.0, (sum_sq - (double)n * m * m) / (double)(n - 1));
+                const double half_width = 1.96 * std::sqrt(variance / (double)n);
+                return (m != 0.0) ? (half_width / m) : ((half_width == 0.0) ? 0.0 : INFINITY);
+            }
+        };
+
+        uint64_t num_epochs = 0;        // epochs ended, warmup included
+        uint64_t num_samples = 0;
+        estimate_t mpki;
+        estimate_t cpi;
+        uint64_t streak = 0;            // converged epochs in a row
+        uint64_t stop_inst = 0;         // instructions when the run converged, 0 before
+
+    public:
+        explicit convergence_t(const sim_config_t& _cfg)
+        : cfg(_cfg)
+        {
+        }
+
+        void reset()
+        {
+            num_epochs = 0;
+            num_samples = 0;
+            mpki = estimate_t();
+            cpi = estimate_t();
+            streak = 0;
+            stop_inst = 0;
+        }
+
+        bool enabled() const
+        {
+            return cfg.EARLY_STOP_EPOCHS > 0;
+        }
+
+        // Whether the run has converged and is to stop.
+        bool converged() const
+        {
+            return stop_inst != 0;
+        }
+
+        // Takes in an epoch of insts instructions, cycles cycles and conddir_m conditional mispredictions, the
+        // instructions of the run num_inst at its end.
+        void epoch(uint64_t insts, uint64_t cycles, uint64_t conddir_m, uint64_t num_inst)
+        {
+            if (!enabled() || converged() || (insts == 0) || (++num_epochs <= cfg.EARLY_STOP_WARMUP_EPOCHS))
+                return;
+            num_samples++;
+            mpki.add(1000.0 * (double)conddir_m / (double)insts);
+            cpi.add((double)cycles / (double)insts);
+            const bool within = (num_samples > 1) && (mpki.rel_half_width(num_samples) <= cfg.EARLY_STOP_REL_ERROR)
+                                && (!cfg.EARLY_STOP_IPC || (cpi.rel_half_width(num_samples) <= cfg.EARLY_STOP_REL_ERROR));
+            streak = within ? (streak + 1) : 0;
+            if (streak == cfg.EARLY_STOP_EPOCHS)
+                stop_inst = num_inst;
+        }
+
+        void output() const
+        {
+            if (!enabled())
+                return;
+            printf("\n-------------------------------------------EARLY TERMINATION (Epochs After The Warmup Epochs)------------------------------------------\n");
+            if (converged())
+                printf("TRUNCATED RUN: stopped at instruction %lu, the estimates within %.2f%% for %lu epochs in a row\n", stop_inst,
+                       100.0 * cfg.EARLY_STOP_REL_ERROR, cfg.EARLY_STOP_EPOCHS);
+            else
+                printf("Not converged to %.2f%% for %lu epochs in a row: the whole trace was simulated\n", 100.0 * cfg.EARLY_STOP_REL_ERROR,
+                       cfg.EARLY_STOP_EPOCHS);
+            printf("epochs       = %lu (%lu of warmup)\n", num_samples, num_epochs - num_samples);
+            if (num_samples > 1)
+            {
+                printf("CondMPKI     = %.4f +- %.2f%% (95%% confidence)\n", mpki.mean(num_samples), 100.0 * mpki.rel_half_width(num_samples));
+                printf("IPC          = %.4f +- %.2f%% (1/CPI, 95%% confidence)\n", 1.0 / cpi.mean(num_samples), 100.0 * cpi.rel_half_width(num_samples));
+            }
+            printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+        }
+
+        uint64_t get_stop_inst() const
+        {
+            return stop_inst;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.io(num_epochs);
+            s.io(num_samples);
+            s.io(mpki);
+            s.io(cpi);
+            s.io(streak);
+            s.io(stop_inst);
+        }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Per-trace cost model of the batch (-B) and sweep (-Q) drivers (-v <model.csv>[,<seed.csv>]): the expected run time
+// of each trace, to lease the longest runs first, to pick the runs to slice (-K) and to estimate when the whole set
+// will be done.
+//
+// The model is a csv of Workload,Run,TraceSize,Instr,ExecTime,Runs rows, keyed by <workload>/<run> as the batch names
+// its runs, and loaded from any csv with those columns (Runs optional): a missing model is seeded from seed.csv, e.g.
+// reference_results_training_set.csv or the results of an earlier -B. A trace it does not know is estimated from its
+// uops (trace summary, convert_trace -s) or else its size, at the average rate of the traces it knows.
+//
+// Times differ between hosts and options (-X runs in a fraction of the time of a timing run), so the model holds
+// relative costs, in the seconds of the runs it was seeded from, and the drivers calibrate them to the current set:
+// calibrated() scales a cost by the observed over the estimated time of the runs completed so far. Each completed run
+// moves its entry halfway to its observed time brought back to the model's scale, and the model is saved after each.
+// Cached, sliced and early-stopped (-c) runs of the batch do not update it.
+class cost_model_t
+{
+    private:
+        // The reference results (reference_results_training_set.csv), for a model that knows no trace yet.
+        static constexpr double DEFAULT_SECONDS_PER_INSTR = 10.4e-6;
+        static constexpr double DEFAULT_SECONDS_PER_MB = 3.14;
+
+        struct entry_t
+        {
+            double size_mb = 0.0;
+            uint64_t instr = 0;
+            double seconds = 0.0;
+            uint64_t runs = 0;
+        };
+
+        std::string path;
+        std::map<std::string, entry_t> entries;    // by <workload>/<run>
+        double sum_instr_seconds = 0.0, sum_size_seconds = 0.0;
+        double sum_instr = 0.0, sum_size_mb = 0.0;
+        double observed = 0.0, estimated = 0.0;    // of the runs completed by this process
+
+        void update_rates()
+        {
+            sum_instr_seconds = sum_size_seconds = sum_instr = sum_size_mb = 0.0;
+            for (const auto& e : entries)
+            {
+                if (e.second.instr)
+                {
+                    sum_instr_seconds += e.second.seconds;
+                    sum_instr += (double)e.second.instr;
+                }
+                if (e.second.size_mb > 0.0)
+                {
+                    sum_size_seconds += e.second.seconds;
+                    sum_size_mb += e.second.size_mb;
+                }
+            }
+        }
+
+        bool read_csv(const char * csv_path)
+        {
+            FILE * f = fopen(csv_path, "r");
+            if (!f)
+                return false;
+            char buf[4096];
+            int workload = -1, run = -1, size = -1, instr = -1, exec_time = -1, runs = -1;
+            if (fgets(buf, sizeof(buf), f))
+            {
+                std::istringstream header(buf);
+                std::string column;
+                for (int k = 0; std::getline(header, column, ','); k++)
+                {
+                    column.erase(column.find_last_not_of(" \r\n") + 1);
+                    workload = (column == "Workload") ? k : workload;
+                    run = (column == "Run") ? k : run;
+                    size = (column == "TraceSize") ? k : size;
+                    instr = (column == "Instr") ? k : instr;
+                    exec_time = (column == "ExecTime") ? k : exec_time;
+                    runs = (column == "Runs") ? k : runs;
+                }
+            }
+            if ((workload < 0) || (run < 0) || (size < 0) || (instr < 0) || (exec_time < 0))
+            {
+                fclose(f);
+                fprintf(stderr, "%s is not a cost model: it needs the Workload, Run, TraceSize, Instr and ExecTime columns\n", csv_path);
+                exit(1);
+            }
+            while (fgets(buf, sizeof(buf), f))
+            {
+                std::vector<std::string> fields;
+                std::istringstream line(buf);
+                std::string field;
+                while (std::getline(line, field, ','))
+                    fields.push_back(field);
+                if ((int)fields.size() <= std::max({workload, run, size, instr, exec_time, runs}))
+                    continue;
+                entry_t e;
+                e.size_mb = atof(fields[size].c_str());
+                e.instr = strtoull(fields[instr].c_str(), nullptr, 10);
+                e.seconds = atof(fields[exec_time].c_str());
+                e.runs = (runs >= 0) ? strtoull(fields[runs].c_str(), nullptr, 10) : 1;
+                // failed runs have no time worth learning from
+                if (e.seconds > 0.0)
+                    entries[fields[workload] + "/" + fields[run]] = e;
+            }
+            fclose(f);
+            return true;
+        }
+
+    public:
+        // Loads the model at model_path, or seeds it from seed_path if it does not exist yet. Exits if neither can
+        // be read, or if either is not a cost model.
+        void load(const char * model_path, const char * seed_path)
+        {
+            path = model_path;
+            if (!read_csv(model_path) && !(seed_path && read_csv(seed_path)))
+            {
+                if (seed_path)
+                {
+                    fprintf(stderr, "Cannot read the cost model %s, nor its seed %s\n", model_path, seed_path);
+                    exit(1);
+                }
+                printf("New cost model %s\n", model_path);
+            }
+            else
+                printf("Cost model of %lu traces from %s\n", entries.size(), (access(model_path, R_OK) == 0) ? model_path : seed_path);
+            update_rates();
+        }
+
+        // Expected run time of the run of workload, in the model's seconds: that of the run, or of the same trace with
+        // another predictor plugin (<run>@<label>), or else estimated from instr (0 if unknown) or the trace size.
+        double estimate(const std::string& workload, const std::string& run, double size_mb, uint64_t instr) const
+        {
+            auto it = entries.find(workload + "/" + run);
+            if (it == entries.end())
+                it = entries.find(workload + "/" + run.substr(0, run.find('@')));
+            if (it != entries.end())
+                return it->second.seconds;
+            if (instr)
+                return (double)instr * ((sum_instr > 0.0) ? sum_instr_seconds/sum_instr : DEFAULT_SECONDS_PER_INSTR);
+            return size_mb * ((sum_size_mb > 0.0) ? sum_size_seconds/sum_size_mb : DEFAULT_SECONDS_PER_MB);
+        }
+
+        // cost, in the seconds of the current host and options.
+        double calibrated(double cost) const
+        {
+            return (estimated > 0.0) ? cost * observed/estimated : cost;
+        }
+
+        // A run estimated at cost took seconds: learns from it, and saves the model if it has a file.
+        void update(const std::string& workload, const std::string& run, double size_mb, uint64_t instr, double cost, double seconds)
+        {
+            observed += seconds;
+            estimated += cost;
+            entry_t& e = entries[workload + "/" + run];
+            const double normalized = seconds * estimated/observed;
+            e.seconds = e.runs ? (e.seconds + normalized)/2 : normalized;
+            e.size_mb = size_mb;
+            e.instr = instr ? instr : e.instr;
+            e.runs++;
+            update_rates();
+            if (!path.empty())
+                save();
+        }
+
+        bool save() const
+        {
+            const std::string tmp = path + ".tmp";
+            FILE * f = fopen(tmp.c_str(), "w");
+            if (!f)
+                return false;
+            fprintf(f, "Workload,Run,TraceSize,Instr,ExecTime,Runs\n");
+            for (const auto& e : entries)
+            {
+                const size_t slash = e.first.find('/');
+                fprintf(f, "%s,%s,%f,%lu,%f,%lu\n", e.first.substr(0, slash).c_str(), e.first.substr(slash + 1).c_str(), e.second.size_mb,
+                        e.second.instr, e.second.seconds, e.second.runs);
+            }
+            return (fclose(f) == 0) && (rename(tmp.c_str(), path.c_str()) == 0);
+        }
+
+        // Time until all the work is done on workers: running holds the times left of the runs in progress, queued
+        // the times of the others in the order they will start, each on the first worker free.
+        static double makespan(std::vector<double> running, const std::vector<double>& queued, unsigned workers)
+        {
+            running.resize(std::max<size_t>(workers, running.size()), 0.0);
+            std::make_heap(running.begin(), running.end(), std::greater<double>());
+            for (const double t : queued)
+            {
+                std::pop_heap(running.begin(), running.end(), std::greater<double>());
+                running.back() += t;
+                std::push_heap(running.begin(), running.end(), std::greater<double>());
+            }
+            return *std::max_element(running.begin(), running.end());
+        }
+
+        static std::string format_time(double seconds)
+        {
+            const uint64_t s = (uint64_t)std::max(0.0, seconds);
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%lu:%02lu:%02lu", s/3600, (s/60)%60, s%60);
+            return buf;
+        }
+};
+
+// <workload>/<run> names of a trace as the batch driver gives them (trace_exec_training_list.py): the parent directory
+// of the trace, and its file name without the extension.
+inline void cost_model_names(const std::string& trace, std::string& workload, std::string& run)
+{
+    const size_t slash = trace.find_last_of('/');
+    const std::string file = (slash == std::string::npos) ? trace : trace.substr(slash + 1);
+    run = file.substr(0, file.find_last_of('.'));
+    if (slash == std::string::npos)
+        workload = ".";
+    else
+    {
+        const size_t prev_slash = (slash == 0) ? std::string::npos : trace.find_last_of('/', slash - 1);
+        const size_t begin = (prev_slash == std::string::npos) ? 0 : prev_slash + 1;
+        workload = trace.substr(begin, slash - begin);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+// The CPUs this process may run on, with their NUMA node and last-level cache domain, from sysfs (Linux only), for the
+// batch driver (-B) to pin its workers: one worker per CPU, spread over the LLC domains, and at most a given number of
+// workers per domain, so that their predictor tables, cache tag arrays and windows do not thrash one shared LLC.
+//
+// A pinned worker also prefers the memory of its node. Its simulator and predictor state is allocated after the fork,
+// so with its first touch on the local node it never has to cross sockets.
+struct cpu_topology_t
+{
+    struct cpu_t
+    {
+        int id;
+        int node;
+        unsigned llc;       // index in llcs
+    };
+
+    struct llc_t
+    {
+        std::string cpu_list;   // as in sysfs, to tell the domains apart
+        uint64_t size;          // bytes
+    };
+
+    std::vector<cpu_t> cpus;
+    std::vector<llc_t> llcs;
+
+    static bool read_line(const std::string& path, std::string& line)
+    {
+        FILE * f = fopen(path.c_str(), "r");
+        if (!f)
+            return false;
+        char buf[4096];
+        const bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+        fclose(f);
+        line = ok ? buf : "";
+        while (!line.empty() && (line.back() == '\n'))
+            line.pop_back();
+        return ok;
+    }
+
+    // "0-3,8,10-11"
+    static std::vector<int> parse_cpu_list(const std::string& list)
+    {
+        std::vector<int> ids;
+        for (const char * p = list.c_str(); *p; )
+        {
+            char * end;
+            const long first = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            long last = first;
+            if (*end == '-')
+                last = strtol(end + 1, &end, 10);
+            for (long id = first; id <= last; id++)
+                ids.push_back(id);
+            p = (*end == ',') ? end + 1 : end;
+        }
+        return ids;
+    }
+
+    // Empty if sysfs is not there to tell.
+    static cpu_topology_t load()
+    {
+        cpu_topology_t t;
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return t;
+
+        std::vector<int> node_of(CPU_SETSIZE, 0);
+        std::string list;
+        for (int node = 0; read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", list); node++)
+            for (const int id : parse_cpu_list(list))
+                if (id < CPU_SETSIZE)
+                    node_of[id] = node;
+
+        for (int id = 0; id < CPU_SETSIZE; id++)
+        {
+            if (!CPU_ISSET(id, &allowed))
+                continue;
+            // the last-level cache is the one of the highest level
+            const std::string cache = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/cache/index";
+            int best_level = 0;
+            llc_t llc = {"", 0};
+            std::string level, size;
+            for (int index = 0; read_line(cache + std::to_string(index) + "/level", level); index++)
+                if (atoi(level.c_str()) > best_level && read_line(cache + std::to_string(index) + "/shared_cpu_list", llc.cpu_list))
+                {
+                    best_level = atoi(level.c_str());
+                    llc.size = read_line(cache + std::to_string(index) + "/size", size) ? strtoull(size.c_str(), nullptr, 10) * 1024 : 0;
+                }
+            if (best_level == 0)
+                return cpu_topology_t();
+
+            unsigned k = 0;
+            while (k < t.llcs.size() && t.llcs[k].cpu_list != llc.cpu_list)
+                k++;
+            if (k == t.llcs.size())
+                t.llcs.push_back(llc);
+            t.cpus.push_back({id, node_of[id], k});
+        }
+        return t;
+    }
+
+    // Pins the calling process to cpu, and makes it prefer the memory of its node.
+    static void pin(const cpu_t& cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu.id, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+        unsigned long nodes[16] = {};
+        if (cpu.node < (int)(8 * sizeof(nodes)))
+        {
+            nodes[cpu.node / (8 * sizeof(nodes[0]))] = 1ul << (cpu.node % (8 * sizeof(nodes[0])));
+            syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes, 8 * sizeof(nodes));
+        }
+    }
+};
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "daemon.h"
+#include "trace_cache.h"
+#include "branch_trace.h"
+#include "result_cache.h"
+
+namespace {
+
+constexpr size_t MAX_SNAPSHOTS = 32;
+constexpr int POLL_MS = 200;
+
+// Options the daemon sets itself, or that run anything but one simulation of the job's trace.
+const char * const RESERVED_OPTIONS[] = {"-i", "-f", "-Y", "-J", "-S", "-s", "-a", "-Z", "-B", "-Q", "-W"};
+
+bool send_all(int fd, const std::string& data)
+{
+    for (size_t sent = 0; sent < data.size(); )
+    {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool read_line(int fd, std::string& line)
+{
+    line.clear();
+    char c;
+    while (true)
+    {
+        const ssize_t n = recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+}
+
+// Mixes the identity of the file at path (real path, size and modification time) into h, if it is one.
+bool hash_file(const std::string& path, uint64_t& h)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    char real[PATH_MAX];
+    const std::string key = std::string(realpath(path.c_str(), real) ? real : path.c_str()) + "|" + std::to_string(st.st_size)
+                            + "|" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+    h = result_cache_t::hash_bytes(key.data(), key.size(), h);
+    return true;
+}
+
+// Removes the files of dir, which is created if missing.
+void clear_dir(const std::string& dir)
+{
+    mkdir(dir.c_str(), 0755);
+    if (DIR * d = opendir(dir.c_str()))
+    {
+        while (dirent * e = readdir(d))
+            if (e->d_name[0] != '.')
+                unlink((dir + "/" + e->d_name).c_str());
+        closedir(d);
+    }
+}
+
+int listen_unix(const std::string& path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (const sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path.c_str(), 0600) != 0 || listen(fd, 64) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class daemon_t
+{
+    private:
+        struct snapshot_entry_t {
+            uint64_t key;
+            std::string path;
+            uint64_t instr;
+            std::string trace;
+            std::string options;
+        };
+
+        struct resident_t {
+            void * addr;
+            size_t size;
+        };
+
+        const std::string dir;
+        const unsigned slots;
+        std::string exe;
+
+        std::mutex mutex;                           // everything below
+        std::condition_variable slot_freed;
+        unsigned busy = 0;
+        uint64_t next_id = 0;
+        std::map<std::string, resident_t> resident; // decoded and branch traces, by path
+        std::list<snapshot_entry_t> snapshots;      // most recently used first
+
+        std::mutex extract_mutex;                   // held while extracting a branch trace
+
+        // Maps the trace at path for the daemon's lifetime, faulting it in, so that its pages stay in memory.
+        void make_resident(const std::string& path)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (resident.count(path))
+                    return;
+            }
+            const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                if (fd >= 0)
+                    close(fd);
+                return;
+            }
+            void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+            close(fd);
+            if (addr == MAP_FAILED)
+                return;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!resident.emplace(path, resident_t{addr, (size_t)st.st_size}).second)
+                munmap(addr, st.st_size);
+        }
+
+        // The branch trace of trace, extracted into the state directory if not done yet, or an empty string if trace
+        // cannot be read.
+        std::string branch_trace(const std::string& trace)
+        {
+            uint64_t h = 0xcbf29ce484222325ull;
+            if (!hash_file(trace, h))
+                return "";
+            std::string name = trace.substr(trace.find_last_of('/') + 1);
+            name = name.substr(0, name.find_last_of('.'));
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "-%016lx.cbpb", h);
+            const std::string path = dir + "/branch/" + name + suffix;
+
+            std::lock_guard<std::mutex> lock(extract_mutex);
+            if (access(path.c_str(), R_OK) != 0)
+            {
+                printf("Extracting the branches of %s: %s\n", trace.c_str(), path.c_str());
+                fflush(stdout);
+                const std::string tmp = path + ".tmp";
+                branch_trace_writer_t writer(tmp.c_str());
+                if (!writer.good())
+                    return "";
+                {
+                    TraceReader reader(trace.c_str());
+                    db_t inst;
+                    while (reader.next(inst))
+                        writer.append(inst.insn_class, inst.pc, inst.next_pc, inst.is_taken, inst.is_last_piece);
+                }
+                writer.close();
+                if (rename(tmp.c_str(), path.c_str()) != 0)
+                    return "";
+            }
+            return path;
+        }
+
+        // The key of the snapshot at instruction first of trace with options: the files they name are part of it.
+        static uint64_t snapshot_key(const std::string& trace, const std::vector<std::string>& options, uint64_t first)
+        {
+            uint64_t h = result_cache_t::hash_bytes(&first, sizeof(first));
+            if (!hash_file(trace, h))
+                h = result_cache_t::hash_bytes(trace.data(), trace.size(), h);
+            for (const std::string& o : options)
+            {
+                h = result_cache_t::hash_bytes(o.data(), o.size() + 1, h);
+                // e.g. <plugin.so>,<args> or <interval>,<reference.so>,<args>
+                std::istringstream parts(o);
+                std::string part;
+                while (std::getline(parts, part, ','))
+                    hash_file(part, h);
+            }
+            return h;
+        }
+
+        void acquire_slot()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slot_freed.wait(lock, [this] { return busy < slots; });
+            busy++;
+        }
+
+        void release_slot()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+            slot_freed.notify_one();
+        }
+
+        std::string status()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string reply;
+            char line[64];
+            for (const auto& r : resident)
+            {
+                snprintf(line, sizeof(line), " %.1f\n", r.second.size/(1024.0*1024.0));
+                reply += "TRACE " + r.first + line;
+            }
+            for (const snapshot_entry_t& s : snapshots)
+                reply += "SNAPSHOT " + std::to_string(s.instr) + " " + s.trace + (s.options.empty() ? "" : " ") + s.options + "\n";
+            return reply + "SLOTS " + std::to_string(busy) + " " + std::to_string(slots) + "\nEND\n";
+        }
+
+        // Runs a RUN request, streaming its progress to client_fd as it goes, and returns the message that ends it.
+        // client_alive is cleared once the client is gone; the job then still runs to the end, for its snapshot.
+        std::string run_job(const std::string& request, int client_fd, bool& client_alive)
+        {
+            std::istringstream words(request);
+            std::string command, trace, word;
+            uint64_t first = 0, last = 0;
+            words >> command;
+            if (!(words >> first >> last >> trace))
+                return "ERROR usage: RUN <first_instr> <last_instr> <trace> [<options>...]\n";
+            if (last && (first >= last))
+                return "ERROR the first instruction must come before the last one\n";
+            std::vector<std::string> options;
+            bool branch_only = false;
+            while (words >> word)
+            {
+                for (const char * reserved : RESERVED_OPTIONS)
+                    if (word == reserved)
+                        return "ERROR " + word + " is not for a daemon job\n";
+                branch_only |= (word == "-X");
+                options.push_back(word);
+            }
+
+            std::vector<std::string> args{exe};
+            std::string input = trace;
+            const bool is_branch_trace = branch_trace_reader_t::is_branch_trace(trace.c_str());
+            if (is_branch_trace && (first || last))
+                return "ERROR a branch trace is replayed whole, without an instruction range\n";
+            if (branch_only && !is_branch_trace && !first && !last)
+            {
+                input = branch_trace(trace);
+                if (input.empty())
+                    return "ERROR cannot extract the branches of " + trace + "\n";
+                make_resident(input);
+            }
+            else if (!is_branch_trace)
+            {
+                const std::string traces = dir + "/traces";
+                const std::string decoded = trace_cache_t::get(trace.c_str(), traces.c_str());
+                make_resident(decoded.empty() ? trace : decoded);
+                args.insert(args.end(), {"-Z", traces});
+            }
+
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                id = next_id++;
+            }
+            const std::string job = dir + "/jobs/" + std::to_string(id);
+
+            // restored from the snapshot at first if there is one, saved to it otherwise
+            std::string snapshot, saved;
+            uint64_t key = 0;
+            if (first)
+            {
+                key = snapshot_key(trace, options, first);
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto s = snapshots.begin(); s != snapshots.end(); ++s)
+                    if (s->key == key)
+                    {
+                        snapshots.splice(snapshots.begin(), snapshots, s);
+                        snapshot = s->path;
+                        break;
+                    }
+                if (snapshot.empty())
+                {
+                    saved = job + ".snap";
+                    args.insert(args.end(), {"-S", std::to_string(first) + "," + saved});
+                }
+                else
+                    args.insert(args.end(), {"-s", snapshot});
+            }
+            if (last)
+                args.insert(args.end(), {"-f", std::to_string(last)});
+            const std::string record_path = job + ".jsonl";
+            const std::string progress_path = job + ".sock";
+            const std::string log_path = job + ".log";
+            args.insert(args.end(), {"-J", record_path, "-Y", "unix:" + progress_path});
+            args.insert(args.end(), options.begin(), options.end());
+            args.push_back(input);
+            std::vector<char *> argv;
+            for (std::string& a : args)
+                argv.push_back(&a[0]);
+            argv.push_back(nullptr);
+
+            const int listen_fd = listen_unix(progress_path);
+            if (listen_fd < 0)
+                return "ERROR cannot listen on " + progress_path + "\n";
+
+            acquire_slot();
+            printf("Running job %lu (%s): %s\n", id, snapshot.empty() ? "cold" : "warm", request.c_str());
+            fflush(stdout);
+            client_alive = client_alive && send_all(client_fd, "JOB " + std::to_string(id) + (snapshot.empty() ? " cold " : " warm ")
+                                                                + log_path + "\n");
+            const auto begin = std::chrono::steady_clock::now();
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (log_fd >= 0)
+                {
+                    dup2(log_fd, STDOUT_FILENO);
+                    dup2(log_fd, STDERR_FILENO);
+                    close(log_fd);
+                }
+                execv(argv[0], argv.data());
+                _exit(127);
+            }
+
+            // The progress records are forwarded whole lines at a time, until the process closes its end of the
+            // socket, or exits without ever connecting (e.g. on bad options).
+            int status = -1;
+            bool reaped = (pid < 0);
+            int progress_fd = -1;
+            std::string pending;
+            while (!reaped)
+            {
+                pollfd p = {(progress_fd >= 0) ? progress_fd : listen_fd, POLLIN, 0};
+                if (poll(&p, 1, POLL_MS) > 0)
+                {
+                    if (progress_fd < 0)
+                    {
+                        progress_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                        continue;
+                    }
+                    char buf[65536];
+                    const ssize_t n = read(progress_fd, buf, sizeof(buf));
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        break;
+                    pending.append(buf, n);
+                    const size_t end = pending.rfind('\n');
+                    if (end != std::string::npos)
+                    {
+                        client_alive = client_alive && send_all(client_fd, pending.substr(0, end + 1));
+                        pending.erase(0, end + 1);
+                    }
+                }
+                else if ((progress_fd < 0) && (waitpid(pid, &status, WNOHANG) == pid))
+                    reaped = true;
+            }
+            if (progress_fd >= 0)
+                close(progress_fd);
+            close(listen_fd);
+            unlink(progress_path.c_str());
+            if (!reaped && (waitpid(pid, &status, 0) != pid))
+                status = -1;
+            release_slot();
+            const double exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            std::string record, message;
+            if (FILE * f = fopen(record_path.c_str(), "r"))
+            {
+                char line[65536];
+                while (fgets(line, sizeof(line), f))
+                    record += std::string("STATS ") + line;
+                fclose(f);
+            }
+            unlink(record_path.c_str());
+
+            const bool pass = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !record.empty();
+            printf("%s job %lu (%.2fs)\n", pass ? "Finished" : "Failed", id, exec_time);
+            fflush(stdout);
+            char end[128];
+            if (pass)
+                snprintf(end, sizeof(end), "DONE %lu %.3f\n", id, exec_time);
+            else
+                snprintf(end, sizeof(end), "FAIL %lu %d %.3f\n", id, WIFEXITED(status) ? WEXITSTATUS(status) : -1, exec_time);
+
+            if (!saved.empty())
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pass && (access(saved.c_str(), R_OK) == 0))
+                {
+                    std::string joined;
+                    for (const std::string& o : options)
+                        joined += (joined.empty() ? "" : " ") + o;
+                    snapshots.push_front({key, dir + "/snapshots/" + std::to_string(id) + ".snap", first, trace, joined});
+                    rename(saved.c_str(), snapshots.front().path.c_str());
+                    while (snapshots.size() > MAX_SNAPSHOTS)
+                    {
+                        unlink(snapshots.back().path.c_str());
+                        snapshots.pop_back();
+                    }
+                }
+                else
+                    unlink(saved.c_str());
+            }
+            return record + end;
+        }
+
+        void serve(int client_fd)
+        {
+            std::string request;
+            bool client_alive = true;
+            while (client_alive && read_line(client_fd, request))
+            {
+                if (!request.empty() && (request.back() == '\r'))
+                    request.pop_back();
+                std::string reply;
+                if (request.compare(0, 4, "RUN ") == 0)
+                    reply = run_job(request, client_fd, client_alive);
+                else if (request == "STATUS")
+                    reply = status();
+                else if (!request.empty())
+                    reply = "ERROR unknown request: " + request + "\n";
+                client_alive = client_alive && send_all(client_fd, reply);
+            }
+            close(client_fd);
+        }
+
+    public:
+        daemon_t(const char * state_dir, unsigned slots)
+        : dir(state_dir), slots(slots)
+        {
+            char path[4096];
+            const ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+            if (n <= 0)
+            {
+                perror("/proc/self/exe");
+                exit(1);
+            }
+            exe.assign(path, n);
+            mkdir(dir.c_str(), 0755);
+            mkdir((dir + "/traces").c_str(), 0755);
+            mkdir((dir + "/branch").c_str(), 0755);
+            clear_dir(dir + "/snapshots");
+            clear_dir(dir + "/jobs");
+        }
+
+        int run(const char * socket_path)
+        {
+            const int listen_fd = listen_unix(socket_path);
+            if (listen_fd < 0)
+            {
+                fprintf(stderr, "Cannot listen on %s: %s\n", socket_path, strerror(errno));
+                return 1;
+            }
+            printf("Serving jobs on %s, %u at a time, state in %s\n", socket_path, slots, dir.c_str());
+            fflush(stdout);
+            while (true)
+            {
+                const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    perror("accept");
+                    return 1;
+                }
+                std::thread([this, fd] { serve(fd); }).detach();
+            }
+        }
+};
+
+} // namespace
+
+int run_daemon(const char * socket_path, const char * state_dir, unsigned slots)
+{
+    signal(SIGPIPE, SIG_IGN);
+    if (slots == 0)
+        slots = std::max(1u, std::thread::hardware_concurrency());
+    daemon_t daemon(state_dir, slots);
+    return daemon.run(socket_path);
+}
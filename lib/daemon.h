@@ -0,0 +1,35 @@
+#pragma once
+
+// Simulation daemon (-i <socket>[,<state_dir>]): a long-running cbp that serves simulation jobs over a local UNIX
+// socket, for the edit-run loop of predictor work. What is slow to get to the first measurement stays resident:
+//
+// - decoded traces: each .gz trace is decoded once into a native trace in <state_dir>/traces (as by -Z, trace_cache.h),
+//   which the daemon keeps mapped so that its pages stay in memory, and every job reads it from there;
+// - branch traces: a branch-only job (-X) over a whole trace replays a branch trace (convert_trace -b), extracted once
+//   into <state_dir>/branch;
+// - warmup snapshots: a job over an instruction range [first, last) restores the simulator and predictor state at
+//   first from a snapshot (-S, -s) saved by the first job of the same trace, options and files, the predictor plugins
+//   among them (keyed by path, size and modification time, so that a rebuilt plugin warms up again). At most
+//   MAX_SNAPSHOTS stay, the least recently used ones dropped first. With CBP_SNAPSHOT_CATALOG set, the jobs also fetch
+//   them from and publish them to that catalog (snapshot_catalog.h), where they outlive the daemon.
+//
+// Each job runs as a cbp process (the daemon's own executable, so a rebuilt cbp needs a restarted daemon), at most
+// slots at a time, with the job's options; its report goes to <state_dir>/jobs/<id>.log. The default state directory
+// is /dev/shm/cbp-daemon, in memory; its snapshots and reports are cleared at startup, its traces kept.
+//
+// Protocol, one text line per message, any number of requests per connection:
+//   client -> daemon   RUN <first_instr> <last_instr> <trace> [<options>...]
+//                          warmed up through first_instr (0: from the start), stopped after last_instr (0: at the end
+//                          of the trace); the measurements are those of the whole run, [0, last_instr), bit for bit
+//                          those of cbp run alone with the same options
+//                      STATUS
+//   daemon -> client   JOB <id> <warm|cold> <report path>         the job started, warm if restored from a snapshot
+//                      {"event":...}                              its progress records as they come (-Y, progress_stream.h)
+//                      STATS {...}                                its stats record (-J, stats.h)
+//                      DONE <id> <seconds>  or  FAIL <id> <exit_status> <seconds>
+//                      ERROR <message>                            a request that was not run
+//   to STATUS          TRACE <path> <MB>, SNAPSHOT <instr> <trace> <options>, SLOTS <busy> <slots>, then END
+// e.g. echo "RUN 50000000 60000000 trace.gz -p ./my_plugin.so" | nc -NU /tmp/cbp.sock
+
+// Serves jobs on socket_path until killed. Never returns but on a failure to listen, with 1.
+int run_daemon(const char * socket_path, const char * state_dir, unsigned slots);
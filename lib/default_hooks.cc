@@ -0,0 +1,32 @@
+#include "cbp.h"
+#include "snapshot.h"
+
+// Defaults of the hooks of cbp.h added after the contest interface, so that an interface file that only defines the
+// original hooks still links, and runs as the simulator did before them. A definition in the interface file takes
+// precedence over these weak ones.
+
+// every per-event notification
+extern const uint32_t cbp_hooks __attribute__((weak)) = CBP_HOOK_ALL;
+
+__attribute__((weak)) void notify_batch(const cbp_batch_t& batch)
+{
+}
+
+__attribute__((weak)) void snapshot_cond_dir_predictor(snapshot_t& s)
+{
+    s.unsupported("the predictor does not define snapshot_cond_dir_predictor()");
+}
+
+__attribute__((weak)) void dump_cond_dir_predictor(snapshot_t& s)
+{
+    snapshot_cond_dir_predictor(s);
+}
+
+__attribute__((weak)) bool freeze_cond_dir_predictor()
+{
+    return false;
+}
+
+__attribute__((weak)) void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+{
+}
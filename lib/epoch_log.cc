@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "epoch_log.h"
+
+epoch_row_t& epoch_row_t::operator+=(const epoch_row_t& r)
+{
+    insts += r.insts;
+    cycles += r.cycles;
+    br.conddir_n += r.br.conddir_n;
+    br.conddir_m += r.br.conddir_m;
+    br.jumpdir_n += r.br.jumpdir_n;
+    br.jumpind_n += r.br.jumpind_n;
+    br.jumpind_m += r.br.jumpind_m;
+    br.jumpret_n += r.br.jumpret_n;
+    br.jumpret_m += r.br.jumpret_m;
+    br.notctrl_n += r.br.notctrl_n;
+    br.notctrl_m += r.br.notctrl_m;
+    br.cycles_wp += r.br.cycles_wp;
+    return *this;
+}
+
+epoch_row_t epoch_row_t::operator-(const epoch_row_t& r) const
+{
+    epoch_row_t d;
+    d.insts = insts - r.insts;
+    d.cycles = cycles - r.cycles;
+    d.br.conddir_n = br.conddir_n - r.br.conddir_n;
+    d.br.conddir_m = br.conddir_m - r.br.conddir_m;
+    d.br.jumpdir_n = br.jumpdir_n - r.br.jumpdir_n;
+    d.br.jumpind_n = br.jumpind_n - r.br.jumpind_n;
+    d.br.jumpind_m = br.jumpind_m - r.br.jumpind_m;
+    d.br.jumpret_n = br.jumpret_n - r.br.jumpret_n;
+    d.br.jumpret_m = br.jumpret_m - r.br.jumpret_m;
+    d.br.notctrl_n = br.notctrl_n - r.br.notctrl_n;
+    d.br.notctrl_m = br.notctrl_m - r.br.notctrl_m;
+    d.br.cycles_wp = br.cycles_wp - r.br.cycles_wp;
+    return d;
+}
+
+// Enough epochs for RECENT_INSTS instructions, the current one partial and the first one started late (start_in_epoch()).
+epoch_log_t::epoch_log_t(uint64_t epoch_size_insts)
+    : recent_capacity(RECENT_INSTS/std::max<uint64_t>(epoch_size_insts, 1) + 2)
+{
+}
+
+void epoch_log_t::reset()
+{
+    current = epoch_row_t();
+    num_epochs = 0;
+    closed = epoch_row_t();
+    last_closed = epoch_row_t();
+    recent.clear();
+    recent_next = 0;
+    checkpoints.clear();
+    stride = 1;
+    kept_from = 0;
+    history.clear();
+}
+
+void epoch_log_t::keep()
+{
+    if (keep_all)
+        return;
+    keep_all = true;
+    kept_from = (num_epochs > 0) ? (num_epochs - 1) : 0;
+    history.clear();
+}
+
+void epoch_log_t::begin()
+{
+    if (num_epochs > 0)
+    {
+        const uint64_t e = num_epochs - 1;
+        if (recent.size() < recent_capacity)
+            recent.push_back(closed);
+        else
+            recent[recent_next] = closed;
+        recent_next = (recent_next + 1) % recent_capacity;
+
+        // the history has every epoch anyway: the checkpoints are only thinned without it
+        if (!keep_all && (e % stride == 0))
+            thin(MAX_CHECKPOINTS - 1);
+        if (e % stride == 0)
+            checkpoints.push_back(closed);
+
+        closed += current;
+        if (keep_all)
+            history.push_back(current);
+        last_closed = current;
+        current = epoch_row_t();
+    }
+    num_epochs++;
+}
+
+void epoch_log_t::thin(uint64_t max_checkpoints)
+{
+    while (checkpoints.size() > max_checkpoints)
+    {
+        const uint64_t n = (checkpoints.size() + 1)/2;
+        for (uint64_t i = 0; i < n; i++)
+            checkpoints[i] = checkpoints[2*i];
+        checkpoints.resize(n);
+        stride *= 2;
+    }
+}
+
+const epoch_row_t& epoch_log_t::epoch(uint64_t e) const
+{
+    if ((num_epochs == 0) || (e == num_epochs - 1))
+        return current;
+    if (!keep_all || (e < kept_from))
+    {
+        fprintf(stderr, "The measurements of epoch %lu were not kept\n", e);
+        exit(1);
+    }
+    return history.at(e - kept_from);
+}
+
+epoch_row_t epoch_log_t::totals() const
+{
+    epoch_row_t t = closed;
+    t += current;
+    return t;
+}
+
+epoch_row_t epoch_log_t::last(uint64_t target_insts) const
+{
+    if (current.insts > target_insts)
+        return current;
+    const epoch_row_t t = totals();
+    // the latest start that leaves more than target_insts instructions: the ring, then the older checkpoints
+    for (uint64_t i = 1; i <= recent.size(); i++)
+    {
+        const epoch_row_t& start = recent[(recent_next + recent.size() - i) % recent.size()];
+        if (t.insts - start.insts > target_insts)
+            return t - start;
+    }
+    for (auto start = checkpoints.rbegin(); start != checkpoints.rend(); ++start)
+        if (t.insts - start->insts > target_insts)
+            return t - *start;
+    return t;
+}
+
+void epoch_log_t::get(epoch_stats_t& stats, uint64_t first_epoch, uint64_t num_epochs_wanted) const
+{
+    const uint64_t n = std::min(num_epochs_wanted, num_epochs - std::min(first_epoch, num_epochs));
+    for (uint64_t e = first_epoch; e < first_epoch + n; e++)
+    {
+        const epoch_row_t& r = epoch(e);
+        stats.insts.push_back(r.insts);
+        stats.cycles.push_back(r.cycles);
+        stats.conddir_n.push_back(r.br.conddir_n);
+        stats.conddir_m.push_back(r.br.conddir_m);
+        stats.jumpdir_n.push_back(r.br.jumpdir_n);
+        stats.jumpind_n.push_back(r.br.jumpind_n);
+        stats.jumpind_m.push_back(r.br.jumpind_m);
+        stats.jumpret_n.push_back(r.br.jumpret_n);
+        stats.jumpret_m.push_back(r.br.jumpret_m);
+        stats.notctrl_n.push_back(r.br.notctrl_n);
+        stats.notctrl_m.push_back(r.br.notctrl_m);
+        stats.cycles_on_wrong_path.push_back(r.br.cycles_wp);
+    }
+}
+
+void epoch_log_t::set(const epoch_stats_t& stats)
+{
+    reset();
+    keep_all = true;
+    for (uint64_t e = 0; e < stats.insts.size(); e++)
+    {
+        begin();
+        current.insts = stats.insts[e];
+        current.cycles = stats.cycles[e];
+        current.br.conddir_n = stats.conddir_n[e];
+        current.br.conddir_m = stats.conddir_m[e];
+        current.br.jumpdir_n = stats.jumpdir_n[e];
+        current.br.jumpind_n = stats.jumpind_n[e];
+        current.br.jumpind_m = stats.jumpind_m[e];
+        current.br.jumpret_n = stats.jumpret_n[e];
+        current.br.jumpret_m = stats.jumpret_m[e];
+        current.br.notctrl_n = stats.notctrl_n[e];
+        current.br.notctrl_m = stats.notctrl_m[e];
+        current.br.cycles_wp = stats.cycles_on_wrong_path[e];
+    }
+}
+
+// The restoring run keeps the measurements of each epoch if it asked for them, from the snapshot on if the saving run
+// did not keep them. A run that does not keep them thins the checkpoints of one that did.
+void epoch_log_t::snapshot(snapshot_t& s)
+{
+    s.check(recent_capacity, "the epoch size (-E) changed");
+    s.io(current);
+    s.io(num_epochs);
+    s.io(closed);
+    s.io(last_closed);
+    s.io(recent);
+    s.io(recent_next);
+    s.io(checkpoints);
+    s.io(stride);
+    bool saved_kept = keep_all;
+    s.io(saved_kept);
+    s.io(kept_from);
+    s.io(history);
+    if (s.loading() && !(keep_all && saved_kept))
+    {
+        history.clear();
+        kept_from = (num_epochs > 0) ? (num_epochs - 1) : 0;
+    }
+    if (s.loading() && !keep_all)
+        thin(MAX_CHECKPOINTS);
+}
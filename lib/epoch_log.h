@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "snapshot.h"
+
+// Per-epoch measurements of a run, one element per epoch. Interval simulation (-K) concatenates those of the slices
+// of a trace, simulated apart, into the measurements of the whole trace.
+struct epoch_stats_t {
+    std::vector<uint64_t> insts;
+    std::vector<uint64_t> cycles;
+    std::vector<uint64_t> conddir_n;
+    std::vector<uint64_t> conddir_m;
+    std::vector<uint64_t> jumpdir_n;
+    std::vector<uint64_t> jumpind_n;
+    std::vector<uint64_t> jumpind_m;
+    std::vector<uint64_t> jumpret_n;
+    std::vector<uint64_t> jumpret_m;
+    std::vector<uint64_t> notctrl_n;
+    std::vector<uint64_t> notctrl_m;
+    std::vector<uint64_t> cycles_on_wrong_path;
+};
+
+// Branch measurements summed over epochs.
+struct branch_totals_t {
+    uint64_t conddir_n = 0;
+    uint64_t conddir_m = 0;
+    uint64_t jumpdir_n = 0;
+    uint64_t jumpind_n = 0;
+    uint64_t jumpind_m = 0;
+    uint64_t jumpret_n = 0;
+    uint64_t jumpret_m = 0;
+    uint64_t notctrl_n = 0;
+    uint64_t notctrl_m = 0;
+    uint64_t cycles_wp = 0;
+};
+
+// The measurements of an epoch, or of consecutive epochs summed.
+struct epoch_row_t {
+    uint64_t insts = 0;
+    uint64_t cycles = 0;
+    branch_totals_t br;
+
+    epoch_row_t& operator+=(const epoch_row_t& r);
+    epoch_row_t operator-(const epoch_row_t& r) const;
+};
+
+// The epochs of a run, in a memory that does not grow with the trace: the measurements of the current epoch, the
+// totals of those before it, and the running totals at the start of enough epochs for the sections of
+// bp_t::output_periodic_info(), which sum the last epochs covering a number of instructions. The starts of the epochs
+// of the last RECENT_INSTS instructions are in a ring, so the Last 10M and 25M sections are exact. Older starts are
+// checkpointed, every other checkpoint being dropped whenever there are MAX_CHECKPOINTS of them (or more, restored
+// from a run that kept every epoch): the 50 Perc section is exact up to MAX_CHECKPOINTS epochs (4G instructions at
+// the default -E), and is an approximation after that, beginning at most one checkpoint interval early.
+//
+// The measurements of each epoch are only kept once keep() asks for them, for the reports that list them: the
+// per-epoch measurements (-E), the stats record (-J), and the slices of -K, -g and the replay sample of -z.
+class epoch_log_t
+{
+    public:
+        static constexpr uint64_t RECENT_INSTS = 25000000;
+        static constexpr uint64_t MAX_CHECKPOINTS = 4096;
+
+        // The epoch being simulated, the last one of the run once it ended.
+        epoch_row_t current;
+
+        epoch_log_t(uint64_t epoch_size_insts);
+        // Back to no epoch, the measurements of each epoch still kept if they were.
+        void reset();
+        // Keeps the measurements of each epoch from the current one on.
+        void keep();
+        bool kept() const { return keep_all; }
+        uint64_t first_kept() const { return kept_from; }
+
+        // Ends the current epoch, if any, and begins a new one.
+        void begin();
+        // Epochs begun, the current one included.
+        uint64_t size() const { return num_epochs; }
+        // The epoch last ended.
+        const epoch_row_t& previous() const { return last_closed; }
+        // Epoch e, kept or current.
+        const epoch_row_t& epoch(uint64_t e) const;
+
+        epoch_row_t totals() const;
+        // The last epochs covering more than target_insts instructions, or all of them.
+        epoch_row_t last(uint64_t target_insts) const;
+
+        // Appends the measurements of epochs [first_epoch, first_epoch + num_epochs), at most up to the current one.
+        void get(epoch_stats_t& stats, uint64_t first_epoch, uint64_t num_epochs) const;
+        // Replaces the epochs with those of stats, all kept.
+        void set(const epoch_stats_t& stats);
+
+        void snapshot(snapshot_t& s);
+
+    private:
+        uint64_t num_epochs = 0;
+        epoch_row_t closed;             // the epochs before the current one
+        epoch_row_t last_closed;
+
+        // Running totals at the start of the last recent_capacity epochs ended, recent_next the oldest once full.
+        uint64_t recent_capacity;
+        std::vector<epoch_row_t> recent;
+        uint64_t recent_next = 0;
+        // Running totals at the start of epochs 0, stride, 2*stride, ...
+        std::vector<epoch_row_t> checkpoints;
+        uint64_t stride = 1;
+        // Drops every other checkpoint, doubling the stride, until there are at most max_checkpoints.
+        void thin(uint64_t max_checkpoints);
+
+        bool keep_all = false;
+        uint64_t kept_from = 0;
+        std::vector<epoch_row_t> history;   // the epochs ended since kept_from
+};
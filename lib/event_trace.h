@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Sampled tracing of predictor internals (-V), for debugging accuracy regressions without printfs in the predictor.
+//
+// The event types to trace are chosen at compile time, as a mask of bits (1 << trace_event_t) in CBP_EVENT_TRACE
+// (make EVENT_TRACE=<mask>): the TRACE_EVENT calls of the other types compile to nothing, and all of them do without
+// EVENT_TRACE. At run time, 1 in N conditional branches is traced, picked by a hash of its sequence number and piece so
+// that its predict-time and update-time events are traced together.
+//
+// Events are fixed-size binary records, pushed by the simulation thread into a single-producer/single-consumer ring
+// and written to the file by a background thread. The simulation never waits on the disk: when the ring is full the
+// record is dropped, and counted. The file is a header (event_trace_header_t) followed by the records, read by
+// scripts/event_trace.py.
+
+enum trace_event_t : uint8_t
+{
+    EVENT_PROVIDER = 0,     // provider of the prediction: flags provider (branch_provider_t), bank HitBank, arg0 AltBank, arg1 prediction
+    EVENT_SC_OVERRIDE,      // statistical corrector overriding TAGE (or loop): bank HitBank, arg0 LSUM, arg1 THRES, flags prediction
+    EVENT_LOOP_HIT,         // loop predictor prediction used: arg0 WITHLOOP, flags prediction
+    EVENT_ALLOC,            // TAGE entry allocated at update: bank of the entry, arg0 TICK, flags outcome
+    EVENT_U_RESET,          // useful bits halved as TICK reached BORNTICK: arg0 TICK
+    NUM_TRACE_EVENTS
+};
+
+#ifndef CBP_EVENT_TRACE
+#define CBP_EVENT_TRACE 0
+#endif
+
+constexpr uint32_t EVENT_TRACE_MASK = CBP_EVENT_TRACE;
+
+constexpr bool event_traced(trace_event_t e)
+{
+    return (EVENT_TRACE_MASK >> e) & 1;
+}
+
+struct trace_record_t
+{
+    uint64_t seq_no;
+    uint64_t pc;
+    uint8_t type;       // trace_event_t
+    uint8_t piece;
+    uint8_t bank;
+    uint8_t flags;
+    int32_t arg0;
+    int32_t arg1;
+    uint32_t reserved;
+};
+static_assert(sizeof(trace_record_t) == 32, "trace records are 32 bytes");
+
+struct event_trace_header_t
+{
+    char magic[8];              // "CBPEVT1"
+    uint32_t record_size;
+    uint32_t event_mask;        // EVENT_TRACE_MASK of the build
+    uint64_t one_in_n;
+};
+
+class event_trace_t
+{
+    private:
+        static constexpr uint64_t RING_SIZE = 1 << 16;
+
+        std::vector<trace_record_t> ring;
+        // Records pushed by the simulation thread / written by the writer thread, each on its own line.
+        alignas(64) std::atomic<uint64_t> pushed{0};
+        alignas(64) std::atomic<uint64_t> written{0};
+        std::atomic<bool> stop{false};
+        uint64_t dropped = 0;
+
+        FILE * file = nullptr;
+        std::thread writer;
+
+        // Simulation thread: the branch being traced, if sampled.
+        uint64_t one_in_n = 0;
+        bool sampled = false;
+        uint64_t cur_seq_no = 0;
+        uint64_t cur_pc = 0;
+        uint8_t cur_piece = 0;
+
+        void drain()
+        {
+            for (;;)
+            {
+                const uint64_t end = pushed.load(std::memory_order_acquire);
+                uint64_t begin = written.load(std::memory_order_relaxed);
+                if (begin == end)
+                {
+                    if (stop.load(std::memory_order_acquire) && (pushed.load(std::memory_order_acquire) == begin))
+                        return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                while (begin != end)
+                {
+                    // up to the end of the ring at most, in one write
+                    const uint64_t slot = begin % RING_SIZE;
+                    const uint64_t n = std::min(end - begin, RING_SIZE - slot);
+                    fwrite(&ring[slot], sizeof(trace_record_t), n, file);
+                    begin += n;
+                    written.store(begin, std::memory_order_release);
+                }
+            }
+        }
+
+    public:
+        event_trace_t() = default;
+        event_trace_t(const event_trace_t&) = delete;
+        event_trace_t& operator=(const event_trace_t&) = delete;
+
+        ~event_trace_t()
+        {
+            close();
+        }
+
+        // Starts tracing 1 in n branches (all of them for n <= 1) to path. Returns false if it cannot be written.
+        bool open(const char * path, uint64_t n)
+        {
+            file = fopen(path, "wb");
+            if (!file)
+                return false;
+            one_in_n = (n > 1) ? n : 1;
+            pushed.store(0);
+            written.store(0);
+            stop.store(false);
+            dropped = 0;
+            const event_trace_header_t header = {"CBPEVT1", sizeof(trace_record_t), EVENT_TRACE_MASK, one_in_n};
+            fwrite(&header, sizeof(header), 1, file);
+            ring.resize(RING_SIZE);
+            writer = std::thread(&event_trace_t::drain, this);
+            return true;
+        }
+
+        // Writes the records left in the ring and closes the file. Returns the number of records dropped.
+        uint64_t close()
+        {
+            if (!file)
+                return 0;
+            stop.store(true, std::memory_order_release);
+            writer.join();
+            fclose(file);
+            file = nullptr;
+            one_in_n = 0;
+            sampled = false;
+            return dropped;
+        }
+
+        uint64_t num_records() const
+        {
+            return pushed.load(std::memory_order_relaxed);
+        }
+
+        // Makes branch (seq_no, piece) at pc the subject of the next events, traced if it is sampled.
+        void begin(uint64_t seq_no, uint8_t piece, uint64_t pc)
+        {
+            sampled = one_in_n && ((((seq_no * 8 + piece) * 0x9E3779B97F4A7C15ull) >> 32) % one_in_n == 0);
+            cur_seq_no = seq_no;
+            cur_piece = piece;
+            cur_pc = pc;
+        }
+
+        bool active() const
+        {
+            return sampled;
+        }
+
+        void emit(trace_event_t type, uint8_t bank, uint8_t flags, int32_t arg0, int32_t arg1)
+        {
+            const uint64_t p = pushed.load(std::memory_order_relaxed);
+            if (p - written.load(std::memory_order_acquire) == RING_SIZE)
+            {
+                dropped++;
+                return;
+            }
+            ring[p % RING_SIZE] = {cur_seq_no, cur_pc, type, cur_piece, bank, flags, arg0, arg1, 0};
+            pushed.store(p + 1, std::memory_order_release);
+        }
+};
+
+// Process-wide, like the predictor hooks of cbp.h: opened by the predictor's setup() when -V is given.
+inline event_trace_t event_trace;
+
+#define TRACE_BEGIN(seq_no, piece, pc)                                           \
+    do {                                                                         \
+        if constexpr (EVENT_TRACE_MASK != 0)                                     \
+            event_trace.begin((seq_no), (piece), (pc));                          \
+    } while (0)
+
+#define TRACE_EVENT(type, bank, flags, arg0, arg1)                               \
+    do {                                                                         \
+        if constexpr (event_traced(type))                                        \
+            if (event_trace.active())                                            \
+                event_trace.emit((type), (bank), (flags), (arg0), (arg1));       \
+    } while (0)
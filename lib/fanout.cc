@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "fanout.h"
+#include "batch.h"
+#include "bp_only_sim.h"
+#include "cbp.h"
+#include "value_predictor_interface.h"
+#include "parameters.h"
+#include "plugin.h"
+#include "broadcast_ring.h"
+
+namespace {
+
+static constexpr uint64_t FANOUT_CHUNK = 4096;     // branch records per batch
+static constexpr uint64_t FANOUT_CHUNKS = 16;      // batches in the ring
+static constexpr uint64_t FANOUT_MAX = 256;        // workers
+
+// Ring shared by the decoding parent and the workers, worker k being consumer k. The branch records come in batches
+// of up to FANOUT_CHUNK, and the last batch holds the trailing counts alone.
+using fanout_ring_t = broadcast_ring_t<branch_record_t, FANOUT_CHUNK, FANOUT_CHUNKS, FANOUT_MAX>;
+
+// A worker process, simulating instances [first, first + count).
+struct fanout_worker_t {
+    uint64_t first = 0;
+    uint64_t count = 1;
+    pid_t pid = -1;
+    int result_fd = -1;         // worker -> parent: one batch_result_t per instance
+    bool exited = false;        // reaped while the trace was read, having failed
+};
+
+// An instance of an interleaved worker: its configuration, its predictor and its simulator.
+struct fanout_instance_t {
+    uint64_t config;
+    const predictor_plugin_t * plugin;      // nullptr: the predictor linked into cbp, or the process's plugin
+    void * instance = nullptr;              // of plugin
+    std::unique_ptr<bp_only_sim_t> sim;
+};
+
+bool write_all(int fd, const void * buf, size_t size)
+{
+    const char * p = static_cast<const char *>(buf);
+    while (size)
+    {
+        const ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void * buf, size_t size)
+{
+    char * p = static_cast<char *>(buf);
+    while (size)
+    {
+        const ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Runs in the forked worker, consumer k of the ring: never returns.
+// The instances of the worker take turns branch by branch: each replays a branch, then prefetches for its next one
+// (predictor_prefetch()) and yields to the next instance, so that its loads are in flight while the others run.
+void run_worker(uint64_t k, const fanout_worker_t& w, const sim_config_t& sim_config, const std::vector<uint64_t>& resolve_delays,
+                const std::vector<predictor_plugin_t *>& plugins, const char * log_dir, fanout_ring_t * ring, int result_fd)
+{
+    const std::string name = "config" + std::to_string(w.first) + ((w.count > 1) ? "-" + std::to_string(w.first + w.count - 1) : "");
+    const std::string log_path = log_dir ? (std::string(log_dir) + "/" + name + ".log") : std::string("/dev/null");
+    const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0)
+    {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+
+    // the parent feeds the batches: without it the worker would wait forever
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    std::vector<fanout_instance_t> instances(w.count);
+    auto switch_to = [&](const fanout_instance_t& inst) {
+        PREDICTOR_CONFIG = inst.config;
+        if (inst.plugin)
+            inst.plugin->activate(inst.instance);
+    };
+    for (uint64_t j = 0; j < w.count; j++)
+    {
+        fanout_instance_t& inst = instances[j];
+        inst.config = w.first + j;
+        // a single plugin is active in every worker: each instance of a group gets its own
+        inst.plugin = plugins.empty() ? ((w.count > 1) ? active_plugin : nullptr) : plugins[inst.config];
+        if (inst.plugin)
+            inst.instance = inst.plugin->create();
+        sim_config_t instance_config = sim_config;
+        instance_config.BRANCH_ONLY_RESOLVE_DELAY = resolve_delays[inst.config];
+        switch_to(inst);
+        predictor_begin();
+        inst.sim.reset(new bp_only_sim_t(instance_config));
+    }
+
+    branch_record_t trailing;
+    for (bool last = false; !last; ring->release(k))
+    {
+        uint64_t count;
+        const branch_record_t * chunk = ring->acquire(k, count, last);
+        if (last)
+            trailing = chunk[0];
+        else if (instances.size() == 1)
+        {
+            for (uint64_t i = 0; i < count; i++)
+                instances[0].sim->replay(chunk[i]);
+        }
+        else
+        {
+            for (uint64_t i = 0; i < count; i++)
+            {
+                const bool prefetch = (i + 1 < count) && (chunk[i + 1].insn_class == InstClass::condBranchInstClass);
+                for (const fanout_instance_t& inst : instances)
+                {
+                    switch_to(inst);
+                    inst.sim->replay(chunk[i]);
+                    if (prefetch)
+                        predictor_prefetch(chunk[i + 1].pc);
+                }
+            }
+        }
+    }
+
+    if constexpr (VALUE_PREDICTION)
+        endPredictor();
+    bool written = true;
+    for (const fanout_instance_t& inst : instances)
+    {
+        switch_to(inst);
+        inst.sim->skip(trailing.uop_delta, trailing.instr_delta);
+        predictor_end();
+        inst.sim->output();
+        fflush(stdout);
+        std::cout.flush();
+
+        const uint64_t total_instr = inst.sim->get_epoch_insts();
+        const batch_result_t result = {inst.sim->get_conddir_stats(total_instr), inst.sim->get_conddir_stats(total_instr/2)};
+        written = written && write_all(result_fd, &result, sizeof(result));
+    }
+    close(result_fd);
+    _exit(written ? 0 : 1);
+}
+
+// Reaps the workers that died while the trace is read, so that the ring no longer waits for them.
+void reap_workers(fanout_ring_t * ring, std::vector<fanout_worker_t>& workers)
+{
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        fanout_worker_t& w = workers[k];
+        int status;
+        if (!w.exited && (waitpid(w.pid, &status, WNOHANG) == w.pid))
+        {
+            w.exited = true;
+            ring->detach(k);
+        }
+    }
+}
+
+} // namespace
+
+uint64_t fanout_max_lag()
+{
+    const char * env = getenv("CBP_FANOUT_LAG");
+    return env ? strtoull(env, nullptr, 10) : 0;
+}
+
+int run_fanout(const std::function<bool(branch_record_t&)>& next_branch, const sim_config_t& sim_config, const std::vector<uint64_t>& resolve_delays, const char * log_dir,
+               const std::vector<predictor_plugin_t *>& plugins)
+{
+    if (log_dir)
+        mkdir(log_dir, 0755);
+    fflush(stdout);
+    std::cout.flush();
+
+    // Instances per worker: several plugin instances can share a process (CBP_FANOUT_GROUP), not the linked predictor
+    // nor the plugins that wrap global state.
+    uint64_t group = 1;
+    if (const char * env = getenv("CBP_FANOUT_GROUP"))
+        group = std::max(1ul, strtoul(env, nullptr, 10));
+    if ((group > 1) && plugins.empty() && !active_plugin)
+    {
+        printf("CBP_FANOUT_GROUP: the predictor linked into cbp has a single instance per process, one instance per worker\n");
+        group = 1;
+    }
+    const bool single_instance = plugins.empty() ? (active_plugin && active_plugin->single_instance())
+                                                 : std::any_of(plugins.begin(), plugins.end(), [](const predictor_plugin_t * p) { return p->single_instance(); });
+    if ((group > 1) && single_instance)
+    {
+        printf("CBP_FANOUT_GROUP: a predictor plugin has a single instance per process (make plugin), one instance per worker\n");
+        group = 1;
+    }
+
+    const uint64_t num_workers = (resolve_delays.size() + group - 1)/group;
+    fanout_ring_t * ring = fanout_ring_t::create(num_workers, fanout_max_lag());
+    if (!ring)
+    {
+        fprintf(stderr, "Fan-out mode (-N): cannot map the ring of %lu workers (at most %lu)\n", num_workers, FANOUT_MAX);
+        return resolve_delays.size();
+    }
+
+    std::vector<fanout_worker_t> workers;
+    for (uint64_t first = 0; first < resolve_delays.size(); first += group)
+    {
+        fanout_worker_t w;
+        w.first = first;
+        w.count = std::min<uint64_t>(group, resolve_delays.size() - first);
+        int result_fds[2];
+        if (pipe(result_fds) != 0)
+        {
+            perror("pipe");
+            return resolve_delays.size();
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(result_fds[0]);
+            run_worker(workers.size(), w, sim_config, resolve_delays, plugins, log_dir, ring, result_fds[1]);
+        }
+        close(result_fds[1]);
+        if (pid < 0)
+        {
+            perror("fork");
+            return resolve_delays.size();
+        }
+        w.pid = pid;
+        w.result_fd = result_fds[0];
+        workers.push_back(w);
+    }
+
+    // The trace is decoded once here, straight into the ring, which the workers read in place.
+    uint64_t num_branches = 0;
+    branch_record_t trailing;
+    auto reap = [&]() { reap_workers(ring, workers); };
+    // A last branch that fills its batch exactly is followed by an empty batch.
+    for (uint64_t count = FANOUT_CHUNK; count == FANOUT_CHUNK;)
+    {
+        branch_record_t * chunk = ring->next_batch(reap);
+        count = 0;
+        while (count < FANOUT_CHUNK && next_branch(chunk[count]))
+            count++;
+        // next_branch left the trailing counts in the record after the last branch
+        if (count < FANOUT_CHUNK)
+            trailing = chunk[count];
+        num_branches += count;
+        ring->publish(count, false);
+    }
+    ring->next_batch(reap)[0] = trailing;
+    ring->publish(1, true);
+
+    std::vector<batch_result_t> results(resolve_delays.size());
+    std::vector<bool> pass(resolve_delays.size(), false);
+    for (fanout_worker_t& w : workers)
+    {
+        uint64_t received = 0;
+        while ((received < w.count) && read_all(w.result_fd, &results[w.first + received], sizeof(batch_result_t)))
+            received++;
+        close(w.result_fd);
+        int status;
+        const bool exited = !w.exited && (waitpid(w.pid, &status, 0) == w.pid) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        for (uint64_t j = 0; j < w.count; j++)
+            pass[w.first + j] = exited && (received == w.count);
+    }
+    fanout_ring_t::destroy(ring);
+    const int num_failed = std::count(pass.begin(), pass.end(), false);
+
+    printf("FAN-OUT MODE: %lu predictor instances in %lu workers, branch-only, %lu branches decoded once\n", resolve_delays.size(), workers.size(), num_branches);
+    printf("%7s %12s %12s %12s %12s %10s %10s %14s%s\n", "Config", "ResolveDelay", "Instr", "NumBr", "MispBr", "MR", "MPKI", "50PercMPKI",
+           plugins.empty() ? "" : "  Predictor");
+    for (uint64_t k = 0; k < resolve_delays.size(); k++)
+    {
+        const batch_result_t& r = results[k];
+        const std::string predictor = plugins.empty() ? std::string() : "  " + plugins[k]->get_label();
+        if (!pass[k])
+        {
+            printf("%7lu %12lu %12s%s\n", k, resolve_delays[k], "Fail", predictor.c_str());
+            continue;
+        }
+        printf("%7lu %12lu %12lu %12lu %12lu %9.4f%% %10.4f %14.4f%s\n", k, resolve_delays[k], r.full.instr, r.full.br,
+               r.full.br_mispred, r.full.mr(), r.full.mpki(), r.half.mpki(), predictor.c_str());
+    }
+    return num_failed;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "branch_trace.h"
+#include "parameters.h"
+
+class predictor_plugin_t;
+
+// Fan-out mode (-N): decodes the trace once and broadcasts its branches to one branch-only simulator
+// (bp_only_sim_t) per configuration, then reports their MPKI side by side.
+//
+// next_branch yields the trace's branches in order; once it returns false, rec.uop_delta and rec.instr_delta hold the
+// micro-ops and instructions after the last branch.
+// Instance k runs with sim_config, but the k-th resolve delay, and with PREDICTOR_CONFIG = k. Each instance is a forked worker, so it owns
+// its own predictor, checkpoint stores and measurement counters out of the global state. The branch records are
+// decoded in batches into a ring in memory shared with all the workers (broadcast_ring.h), which read them in place.
+// Worker reports go to <log_dir>/config<k>.log if log_dir is given, and are discarded
+// otherwise. With predictor plugins (plugin.h), one per instance, instance k activates the k-th in its worker.
+//
+// With CBP_FANOUT_GROUP=<n> in the environment and plugin predictors, each worker simulates n instances instead of one,
+// interleaved branch by branch on its core: an instance replays a branch, lets its plugin prefetch what the prediction
+// of the next one reads (the prefetch hook of cbp_plugin.h) and yields to the next instance, which runs while those
+// loads are in flight. The instances of a worker are plugin instances (create()) of their own, each of which the worker
+// activates in turn; the results are those of one worker per instance, and the reports of worker k..k+n-1 go to
+// config<k>-<k+n-1>.log. The predictor linked into cbp is global state, one instance per process, so it always runs
+// one instance per worker, as do the plugins flagged single_instance (those of make plugin, cbp_plugin.h).
+// Returns the number of failed instances.
+// The batches the decoding may run ahead of the slowest worker of -N or -u: CBP_FANOUT_LAG=<batches> in the environment,
+// by default (0) as many as the ring has slots. A smaller lag keeps the batches the workers read in the shared cache.
+uint64_t fanout_max_lag();
+
+int run_fanout(const std::function<bool(branch_record_t&)>& next_branch, const sim_config_t& sim_config, const std::vector<uint64_t>& resolve_delays, const char * log_dir,
+               const std::vector<predictor_plugin_t *>& plugins = {});
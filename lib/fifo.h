@@ -21,6 +21,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
+#include "invariant.h"
 
 template <class T>
 class fifo_t {
@@ -34,6 +35,8 @@ private:
 public:
     fifo_t(uint64_t size);
     ~fifo_t();
+    fifo_t(const fifo_t&) = delete;
+    fifo_t& operator=(const fifo_t&) = delete;
     bool empty();       // returns true if empty, false otherwise
     bool full();        // returns true if full, false otherwise
     T pop();        // pop and return head entry
@@ -54,6 +57,7 @@ fifo_t<T>::fifo_t(uint64_t size) {
 
 template <class T>
 fifo_t<T>::~fifo_t() {
+   delete[] q;
 }
 
 template <class T>
@@ -71,7 +75,7 @@ template <class T>
 T fifo_t<T>::pop() {
    T ret = q[head];
    
-   assert(length > 0);
+   CBP_CHECK(length > 0);
    length--;
    head++;
    if (head == size)
@@ -83,7 +87,7 @@ T fifo_t<T>::pop() {
 // push value at tail entry
 template <class T>
 void fifo_t<T>::push(T value) {
-   assert(length < size);
+   CBP_CHECK(length < size);
    length++;
    q[tail] = value;
    tail++;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "snapshot.h"
+#include "simd_dispatch.h"
+
+// Folded global histories, stored as structure of arrays so that all of them are updated in one pass.
+//
+// Each of the N original history lengths is folded into R compressed registers of different widths (TAGE and ITTAGE
+// fold each length into one index and two tag registers), the cyclic shift registers of P. Michaud's PPM-like
+// predictor at CBP-1. The history bit leaving a length is read once and shared by all its registers, and the
+// registers of one row are updated with the same shifts and xors, which the compiler can vectorize.
+//
+// Entries left uninitialized stay 0 and are harmless, so callers may index lengths from 1. BUFLEN is the length of the
+// history buffer that update(h, PT) reads, unused by callers that shift the bits in themselves.
+template <int N, int R, int BUFLEN = 1>
+class folded_history_set_t
+{
+    static_assert((BUFLEN & (BUFLEN - 1)) == 0, "the history buffer length must be a power of two");
+
+    private:
+        std::array<int, N> mOLength = {};                           // original length, shared by the R registers
+        std::array<std::array<unsigned, N>, R> mOutPoint = {};
+        std::array<std::array<unsigned, N>, R> mCLength = {};
+        std::array<std::array<unsigned, N>, R> mMask = {};
+
+    public:
+        std::array<std::array<unsigned, N>, R> comp = {};         // compressed histories, comp[register][length]
+
+        // Folds original_length history bits into compressed_length bits for register r of length i.
+        void init(int i, int r, int original_length, int compressed_length)
+        {
+            comp[r][i] = 0;
+            mOLength[i] = original_length;
+            mCLength[r][i] = compressed_length;
+            mOutPoint[r][i] = original_length % compressed_length;
+            mMask[r][i] = (1u << compressed_length) - 1;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.io(mOLength);
+            s.io(mOutPoint);
+            s.io(mCLength);
+            s.io(mMask);
+            s.io(comp);
+        }
+
+        int original_length(int i) const
+        {
+            return mOLength[i];
+        }
+
+        // Shifts in h[PT], the newest bit of the history buffer h, and shifts out the oldest bit of each length.
+        void update(const uint8_t * h, int PT)
+        {
+            std::array<unsigned, N> out;
+            for (int i = 0; i < N; i++)
+                out[i] = h[(PT + mOLength[i]) & (BUFLEN - 1)];
+            update(h[PT & (BUFLEN - 1)], out);
+        }
+
+        // Same for a history kept elsewhere: shifts in the bit in, and out[i], the bit leaving length i (the
+        // original_length(i)-th newest before in).
+        CBP_SIMD_KERNEL void update(unsigned in, const std::array<unsigned, N>& out)
+        {
+            for (int r = 0; r < R; r++)
+                for (int i = 0; i < N; i++)
+                {
+                    unsigned c = (comp[r][i] << 1) ^ in ^ (out[i] << mOutPoint[r][i]);
+                    c ^= c >> mCLength[r][i];
+                    comp[r][i] = c & mMask[r][i];
+                }
+        }
+};
@@ -0,0 +1,4 @@
+#include "footprint.h"
+
+checkpoint_footprint_t checkpoint_footprint;
+uint64_t checkpoint_oldest_inflight = 0;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/resource.h>
+
+// Memory footprint of the simulator's growing structures, sampled at each epoch end and reported per epoch (-E), to
+// tell which of them a run's memory goes to and size the worker concurrency of batch runs.
+//
+// The predictors' checkpoint rings are out of the simulator's reach, so they keep process-wide counts of the
+// checkpoints in flight and of the bytes they hold themselves (checkpoint_footprint). Both globals below are defined
+// in the simulator (footprint.cc), so that a predictor plugin (cbp_plugin.h) shares them instead of having copies.
+
+struct checkpoint_footprint_t
+{
+    uint64_t live = 0;      // checkpoints taken and not yet released, in all the rings
+    uint64_t bytes = 0;     // storage of all the rings
+    uint64_t stragglers = 0;    // checkpoints reclaimed without being released, their update missed
+};
+
+extern checkpoint_footprint_t checkpoint_footprint;
+
+// Sequence number of the oldest micro-op still in flight, set by the simulator before each prediction. The
+// checkpoints of older micro-ops can no longer be released (their update was missed, e.g. for a squashed micro-op),
+// so the rings reclaim them instead of growing around them.
+extern uint64_t checkpoint_oldest_inflight;
+
+// Reports the stragglers of the run, if any, at the end of the report.
+inline void checkpoint_stragglers_report()
+{
+    if (checkpoint_footprint.stragglers)
+        printf("\nCheckpoints reclaimed without an update (predictor missed the update of %lu branches)\n", checkpoint_footprint.stragglers);
+}
+
+struct footprint_sample_t
+{
+    uint64_t ckpt_live;
+    uint64_t ckpt_bytes;
+    uint64_t window;        // instructions in the window
+    uint64_t sq_lines;      // store queue lines
+    uint64_t dq;
+    uint64_t aq;
+    uint64_t eq;
+    uint64_t sched_depth;   // deepest of the ALU and load/store lane schedules, in cycles
+    uint64_t sched_bytes;   // storage of both schedules
+    uint64_t peak_rss;      // of the process, in bytes
+};
+
+// Peak resident set size of the process so far, in bytes.
+inline uint64_t peak_rss_bytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (uint64_t)usage.ru_maxrss * 1024;    // kilobytes on Linux
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include "folded_history.h"
+
+// Global branch history shared by several predictors, advanced once per branch.
+//
+// Holds the global history buffer, the path history, the direction history of the conditional branches and a set of
+// folded views of the global history. Each predictor reserves the folded rows it needs when it is built and
+// initializes their lengths; all rows are then updated together in one pass, so a predictor gets its folded
+// histories without updating anything itself.
+//
+// Predictors only read the history: the owner calls update() once per branch, after the predictors have updated
+// their own state for that branch.
+template <int NFOLD, int R, int BUFLEN, int PHISTW>
+class global_history_t
+{
+    static_assert((BUFLEN & (BUFLEN - 1)) == 0, "the history buffer length must be a power of two");
+
+    private:
+        int num_rows = 0;
+
+    public:
+        static constexpr int BUFFER_LENGTH = BUFLEN;
+        static constexpr int PATH_WIDTH = PHISTW;
+
+        std::array<uint8_t, BUFLEN> ghist = {};    // global history buffer, the newest bit at ptghist
+        int ptghist = 0;
+        uint64_t phist = 0;                         // path history, PHISTW bits
+        uint64_t dirhist = 0;                       // outcomes of the conditional branches, the newest in bit 0
+        folded_history_set_t<NFOLD, R, BUFLEN> folded;
+
+        // Reserves n consecutive folded rows and returns the first one. The caller sets them up with folded.init().
+        int reserve_folded(int n)
+        {
+            assert(num_rows + n <= NFOLD && "not enough folded history rows");
+            const int first = num_rows;
+            num_rows += n;
+            return first;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.check(num_rows, "folded history rows");
+            s.io(ghist);
+            s.io(ptghist);
+            s.io(phist);
+            s.io(dirhist);
+            s.io(folded);
+        }
+
+        // Shifts in the nbits low bits of T and of PATH, the lowest first: T into the global history, 7 bits of PATH
+        // per bit into the path history.
+        void push(int T, int PATH, int nbits)
+        {
+            for (int t = 0; t < nbits; t++)
+            {
+                const bool DIR = (T & 1);
+                T >>= 1;
+                const int PATHBIT = (PATH & 127);
+                PATH >>= 1;
+                ptghist--;
+                ghist[ptghist & (BUFLEN - 1)] = DIR;
+                phist = (phist << 1) ^ PATHBIT;
+                folded.update(ghist.data(), ptghist);
+            }
+            phist = (phist & ((1 << PHISTW) - 1));
+        }
+
+        // The CBP2016 TAGE-SC-L encoding of a branch: 2 bits of PC and direction, 3 for indirect branches.
+        // brtype: bit 0 set for conditional branches, bit 1 for indirect ones.
+        void update(uint64_t PC, int brtype, bool taken, uint64_t nextPC)
+        {
+            if (brtype & 1)
+                dirhist = (dirhist << 1) | taken;
+
+            int maxt = 2;
+            if (brtype & 1)   // conditional
+                maxt = 2;
+            else if ((brtype & 2))
+                maxt = 3;
+
+            int T = ((PC ^ (PC >> 2))) ^ taken;
+            int PATH = PC ^ (PC >> 2) ^ (PC >> 4);
+            if ((brtype == 3) & taken)
+            {
+                T = (T ^ (nextPC >> 2));
+                PATH = PATH ^ (nextPC >> 2) ^ (nextPC >> 4);
+            }
+            push(T, PATH, maxt);
+        }
+};
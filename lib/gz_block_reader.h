@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "trace_index.h"
+#include "block_trace.h"
+#include "async_file.h"
+
+// Block-buffered reader for gzip-compressed traces.
+//
+// Inflates large blocks straight into a contiguous buffer through zlib, so that the many small per-field reads of
+// TraceReader::readInstr are served by a bounds check and a memcpy, instead of going through the iostream sentry and
+// the virtual streambuf machinery of gzstream. Mirrors the subset of std::istream that the reader uses (read/eof).
+//
+// The compressed bytes are read ahead by an async_file_reader_t (async_file.h) and inflated by hand, so that inflation
+// does not wait on the storage for each block. With CBP_TRACE_IO=off, or for a file that is not gzip (which gzread
+// passes through), the stream goes through gzread until a seek() to an access point of the trace index
+// (trace_index.h), which gzread cannot start from in the middle of a gzip member.
+class gz_block_reader_t
+{
+    private:
+        gzFile mFile = nullptr;
+        std::vector<char> mBuf;
+        size_t mPos;
+        size_t mEnd;
+        bool mEof;
+        uint64_t mBase;     // offset of mBuf[0] in the inflated stream
+
+        // Set when inflating by hand, instead of mFile.
+        async_file_reader_t * mInput = nullptr;
+        z_stream mStrm = {};
+        bool mRawMember = false;    // inflating the raw deflate data of the member an access point is in
+
+        // Set instead of mFile for a block trace.
+        block_trace_reader_t * mBlocks = nullptr;
+
+        bool refill_in()
+        {
+            const uint8_t * data;
+            size_t size;
+            if ((mStrm.avail_in == 0) && mInput->next(data, size))
+            {
+                mStrm.next_in = (Bytef *)data;
+                mStrm.avail_in = size;
+            }
+            return mStrm.avail_in != 0;
+        }
+
+        // Inflates up to n bytes from the access point on; a short count means the end of the trace (or an error).
+        size_t inflate_raw(char * dst, size_t n)
+        {
+            mStrm.next_out = (Bytef *)dst;
+            mStrm.avail_out = n;
+            while (mStrm.avail_out > 0 && refill_in())
+            {
+                const int ret = inflate(&mStrm, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END)
+                {
+                    // The 8-byte gzip trailer of the raw member is left to skip; inflate checks those of the next
+                    // members itself, after parsing their headers.
+                    for (int skip = (mRawMember ? 8 : 0); skip > 0; skip--)
+                    {
+                        if (!refill_in())
+                            break;
+                        mStrm.next_in++;
+                        mStrm.avail_in--;
+                    }
+                    mRawMember = false;
+                    if (!refill_in() || inflateReset2(&mStrm, 15 + 16) != Z_OK)
+                        break;
+                }
+                else if (ret != Z_OK)
+                    break;
+            }
+            return n - mStrm.avail_out;
+        }
+
+        size_t fill(char * dst, size_t n)
+        {
+            if (mBlocks)
+                return mBlocks->read(dst, n);
+            if (mInput)
+                return inflate_raw(dst, n);
+            const int num = mFile ? gzread(mFile, dst, n) : -1;
+            return (num > 0) ? num : 0;
+        }
+
+        // Slow path: drains what is left in the buffer, then inflates the next block(s). Without dst, the bytes are
+        // skipped over.
+        bool read_slow(char * dst, size_t n)
+        {
+            while (n > 0)
+            {
+                const size_t avail = mEnd - mPos;
+                if (avail >= n)
+                {
+                    if (dst)
+                        memcpy(dst, mBuf.data() + mPos, n);
+                    mPos += n;
+                    return true;
+                }
+                if (dst)
+                {
+                    memcpy(dst, mBuf.data() + mPos, avail);
+                    dst += avail;
+                }
+                n -= avail;
+                mBase += mEnd;
+                mPos = mEnd = 0;
+
+                const size_t num = fill(mBuf.data(), mBuf.size());
+                if (num == 0)
+                {
+                    mEof = true;
+                    return false;
+                }
+                mEnd = num;
+            }
+            return true;
+        }
+
+    public:
+        gz_block_reader_t(const char * trace_name, size_t block_size = 1 << 20)
+        : mBuf(block_size), mPos(0), mEnd(0), mEof(false), mBase(0)
+        {
+            if (block_trace_reader_t::is_block_trace(trace_name))
+            {
+                mFile = nullptr;
+                mBlocks = new block_trace_reader_t(trace_name);
+                return;
+            }
+            if (remote_file_t::is_remote(trace_name))
+            {
+                fprintf(stderr, "Remote trace %s is not a block trace: only block traces (convert_trace -c) are read by URL\n", trace_name);
+                exit(1);
+            }
+            const char * io = getenv("CBP_TRACE_IO");
+            if (!(io && !strcmp(io, "off")) && is_gzip(trace_name))
+            {
+                mInput = new async_file_reader_t(trace_name);
+                if (inflateInit2(&mStrm, 15 + 16) == Z_OK)
+                    return;
+                // Read it through gzopen() as with CBP_TRACE_IO=off, rather than as an empty trace.
+                delete mInput;
+                mInput = nullptr;
+            }
+            mFile = gzopen(trace_name, "rb");
+            if (mFile)
+                gzbuffer(mFile, block_size);
+        }
+
+        ~gz_block_reader_t()
+        {
+            if (mFile)
+                gzclose(mFile);
+            if (mInput)
+            {
+                inflateEnd(&mStrm);
+                delete mInput;
+            }
+            delete mBlocks;
+        }
+
+        static bool is_gzip(const char * path)
+        {
+            unsigned char magic[2];
+            FILE * f = fopen(path, "rb");
+            if (!f)
+                return false;
+            const bool match = (fread(magic, sizeof(magic), 1, f) == 1) && (magic[0] == 0x1f) && (magic[1] == 0x8b);
+            fclose(f);
+            return match;
+        }
+
+        gz_block_reader_t(const gz_block_reader_t&) = delete;
+        gz_block_reader_t& operator=(const gz_block_reader_t&) = delete;
+
+        // Copies the next n bytes of the decompressed stream to dst.
+        // Returns false (and sets eof) if the stream ends before n bytes could be read.
+        inline bool read(char * dst, size_t n)
+        {
+            if (__builtin_expect(mEnd - mPos >= n, 1))
+            {
+                memcpy(dst, mBuf.data() + mPos, n);
+                mPos += n;
+                return true;
+            }
+            return read_slow(dst, n);
+        }
+
+        // Moves past the next n bytes of the decompressed stream, as read() without copying them.
+        inline bool skip(size_t n)
+        {
+            if (__builtin_expect(mEnd - mPos >= n, 1))
+            {
+                mPos += n;
+                return true;
+            }
+            return read_slow(nullptr, n);
+        }
+
+        bool eof() const
+        {
+            return mEof;
+        }
+
+        // Returns true if the stream starts with the n bytes at magic, without consuming them: to tell the formats
+        // carried in a gzip stream apart before anything is read.
+        bool starts_with(const char * magic, size_t n)
+        {
+            assert((tell() == 0) && (n <= mBuf.size()));
+            if (mEnd < n)
+                mEnd += fill(mBuf.data() + mEnd, mBuf.size() - mEnd);
+            return (mEnd >= n) && !memcmp(mBuf.data(), magic, n);
+        }
+
+        // Offset of the next byte read in the inflated stream.
+        uint64_t tell() const
+        {
+            return mBase + mPos;
+        }
+
+        // A block trace is its own seek index: moves to the last block starting at or before instruction num_instrs,
+        // and returns where it starts in mark. Returns false if this is not a block trace.
+        bool seek_block(uint64_t num_instrs, trace_index_mark_t& mark)
+        {
+            if (!mBlocks)
+                return false;
+            mark = mBlocks->seek(num_instrs);
+            mEof = false;
+            mBase = mark.out;
+            mPos = mEnd = 0;
+            return true;
+        }
+
+        // Moves to offset out of the inflated stream, restarting inflation from access point p of the trace index
+        // (or from the start if p is null) and inflating up to out. Returns false if the stream ends before out.
+        bool seek(const char * trace_name, const trace_index_point_t * p, uint64_t out)
+        {
+            mEof = false;
+            // from a point behind the current position, it is faster to read on
+            const bool read_on = (out >= tell()) && (!p || p->out <= tell());
+            if (!read_on && !p)
+            {
+                if (mInput)
+                {
+                    mInput->seek(0);
+                    mStrm.avail_in = 0;
+                    mRawMember = false;
+                    if (inflateReset2(&mStrm, 15 + 16) != Z_OK)
+                        return false;
+                }
+                else if (!mFile || gzrewind(mFile) != 0)
+                    return false;
+                mBase = mPos = mEnd = 0;
+            }
+            else if (!read_on)
+            {
+                if (mFile)
+                    gzclose(mFile);
+                mFile = nullptr;
+                if (mInput)
+                    inflateEnd(&mStrm);
+                else
+                    mInput = new async_file_reader_t(trace_name);
+                mStrm = {};
+                const int bits = p->bits;
+                int prime = 0;
+                mInput->seek(p->in - (bits ? 1 : 0));
+                if (bits)
+                {
+                    if (!refill_in())
+                        return false;
+                    prime = *mStrm.next_in++;
+                    mStrm.avail_in--;
+                }
+                if (!mInput->good() || inflateInit2(&mStrm, -15) != Z_OK)
+                    return false;
+                if ((bits && inflatePrime(&mStrm, bits, prime >> (8 - bits)) != Z_OK)
+                    || inflateSetDictionary(&mStrm, p->window.data(), p->window.size()) != Z_OK)
+                    return false;
+                mRawMember = true;
+                mBase = p->out;
+                mPos = mEnd = 0;
+            }
+
+            // inflate up to out
+            while (mBase + mEnd < out)
+            {
+                mBase += mEnd;
+                mPos = mEnd = 0;
+                mEnd = fill(mBuf.data(), mBuf.size());
+                if (mEnd == 0)
+                {
+                    mEof = true;
+                    return false;
+                }
+            }
+            mPos = out - mBase;
+            return true;
+        }
+};
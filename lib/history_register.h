@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "invariant.h"
+
+// Global history of N outcomes, packed 64 per word in a circular buffer, with O(1) checkpoints.
+//
+// Outcomes are addressed by absolute position: push() writes at the head and advances it, and the buffer keeps the
+// last CAPACITY of them, so a checkpoint is just the head position, whose high bits count the laps of the ring (the
+// generation that tells a checkpoint from one that has been overwritten). The history as it was at a checkpoint is
+// read in place for as long as fewer than SLACK outcomes have been pushed since, which covers the branches in flight.
+//
+// restore() resumes from a checkpoint without rewinding the head, since the checkpoints taken after it still read the
+// outcomes pushed since then: the N outcomes of the checkpoint are copied to the head instead, N/64 word moves, which
+// also use up N positions, so a predictor that restores long after its checkpoints needs a larger SLACK. Restoring the
+// newest checkpoint, as after a misprediction that stalled fetch, is free. The history starts all not taken, as a
+// cleared history register would.
+template <int N, int SLACK = 4096>
+class history_register_t
+{
+    static_assert(N > 0 && SLACK > 0, "empty history register");
+
+    private:
+        static constexpr uint64_t ring_size()
+        {
+            uint64_t size = 64;
+            while (size < 2 * (uint64_t) N + SLACK)
+                size <<= 1;
+            return size;
+        }
+
+    public:
+        using checkpoint_t = uint64_t;
+        static constexpr uint64_t CAPACITY = ring_size();
+
+    private:
+        static constexpr uint64_t MASK = CAPACITY - 1;
+        static constexpr uint64_t WORDS = CAPACITY / 64;
+
+        std::array<uint64_t, WORDS> words = {};
+        uint64_t head = N;  // position of the next outcome; positions below N are the cleared initial history
+
+        // the 64 outcomes from pos up, the one at pos in bit 0
+        uint64_t load(uint64_t pos) const
+        {
+            const uint64_t w = (pos & MASK) >> 6;
+            const int s = pos & 63;
+            uint64_t v = words[w] >> s;
+            if (s)
+                v |= words[(w + 1) & (WORDS - 1)] << (64 - s);
+            return v;
+        }
+
+        // writes the n low bits of v from pos up
+        void store(uint64_t pos, uint64_t v, int n)
+        {
+            const uint64_t m = (n == 64) ? ~0ULL : ((1ULL << n) - 1);
+            const uint64_t w = (pos & MASK) >> 6;
+            const int s = pos & 63;
+            v &= m;
+            words[w] = (words[w] & ~(m << s)) | (v << s);
+            if (s && (n > 64 - s))
+            {
+                const uint64_t w1 = (w + 1) & (WORDS - 1);
+                words[w1] = (words[w1] & ~(m >> (64 - s))) | (v >> (64 - s));
+            }
+        }
+
+    public:
+        checkpoint_t checkpoint() const
+        {
+            return head;
+        }
+
+        // whether the N outcomes of cp are still in the ring
+        bool live(checkpoint_t cp) const
+        {
+            return (cp <= head) && (head - cp + N <= CAPACITY);
+        }
+
+        void push(bool taken)
+        {
+            const uint64_t bit = 1ULL << (head & 63);
+            uint64_t& w = words[(head & MASK) >> 6];
+            w = taken ? (w | bit) : (w & ~bit);
+            head++;
+        }
+
+        // i-th newest outcome as of cp, 0 being the newest
+        bool at(checkpoint_t cp, int i) const
+        {
+            CBP_CHECK(i >= 0 && i < N && live(cp));
+            const uint64_t pos = (cp - 1 - i) & MASK;
+            return (words[pos >> 6] >> (pos & 63)) & 1;
+        }
+
+        // i-th newest outcome, 0 being the newest
+        bool operator[](int i) const
+        {
+            return at(head, i);
+        }
+
+        // Makes the history that of cp again.
+        void restore(checkpoint_t cp)
+        {
+            // nothing pushed since, e.g. when fetch stalled behind the mispredicted branch
+            if (cp == head)
+                return;
+            // the copy must not overwrite its own source
+            CBP_CHECK(live(cp) && (head - cp + 2 * (uint64_t) N <= CAPACITY) && "checkpoint overwritten");
+            for (int k = 0; k < N; k += 64)
+                store(head + k, load(cp - N + k), (N - k < 64) ? (N - k) : 64);
+            head += N;
+        }
+};
@@ -0,0 +1,118 @@
+#include "huge_arena.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Constant-initialized (no constructor runs), so the predictors may allocate from it during static initialization.
+huge_arena_t huge_arena;
+
+namespace {
+
+enum { HUGE_PAGES_OFF, HUGE_PAGES_THP, HUGE_PAGES_HUGETLB };
+
+const char * const mode_names[] = {"off", "thp", "hugetlb"};
+
+int read_mode()
+{
+   const char * env = getenv("CBP_HUGE_PAGES");
+   if (!env || !*env)
+      return HUGE_PAGES_THP;
+   for (int m = 0; m < 3; m++)
+      if (!strcmp(env, mode_names[m]))
+         return m;
+   fprintf(stderr, "CBP_HUGE_PAGES must be off, thp or hugetlb, not `%s`.\n", env);
+   exit(1);
+}
+
+size_t round_up(size_t n, size_t to)
+{
+   return (n + to - 1) / to * to;
+}
+
+}
+
+void huge_arena_t::map_chunk(size_t bytes)
+{
+   bytes = round_up(bytes > CHUNK_SIZE ? bytes : CHUNK_SIZE, HUGE_PAGE_SIZE);
+   void * p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+   if (mode == HUGE_PAGES_HUGETLB)
+   {
+      p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
+         hugetlb_fallbacks++;
+   }
+#endif
+   if (p == MAP_FAILED)
+   {
+      // over-map by a huge page to align the chunk, so that the kernel can back all of it with huge pages
+      const size_t span = bytes + HUGE_PAGE_SIZE;
+      char * raw = (char *) mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED)
+      {
+         fprintf(stderr, "Cannot map %zu bytes for the predictor tables: %s\n", bytes, strerror(errno));
+         exit(1);
+      }
+      char * aligned = (char *) round_up((uintptr_t) raw, HUGE_PAGE_SIZE);
+      if (aligned > raw)
+         munmap(raw, aligned - raw);
+      if (raw + span > aligned + bytes)
+         munmap(aligned + bytes, raw + span - (aligned + bytes));
+#ifdef MADV_HUGEPAGE
+      if (mode != HUGE_PAGES_OFF)
+         madvise(aligned, bytes, MADV_HUGEPAGE);   // advisory, the chunk works either way
+#endif
+      p = aligned;
+   }
+   // the tail of the previous chunk is left unused
+   cur = (char *) p;
+   end = cur + bytes;
+   mapped += bytes;
+}
+
+void * huge_arena_t::alloc(size_t bytes, size_t align)
+{
+   std::lock_guard<std::mutex> guard(lock);
+   if (mode < 0)
+      mode = read_mode();
+   if (bytes == 0)
+      bytes = 1;
+   char * p = (char *) round_up((uintptr_t) cur, align);
+   if (!cur || (p + bytes > end))
+   {
+      map_chunk(bytes);
+      p = cur;
+   }
+   cur = p + bytes;
+   used += bytes;
+   // fresh anonymous pages are zero, and so are rolled-back ones (free clears them)
+   return p;
+}
+
+void huge_arena_t::free(void * p, size_t bytes)
+{
+   if (!p)
+      return;
+   std::lock_guard<std::mutex> guard(lock);
+   if (bytes == 0)
+      bytes = 1;
+   if ((char *) p + bytes == cur)
+   {
+      memset(p, 0, bytes);
+      cur = (char *) p;
+      used -= bytes;
+   }
+}
+
+const char * huge_arena_t::mode_name()
+{
+   std::lock_guard<std::mutex> guard(lock);
+   if (mode < 0)
+      mode = read_mode();
+   if ((mode == HUGE_PAGES_HUGETLB) && hugetlb_fallbacks)
+      return "hugetlb (pool short, thp for some tables)";
+   return mode_names[mode];
+}
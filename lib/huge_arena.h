@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Arena of the large long-lived tables (cache tags and timestamps, TAGE and ITTAGE tables), backed by 2 MB pages.
+//
+// The simulator's hot lookups land at random in these tables, and with 4 KB pages most of them miss the host TLB.
+// The arena maps 2 MB-aligned chunks and hands them out by bumping a pointer, so the tables are packed together in
+// few huge pages instead of scattered in the heap. How the chunks are backed is chosen by the CBP_HUGE_PAGES
+// environment variable, since the predictors allocate their tables before the options are parsed:
+//
+//   thp      (default) transparent huge pages, requested with madvise(MADV_HUGEPAGE)
+//   hugetlb  the reserved huge page pool (MAP_HUGETLB), falling back to thp when the pool is short
+//   off      plain pages
+//
+// Tables live as long as the simulator, so memory is only reclaimed when the latest allocation is freed (a vector
+// that was grown); other frees leave the memory in place.
+class huge_arena_t
+{
+    private:
+        std::mutex lock;
+        char * cur = nullptr;   // next free byte of the current chunk
+        char * end = nullptr;
+        int mode = -1;          // HUGE_PAGES_*, read from the environment at the first allocation
+        uint64_t mapped = 0;
+        uint64_t used = 0;
+        uint64_t hugetlb_fallbacks = 0;
+
+        void map_chunk(size_t bytes);
+
+    public:
+        static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+        static constexpr size_t CHUNK_SIZE = 16 * HUGE_PAGE_SIZE;
+
+        // Zeroed, aligned to align (at most a huge page). Exits if the memory cannot be mapped.
+        void * alloc(size_t bytes, size_t align = 64);
+        void free(void * p, size_t bytes);
+
+        uint64_t bytes_mapped() const { return mapped; }
+        uint64_t bytes_used() const { return used; }
+        const char * mode_name();
+};
+
+extern huge_arena_t huge_arena;
+
+// Array of n default-constructed T from the arena, for the tables allocated once (new T[n] otherwise).
+template <class T>
+T * huge_new_array(size_t n)
+{
+    T * p = static_cast<T *>(huge_arena.alloc(n * sizeof(T), alignof(T) > 64 ? alignof(T) : 64));
+    for (size_t i = 0; i < n; i++)
+        new (p + i) T();
+    return p;
+}
+
+// Same, for a T whose default state is all zero bits: the arena's memory already is, so no constructor runs and the
+// pages of the array are only faulted in when an entry is first touched.
+template <class T>
+T * huge_new_zeroed_array(size_t n)
+{
+    static_assert(std::is_trivially_destructible<T>::value && std::is_trivially_copyable<T>::value,
+                  "the entries are not constructed");
+    return static_cast<T *>(huge_arena.alloc(n * sizeof(T), alignof(T) > 64 ? alignof(T) : 64));
+}
+
+template <class T>
+void huge_delete_array(T * p, size_t n)
+{
+    if (!p)
+        return;
+    for (size_t i = 0; i < n; i++)
+        p[i].~T();
+    huge_arena.free(p, n * sizeof(T));
+}
+
+// Standard allocator over the arena, for containers sized once (std::vector<T, huge_allocator_t<T>>).
+template <class T>
+struct huge_allocator_t
+{
+    using value_type = T;
+
+    huge_allocator_t() = default;
+    template <class U>
+    huge_allocator_t(const huge_allocator_t<U>&) {}
+
+    T * allocate(size_t n)
+    {
+        return static_cast<T *>(huge_arena.alloc(n * sizeof(T), alignof(T) > 64 ? alignof(T) : 64));
+    }
+
+    // Value-initialization of a trivial T only writes zeros over the arena's zeros: it is skipped, so that resize()
+    // leaves fresh pages untouched. Other constructions are as usual.
+    template <class U>
+    void construct(U * p)
+    {
+        if constexpr (!std::is_trivially_default_constructible<U>::value)
+            ::new ((void *) p) U();
+    }
+
+    template <class U, class... Args>
+    void construct(U * p, Args&&... args)
+    {
+        ::new ((void *) p) U(std::forward<Args>(args)...);
+    }
+
+    void deallocate(T * p, size_t n)
+    {
+        huge_arena.free(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const huge_allocator_t<U>&) const { return true; }
+    template <class U>
+    bool operator!=(const huge_allocator_t<U>&) const { return false; }
+};
+
+// As construct() relies on the arena's zeros, a vector is to be sized once: elements regrown after a shrink keep
+// their old values.
+template <class T>
+using huge_vector_t = std::vector<T, huge_allocator_t<T>>;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include "trace_db.h"
+#include "branch_trace.h"
+#include "bp.h"
+
+// Indirect-prediction study (-O): ITTAGE alone, fed the unconditional branches of a trace in order as bp_t::predict
+// does (direct jumps and calls only track the history, indirect jumps, calls and returns are predicted and updated at
+// once, or returns by the return address stack if there is one), without the conditional branch predictor nor any timing
+// model. The JumpIndirect and JumpReturn rows are those of a full run with ITTAGE enabled (PERFECT_INDIRECT_PRED
+// false) and the same RAS_SIZE, at the cost of a pass over the branch records.
+class indirect_study_t
+{
+    private:
+        std::unique_ptr<IPREDICTOR> ittage;
+        std::unique_ptr<ras_t> ras;
+        uint64_t num_inst = 0;
+        uint64_t jumpdir_n = 0;
+        uint64_t jumpind_n = 0;
+        uint64_t jumpind_m = 0;
+        uint64_t jumpret_n = 0;
+        uint64_t jumpret_m = 0;
+
+    public:
+        indirect_study_t(uint64_t ras_size)
+        : ittage(new IPREDICTOR()), ras((ras_size > 0) ? new ras_t(ras_size) : nullptr)
+        {
+        }
+
+        // Accounts for num_insts non-branch instructions.
+        void skip(uint64_t num_insts)
+        {
+            num_inst += num_insts;
+        }
+
+        // skip() over the record's non-branch instructions, then predicts its branch.
+        void replay(const branch_record_t& rec)
+        {
+            num_inst += rec.instr_delta + 1;
+            switch (rec.insn_class)
+            {
+                case InstClass::uncondDirectBranchInstClass:
+                case InstClass::callDirectInstClass:
+                    ittage->TrackOtherInst(rec.pc, rec.next_pc);
+                    if (ras && (rec.insn_class == InstClass::callDirectInstClass))
+                        ras->push(rec.pc + 4);
+                    jumpdir_n++;
+                    break;
+                case InstClass::uncondIndirectBranchInstClass:
+                case InstClass::callIndirectInstClass:
+                case InstClass::ReturnInstClass:
+                {
+                    const bool is_ret = rec.insn_class == InstClass::ReturnInstClass;
+                    bool misp;
+                    if (is_ret && ras)
+                    {
+                        misp = ras->pop() != rec.next_pc;
+                        ittage->TrackOtherInst(rec.pc, rec.next_pc);
+                    }
+                    else
+                    {
+                        misp = ittage->GetPrediction(rec.pc) != rec.next_pc;
+                        ittage->UpdatePredictor(rec.pc, rec.next_pc);
+                    }
+                    if (ras && (rec.insn_class == InstClass::callIndirectInstClass))
+                        ras->push(rec.pc + 4);
+                    jumpind_n += !is_ret;
+                    jumpind_m += !is_ret && misp;
+                    jumpret_n += is_ret;
+                    jumpret_m += is_ret && misp;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        // The unconditional rows of bp_t::output.
+        void output() const
+        {
+            auto row = [&](const char * type, uint64_t n, uint64_t m) {
+                printf("%s%10ld %10ld %8.4lf%% %8.4lf\n", type, n, m, 100.0*((double)m/(double)n), 1000.0*((double)m/(double)num_inst));
+            };
+            printf("\n-----------------------------------------------INDIRECT BRANCH PREDICTION MEASUREMENTS (ITTAGE alone, %lu instructions)----------------------------------------------\n", num_inst);
+            printf("Type                   NumBr     MispBr        mr     mpki\n");
+            row("JumpDirect       ", jumpdir_n, 0);
+            row("JumpIndirect     ", jumpind_n, jumpind_m);
+            row("JumpReturn       ", jumpret_n, jumpret_m);
+            printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+        }
+};
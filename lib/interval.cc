@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "interval.h"
+#include "trace_index.h"
+#include "block_trace.h"
+#include "simpoint.h"
+#include "stats.h"
+
+namespace {
+
+struct slice_t {
+    std::string name;
+    uint64_t warmup_begin;
+    uint64_t begin;
+    uint64_t end;
+    pid_t pid = -1;
+    int result_fd = -1;
+    bool pass = false;
+    double exec_time = 0.0;
+    epoch_stats_t stats;
+};
+
+// The per-epoch vectors, in the order they are sent back by the workers.
+std::array<std::vector<uint64_t> *, 12> columns(epoch_stats_t& stats)
+{
+    return {&stats.insts, &stats.cycles, &stats.conddir_n, &stats.conddir_m, &stats.jumpdir_n, &stats.jumpind_n,
+            &stats.jumpind_m, &stats.jumpret_n, &stats.jumpret_m, &stats.notctrl_n, &stats.notctrl_m, &stats.cycles_on_wrong_path};
+}
+
+// Their names in the "epochs" group of a stats record, as bp_t::register_stats() writes them.
+const char * const column_names[] = {"insts", "cycles", "conddir_n", "conddir_m", "jumpdir_n", "jumpind_n", "jumpind_m", "jumpret_n", "jumpret_m",
+                                     "notctrl_n", "notctrl_m", "cycles_wp"};
+
+// Runs in the forked worker: never returns.
+void run_worker(const char * trace_name, const slice_t& slice, const char * log_dir, int result_fd, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t))
+{
+    const std::string log_path = log_dir ? (std::string(log_dir) + "/" + slice.name + ".log") : std::string("/dev/null");
+    const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0)
+    {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+
+    epoch_stats_t stats = simulate_fn(trace_name, slice.warmup_begin, slice.begin, slice.end);
+    fflush(stdout);
+    std::cout.flush();
+    _exit(send_epoch_stats(result_fd, stats) ? 0 : 1);
+}
+
+// Full Simulation row of the measurements.
+conddir_stats_t full_stats(bp_t& bp, const epoch_stats_t& stats)
+{
+    bp.set_epoch_stats(stats);
+    return bp.conddir_stats(std::accumulate(stats.insts.begin(), stats.insts.end(), (uint64_t)0));
+}
+
+double rel_error(double estimate, double reference)
+{
+    return 100.0*(estimate - reference)/reference;
+}
+
+// A measurement of cycles (Cycles, IPC, BrPerCyc, MispBrPerCyc, the CycWP columns, or the error of one of those) as the
+// reports print it: n/a in branch-only mode (-X), which simulates no cycles.
+std::string per_cycle_text(const char * format, double value, bool timed)
+{
+    if (!timed)
+        return "n/a";
+    char text[32];
+    snprintf(text, sizeof(text), format, value);
+    return text;
+}
+
+// A count of cycles (Cycles, CycWP) as the reports print it, n/a in branch-only mode.
+std::string per_cycle_text(uint64_t value, bool timed)
+{
+    return timed ? std::to_string(value) : "n/a";
+}
+
+// Length of the trace in instructions, from its seek index; exits without one, as slices cannot be reached.
+uint64_t indexed_length(const char * trace_name)
+{
+    const uint64_t trace_instrs = indexed_trace_length(trace_name);
+    if (trace_instrs == 0)
+    {
+        fprintf(stderr, "Interval simulation needs the seek index of %s: run convert_trace -i %s first\n", trace_name, trace_name);
+        exit(1);
+    }
+    return trace_instrs;
+}
+
+// Simulates the slices side by side, one forked worker each. Returns the number of failed workers.
+int run_slices(const char * trace_name, std::vector<slice_t>& slices, uint64_t epoch_size, const char * log_dir, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t))
+{
+    int num_failed = 0;
+    const auto begin_time = std::chrono::steady_clock::now();
+    for (slice_t& slice : slices)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            perror("pipe");
+            return slices.size();
+        }
+        fflush(stdout);
+        std::cout.flush();
+
+        slice.pid = fork();
+        if (slice.pid == 0)
+        {
+            close(fds[0]);
+            run_worker(trace_name, slice, log_dir, fds[1], simulate_fn);
+        }
+        close(fds[1]);
+        if (slice.pid < 0)
+        {
+            perror("fork");
+            close(fds[0]);
+            return slices.size();
+        }
+        slice.result_fd = fds[0];
+    }
+
+    // Results are read before waiting, so that no worker blocks on a full pipe.
+    for (slice_t& slice : slices)
+    {
+        const bool received = receive_epoch_stats(slice.result_fd, slice.stats);
+        int status;
+        slice.pass = (waitpid(slice.pid, &status, 0) == slice.pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0) && received;
+        slice.exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+        // all but the last slice end on an epoch boundary
+        if (slice.pass && (slice.end != UINT64_MAX))
+            slice.pass = slice.stats.insts.size() == (slice.end - slice.begin)/epoch_size;
+        if (!slice.pass)
+        {
+            printf("Failed %s\n", slice.name.c_str());
+            num_failed++;
+        }
+    }
+    return num_failed;
+}
+
+} // namespace
+
+bool send_epoch_stats(int fd, epoch_stats_t& stats)
+{
+    FILE * f = fdopen(fd, "wb");
+    bool written = f != nullptr;
+    for (std::vector<uint64_t> * column : columns(stats))
+    {
+        const uint64_t n = column->size();
+        written = written && (fwrite(&n, sizeof(n), 1, f) == 1) && (fwrite(column->data(), sizeof(uint64_t), n, f) == n);
+    }
+    return f && (fclose(f) == 0) && written;
+}
+
+bool receive_epoch_stats(int fd, epoch_stats_t& stats)
+{
+    FILE * f = fdopen(fd, "rb");
+    if (!f)
+        return false;
+    bool ok = true;
+    for (std::vector<uint64_t> * column : columns(stats))
+    {
+        uint64_t n = 0;
+        ok = ok && (fread(&n, sizeof(n), 1, f) == 1);
+        column->resize(ok ? n : 0);
+        ok = ok && (fread(column->data(), sizeof(uint64_t), n, f) == n);
+    }
+    fclose(f);
+    return ok;
+}
+
+void append_epoch_stats(epoch_stats_t& merged, epoch_stats_t& slice)
+{
+    const auto merged_columns = columns(merged);
+    const auto slice_columns = columns(slice);
+    for (size_t c = 0; c < merged_columns.size(); c++)
+        merged_columns[c]->insert(merged_columns[c]->end(), slice_columns[c]->begin(), slice_columns[c]->end());
+}
+
+uint64_t indexed_trace_length(const char * trace_name)
+{
+    // a block trace is its own index
+    trace_index_t index;
+    return block_trace_reader_t::is_block_trace(trace_name) ? block_trace_reader_t::num_instrs(trace_name)
+           : (index.load(trace_name) ? index.num_instrs : 0);
+}
+
+bool parse_epoch_stats(const std::string& record, epoch_stats_t& stats)
+{
+    const size_t group = record.find("\"epochs\": {");
+    const size_t group_end = (group == std::string::npos) ? std::string::npos : record.find('}', group);
+    if (group_end == std::string::npos)
+        return false;
+    const auto all_columns = columns(stats);
+    for (size_t c = 0; c < all_columns.size(); c++)
+    {
+        const std::string name = std::string("\"") + column_names[c] + "\": [";
+        size_t pos = record.find(name, group);
+        if (pos >= group_end)
+            return false;
+        all_columns[c]->clear();
+        for (pos += name.size(); record[pos] != ']'; )
+        {
+            char * next;
+            all_columns[c]->push_back(strtoull(record.c_str() + pos, &next, 10));
+            pos = next - record.c_str();
+            if (record[pos] == ',')
+                pos++;
+            else if (record[pos] != ']')
+                return false;
+        }
+    }
+    return all_columns[0]->size() == all_columns[1]->size();
+}
+
+int run_slice(const char * trace_name, const sim_config_t& sim_config, uint64_t warmup_begin, uint64_t begin, uint64_t end, const char * stats_json,
+              epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t))
+{
+    const uint64_t epoch_size = sim_config.EPOCH_SIZE_INSTS;
+    if ((begin % epoch_size) || (end && (end % epoch_size)) || (end && (end <= begin)) || (warmup_begin > begin))
+    {
+        fprintf(stderr, "A slice (-K slice,<warmup_begin>,<begin>,<end>) is whole epochs of %lu instructions, warmed up before it: not [%lu, %lu) from %lu\n",
+                epoch_size, begin, end, warmup_begin);
+        exit(1);
+    }
+    if (warmup_begin)
+        indexed_length(trace_name);
+
+    const auto begin_time = std::chrono::steady_clock::now();
+    epoch_stats_t stats = simulate_fn(trace_name, warmup_begin, begin, end ? end : UINT64_MAX);
+    const double exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+    if (end && (stats.insts.size() != (end - begin)/epoch_size))
+    {
+        fprintf(stderr, "Slice [%lu, %lu) of %s: the trace ends at instruction %lu\n", begin, end, trace_name,
+                begin + std::accumulate(stats.insts.begin(), stats.insts.end(), (uint64_t)0));
+        return 1;
+    }
+
+    bp_t bp(sim_config);
+    const conddir_stats_t row = full_stats(bp, stats);
+    printf("\nSlice [%lu, %lu) warmed up from %lu (%.2fs): %lu instructions, IPC %s, MPKI %.4f, CycWPPKI %s\n", begin, end, warmup_begin, exec_time,
+           row.instr, per_cycle_text("%.4f", row.ipc(), row.timed()).c_str(), row.mpki(), per_cycle_text("%.4f", row.cyc_wp_pki(), row.timed()).c_str());
+    if (!stats_json)
+        return 0;
+    stats_t st;
+    st.group("slice").add("warmup_begin", warmup_begin).add("begin", begin).add("end", end);
+    st.group("epochs");
+    const auto all_columns = columns(stats);
+    for (size_t c = 0; c < all_columns.size(); c++)
+        st.add(column_names[c], *all_columns[c]);
+    if (!st.append_json(stats_json, trace_name))
+    {
+        fprintf(stderr, "Cannot write the stats record to %s\n", stats_json);
+        exit(1);
+    }
+    return 0;
+}
+
+std::string report_intervals(const char * trace_name, const sim_config_t& sim_config, uint64_t warmup_instrs, std::vector<epoch_stats_t>& stats,
+                             const std::vector<uint64_t>& begins, const std::vector<double>& exec_times, epoch_stats_t * reference, double reference_time)
+{
+    const uint64_t num_slices = stats.size();
+    epoch_stats_t merged;
+    for (uint64_t k = 0; k < num_slices; k++)
+        append_epoch_stats(merged, stats[k]);
+    const uint64_t total_instr = std::accumulate(merged.insts.begin(), merged.insts.end(), (uint64_t)0);
+    const uint64_t total_cycles = std::accumulate(merged.cycles.begin(), merged.cycles.end(), (uint64_t)0);
+    const uint64_t total_cycles_wp = std::accumulate(merged.cycles_on_wrong_path.begin(), merged.cycles_on_wrong_path.end(), (uint64_t)0);
+
+    stats_t st;
+    st.group("interval").add("slices", num_slices).add("warmup_instrs", warmup_instrs);
+    bp_t bp(sim_config);
+    printf("\n------------------------------------------INTERVAL SIMULATION (%lu slices, %lu warmup instructions per slice)------------------------------------------\n", num_slices, warmup_instrs);
+    printf("Slice  FirstInstr        Instr       Cycles      IPC      NumBr     MispBr BrPerCyc MispBrPerCyc        MR     MPKI      CycWP   CycWPAvg   CycWPPKI    Time\n");
+    for (uint64_t k = 0; k < num_slices; k++)
+    {
+        printf("%5lu %11lu ", k, begins[k]);
+        const conddir_stats_t row = full_stats(bp, stats[k]);
+        printf("%12ld %12s %8s %10ld %10ld %8s %12s %8.4lf%% %8.4lf %10s %10s %10s %6.2fs\n",
+               row.instr, per_cycle_text(row.cycles, row.timed()).c_str(), per_cycle_text("%.4f", row.ipc(), row.timed()).c_str(), row.br, row.br_mispred,
+               per_cycle_text("%.4lf", row.br_per_cyc(), row.timed()).c_str(), per_cycle_text("%.4lf", row.mispred_per_cyc(), row.timed()).c_str(),
+               row.mr(), row.mpki(), per_cycle_text(row.cycles_wp, row.timed()).c_str(), per_cycle_text("%.4lf", row.cyc_wp_avg(), row.timed()).c_str(),
+               per_cycle_text("%.4lf", row.cyc_wp_pki(), row.timed()).c_str(), exec_times[k]);
+    }
+    if (reference)
+    {
+        const conddir_stats_t estimate = full_stats(bp, merged);
+        const conddir_stats_t serial = full_stats(bp, *reference);
+        const bool timed = estimate.timed() && serial.timed();
+        printf("Serial reference (%.2fs): IPC %s, MPKI %.4f, CycWPPKI %s\n", reference_time, per_cycle_text("%.4f", serial.ipc(), timed).c_str(),
+               serial.mpki(), per_cycle_text("%.4f", serial.cyc_wp_pki(), timed).c_str());
+        printf("Interval error: IPC %s, MPKI %+.4f%%, CycWPPKI %s\n", per_cycle_text("%+.4f%%", rel_error(estimate.ipc(), serial.ipc()), timed).c_str(),
+               rel_error(estimate.mpki(), serial.mpki()), per_cycle_text("%+.4f%%", rel_error(estimate.cyc_wp_pki(), serial.cyc_wp_pki()), timed).c_str());
+        // the errors of cycles are left out in branch-only mode (-X), as the stats record of the run leaves out the IPC
+        if (timed)
+            st.add("ipc_error", rel_error(estimate.ipc(), serial.ipc()));
+        st.add("mpki_error", rel_error(estimate.mpki(), serial.mpki()));
+        if (timed)
+            st.add("cyc_wp_pki_error", rel_error(estimate.cyc_wp_pki(), serial.cyc_wp_pki()));
+    }
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    // The merged slices, reported as a serial run would be.
+    printf("\n-----------------------------------ILP LIMIT STUDY (Interval Simulation i.e. Merged Slices)-----------------------------------\n");
+    printf("instructions = %lu\n", total_instr);
+    printf("cycles       = %s\n", per_cycle_text(total_cycles, total_cycles != 0).c_str());
+    printf("CycWP        = %s\n", per_cycle_text(total_cycles_wp, total_cycles != 0).c_str());
+    printf("IPC          = %s\n", per_cycle_text("%.4f", (double)total_instr/(double)total_cycles, total_cycles != 0).c_str());
+    printf("\n---------------------------------------------------------------------------------------------------------------------------------------\n");
+    bp.set_epoch_stats(merged);
+    bp.output(total_instr);
+    bp.output_periodic_info();
+    bp.register_stats(st);
+    return st.to_json(trace_name);
+}
+
+int run_intervals(const char * trace_name, const sim_config_t& sim_config, uint64_t num_slices, uint64_t warmup_instrs, bool reference, const char * log_dir, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t))
+{
+    const uint64_t trace_instrs = indexed_length(trace_name);
+    if (log_dir)
+        mkdir(log_dir, 0755);
+
+    // Slice boundaries on epoch boundaries of the whole trace.
+    const uint64_t epoch_size = sim_config.EPOCH_SIZE_INSTS;
+    const uint64_t num_epochs = (trace_instrs + epoch_size - 1)/epoch_size;
+    num_slices = std::max<uint64_t>(1, std::min(num_slices, num_epochs));
+    std::vector<slice_t> slices(num_slices + (reference ? 1 : 0));
+    for (uint64_t k = 0; k < num_slices; k++)
+    {
+        slice_t& slice = slices[k];
+        slice.name = "slice" + std::to_string(k);
+        slice.begin = (k*num_epochs/num_slices)*epoch_size;
+        slice.end = (k + 1 < num_slices) ? ((k + 1)*num_epochs/num_slices)*epoch_size : UINT64_MAX;
+        slice.warmup_begin = (slice.begin > warmup_instrs) ? slice.begin - warmup_instrs : 0;
+    }
+    if (reference)
+        slices.back() = {"reference", 0, 0, UINT64_MAX};
+
+    const int num_failed = run_slices(trace_name, slices, epoch_size, log_dir, simulate_fn);
+    if (num_failed)
+        return num_failed;
+
+    std::vector<epoch_stats_t> stats(num_slices);
+    std::vector<uint64_t> begins(num_slices);
+    std::vector<double> exec_times(num_slices);
+    for (uint64_t k = 0; k < num_slices; k++)
+    {
+        stats[k] = std::move(slices[k].stats);
+        begins[k] = slices[k].begin;
+        exec_times[k] = slices[k].exec_time;
+    }
+    report_intervals(trace_name, sim_config, warmup_instrs, stats, begins, exec_times, reference ? &slices.back().stats : nullptr,
+                     slices.back().exec_time);
+    return 0;
+}
+
+int run_simpoints(const char * trace_name, const sim_config_t& sim_config, const simpoint_profile_t& profile, uint64_t warmup_instrs, bool reference, const char * log_dir, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t))
+{
+    indexed_length(trace_name);
+    const uint64_t epoch_size = sim_config.EPOCH_SIZE_INSTS;
+    if (profile.interval_instrs % epoch_size != 0)
+    {
+        fprintf(stderr, "SimPoint intervals of %lu instructions are not whole epochs of %lu instructions: set the epoch size with -E\n",
+                profile.interval_instrs, epoch_size);
+        exit(1);
+    }
+    if (log_dir)
+        mkdir(log_dir, 0755);
+
+    const uint64_t num_points = profile.points.size();
+    std::vector<slice_t> slices(num_points + (reference ? 1 : 0));
+    for (uint64_t k = 0; k < num_points; k++)
+    {
+        slice_t& slice = slices[k];
+        slice.name = "simpoint" + std::to_string(k);
+        slice.begin = profile.points[k].interval*profile.interval_instrs;
+        // the last interval may be short, and is simulated to the end
+        slice.end = (slice.begin + profile.interval_instrs < profile.num_instrs) ? slice.begin + profile.interval_instrs : UINT64_MAX;
+        slice.warmup_begin = (slice.begin > warmup_instrs) ? slice.begin - warmup_instrs : 0;
+    }
+    if (reference)
+        slices.back() = {"reference", 0, 0, UINT64_MAX};
+
+    const int num_failed = run_slices(trace_name, slices, epoch_size, log_dir, simulate_fn);
+    if (num_failed)
+        return num_failed;
+
+    // Weighted means of the per-instruction rates; IPC from the weighted CPI.
+    bp_t bp(sim_config);
+    double total_weight = 0.0, cpi = 0.0, mpki = 0.0, cyc_wp_pki = 0.0;
+    bool timed = true;
+    printf("\n------------------------------------------SIMPOINT SIMULATION (%lu points of %lu instructions, %lu warmup instructions per point)------------------------------------------\n",
+           num_points, profile.interval_instrs, warmup_instrs);
+    printf("Point   Interval  FirstInstr  Weight        Instr       Cycles      IPC      NumBr     MispBr     MPKI   CycWPPKI    Time\n");
+    for (uint64_t k = 0; k < num_points; k++)
+    {
+        const double weight = profile.points[k].weight;
+        const conddir_stats_t stats = full_stats(bp, slices[k].stats);
+        printf("%5lu %10lu %11lu %7.4f %12ld %12s %8s %10ld %10ld %8.4lf %10s %6.2fs\n", k, profile.points[k].interval, slices[k].begin, weight,
+               stats.instr, per_cycle_text(stats.cycles, stats.timed()).c_str(), per_cycle_text("%.4f", stats.ipc(), stats.timed()).c_str(), stats.br,
+               stats.br_mispred, stats.mpki(), per_cycle_text("%.4lf", stats.cyc_wp_pki(), stats.timed()).c_str(), slices[k].exec_time);
+        timed = timed && stats.timed();
+        total_weight += weight;
+        cpi += weight/stats.ipc();
+        mpki += weight*stats.mpki();
+        cyc_wp_pki += weight*stats.cyc_wp_pki();
+    }
+    cpi /= total_weight;
+    mpki /= total_weight;
+    cyc_wp_pki /= total_weight;
+    printf("Weighted estimate: IPC %s, MPKI %.4f, CycWPPKI %s\n", per_cycle_text("%.4f", 1.0/cpi, timed).c_str(), mpki,
+           per_cycle_text("%.4f", cyc_wp_pki, timed).c_str());
+    if (reference)
+    {
+        const conddir_stats_t serial = full_stats(bp, slices.back().stats);
+        timed = timed && serial.timed();
+        printf("Serial reference (%.2fs): IPC %s, MPKI %.4f, CycWPPKI %s\n", slices.back().exec_time, per_cycle_text("%.4f", serial.ipc(), timed).c_str(),
+               serial.mpki(), per_cycle_text("%.4f", serial.cyc_wp_pki(), timed).c_str());
+        printf("SimPoint error: IPC %s, MPKI %+.4f%%, CycWPPKI %s\n", per_cycle_text("%+.4f%%", rel_error(1.0/cpi, serial.ipc()), timed).c_str(),
+               rel_error(mpki, serial.mpki()), per_cycle_text("%+.4f%%", rel_error(cyc_wp_pki, serial.cyc_wp_pki()), timed).c_str());
+    }
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+    return 0;
+}
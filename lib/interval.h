@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bp.h"
+#include "parameters.h"
+
+struct simpoint_profile_t;
+
+// Interval simulation (-K): simulates one trace as num_slices contiguous slices side by side and merges their
+// measurements into the report of the whole trace.
+//
+// Slices are whole epochs of the trace, so that each epoch is measured by exactly one slice and the merged per-epoch
+// measurements feed the usual report sections. Each slice first warms the simulator and predictor up over the
+// warmup_instrs instructions before it, which are simulated again but not measured; the cold state at the start of a
+// slice is what makes the result an estimate. Seeking to the warmup start needs the trace's seek index (convert_trace -i),
+// which also gives the length of the trace.
+//
+// simulate_fn(trace, warmup_begin, begin, end) runs in a forked worker and returns the measurements of the epochs of
+// instructions [begin, end), end being UINT64_MAX for the last slice. With reference set, another worker simulates the
+// whole trace serially to report the error of the estimate. Worker stdout goes to <log_dir>/slice<k>.log (and
+// reference.log) if log_dir is given, and is discarded otherwise.
+// Returns the number of failed workers.
+int run_intervals(const char * trace_name, const sim_config_t& sim_config, uint64_t num_slices, uint64_t warmup_instrs, bool reference, const char * log_dir, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t));
+
+// The per-epoch measurements of a slice, sent by its worker over fd and received by the parent; fd is closed. False
+// on error.
+bool send_epoch_stats(int fd, epoch_stats_t& stats);
+bool receive_epoch_stats(int fd, epoch_stats_t& stats);
+// Appends the epochs of the next slice to merged.
+void append_epoch_stats(epoch_stats_t& merged, epoch_stats_t& slice);
+// Length of the trace in instructions, from its seek index (or its blocks), 0 without one.
+uint64_t indexed_trace_length(const char * trace_name);
+
+// Prints the report of interval simulation from the measurements of its slices, slice k starting at instruction
+// begins[k] and simulated in exec_times[k] seconds, and the error of their merged measurements against those of the
+// serial run if reference is given. Returns the stats record (-J, stats.h) of the merged measurements and the error.
+std::string report_intervals(const char * trace_name, const sim_config_t& sim_config, uint64_t warmup_instrs, std::vector<epoch_stats_t>& stats,
+                             const std::vector<uint64_t>& begins, const std::vector<double>& exec_times, epoch_stats_t * reference, double reference_time);
+
+// One slice alone (-K slice,<warmup_begin>,<begin>,<end>), for the slices of a distributed sweep (sweep.h): simulates
+// instructions [begin, end) after warming up from warmup_begin, as a worker of run_intervals() does, end being 0 for
+// the end of the trace. Prints its measurements, and appends them to the stats record stats_json if any, as the series
+// of the "epochs" group with the names bp_t gives them. Returns 0, or 1 if the trace ends before end.
+int run_slice(const char * trace_name, const sim_config_t& sim_config, uint64_t warmup_begin, uint64_t begin, uint64_t end, const char * stats_json,
+              epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t));
+// The per-epoch measurements of the "epochs" group of a stats record, of a slice or of a whole run. False if it has none.
+bool parse_epoch_stats(const std::string& record, epoch_stats_t& stats);
+
+// SimPoint simulation (-K simpoints,<warmup_instrs>[,ref]): simulates only the representative intervals of the trace's
+// SimPoint profile (simpoint.h, convert_trace -p), side by side as the slices above and each warmed up the same way, and
+// reports the weighted means of their IPC, MPKI and CycWPPKI. Intervals are whole epochs (-E).
+// Returns the number of failed workers.
+int run_simpoints(const char * trace_name, const sim_config_t& sim_config, const simpoint_profile_t& profile, uint64_t warmup_instrs, bool reference, const char * log_dir, epoch_stats_t (*simulate_fn)(const char *, uint64_t, uint64_t, uint64_t));
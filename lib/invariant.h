@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Tiered invariant checks, selected per binary by CBP_CHECKS (make CHECKS=<level>, see the Makefiles):
+//
+//   always  CBP_CHECK, whatever the level: the checks that guard correctness rather than debugging, i.e. a bound of
+//      fixed-capacity storage indexed by trace data, a lookup that must find its own entry, a configuration the
+//      model cannot run with. Each is a compare and a never-taken branch.
+//   0  release (cbp): CBP_CHECK only. NDEBUG is defined too, so assert() compiles out of the hot loop.
+//   1  cheap: the assert()s, local checks of a field or an index next to the code they guard.
+//   2  expensive (cbp_checked, by default): CBP_CHECK_EXPENSIVE as well, checks that walk a whole structure (a cache
+//      set, a chunk of a schedule) and would slow every uop down if they ran in release.
+//
+// A failed check reports the condition and where it is, and aborts as assert() does. The condition of a disabled
+// check is not evaluated, so it must have no side effects, but it is still compiled.
+
+#ifndef CBP_CHECKS
+#define CBP_CHECKS 0
+#endif
+
+#define CBP_CHECK_FAILED(cond) \
+    (fprintf(stderr, "%s:%d: %s: invariant failed: %s\n", __FILE__, __LINE__, __func__, #cond), abort())
+
+#define CBP_CHECK(cond) (__builtin_expect(!!(cond), 1) ? (void)0 : CBP_CHECK_FAILED(cond))
+
+#if CBP_CHECKS >= 2
+#define CBP_CHECK_EXPENSIVE(cond) ((cond) ? (void)0 : CBP_CHECK_FAILED(cond))
+#else
+#define CBP_CHECK_EXPENSIVE(cond) ((void)sizeof(!(cond)))
+#endif
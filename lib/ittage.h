@@ -27,12 +27,15 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 
+#include <algorithm>
 #include <assert.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
+#include "folded_history.h"
+#include "huge_arena.h"
 
 #ifndef _ITTAGE_H
 #define _ITTAGE_H
@@ -46,51 +49,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 
 // Fast  implementation of the ITTAGE predictor: probably not optimal, but not
 // that far
-//
-// utility class for index computation
-// this is the cyclic shift register for folding
-// a long global history into a smaller number of bits; see P. Michaud's
-// PPM-like predictor at CBP-1
-class folded_history {
-public:
-  unsigned comp;
-  int CLENGTH;
-  int OLENGTH;
-  int OUTPOINT;
-
-  folded_history() {}
-
-  void init(int original_length, int compressed_length) {
-    comp = 0;
-    OLENGTH = original_length;
-    CLENGTH = compressed_length;
-    OUTPOINT = OLENGTH % CLENGTH;
-  }
-
-  void update(uint8_t *h, int PT) {
-    comp = (comp << 1) ^ h[PT & (HISTBUFFERLENGTH - 1)];
-    comp ^= h[(PT + OLENGTH) & (HISTBUFFERLENGTH - 1)] << OUTPOINT;
-    comp ^= (comp >> CLENGTH);
-    comp = (comp) & ((1 << CLENGTH) - 1);
-  }
-};
 
-class ientry // ITTAGE global table entry
+// ITTAGE global table entry, packed to 16 bytes (24 with byte counters and a full-word tag) as the packed_gentry
+// of TAGE-SC-L: the fields are cut down to the widths of IPREDICTOR, so that the tables take less host cache for
+// identical predictions. The tag, u and ctr share the word after the target.
+#define IPACKEDTAGBITS 11 // tag field of ientry, at least TBITS
+class ientry
 {
 public:
   uint64_t target;
-  int8_t ctr;
-  uint tag;
-  int8_t u;
-
-  ientry() {
-    target = 0xdeadbeef;
+  uint16_t tag : IPACKEDTAGBITS;
+  uint16_t u : 2;
+  int16_t ctr : 3;
 
-    ctr = 0;
-    u = 0;
-    tag = 0;
-  }
+  ientry() : target(0xdeadbeef), tag(0), u(0), ctr(0) {}
 };
+static_assert(sizeof(ientry) == 2 * sizeof(uint64_t),
+              "ientry fields must fit in a target and 16 bits");
 
 class IPREDICTOR {
 public:
@@ -105,6 +80,8 @@ public:
 #define PHISTWIDTH 27 // width of the path history used in ITTAGE
 #define UWIDTH 2      // u counter width on ITTAGE
 #define CWIDTH 3      // predictor counter width on the ITTAGE tagged tables
+  static_assert(TBITS <= IPACKEDTAGBITS && UWIDTH <= 2 && CWIDTH <= 3,
+                "the ITTAGE fields must fit in ientry");
 
   // the counter to chose between longest match and alternate prediction on
   // ITTAGE when weak confidence counters
@@ -116,16 +93,19 @@ public:
   uint8_t ghist[HISTBUFFERLENGTH];
   int ptghist;
   long long phist;                   // path history
-  folded_history ch_i[NHIST + 1];    // utility for computing ITTAGE indices
-  folded_history ch_t[2][NHIST + 1]; // utility for computing ITTAGE tags
+  // utility for computing ITTAGE indices (register 0) and tags (registers 1
+  // and 2)
+  folded_history_set_t<NHIST + 1, 3, HISTBUFFERLENGTH> ch;
 
   ientry *itable[NHIST + 1];
   int m[NHIST + 1];
   int TB[NHIST + 1];
   int logg[NHIST + 1];
 
-  int GI[NHIST + 1]; // indexes to the different tables are computed only once
-  uint GTAG[NHIST + 1]; // tags for the different tables are computed only once
+  // indexes and tags of the different tables are computed only once, by
+  // GetPrediction, and reused by the UpdatePredictor that follows it
+  int GI[NHIST + 1];
+  uint GTAG[NHIST + 1];
   uint64_t pred_target; // prediction
   uint64_t alt_target;  // alternate  TAGEprediction
   uint64_t tage_target; // TAGE prediction
@@ -136,8 +116,21 @@ public:
   int Seed;    // for the pseudo-random number generator
   uint64_t target_inter;
 
-  IPREDICTOR(void) { reinit(); }
+  IPREDICTOR(void) {
+    for (int i = 0; i <= NHIST; i++)
+      itable[i] = huge_new_array<ientry>(1 << LOGG);
+    reinit();
+  }
+
+  ~IPREDICTOR() {
+    for (int i = 0; i <= NHIST; i++)
+      huge_delete_array(itable[i], 1 << LOGG);
+  }
+
+  IPREDICTOR(const IPREDICTOR &) = delete;
+  IPREDICTOR &operator=(const IPREDICTOR &) = delete;
 
+  // Back to the state of a new predictor, in the tables already allocated.
   void reinit() {
     m[0] = 0;
     m[1] = MINHIST;
@@ -154,12 +147,12 @@ public:
     }
 
     for (int i = 0; i <= NHIST; i++)
-      itable[i] = new ientry[(1 << LOGG)];
+      std::fill(itable[i], itable[i] + (1 << LOGG), ientry());
 
     for (int i = 0; i <= NHIST; i++) {
-      ch_i[i].init(m[i], (logg[i]));
-      ch_t[0][i].init(ch_i[i].OLENGTH, TB[i]);
-      ch_t[1][i].init(ch_i[i].OLENGTH, TB[i] - 1);
+      ch.init(i, 0, m[i], (logg[i]));
+      ch.init(i, 1, ch.original_length(i), TB[i]);
+      ch.init(i, 2, ch.original_length(i), TB[i] - 1);
     }
 
     Seed = 0;
@@ -169,7 +162,7 @@ public:
     Seed = 0;
 
     for (int i = 0; i < HISTBUFFERLENGTH; i++)
-      ghist[0] = 0;
+      ghist[i] = 0;
     ptghist = 0;
     use_alt_on_na = 0;
     GHIST = 0;
@@ -177,6 +170,30 @@ public:
     phist = 0;
   }
 
+  // the history lengths and table sizes are fixed, only the contents are
+  // saved
+  void snapshot(snapshot_t &s) {
+    s.io(use_alt_on_na);
+    s.io(GHIST);
+    s.io(TICK);
+    s.io(ghist);
+    s.io(ptghist);
+    s.io(phist);
+    s.io(ch);
+    for (int i = 0; i <= NHIST; i++)
+      s.io(itable[i], (1 << LOGG));
+    s.io(GI);
+    s.io(GTAG);
+    s.io(pred_target);
+    s.io(alt_target);
+    s.io(tage_target);
+    s.io(LongestMatchPred);
+    s.io(HitBank);
+    s.io(AltBank);
+    s.io(Seed);
+    s.io(target_inter);
+  }
+
   // F serves to mix path history: not very important impact
 
   int F(long long A, int size, int bank) {
@@ -195,19 +212,19 @@ public:
   }
 
   // gindex computes a full hash of PC, ghist and phist
-  int gindex(unsigned int PC, int bank, long long hist, folded_history *ch_i) {
+  int gindex(unsigned int PC, int bank, long long hist, const unsigned *ch_i) {
     int index;
     int M = (m[bank] > PHISTWIDTH) ? PHISTWIDTH : m[bank];
-    index = PC ^ (PC >> (abs(logg[bank] - bank) + 1)) ^ ch_i[bank].comp ^
+    index = PC ^ (PC >> (abs(logg[bank] - bank) + 1)) ^ ch_i[bank] ^
             F(hist, M, bank);
 
     return (index & ((1 << (logg[bank])) - 1));
   }
 
   //  tag computation
-  uint16_t gtag(unsigned int PC, int bank, folded_history *ch0,
-                folded_history *ch1) {
-    int tag = (PC) ^ ch0[bank].comp ^ (ch1[bank].comp << 1);
+  uint16_t gtag(unsigned int PC, int bank, const unsigned *ch0,
+                const unsigned *ch1) {
+    int tag = (PC) ^ ch0[bank] ^ (ch1[bank] << 1);
     return (tag & ((1 << (TB[bank])) - 1));
   }
 
@@ -222,6 +239,12 @@ public:
     }
   }
 
+  void ientryctrupdate(ientry &entry, bool taken) {
+    int8_t ctr = entry.ctr;
+    ctrupdate(ctr, taken, CWIDTH);
+    entry.ctr = ctr;
+  }
+
   // just a simple pseudo random number generator: use available information
   // to allocate entries  in the loop predictor
   int MYRANDOM() {
@@ -233,14 +256,14 @@ public:
     return (Seed);
   };
 
-  //  ITTAGE PREDICTION: same code at fetch or retire time but the index and
-  //  tags must recomputed
+  //  ITTAGE PREDICTION: computes the indexes and tags that the update of the
+  //  same branch uses
   uint64_t GetPrediction(uint64_t PC) {
     HitBank = -1;
     AltBank = -1;
     for (int i = 0; i <= NHIST; i++) {
-      GI[i] = gindex(PC, i, phist, ch_i);
-      GTAG[i] = gtag(PC, i, ch_t[0], ch_t[1]);
+      GI[i] = gindex(PC, i, phist, ch.comp[0].data());
+      GTAG[i] = gtag(PC, i, ch.comp[1].data(), ch.comp[2].data());
     }
 
     alt_target = 0;
@@ -250,23 +273,21 @@ public:
 
     int AltConf = -4;
     int HitConf = -4;
-    // Look for the bank with longest matching history
-    for (int i = NHIST; i >= 0; i--) {
-      if (itable[i][GI[i]].tag == GTAG[i]) {
-        HitBank = i;
-        HitConf = itable[HitBank][GI[HitBank]].ctr;
-        LongestMatchPred = itable[HitBank][GI[HitBank]].target;
-        break;
-      }
-    }
-
-    // Look for the alternate bank
-    for (int i = HitBank - 1; i >= 0; i--) {
-      if (itable[i][GI[i]].tag == GTAG[i]) {
-        alt_target = itable[i][GI[i]].target;
-        AltBank = i;
+    // Tag match on all banks at once, without early exits: the bank with the
+    // longest matching history is the highest bit of the hit mask and the
+    // alternate bank the next one
+    uint32_t hits = 0;
+    for (int i = 0; i <= NHIST; i++)
+      hits |= (uint32_t)(itable[i][GI[i]].tag == GTAG[i]) << i;
+    if (hits) {
+      HitBank = 31 - __builtin_clz(hits);
+      HitConf = itable[HitBank][GI[HitBank]].ctr;
+      LongestMatchPred = itable[HitBank][GI[HitBank]].target;
+      hits &= ~(1u << HitBank);
+      if (hits) {
+        AltBank = 31 - __builtin_clz(hits);
+        alt_target = itable[AltBank][GI[AltBank]].target;
         AltConf = itable[AltBank][GI[AltBank]].ctr;
-        break;
       }
     }
     // computes the prediction and the alternate prediction
@@ -286,7 +307,7 @@ public:
   }
 
   void HistoryUpdate(uint64_t PC, uint64_t target, long long &X, int &Y,
-                     folded_history *H, folded_history *G, folded_history *J) {
+                     folded_history_set_t<NHIST + 1, 3, HISTBUFFERLENGTH> &C) {
 
     int maxt = 3;
     int T = (PC >> 2) ^ (PC >> 6);
@@ -302,12 +323,7 @@ public:
       ghist[Y & (HISTBUFFERLENGTH - 1)] = DIR;
       X = (X << 1) ^ PATHBIT;
 
-      for (int i = 1; i <= NHIST; i++) {
-
-        H[i].update(ghist, Y);
-        G[i].update(ghist, Y);
-        J[i].update(ghist, Y);
-      }
+      C.update(ghist, Y);
     }
 
     X = (X & ((1 << PHISTWIDTH) - 1));
@@ -317,7 +333,7 @@ public:
 
   void TrackOtherInst(uint64_t PC, uint64_t branchTarget) {
 
-    HistoryUpdate(PC, branchTarget, phist, ptghist, ch_i, ch_t[0], ch_t[1]);
+    HistoryUpdate(PC, branchTarget, phist, ptghist, ch);
   }
   // PREDICTOR UPDATE
 
@@ -401,13 +417,13 @@ public:
         {
           if (alt_target == branchTarget)
             if (AltBank >= 0) {
-              ctrupdate(itable[AltBank][GI[AltBank]].ctr,
-                        (alt_target == branchTarget), CWIDTH);
+              ientryctrupdate(itable[AltBank][GI[AltBank]],
+                              (alt_target == branchTarget));
             }
         }
 
-      ctrupdate(itable[HitBank][GI[HitBank]].ctr,
-                (LongestMatchPred == branchTarget), CWIDTH);
+      ientryctrupdate(itable[HitBank][GI[HitBank]],
+                      (LongestMatchPred == branchTarget));
       if (LongestMatchPred != branchTarget)
         if (itable[HitBank][GI[HitBank]].ctr < 0)
           itable[HitBank][GI[HitBank]].target = branchTarget;
@@ -419,7 +435,7 @@ public:
       }
     // END TAGE UPDATE
 
-    HistoryUpdate(PC, branchTarget, phist, ptghist, ch_i, ch_t[0], ch_t[1]);
+    HistoryUpdate(PC, branchTarget, phist, ptghist, ch);
 
     // END PREDICTOR UPDATE
   }
@@ -433,4 +449,5 @@ public:
 #undef UWIDTH
 #undef CWIDTH
 };
+#undef IPACKEDTAGBITS
 #endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "snapshot.h"
+
+// Fixed-size table of local (per-branch) histories, selected by a hash of the PC.
+//
+// The set of a branch is (PC ^ (PC >> SHIFT)) mod SETS, SETS being a power of two. With one way, the default, the
+// table is direct-mapped and untagged, as the local histories of TAGE-SC-L: the branches of a set share its history.
+// With more ways, each entry is tagged with the PC bits above the index and the ways of a set are kept in most recently
+// used order; a branch that misses reads the INIT history, and replaces the least recently used way when its history
+// is written. Either way the storage is that of the table, whatever the number of static branches.
+template <int SETS, int SHIFT, int WAYS = 1, class T = uint64_t, T INIT = 0>
+class local_history_table_t
+{
+    static_assert((SETS & (SETS - 1)) == 0, "the number of sets must be a power of two");
+    static_assert(WAYS >= 1, "a set needs a way");
+
+    private:
+        static constexpr uint32_t NO_TAG = 0;   // tags have bit 16 set
+
+        std::array<T, SETS * WAYS> hist = {};
+        std::array<uint32_t, (WAYS > 1) ? SETS * WAYS : 0> tags = {};  // set-major, the most recently used way first
+
+        static uint64_t set(uint64_t pc)
+        {
+            return (pc ^ (pc >> SHIFT)) & (SETS - 1);
+        }
+
+        static uint32_t tag(uint64_t pc)
+        {
+            return (uint32_t) (((pc >> SHIFT) ^ (pc / SETS)) & 0xffff) | 0x10000;
+        }
+
+    public:
+        local_history_table_t()
+        {
+            fill(INIT);
+        }
+
+        static constexpr int ENTRIES = SETS * WAYS;
+
+        // Sets the history of every entry to h, and frees them all.
+        void fill(T h)
+        {
+            hist.fill(h);
+            tags.fill(NO_TAG);
+        }
+
+        // History of the branch at pc.
+        T read(uint64_t pc) const
+        {
+            if constexpr (WAYS == 1)
+                return hist[set(pc)];
+            else
+            {
+                const uint64_t base = set(pc) * WAYS;
+                const uint32_t t = tag(pc);
+                for (int w = 0; w < WAYS; w++)
+                    if (tags[base + w] == t)
+                        return hist[base + w];
+                return INIT;
+            }
+        }
+
+        // History of the branch at pc, to be written: a branch that misses is given the least recently used way,
+        // with the INIT history.
+        T& write(uint64_t pc)
+        {
+            if constexpr (WAYS == 1)
+                return hist[set(pc)];
+            else
+            {
+                const uint64_t base = set(pc) * WAYS;
+                const uint32_t t = tag(pc);
+                int w = 0;
+                while ((w < WAYS - 1) && (tags[base + w] != t))
+                    w++;
+                T h = (tags[base + w] == t) ? hist[base + w] : INIT;
+                // moves the way to the front
+                for (; w > 0; w--)
+                {
+                    tags[base + w] = tags[base + w - 1];
+                    hist[base + w] = hist[base + w - 1];
+                }
+                tags[base] = t;
+                hist[base] = h;
+                return hist[base];
+            }
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.io(hist);
+            s.io(tags);
+        }
+};
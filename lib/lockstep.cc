@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "lockstep.h"
+#include "plugin.h"
+#include "snapshot.h"
+
+namespace {
+
+// The snapshot write(s) saves, as bytes.
+template <class F>
+std::string snapshot_bytes(const char * name, F write)
+{
+    char * buf = nullptr;
+    size_t size = 0;
+    {
+        snapshot_t s(open_memstream(&buf, &size), name);
+        write(s);
+    }
+    std::string bytes(buf, size);
+    free(buf);
+    return bytes;
+}
+
+} // namespace
+
+lockstep_t::lockstep_t(const predictor_plugin_t& reference, uint64_t _interval)
+: ref(reference.get_table()), ref_instance(reference.create()), ref_label(reference.get_label()), interval(_interval)
+{
+}
+
+void lockstep_t::diverged(uint64_t call, const char * what, uint64_t seq_no, uint8_t piece, uint64_t pc, const std::string& how) const
+{
+    fflush(stdout);
+    fprintf(stderr, "Lockstep divergence from the reference %s at call %lu, %s of seq_no %lu piece %u at pc 0x%lx: %s\n",
+            ref_label.c_str(), call, what, seq_no, piece, pc, how.c_str());
+    if (num_checks)
+        fprintf(stderr, "The states were last identical after call %lu\n", last_checked);
+    exit(1);
+}
+
+void lockstep_t::check_state(const char * what, uint64_t seq_no, uint8_t piece, uint64_t pc)
+{
+    const std::string state = snapshot_bytes("of the predictor", [](snapshot_t& s) { predictor_dump(s); });
+    const std::string ref_state = snapshot_bytes("of the reference", [&](snapshot_t& s) {
+        if (ref.dump)
+            ref.dump(ref_instance, s);
+        else
+            ref.snapshot(ref_instance, s);
+    });
+    if (state != ref_state)
+    {
+        const size_t n = std::min(state.size(), ref_state.size());
+        const size_t at = std::mismatch(state.begin(), state.begin() + n, ref_state.begin()).first - state.begin();
+        diverged(num_calls, what, seq_no, piece, pc, "the states differ from byte " + std::to_string(at) + " of their dumps ("
+                 + std::to_string(state.size()) + " bytes, the reference " + std::to_string(ref_state.size()) + ")");
+    }
+    num_checks++;
+    last_checked = num_calls;
+}
+
+void lockstep_t::end()
+{
+    check_state("endCondDirPredictor", 0, 0, 0);
+    ref.end(ref_instance);
+    printf("Lockstep: %lu calls, %lu predictions and %lu state checks identical to the reference %s\n", num_calls, num_predictions,
+           num_checks, ref_label.c_str());
+}
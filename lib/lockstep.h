@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "cbp_plugin.h"
+
+class predictor_plugin_t;
+
+// Lockstep validation (-l <interval>,<reference.so>[,<args>]): a reference predictor plugin gets every call the
+// simulated predictor gets, in the same order, so that an optimized implementation can be checked against the one it
+// replaces, bit for bit. Every prediction is compared with the reference's, and the whole states of both are compared
+// every interval calls through their dumps (dump_cond_dir_predictor()): the canonical form of the state, the tables,
+// counters, thresholds and histories decoded in a fixed order, whatever their layout in memory, without the checkpoints
+// in flight or the statistics. A predictor without a dump is compared through its snapshot. The run stops at the first
+// check that fails, with the call it follows and the byte of the dumps where they differ.
+//
+// The calls go through the predictor_* functions of plugin.h, so the reference follows the simulated predictor on the
+// predictor thread as well (-t). Both declare the same hooks, so that the simulator makes the same calls to them.
+class lockstep_t
+{
+    private:
+        const cbp_plugin_t& ref;
+        void * ref_instance;
+        const std::string ref_label;
+        const uint64_t interval;
+        uint64_t num_calls = 0;
+        uint64_t num_predictions = 0;
+        uint64_t num_checks = 0;
+        uint64_t last_checked = 0;      // call of the last state check, 0 before the first
+
+        // Compares the states after call num_calls, what of seq_no/piece at pc; stops the run if they differ.
+        void check_state(const char * what, uint64_t seq_no, uint8_t piece, uint64_t pc);
+        // Stops the run at call (counted from 1, 0 for the begin), what of seq_no/piece at pc.
+        [[noreturn]] void diverged(uint64_t call, const char * what, uint64_t seq_no, uint8_t piece, uint64_t pc, const std::string& how) const;
+
+        void called(const char * what, uint64_t seq_no, uint8_t piece, uint64_t pc)
+        {
+            if ((++num_calls % interval) == 0)
+                check_state(what, seq_no, piece, pc);
+        }
+
+    public:
+        // Creates the instance of reference; exits if it cannot be created.
+        lockstep_t(const predictor_plugin_t& reference, uint64_t _interval);
+        lockstep_t(const lockstep_t&) = delete;
+        lockstep_t& operator=(const lockstep_t&) = delete;
+
+        void begin()
+        {
+            ref.begin(ref_instance);
+            check_state("beginCondDirPredictor", 0, 0, 0);
+        }
+
+        // A last check of the states, before the end of the predictors, and the report.
+        void end();
+
+        void cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle, bool pred_dir)
+        {
+            num_predictions++;
+            if (ref.get_cond_dir_prediction(ref_instance, seq_no, piece, pc, pred_cycle) != pred_dir)
+                diverged(num_calls + 1, "get_cond_dir_prediction", seq_no, piece, pc, std::string("predicted ") + (pred_dir ? "taken" : "not taken")
+                         + ", the reference " + (pred_dir ? "not taken" : "taken"));
+            called("get_cond_dir_prediction", seq_no, piece, pc);
+        }
+
+        void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+        {
+            ref.spec_update(ref_instance, seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+            called("spec_update", seq_no, piece, pc);
+        }
+
+        void static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t id)
+        {
+            ref.notify_static_id(ref_instance, seq_no, piece, pc, id);
+            called("notify_static_id", seq_no, piece, pc);
+        }
+
+        void instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+        {
+            ref.notify_instr_fetch(ref_instance, seq_no, piece, pc, cycle);
+            called("notify_instr_fetch", seq_no, piece, pc);
+        }
+
+        void instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+        {
+            ref.notify_instr_decode(ref_instance, seq_no, piece, pc, dec_info, cycle);
+            called("notify_instr_decode", seq_no, piece, pc);
+        }
+
+        void agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+        {
+            ref.notify_agen_complete(ref_instance, seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+            called("notify_agen_complete", seq_no, piece, pc);
+        }
+
+        void instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            ref.notify_instr_execute_resolve(ref_instance, seq_no, piece, pc, pred_dir, info, cycle);
+            called("notify_instr_execute_resolve", seq_no, piece, pc);
+        }
+
+        void instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            ref.notify_instr_commit(ref_instance, seq_no, piece, pc, pred_dir, info, cycle);
+            called("notify_instr_commit", seq_no, piece, pc);
+        }
+
+        void batch(const cbp_batch_t& b)
+        {
+            ref.notify_batch(ref_instance, b);
+            called("notify_batch", 0, 0, 0);
+        }
+};
+
+// The lockstep validation of the run, if any (-l).
+inline lockstep_t * lockstep = nullptr;
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "invariant.h"
+#include "snapshot.h"
+
+// Append-only log addressed by absolute position, kept in a power-of-two ring.
+//
+// Positions only grow: records are appended at end() and released from the front once nothing refers to them any
+// more, so a position taken earlier stays valid until it is released. The ring doubles on the (cold) path where it
+// is full, so steady-state operation does not allocate.
+template <class T>
+class log_ring_t
+{
+    private:
+        std::vector<T> slots;
+        uint64_t mask;
+        uint64_t head;  // position of the oldest record
+        uint64_t tail;  // position of the next record
+
+        void grow()
+        {
+            std::vector<T> old_slots(slots.size() * 2);
+            old_slots.swap(slots);
+            const uint64_t old_mask = mask;
+            mask = slots.size() - 1;
+            for (uint64_t pos = head; pos < tail; pos++)
+                slots[pos & mask] = old_slots[pos & old_mask];
+        }
+
+    public:
+        log_ring_t(uint64_t capacity = 256)
+        : head(0), tail(0)
+        {
+            uint64_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        uint64_t begin() const
+        {
+            return head;
+        }
+
+        uint64_t end() const
+        {
+            return tail;
+        }
+
+        void push_back(const T& val)
+        {
+            if (tail - head == slots.size())
+                grow();
+            slots[tail & mask] = val;
+            tail++;
+        }
+
+        const T& operator[](uint64_t pos) const
+        {
+            CBP_CHECK(pos >= head && pos < tail);
+            return slots[pos & mask];
+        }
+
+        // Only the live records, each one walked: the released slots and the padding of the records would make two
+        // logs with the same records save different bytes (lib/lockstep.h compares them).
+        void snapshot(snapshot_t& s)
+        {
+            s.io(head);
+            s.io(tail);
+            if (s.loading())
+                while (tail - head > slots.size())
+                {
+                    slots.resize(slots.size() * 2);
+                    mask = slots.size() - 1;
+                }
+            for (uint64_t pos = head; pos < tail; pos++)
+                s.io(slots[pos & mask]);
+        }
+
+        // Drops all the records. Positions go on from end().
+        void clear()
+        {
+            head = tail;
+        }
+
+        // Drops the records before pos.
+        void release(uint64_t pos)
+        {
+            CBP_CHECK(pos <= tail);
+            if (pos > head)
+                head = pos;
+        }
+};
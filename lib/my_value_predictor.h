@@ -284,5 +284,9 @@ struct ForUpdate
 
 };
 
+// The tables and the in-flight state of this file are only declared: getPrediction(), speculativeUpdate() and
+// updatePredictor() (my_value_predictor.cc) are stubs that never speculate. A predictor filled in here should keep its
+// in-flight ForUpdate records in a checkpoint_ring_t (checkpoint_ring.h) keyed by seq_no and piece rather than in
+// Update[MAXINFLIGHT], and its entries cut to their widths as packed_gentry does for TAGE (cbp2016_tage_sc_l.h).
 #define MAXINFLIGHT 512
 //static ForUpdate Update[MAXINFLIGHT]; // there may be 512 instructions inflight
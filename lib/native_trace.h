@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "invariant.h"
+#include "trace_db.h"
+
+// Native trace format: already-cracked db_t pieces stored uncompressed at a fixed stride.
+//
+// Converting a .gz trace once (see tools/convert_trace.cc) skips both zlib inflation and the piece-cracking logic of
+// TraceReader::populateNewInstr on every later run, and the file can simply be mmapped.
+//
+// Layout : native_trace_header_t
+//          num_pieces x native_trace_record_t
+
+static constexpr char NATIVE_TRACE_MAGIC[8] = {'C', 'B', 'P', 'N', 'A', 'T', 'V', '\0'};
+static constexpr uint32_t NATIVE_TRACE_VERSION = 1;
+
+struct native_trace_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t num_pieces;
+    uint64_t num_instrs;    // trace (macro) instructions the pieces were cracked from
+};
+
+// One db_t piece. Register ids fit on a byte, as in the original trace format.
+struct native_trace_record_t
+{
+    uint64_t pc;
+    uint64_t next_pc;
+    uint64_t addr;
+    uint64_t value[4];      // A, B, C, D
+    uint8_t log_reg[4];
+    uint8_t insn_class;
+    uint8_t size;
+    uint8_t flags;          // is_taken | is_load << 1 | is_store << 2 | is_last_piece << 3
+    uint8_t operand_flags;  // per operand k: valid << 2k | is_int << (2k + 1)
+
+    void encode(const db_t& inst)
+    {
+        const db_operand_t * ops[4] = {&inst.A, &inst.B, &inst.C, &inst.D};
+        pc = inst.pc;
+        next_pc = inst.next_pc;
+        addr = inst.addr;
+        operand_flags = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            CBP_CHECK(ops[k]->log_reg <= UINT8_MAX);
+            value[k] = ops[k]->value;
+            log_reg[k] = ops[k]->log_reg;
+            operand_flags |= (ops[k]->valid << (2 * k)) | (ops[k]->is_int << (2 * k + 1));
+        }
+        CBP_CHECK(inst.size <= UINT8_MAX);
+        insn_class = static_cast<uint8_t>(inst.insn_class);
+        size = inst.size;
+        flags = inst.is_taken | (inst.is_load << 1) | (inst.is_store << 2) | (inst.is_last_piece << 3);
+    }
+
+    void decode(db_t& inst) const
+    {
+        db_operand_t * ops[4] = {&inst.A, &inst.B, &inst.C, &inst.D};
+        inst.pc = pc;
+        inst.next_pc = next_pc;
+        inst.addr = addr;
+        for (int k = 0; k < 4; k++)
+        {
+            ops[k]->value = value[k];
+            ops[k]->log_reg = log_reg[k];
+            ops[k]->valid = (operand_flags >> (2 * k)) & 1;
+            ops[k]->is_int = (operand_flags >> (2 * k + 1)) & 1;
+        }
+        inst.insn_class = static_cast<InstClass>(insn_class);
+        inst.size = size;
+        inst.is_taken = flags & 1;
+        inst.is_load = (flags >> 1) & 1;
+        inst.is_store = (flags >> 2) & 1;
+        inst.is_last_piece = (flags >> 3) & 1;
+    }
+};
+
+static_assert(sizeof(native_trace_record_t) == 64, "Native trace records are expected to be one cache line");
+
+class native_trace_writer_t
+{
+    private:
+        FILE * mFile;
+        native_trace_header_t mHeader;
+
+    public:
+        native_trace_writer_t(const char * path)
+        {
+            memset(&mHeader, 0, sizeof(mHeader));
+            memcpy(mHeader.magic, NATIVE_TRACE_MAGIC, sizeof(mHeader.magic));
+            mHeader.version = NATIVE_TRACE_VERSION;
+            mHeader.record_size = sizeof(native_trace_record_t);
+
+            mFile = fopen(path, "wb");
+            // header is rewritten with the final counts on close
+            if (mFile)
+                fwrite(&mHeader, sizeof(mHeader), 1, mFile);
+        }
+
+        ~native_trace_writer_t()
+        {
+            close();
+        }
+
+        bool good() const
+        {
+            return mFile != nullptr;
+        }
+
+        void append(const db_t& inst)
+        {
+            native_trace_record_t rec;
+            rec.encode(inst);
+            fwrite(&rec, sizeof(rec), 1, mFile);
+            mHeader.num_pieces++;
+            mHeader.num_instrs += inst.is_last_piece;
+        }
+
+        void close()
+        {
+            if (!mFile)
+                return;
+            fseek(mFile, 0, SEEK_SET);
+            fwrite(&mHeader, sizeof(mHeader), 1, mFile);
+            fclose(mFile);
+            mFile = nullptr;
+        }
+};
+
+class native_trace_reader_t
+{
+    private:
+        const uint8_t * mMap;
+        size_t mMapSize;
+        const native_trace_record_t * mRecords;
+        uint64_t mNumPieces;
+        uint64_t mNext;
+
+    public:
+        // Returns true if the file at path starts with the native trace magic.
+        static bool is_native(const char * path)
+        {
+            char magic[sizeof(NATIVE_TRACE_MAGIC)];
+            FILE * f = fopen(path, "rb");
+            if (!f)
+                return false;
+            const bool match = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, NATIVE_TRACE_MAGIC, sizeof(magic));
+            fclose(f);
+            return match;
+        }
+
+        native_trace_reader_t(const char * path)
+        : mMap(nullptr), mMapSize(0), mRecords(nullptr), mNumPieces(0), mNext(0)
+        {
+            const int fd = open(path, O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(native_trace_header_t))
+            {
+                fprintf(stderr, "Unable to open native trace %s\n", path);
+                exit(1);
+            }
+            mMapSize = st.st_size;
+            void * map = mmap(nullptr, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map == MAP_FAILED)
+            {
+                fprintf(stderr, "Unable to mmap native trace %s\n", path);
+                exit(1);
+            }
+            madvise(map, mMapSize, MADV_SEQUENTIAL);
+            mMap = (const uint8_t *)map;
+
+            native_trace_header_t header;
+            memcpy(&header, mMap, sizeof(header));
+            if (header.version != NATIVE_TRACE_VERSION || header.record_size != sizeof(native_trace_record_t)
+                || sizeof(header) + header.num_pieces * sizeof(native_trace_record_t) > mMapSize)
+            {
+                fprintf(stderr, "Corrupt or incompatible native trace %s\n", path);
+                exit(1);
+            }
+            mRecords = (const native_trace_record_t *)(mMap + sizeof(header));
+            mNumPieces = header.num_pieces;
+        }
+
+        ~native_trace_reader_t()
+        {
+            if (mMap)
+                munmap((void *)mMap, mMapSize);
+        }
+
+        native_trace_reader_t(const native_trace_reader_t&) = delete;
+        native_trace_reader_t& operator=(const native_trace_reader_t&) = delete;
+
+        // Moves to piece num_pieces (at most the end of the trace).
+        void seek(uint64_t num_pieces)
+        {
+            mNext = (num_pieces < mNumPieces) ? num_pieces : mNumPieces;
+        }
+
+        bool next(db_t& inst)
+        {
+            if (mNext == mNumPieces)
+                return false;
+            mRecords[mNext++].decode(inst);
+            return true;
+        }
+};
@@ -23,59 +23,15 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <inttypes.h>
-
-bool VP_ENABLE = false;
-bool VP_PERFECT = false;
-uint64_t VP_TRACK = 0;
-uint64_t WINDOW_SIZE = 1024; //old_value = 512;
-uint64_t FETCH_WIDTH = 16;
-uint64_t FETCH_NUM_BRANCH = 16;     // 0: unlimited; >0: finite
-bool FETCH_STOP_AT_INDIRECT = true;
-bool FETCH_STOP_AT_TAKEN = true;
-bool FETCH_MODEL_ICACHE = true;
-
-bool PERFECT_BRANCH_PRED = false;
-bool PERFECT_INDIRECT_PRED = true;    // old_value = false
-uint64_t PIPELINE_FILL_LATENCY = 10; // old_value =5;
-uint64_t NUM_LDST_LANES = 8;
-uint64_t NUM_ALU_LANES = 16;
-
-bool PREFETCHER_ENABLE = true;
-bool PERFECT_CACHE = false;
-bool WRITE_ALLOCATE = true;
-
-uint64_t IC_SIZE = (1 << 17);
-uint64_t IC_ASSOC = 8;
-uint64_t IC_BLOCKSIZE = 64;
-
-uint64_t L1_SIZE = (1 << 17); // old_value = (1 << 16);
-uint64_t L1_ASSOC = 8;
-uint64_t L1_BLOCKSIZE = 64;
-uint64_t L1_LATENCY = 3;
-
-uint64_t L2_SIZE = (1 << 22); // old_value = (1 << 20);
-uint64_t L2_ASSOC = 8;
-uint64_t L2_BLOCKSIZE = 64;
-uint64_t L2_LATENCY = 12;
-
-uint64_t L3_SIZE = (1 << 25); // old_value = (1 << 23);
-uint64_t L3_ASSOC = 16;
-uint64_t L3_BLOCKSIZE = 128;
-uint64_t L3_LATENCY = 50; // old_value = 60;
-
-uint64_t MAIN_MEMORY_LATENCY = 150;
-
-uint64_t DEFAULT_EXEC_LATENCY = 1;
-uint64_t FP_EXEC_LATENCY = 3;
-uint64_t SLOW_ALU_EXEC_LATENCY = 4;
-
-uint64_t LOG_LEVEL = 0;
-uint64_t LOG_START_CYCLE = 0;
-uint64_t LOG_END_CYCLE = 0;
-
-uint64_t DQ_LATENCY = 2;
-
-uint64_t MISP_REDUCTION_PERC = 0;
-
-uint64_t EPOCH_SIZE_INSTS = 1000000;
-bool PRINT_PER_EPOCH_STATS = false;
+#include "parameters.h"
+
+uint64_t PREDICTOR_CONFIG = 0;
+const char * BRANCH_PROFILE_CSV = nullptr;
+uint64_t BRANCH_PROFILE_TOP_N = 100;
+const char * EVENT_TRACE_FILE = nullptr;
+uint64_t EVENT_TRACE_ONE_IN_N = 1;
+const char * BRANCH_DATASET_FILE = nullptr;
+uint64_t BRANCH_DATASET_HISTORY_BITS = 64;
+const char * TABLE_HEATMAP_FILE = nullptr;
+uint64_t TABLE_HEATMAP_ONE_IN_N = 64;
+uint64_t TABLE_HEATMAP_REGIONS = 64;
@@ -24,6 +24,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef _PARAMETERS_H_
 #define _PARAMETERS_H_
 
+#include <inttypes.h>
+
 enum class VPTracks
 {
     ALL  = 0,
@@ -32,58 +34,116 @@ enum class VPTracks
     NumTracks
 };
 
-extern bool VP_ENABLE;
-extern bool VP_PERFECT;
-extern uint64_t VP_TRACK;
-extern uint64_t WINDOW_SIZE;
-extern uint64_t FETCH_WIDTH;
-extern uint64_t FETCH_NUM_BRANCH;
-extern bool FETCH_STOP_AT_INDIRECT;
-extern bool FETCH_STOP_AT_TAKEN;
-extern bool FETCH_MODEL_ICACHE;
-
-extern bool PERFECT_BRANCH_PRED;
-extern bool PERFECT_INDIRECT_PRED;
-extern uint64_t PIPELINE_FILL_LATENCY;
-extern uint64_t NUM_LDST_LANES;
-extern uint64_t NUM_ALU_LANES;
-
-extern bool PREFETCHER_ENABLE;
-extern bool PERFECT_CACHE;
-extern bool WRITE_ALLOCATE;
-
-extern uint64_t IC_SIZE;
-extern uint64_t IC_ASSOC;
-extern uint64_t IC_BLOCKSIZE;
-
-extern uint64_t L1_SIZE;
-extern uint64_t L1_ASSOC;
-extern uint64_t L1_BLOCKSIZE;
-extern uint64_t L1_LATENCY;
-
-extern uint64_t L2_SIZE;
-extern uint64_t L2_ASSOC;
-extern uint64_t L2_BLOCKSIZE;
-extern uint64_t L2_LATENCY;
-
-extern uint64_t L3_SIZE;
-extern uint64_t L3_ASSOC;
-extern uint64_t L3_BLOCKSIZE;
-extern uint64_t L3_LATENCY;
-
-extern uint64_t MAIN_MEMORY_LATENCY;
-
-extern uint64_t DEFAULT_EXEC_LATENCY;
-extern uint64_t FP_EXEC_LATENCY;
-extern uint64_t SLOW_ALU_EXEC_LATENCY;
-
-extern uint64_t LOG_LEVEL;
-extern uint64_t LOG_START_CYCLE;
-extern uint64_t LOG_END_CYCLE;
-
-extern uint64_t DQ_LATENCY;
-extern uint64_t MISP_REDUCTION_PERC;
-
-extern uint64_t EPOCH_SIZE_INSTS;
-extern bool PRINT_PER_EPOCH_STATS;
+// Simulator knobs, set from the command line (lib/cbp.cc).
+// Passed by value to uarchsim_t, bp_only_sim_t and the structures they construct (bp_t, caches), so that several
+// simulations with different configurations can run in one process.
+struct sim_config_t {
+   bool VP_ENABLE = false;
+   bool VP_PERFECT = false;
+   uint64_t VP_TRACK = 0;
+   uint64_t WINDOW_SIZE = 1024; //old_value = 512;
+   uint64_t FETCH_WIDTH = 16;
+   uint64_t FETCH_NUM_BRANCH = 16;     // 0: unlimited; >0: finite
+   bool FETCH_STOP_AT_INDIRECT = true;
+   bool FETCH_STOP_AT_TAKEN = true;
+   bool FETCH_MODEL_ICACHE = true;
+
+   bool PERFECT_BRANCH_PRED = false;
+   bool PERFECT_INDIRECT_PRED = true;    // old_value = false
+   uint64_t RAS_SIZE = 0;               // return address stack entries (-r); 0: returns are predicted as the other indirect jumps
+   uint64_t PIPELINE_FILL_LATENCY = 10; // old_value =5;
+   uint64_t NUM_LDST_LANES = 8;
+   uint64_t NUM_ALU_LANES = 16;
+
+   bool PREFETCHER_ENABLE = true;
+   bool PERFECT_CACHE = false;
+   bool WRITE_ALLOCATE = true;
+   bool CACHE_TREE_PLRU = false;        // tree pseudo-LRU instead of LRU replacement in all the caches
+   uint64_t CACHE_SET_SAMPLING = 1;     // the L2$ and L3$ model 1 in CACHE_SET_SAMPLING of their sets (-m), 1: all of them
+
+   uint64_t IC_SIZE = (1 << 17);
+   uint64_t IC_ASSOC = 8;
+   uint64_t IC_BLOCKSIZE = 64;
+
+   uint64_t L1_SIZE = (1 << 17); // old_value = (1 << 16);
+   uint64_t L1_ASSOC = 8;
+   uint64_t L1_BLOCKSIZE = 64;
+   uint64_t L1_LATENCY = 3;
+
+   uint64_t L2_SIZE = (1 << 22); // old_value = (1 << 20);
+   uint64_t L2_ASSOC = 8;
+   uint64_t L2_BLOCKSIZE = 64;
+   uint64_t L2_LATENCY = 12;
+
+   uint64_t L3_SIZE = (1 << 25); // old_value = (1 << 23);
+   uint64_t L3_ASSOC = 16;
+   uint64_t L3_BLOCKSIZE = 128;
+   uint64_t L3_LATENCY = 50; // old_value = 60;
+
+   uint64_t MAIN_MEMORY_LATENCY = 150;
+
+   uint64_t DEFAULT_EXEC_LATENCY = 1;
+   uint64_t FP_EXEC_LATENCY = 3;
+   uint64_t SLOW_ALU_EXEC_LATENCY = 4;
+
+   uint64_t LOG_LEVEL = 0;
+   uint64_t LOG_START_CYCLE = 0;
+   uint64_t LOG_END_CYCLE = 0;
+
+   uint64_t DQ_LATENCY = 2;
+
+   uint64_t MISP_REDUCTION_PERC = 0;
+
+   uint64_t EPOCH_SIZE_INSTS = 1000000;
+   bool PRINT_PER_EPOCH_STATS = false;
+
+   bool PIPELINED_TRACE_READ = false;
+
+   // Early termination (-c, convergence.h): the run stops once the 95% confidence interval of the conditional MPKI
+   // over the epochs after the first EARLY_STOP_WARMUP_EPOCHS, and with EARLY_STOP_IPC that of the CPI too, has stayed
+   // within EARLY_STOP_REL_ERROR of the mean for EARLY_STOP_EPOCHS epochs in a row. 0 epochs: never.
+   double EARLY_STOP_REL_ERROR = 0.0;
+   uint64_t EARLY_STOP_EPOCHS = 0;
+   uint64_t EARLY_STOP_WARMUP_EPOCHS = 0;
+   bool EARLY_STOP_IPC = false;
+
+   bool BRANCH_ONLY_MODE = false;
+   uint64_t BRANCH_ONLY_RESOLVE_DELAY = 0;
+   // Analytic timing model (-n, analytic_sim.h) instead of uarchsim_t.
+   bool ANALYTIC_MODE = false;
+   // Sampled simulation (-U): every SAMPLE_PERIOD_INSTS instructions, a unit of SAMPLE_UNIT_INSTS instructions is
+   // measured after SAMPLE_WARMUP_INSTS of detailed warmup; the rest is only functionally warmed. 0: no sampling.
+   uint64_t SAMPLE_UNIT_INSTS = 0;
+   uint64_t SAMPLE_PERIOD_INSTS = 0;
+   uint64_t SAMPLE_WARMUP_INSTS = 0;
+   // Phase-adaptive sampling (-U phase,...): the period is an interval whose unit is measured only if the interval is
+   // predicted to be of a phase without a measurement yet (see phase_detector.h); its other intervals are warmed.
+   bool SAMPLE_PHASES = false;
+   double SAMPLE_PHASE_THRESHOLD = 0.1;
+};
+
+// Index of the predictor instance in fan-out mode (-N), for predictor code that selects a variant from it.
+// Process-wide, like the predictor hooks of cbp.h.
+extern uint64_t PREDICTOR_CONFIG;
+
+// Per-branch misprediction profile (-H): the predictor writes its BRANCH_PROFILE_TOP_N most mispredicted branches to
+// BRANCH_PROFILE_CSV at endCondDirPredictor(), if set.
+extern const char * BRANCH_PROFILE_CSV;
+extern uint64_t BRANCH_PROFILE_TOP_N;
+
+// Predictor event trace (-V, lib/event_trace.h): 1 in EVENT_TRACE_ONE_IN_N conditional branches traced to
+// EVENT_TRACE_FILE, if set.
+extern const char * EVENT_TRACE_FILE;
+extern uint64_t EVENT_TRACE_ONE_IN_N;
+
+// Branch outcome dataset (-x, lib/branch_dataset.h): every conditional branch written to BRANCH_DATASET_FILE, if set,
+// with the outcomes of the BRANCH_DATASET_HISTORY_BITS conditional branches before it.
+extern const char * BRANCH_DATASET_FILE;
+extern uint64_t BRANCH_DATASET_HISTORY_BITS;
+
+// Predictor table heatmaps (CBP_TABLE_HEATMAP, lib/table_heatmap.h): the lookups of 1 in TABLE_HEATMAP_ONE_IN_N
+// branches and entries, by TABLE_HEATMAP_REGIONS regions of each table, written to TABLE_HEATMAP_FILE, if set.
+extern const char * TABLE_HEATMAP_FILE;
+extern uint64_t TABLE_HEATMAP_ONE_IN_N;
+extern uint64_t TABLE_HEATMAP_REGIONS;
 #endif
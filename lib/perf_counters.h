@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Host hardware counters of the calling thread, through Linux perf_event_open: cycles, instructions, L1 D$ read
+// misses, last-level cache misses and branch misses, counted in user mode only.
+//
+// The events are opened as one group, so that they are always scheduled (and multiplexed) together. Reads use rdpmc
+// from the event's mmapped page where the kernel allows it, which costs a few tens of cycles, and fall back to a read()
+// of the group otherwise. An event that cannot be opened (e.g. in a VM without a virtual PMU) reads as 0 and is
+// reported as unavailable.
+class perf_counters_t
+{
+    public:
+        enum event_t { CYCLES = 0, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+    private:
+        int fds[NUM_EVENTS];
+        perf_event_mmap_page * pages[NUM_EVENTS] = {};
+        int leader = -1;
+        int num_open = 0;
+        int group_slot[NUM_EVENTS];     // position of each event in a group read, -1 if not open
+        bool rdpmc = false;
+        int error = 0;                  // errno of the first event that failed to open
+
+        static uint64_t event_config(event_t e, uint32_t& type)
+        {
+            type = PERF_TYPE_HARDWARE;
+            switch (e)
+            {
+                case CYCLES:        return PERF_COUNT_HW_CPU_CYCLES;
+                case INSTRUCTIONS:  return PERF_COUNT_HW_INSTRUCTIONS;
+                case LLC_MISSES:    return PERF_COUNT_HW_CACHE_MISSES;
+                case BRANCH_MISSES: return PERF_COUNT_HW_BRANCH_MISSES;
+                default:
+                    type = PERF_TYPE_HW_CACHE;
+                    return PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            }
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        static uint64_t read_pmc(uint32_t counter)
+        {
+            uint32_t lo, hi;
+            asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+            return ((uint64_t)hi << 32) | lo;
+        }
+
+        // Count of an event from its mmapped page, retried while the kernel updates the page. false if the event is
+        // not on a counter at the moment (multiplexed out), for the caller to fall back to read().
+        static bool read_page(const perf_event_mmap_page * page, uint64_t& count)
+        {
+            uint32_t seq;
+            bool ok;
+            do
+            {
+                seq = page->lock;
+                asm volatile("" ::: "memory");
+                const uint32_t index = page->index;
+                count = page->offset;
+                ok = page->cap_user_rdpmc && (index != 0);
+                if (ok)
+                {
+                    const int shift = 64 - page->pmc_width;
+                    count += (uint64_t)(((int64_t)read_pmc(index - 1) << shift) >> shift);
+                }
+                asm volatile("" ::: "memory");
+            } while (page->lock != seq);
+            return ok;
+        }
+#endif
+
+    public:
+        perf_counters_t()
+        {
+            for (int e = 0; e < NUM_EVENTS; e++)
+            {
+                fds[e] = -1;
+                group_slot[e] = -1;
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.config = event_config((event_t)e, attr.type);
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.disabled = (leader < 0);
+                fds[e] = syscall(SYS_perf_event_open, &attr, 0 /*this thread*/, -1 /*any cpu*/, leader, 0);
+                if (fds[e] < 0)
+                {
+                    if (!error)
+                        error = errno;
+                    continue;
+                }
+                if (leader < 0)
+                    leader = fds[e];
+                group_slot[e] = num_open++;
+                void * page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[e], 0);
+                pages[e] = (page == MAP_FAILED) ? nullptr : (perf_event_mmap_page *)page;
+            }
+            if (leader >= 0)
+            {
+                ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+                rdpmc = true;
+                for (int e = 0; e < NUM_EVENTS; e++)
+                    rdpmc = rdpmc && ((fds[e] < 0) || (pages[e] && pages[e]->cap_user_rdpmc));
+            }
+        }
+
+        ~perf_counters_t()
+        {
+            for (int e = 0; e < NUM_EVENTS; e++)
+            {
+                if (pages[e])
+                    munmap(pages[e], sysconf(_SC_PAGESIZE));
+                if (fds[e] >= 0)
+                    close(fds[e]);
+            }
+        }
+
+        perf_counters_t(const perf_counters_t&) = delete;
+        perf_counters_t& operator=(const perf_counters_t&) = delete;
+
+        bool available(event_t e) const
+        {
+            return fds[e] >= 0;
+        }
+
+        bool any_available() const
+        {
+            return leader >= 0;
+        }
+
+        int open_error() const
+        {
+            return error;
+        }
+
+        // Current counts of all the events, 0 for those not available.
+        void read(uint64_t counts[NUM_EVENTS]) const
+        {
+            bool ok = false;
+#if defined(__x86_64__) || defined(__i386__)
+            if (rdpmc)
+            {
+                ok = true;
+                for (int e = 0; (e < NUM_EVENTS) && ok; e++)
+                {
+                    counts[e] = 0;
+                    if (fds[e] >= 0)
+                        ok = read_page(pages[e], counts[e]);
+                }
+            }
+#endif
+            if (!ok)
+            {
+                uint64_t group[1 + NUM_EVENTS] = {};
+                if ((leader < 0) || (::read(leader, group, sizeof(group)) < (ssize_t)sizeof(uint64_t)))
+                    memset(group, 0, sizeof(group));
+                for (int e = 0; e < NUM_EVENTS; e++)
+                    counts[e] = (group_slot[e] >= 0) ? group[1 + group_slot[e]] : 0;
+            }
+        }
+};
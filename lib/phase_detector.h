@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Online phase detection for phase-adaptive sampling (-U phase,...): the trace is cut into intervals, each summarized
+// by a signature of the branches it ran, and an interval joins the first phase seen before whose signature is within
+// the threshold of its own, or starts a new phase.
+//
+// The signature is a basic block vector folded into BUCKETS counters, as the working-set signatures of online phase
+// trackers are: at every branch, the instructions since the one before it are added to the bucket of a hash of its PC.
+// The distance between two signatures is the Manhattan distance of the normalized vectors, halved, so from 0 (the
+// same mix of blocks) to 1 (no bucket in common). A phase keeps the signature of its first interval, so that a slow
+// drift does not carry it over to another phase.
+class phase_detector_t
+{
+    public:
+        static constexpr int BUCKETS = 32;
+
+        struct phase_t
+        {
+            double signature[BUCKETS];
+            uint64_t intervals = 0;
+            uint64_t insts = 0;             // in all the intervals of the phase
+            uint64_t measured = 0;          // intervals of the phase simulated in detail
+        };
+
+    private:
+        double threshold;
+        std::vector<phase_t> phases;
+        uint64_t counts[BUCKETS] = {};
+        uint64_t total = 0;
+        uint64_t block_insts = 0;
+
+        static int bucket(uint64_t pc)
+        {
+            return ((pc >> 2) * 0x9E3779B97F4A7C15ull) >> 59;
+        }
+
+        double distance(const double * a, const double * b) const
+        {
+            double d = 0.0;
+            for (int k = 0; k < BUCKETS; k++)
+                d += std::abs(a[k] - b[k]);
+            return d / 2.0;
+        }
+
+    public:
+        explicit phase_detector_t(double _threshold)
+        : threshold(_threshold)
+        {
+            static_assert(BUCKETS == 32, "bucket() keeps the top 5 bits of the hash");
+        }
+
+        // Counts an instruction of the current interval (the last piece of a trace instruction).
+        void count(uint64_t pc, bool is_branch)
+        {
+            block_insts++;
+            if (!is_branch)
+                return;
+            counts[bucket(pc)] += block_insts;
+            total += block_insts;
+            block_insts = 0;
+        }
+
+        // Ends the current interval, of insts instructions, and returns the phase it belongs to.
+        uint64_t classify(uint64_t insts)
+        {
+            double signature[BUCKETS];
+            for (int k = 0; k < BUCKETS; k++)
+                signature[k] = total ? ((double)counts[k] / (double)total) : 0.0;
+            for (uint64_t& c : counts)
+                c = 0;
+            total = 0;
+            block_insts = 0;
+
+            uint64_t id = phases.size();
+            for (uint64_t p = 0; (p < phases.size()) && (id == phases.size()); p++)
+                if (distance(signature, phases[p].signature) <= threshold)
+                    id = p;
+            if (id == phases.size())
+            {
+                phases.emplace_back();
+                for (int k = 0; k < BUCKETS; k++)
+                    phases.back().signature[k] = signature[k];
+            }
+            phases[id].intervals++;
+            phases[id].insts += insts;
+            return id;
+        }
+
+        // Whether the intervals of phase id already have a measurement to be extrapolated from.
+        bool is_measured(uint64_t id) const
+        {
+            return phases[id].measured > 0;
+        }
+
+        void add_measurement(uint64_t id)
+        {
+            phases[id].measured++;
+        }
+
+        const std::vector<phase_t>& get_phases() const
+        {
+            return phases;
+        }
+};
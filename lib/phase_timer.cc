@@ -0,0 +1,261 @@
+#include "phase_timer.h"
+
+#ifdef CBP_PHASE_TIMERS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+thread_local phase_clock_t * phase_clock_ptr = nullptr;
+
+namespace {
+
+const char * const phase_names[NUM_PHASES] = {"Driver", "Decode", "Step", "Pipe", "Cache", "Predict", "Hooks", "SpecUpd"};
+
+std::mutex clocks_mutex;
+std::vector<std::unique_ptr<phase_clock_t>> clocks;   // kept until exit, as threads may end before the report
+
+// Counter value and time at the first registration, to convert ticks to seconds.
+uint64_t start_ticks = 0;
+std::chrono::steady_clock::time_point start_time;
+
+#ifdef CBP_PERF_COUNTERS
+// Called with clocks_mutex held.
+void perf_counters_report()
+{
+    const perf_counters_t& counters = clocks.front()->counters;
+    if (!counters.any_available())
+    {
+        printf("\nHost performance counters unavailable: %s\n", strerror(counters.open_error()));
+        return;
+    }
+
+    uint64_t events[NUM_PHASES][perf_counters_t::NUM_EVENTS] = {};
+    for (const auto& clock : clocks)
+        for (int p = 0; p < NUM_PHASES; p++)
+            for (int e = 0; e < perf_counters_t::NUM_EVENTS; e++)
+                events[p][e] += clock->events[p][e];
+
+    auto per_kilo_instr = [&](int p, perf_counters_t::event_t e) {
+        const uint64_t instrs = events[p][perf_counters_t::INSTRUCTIONS];
+        return instrs ? 1000.0 * (double)events[p][e] / (double)instrs : 0.0;
+    };
+
+    printf("\n----------------------------------------HOST PERFORMANCE COUNTERS (perf_event, All Threads)----------------------------------------\n");
+    printf("Phase             Cycles           Instrs     IPC   L1D MPKI   LLC MPKI  BrMiss MPKI\n");
+    for (int p = 0; p < NUM_PHASES; p++)
+    {
+        const uint64_t cycles = events[p][perf_counters_t::CYCLES];
+        printf("%-8s %15lu %16lu %7.3f %10.3f %10.3f %12.3f\n", phase_names[p], cycles, events[p][perf_counters_t::INSTRUCTIONS],
+               cycles ? (double)events[p][perf_counters_t::INSTRUCTIONS] / (double)cycles : 0.0,
+               per_kilo_instr(p, perf_counters_t::L1D_MISSES), per_kilo_instr(p, perf_counters_t::LLC_MISSES),
+               per_kilo_instr(p, perf_counters_t::BRANCH_MISSES));
+    }
+    if (counters.open_error())
+        printf("Some events are unavailable (%s) and read as 0\n", strerror(counters.open_error()));
+    printf("MPKI are per 1000 host instructions\n");
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+}
+#endif
+
+#ifdef CBP_ALLOC_STATS
+// Allocations of the threads with no clock, as Unscoped (the clocks themselves are allocated before they are set).
+std::atomic<uint64_t> unscoped_allocs(0);
+std::atomic<uint64_t> unscoped_alloc_bytes(0);
+
+// Totals at the end of the warm-up, Unscoped last.
+bool steady = false;
+uint64_t steady_uops = 0;
+uint64_t steady_allocs[NUM_PHASES + 1] = {};
+
+void count_alloc(size_t n)
+{
+    phase_clock_t * clock = phase_clock_ptr;
+    if (clock)
+    {
+        clock->allocs[clock->current]++;
+        clock->alloc_bytes[clock->current] += n;
+    }
+    else
+    {
+        unscoped_allocs.fetch_add(1, std::memory_order_relaxed);
+        unscoped_alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+void * counted_alloc(size_t n, size_t align = 0)
+{
+    count_alloc(n);
+    void * p = nullptr;
+    if (align > alignof(std::max_align_t))
+    {
+        if (posix_memalign(&p, align, n ? n : 1) != 0)
+            p = nullptr;
+    }
+    else
+        p = malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+// Called with clocks_mutex held.
+void sum_allocs(uint64_t * allocs, uint64_t * bytes)
+{
+    for (int p = 0; p <= NUM_PHASES; p++)
+        allocs[p] = bytes[p] = 0;
+    for (const auto& clock : clocks)
+        for (int p = 0; p < NUM_PHASES; p++)
+        {
+            allocs[p] += clock->allocs[p];
+            bytes[p] += clock->alloc_bytes[p];
+        }
+    allocs[NUM_PHASES] = unscoped_allocs.load(std::memory_order_relaxed);
+    bytes[NUM_PHASES] = unscoped_alloc_bytes.load(std::memory_order_relaxed);
+}
+
+// Called with clocks_mutex held.
+void alloc_stats_report(uint64_t num_uops)
+{
+    uint64_t allocs[NUM_PHASES + 1], bytes[NUM_PHASES + 1];
+    sum_allocs(allocs, bytes);
+    const uint64_t steady_run_uops = (num_uops > steady_uops) ? num_uops - steady_uops : 0;
+    auto per_kilo_uop = [](uint64_t n, uint64_t uops) { return uops ? 1000.0 * (double)n / (double)uops : 0.0; };
+
+    printf("\n----------------------------------------ALLOCATIONS (operator new, All Threads)----------------------------------------\n");
+    printf("Phase             Allocs            Bytes  Allocs/Kuop  Bytes/uop     Steady  Steady/Kuop\n");
+    uint64_t total = 0, total_bytes = 0, total_steady = 0;
+    for (int p = 0; p <= NUM_PHASES; p++)
+    {
+        const uint64_t s = steady ? allocs[p] - steady_allocs[p] : 0;
+        printf("%-8s %15lu %16lu %12.3f %10.3f %10lu %12.3f\n", (p < NUM_PHASES) ? phase_names[p] : "Unscoped", allocs[p], bytes[p],
+               per_kilo_uop(allocs[p], num_uops), num_uops ? (double)bytes[p] / (double)num_uops : 0.0, s, per_kilo_uop(s, steady_run_uops));
+        total += allocs[p];
+        total_bytes += bytes[p];
+        total_steady += s;
+    }
+    printf("%-8s %15lu %16lu %12.3f %10.3f %10lu %12.3f\n", "Total", total, total_bytes, per_kilo_uop(total, num_uops),
+           num_uops ? (double)total_bytes / (double)num_uops : 0.0, total_steady, per_kilo_uop(total_steady, steady_run_uops));
+    if (steady)
+        printf("Steady state: the %lu uops after the first epoch\n", steady_run_uops);
+    else
+        printf("No steady state: the run ended within its first epoch\n");
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+
+    const char * limit = getenv("CBP_STEADY_ALLOC_LIMIT");
+    if (limit && (!steady || (per_kilo_uop(total_steady, steady_run_uops) > atof(limit))))
+    {
+        fflush(stdout);
+        if (steady)
+            fprintf(stderr, "Steady-state allocations of %.3f per 1000 uops, above CBP_STEADY_ALLOC_LIMIT=%s\n", per_kilo_uop(total_steady, steady_run_uops), limit);
+        else
+            fprintf(stderr, "CBP_STEADY_ALLOC_LIMIT: the run has no steady state to check\n");
+        exit(1);
+    }
+}
+#endif
+
+} // namespace
+
+#ifdef CBP_ALLOC_STATS
+void alloc_stats_steady(uint64_t num_uops)
+{
+    std::lock_guard<std::mutex> lock(clocks_mutex);
+    if (steady)
+        return;
+    uint64_t bytes[NUM_PHASES + 1];
+    sum_allocs(steady_allocs, bytes);
+    steady = true;
+    steady_uops = num_uops;
+}
+
+void * operator new(size_t n) { return counted_alloc(n); }
+void * operator new[](size_t n) { return counted_alloc(n); }
+void * operator new(size_t n, std::align_val_t align) { return counted_alloc(n, (size_t)align); }
+void * operator new[](size_t n, std::align_val_t align) { return counted_alloc(n, (size_t)align); }
+
+void * operator new(size_t n, const std::nothrow_t&) noexcept
+{
+    try { return counted_alloc(n); } catch (...) { return nullptr; }
+}
+
+void * operator new[](size_t n, const std::nothrow_t&) noexcept
+{
+    try { return counted_alloc(n); } catch (...) { return nullptr; }
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+void operator delete(void * p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { free(p); }
+void operator delete(void * p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void * p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void * p, const std::nothrow_t&) noexcept { free(p); }
+#endif
+
+phase_clock_t& phase_clock_register()
+{
+    std::lock_guard<std::mutex> lock(clocks_mutex);
+    clocks.emplace_back(new phase_clock_t());
+    phase_clock_ptr = clocks.back().get();
+    phase_clock_ptr->last = phase_clock_t::now();
+#ifdef CBP_PERF_COUNTERS
+    phase_clock_ptr->counters.read(phase_clock_ptr->last_events);
+#endif
+    if (clocks.size() == 1)
+    {
+        start_ticks = phase_clock_ptr->last;
+        start_time = std::chrono::steady_clock::now();
+    }
+    return *phase_clock_ptr;
+}
+
+void phase_timers_report(uint64_t num_uops, uint64_t num_branches)
+{
+    // charge the time up to now to the phase of the reporting thread
+    phase_clock_t& self = phase_clock();
+    self.leave(self.current);
+
+    std::lock_guard<std::mutex> lock(clocks_mutex);
+    const double wall_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time).count();
+    const double ns_per_tick = wall_ns / (double)(self.last - start_ticks);
+
+    uint64_t ticks[NUM_PHASES] = {};
+    uint64_t calls[NUM_PHASES] = {};
+    uint64_t total_ticks = 0;
+    for (const auto& clock : clocks)
+        for (int p = 0; p < NUM_PHASES; p++)
+        {
+            ticks[p] += clock->ticks[p];
+            calls[p] += clock->calls[p];
+            total_ticks += clock->ticks[p];
+        }
+
+    printf("\n----------------------------------------SIMULATOR THROUGHPUT (Phase Timers, All Threads)----------------------------------------\n");
+    printf("Phase        Time(s)    Share          Calls    ns/call\n");
+    for (int p = 0; p < NUM_PHASES; p++)
+        printf("%-8s %11.3f %7.2f%% %14lu %10.2f\n", phase_names[p], ticks[p] * ns_per_tick * 1e-9, 100.0 * (double)ticks[p] / (double)total_ticks,
+               calls[p], calls[p] ? (ticks[p] * ns_per_tick / (double)calls[p]) : 0.0);
+    printf("Wall time    = %.3f s (%lu thread%s)\n", wall_ns * 1e-9, clocks.size(), (clocks.size() > 1) ? "s" : "");
+    printf("uops/sec     = %.0f\n", (double)num_uops / (wall_ns * 1e-9));
+    printf("ns/branch    = %.2f\n", num_branches ? wall_ns / (double)num_branches : 0.0);
+    printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+#ifdef CBP_PERF_COUNTERS
+    perf_counters_report();
+#endif
+#ifdef CBP_ALLOC_STATS
+    alloc_stats_report(num_uops);
+#endif
+}
+
+#endif
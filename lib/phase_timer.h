@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+
+// Where the simulator's own time goes (make PHASE_TIMERS=1): trace decode, the timing model, the pipe evaluation,
+// the caches, the branch predictor and the predictor hooks.
+//
+// Each thread is in one phase at a time. PHASE_SCOPE(p) switches to phase p until the end of the enclosing scope, and
+// the time stamp counter ticks elapsed since the last switch are charged to the phase being left, so nested phases
+// are exclusive: the time in the cache while stepping is charged to the cache, not to step. Time outside of any
+// scope is charged to the driver loop. A switch costs one counter read.
+// phase_timers_report() prints the totals of all the threads, with the simulation throughput.
+// Without PHASE_TIMERS, the scopes compile to nothing and the report prints nothing.
+//
+// With PERF_COUNTERS (which implies PHASE_TIMERS), each switch also reads the host hardware counters of the thread
+// (perf_counters.h) and charges their deltas to the phase being left in the same way, to tell which phases are bound
+// by cache misses or host branch mispredictions. A switch then costs one rdpmc per counter.
+//
+// With ALLOC_STATS (which also implies PHASE_TIMERS), operator new is replaced by one that counts the allocations and
+// their bytes, charged to the phase of the allocating thread as the call-site category: a new db_t to Decode, the
+// lists and checkpoints of the window to Pipe and Step, those of the predictor to Predict, SpecUpd and Hooks. Threads
+// outside of any scope (the trace readers) are charged as Unscoped. alloc_stats_steady() marks the end of the warm-up
+// (the first epoch), and the report gives the allocations per 1000 uops over the whole run and in the steady state
+// after the mark, which is to be zero once the hot paths allocate nothing: with the environment variable
+// CBP_STEADY_ALLOC_LIMIT=<allocations per 1000 uops>, a run above the limit fails (exit status 1) after its report.
+
+enum phase_t : uint8_t
+{
+    PHASE_DRIVER = 0,   // outside of any scope: the main loop, trace pipeline hand-off
+    PHASE_DECODE,       // TraceReader::next
+    PHASE_STEP,         // uarchsim_t::step and bp_only_sim_t::step, less the phases below
+    PHASE_PIPE,         // uarchsim_t::eval_cycles (decode, agen, execute and retire of the window)
+    PHASE_CACHE,        // cache_t::access
+    PHASE_PREDICT,      // bp_t::predict, i.e. get_cond_dir_prediction, less spec_update
+    PHASE_HOOKS,        // the notify_* calls, including the predictor update at execute
+    PHASE_SPEC_UPDATE,  // the spec_update calls of bp_t::predict
+    NUM_PHASES
+};
+
+#ifdef CBP_PHASE_TIMERS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#ifdef CBP_PERF_COUNTERS
+#include "perf_counters.h"
+#endif
+
+struct phase_clock_t
+{
+    uint64_t ticks[NUM_PHASES] = {};
+    uint64_t calls[NUM_PHASES] = {};
+    uint64_t last = 0;
+    phase_t current = PHASE_DRIVER;
+#ifdef CBP_ALLOC_STATS
+    uint64_t allocs[NUM_PHASES] = {};
+    uint64_t alloc_bytes[NUM_PHASES] = {};
+#endif
+#ifdef CBP_PERF_COUNTERS
+    perf_counters_t counters;
+    uint64_t events[NUM_PHASES][perf_counters_t::NUM_EVENTS] = {};
+    uint64_t last_events[perf_counters_t::NUM_EVENTS] = {};
+
+    void charge_events()
+    {
+        uint64_t e[perf_counters_t::NUM_EVENTS];
+        counters.read(e);
+        for (int i = 0; i < perf_counters_t::NUM_EVENTS; i++)
+        {
+            events[current][i] += e[i] - last_events[i];
+            last_events[i] = e[i];
+        }
+    }
+#endif
+
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t v;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+        return v;
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    phase_t enter(phase_t p)
+    {
+        const uint64_t t = now();
+        ticks[current] += t - last;
+        last = t;
+#ifdef CBP_PERF_COUNTERS
+        charge_events();
+#endif
+        calls[p]++;
+        const phase_t prev = current;
+        current = p;
+        return prev;
+    }
+
+    void leave(phase_t prev)
+    {
+        const uint64_t t = now();
+        ticks[current] += t - last;
+        last = t;
+#ifdef CBP_PERF_COUNTERS
+        charge_events();
+#endif
+        current = prev;
+    }
+};
+
+// The clock of the calling thread, registered for the report on first use.
+extern thread_local phase_clock_t * phase_clock_ptr;
+phase_clock_t& phase_clock_register();
+
+inline phase_clock_t& phase_clock()
+{
+    return phase_clock_ptr ? *phase_clock_ptr : phase_clock_register();
+}
+
+class phase_scope_t
+{
+    private:
+        phase_clock_t& clock;
+        const phase_t prev;
+
+    public:
+        explicit phase_scope_t(phase_t p)
+        : clock(phase_clock()), prev(clock.enter(p))
+        {
+        }
+
+        ~phase_scope_t()
+        {
+            clock.leave(prev);
+        }
+
+        phase_scope_t(const phase_scope_t&) = delete;
+        phase_scope_t& operator=(const phase_scope_t&) = delete;
+};
+
+#define PHASE_SCOPE_NAME2(line) phase_scope_##line
+#define PHASE_SCOPE_NAME(line) PHASE_SCOPE_NAME2(line)
+#define PHASE_SCOPE(p) phase_scope_t PHASE_SCOPE_NAME(__LINE__)(p)
+
+void phase_timers_report(uint64_t num_uops, uint64_t num_branches);
+
+#else
+
+#define PHASE_SCOPE(p) do {} while (0)
+
+inline void phase_timers_report(uint64_t, uint64_t)
+{
+}
+
+#endif
+
+#ifdef CBP_ALLOC_STATS
+// End of the warm-up, num_uops into the run: the allocations from then on are those of the steady state.
+void alloc_stats_steady(uint64_t num_uops);
+#else
+inline void alloc_stats_steady(uint64_t)
+{
+}
+#endif
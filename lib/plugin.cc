@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include "plugin.h"
+#include "snapshot.h"
+
+namespace {
+
+// The hooks a plugin leaves out of its mask are never called by the timing model, but the branch-only one always
+// reports the resolution of a branch: these keep the table complete.
+void no_fetch(void *, uint64_t, uint8_t, uint64_t, uint64_t) {}
+void no_decode(void *, uint64_t, uint8_t, uint64_t, const DecodeInfo&, uint64_t) {}
+void no_agen(void *, uint64_t, uint8_t, uint64_t, const DecodeInfo&, uint64_t, uint64_t, uint64_t) {}
+void no_execute(void *, uint64_t, uint8_t, uint64_t, bool, const ExecuteInfo&, uint64_t) {}
+void no_commit(void *, uint64_t, uint8_t, uint64_t, bool, const ExecuteInfo&, uint64_t) {}
+void no_batch(void *, const cbp_batch_t&) {}
+void no_static_id(void *, uint64_t, uint8_t, uint64_t, uint32_t) {}
+
+[[noreturn]] void fail(const std::string& path, const char * what)
+{
+    fprintf(stderr, "Unable to load the predictor plugin %s: %s\n", path.c_str(), what);
+    exit(1);
+}
+
+} // namespace
+
+predictor_plugin_t::predictor_plugin_t(const char * spec)
+{
+    const std::string s(spec);
+    const size_t comma = s.find(',');
+    path = s.substr(0, comma);
+    if (comma != std::string::npos)
+        args = s.substr(comma + 1);
+
+    // RTLD_LOCAL: the symbols of a plugin do not resolve those of the plugins loaded after it.
+    library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+        fail(path, dlerror());
+    const cbp_plugin_entry_t entry = reinterpret_cast<cbp_plugin_entry_t>(dlsym(library, CBP_PLUGIN_ENTRY));
+    if (!entry)
+        fail(path, "no " CBP_PLUGIN_ENTRY "()");
+    api = entry(CBP_PLUGIN_ABI_VERSION);
+    if (!api || (api->abi_version != CBP_PLUGIN_ABI_VERSION))
+        fail(path, "built for another version of the plugin ABI (cbp_plugin.h)");
+    if ((api->decode_info_size != sizeof(DecodeInfo)) || (api->exec_info_size != sizeof(ExecuteInfo)))
+        fail(path, "built with other DecodeInfo or ExecuteInfo structures (lib/sim_common_structs.h)");
+    if (!api->create || !api->begin || !api->end || !api->get_cond_dir_prediction || !api->spec_update)
+        fail(path, "missing create, begin, end, get_cond_dir_prediction or spec_update");
+
+    const uint32_t h = api->hooks;
+    if (((h & CBP_HOOK_FETCH) && !api->notify_instr_fetch) || ((h & CBP_HOOK_DECODE) && !api->notify_instr_decode)
+        || ((h & CBP_HOOK_AGEN) && !api->notify_agen_complete) || ((h & CBP_HOOK_EXECUTE) && !api->notify_instr_execute_resolve)
+        || ((h & CBP_HOOK_COMMIT) && !api->notify_instr_commit) || ((h & CBP_HOOK_BATCH) && !api->notify_batch)
+        || ((h & CBP_HOOK_STATIC_ID) && !api->notify_static_id))
+        fail(path, "missing one of the notify_* hooks of its mask");
+    table = *api;
+    if (!(h & CBP_HOOK_FETCH))
+        table.notify_instr_fetch = no_fetch;
+    if (!(h & CBP_HOOK_DECODE))
+        table.notify_instr_decode = no_decode;
+    if (!(h & CBP_HOOK_AGEN))
+        table.notify_agen_complete = no_agen;
+    if (!(h & CBP_HOOK_EXECUTE))
+        table.notify_instr_execute_resolve = no_execute;
+    if (!(h & CBP_HOOK_COMMIT))
+        table.notify_instr_commit = no_commit;
+    if (!(h & CBP_HOOK_BATCH))
+        table.notify_batch = no_batch;
+    if (!(h & CBP_HOOK_STATIC_ID))
+        table.notify_static_id = no_static_id;
+
+    label = api->name ? api->name : path;
+    if (!args.empty())
+        label += ":" + args;
+}
+
+void * predictor_plugin_t::create() const
+{
+    void * instance = table.create(args.c_str());
+    if (!instance)
+    {
+        fprintf(stderr, "The predictor plugin %s could not create an instance for `%s`\n", path.c_str(), args.c_str());
+        exit(1);
+    }
+    return instance;
+}
+
+void predictor_plugin_t::activate()
+{
+    activate(create());
+}
+
+void predictor_plugin_t::activate(void * instance) const
+{
+    plugin_instance = instance;
+    active_plugin = this;
+    plugin_api = &table;
+    predictor_hooks = table.hooks;
+}
+
+void predictor_snapshot(snapshot_t& s)
+{
+    if (!plugin_api)
+        snapshot_cond_dir_predictor(s);
+    else if (plugin_api->snapshot)
+        plugin_api->snapshot(plugin_instance, s);
+    else
+    {
+        fprintf(stderr, "The predictor plugin does not support snapshots (-S, -s, -e)\n");
+        exit(1);
+    }
+}
+
+void predictor_dump(snapshot_t& s)
+{
+    if (!plugin_api)
+        dump_cond_dir_predictor(s);
+    else if (plugin_api->dump)
+        plugin_api->dump(plugin_instance, s);
+    else
+        predictor_snapshot(s);
+}
+
+bool predictor_freeze()
+{
+    if (!plugin_api)
+        return freeze_cond_dir_predictor();
+    return plugin_api->freeze && plugin_api->freeze(plugin_instance);
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "cbp_plugin.h"
+#include "lockstep.h"
+#include "shadow.h"
+#include "usdt.h"
+
+// Predictor plugins (-p <plugin.so>[,<args>]): predictors loaded at runtime through the ABI of cbp_plugin.h, in place
+// of the one linked into cbp.
+//
+// parseargs loads every plugin of the command line, in the parent process, so that their hooks are known before any
+// simulation. A process that simulates one of them activates it: it creates its instance, and from then on the
+// predictor calls of the simulator (the predictor_* functions below, behind the call_* ones of predictor_thread.h)
+// go to that instance. Without an active plugin they go to the hooks linked into cbp, as they always did. A single
+// plugin is active for the whole run; several are simulated side by side by the batch driver (-B) and the fan-out
+// modes (-N, -u), each in the workers it forks for them.
+//
+// This dispatch is the predictor type cbp_hooks_t of the simulator in libcbp.a (cbp_predictor.h). A driver of its own
+// instantiates the simulator over a predictor called without it (tools/inline_sim.cc).
+class predictor_plugin_t
+{
+    private:
+        void * library = nullptr;
+        const cbp_plugin_t * api = nullptr;
+        std::string path;
+        std::string args;
+        std::string label;          // name of the plugin, then :<args> if any
+        cbp_plugin_t table;         // api, with no-ops for the hooks it leaves out
+
+    public:
+        // Loads spec, <plugin.so>[,<args>]; exits if it cannot be loaded, or is not a plugin of this ABI.
+        explicit predictor_plugin_t(const char * spec);
+        predictor_plugin_t(const predictor_plugin_t&) = delete;
+        predictor_plugin_t& operator=(const predictor_plugin_t&) = delete;
+
+        // A new instance; exits if it cannot be created.
+        void * create() const;
+        // Creates the instance of this process and routes the predictor calls to it; exits if it cannot be created.
+        void activate();
+        // Routes the predictor calls to instance, one of create(): the instances of an interleaved fan-out worker take
+        // turns as the predictor of the process (fanout.h).
+        void activate(void * instance) const;
+
+        const std::string& get_path() const { return path; }
+        const std::string& get_args() const { return args; }
+        const std::string& get_label() const { return label; }
+        uint32_t hooks() const { return table.hooks; }
+        bool has_snapshots() const { return table.snapshot != nullptr; }
+        bool single_instance() const { return table.single_instance; }
+        const cbp_plugin_t& get_table() const { return table; }
+};
+
+// The plugins of the command line, in order.
+inline std::vector<std::unique_ptr<predictor_plugin_t>> predictor_plugins;
+
+// The active plugin, if any, its table and its instance.
+inline const predictor_plugin_t * active_plugin = nullptr;
+inline const cbp_plugin_t * plugin_api = nullptr;
+inline void * plugin_instance = nullptr;
+
+// The hooks of the predictor simulated by this process: cbp_hooks, or the active plugin's.
+inline uint32_t predictor_hooks = cbp_hooks;
+
+// The hooks of every predictor of the run, for the choices made before any is active (reading values from the trace).
+inline uint32_t all_predictor_hooks()
+{
+    if (predictor_plugins.empty())
+        return cbp_hooks;
+    uint32_t hooks = 0;
+    for (const std::unique_ptr<predictor_plugin_t>& plugin : predictor_plugins)
+        hooks |= plugin->hooks();
+    return hooks;
+}
+
+// The predictor of this process: the active plugin if any, else the hooks linked into cbp. The reference of a lockstep
+// validation (-l, lockstep.h) and the shadow predictors (-o, shadow.h) follow it, call for call.
+inline void predictor_begin()
+{
+    if (plugin_api)
+        plugin_api->begin(plugin_instance);
+    else
+        beginCondDirPredictor();
+    if (lockstep)
+        lockstep->begin();
+    if (shadow_predictors)
+        shadow_predictors->begin();
+}
+
+inline void predictor_end()
+{
+    if (lockstep)
+        lockstep->end();
+    if (shadow_predictors)
+        shadow_predictors->end();
+    if (plugin_api)
+        plugin_api->end(plugin_instance);
+    else
+        endCondDirPredictor();
+}
+
+// The next prediction will be of pc: lets the active plugin start loading what it reads, if it can (cbp_plugin.h).
+inline void predictor_prefetch(uint64_t pc)
+{
+    if (plugin_api && plugin_api->prefetch)
+        plugin_api->prefetch(plugin_instance, pc);
+}
+
+inline bool predictor_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+{
+    CBP_PROBE3(predict, seq_no, piece, pc);
+    const bool taken = plugin_api ? plugin_api->get_cond_dir_prediction(plugin_instance, seq_no, piece, pc, pred_cycle)
+                                  : get_cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+    CBP_PROBE4(predict_done, seq_no, piece, pc, taken);
+    if (lockstep)
+        lockstep->cond_dir_prediction(seq_no, piece, pc, pred_cycle, taken);
+    if (shadow_predictors)
+        shadow_predictors->cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+    return taken;
+}
+
+inline void predictor_spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+{
+    CBP_PROBE6(spec_update, seq_no, piece, pc, inst_class, resolve_dir, pred_dir);
+    if (plugin_api)
+        plugin_api->spec_update(plugin_instance, seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    else
+        spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    CBP_PROBE6(spec_update_done, seq_no, piece, pc, inst_class, resolve_dir, pred_dir);
+    if (lockstep)
+        lockstep->spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    if (shadow_predictors)
+        shadow_predictors->spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+}
+
+inline void predictor_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+{
+    if (plugin_api)
+        plugin_api->notify_instr_fetch(plugin_instance, seq_no, piece, pc, cycle);
+    else
+        notify_instr_fetch(seq_no, piece, pc, cycle);
+    if (lockstep)
+        lockstep->instr_fetch(seq_no, piece, pc, cycle);
+    if (shadow_predictors)
+        shadow_predictors->instr_fetch(seq_no, piece, pc, cycle);
+}
+
+inline void predictor_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+{
+    if (plugin_api)
+        plugin_api->notify_static_id(plugin_instance, seq_no, piece, pc, static_id);
+    else
+        notify_static_id(seq_no, piece, pc, static_id);
+    if (lockstep)
+        lockstep->static_id(seq_no, piece, pc, static_id);
+    if (shadow_predictors)
+        shadow_predictors->static_id(seq_no, piece, pc, static_id);
+}
+
+inline void predictor_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+{
+    if (plugin_api)
+        plugin_api->notify_instr_decode(plugin_instance, seq_no, piece, pc, dec_info, cycle);
+    else
+        notify_instr_decode(seq_no, piece, pc, dec_info, cycle);
+    if (lockstep)
+        lockstep->instr_decode(seq_no, piece, pc, dec_info, cycle);
+    if (shadow_predictors)
+        shadow_predictors->instr_decode(seq_no, piece, pc, dec_info, cycle);
+}
+
+inline void predictor_agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+{
+    if (plugin_api)
+        plugin_api->notify_agen_complete(plugin_instance, seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    else
+        notify_agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    if (lockstep)
+        lockstep->agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    if (shadow_predictors)
+        shadow_predictors->agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+}
+
+inline void predictor_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+{
+    CBP_PROBE5(resolve, seq_no, piece, pc, pred_dir, cycle);
+    if (plugin_api)
+        plugin_api->notify_instr_execute_resolve(plugin_instance, seq_no, piece, pc, pred_dir, info, cycle);
+    else
+        notify_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+    CBP_PROBE5(resolve_done, seq_no, piece, pc, pred_dir, cycle);
+    if (lockstep)
+        lockstep->instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+    if (shadow_predictors)
+        shadow_predictors->instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+}
+
+inline void predictor_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+{
+    if (plugin_api)
+        plugin_api->notify_instr_commit(plugin_instance, seq_no, piece, pc, pred_dir, info, cycle);
+    else
+        notify_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    if (lockstep)
+        lockstep->instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    if (shadow_predictors)
+        shadow_predictors->instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+}
+
+inline void predictor_batch(const cbp_batch_t& batch)
+{
+    if (plugin_api)
+        plugin_api->notify_batch(plugin_instance, batch);
+    else
+        notify_batch(batch);
+    if (lockstep)
+        lockstep->batch(batch);
+    if (shadow_predictors)
+        shadow_predictors->batch(batch);
+}
+
+// Exits if the active plugin does not support snapshots.
+void predictor_snapshot(snapshot_t& s);
+// The canonical form of the state of the predictor, for the lockstep validation: its snapshot if it has none.
+void predictor_dump(snapshot_t& s);
+bool predictor_freeze();
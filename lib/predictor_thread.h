@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "cbp.h"
+#include "plugin.h"
+
+// Decoupled predictor (-t): the contestant predictor runs on a thread of its own, fed by the timing thread.
+//
+// Every call into the predictor (get_cond_dir_prediction, spec_update and the notify_* hooks) becomes an event in a
+// single-producer/single-consumer ring, which the predictor thread delivers in the order it was posted, so the
+// predictor sees exactly the calls of a serial run. Only a prediction is waited for: the timing model needs the
+// direction at once, to know whether fetch goes down the wrong path. The hooks in between, where the predictor does
+// its updates, are posted and the timing thread moves on, so they run while it models the instructions that follow.
+// The ring holds lag events, which bounds how far the predictor may fall behind; the timing thread waits for a free
+// slot beyond that.
+//
+// The predictor is only called from its thread between start and stop, so beginCondDirPredictor(), snapshots and
+// endCondDirPredictor() stay on the timing thread, outside of that window or after drain().
+class predictor_thread_t
+{
+    private:
+        enum event_type_t : uint8_t
+        {
+            EVENT_PREDICT,
+            EVENT_SPEC_UPDATE,
+            EVENT_FETCH,
+            EVENT_STATIC_ID,
+            EVENT_DECODE,
+            EVENT_AGEN,
+            EVENT_EXECUTE,
+            EVENT_COMMIT,
+            EVENT_STOP
+        };
+
+        struct event_t
+        {
+            event_type_t type;
+            uint8_t piece;
+            bool resolve_dir;   // spec_update
+            bool pred_dir;      // spec_update, execute and commit
+            InstClass inst_class;
+            uint64_t seq_no;
+            uint64_t pc;
+            uint64_t cycle;
+            uint64_t next_pc;   // spec_update
+            uint64_t mem_va;    // agen
+            uint64_t mem_sz;
+            uint32_t static_id; // notify_static_id
+            ExecuteInfo info;   // decode (info.dec_info), execute and commit
+        };
+
+        std::vector<event_t> ring;
+        const uint64_t mask;
+
+        // Events posted by the timing thread / delivered by the predictor thread, and the answer to the last
+        // prediction as (number of predictions << 1) | direction, each on its own line.
+        alignas(64) std::atomic<uint64_t> mPosted;
+        alignas(64) std::atomic<uint64_t> mDelivered;
+        alignas(64) std::atomic<uint64_t> mAnswer;
+
+        // Timing-thread state
+        alignas(64) uint64_t posted = 0;
+        uint64_t predictions = 0;
+
+        std::thread consumer;
+
+        // One step of a wait on the other thread: a spin at first, then a yield, so that the two threads also make
+        // progress when they share a core.
+        static void backoff(unsigned& spins)
+        {
+            if (spins++ < 256)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            else
+                std::this_thread::yield();
+        }
+
+        // A slot for the next event, once the predictor thread has delivered the one it held.
+        event_t& slot()
+        {
+            unsigned spins = 0;
+            while (posted - mDelivered.load(std::memory_order_acquire) > mask)
+                backoff(spins);
+            return ring[posted & mask];
+        }
+
+        void publish()
+        {
+            mPosted.store(++posted, std::memory_order_release);
+        }
+
+        void deliver(const event_t& e)
+        {
+            switch (e.type)
+            {
+                case EVENT_PREDICT:
+                {
+                    const bool taken = predictor_cond_dir_prediction(e.seq_no, e.piece, e.pc, e.cycle);
+                    mAnswer.store(((mAnswer.load(std::memory_order_relaxed) >> 1) + 1) << 1 | taken, std::memory_order_release);
+                    break;
+                }
+                case EVENT_SPEC_UPDATE:
+                    predictor_spec_update(e.seq_no, e.piece, e.pc, e.inst_class, e.resolve_dir, e.pred_dir, e.next_pc);
+                    break;
+                case EVENT_FETCH:
+                    predictor_instr_fetch(e.seq_no, e.piece, e.pc, e.cycle);
+                    break;
+                case EVENT_STATIC_ID:
+                    predictor_static_id(e.seq_no, e.piece, e.pc, e.static_id);
+                    break;
+                case EVENT_DECODE:
+                    predictor_instr_decode(e.seq_no, e.piece, e.pc, e.info.dec_info, e.cycle);
+                    break;
+                case EVENT_AGEN:
+                    predictor_agen_complete(e.seq_no, e.piece, e.pc, e.info.dec_info, e.mem_va, e.mem_sz, e.cycle);
+                    break;
+                case EVENT_EXECUTE:
+                    predictor_instr_execute_resolve(e.seq_no, e.piece, e.pc, e.pred_dir, e.info, e.cycle);
+                    break;
+                case EVENT_COMMIT:
+                    predictor_instr_commit(e.seq_no, e.piece, e.pc, e.pred_dir, e.info, e.cycle);
+                    break;
+                case EVENT_STOP:
+                    break;
+            }
+        }
+
+        void consume()
+        {
+            uint64_t delivered = 0;
+            while (true)
+            {
+                uint64_t available;
+                unsigned spins = 0;
+                while ((available = mPosted.load(std::memory_order_acquire)) == delivered)
+                    backoff(spins);
+                for (; delivered < available; delivered++)
+                {
+                    const event_t& e = ring[delivered & mask];
+                    if (e.type == EVENT_STOP)
+                    {
+                        mDelivered.store(delivered + 1, std::memory_order_release);
+                        return;
+                    }
+                    deliver(e);
+                    mDelivered.store(delivered + 1, std::memory_order_release);
+                }
+            }
+        }
+
+    public:
+        // lag: events in flight at most, rounded up to a power of two.
+        predictor_thread_t(uint64_t lag)
+        : ring(std::max<uint64_t>(2, 1ULL << (64 - __builtin_clzll(std::max<uint64_t>(lag, 2) - 1)))), mask(ring.size() - 1),
+          mPosted(0), mDelivered(0), mAnswer(0)
+        {
+            consumer = std::thread(&predictor_thread_t::consume, this);
+        }
+
+        // Delivers the events left, then stops the thread.
+        ~predictor_thread_t()
+        {
+            slot().type = EVENT_STOP;
+            publish();
+            consumer.join();
+        }
+
+        predictor_thread_t(const predictor_thread_t&) = delete;
+        predictor_thread_t& operator=(const predictor_thread_t&) = delete;
+
+        // Waits until the predictor has seen every event posted.
+        void drain()
+        {
+            unsigned spins = 0;
+            while (mDelivered.load(std::memory_order_acquire) != posted)
+                backoff(spins);
+        }
+
+        bool cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_PREDICT;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.cycle = pred_cycle;
+            publish();
+            predictions++;
+            uint64_t answer;
+            unsigned spins = 0;
+            while (((answer = mAnswer.load(std::memory_order_acquire)) >> 1) != predictions)
+                backoff(spins);
+            return answer & 1;
+        }
+
+        void post_spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+        {
+            event_t& e = slot();
+            e.type = EVENT_SPEC_UPDATE;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.inst_class = inst_class;
+            e.resolve_dir = resolve_dir;
+            e.pred_dir = pred_dir;
+            e.next_pc = next_pc;
+            publish();
+        }
+
+        void post_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_FETCH;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.cycle = cycle;
+            publish();
+        }
+
+        void post_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+        {
+            event_t& e = slot();
+            e.type = EVENT_STATIC_ID;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.static_id = static_id;
+            publish();
+        }
+
+        void post_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_DECODE;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.info.dec_info = dec_info;
+            e.cycle = cycle;
+            publish();
+        }
+
+        void post_agen(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_AGEN;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.info.dec_info = dec_info;
+            e.mem_va = mem_va;
+            e.mem_sz = mem_sz;
+            e.cycle = cycle;
+            publish();
+        }
+
+        void post_execute(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_EXECUTE;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.pred_dir = pred_dir;
+            e.info = info;
+            e.cycle = cycle;
+            publish();
+        }
+
+        void post_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            event_t& e = slot();
+            e.type = EVENT_COMMIT;
+            e.seq_no = seq_no;
+            e.piece = piece;
+            e.pc = pc;
+            e.pred_dir = pred_dir;
+            e.info = info;
+            e.cycle = cycle;
+            publish();
+        }
+};
+
+// The decoupled predictor of the running simulation, if any (-t).
+inline predictor_thread_t * predictor_thread = nullptr;
+
+// The predictor calls of the simulator: to the predictor thread when there is one, else direct (to the active plugin,
+// if any, lib/plugin.h).
+inline bool call_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+{
+    if (predictor_thread)
+        return predictor_thread->cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+    return predictor_cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+}
+
+inline void call_spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+{
+    if (predictor_thread)
+        predictor_thread->post_spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    else
+        predictor_spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+}
+
+inline void call_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+{
+    if (predictor_thread)
+        predictor_thread->post_fetch(seq_no, piece, pc, cycle);
+    else
+        predictor_instr_fetch(seq_no, piece, pc, cycle);
+}
+
+inline void call_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+{
+    if (predictor_thread)
+        predictor_thread->post_static_id(seq_no, piece, pc, static_id);
+    else
+        predictor_static_id(seq_no, piece, pc, static_id);
+}
+
+inline void call_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+{
+    if (predictor_thread)
+        predictor_thread->post_decode(seq_no, piece, pc, dec_info, cycle);
+    else
+        predictor_instr_decode(seq_no, piece, pc, dec_info, cycle);
+}
+
+inline void call_agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+{
+    if (predictor_thread)
+        predictor_thread->post_agen(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    else
+        predictor_agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+}
+
+inline void call_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+{
+    if (predictor_thread)
+        predictor_thread->post_execute(seq_no, piece, pc, pred_dir, info, cycle);
+    else
+        predictor_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+}
+
+inline void call_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+{
+    if (predictor_thread)
+        predictor_thread->post_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    else
+        predictor_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+}
@@ -0,0 +1,100 @@
+#include "progress_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+progress_stream_t progress_stream;
+
+void progress_stream_t::open(const char * target)
+{
+    if (!strncmp(target, "unix:", 5))
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (strlen(target + 5) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Progress socket path too long: %s\n", target + 5);
+            exit(1);
+        }
+        strcpy(addr.sun_path, target + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if ((fd < 0) || (connect(fd, (const sockaddr *)&addr, sizeof(addr)) != 0))
+        {
+            fprintf(stderr, "Cannot connect to the progress socket %s: %s\n", target + 5, strerror(errno));
+            exit(1);
+        }
+        is_socket = true;
+    }
+    else
+    {
+        fd = ::open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Cannot open the progress file %s: %s\n", target, strerror(errno));
+            exit(1);
+        }
+    }
+}
+
+void progress_stream_t::emit(const char * line, int len)
+{
+    if (len <= 0)
+        return;
+    const ssize_t n = is_socket ? send(fd, line, len, MSG_DONTWAIT | MSG_NOSIGNAL) : write(fd, line, len);
+    // a partially sent record would garble the stream: the reader gets whole lines or nothing
+    if (n != len)
+    {
+        dropped++;
+        if (is_socket && (n > 0))
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void progress_stream_t::begin(const char * trace_name)
+{
+    if (fd < 0)
+        return;
+    // traces are paths of our own, only quotes and backslashes need escaping
+    size_t k = 0;
+    for (const char * p = trace_name; *p && (k + 2 < sizeof(trace)); p++)
+    {
+        if ((*p == '"') || (*p == '\\'))
+            trace[k++] = '\\';
+        trace[k++] = *p;
+    }
+    trace[k] = '\0';
+    total_instr = 0;
+    total_conddir_m = 0;
+    char line[512];
+    emit(line, snprintf(line, sizeof(line), "{\"event\":\"begin\",\"trace\":\"%s\",\"pid\":%d}\n", trace, (int)getpid()));
+}
+
+void progress_stream_t::epoch(uint64_t epoch, uint64_t instr, uint64_t cycles, uint64_t conddir_n, uint64_t conddir_m, uint64_t cycles_wp)
+{
+    if (fd < 0)
+        return;
+    total_instr += instr;
+    total_conddir_m += conddir_m;
+    char line[768];
+    emit(line, snprintf(line, sizeof(line), "{\"event\":\"epoch\",\"trace\":\"%s\",\"pid\":%d,\"epoch\":%lu,\"instr\":%lu,\"cycles\":%lu,"
+                                            "\"conddir_n\":%lu,\"conddir_m\":%lu,\"cycles_wp\":%lu,\"total_instr\":%lu,\"total_conddir_m\":%lu}\n",
+                        trace, (int)getpid(), epoch, instr, cycles, conddir_n, conddir_m, cycles_wp, total_instr, total_conddir_m));
+}
+
+void progress_stream_t::end()
+{
+    if (fd < 0)
+        return;
+    char line[640];
+    emit(line, snprintf(line, sizeof(line), "{\"event\":\"end\",\"trace\":\"%s\",\"pid\":%d,\"total_instr\":%lu,\"total_conddir_m\":%lu,\"dropped\":%lu}\n",
+                        trace, (int)getpid(), total_instr, total_conddir_m, dropped));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+// Live progress of the simulations (-Y <file> or -Y unix:<socket>): one JSON line per epoch as it completes, and one at
+// the beginning and end of each trace, so that a dashboard can follow long runs and a sweep can kill configurations
+// that are clearly losing without waiting for the report. Records look like
+//
+//   {"event":"epoch","trace":"t.gz","pid":123,"epoch":4,"instr":1000000,"cycles":402113,"conddir_n":131524,
+//    "conddir_m":262,"cycles_wp":5321,"total_instr":5000000,"total_conddir_m":1329}
+//
+// ("begin" records only carry the trace and pid, "end" ones the totals). Cycles and CycWP are 0 in branch-only mode.
+//
+// A file is opened for appending and every record is one write(2), so that the processes of a batch (-B) or of a
+// node can share it. A UNIX stream socket is connected once, by parseargs (the workers of a batch share it), and records
+// are sent without waiting: when the reader falls behind they are dropped, and counted in the "end" record, but the
+// simulation never stalls on it.
+class progress_stream_t
+{
+    private:
+        int fd = -1;
+        bool is_socket = false;
+        char trace[256] = "";
+        uint64_t total_instr = 0;
+        uint64_t total_conddir_m = 0;
+        uint64_t dropped = 0;
+
+        void emit(const char * line, int len);
+
+    public:
+        // Exits if target cannot be opened.
+        void open(const char * target);
+        bool enabled() const { return fd >= 0; }
+
+        void begin(const char * trace_name);
+        // Epoch (0-based) of the current trace just completed.
+        void epoch(uint64_t epoch, uint64_t instr, uint64_t cycles, uint64_t conddir_n, uint64_t conddir_m, uint64_t cycles_wp);
+        void end();
+};
+
+// Process-wide, like the predictor hooks of cbp.h: opened by parseargs, fed by uarchsim_t and bp_only_sim_t.
+extern progress_stream_t progress_stream;
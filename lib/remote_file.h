@@ -0,0 +1,409 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <dirent.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Remote trace files: block traces (block_trace.h) read from object storage by URL, http://, https:// or
+// s3://<bucket>/<key>, so that a node starts simulating as soon as the blocks it needs arrive, instead of copying the
+// whole trace first.
+//
+// The file is fetched in chunks of CHUNK bytes by HTTP range requests, made by the curl tool (there is no HTTP
+// library to link). Each chunk is kept in a node-local cache directory, on local SSD, shared by all the processes of
+// the node: a chunk is written under a temporary name and renamed into place, so the readers only ever see whole
+// chunks, and the chunks least recently read are removed once the directory is over its budget. A chunk read also
+// queues the next few for background threads to fetch, as the blocks are read in order. A repeated run reads the
+// whole trace from the local disk. The settings come from the environment, since TraceReader is constructed in many
+// places that have no options to pass:
+//
+//   CBP_REMOTE_CACHE      <dir>[,<max_GB>], the cache directory and its budget (default /tmp/cbp-remote-cache,16)
+//   CBP_REMOTE_READAHEAD  chunks fetched ahead of the last one read (default 8)
+//   CBP_S3_ENDPOINT       the S3-compatible endpoint of s3:// URLs, addressed path-style (default
+//                         https://s3.amazonaws.com)
+//   AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY, AWS_SESSION_TOKEN, AWS_REGION
+//                         the credentials that sign the s3:// requests (curl --aws-sigv4), unsigned without them
+//
+// Entries are keyed by the URL without its query string (a presigned URL changes its signature, not its object), the
+// size of the object and its ETag or Last-Modified, so a changed object gets new chunks.
+class remote_file_t
+{
+    public:
+        static constexpr uint64_t CHUNK = 4 << 20;
+
+    private:
+        struct object_t
+        {
+            uint64_t size;
+            std::string key;
+        };
+
+        std::string mUrl;
+        std::string mConfig;        // curl options on its standard input: the credentials stay off the command line
+        object_t mObject;
+        std::string mDir;
+        uint64_t mBudget;
+        unsigned mReadAhead;
+
+        std::mutex mLock;
+        std::condition_variable mCv;
+        std::set<uint64_t> mFetching;   // by this process
+        std::set<uint64_t> mTouched;    // read by this process, their time stamp updated
+        std::deque<uint64_t> mQueue;    // to fetch ahead
+        uint64_t mQueued = 0;           // chunks up to here are queued or were
+        bool mStop = false;
+        std::vector<std::thread> mPrefetchers;
+
+        static uint64_t hash_string(const std::string& s, uint64_t h = 0xcbf29ce484222325ull)
+        {
+            for (const char c : s)
+                h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+            return h;
+        }
+
+        // Runs curl with args, config on its standard input and, if out is given, its standard output into out.
+        static bool run_curl(const std::vector<std::string>& args, const std::string& config, std::string * out)
+        {
+            std::vector<char *> argv;
+            argv.push_back((char *)"curl");
+            argv.push_back((char *)"-K");
+            argv.push_back((char *)"-");
+            for (const std::string& a : args)
+                argv.push_back((char *)a.c_str());
+            argv.push_back(nullptr);
+
+            int in_pipe[2], out_pipe[2];
+            if (pipe(in_pipe) != 0)
+                return false;
+            if (pipe(out_pipe) != 0)
+            {
+                close(in_pipe[0]);
+                close(in_pipe[1]);
+                return false;
+            }
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                dup2(in_pipe[0], STDIN_FILENO);
+                dup2(out_pipe[1], STDOUT_FILENO);
+                close(in_pipe[0]);
+                close(in_pipe[1]);
+                close(out_pipe[0]);
+                close(out_pipe[1]);
+                execvp("curl", argv.data());
+                _exit(127);
+            }
+            close(in_pipe[0]);
+            close(out_pipe[1]);
+            bool ok = (pid > 0) && (write(in_pipe[1], config.data(), config.size()) == (ssize_t)config.size());
+            close(in_pipe[1]);
+            char buf[4096];
+            for (ssize_t n; (n = read(out_pipe[0], buf, sizeof(buf))) > 0;)
+                if (out)
+                    out->append(buf, n);
+            close(out_pipe[0]);
+            int status;
+            return ok && (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+        }
+
+        // Value of the last header name (lower case) in the headers of all the responses, redirects included.
+        static std::string header(const std::string& headers, const char * name)
+        {
+            std::string value;
+            size_t pos = 0;
+            while (pos < headers.size())
+            {
+                size_t end = headers.find('\n', pos);
+                if (end == std::string::npos)
+                    end = headers.size();
+                std::string line = headers.substr(pos, end - pos);
+                pos = end + 1;
+                const size_t colon = line.find(':');
+                if (colon == std::string::npos)
+                    continue;
+                std::string field = line.substr(0, colon);
+                std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+                if (field != name)
+                    continue;
+                value = line.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(" \t"));
+                value.erase(value.find_last_not_of(" \t\r") + 1);
+            }
+            return value;
+        }
+
+        // Size and key of the object, asked once per process and URL.
+        object_t stat_object()
+        {
+            static std::mutex lock;
+            static std::map<std::string, object_t> known;
+            std::lock_guard<std::mutex> guard(lock);
+            const auto it = known.find(mUrl);
+            if (it != known.end())
+                return it->second;
+
+            std::string headers;
+            const std::string range = "0-0";
+            if (!run_curl({"-sSfL", "--retry", "3", "-r", range, "-D", "-", "-o", "/dev/null", "--url", mUrl}, mConfig, &headers))
+            {
+                fprintf(stderr, "Unable to reach remote trace %s\n", mUrl.c_str());
+                exit(1);
+            }
+            const std::string content_range = header(headers, "content-range");
+            const size_t slash = content_range.find('/');
+            if (content_range.compare(0, 6, "bytes ") || (slash == std::string::npos) || (content_range[slash + 1] == '*'))
+            {
+                fprintf(stderr, "Remote trace %s: the server does not answer range requests\n", mUrl.c_str());
+                exit(1);
+            }
+            object_t o;
+            o.size = strtoull(content_range.c_str() + slash + 1, nullptr, 10);
+            std::string version = header(headers, "etag");
+            if (version.empty())
+                version = header(headers, "last-modified");
+            const std::string base = mUrl.substr(0, mUrl.find('?'));
+            char key[64];
+            snprintf(key, sizeof(key), "%016lx", hash_string(base + "|" + std::to_string(o.size) + "|" + version));
+            std::string name = base.substr(base.find_last_of('/') + 1);
+            o.key = (name.empty() ? "trace" : name) + "-" + key;
+            known[mUrl] = o;
+            return o;
+        }
+
+        std::string chunk_path(uint64_t c) const
+        {
+            return mDir + "/" + mObject.key + "." + std::to_string(c);
+        }
+
+        uint64_t chunk_size(uint64_t c) const
+        {
+            return std::min(CHUNK, mObject.size - c * CHUNK);
+        }
+
+        // Removes the chunks least recently read until the cache is within its budget.
+        void evict()
+        {
+            struct entry_t
+            {
+                int64_t mtime;
+                uint64_t size;
+                std::string path;
+            };
+            std::vector<entry_t> entries;
+            uint64_t total = 0;
+            DIR * dir = opendir(mDir.c_str());
+            if (!dir)
+                return;
+            for (struct dirent * e; (e = readdir(dir)) != nullptr;)
+            {
+                const std::string path = mDir + "/" + e->d_name;
+                struct stat st;
+                if ((e->d_name[0] == '.') || (stat(path.c_str(), &st) != 0) || !S_ISREG(st.st_mode))
+                    continue;
+                entries.push_back({(int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec, (uint64_t)st.st_size, path});
+                total += st.st_size;
+            }
+            closedir(dir);
+            if (total <= mBudget)
+                return;
+            std::sort(entries.begin(), entries.end(), [](const entry_t& a, const entry_t& b) { return a.mtime < b.mtime; });
+            for (const entry_t& e : entries)
+            {
+                if (total <= mBudget)
+                    break;
+                if (unlink(e.path.c_str()) == 0)
+                    total -= e.size;
+            }
+        }
+
+        // Fetches chunk c into the cache, unless this process is fetching it already, in which case it waits for it.
+        void fetch(uint64_t c)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                if (mFetching.count(c))
+                {
+                    mCv.wait(lock, [&]() { return !mFetching.count(c); });
+                    return;
+                }
+                mFetching.insert(c);
+            }
+            const std::string path = chunk_path(c);
+            const std::string tmp = path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(hash_string(path, (uint64_t)pthread_self()));
+            const std::string range = std::to_string(c * CHUNK) + "-" + std::to_string(c * CHUNK + chunk_size(c) - 1);
+            struct stat st;
+            const bool ok = run_curl({"-sSfL", "--retry", "3", "-r", range, "-o", tmp, "--url", mUrl}, mConfig, nullptr)
+                            && (stat(tmp.c_str(), &st) == 0) && ((uint64_t)st.st_size == chunk_size(c))
+                            && (rename(tmp.c_str(), path.c_str()) == 0);
+            if (!ok)
+            {
+                unlink(tmp.c_str());
+                fprintf(stderr, "Unable to fetch bytes %s of remote trace %s\n", range.c_str(), mUrl.c_str());
+                exit(1);
+            }
+            evict();
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mFetching.erase(c);
+            }
+            mCv.notify_all();
+        }
+
+        // Queues the chunks after c to fetch ahead.
+        void read_ahead(uint64_t c)
+        {
+            const uint64_t num_chunks = (mObject.size + CHUNK - 1) / CHUNK;
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                for (uint64_t a = std::max(mQueued, c + 1); (a <= c + mReadAhead) && (a < num_chunks); a++)
+                    mQueue.push_back(a);
+                mQueued = std::max(mQueued, std::min(c + mReadAhead + 1, num_chunks));
+            }
+            mCv.notify_all();
+        }
+
+        void prefetch()
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            while (!mStop)
+            {
+                if (mQueue.empty())
+                {
+                    mCv.wait(lock);
+                    continue;
+                }
+                const uint64_t c = mQueue.front();
+                mQueue.pop_front();
+                lock.unlock();
+                if (access(chunk_path(c).c_str(), F_OK) != 0)
+                    fetch(c);
+                lock.lock();
+            }
+        }
+
+        // Copies n bytes at offset within chunk c to dst, fetching the chunk if it is not in the cache.
+        void read_chunk(uint64_t c, char * dst, size_t n, uint64_t offset)
+        {
+            const std::string path = chunk_path(c);
+            for (;;)
+            {
+                const int fd = open(path.c_str(), O_RDONLY);
+                if (fd >= 0)
+                {
+                    const bool ok = ::pread(fd, dst, n, offset) == (ssize_t)n;
+                    bool touch;
+                    {
+                        std::lock_guard<std::mutex> lock(mLock);
+                        touch = mTouched.insert(c).second;
+                    }
+                    // a read makes it the most recently used, once per process
+                    if (ok && touch)
+                        futimens(fd, nullptr);
+                    close(fd);
+                    if (ok)
+                        return;
+                }
+                // missing, or evicted by another process
+                fetch(c);
+            }
+        }
+
+    public:
+        static bool is_remote(const char * path)
+        {
+            return !strncmp(path, "http://", 7) || !strncmp(path, "https://", 8) || !strncmp(path, "s3://", 5);
+        }
+
+        // Opens url; exits if the object cannot be reached, or its server does not answer range requests.
+        explicit remote_file_t(const char * url)
+        {
+            mUrl = url;
+            if (!strncmp(url, "s3://", 5))
+            {
+                const char * endpoint = getenv("CBP_S3_ENDPOINT");
+                mUrl = std::string(endpoint ? endpoint : "https://s3.amazonaws.com") + "/" + (url + 5);
+                const char * id = getenv("AWS_ACCESS_KEY_ID");
+                const char * secret = getenv("AWS_SECRET_ACCESS_KEY");
+                if (id && secret)
+                {
+                    const char * region = getenv("AWS_REGION");
+                    const char * token = getenv("AWS_SESSION_TOKEN");
+                    mConfig = std::string("aws-sigv4 = \"aws:amz:") + (region ? region : "us-east-1") + ":s3\"\n"
+                              + "user = \"" + id + ":" + secret + "\"\n";
+                    if (token)
+                        mConfig += std::string("header = \"x-amz-security-token: ") + token + "\"\n";
+                }
+            }
+
+            const char * cache = getenv("CBP_REMOTE_CACHE");
+            std::string spec = cache ? cache : "/tmp/cbp-remote-cache";
+            double budget_gb = 16;
+            const size_t comma = spec.find(',');
+            if (comma != std::string::npos)
+            {
+                budget_gb = atof(spec.c_str() + comma + 1);
+                spec.resize(comma);
+            }
+            mDir = spec;
+            mBudget = (uint64_t)(budget_gb * (1ull << 30));
+            mkdir(mDir.c_str(), 0755);
+            const char * ahead = getenv("CBP_REMOTE_READAHEAD");
+            mReadAhead = ahead ? (unsigned)atoi(ahead) : 8;
+
+            mObject = stat_object();
+            for (unsigned t = 0; t < std::min(2u, mReadAhead); t++)
+                mPrefetchers.emplace_back(&remote_file_t::prefetch, this);
+        }
+
+        ~remote_file_t()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mStop = true;
+            }
+            mCv.notify_all();
+            for (std::thread& t : mPrefetchers)
+                t.join();
+        }
+
+        remote_file_t(const remote_file_t&) = delete;
+        remote_file_t& operator=(const remote_file_t&) = delete;
+
+        uint64_t size() const
+        {
+            return mObject.size;
+        }
+
+        // Reads n bytes at offset into dst, as pread() would; false past the end of the object. Thread-safe.
+        bool pread(void * dst, size_t n, uint64_t offset)
+        {
+            if (offset + n > mObject.size)
+                return false;
+            char * out = (char *)dst;
+            while (n > 0)
+            {
+                const uint64_t c = offset / CHUNK;
+                const size_t num = std::min<uint64_t>(n, (c + 1) * CHUNK - offset);
+                read_chunk(c, out, num, offset - c * CHUNK);
+                read_ahead(c);
+                out += num;
+                offset += num;
+                n -= num;
+            }
+            return true;
+        }
+};
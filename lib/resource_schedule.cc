@@ -22,30 +22,35 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
 
+#include <algorithm>
 #include <inttypes.h>
 #include <assert.h>
+#include <string.h>
 #include "resource_schedule.h"
+#include "snapshot.h"
+#include "invariant.h"
+
+static_assert(SCHED_DEPTH_INCREMENT % 64 == 0, "an aligned 64-cycle chunk must map to one bitmap word");
 
 resource_schedule::resource_schedule(uint64_t width) {
    base_cycle = 0;
    this->width = width;
    depth = SCHED_DEPTH_INCREMENT;
-   sched = new uint64_t[depth];
-   for (uint64_t i = 0; i < depth; i++)
-      sched[i] = 0;
+   sched.assign(depth, 0);
+   full.assign(depth / 64, 0);
 }
 
-resource_schedule::~resource_schedule() {
+void resource_schedule::reset() {
+   base_cycle = 0;
+   depth = SCHED_DEPTH_INCREMENT;
+   std::fill(sched.begin(), sched.end(), 0);
+   std::fill(full.begin(), full.end(), 0);
 }
 
+// Slots at or beyond the old depth are never indexed with the old mask: they are still 0 and the counts already
+// scheduled stay at their slot, as when the array was copied into a larger one.
 void resource_schedule::resize(uint64_t new_depth) {
-   uint64_t old_depth;
-   uint64_t *old;
    uint64_t increments;
-   uint64_t i;
-
-   old_depth = depth;
-   old = sched;
 
    increments = (new_depth/SCHED_DEPTH_INCREMENT);
    if (new_depth % SCHED_DEPTH_INCREMENT)
@@ -53,13 +58,40 @@ void resource_schedule::resize(uint64_t new_depth) {
    depth = increments*SCHED_DEPTH_INCREMENT;
    assert(depth >= new_depth);
 
-   sched = new uint64_t[depth];
-   for (i = 0; i < old_depth; i++)
-      sched[i] = old[i];
-   for (i = old_depth; i < depth; i++)
-      sched[i] = 0;
+   if (depth > sched.size()) {
+      uint64_t capacity = 2 * sched.size();
+      while (capacity < depth)
+         capacity *= 2;
+      sched.resize(capacity, 0);
+      full.resize(capacity / 64, 0);
+   }
+}
 
-   delete[] old;
+// First cycle in [cycle, limit_cycle] with a free slot, or MAX_CYCLE.
+uint64_t resource_schedule::find_free(uint64_t cycle, uint64_t limit_cycle) {
+   while (true) {
+      if ((cycle - base_cycle + 1) > depth)
+         resize(cycle - base_cycle + 1);
+
+      // Scan up to the end of the aligned chunk, without going past the depth or the limit.
+      uint64_t last = cycle | 63;
+      if (last > base_cycle + depth - 1)
+         last = base_cycle + depth - 1;
+      if (last > limit_cycle)
+         last = limit_cycle;
+
+      const uint64_t slot = MOD_S(cycle, depth);
+      const uint64_t nbits = last - cycle + 1;
+      uint64_t nonfull = ~full[slot >> 6] >> (slot & 63);
+      if (nbits < 64)
+         nonfull &= (1lu << nbits) - 1;
+      if (nonfull)
+         return cycle + __builtin_ctzl(nonfull);
+
+      if (last >= limit_cycle)
+         return MAX_CYCLE;
+      cycle = last + 1;
+   }
 }
 
 uint64_t resource_schedule::schedule(uint64_t start_cycle, uint64_t max_delta) 
@@ -67,56 +99,64 @@ uint64_t resource_schedule::schedule(uint64_t start_cycle, uint64_t max_delta)
    assert(start_cycle >= base_cycle);
 
    uint64_t limit_cycle = max_delta == MAX_CYCLE ? MAX_CYCLE : start_cycle + max_delta;
-   bool found = false;
-
-   while (!found) {
-      if ((start_cycle - base_cycle + 1) > depth)
-         resize(start_cycle - base_cycle + 1);
-
-      if (sched[MOD_S(start_cycle,depth)] < width) {
-         found = true;
-         sched[MOD_S(start_cycle,depth)]++;
-      }
-      else {
-         start_cycle++;
-         if(start_cycle > limit_cycle)
-         {
-            return MAX_CYCLE;
-         }
-      }
-   }
-
-   assert(found);
+   start_cycle = find_free(start_cycle, limit_cycle);
+   if (start_cycle == MAX_CYCLE)
+      return MAX_CYCLE;
+
+   const uint64_t slot = MOD_S(start_cycle, depth);
+   if (++sched[slot] >= width)
+      full[slot >> 6] |= (1lu << (slot & 63));
+   CBP_CHECK_EXPENSIVE(chunk_consistent(slot));
    return(start_cycle);
 }
 
+// Whether the bitmap word of slot marks exactly the full slots of its aligned 64-slot chunk.
+bool resource_schedule::chunk_consistent(uint64_t slot) const {
+   const uint64_t first = slot & ~63lu;
+   for (uint64_t i = 0; i < 64; i++)
+      if (((full[first >> 6] >> i) & 1) != (sched[first + i] >= width))
+         return false;
+   return true;
+}
+
 uint64_t resource_schedule::try_schedule(uint64_t try_cycle)
 {
    // Calling this assumes all previous events to schedule have been scheduled.
    assert(try_cycle >= base_cycle);
 
-   bool found = false;
-
-   while (!found) {
-      if ((try_cycle - base_cycle + 1) > depth)
-         resize(try_cycle - base_cycle + 1);
-
-      if (sched[MOD_S(try_cycle,depth)] < width) {
-         found = true;
-      }
-      else {
-         try_cycle++;
-      }
-   }
+   return find_free(try_cycle, MAX_CYCLE);
+}
 
-   assert(found);
-   return(try_cycle);
+// Frees n consecutive slots from slot, which all lie in one aligned 64-slot chunk.
+void resource_schedule::clear_slots(uint64_t slot, uint64_t n) {
+   memset(&sched[slot], 0, n * sizeof(sched[0]));
+   const uint64_t mask = (n == 64) ? ~0lu : (((1lu << n) - 1) << (slot & 63));
+   full[slot >> 6] &= ~mask;
 }
 
 void resource_schedule::advance_base_cycle(uint64_t new_base_cycle) {
    assert(new_base_cycle >= base_cycle);
-   for (uint64_t i = base_cycle; i < new_base_cycle; i++)
-      sched[MOD_S(i,depth)] = 0;
+   // The slot mapping repeats every power of two above the mask, so older cycles would clear the same slots again.
+   uint64_t period = 1;
+   while (period < depth)
+      period <<= 1;
+   uint64_t cycle = base_cycle;
+   if (new_base_cycle - cycle > period)
+      cycle = new_base_cycle - period;
+   while (cycle < new_base_cycle) {
+      uint64_t last = cycle | 63;
+      if (last > new_base_cycle - 1)
+         last = new_base_cycle - 1;
+      clear_slots(MOD_S(cycle, depth), last - cycle + 1);
+      cycle = last + 1;
+   }
    base_cycle = new_base_cycle;
 }
 
+void resource_schedule::snapshot(snapshot_t& s) {
+   s.check(width, "resource width");
+   s.io(sched);
+   s.io(full);
+   s.io(depth);
+   s.io(base_cycle);
+}
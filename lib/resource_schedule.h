@@ -22,25 +22,43 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
 
+#include <vector>
+
+class snapshot_t;
+
 #define SCHED_DEPTH_INCREMENT 256
 #define MOD_S(x,y)      ((x) & ((y)-1))
 
 constexpr uint64_t MAX_CYCLE = ~0lu;
 
+// Per-cycle occupancy of a resource with a fixed width.
+// Next to the per-cycle counts, a bitmap marks the full cycles, so the first non-full cycle is found 64 cycles at a
+// time. The depth is a multiple of SCHED_DEPTH_INCREMENT (itself a multiple of 64), so the 64 cycles of an aligned
+// chunk occupy the 64 consecutive slots of one bitmap word. The storage grows geometrically, independently of the
+// depth.
 class resource_schedule {
 private:
-   uint64_t *sched;
+   std::vector<uint64_t> sched;     // per-slot counts, storage for at least depth slots
+   std::vector<uint64_t> full;      // bit set for slots whose count reached width
    uint64_t depth;
    uint64_t width;
 
    uint64_t base_cycle;
 
    void resize(uint64_t new_depth);
+   uint64_t find_free(uint64_t cycle, uint64_t limit_cycle);
+   void clear_slots(uint64_t slot, uint64_t n);
+   bool chunk_consistent(uint64_t slot) const;
 
 public:
    resource_schedule(uint64_t width);
-   ~resource_schedule();
+   // Empty again from cycle 0, keeping the storage.
+   void reset();
    uint64_t schedule(uint64_t start_cycle, uint64_t max_delta = MAX_CYCLE);
    uint64_t try_schedule(uint64_t try_cycle);
    void advance_base_cycle(uint64_t new_base_cycle);
+   // Cycles covered, and bytes of storage.
+   uint64_t get_depth() const { return depth; }
+   uint64_t bytes() const { return (sched.capacity() + full.capacity()) * sizeof(uint64_t); }
+   void snapshot(snapshot_t& s);
 };
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "batch.h"
+
+// Content-addressed cache of batch results (-C): a run is keyed by a hash of the trace file contents, of the sources
+// and flags the simulator was built from (source_hash, computed by lib/Makefile) and of its configuration, and its
+// measurements are stored under that key in the cache directory, one small file per run. A batch run that finds its
+// key returns the stored measurements instead of simulating the trace.
+//
+// The source hash covers the predictor and library sources, so any change to them, or to the build flags, misses. A
+// run of a predictor plugin (-p) is keyed by the contents of the plugin and its arguments as well.
+// Hashes are 64-bit, so distinct runs sharing a key are too unlikely to worry about.
+
+// Hash of the sources and flags of this build, defined in source_hash.cc.
+extern const uint64_t source_hash;
+
+class result_cache_t
+{
+    private:
+        static constexpr char MAGIC[8] = {'C', 'B', 'P', 'R', 'E', 'S', '2', '\0'};
+
+        struct entry_t
+        {
+            batch_result_t result;
+            double exec_time;       // of the run that stored it
+        };
+
+        std::string dir;
+        uint64_t config_hash;
+
+        std::string path_for(uint64_t key) const
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "/%016lx.res", key);
+            return dir + name;
+        }
+
+    public:
+        // 64-bit FNV-1a, folded 8 bytes at a time: about as fast as the trace can be read.
+        static uint64_t hash_bytes(const void * data, size_t size, uint64_t h = 0xcbf29ce484222325ull)
+        {
+            const uint8_t * p = (const uint8_t *)data;
+            for (; size >= 8; p += 8, size -= 8)
+            {
+                uint64_t w;
+                memcpy(&w, p, 8);
+                h = (h ^ w) * 0x100000001b3ull;
+                h ^= h >> 29;
+            }
+            for (; size; p++, size--)
+                h = (h ^ *p) * 0x100000001b3ull;
+            return h;
+        }
+
+        // Hash of the contents of the file at path. Returns false if it cannot be read.
+        static bool hash_file(const char * path, uint64_t& h)
+        {
+            FILE * f = fopen(path, "rb");
+            if (!f)
+                return false;
+            static thread_local char buf[1 << 20];
+            h = 0xcbf29ce484222325ull;
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+                h = hash_bytes(buf, n, h);
+            const bool ok = !ferror(f);
+            fclose(f);
+            return ok;
+        }
+
+        // config_hash identifies the options the runs are simulated with.
+        result_cache_t(const char * dir, uint64_t config_hash)
+        : dir(dir), config_hash(config_hash)
+        {
+            mkdir(dir, 0755);
+        }
+
+        // Key of the run on trace, of the plugin at plugin_path with plugin_args if not nullptr, false if the trace or
+        // the plugin cannot be read.
+        bool key(const char * trace, uint64_t& key, const char * plugin_path = nullptr, const std::string& plugin_args = "") const
+        {
+            uint64_t h;
+            if (!hash_file(trace, h))
+                return false;
+            const uint64_t parts[3] = {h, source_hash, config_hash};
+            key = hash_bytes(parts, sizeof(parts));
+            if (plugin_path)
+            {
+                if (!hash_file(plugin_path, h))
+                    return false;
+                const uint64_t plugin_parts[3] = {key, h, hash_bytes(plugin_args.data(), plugin_args.size())};
+                key = hash_bytes(plugin_parts, sizeof(plugin_parts));
+            }
+            return true;
+        }
+
+        bool load(uint64_t key, batch_result_t& result, double& exec_time) const
+        {
+            FILE * f = fopen(path_for(key).c_str(), "rb");
+            if (!f)
+                return false;
+            char magic[sizeof(MAGIC)];
+            entry_t e;
+            const bool ok = (fread(magic, sizeof(magic), 1, f) == 1) && !memcmp(magic, MAGIC, sizeof(magic))
+                            && (fread(&e, sizeof(e), 1, f) == 1);
+            fclose(f);
+            if (ok)
+            {
+                result = e.result;
+                exec_time = e.exec_time;
+            }
+            return ok;
+        }
+
+        // Written to a temporary file first, so that concurrent batches never read a partial entry.
+        bool store(uint64_t key, const batch_result_t& result, double exec_time) const
+        {
+            const std::string path = path_for(key);
+            const std::string tmp = path + "." + std::to_string(getpid());
+            FILE * f = fopen(tmp.c_str(), "wb");
+            if (!f)
+                return false;
+            const entry_t e = {result, exec_time};
+            bool ok = (fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1) && (fwrite(&e, sizeof(e), 1, f) == 1);
+            ok = (fclose(f) == 0) && ok && (rename(tmp.c_str(), path.c_str()) == 0);
+            if (!ok)
+                unlink(tmp.c_str());
+            return ok;
+        }
+};
@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include "shadow.h"
+#include "plugin.h"
+
+shadow_predictors_t::shadow_predictors_t(const std::vector<std::unique_ptr<predictor_plugin_t>>& plugins)
+{
+    shadows.reserve(plugins.size());
+    for (const std::unique_ptr<predictor_plugin_t>& plugin : plugins)
+        shadows.push_back({plugin->get_table(), plugin->create(), plugin->get_label()});
+}
+
+void shadow_predictors_t::output(uint64_t num_inst, uint64_t conddir_n, uint64_t conddir_m) const
+{
+    auto row = [num_inst](const char * label, uint64_t n, uint64_t m) {
+        printf("%-30s %10lu %10lu %8.4lf%% %8.4lf\n", label, n, m, 100.0 * ((double)m / (double)n), 1000.0 * ((double)m / (double)num_inst));
+    };
+    printf("\n-----------------------------------------SHADOW PREDICTORS (Conditional Branches, Under The Timing Of The Primary Predictor)----------------------------------------\n");
+    printf("Predictor                           NumBr     MispBr        mr     mpki\n");
+    row(active_plugin ? active_plugin->get_label().c_str() : "primary", conddir_n, conddir_m);
+    for (const shadow_t& sh : shadows)
+        row(sh.label.c_str(), sh.conddir_n, sh.conddir_m);
+    printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+}
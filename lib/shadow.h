@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cbp_plugin.h"
+
+class predictor_plugin_t;
+
+// Shadow predictors (-o <shadow.so>[,<args>], repeated): predictor plugins that get every call the simulated predictor
+// gets, in the same order and with the same arguments, without driving the timing. The simulated (primary) predictor
+// alone sets the fetch redirects, so the shadows are compared under one realistic timing and resolve order, rather
+// than each under its own as with -N. A shadow's predictions are checked against the outcomes its spec_update gets,
+// and it reports its own MPKI at the end of the run. The pred_dir of its updates is the primary's prediction, the one
+// the pipeline followed: a shadow updating on its own prediction keeps it, as the sample predictor does in its
+// checkpoint of the branch.
+//
+// The calls go through the predictor_* functions of plugin.h, after the primary's, so the shadows follow it on the
+// predictor thread as well (-t). A shadow only gets the calls of the hooks the primary declares.
+class shadow_predictors_t
+{
+    private:
+        struct shadow_t
+        {
+            const cbp_plugin_t& api;
+            void * instance;
+            std::string label;
+            bool last_pred = false;     // the prediction of the last get_cond_dir_prediction
+            uint64_t conddir_n = 0;
+            uint64_t conddir_m = 0;
+        };
+
+        std::vector<shadow_t> shadows;
+
+    public:
+        // Creates an instance of each plugin; exits if one cannot be created.
+        explicit shadow_predictors_t(const std::vector<std::unique_ptr<predictor_plugin_t>>& plugins);
+        shadow_predictors_t(const shadow_predictors_t&) = delete;
+        shadow_predictors_t& operator=(const shadow_predictors_t&) = delete;
+
+        void begin()
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.begin(sh.instance);
+        }
+
+        void end()
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.end(sh.instance);
+        }
+
+        void cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.last_pred = sh.api.get_cond_dir_prediction(sh.instance, seq_no, piece, pc, pred_cycle);
+        }
+
+        void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+        {
+            const bool cond = (inst_class == InstClass::condBranchInstClass);
+            for (shadow_t& sh : shadows)
+            {
+                sh.conddir_n += cond;
+                sh.conddir_m += cond && (sh.last_pred != resolve_dir);
+                sh.api.spec_update(sh.instance, seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+            }
+        }
+
+        void static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t id)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_static_id(sh.instance, seq_no, piece, pc, id);
+        }
+
+        void instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_instr_fetch(sh.instance, seq_no, piece, pc, cycle);
+        }
+
+        void instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_instr_decode(sh.instance, seq_no, piece, pc, dec_info, cycle);
+        }
+
+        void agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_agen_complete(sh.instance, seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+        }
+
+        void instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_instr_execute_resolve(sh.instance, seq_no, piece, pc, pred_dir, info, cycle);
+        }
+
+        void instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_instr_commit(sh.instance, seq_no, piece, pc, pred_dir, info, cycle);
+        }
+
+        void batch(const cbp_batch_t& b)
+        {
+            for (shadow_t& sh : shadows)
+                sh.api.notify_batch(sh.instance, b);
+        }
+
+        // The report, next to the conditional branches conddir_n and mispredictions conddir_m of the primary, over the
+        // num_inst instructions of the run.
+        void output(uint64_t num_inst, uint64_t conddir_n, uint64_t conddir_m) const;
+};
+
+// The shadow predictors of the run, if any (-o).
+inline shadow_predictors_t * shadow_predictors = nullptr;
@@ -24,8 +24,11 @@
 
 #include <optional>
 #include <vector>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <ostream>
+#include "invariant.h"
 
 enum class InstClass : uint8_t
 {
@@ -95,10 +98,57 @@ enum class HitMissInfo : uint8_t
     Invalid
 };
 
+// Vector of at most N elements stored inline, so filling and copying it never allocates.
+template <class T, size_t N>
+class inline_vector_t
+{
+    T elems[N] = {};
+    uint8_t count = 0;
+
+public:
+    void push_back(const T& val)
+    {
+        CBP_CHECK(count < N);
+        elems[count++] = val;
+    }
+
+    void clear()
+    {
+        count = 0;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    const T& operator[](size_t i) const
+    {
+        CBP_CHECK(i < count);
+        return elems[i];
+    }
+
+    const T* begin() const
+    {
+        return elems;
+    }
+
+    const T* end() const
+    {
+        return elems + count;
+    }
+};
+
 struct DecodeInfo
 {
     InstClass insn_class;
-    std::vector<uint64_t> src_reg_info;
+    uint32_t static_id;                          // dense id of the pc (db_t::static_id)
+    inline_vector_t<uint64_t, 3> src_reg_info;   // at most A, B and C
     std::optional<uint64_t> dst_reg_info;
     //std::optional<uint64_t> imm_op;
     DecodeInfo()
@@ -109,6 +159,7 @@ struct DecodeInfo
     void reset()
     {
         insn_class = InstClass::undefInstClass;
+        static_id = 0;
         src_reg_info.clear();
         dst_reg_info.reset();
     }
@@ -0,0 +1,25 @@
+#pragma once
+
+// Runtime ISA dispatch for the few loops that the compiler vectorizes and that run on every branch or access: the
+// cache way compare, the folded history update, the TAGE tag match, the SC sums and the perceptron dot product and
+// training.
+//
+// A function marked CBP_SIMD_KERNEL is compiled three times, for x86-64-v4 (AVX-512), x86-64-v3 (AVX2, BMI2) and the
+// baseline of the build, and called through an ifunc whose resolver reads CPUID once, when the dynamic loader binds
+// the symbol at startup. One binary built with the default -O3 thus runs the AVX-512 kernels on the Xeons and the
+// AVX2 ones on the EPYCs, without per-host builds or -march=native. The kernels are left out of line by the dispatch,
+// so only loops with enough work per call are marked, never the one-line helpers around them.
+//
+// x86-64 ELF only, with GCC or a clang that knows target_clones, and left out with make SIMD_CLONES=0
+// (CBP_NO_SIMD_CLONES): elsewhere CBP_SIMD_KERNEL is empty and the kernels are built for the target alone. On aarch64
+// NEON is the baseline and the build vectorizes for it already; SVE clones would need GCC 14's aarch64 target_clones.
+
+#if defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute) && !defined(CBP_NO_SIMD_CLONES)
+#if __has_attribute(target_clones)
+#define CBP_SIMD_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#endif
+#endif
+
+#ifndef CBP_SIMD_KERNEL
+#define CBP_SIMD_KERNEL
+#endif
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "trace_reader.h"
+
+// SimPoint profile of a trace, kept next to it in a sidecar text file (<trace>.simpts, written by convert_trace -p):
+// the representative intervals of the trace and their weights, for simulating only those (-K simpoints,...).
+//
+// A decode-only pass cuts the trace into intervals of interval_instrs trace instructions and builds the basic block
+// vector (BBV) of each: the instructions it spent in each basic block, a block ending at every branch (is_br). As in
+// SimPoint, the vectors are normalized and randomly projected to DIMS dimensions on the fly, the projection of a block
+// being drawn from a hash of its start PC, so no per-block table is kept. The intervals are then clustered with
+// k-means for k = 1..max_k, and the smallest k whose Bayesian information criterion (BIC) reaches 90% of the range of
+// scores seen is kept. Each cluster is represented by its interval closest to the centroid, weighted by the fraction
+// of the intervals in the cluster.
+struct simpoint_profile_t
+{
+    static constexpr int DIMS = 15;
+    static constexpr double BIC_THRESHOLD = 0.9;
+
+    struct point_t
+    {
+        uint64_t interval;  // simulates instructions [interval * interval_instrs, (interval + 1) * interval_instrs)
+        double weight;
+    };
+
+    uint64_t trace_size = 0;        // size of the profiled trace file, to detect a stale profile
+    uint64_t num_instrs = 0;
+    uint64_t interval_instrs = 0;
+    std::vector<point_t> points;    // by interval
+
+    static std::string path_for(const char * trace_name)
+    {
+        return std::string(trace_name) + ".simpts";
+    }
+
+    static uint64_t file_size(const char * path)
+    {
+        struct stat st;
+        return (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+    }
+
+    // Loads the profile of trace_name, if there is one and it still matches the trace.
+    bool load(const char * trace_name)
+    {
+        FILE * f = fopen(path_for(trace_name).c_str(), "r");
+        if (!f)
+            return false;
+        simpoint_profile_t p;
+        bool ok = (fscanf(f, "# simpoints %lu %lu %lu", &p.trace_size, &p.num_instrs, &p.interval_instrs) == 3)
+                  && (p.trace_size == file_size(trace_name)) && (p.interval_instrs > 0);
+        point_t point;
+        while (ok && (fscanf(f, "%lu %lf", &point.interval, &point.weight) == 2))
+            p.points.push_back(point);
+        fclose(f);
+        ok = ok && !p.points.empty();
+        if (ok)
+            *this = p;
+        return ok;
+    }
+
+    bool save(const char * trace_name) const
+    {
+        FILE * f = fopen(path_for(trace_name).c_str(), "w");
+        if (!f)
+            return false;
+        bool ok = fprintf(f, "# simpoints %lu %lu %lu\n", trace_size, num_instrs, interval_instrs) > 0;
+        for (const point_t& p : points)
+            ok = ok && (fprintf(f, "%lu %.6f\n", p.interval, p.weight) > 0);
+        return (fclose(f) == 0) && ok;
+    }
+
+    // Profiles the whole trace and picks its simulation points.
+    void build(const char * trace_name, uint64_t interval_size, uint64_t max_k)
+    {
+        *this = simpoint_profile_t();
+        trace_size = file_size(trace_name);
+        interval_instrs = interval_size;
+
+        std::vector<std::array<double, DIMS>> bbvs;
+        std::array<double, DIMS> bbv = {};
+        uint64_t block_pc = 0, block_instrs = 0, interval_count = 0;
+        bool new_block = true;
+        auto end_block = [&]() {
+            for (int d = 0; d < DIMS; d++)
+                bbv[d] += block_instrs * projection(block_pc, d);
+            block_instrs = 0;
+        };
+        auto count_instr = [&](InstClass type, uint64_t pc) {
+            if (new_block)
+                block_pc = pc;
+            new_block = is_br(type);
+            block_instrs++;
+            num_instrs++;
+            if (new_block)
+                end_block();
+            if (++interval_count == interval_instrs)
+            {
+                // a block across the interval boundary counts its instructions in each interval
+                end_block();
+                for (double& x : bbv)
+                    x /= interval_count;
+                bbvs.push_back(bbv);
+                bbv = {};
+                interval_count = 0;
+            }
+        };
+
+        TraceReader reader(trace_name);
+        if (reader.mNative || reader.mStatic)
+        {
+            db_t inst;
+            bool first_piece = true;
+            while (reader.next(inst))
+            {
+                if (first_piece)
+                    count_instr(inst.insn_class, inst.pc);
+                first_piece = inst.is_last_piece;
+            }
+        }
+        else
+            while (reader.readInstr())
+                count_instr(reader.mInstr.mType, reader.mInstr.mPc);
+        if (interval_count > 0)
+        {
+            end_block();
+            for (double& x : bbv)
+                x /= interval_count;
+            bbvs.push_back(bbv);
+        }
+        if (bbvs.empty())
+            return;
+
+        // the clustering of the best k, by BIC
+        std::vector<std::vector<uint64_t>> clusterings;
+        std::vector<std::vector<std::array<double, DIMS>>> all_centroids;
+        std::vector<double> scores;
+        // as many clusters as intervals would fit them exactly: at most one fewer
+        for (uint64_t k = 1; k <= std::min<uint64_t>(max_k, std::max<uint64_t>(1, bbvs.size() - 1)); k++)
+        {
+            std::vector<uint64_t> assignment;
+            std::vector<std::array<double, DIMS>> centroids;
+            const double sse = kmeans(bbvs, k, assignment, centroids);
+            clusterings.push_back(assignment);
+            all_centroids.push_back(centroids);
+            scores.push_back(bic(bbvs.size(), assignment, k, sse));
+        }
+        const auto [lo, hi] = std::minmax_element(scores.begin(), scores.end());
+        const double threshold = *lo + BIC_THRESHOLD * (*hi - *lo);
+        uint64_t best = 0;
+        while (scores[best] < threshold)
+            best++;
+
+        const std::vector<uint64_t>& assignment = clusterings[best];
+        const std::vector<std::array<double, DIMS>>& centroids = all_centroids[best];
+        for (uint64_t c = 0; c < centroids.size(); c++)
+        {
+            uint64_t members = 0, closest = 0;
+            double closest_dist = std::numeric_limits<double>::max();
+            for (uint64_t i = 0; i < bbvs.size(); i++)
+                if (assignment[i] == c)
+                {
+                    members++;
+                    const double dist = distance(bbvs[i], centroids[c]);
+                    if (dist < closest_dist)
+                    {
+                        closest_dist = dist;
+                        closest = i;
+                    }
+                }
+            if (members > 0)
+                points.push_back({closest, (double)members / bbvs.size()});
+        }
+        std::sort(points.begin(), points.end(), [](const point_t& a, const point_t& b) { return a.interval < b.interval; });
+    }
+
+    void print(const char * trace_name) const
+    {
+        printf("%s: %lu instructions, %lu simulation points of %lu instructions\n", trace_name, num_instrs, points.size(), interval_instrs);
+        printf("%10s %14s %8s\n", "Interval", "FirstInstr", "Weight");
+        for (const point_t& p : points)
+            printf("%10lu %14lu %8.4f\n", p.interval, p.interval * interval_instrs, p.weight);
+    }
+
+    // Uniform in [-1, 1], from the start PC of a basic block and a dimension.
+    static double projection(uint64_t pc, int dim)
+    {
+        uint64_t x = pc * DIMS + dim + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return (double)(x >> 11) / (double)(1ULL << 52) - 1.0;
+    }
+
+    static double distance(const std::array<double, DIMS>& a, const std::array<double, DIMS>& b)
+    {
+        double d = 0.0;
+        for (int i = 0; i < DIMS; i++)
+            d += (a[i] - b[i]) * (a[i] - b[i]);
+        return d;
+    }
+
+    // Best of a few runs of Lloyd's algorithm from k-means++ seeds, with a fixed seed so that profiles are
+    // reproducible. Returns the sum of the squared distances to the centroids.
+    static double kmeans(const std::vector<std::array<double, DIMS>>& x, uint64_t k, std::vector<uint64_t>& best_assignment,
+                         std::vector<std::array<double, DIMS>>& best_centroids)
+    {
+        static constexpr int RUNS = 5;
+        static constexpr int MAX_ITERATIONS = 100;
+        std::mt19937_64 rng(k);
+        double best_sse = std::numeric_limits<double>::max();
+        for (int run = 0; run < RUNS; run++)
+        {
+            std::vector<std::array<double, DIMS>> centroids{x[rng() % x.size()]};
+            std::vector<double> dist(x.size());
+            while (centroids.size() < k)
+            {
+                double total = 0.0;
+                for (uint64_t i = 0; i < x.size(); i++)
+                {
+                    dist[i] = std::numeric_limits<double>::max();
+                    for (const auto& c : centroids)
+                        dist[i] = std::min(dist[i], distance(x[i], c));
+                    total += dist[i];
+                }
+                double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+                uint64_t next = 0;
+                while ((next + 1 < x.size()) && ((target -= dist[next]) > 0.0))
+                    next++;
+                centroids.push_back(x[next]);
+            }
+
+            std::vector<uint64_t> assignment(x.size(), k);
+            for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++)
+            {
+                bool changed = false;
+                for (uint64_t i = 0; i < x.size(); i++)
+                {
+                    uint64_t nearest = 0;
+                    for (uint64_t c = 1; c < k; c++)
+                        if (distance(x[i], centroids[c]) < distance(x[i], centroids[nearest]))
+                            nearest = c;
+                    changed |= (assignment[i] != nearest);
+                    assignment[i] = nearest;
+                }
+                if (!changed)
+                    break;
+                std::vector<std::array<double, DIMS>> sums(k, std::array<double, DIMS>{});
+                std::vector<uint64_t> sizes(k, 0);
+                for (uint64_t i = 0; i < x.size(); i++)
+                {
+                    sizes[assignment[i]]++;
+                    for (int d = 0; d < DIMS; d++)
+                        sums[assignment[i]][d] += x[i][d];
+                }
+                for (uint64_t c = 0; c < k; c++)
+                    if (sizes[c] > 0)
+                        for (int d = 0; d < DIMS; d++)
+                            centroids[c][d] = sums[c][d] / sizes[c];
+            }
+
+            double sse = 0.0;
+            for (uint64_t i = 0; i < x.size(); i++)
+                sse += distance(x[i], centroids[assignment[i]]);
+            if (sse < best_sse)
+            {
+                best_sse = sse;
+                best_assignment = assignment;
+                best_centroids = centroids;
+            }
+        }
+        return best_sse;
+    }
+
+    // BIC of a clustering under the identical spherical Gaussians model of X-means (Pelleg and Moore), as SimPoint
+    // scores its clusterings.
+    static double bic(uint64_t n, const std::vector<uint64_t>& assignment, uint64_t k, double sse)
+    {
+        const double r = n;
+        const double variance = std::max((n > k) ? sse / (n - k) : 0.0, 1e-12);
+        std::vector<uint64_t> sizes(k, 0);
+        for (uint64_t c : assignment)
+            sizes[c]++;
+        double likelihood = 0.0;
+        for (uint64_t size : sizes)
+            if (size > 0)
+            {
+                const double rn = size;
+                likelihood += -rn / 2.0 * std::log(2.0 * M_PI) - rn * DIMS / 2.0 * std::log(variance) - (rn - k) / 2.0
+                              + rn * std::log(rn) - rn * std::log(r);
+            }
+        const double params = k * (DIMS + 1);
+        return likelihood - params / 2.0 * std::log(r);
+    }
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <tuple>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Binary snapshot of the simulator and predictor state, to resume a run from a given instruction (-S/-s).
+//
+// The same code saves and restores: every stateful class has a snapshot(snapshot_t&) member that passes each of its
+// members to io() in a fixed order, and io() writes them out or reads them back depending on the mode. Plain data is
+// copied as bytes; classes with a snapshot() member and the standard containers are walked. Sizes and configuration
+// are derived from the sim_config_t the simulator was built with, which the header records and checks on restore.
+// A snapshot is only meant to be restored by the same binary.
+class snapshot_t
+{
+    private:
+        FILE *f;
+        const char *path;
+        const bool restoring;
+        const bool forked;
+
+        template <class T, class = void>
+        struct has_snapshot : std::false_type {};
+        template <class T>
+        struct has_snapshot<T, std::void_t<decltype(std::declval<T&>().snapshot(std::declval<snapshot_t&>()))>> : std::true_type {};
+
+        [[noreturn]] void fail(const char *what) const
+        {
+            fprintf(stderr, "%s snapshot %s: %s\n", (restoring ? "Unable to restore" : "Unable to save"), path, what);
+            if (forked)
+                _exit(1);
+            exit(1);
+        }
+
+    public:
+        static constexpr uint64_t MAGIC = 0x3130504e53504243ull;  // "CBPSNP01"
+
+        // _forked: saved by a child forked for it (lib/autosave.h), which leaves on an error without running the
+        // parent's exit handlers.
+        snapshot_t(const char *_path, bool _restoring, bool _forked = false)
+        : path(_path), restoring(_restoring), forked(_forked)
+        {
+            f = fopen(path, restoring ? "rb" : "wb");
+            if (!f)
+                fail("cannot open file");
+            uint64_t magic = MAGIC;
+            io(magic);
+            if (magic != MAGIC)
+                fail("not a snapshot");
+        }
+
+        // Saved into the stream _f, closed with the snapshot: an open_memstream() for the snapshots compared in memory
+        // (lib/lockstep.h), _path naming it in the errors.
+        snapshot_t(FILE *_f, const char *_path)
+        : f(_f), path(_path), restoring(false), forked(false)
+        {
+            if (!f)
+                fail("cannot open stream");
+            uint64_t magic = MAGIC;
+            io(magic);
+        }
+
+        ~snapshot_t()
+        {
+            if (f && (fclose(f) != 0) && !restoring)
+                fail("write error");
+        }
+
+        snapshot_t(const snapshot_t&) = delete;
+        snapshot_t& operator=(const snapshot_t&) = delete;
+
+        bool loading() const
+        {
+            return restoring;
+        }
+
+        void raw(void *p, size_t size)
+        {
+            if (restoring ? (fread(p, 1, size, f) != size) : (fwrite(p, 1, size, f) != size))
+                fail(restoring ? "truncated file" : "write error");
+        }
+
+        // Saves val, or restores it and checks that it matches val, for the sizes and settings the state depends on.
+        template <class T>
+        void check(const T& val, const char *what)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "only plain data can be checked");
+            unsigned char saved[sizeof(T)];
+            memcpy(saved, &val, sizeof(T));
+            raw(saved, sizeof(T));
+            if (restoring && (memcmp(saved, &val, sizeof(T)) != 0))
+                fail(what);
+        }
+
+        // Stops with an error when a component cannot be saved or restored.
+        [[noreturn]] void unsupported(const char *what) const
+        {
+            fail(what);
+        }
+
+        template <class T>
+        void io(T& val)
+        {
+            if constexpr (has_snapshot<T>::value)
+                val.snapshot(*this);
+            else
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "give the class a snapshot() member");
+                raw(&val, sizeof(T));
+            }
+        }
+
+        template <class T>
+        void io(T *p, size_t n)
+        {
+            if constexpr (std::is_trivially_copyable_v<T> && !has_snapshot<T>::value)
+                raw(p, n * sizeof(T));
+            else
+                for (size_t i = 0; i < n; i++)
+                    io(p[i]);
+        }
+
+        template <class A, class B>
+        void io(std::pair<A, B>& p)
+        {
+            io(p.first);
+            io(p.second);
+        }
+
+        template <class... Ts>
+        void io(std::tuple<Ts...>& t)
+        {
+            std::apply([this](auto&... vals) { (io(vals), ...); }, t);
+        }
+
+        template <class T, class A>
+        void io(std::vector<T, A>& v)
+        {
+            uint64_t n = v.size();
+            io(n);
+            if (restoring)
+                v.resize(n);
+            io(v.data(), n);
+        }
+
+        template <class T>
+        void io(std::deque<T>& d)
+        {
+            uint64_t n = d.size();
+            io(n);
+            if (restoring)
+                d.resize(n);
+            for (T& val : d)
+                io(val);
+        }
+
+        template <class K, class V>
+        void io(std::unordered_map<K, V>& m)
+        {
+            uint64_t n = m.size();
+            io(n);
+            if (restoring)
+            {
+                m.clear();
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    std::pair<K, V> kv;
+                    io(kv.first);
+                    io(kv.second);
+                    m.insert(std::move(kv));
+                }
+            }
+            else
+                for (auto& kv : m)
+                {
+                    K key = kv.first;
+                    io(key);
+                    io(kv.second);
+                }
+        }
+
+        template <class K>
+        void io(std::unordered_set<K>& s)
+        {
+            uint64_t n = s.size();
+            io(n);
+            if (restoring)
+            {
+                s.clear();
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    K key;
+                    io(key);
+                    s.insert(key);
+                }
+            }
+            else
+                for (K key : s)
+                    io(key);
+        }
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "result_cache.h"
+
+// Catalog of warmup snapshots (CBP_SNAPSHOT_CATALOG=<dir>), so that a state is warmed up once for all the users, daemon
+// jobs and runs of a host or a shared file system. A run that saves a snapshot (-S <instr>,<file>) looks it up first:
+// if the catalog has it, the file is fetched from there and the run restores from it as with -s, bit for bit the same
+// run, without simulating the warmup; otherwise the snapshot is saved as usual, then published to the catalog.
+//
+// A snapshot is keyed like a cached batch result (result_cache.h): the trace contents, the sources and flags of the
+// build (source_hash), the simulator options, the predictor plugin and its arguments, and the instruction it is
+// taken at. Its bytes are stored in content-addressed chunks, cut where a rolling hash of the last 64 bytes has its
+// top bits clear (content-defined chunking), so that the cuts follow the contents rather than the offsets: the
+// snapshots of two predictor variants that differ in one component, or of the same predictor a few instructions
+// apart, share the chunks of the tables they have in common, although the sections after them are shifted.
+//
+// <dir>/index/<key>.idx    the snapshot's chunks in order, a text file
+// <dir>/chunks/<hh>/<hash> a chunk, named by the hash of its contents
+//
+// Chunks and indices are written to temporary files and renamed, so concurrent runs never see them partial, and an
+// index is only written once all its chunks are. Nothing is ever removed: the catalog is cleared with rm -r.
+class snapshot_catalog_t
+{
+    private:
+        static constexpr const char * INDEX_MAGIC = "CBPSCAT1";
+        // Small chunks share more: the tables are written all over between two snapshot points, so that two snapshots
+        // of the int sample trace 10000 instructions apart share a third of their bytes in 6 KB chunks, and 4 % in
+        // 80 KB ones.
+        static constexpr size_t MIN_CHUNK = 2 << 10;
+        static constexpr size_t MAX_CHUNK = 64 << 10;
+        static constexpr int CUT_BITS = 12;         // about one cut in 4 KB past MIN_CHUNK
+
+        struct chunk_t
+        {
+            uint64_t hash;
+            size_t size;
+        };
+
+        std::string dir;
+
+        // random values of the rolling (gear) hash, one per byte value, the same in every build
+        static const uint64_t * gear()
+        {
+            static const std::array<uint64_t, 256> table = [] {
+                std::array<uint64_t, 256> t;
+                uint64_t x = 0;
+                for (uint64_t& g : t)
+                {
+                    // splitmix64
+                    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+                    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                    g = z ^ (z >> 31);
+                }
+                return t;
+            }();
+            return table.data();
+        }
+
+        // Length of the chunk that starts at p, n bytes being left.
+        static size_t cut(const uint8_t * p, size_t n)
+        {
+            if (n <= MIN_CHUNK)
+                return n;
+            const uint64_t * g = gear();
+            const size_t end = std::min(n, MAX_CHUNK);
+            uint64_t h = 0;
+            for (size_t k = MIN_CHUNK - 64; k < MIN_CHUNK; k++)
+                h = (h << 1) + g[p[k]];
+            for (size_t k = MIN_CHUNK; k < end; k++)
+            {
+                h = (h << 1) + g[p[k]];
+                if ((h >> (64 - CUT_BITS)) == 0)
+                    return k + 1;
+            }
+            return end;
+        }
+
+        std::string index_path(uint64_t key) const
+        {
+            char name[40];
+            snprintf(name, sizeof(name), "/index/%016" PRIx64 ".idx", key);
+            return dir + name;
+        }
+
+        std::string chunk_path(uint64_t hash) const
+        {
+            char name[48];
+            snprintf(name, sizeof(name), "/chunks/%02x/%016" PRIx64, (unsigned)(hash >> 56), hash);
+            return dir + name;
+        }
+
+        // Writes size bytes at p to path through a temporary file, unless path exists already.
+        static bool write_file(const std::string& path, const void * p, size_t size)
+        {
+            if (access(path.c_str(), R_OK) == 0)
+                return true;
+            const std::string tmp = path + "." + std::to_string(getpid());
+            FILE * f = fopen(tmp.c_str(), "wb");
+            if (!f)
+                return false;
+            bool ok = (fwrite(p, 1, size, f) == size);
+            ok = (fclose(f) == 0) && ok && (rename(tmp.c_str(), path.c_str()) == 0);
+            if (!ok)
+                unlink(tmp.c_str());
+            return ok;
+        }
+
+        bool read_index(uint64_t key, std::vector<chunk_t>& chunks) const
+        {
+            FILE * f = fopen(index_path(key).c_str(), "r");
+            if (!f)
+                return false;
+            char line[4096];
+            bool ok = fgets(line, sizeof(line), f) && !strncmp(line, INDEX_MAGIC, strlen(INDEX_MAGIC));
+            while (ok && fgets(line, sizeof(line), f))
+            {
+                chunk_t c;
+                if (sscanf(line, "chunk %" SCNx64 " %zu", &c.hash, &c.size) == 2)
+                    chunks.push_back(c);
+            }
+            fclose(f);
+            return ok && !chunks.empty();
+        }
+
+    public:
+        explicit snapshot_catalog_t(const char * _dir)
+        : dir(_dir)
+        {
+            mkdir(dir.c_str(), 0755);
+            mkdir((dir + "/index").c_str(), 0755);
+            mkdir((dir + "/chunks").c_str(), 0755);
+        }
+
+        // Key of the snapshot at instruction instr of trace, simulated with the options hashed in config_hash and
+        // the plugin at plugin_path with plugin_args if not nullptr. A trace that is not a local file (remote_file.h) is
+        // keyed by its name. False if the plugin cannot be read.
+        static bool key(const char * trace, uint64_t config_hash, uint64_t instr, const char * plugin_path, const std::string& plugin_args,
+                        uint64_t& key)
+        {
+            uint64_t h;
+            if (!result_cache_t::hash_file(trace, h))
+                h = result_cache_t::hash_bytes(trace, strlen(trace));
+            uint64_t parts[5] = {h, source_hash, config_hash, instr, 0};
+            if (plugin_path)
+            {
+                if (!result_cache_t::hash_file(plugin_path, parts[4]))
+                    return false;
+                parts[4] = result_cache_t::hash_bytes(plugin_args.data(), plugin_args.size(), parts[4]);
+            }
+            key = result_cache_t::hash_bytes(parts, sizeof(parts));
+            return true;
+        }
+
+        // Assembles the snapshot of key into path. False, leaving no file, if the catalog does not have it whole.
+        bool fetch(uint64_t key, const char * path) const
+        {
+            std::vector<chunk_t> chunks;
+            if (!read_index(key, chunks))
+                return false;
+            const std::string tmp = std::string(path) + "." + std::to_string(getpid());
+            FILE * out = fopen(tmp.c_str(), "wb");
+            if (!out)
+                return false;
+            std::vector<uint8_t> buf;
+            bool ok = true;
+            for (const chunk_t& c : chunks)
+            {
+                buf.resize(c.size + 1);
+                FILE * f = fopen(chunk_path(c.hash).c_str(), "rb");
+                ok = f && (fread(buf.data(), 1, buf.size(), f) == c.size) && (result_cache_t::hash_bytes(buf.data(), c.size) == c.hash)
+                     && (fwrite(buf.data(), 1, c.size, out) == c.size);
+                if (f)
+                    fclose(f);
+                if (!ok)
+                    break;
+            }
+            ok = (fclose(out) == 0) && ok && (rename(tmp.c_str(), path) == 0);
+            if (!ok)
+                unlink(tmp.c_str());
+            return ok;
+        }
+
+        // Stores the snapshot at path under key, with what it is of in its index. Prints what it took.
+        bool publish(uint64_t key, const char * path, uint64_t instr, const char * trace)
+        {
+            std::vector<uint8_t> data;
+            if (FILE * f = fopen(path, "rb"))
+            {
+                uint8_t buf[1 << 16];
+                size_t n;
+                while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+                    data.insert(data.end(), buf, buf + n);
+                fclose(f);
+            }
+            if (data.empty())
+                return false;
+
+            std::string index = std::string(INDEX_MAGIC) + "\ninstr " + std::to_string(instr) + "\ntrace " + trace + "\nsize "
+                                + std::to_string(data.size()) + "\n";
+            uint64_t num_chunks = 0, num_new = 0, new_bytes = 0;
+            for (size_t pos = 0; pos < data.size(); num_chunks++)
+            {
+                const size_t size = cut(&data[pos], data.size() - pos);
+                const uint64_t hash = result_cache_t::hash_bytes(&data[pos], size);
+                const std::string chunk = chunk_path(hash);
+                if (access(chunk.c_str(), R_OK) != 0)
+                {
+                    mkdir(chunk.substr(0, chunk.find_last_of('/')).c_str(), 0755);
+                    if (!write_file(chunk, &data[pos], size))
+                    {
+                        fprintf(stderr, "Cannot write the snapshot chunk %s\n", chunk.c_str());
+                        return false;
+                    }
+                    num_new++;
+                    new_bytes += size;
+                }
+                char line[64];
+                snprintf(line, sizeof(line), "chunk %016" PRIx64 " %zu\n", hash, size);
+                index += line;
+                pos += size;
+            }
+            const std::string index_file = index_path(key);
+            if (!write_file(index_file, index.data(), index.size()))
+            {
+                fprintf(stderr, "Cannot write the snapshot index %s\n", index_file.c_str());
+                return false;
+            }
+            printf("Published the snapshot at instruction %lu to the catalog %s: %lu chunks, %lu new (%.1f of %.1f MB)\n", instr,
+                   dir.c_str(), num_chunks, num_new, new_bytes/1e6, data.size()/1e6);
+            return true;
+        }
+
+        const std::string& get_dir() const
+        {
+            return dir;
+        }
+};
@@ -0,0 +1,9 @@
+#include "result_cache.h"
+
+// Set by lib/Makefile from the predictor and library sources and the build flags. This file is rebuilt whenever the
+// hash changes (source_hash.stamp), so that the hash always matches the rest of the build.
+#ifndef CBP_SOURCE_HASH
+#define CBP_SOURCE_HASH 0
+#endif
+
+const uint64_t source_hash = CBP_SOURCE_HASH;
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "huge_arena.h"
+#include "snapshot.h"
+
+// Sparse backing store of a large table whose entries start all zero, for the limit studies that scale a predictor's
+// tables far beyond what a run touches (SPARSE_TAGE in the configuration of CBP2016_TAGE_SC_L).
+//
+// The table is cut into pages of 1 << PAGE_LOG entries, which are taken zeroed from the arena (huge_arena.h) the
+// first time one of their entries is accessed, and found through a directory of page pointers. The memory of a table is
+// then that of the pages touched, packed together in the arena's huge pages in the order they were first touched,
+// rather than every (huge) page of a dense array that an entry falls in. A page is contiguous, so a run of entries
+// within one page can be walked from a pointer to its first.
+//
+// A sparse_table_t is a handle, as a pointer to a dense array is: copies share the pages, and the table is allocated
+// and freed by sparse_new_table() and sparse_delete_table(), as by huge_new_zeroed_array() and huge_delete_array().
+template <class T, int PAGE_LOG>
+class sparse_table_t
+{
+    static_assert(std::is_trivially_destructible<T>::value && std::is_trivially_copyable<T>::value,
+                  "the entries are not constructed");
+
+    private:
+        T ** dir = nullptr;
+
+        [[gnu::noinline]] T * fault(size_t p) const
+        {
+            dir[p] = static_cast<T *>(huge_arena.alloc(PAGE_SIZE * sizeof(T), alignof(T) > 64 ? alignof(T) : 64));
+            return dir[p];
+        }
+
+    public:
+        static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_LOG;
+
+        static size_t num_pages(size_t n) { return (n + PAGE_SIZE - 1) >> PAGE_LOG; }
+
+        sparse_table_t() = default;
+        explicit sparse_table_t(T ** _dir) : dir(_dir) {}
+
+        T& operator[](size_t i) const
+        {
+            T * page = dir[i >> PAGE_LOG];
+            if (__builtin_expect(page == nullptr, 0))
+                page = fault(i >> PAGE_LOG);
+            return page[i & (PAGE_SIZE - 1)];
+        }
+
+        // Entry i without touching its page: zero if the page never was.
+        T peek(size_t i) const
+        {
+            const T * page = dir[i >> PAGE_LOG];
+            return page ? page[i & (PAGE_SIZE - 1)] : T();
+        }
+
+        // The n entries, as s.io(p, n) of a dense array would save them; the untouched pages are only a flag, and
+        // restore as zero.
+        void snapshot(snapshot_t& s, size_t n) const
+        {
+            for (size_t p = 0; p < num_pages(n); p++)
+            {
+                bool touched = dir[p] != nullptr;
+                s.io(touched);
+                if (touched)
+                    s.io(&(*this)[p << PAGE_LOG], PAGE_SIZE);
+                else if (dir[p])
+                    memset(dir[p], 0, PAGE_SIZE * sizeof(T));
+            }
+        }
+
+        T ** directory() const { return dir; }
+};
+
+// Table of n zeroed entries, no page touched.
+template <class T, int PAGE_LOG>
+sparse_table_t<T, PAGE_LOG> sparse_new_table(size_t n)
+{
+    return sparse_table_t<T, PAGE_LOG>(huge_new_zeroed_array<T *>(sparse_table_t<T, PAGE_LOG>::num_pages(n)));
+}
+
+// The pages stay in the arena, as any table freed but the latest allocation.
+template <class T, int PAGE_LOG>
+void sparse_delete_table(sparse_table_t<T, PAGE_LOG>& t, size_t n)
+{
+    huge_delete_array(t.directory(), sparse_table_t<T, PAGE_LOG>::num_pages(n));
+    t = sparse_table_t<T, PAGE_LOG>();
+}
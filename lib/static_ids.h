@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "snapshot.h"
+
+// Dense ids of the static instructions of a trace: each distinct PC gets the next id, from 0, the first time it is
+// seen, so the ids of a trace are those of the order its PCs first appear in. A structure indexed by PC can then be a
+// flat array, grown as new ids come, instead of a hash table.
+//
+// The dictionary itself is an open-addressing table with linear probing, kept at most half full by doubling, and the
+// last PC looked up is remembered, as the pieces of a trace instruction share its PC.
+class static_ids_t
+{
+    private:
+        static constexpr uint64_t INITIAL_CAPACITY = 1 << 14;
+        static constexpr uint32_t FREE = UINT32_MAX;
+
+        struct entry_t
+        {
+            uint64_t pc;
+            uint32_t id;        // FREE for a free slot
+        };
+
+        std::vector<entry_t> table;
+        uint64_t mask = 0;
+        std::vector<uint64_t> pcs;      // by id
+        uint64_t last_pc = 0;
+        uint32_t last_id = FREE;
+
+        static uint64_t hash(uint64_t pc)
+        {
+            return (pc ^ (pc >> 17)) * 0x9E3779B97F4A7C15ull;
+        }
+
+        entry_t& find(uint64_t pc)
+        {
+            uint64_t i = (hash(pc) >> 20) & mask;
+            while ((table[i].id != FREE) && (table[i].pc != pc))
+                i = (i + 1) & mask;
+            return table[i];
+        }
+
+        // capacity must keep the table at most half full
+        void rebuild(uint64_t capacity)
+        {
+            table.assign(capacity, entry_t{0, FREE});
+            mask = capacity - 1;
+            for (uint32_t id = 0; id < pcs.size(); id++)
+                find(pcs[id]) = {pcs[id], id};
+        }
+
+        void grow()
+        {
+            rebuild(table.empty() ? INITIAL_CAPACITY : 2 * table.size());
+        }
+
+    public:
+        // The id of pc, assigned now if it is new.
+        uint32_t id(uint64_t pc)
+        {
+            if ((pc == last_pc) && (last_id != FREE))
+                return last_id;
+            if (2 * (pcs.size() + 1) > table.size())
+                grow();
+            entry_t& e = find(pc);
+            if (e.id == FREE)
+            {
+                e = {pc, (uint32_t)pcs.size()};
+                pcs.push_back(pc);
+            }
+            last_pc = pc;
+            last_id = e.id;
+            return e.id;
+        }
+
+        // Ids assigned so far: every id is below it.
+        uint64_t size() const
+        {
+            return pcs.size();
+        }
+
+        uint64_t pc_of(uint32_t id) const
+        {
+            return pcs[id];
+        }
+
+        // The PCs are saved in id order, and the table rebuilt from them on restore.
+        void snapshot(snapshot_t& s)
+        {
+            s.io(pcs);
+            if (s.loading())
+            {
+                table.clear();
+                if (!pcs.empty())
+                {
+                    uint64_t capacity = INITIAL_CAPACITY;
+                    while (2 * pcs.size() > capacity)
+                        capacity *= 2;
+                    rebuild(capacity);
+                }
+                last_id = FREE;
+            }
+        }
+};
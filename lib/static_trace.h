@@ -0,0 +1,646 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+#include "trace_db.h"
+#include "native_trace.h"
+#include "gz_block_reader.h"
+
+// Static trace format: the pieces of every static instruction are stored once, in a table at the head of the trace,
+// and each trace instruction is a short record of what changes from one execution to the next (convert_trace -d
+// writes them).
+//
+// The records of a .gz trace repeat the class, register lists and crack plan of the static instruction every time it
+// executes, and TraceReader works out the pieces again each time. Here a static instruction is the list of its pieces
+// as TraceReader cracks them, with the dynamic fields cleared: its PC, class, operands, sizes and address offsets.
+// A PC whose crack plan varies (e.g. a SIMD output whose high half is sometimes zero) has one entry per plan. The
+// records then only carry the entry, and decoding a piece is a copy of its template and a few stores.
+//
+// Layout (a single gzip stream, so that the seek index of trace_index.h and block traces apply as to a .gz trace):
+//          static_trace_header_t
+//          with STATIC_TRACE_SHARED: uint64_t hash of the dictionary
+//          num_statics x (varint num_pieces, num_pieces x native_trace_record_t template)
+//          num_instrs x record : varint static id (the hottest entries have the smallest ids)
+//                                if a branch: varint (zigzag(next_pc - pc) << 1 | taken)
+//                                if a load or store: varint effective address of the first piece
+//                                with values: varint output value of each piece with a valid D
+//
+// Without values (convert_trace -d ... novalues), outputs decode as 0, which only value prediction sees.
+//
+// Shared dictionaries: the traces of one binary (a workload family, int_0..int_N) execute mostly the same static
+// instructions. convert_trace -D scans all of them into a static dictionary, the table of their static instructions
+// hottest first, which is content-addressed: its file is <hash>.cbpdict, hash being that of its table. A static trace
+// written against it (convert_trace -d ... <dictionary>, version 2, flag STATIC_TRACE_SHARED) has the hash after its
+// header, and in its own table only the static instructions that are not in the dictionary: ids below the size of
+// the dictionary are its entries, the others those of the trace, in order. The decoder finds the dictionary next to
+// the trace, else in the directory of CBP_STATIC_DICT_DIR, and keeps every dictionary it loads for the process, so
+// that the traces of a family read one after the other share its decoded table.
+//
+// Dictionary layout (gzip):
+//          static_dict_header_t
+//          num_statics x (varint num_pieces, num_pieces x native_trace_record_t template)
+
+static constexpr char STATIC_TRACE_MAGIC[8] = {'C', 'B', 'P', 'S', 'T', 'A', 'T', '\0'};
+static constexpr uint32_t STATIC_TRACE_VERSION = 1;
+static constexpr uint32_t STATIC_TRACE_SHARED_VERSION = 2;
+static constexpr uint32_t STATIC_TRACE_VALUES = 1;
+static constexpr uint32_t STATIC_TRACE_SHARED = 2;
+
+static constexpr char STATIC_DICT_MAGIC[8] = {'C', 'B', 'P', 'S', 'D', 'I', 'C', 'T'};
+static constexpr uint32_t STATIC_DICT_VERSION = 1;
+
+struct static_trace_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;         // STATIC_TRACE_VALUES, STATIC_TRACE_SHARED
+    uint64_t num_statics;   // in the trace's own table
+    uint64_t num_instrs;
+    uint64_t num_pieces;
+};
+
+struct static_dict_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_statics;
+    uint64_t hash;          // of the table after the header
+};
+
+// The templates of the pieces of a trace instruction, as the key of their static instruction.
+inline std::string static_trace_key(const std::vector<db_t>& pieces)
+{
+    const db_t& first = pieces.front();
+    const bool branch = is_br(first.insn_class);
+    const uint64_t base = (first.is_load || first.is_store) ? first.addr : 0;
+    std::string k(pieces.size() * sizeof(native_trace_record_t), '\0');
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        db_t t = pieces[i];
+        // pieces of a trace instruction share its outcome, which is only kept once in the record
+        assert(t.next_pc == first.next_pc && t.is_taken == first.is_taken);
+        if (branch)
+        {
+            t.next_pc = 0;
+            t.is_taken = false;
+        }
+        t.addr -= base;
+        t.D.value = 0;
+        native_trace_record_t rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.encode(t);
+        memcpy(&k[i * sizeof(rec)], &rec, sizeof(rec));
+    }
+    return k;
+}
+
+inline void static_trace_put_varint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+// A static dictionary (convert_trace -D): the keys of its static instructions by id, for the writer, and their decoded
+// pieces, for the decoder.
+class static_dictionary_t
+{
+    public:
+        struct static_t
+        {
+            const db_t * pieces;
+            uint32_t count;
+            bool branch;
+            bool mem;
+        };
+
+        uint64_t hash = 0;
+        std::vector<std::string> keys;
+        std::unordered_map<std::string, uint64_t> ids;
+        std::vector<db_t> pieces;
+        std::vector<static_t> statics;      // into pieces
+
+        static uint64_t hash_bytes(const std::string& data)
+        {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (const char c : data)
+                h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+            return h;
+        }
+
+        static std::string file_name(uint64_t hash)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "%016lx.cbpdict", hash);
+            return name;
+        }
+
+        // The serialized table of keys.
+        static std::string table(const std::vector<std::string>& keys)
+        {
+            std::string t;
+            for (const std::string& k : keys)
+            {
+                static_trace_put_varint(t, k.size() / sizeof(native_trace_record_t));
+                t += k;
+            }
+            return t;
+        }
+
+        // Writes the dictionary of keys, hottest first, into dir; returns its path, empty if it could not be written.
+        static std::string write(const char * dir, const std::vector<std::string>& keys)
+        {
+            const std::string t = table(keys);
+            static_dict_header_t header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, STATIC_DICT_MAGIC, sizeof(header.magic));
+            header.version = STATIC_DICT_VERSION;
+            header.num_statics = keys.size();
+            header.hash = hash_bytes(t);
+            const std::string path = std::string(dir) + "/" + file_name(header.hash);
+            gzFile f = gzopen(path.c_str(), "wb");
+            if (!f)
+                return std::string();
+            const bool ok = (gzwrite(f, &header, sizeof(header)) == (int)sizeof(header)) && (gzwrite(f, t.data(), t.size()) == (int)t.size());
+            return ((gzclose(f) == Z_OK) && ok) ? path : std::string();
+        }
+
+        // Loads the dictionary at path, whose hash must be hash (any if 0); nullptr if it is missing or not that one.
+        static std::shared_ptr<static_dictionary_t> load(const std::string& path, uint64_t hash)
+        {
+            gzFile f = gzopen(path.c_str(), "rb");
+            if (!f)
+                return nullptr;
+            std::string data;
+            char buf[1 << 16];
+            for (int n; (n = gzread(f, buf, sizeof(buf))) > 0; )
+                data.append(buf, n);
+            gzclose(f);
+            static_dict_header_t header;
+            if ((data.size() < sizeof(header)) || memcmp(data.data(), STATIC_DICT_MAGIC, sizeof(header.magic)))
+                return nullptr;
+            memcpy(&header, data.data(), sizeof(header));
+            data.erase(0, sizeof(header));
+            if ((header.version != STATIC_DICT_VERSION) || (hash_bytes(data) != header.hash) || (hash && (header.hash != hash)))
+                return nullptr;
+
+            std::shared_ptr<static_dictionary_t> dict(new static_dictionary_t);
+            dict->hash = header.hash;
+            std::vector<uint64_t> first;
+            size_t pos = 0;
+            for (uint64_t s = 0; s < header.num_statics; s++)
+            {
+                uint64_t count = 0;
+                for (int shift = 0; (pos < data.size()) && (shift < 64); shift += 7)
+                {
+                    const uint8_t b = data[pos++];
+                    count |= (uint64_t)(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                        break;
+                }
+                const size_t size = count * sizeof(native_trace_record_t);
+                if ((count == 0) || (count > UINT32_MAX) || (pos + size > data.size()))
+                    return nullptr;
+                dict->keys.push_back(data.substr(pos, size));
+                dict->ids[dict->keys.back()] = s;
+                first.push_back(dict->pieces.size());
+                for (uint64_t i = 0; i < count; i++)
+                {
+                    native_trace_record_t rec;
+                    memcpy(&rec, &data[pos + i * sizeof(rec)], sizeof(rec));
+                    dict->pieces.emplace_back();
+                    rec.decode(dict->pieces.back());
+                }
+                pos += size;
+                dict->statics.push_back({nullptr, (uint32_t)count, false, false});
+            }
+            for (uint64_t s = 0; s < dict->statics.size(); s++)
+            {
+                static_t& st = dict->statics[s];
+                st.pieces = &dict->pieces[first[s]];
+                st.branch = is_br(st.pieces[0].insn_class);
+                st.mem = st.pieces[0].is_load || st.pieces[0].is_store;
+            }
+            return dict;
+        }
+
+        // The dictionary of hash, for the static trace trace_name: loaded once per process, from the directory of the
+        // trace, else from CBP_STATIC_DICT_DIR. nullptr if it is in neither.
+        static std::shared_ptr<const static_dictionary_t> find(uint64_t hash, const char * trace_name)
+        {
+            static std::unordered_map<uint64_t, std::shared_ptr<const static_dictionary_t>> loaded;
+            const auto it = loaded.find(hash);
+            if (it != loaded.end())
+                return it->second;
+            const std::string trace(trace_name);
+            const size_t slash = trace.find_last_of('/');
+            std::vector<std::string> dirs = {(slash == std::string::npos) ? std::string(".") : trace.substr(0, slash)};
+            if (const char * env = getenv("CBP_STATIC_DICT_DIR"))
+                dirs.push_back(env);
+            for (const std::string& dir : dirs)
+                if (std::shared_ptr<const static_dictionary_t> dict = load(dir + "/" + file_name(hash), hash))
+                    return loaded[hash] = dict;
+            return nullptr;
+        }
+};
+
+// Scans the traces of a family for their static dictionary (convert_trace -D).
+class static_dictionary_builder_t
+{
+    private:
+        std::unordered_map<std::string, uint64_t> mCounts;     // executions of each key
+        std::vector<db_t> mPending;
+
+    public:
+        void scan(const db_t& inst)
+        {
+            mPending.push_back(inst);
+            if (!inst.is_last_piece)
+                return;
+            mCounts[static_trace_key(mPending)]++;
+            mPending.clear();
+        }
+
+        uint64_t num_statics() const
+        {
+            return mCounts.size();
+        }
+
+        // Writes the dictionary into dir, hottest static instructions first; returns its path, empty on failure.
+        std::string write(const char * dir) const
+        {
+            std::vector<std::pair<std::string, uint64_t>> order(mCounts.begin(), mCounts.end());
+            // by key among equal counts, so that the same traces always make the same dictionary
+            std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first); });
+            std::vector<std::string> keys;
+            for (const auto& k : order)
+                keys.push_back(k.first);
+            return static_dictionary_t::write(dir, keys);
+        }
+};
+
+// Two passes over the same trace: scan() every piece to build the table, then append() them all again to write the
+// records.
+class static_trace_writer_t
+{
+    private:
+        gzFile mFile;
+        bool mValues;
+        bool mOk = true;
+        bool mStarted = false;
+        std::unordered_map<std::string, uint64_t> mIds;     // templates of a static instruction -> id
+        std::vector<std::string> mTable;                    // by id
+        std::vector<uint64_t> mCounts;                      // executions of each id, in the scan
+        std::vector<db_t> mPending;                         // pieces of the trace instruction being gathered
+        std::vector<uint8_t> mOut;
+        const static_dictionary_t * mDict;                  // the ids below its size are its entries, if any
+        uint64_t mNumInstrs = 0;
+        uint64_t mNumPieces = 0;
+
+        void put(const void * data, size_t size)
+        {
+            mOut.insert(mOut.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+            if (mOut.size() >= (1 << 20))
+                flush();
+        }
+
+        void put_varint(uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                mOut.push_back((v & 0x7F) | 0x80);
+                v >>= 7;
+            }
+            mOut.push_back(v);
+        }
+
+        void flush()
+        {
+            if (!mOut.empty() && (gzwrite(mFile, mOut.data(), mOut.size()) != (int)mOut.size()))
+                mOk = false;
+            mOut.clear();
+        }
+
+        static bool has_addr(const db_t& first)
+        {
+            return first.is_load || first.is_store;
+        }
+
+        std::string key() const
+        {
+            return static_trace_key(mPending);
+        }
+
+        // Orders the table by decreasing executions, and writes it after the header.
+        void start()
+        {
+            std::vector<uint64_t> order(mTable.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) { return mCounts[a] > mCounts[b]; });
+            std::vector<std::string> table(mTable.size());
+            const uint64_t first_id = mDict ? mDict->keys.size() : 0;
+            for (uint64_t id = 0; id < order.size(); id++)
+            {
+                table[id] = std::move(mTable[order[id]]);
+                mIds[table[id]] = first_id + id;
+            }
+            mTable.swap(table);
+
+            static_trace_header_t header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, STATIC_TRACE_MAGIC, sizeof(header.magic));
+            header.version = mDict ? STATIC_TRACE_SHARED_VERSION : STATIC_TRACE_VERSION;
+            header.flags = (mValues ? STATIC_TRACE_VALUES : 0) | (mDict ? STATIC_TRACE_SHARED : 0);
+            header.num_statics = mTable.size();
+            header.num_instrs = mNumInstrs;
+            header.num_pieces = mNumPieces;
+            put(&header, sizeof(header));
+            if (mDict)
+                put(&mDict->hash, sizeof(mDict->hash));
+            for (const std::string& k : mTable)
+            {
+                put_varint(k.size() / sizeof(native_trace_record_t));
+                put(k.data(), k.size());
+            }
+            mStarted = true;
+        }
+
+    public:
+        // With a dictionary, only the static instructions that are not in it go in the table of the trace.
+        static_trace_writer_t(const char * path, bool values, const static_dictionary_t * dict = nullptr)
+        : mValues(values), mDict(dict)
+        {
+            mFile = gzopen(path, "wb");
+        }
+
+        ~static_trace_writer_t()
+        {
+            if (mFile)
+                gzclose(mFile);
+        }
+
+        bool good() const
+        {
+            return mFile != nullptr;
+        }
+
+        // In the table of the trace, without those of the dictionary.
+        uint64_t num_statics() const
+        {
+            return mTable.size();
+        }
+
+        // First pass: adds the static instruction of each trace instruction to the table, unless it is in the
+        // dictionary.
+        void scan(const db_t& inst)
+        {
+            mPending.push_back(inst);
+            if (!inst.is_last_piece)
+                return;
+            mNumInstrs++;
+            mNumPieces += mPending.size();
+            const std::string k = key();
+            if (mDict && mDict->ids.count(k))
+            {
+                mPending.clear();
+                return;
+            }
+            const auto it = mIds.emplace(k, mTable.size()).first;
+            if (it->second == mTable.size())
+            {
+                mTable.push_back(it->first);
+                mCounts.push_back(0);
+            }
+            mCounts[it->second]++;
+            mPending.clear();
+        }
+
+        // Second pass: writes the record of each trace instruction.
+        void append(const db_t& inst)
+        {
+            if (!mStarted)
+                start();
+            mPending.push_back(inst);
+            if (!inst.is_last_piece)
+                return;
+            const std::string k = key();
+            uint64_t id = UINT64_MAX;
+            if (mDict)
+            {
+                const auto shared = mDict->ids.find(k);
+                if (shared != mDict->ids.end())
+                    id = shared->second;
+            }
+            if (id == UINT64_MAX)
+            {
+                const auto it = mIds.find(k);
+                if (it != mIds.end())
+                    id = it->second;
+            }
+            const db_t& first = mPending.front();
+            if (id == UINT64_MAX)
+                mOk = false;    // not the trace that was scanned
+            else
+            {
+                put_varint(id);
+                if (is_br(first.insn_class))
+                {
+                    const int64_t delta = first.next_pc - first.pc;
+                    put_varint((((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63)) << 1 | first.is_taken);
+                }
+                if (has_addr(first))
+                    put_varint(first.addr);
+                if (mValues)
+                    for (const db_t& piece : mPending)
+                        if (piece.D.valid)
+                            put_varint(piece.D.value);
+            }
+            mPending.clear();
+            if (mOut.size() >= (1 << 20))
+                flush();
+        }
+
+        // Returns false if any write failed.
+        bool close()
+        {
+            if (!mStarted)
+                start();
+            flush();
+            mOk = (gzclose(mFile) == Z_OK) && mOk && mPending.empty();
+            mFile = nullptr;
+            return mOk;
+        }
+};
+
+// Reads the table of a static trace at the head of a (gzip) trace stream, then decodes its records into pieces.
+class static_trace_decoder_t
+{
+    private:
+        typedef static_dictionary_t::static_t static_t;
+
+        std::shared_ptr<const static_dictionary_t> mDict;   // of a trace written against one, shared by the process
+        std::vector<db_t> mPieces;                          // of the trace's own table
+        std::vector<static_t> mStatics;                     // those of the dictionary, then the trace's own
+        bool mStored;   // the records carry the output values
+        bool mValues;   // and they are decoded
+
+        // Trace instruction being handed out
+        const static_t * mCur = nullptr;
+        uint32_t mNext = 0;
+        uint64_t mNextPc = 0;
+        bool mTaken = false;
+        uint64_t mBase = 0;
+        std::vector<uint64_t> mOutputs;     // of the pieces with a valid D, in order
+        size_t mNextOutput = 0;
+
+        static bool get_varint(gz_block_reader_t& in, uint64_t& v)
+        {
+            v = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t b;
+                if (!in.read((char *)&b, 1))
+                    return false;
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                    return true;
+            }
+            return false;
+        }
+
+        // Reads the record of the next trace instruction, or returns false at the end of the trace.
+        bool read_record(gz_block_reader_t& in)
+        {
+            uint64_t id, v;
+            if (!get_varint(in, id))
+                return false;
+            if (id >= mStatics.size())
+            {
+                fprintf(stderr, "Corrupt static trace: static instruction %lu of %lu\n", id, mStatics.size());
+                exit(1);
+            }
+            mCur = &mStatics[id];
+            mNext = 0;
+            bool ok = true;
+            if (mCur->branch)
+            {
+                ok = get_varint(in, v);
+                mTaken = v & 1;
+                v >>= 1;
+                mNextPc = mCur->pieces[0].pc + ((int64_t)(v >> 1) ^ -(int64_t)(v & 1));
+            }
+            mBase = 0;
+            if (ok && mCur->mem)
+                ok = get_varint(in, mBase);
+            mOutputs.clear();
+            mNextOutput = 0;
+            for (uint32_t i = 0; ok && mStored && (i < mCur->count); i++)
+                if (mCur->pieces[i].D.valid)
+                {
+                    ok = get_varint(in, v);
+                    if (mValues)
+                        mOutputs.push_back(v);
+                }
+            // a truncated record ends the trace, as a truncated instruction does for TraceReader
+            return ok;
+        }
+
+    public:
+        // Returns true if the stream at in, which has not been read from yet, is a static trace.
+        static bool is_static_trace(gz_block_reader_t& in)
+        {
+            return in.starts_with(STATIC_TRACE_MAGIC, sizeof(STATIC_TRACE_MAGIC));
+        }
+
+        // Without values, the output values are skipped over and decode as 0.
+        static_trace_decoder_t(gz_block_reader_t& in, const char * trace_name, bool values = true)
+        {
+            static_trace_header_t header;
+            bool ok = in.read((char *)&header, sizeof(header)) && !memcmp(header.magic, STATIC_TRACE_MAGIC, sizeof(header.magic))
+                      && (header.version == ((header.flags & STATIC_TRACE_SHARED) ? STATIC_TRACE_SHARED_VERSION : STATIC_TRACE_VERSION));
+            mStored = header.flags & STATIC_TRACE_VALUES;
+            mValues = values && mStored;
+            uint64_t hash = 0;
+            if (ok && (header.flags & STATIC_TRACE_SHARED))
+            {
+                ok = in.read((char *)&hash, sizeof(hash));
+                mDict = ok ? static_dictionary_t::find(hash, trace_name) : nullptr;
+                if (ok && !mDict)
+                {
+                    fprintf(stderr, "Static trace %s needs the dictionary %s, next to it or in CBP_STATIC_DICT_DIR\n", trace_name,
+                            static_dictionary_t::file_name(hash).c_str());
+                    exit(1);
+                }
+                if (mDict)
+                    mStatics = mDict->statics;
+            }
+            std::vector<uint64_t> first;
+            for (uint64_t s = 0; ok && (s < header.num_statics); s++)
+            {
+                uint64_t count;
+                ok = get_varint(in, count) && (count > 0) && (count <= UINT32_MAX);
+                first.push_back(mPieces.size());
+                for (uint64_t i = 0; ok && (i < count); i++)
+                {
+                    native_trace_record_t rec;
+                    ok = in.read((char *)&rec, sizeof(rec));
+                    mPieces.emplace_back();
+                    rec.decode(mPieces.back());
+                }
+                if (!ok)
+                    break;
+                mStatics.push_back({nullptr, (uint32_t)count, false, false});
+            }
+            if (!ok)
+            {
+                fprintf(stderr, "Corrupt or incompatible static trace %s\n", trace_name);
+                exit(1);
+            }
+            // mPieces is complete: point the trace's own statics into it
+            const uint64_t num_shared = mStatics.size() - first.size();
+            for (uint64_t s = 0; s < first.size(); s++)
+            {
+                static_t& st = mStatics[num_shared + s];
+                st.pieces = &mPieces[first[s]];
+                st.branch = is_br(st.pieces[0].insn_class);
+                st.mem = st.pieces[0].is_load || st.pieces[0].is_store;
+            }
+        }
+
+        // Drops the rest of the trace instruction being handed out, after a seek to the start of another.
+        void reset()
+        {
+            mCur = nullptr;
+        }
+
+        // Fills inst with the next piece, and returns false once the trace is done.
+        bool next(gz_block_reader_t& in, db_t& inst)
+        {
+            if ((!mCur || mNext == mCur->count) && !read_record(in))
+                return false;
+            inst = mCur->pieces[mNext];
+            if (mCur->branch)
+            {
+                inst.next_pc = mNextPc;
+                inst.is_taken = mTaken;
+            }
+            inst.addr += mBase;
+            if (inst.D.valid && mValues)
+                inst.D.value = mOutputs[mNextOutput++];
+            mNext++;
+            return true;
+        }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Machine-readable measurements of a run (-J): each subsystem registers its counters in a group of its own, and the
+// registry is appended as one JSON line per run, tagged with its trace, to a JSON Lines file, to be loaded e.g. with
+// pandas.read_json(lines=True) without parsing any of the text report.
+//
+// A value is a count, a real (NaN and infinities, e.g. a miss ratio without accesses, are written as null) or a
+// per-epoch series of counts. Groups and values keep their registration order.
+class stats_t
+{
+    private:
+        struct value_t
+        {
+            std::string name;
+            enum { COUNT, REAL, SERIES } kind;
+            uint64_t count = 0;
+            double real = 0.0;
+            std::vector<uint64_t> series;
+        };
+
+        std::vector<std::pair<std::string, std::vector<value_t>>> groups;
+
+        std::vector<value_t>& current()
+        {
+            if (groups.empty())
+                group("stats");
+            return groups.back().second;
+        }
+
+        static void append_string(std::string& out, const std::string& s)
+        {
+            out += '"';
+            for (const char c : s)
+            {
+                if ((c == '"') || (c == '\\'))
+                    out += '\\';
+                if ((unsigned char)c < 0x20)
+                {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else
+                    out += c;
+            }
+            out += '"';
+        }
+
+        static void append_value(std::string& out, const value_t& v)
+        {
+            char buf[32];
+            switch (v.kind)
+            {
+                case value_t::COUNT:
+                    snprintf(buf, sizeof(buf), "%lu", v.count);
+                    out += buf;
+                    break;
+                case value_t::REAL:
+                    if (std::isfinite(v.real))
+                    {
+                        snprintf(buf, sizeof(buf), "%.17g", v.real);
+                        out += buf;
+                    }
+                    else
+                        out += "null";
+                    break;
+                case value_t::SERIES:
+                    out += '[';
+                    for (uint64_t i = 0; i < v.series.size(); i++)
+                    {
+                        snprintf(buf, sizeof(buf), (i == 0) ? "%lu" : ",%lu", v.series[i]);
+                        out += buf;
+                    }
+                    out += ']';
+                    break;
+            }
+        }
+
+    public:
+        // Starts a group: the values added next go to it.
+        stats_t& group(const std::string& name)
+        {
+            groups.emplace_back(name, std::vector<value_t>());
+            return *this;
+        }
+
+        stats_t& add(const std::string& name, uint64_t count)
+        {
+            current().push_back({name, value_t::COUNT, count, 0.0, {}});
+            return *this;
+        }
+
+        stats_t& add(const std::string& name, double real)
+        {
+            current().push_back({name, value_t::REAL, 0, real, {}});
+            return *this;
+        }
+
+        stats_t& add(const std::string& name, const std::vector<uint64_t>& per_epoch)
+        {
+            current().push_back({name, value_t::SERIES, 0, 0.0, per_epoch});
+            return *this;
+        }
+
+        // {"trace": "<trace>", "<group>": {"<name>": <value>, ...}, ...}
+        std::string to_json(const std::string& trace) const
+        {
+            std::string out = "{\"trace\": ";
+            append_string(out, trace);
+            for (const auto& g : groups)
+            {
+                out += ", ";
+                append_string(out, g.first);
+                out += ": {";
+                for (uint64_t i = 0; i < g.second.size(); i++)
+                {
+                    if (i)
+                        out += ", ";
+                    append_string(out, g.second[i].name);
+                    out += ": ";
+                    append_value(out, g.second[i]);
+                }
+                out += '}';
+            }
+            out += "}\n";
+            return out;
+        }
+
+        // Appends the record of the run on trace to the file at path with a single write, so that the batch workers
+        // (-B) can share the file. Returns false if it cannot be written.
+        bool append_json(const char * path, const std::string& trace) const
+        {
+            const std::string line = to_json(trace);
+            const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0)
+                return false;
+            const bool written = write(fd, line.data(), line.size()) == (ssize_t)line.size();
+            return (close(fd) == 0) && written;
+        }
+};
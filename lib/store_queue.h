@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include "snapshot.h"
+
+// Store queue with oracle memory disambiguation: the byte timestamps of the youngest store to each byte, until the
+// store commits.
+//
+// Entries are kept per line, with a mask of the bytes written, so an access does one lookup per line it touches.
+// Lines are reclaimed in program order once the stores to them have all committed (release()), which keeps the SQ
+// bounded by the stores in flight rather than by every byte ever stored.
+class store_queue_t
+{
+    private:
+        static constexpr int LINE_BITS = 6;
+        static constexpr uint64_t LINE_BYTES = (1 << LINE_BITS);
+
+        struct line_t
+        {
+            uint64_t valid;                     // mask of the bytes written
+            uint64_t max_ret_cycle;             // latest commit cycle of the bytes
+            uint64_t exec_cycle[LINE_BYTES];    // store's execution cycle
+            uint64_t ret_cycle[LINE_BYTES];     // store's commit cycle
+        };
+
+        std::unordered_map<uint64_t, line_t> lines;
+        // (line, commit cycle) of each store to a line, in program order
+        std::deque<std::pair<uint64_t, uint64_t>> release_order;
+        uint64_t max_lines;
+
+    public:
+        store_queue_t(uint64_t capacity = 256)
+        : max_lines(0)
+        {
+            lines.reserve(capacity);
+        }
+
+        void clear()
+        {
+            lines.clear();
+            release_order.clear();
+            max_lines = 0;
+        }
+
+        // Searches the SQ for the size bytes at addr, for a load searching it at exec_cycle that gets the bytes it
+        // misses from the L1 D$ at data_cache_cycle. Returns the cycle all bytes are available, and whether any
+        // byte missed.
+        uint64_t load(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t data_cache_cycle, bool& miss) const
+        {
+            uint64_t cycle = 0;
+            miss = false;
+            const line_t *line = nullptr;
+            for (uint64_t i = 0; i < size; i++, addr++)
+            {
+                const uint64_t b = (addr & (LINE_BYTES - 1));
+                if ((i == 0) || (b == 0))
+                {
+                    auto it = lines.find(addr >> LINE_BITS);
+                    line = ((it != lines.end()) ? &it->second : nullptr);
+                }
+                if (line && ((line->valid >> b) & 1) && (exec_cycle < line->ret_cycle[b]))
+                {
+                    // SQ hit: the byte's timestamp is the later of load's execution cycle and store's execution cycle
+                    cycle = std::max(cycle, std::max(exec_cycle, line->exec_cycle[b]));
+                }
+                else
+                {
+                    // SQ miss: the byte's timestamp is its availability in L1 D$
+                    cycle = std::max(cycle, data_cache_cycle);
+                    miss = true;
+                }
+            }
+            return cycle;
+        }
+
+        // Records a store of size bytes at addr, executed at exec_cycle and committed at ret_cycle.
+        void store(uint64_t addr, uint64_t size, uint64_t exec_cycle, uint64_t ret_cycle)
+        {
+            line_t *line = nullptr;
+            for (uint64_t i = 0; i < size; i++, addr++)
+            {
+                const uint64_t b = (addr & (LINE_BYTES - 1));
+                if ((i == 0) || (b == 0))
+                {
+                    line = &lines[addr >> LINE_BITS];
+                    line->max_ret_cycle = std::max(line->max_ret_cycle, ret_cycle);
+                    release_order.emplace_back(addr >> LINE_BITS, ret_cycle);
+                }
+                line->valid |= (1ULL << b);
+                line->exec_cycle[b] = exec_cycle;
+                line->ret_cycle[b] = ret_cycle;
+            }
+            max_lines = std::max(max_lines, (uint64_t) lines.size());
+        }
+
+        // Reclaims the lines whose stores have all committed by cycle. No load searching the SQ at cycle or later
+        // can hit them any more. A line is dropped when its oldest outstanding store is released, unless a younger
+        // store to it is still in flight.
+        void release(uint64_t cycle)
+        {
+            while (!release_order.empty() && (release_order.front().second <= cycle))
+            {
+                auto it = lines.find(release_order.front().first);
+                if ((it != lines.end()) && (it->second.max_ret_cycle <= cycle))
+                    lines.erase(it);
+                release_order.pop_front();
+            }
+        }
+
+        static constexpr uint64_t line_bytes()
+        {
+            return LINE_BYTES;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.io(lines);
+            s.io(release_order);
+            s.io(max_lines);
+        }
+
+        // Number of lines held.
+        uint64_t size() const
+        {
+            return lines.size();
+        }
+
+        // Number of lines held at once, at most.
+        uint64_t high_water() const
+        {
+            return max_lines;
+        }
+};
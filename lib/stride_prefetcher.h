@@ -4,7 +4,12 @@
 #include <vector>
 #include <deque>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include "cache.h"
+#include "snapshot.h"
+#include "stats.h"
 //#include <optional>
 
 #define DEF_ENUM(ENUM, NAME) _DEF_ENUM(ENUM, NAME)
@@ -67,23 +72,21 @@ struct RPTEntry
     uint64_t prev_address = 0xdeadbeef;
     uint64_t current_address = 0xdeadbeef;
     int64_t stride = -1;
-    uint64_t lru= 0;
     uint64_t index = -1;
 
     RPTEntry() =default;
-    RPTEntry(PrefetcherState st_, uint64_t t_ , uint64_t p_ , uint64_t c_ , int64_t s_, uint64_t l_, uint64_t i_)
+    RPTEntry(PrefetcherState st_, uint64_t t_ , uint64_t p_ , uint64_t c_ , int64_t s_, uint64_t i_)
     :state(st_)
     ,tag(t_)
     ,prev_address(p_)
     ,current_address(c_)
     ,stride(s_)
-    ,lru(l_)
     ,index(i_)
     {}
 
     friend std::ostream& operator<<(std::ostream& stream, const RPTEntry& e)
     {
-        stream << "Index:" <<std::hex << e.index << " State " << e.state << " Tag: " << std::hex << e.tag << " Prev: " << std::hex << e.prev_address << " Cur: " << std::hex << e.current_address << " Stride: " << std::hex << e.stride << " LRU: " << e.lru;
+        stream << "Index:" <<std::hex << e.index << " State " << e.state << " Tag: " << std::hex << e.tag << " Prev: " << std::hex << e.prev_address << " Cur: " << std::hex << e.current_address << " Stride: " << std::hex << e.stride;
         return stream;
 
     }
@@ -100,9 +103,10 @@ enum class CacheLevel
 struct Prefetch
 {
 
-    explicit Prefetch(uint64_t a_, uint64_t cycle)
+    explicit Prefetch(uint64_t a_, uint64_t cycle, uint64_t source_)
     : address(a_)
     , cycle_generated(cycle)
+    , source(source_)
     {}
     Prefetch() = default;
 
@@ -114,22 +118,32 @@ struct Prefetch
 
     uint64_t address = 0xdeadbeef;
     uint64_t cycle_generated = ~0lu;
+    uint64_t source = 0;    // index of the RPT entry that generated it
     //CacheLevel level;
 };
 
+// The RPT is fully associative with true LRU replacement. Entries are found through a tag index rather than by
+// searching the table, and the LRU order is kept as a list, so lookups and LRU updates do not depend on the number
+// of entries. The queue of generated prefetches is a binary heap ordered by generation cycle, then address, with the
+// lines it holds in a hash set for duplicate filtering.
 class StridePrefetcher
 {
    public:
     void init(const uint64_t n)
     {
+        tag_index.clear();
+        tag_index.reserve(2 * n);
         for(uint64_t i = 0; i < n; i++)
         {
-            //Initialize LRU
+            //Initialize LRU: entry 0 is the least recently used
             rpt[i].index = i;
-            rpt[i].lru = i;
+            lru_prev[i] = (i + n - 1) % n;
+            lru_next[i] = (i + 1) % n;
         }
+        lru_head = 0;
         //Clear queue of generated prefetches
         queue.clear();
+        queued_lines.clear();
     }
 
     StridePrefetcher()
@@ -137,29 +151,62 @@ class StridePrefetcher
         init(NUM_RPT_ENTRIES);
     }
 
+    // Back to the state of a new prefetcher.
+    void reset()
+    {
+        rpt.fill(RPTEntry());
+        init(NUM_RPT_ENTRIES);
+        stat_trainings = 0;
+        stat_generated = 0;
+        stat_issued = 0;
+        stat_duplicate_pf_filtered = 0;
+        stat_dropped_untimely_pf = 0;
+        stat_put_back = 0;
+        stat_stride_zero = 0;
+    }
+
     uint64_t victim_way()
     {
-        auto entry = std::find_if(rpt.begin(), rpt.end(), [](RPTEntry& e){ return !e.lru; });
-        assert((entry != rpt.end()) && "Must find a valid victim way ");
-        spdlog::debug("Prefetch: Found victim entry : {}", *entry);
+        const auto& entry = rpt[lru_head];
+        spdlog::debug("Prefetch: Found victim entry : {}", entry);
 
-        return entry->index;
+        return entry.index;
     }
 
     void update_lru(uint64_t index)
     {
         spdlog::debug("Updating LRU Index: {}", index);
-        auto& lru_way = rpt[index];
-        std::for_each(rpt.begin(), rpt.end(), [&lru_way](RPTEntry &e) { if(e.lru > lru_way.lru){ --e.lru;} });
-        lru_way.lru = (NUM_RPT_ENTRIES - 1);
+        // The list is circular with the LRU entry at its head, so the MRU entry is lru_prev[lru_head].
+        if(index == lru_head)
+        {
+            lru_head = lru_next[index];
+            return;
+        }
+        if(index == lru_prev[lru_head])
+        {
+            return;
+        }
+        lru_next[lru_prev[index]] = lru_next[index];
+        lru_prev[lru_next[index]] = lru_prev[index];
+        const uint64_t mru = lru_prev[lru_head];
+        lru_prev[index] = mru;
+        lru_next[index] = lru_head;
+        lru_next[mru] = index;
+        lru_prev[lru_head] = index;
+    }
+
+    RPTEntry* find(uint64_t tag)
+    {
+        auto it = tag_index.find(tag);
+        return (it == tag_index.end()) ? nullptr : &rpt[it->second];
     }
 
     // Prefetches will be generated when the load is fetched as in "Effective Hardware-Based Data Prefetching for High-Performance Processors"
     // However because we train immediately, there is no need for a count variable.
     void lookahead(uint64_t la_pc, uint64_t cycle)
     {
-        auto entry = std::find_if(rpt.begin(), rpt.end(), [la_pc](RPTEntry& e){ return e.tag == la_pc; });
-        if(entry == rpt.end())
+        RPTEntry* entry = find(la_pc);
+        if(!entry)
         {
             return;
         }
@@ -172,12 +219,17 @@ class StridePrefetcher
     void train(const PrefetchTrainingInfo & info)
     {
         spdlog::debug("Prefetcher: Training on LD {}", info);
-        auto entry = std::find_if(rpt.begin(), rpt.end(), [&info](RPTEntry& e){ return e.tag == info.pc; });
-        if(entry == rpt.end())
+        RPTEntry* entry = find(info.pc);
+        if(!entry)
         {
             //Establish a new entry
             auto victim_index = victim_way();
             auto& victim_entry = rpt[victim_index];
+            if(victim_entry.state != PrefetcherState::Invalid)
+            {
+                tag_index.erase(victim_entry.tag);
+            }
+            tag_index[info.pc] = victim_index;
             victim_entry.state = PrefetcherState::Initial;
             victim_entry.tag = info.pc;
             victim_entry.prev_address = 0xdeadbeef;
@@ -291,32 +343,12 @@ class StridePrefetcher
             return;
         }
 
-        Prefetch pf{entry.current_address + entry.stride * PREFETCH_MULTIPLIER, cycle};
+        Prefetch pf{entry.current_address + entry.stride * PREFETCH_MULTIPLIER, cycle, entry.index};
         spdlog::debug("Prefetcher: Queuing a new prefetch: {} Entry {}", pf, entry);
 
-        auto it = std::find_if(queue.begin(), queue.end(), [&](const Prefetch & qpf)
-        {
-            return (qpf.address & CACHE_LINE_MASK) == (pf.address & CACHE_LINE_MASK);
-        });
-
-        if(it == queue.end())
+        if(queued_lines.insert(pf.address & CACHE_LINE_MASK).second)
         {
-            queue.push_back(pf);
-            
-            // Make extra sure PF are sorted by generation order from oldest to youngest
-            std::sort(queue.begin(), queue.end(), [](const Prefetch & lhs, const Prefetch & rhs)
-            {
-                if(lhs.cycle_generated != rhs.cycle_generated)
-                {
-                    return lhs.cycle_generated < rhs.cycle_generated;
-                }
-                if(lhs.address != rhs.address)
-                {
-                    return lhs.address < rhs.address;
-                }
-                return false;
-            });
-
+            push(pf);
             ++stat_generated;
         }
         else
@@ -333,7 +365,7 @@ class StridePrefetcher
         {
             spdlog::debug("Dropping pf because too old (created at cycle {}, current fetch cycle {})", queue.front().cycle_generated, cycle);
             ++stat_dropped_untimely_pf;
-            queue.pop_front();
+            pop();
         }
 
         if(!queue.empty())
@@ -341,7 +373,7 @@ class StridePrefetcher
             p = queue.front();
             if(p.cycle_generated <= cycle)
             {
-                queue.pop_front();
+                pop();
                 ++stat_issued;
                 return true;
             }
@@ -351,10 +383,12 @@ class StridePrefetcher
         return false;
     }
 
+    // p was the oldest prefetch when issued, so it goes back to the front of the queue.
     void put_back(const Prefetch & p)
     {
         ++stat_put_back;
-        queue.push_front(p);
+        queued_lines.insert(p.address & CACHE_LINE_MASK);
+        push(p);
     }
 
     uint64_t get_oldest_pf_cycle() const
@@ -369,7 +403,72 @@ class StridePrefetcher
         }
     }
 
-    void print_stats()
+    void snapshot(snapshot_t& s)
+    {
+        s.io(rpt);
+        s.io(tag_index);
+        s.io(lru_prev);
+        s.io(lru_next);
+        s.io(lru_head);
+        s.io(queue);
+        s.io(queued_lines);
+        s.io(stat_trainings);
+        s.io(stat_generated);
+        s.io(stat_issued);
+        s.io(stat_duplicate_pf_filtered);
+        s.io(stat_dropped_untimely_pf);
+        s.io(stat_put_back);
+        s.io(stat_stride_zero);
+    }
+
+    // Usefulness of the prefetches, from what became of the blocks they brought into the L1$ (usage, by RPT entry):
+    // accuracy is the share of the blocks filled that a demand access then hit, coverage the share of the demand
+    // misses these hits removed, and late the share of the useful prefetches still in flight at the demand access.
+    struct usefulness_t
+    {
+        prefetch_usage_t total;
+        double accuracy = 0.0;
+        double coverage = 0.0;
+        double late_ratio = 0.0;
+    };
+
+    static usefulness_t usefulness(const std::vector<prefetch_usage_t>& usage, uint64_t demand_misses)
+    {
+        usefulness_t u;
+        for(const prefetch_usage_t& e : usage)
+        {
+            u.total.fills += e.fills;
+            u.total.useful += e.useful;
+            u.total.late += e.late;
+            u.total.useless += e.useless;
+        }
+        u.accuracy = u.total.fills ? (double)u.total.useful / u.total.fills : 0.0;
+        u.coverage = (u.total.useful + demand_misses) ? (double)u.total.useful / (u.total.useful + demand_misses) : 0.0;
+        u.late_ratio = u.total.useful ? (double)u.total.late / u.total.useful : 0.0;
+        return u;
+    }
+
+    void register_stats(stats_t& st, const std::vector<prefetch_usage_t>& usage, uint64_t demand_misses) const
+    {
+        const usefulness_t u = usefulness(usage, demand_misses);
+        st.group("prefetcher")
+          .add("fills", u.total.fills)
+          .add("useful", u.total.useful)
+          .add("late", u.total.late)
+          .add("useless", u.total.useless)
+          .add("accuracy", u.accuracy)
+          .add("coverage", u.coverage)
+          .add("late_ratio", u.late_ratio)
+          .add("trainings", stat_trainings)
+          .add("generated", stat_generated)
+          .add("issued", stat_issued)
+          .add("duplicate_pf_filtered", stat_duplicate_pf_filtered)
+          .add("dropped_untimely_pf", stat_dropped_untimely_pf)
+          .add("put_back", stat_put_back)
+          .add("stride_zero", stat_stride_zero);
+    }
+
+    void print_stats(const std::vector<prefetch_usage_t>& usage, uint64_t demand_misses)
     {
         std::cout << "Num Trainings :" << std::dec << stat_trainings  <<std::endl;
         std::cout << "Num Prefetches generated :" << stat_generated << std::endl;
@@ -378,13 +477,69 @@ class StridePrefetcher
         std::cout << "Num untimely prefetches dropped from PF queue :" << stat_dropped_untimely_pf << std::endl;
         std::cout << "Num prefetches not issued LDST contention :" << stat_put_back << std::endl;
         std::cout << "Num prefetches not issued stride 0 :" << stat_stride_zero << std::endl;
+
+        const usefulness_t u = usefulness(usage, demand_misses);
+        printf("Num prefetched L1$ blocks :%lu (useful %lu, late %lu, evicted unused %lu)\n", u.total.fills, u.total.useful, u.total.late, u.total.useless);
+        printf("Accuracy :%.2f%%, coverage :%.2f%%, late :%.2f%%\n", 100.0 * u.accuracy, 100.0 * u.coverage, 100.0 * u.late_ratio);
+
+        // the RPT entries that filled the most blocks
+        static constexpr uint64_t TOP_ENTRIES = 8;
+        std::vector<uint64_t> order;
+        for(uint64_t i = 0; i < usage.size(); i++)
+        {
+            if(usage[i].fills)
+            {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) { return (usage[a].fills != usage[b].fills) ? usage[a].fills > usage[b].fills : a < b; });
+        order.resize(std::min<uint64_t>(order.size(), TOP_ENTRIES));
+        if(!order.empty())
+        {
+            printf("RPT entry           PC      Fills     Useful       Late    Useless   Stride\n");
+        }
+        for(const uint64_t i : order)
+        {
+            const RPTEntry& e = rpt[i];
+            printf("%9lu %12lx %10lu %10lu %10lu %10lu %8ld\n", i, (e.state == PrefetcherState::Invalid) ? 0 : (e.tag << 2),
+                   usage[i].fills, usage[i].useful, usage[i].late, usage[i].useless, e.stride);
+        }
     }
     private:
     std::array<RPTEntry, NUM_RPT_ENTRIES> rpt;
-    uint64_t lru_info;
+    std::unordered_map<uint64_t, uint64_t> tag_index;   // tag -> index of the valid entries
+    //LRU order, a circular list from the LRU entry (lru_head) to the MRU one
+    std::array<uint64_t, NUM_RPT_ENTRIES> lru_prev;
+    std::array<uint64_t, NUM_RPT_ENTRIES> lru_next;
+    uint64_t lru_head;
+
+    //Queue to store generated prefetches: a heap with the oldest prefetch at the front
+    std::vector<Prefetch> queue;
+    //Lines of the queued prefetches
+    std::unordered_set<uint64_t> queued_lines;
+
+    // Heap order: generation order from oldest to youngest, then address order
+    static bool younger(const Prefetch & lhs, const Prefetch & rhs)
+    {
+        if(lhs.cycle_generated != rhs.cycle_generated)
+        {
+            return lhs.cycle_generated > rhs.cycle_generated;
+        }
+        return lhs.address > rhs.address;
+    }
 
-    //Queue to store generated prefetches
-    std::deque<Prefetch> queue;
+    void push(const Prefetch & pf)
+    {
+        queue.push_back(pf);
+        std::push_heap(queue.begin(), queue.end(), younger);
+    }
+
+    void pop()
+    {
+        queued_lines.erase(queue.front().address & CACHE_LINE_MASK);
+        std::pop_heap(queue.begin(), queue.end(), younger);
+        queue.pop_back();
+    }
     //Stats
     uint64_t stat_trainings = 0;
     uint64_t stat_generated = 0;
@@ -0,0 +1,797 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "sweep.h"
+#include "trace_summary.h"
+#include "cost_model.h"
+#include "interval.h"
+
+// Protocol, one text line per message, the stats record following its DONE line:
+//   worker -> coordinator   GET                                  ready for a job
+//                           DONE <id> <exec_time> <length>       then <length> bytes of stats record
+//                           FAIL <id> <exit_status>
+//   coordinator -> worker   JOB <id> <jobs file line>
+//                           END                                  no more jobs
+// A GET is only answered once there is a job to lease, or with END once the sweep is finished. Job ids are hashes of
+// the jobs file lines, so that results delivered across a coordinator restart still find their job.
+
+namespace {
+
+constexpr unsigned MAX_ATTEMPTS = 3;
+constexpr unsigned RECONNECT_SECONDS = 5;
+
+std::string job_id(const std::string& line)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char c : line)
+        h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+    char id[24];
+    snprintf(id, sizeof(id), "%016lx", h);
+    return id;
+}
+
+// Probes idle connections, so that the peer of a dead node is noticed within about a minute.
+void set_keepalive(int fd)
+{
+    const int on = 1, idle = 30, interval = 10, count = 3;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+bool send_all(int fd, const std::string& data)
+{
+    for (size_t sent = 0; sent < data.size(); )
+    {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Appends data to the file at path, and waits for it to be on disk: the journal must never get ahead of the records.
+bool append_durably(const char * path, const std::string& data)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return false;
+    const bool written = (write(fd, data.data(), data.size()) == (ssize_t)data.size()) && (fdatasync(fd) == 0);
+    return (close(fd) == 0) && written;
+}
+
+std::string json_string(const std::string& s)
+{
+    std::string out = "\"";
+    for (const char c : s)
+    {
+        if ((c == '"') || (c == '\\'))
+            out += '\\';
+        out += ((unsigned char)c < 0x20) ? ' ' : c;
+    }
+    return out + '"';
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Coordinator
+
+struct sweep_job_t {
+    std::string line;       // as in the jobs file
+    std::string id;
+    std::string trace;
+    uint64_t num_uops;      // from the trace summary (<trace>.sum), 0 without one
+    uint64_t trace_size;
+    double cost = 0.0;      // estimated by the cost model, in its seconds
+    enum { QUEUED, LEASED, DONE, FAILED } state = QUEUED;
+    unsigned attempts = 0;  // failed runs
+    int64_t sliced = -1;    // with slicing, the sliced job it is part of
+    int64_t slice = -1;     // and its slice, -1 for the whole run of the reference
+};
+
+// A job of the jobs file cut into slices (sweep_slicing_t), until all of them are in.
+struct sliced_job_t {
+    std::string line;
+    std::string trace;
+    std::vector<uint64_t> begins;           // first instruction of each slice
+    std::vector<uint64_t> ends;             // UINT64_MAX for the last one
+    std::vector<epoch_stats_t> stats;       // of each slice, once in
+    std::vector<double> exec_times;
+    epoch_stats_t reference;
+    double reference_time = 0.0;
+    uint64_t left = 0;                      // slices, and reference, not in yet
+};
+
+struct client_t {
+    int fd;
+    std::string peer;
+    std::string in;         // received, not yet handled
+    int64_t leased = -1;    // job index
+    std::chrono::steady_clock::time_point lease_begin;
+    bool waiting = false;   // sent a GET not answered yet
+};
+
+class coordinator_t
+{
+    private:
+        const char * stats_path;
+        std::string journal_path;
+        std::vector<sweep_job_t> jobs;
+        std::unordered_map<std::string, uint64_t> by_id;
+        std::vector<uint64_t> order;    // longest first
+        uint64_t remaining = 0;         // neither done nor failed
+        uint64_t num_done = 0;
+        std::vector<client_t> clients;
+        cost_model_t * model;
+        const sweep_slicing_t * slicing;
+        std::vector<sliced_job_t> sliced;
+
+        void lease(client_t& c)
+        {
+            for (const uint64_t j : order)
+                if (jobs[j].state == sweep_job_t::QUEUED)
+                {
+                    if (!send_all(c.fd, "JOB " + jobs[j].id + " " + jobs[j].line + "\n"))
+                        return;     // the connection is dropped on its next poll
+                    jobs[j].state = sweep_job_t::LEASED;
+                    c.leased = j;
+                    c.lease_begin = std::chrono::steady_clock::now();
+                    c.waiting = false;
+                    printf("Leased job %s to %s: %s\n", jobs[j].id.c_str(), c.peer.c_str(), jobs[j].line.c_str());
+                    return;
+                }
+        }
+
+        void release(client_t& c, const char * why)
+        {
+            if (c.leased >= 0 && jobs[c.leased].state == sweep_job_t::LEASED)
+            {
+                jobs[c.leased].state = sweep_job_t::QUEUED;
+                printf("Requeued job %s from %s (%s)\n", jobs[c.leased].id.c_str(), c.peer.c_str(), why);
+            }
+            c.leased = -1;
+        }
+
+        sweep_job_t * find(client_t& c, const std::string& id)
+        {
+            const auto it = by_id.find(id);
+            if (it == by_id.end())
+            {
+                printf("Ignored a result from %s for job %s, not in the jobs file\n", c.peer.c_str(), id.c_str());
+                return nullptr;
+            }
+            if (c.leased == (int64_t)it->second)
+                c.leased = -1;
+            sweep_job_t& job = jobs[it->second];
+            return (job.state == sweep_job_t::DONE || job.state == sweep_job_t::FAILED) ? nullptr : &job;
+        }
+
+        void finish(client_t& c, const std::string& id, double exec_time, const std::string& record)
+        {
+            sweep_job_t * job = find(c, id);
+            if (!job)
+                return;
+            if (record.size() < 3 || record.front() != '{' || record.back() != '\n')
+            {
+                fail(c, *job, "malformed stats record");
+                return;
+            }
+            if ((job->sliced >= 0) && !add_slice(*job, record, exec_time))
+            {
+                fail(c, *job, "no measurements of the epochs of the slice, or not as many as it has");
+                return;
+            }
+            const std::string tagged = "{\"job\": " + json_string(job->line) + ", " + record.substr(1);
+            if (!append_durably(stats_path, tagged) || !append_durably(journal_path.c_str(), job->id + "\t" + job->line + "\n"))
+            {
+                fprintf(stderr, "Cannot write the results of the sweep to %s and %s\n", stats_path, journal_path.c_str());
+                exit(1);
+            }
+            job->state = sweep_job_t::DONE;
+            remaining--;
+            num_done++;
+            printf("Finished job %s on %s (%.2fs) [%lu/%lu]: %s\n", job->id.c_str(), c.peer.c_str(), exec_time, num_done, jobs.size(), job->line.c_str());
+            if ((job->sliced >= 0) && (--sliced[job->sliced].left == 0))
+                stitch(sliced[job->sliced]);
+            // a slice takes a fraction of the time of its trace
+            if (model && (job->slice < 0))
+            {
+                std::string workload, run;
+                cost_model_names(job->trace, workload, run);
+                model->update(workload, run, job->trace_size/(1024.0 * 1024), job->num_uops, job->cost, exec_time);
+                printf("About %s left\n", cost_model_t::format_time(time_left()).c_str());
+            }
+        }
+
+        // Of the sweep, from the cost model: the leased jobs on the workers holding them, then the queued ones on the
+        // first worker free, as many workers as there are connections (one per job slot).
+        double time_left() const
+        {
+            const auto now = std::chrono::steady_clock::now();
+            std::vector<double> left, queued;
+            for (const client_t& c : clients)
+                if (c.leased >= 0)
+                {
+                    const double elapsed = std::chrono::duration<double>(now - c.lease_begin).count();
+                    left.push_back(std::max(0.0, model->calibrated(jobs[c.leased].cost) - elapsed));
+                }
+            for (const uint64_t j : order)
+                if (jobs[j].state == sweep_job_t::QUEUED)
+                    queued.push_back(model->calibrated(jobs[j].cost));
+            return cost_model_t::makespan(left, queued, std::max<size_t>(1, clients.size()));
+        }
+
+        void fail(client_t& c, sweep_job_t& job, const char * why)
+        {
+            job.attempts++;
+            const bool give_up = job.attempts >= MAX_ATTEMPTS;
+            // A job re-leased after a coordinator restart may be running on another worker too: let that run finish.
+            const uint64_t j = &job - jobs.data();
+            const bool running = std::any_of(clients.begin(), clients.end(), [&](const client_t& other) { return other.leased == (int64_t)j; });
+            if (give_up || !running)
+                job.state = give_up ? sweep_job_t::FAILED : sweep_job_t::QUEUED;
+            remaining -= give_up;
+            printf("Failed job %s on %s (%s, attempt %u of %u): %s\n", job.id.c_str(), c.peer.c_str(), why, job.attempts, MAX_ATTEMPTS, job.line.c_str());
+        }
+
+        // The line the merged measurements of a sliced job are recorded under: how -K would run it on one node.
+        std::string sliced_line(const sliced_job_t& sj) const
+        {
+            return sj.line + " -K " + std::to_string(slicing->max_slices) + "," + std::to_string(slicing->warmup_instrs)
+                   + (slicing->reference ? ",ref" : "");
+        }
+
+        // Takes the measurements of the epochs of a slice, or of the reference, from its stats record. False if it
+        // has none, or not as many epochs as the slice.
+        bool add_slice(const sweep_job_t& job, const std::string& record, double exec_time)
+        {
+            sliced_job_t& sj = sliced[job.sliced];
+            epoch_stats_t& stats = (job.slice < 0) ? sj.reference : sj.stats[job.slice];
+            if (!parse_epoch_stats(record, stats) || stats.insts.empty())
+                return false;
+            if (job.slice < 0)
+                sj.reference_time = exec_time;
+            else
+                sj.exec_times[job.slice] = exec_time;
+            const uint64_t epoch_size = slicing->sim_config.EPOCH_SIZE_INSTS;
+            return (job.slice < 0) || (sj.ends[job.slice] == UINT64_MAX) || (stats.insts.size() == (sj.ends[job.slice] - sj.begins[job.slice])/epoch_size);
+        }
+
+        // All the slices of sj are in: prints the report of the trace and records the merged measurements.
+        void stitch(sliced_job_t& sj)
+        {
+            printf("Stitching the %lu slices of %s\n", sj.stats.size(), sj.line.c_str());
+            const std::string record = report_intervals(sj.trace.c_str(), slicing->sim_config, slicing->warmup_instrs, sj.stats, sj.begins, sj.exec_times,
+                                                        slicing->reference ? &sj.reference : nullptr, sj.reference_time);
+            if (!append_durably(stats_path, "{\"job\": " + json_string(sliced_line(sj)) + ", " + record.substr(1)))
+            {
+                fprintf(stderr, "Cannot write the results of the sweep to %s\n", stats_path);
+                exit(1);
+            }
+        }
+
+        // Cuts the job of line into slices of whole epochs of its trace, as interval simulation does, and adds them
+        // as jobs, after the reference if any.
+        void add_sliced(const std::string& line, const std::string& trace)
+        {
+            const uint64_t trace_instrs = indexed_trace_length(trace.c_str());
+            if (trace_instrs == 0)
+            {
+                fprintf(stderr, "Distributed interval simulation needs the seek index of %s: run convert_trace -i %s first\n", trace.c_str(), trace.c_str());
+                exit(1);
+            }
+            const uint64_t epoch_size = slicing->sim_config.EPOCH_SIZE_INSTS;
+            const uint64_t num_epochs = (trace_instrs + epoch_size - 1)/epoch_size;
+            const uint64_t num_slices = std::max<uint64_t>(1, std::min(slicing->max_slices, num_epochs));
+            sliced_job_t sj;
+            sj.line = line;
+            sj.trace = trace;
+            sj.stats.resize(num_slices);
+            sj.exec_times.resize(num_slices);
+            sj.left = num_slices + (slicing->reference ? 1 : 0);
+            const int64_t index = sliced.size();
+            auto add = [&](const std::string& job_line, int64_t slice) {
+                sweep_job_t job;
+                job.line = job_line;
+                job.id = job_id(job_line);
+                job.trace = trace;
+                job.sliced = index;
+                job.slice = slice;
+                if (!by_id.emplace(job.id, jobs.size()).second)
+                {
+                    fprintf(stderr, "The jobs file has the job %s twice\n", line.c_str());
+                    exit(1);
+                }
+                jobs.push_back(job);
+            };
+            if (slicing->reference)
+                add(line, -1);
+            for (uint64_t k = 0; k < num_slices; k++)
+            {
+                const uint64_t begin = (k*num_epochs/num_slices)*epoch_size;
+                const uint64_t end = (k + 1 < num_slices) ? ((k + 1)*num_epochs/num_slices)*epoch_size : UINT64_MAX;
+                const uint64_t warmup_begin = (begin > slicing->warmup_instrs) ? begin - slicing->warmup_instrs : 0;
+                sj.begins.push_back(begin);
+                sj.ends.push_back(end);
+                add(line + " -K slice," + std::to_string(warmup_begin) + "," + std::to_string(begin) + "," + std::to_string((end == UINT64_MAX) ? 0 : end), k);
+            }
+            sliced.push_back(sj);
+        }
+
+        // The slices a previous coordinator finished are in its stats records: those that are not are run again. A
+        // sliced job it finished all the slices of, but did not record the merged measurements of, is stitched.
+        void resume_sliced()
+        {
+            std::vector<std::string> records;
+            if (FILE * f = fopen(stats_path, "r"))
+            {
+                std::string record;
+                char buf[65536];
+                while (fgets(buf, sizeof(buf), f))
+                {
+                    record += buf;
+                    if (record.back() == '\n')
+                    {
+                        records.push_back(record);
+                        record.clear();
+                    }
+                }
+                fclose(f);
+            }
+            auto find_record = [&](const std::string& line) -> const std::string * {
+                const std::string prefix = "{\"job\": " + json_string(line) + ", ";
+                for (const std::string& record : records)
+                    if (!record.compare(0, prefix.size(), prefix))
+                        return &record;
+                return nullptr;
+            };
+            for (sweep_job_t& job : jobs)
+                if ((job.sliced >= 0) && (job.state == sweep_job_t::DONE))
+                {
+                    const std::string * record = find_record(job.line);
+                    if (record && add_slice(job, *record, 0.0))
+                        sliced[job.sliced].left--;
+                    else
+                    {
+                        job.state = sweep_job_t::QUEUED;
+                        num_done--;
+                        remaining++;
+                    }
+                }
+            for (sliced_job_t& sj : sliced)
+                if ((sj.left == 0) && !find_record(sliced_line(sj)))
+                    stitch(sj);
+        }
+
+        // Handles the complete messages received from c. Returns false on a protocol error.
+        bool handle(client_t& c)
+        {
+            for (size_t nl; (nl = c.in.find('\n')) != std::string::npos; )
+            {
+                std::istringstream header(c.in.substr(0, nl));
+                std::string kind, id;
+                header >> kind;
+                if (kind == "GET")
+                    c.waiting = true;
+                else if (kind == "DONE")
+                {
+                    double exec_time;
+                    size_t length;
+                    if (!(header >> id >> exec_time >> length))
+                        return false;
+                    if (c.in.size() < nl + 1 + length)
+                        return true;    // the rest of the record is still on its way
+                    finish(c, id, exec_time, c.in.substr(nl + 1, length));
+                    c.in.erase(0, nl + 1 + length);
+                    continue;
+                }
+                else if (kind == "FAIL")
+                {
+                    int status;
+                    if (!(header >> id >> status))
+                        return false;
+                    if (sweep_job_t * job = find(c, id))
+                        fail(c, *job, ("exit status " + std::to_string(status)).c_str());
+                }
+                else
+                    return false;
+                c.in.erase(0, nl + 1);
+            }
+            return true;
+        }
+
+    public:
+        coordinator_t(const char * jobs_path, const char * stats_path, cost_model_t * model, const sweep_slicing_t * slicing)
+        : stats_path(stats_path), journal_path(std::string(jobs_path) + ".done"), model(model), slicing(slicing)
+        {
+            FILE * f = fopen(jobs_path, "r");
+            if (!f)
+            {
+                fprintf(stderr, "Cannot open the jobs file %s\n", jobs_path);
+                exit(1);
+            }
+            char buf[4096];
+            while (fgets(buf, sizeof(buf), f))
+            {
+                std::string line(buf);
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+                line.erase(0, line.find_first_not_of(" \t"));
+                if (line.empty() || line[0] == '#')
+                    continue;
+                if (slicing)
+                {
+                    add_sliced(line, line.substr(0, line.find_first_of(" \t")));
+                    continue;
+                }
+                sweep_job_t job;
+                job.line = line;
+                job.id = job_id(line);
+                job.trace = line.substr(0, line.find_first_of(" \t"));
+                if (!by_id.emplace(job.id, jobs.size()).second)
+                {
+                    printf("Skipped a duplicate job: %s\n", line.c_str());
+                    continue;
+                }
+                jobs.push_back(job);
+            }
+            fclose(f);
+
+            // Jobs already finished by a previous coordinator.
+            uint64_t resumed = 0;
+            if ((f = fopen(journal_path.c_str(), "r")))
+            {
+                while (fgets(buf, sizeof(buf), f))
+                {
+                    const auto it = by_id.find(std::string(buf, strcspn(buf, "\t\n")));
+                    if (it != by_id.end() && jobs[it->second].state != sweep_job_t::DONE)
+                    {
+                        jobs[it->second].state = sweep_job_t::DONE;
+                        resumed++;
+                    }
+                }
+                fclose(f);
+            }
+            num_done = resumed;
+            remaining = jobs.size() - resumed;
+            if (slicing)
+                resume_sliced();
+
+            // Longest traces first, as the batch driver does.
+            for (sweep_job_t& job : jobs)
+            {
+                trace_summary_t summary;
+                job.num_uops = summary.load(job.trace.c_str()) ? summary.num_uops : 0;
+                job.trace_size = trace_summary_t::file_size(job.trace.c_str());
+                if (model)
+                {
+                    std::string workload, run;
+                    cost_model_names(job.trace, workload, run);
+                    job.cost = model->estimate(workload, run, job.trace_size/(1024.0 * 1024), job.num_uops);
+                    if (job.slice >= 0)
+                        job.cost /= sliced[job.sliced].stats.size();
+                }
+            }
+            const bool by_uops = std::all_of(jobs.begin(), jobs.end(), [](const sweep_job_t& job) { return job.num_uops > 0; });
+            for (uint64_t j = 0; j < jobs.size(); j++)
+                order.push_back(j);
+            std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+                if (model)
+                    return jobs[a].cost > jobs[b].cost;
+                return by_uops ? (jobs[a].num_uops > jobs[b].num_uops) : (jobs[a].trace_size > jobs[b].trace_size);
+            });
+
+            if (slicing)
+                printf("Sweep of %lu jobs as %lu slices%s, %lu already finished\n", sliced.size(), jobs.size() - (slicing->reference ? sliced.size() : 0),
+                       slicing->reference ? " and their whole runs" : "", num_done);
+            else
+                printf("Sweep of %lu jobs, %lu already finished\n", jobs.size(), resumed);
+        }
+
+        int run(uint16_t port)
+        {
+            const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+            const int on = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+            if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0)
+            {
+                perror("sweep coordinator");
+                exit(1);
+            }
+            printf("Listening on port %u\n", port);
+            fflush(stdout);
+
+            while (remaining > 0)
+            {
+                std::vector<pollfd> fds(1 + clients.size());
+                fds[0] = {listen_fd, POLLIN, 0};
+                for (uint64_t k = 0; k < clients.size(); k++)
+                    fds[1 + k] = {clients[k].fd, POLLIN, 0};
+                if (poll(fds.data(), fds.size(), -1) < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    perror("poll");
+                    exit(1);
+                }
+
+                for (uint64_t k = 0; k < clients.size(); k++)
+                {
+                    client_t& c = clients[k];
+                    if (!fds[1 + k].revents)
+                        continue;
+                    char buf[65536];
+                    const ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+                    if (n > 0)
+                    {
+                        c.in.append(buf, n);
+                        if (handle(c))
+                            continue;
+                        printf("Protocol error from %s\n", c.peer.c_str());
+                    }
+                    else if (n < 0 && (errno == EINTR || errno == EAGAIN))
+                        continue;
+                    release(c, "connection lost");
+                    close(c.fd);
+                    c.fd = -1;
+                }
+                clients.erase(std::remove_if(clients.begin(), clients.end(), [](const client_t& c) { return c.fd < 0; }), clients.end());
+
+                if (fds[0].revents & POLLIN)
+                {
+                    sockaddr_storage peer;
+                    socklen_t peer_len = sizeof(peer);
+                    const int fd = accept(listen_fd, (sockaddr *)&peer, &peer_len);
+                    if (fd >= 0)
+                    {
+                        set_keepalive(fd);
+                        char host[NI_MAXHOST] = "?", serv[NI_MAXSERV] = "?";
+                        getnameinfo((sockaddr *)&peer, peer_len, host, sizeof(host), serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV);
+                        clients.push_back({fd, std::string(host) + ":" + serv, "", -1, {}, false});
+                    }
+                }
+
+                for (client_t& c : clients)
+                    if (c.waiting)
+                        lease(c);
+                fflush(stdout);
+            }
+
+            for (const client_t& c : clients)
+            {
+                send_all(c.fd, "END\n");
+                close(c.fd);
+            }
+            close(listen_fd);
+
+            const int num_failed = std::count_if(jobs.begin(), jobs.end(), [](const sweep_job_t& job) { return job.state == sweep_job_t::FAILED; });
+            printf("Sweep finished: %lu jobs, %d failed, records in %s\n", jobs.size(), num_failed, stats_path);
+            return num_failed;
+        }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Worker
+
+class worker_t
+{
+    private:
+        const char * host;
+        uint16_t port;
+        const char * log_dir;
+        std::string exe;
+        std::atomic<int> num_failed{0};
+
+        int connect_to_coordinator()
+        {
+            bool reported = false;
+            while (true)
+            {
+                addrinfo hints = {}, * addrs = nullptr;
+                hints.ai_socktype = SOCK_STREAM;
+                if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addrs) == 0)
+                {
+                    for (addrinfo * a = addrs; a; a = a->ai_next)
+                    {
+                        const int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+                        {
+                            freeaddrinfo(addrs);
+                            set_keepalive(fd);
+                            return fd;
+                        }
+                        if (fd >= 0)
+                            close(fd);
+                    }
+                    freeaddrinfo(addrs);
+                }
+                if (!reported)
+                    printf("Waiting for the coordinator at %s:%u\n", host, port);
+                reported = true;
+                fflush(stdout);
+                sleep(RECONNECT_SECONDS);
+            }
+        }
+
+        static bool read_line(int fd, std::string& line)
+        {
+            line.clear();
+            char c;
+            while (true)
+            {
+                const ssize_t n = recv(fd, &c, 1, 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                if (c == '\n')
+                    return true;
+                line += c;
+            }
+        }
+
+        // Runs the job as a cbp process writing its stats record to a file of its own, and returns the message
+        // reporting its outcome.
+        std::string run_job(unsigned slot, const std::string& id, const std::string& line)
+        {
+            std::istringstream words(line);
+            std::vector<std::string> args{exe};
+            std::string trace, word;
+            words >> trace;
+            while (words >> word)
+                args.push_back(word);
+            const std::string record_path = "/tmp/cbp-sweep-" + std::to_string(getpid()) + "-" + std::to_string(slot) + ".jsonl";
+            unlink(record_path.c_str());
+            args.push_back("-J");
+            args.push_back(record_path);
+            args.push_back(trace);
+            std::vector<char *> argv;
+            for (std::string& a : args)
+                argv.push_back(&a[0]);
+            argv.push_back(nullptr);
+            const std::string log_path = log_dir ? (std::string(log_dir) + "/" + id + ".log") : std::string("/dev/null");
+
+            printf("Running job %s: %s\n", id.c_str(), line.c_str());
+            fflush(stdout);
+            const auto begin = std::chrono::steady_clock::now();
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (log_fd >= 0)
+                {
+                    dup2(log_fd, STDOUT_FILENO);
+                    if (log_dir)
+                        dup2(log_fd, STDERR_FILENO);
+                    close(log_fd);
+                }
+                execv(argv[0], argv.data());
+                _exit(127);
+            }
+            int status = -1;
+            if (pid < 0 || waitpid(pid, &status, 0) != pid)
+                status = -1;
+            const double exec_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            std::string record;
+            if (FILE * f = fopen(record_path.c_str(), "r"))
+            {
+                char buf[65536];
+                size_t n;
+                while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+                    record.append(buf, n);
+                fclose(f);
+            }
+            unlink(record_path.c_str());
+
+            const bool pass = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !record.empty();
+            printf("%s job %s (%.2fs)\n", pass ? "Finished" : "Failed", id.c_str(), exec_time);
+            fflush(stdout);
+            if (!pass)
+            {
+                num_failed++;
+                return "FAIL " + id + " " + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : -1) + "\n";
+            }
+            char header[128];
+            snprintf(header, sizeof(header), "DONE %s %.3f %lu\n", id.c_str(), exec_time, record.size());
+            return header + record;
+        }
+
+        // One job at a time, on a connection of its own: the coordinator ties leases to connections.
+        void run_slot(unsigned slot)
+        {
+            std::string report;     // of the last job, until the coordinator has it
+            while (true)
+            {
+                const int fd = connect_to_coordinator();
+                std::string message;
+                while (send_all(fd, report + "GET\n") && read_line(fd, message))
+                {
+                    // the coordinator handles messages in order, so it has the report if it answers the GET
+                    report.clear();
+                    if (message == "END")
+                    {
+                        close(fd);
+                        return;
+                    }
+                    const size_t space = message.find(' ', 4);
+                    if (message.compare(0, 4, "JOB ") != 0 || space == std::string::npos)
+                        break;
+                    report = run_job(slot, message.substr(4, space - 4), message.substr(space + 1));
+                }
+                close(fd);
+                printf("Lost the connection to the coordinator\n");
+                fflush(stdout);
+            }
+        }
+
+    public:
+        worker_t(const char * host, uint16_t port, const char * log_dir)
+        : host(host), port(port), log_dir(log_dir)
+        {
+            char path[4096];
+            const ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+            if (n <= 0)
+            {
+                perror("/proc/self/exe");
+                exit(1);
+            }
+            exe.assign(path, n);
+        }
+
+        int run(unsigned slots)
+        {
+            std::vector<std::thread> threads;
+            for (unsigned slot = 0; slot < slots; slot++)
+                threads.emplace_back([this, slot] { run_slot(slot); });
+            for (std::thread& t : threads)
+                t.join();
+            printf("No more jobs, %d failed\n", num_failed.load());
+            return num_failed;
+        }
+};
+
+} // namespace
+
+int run_sweep_coordinator(uint16_t port, const char * jobs_path, const char * stats_path, cost_model_t * model, const sweep_slicing_t * slicing)
+{
+    signal(SIGPIPE, SIG_IGN);
+    coordinator_t coordinator(jobs_path, stats_path, model, slicing);
+    return coordinator.run(port);
+}
+
+int run_sweep_worker(const char * host, uint16_t port, unsigned slots, const char * log_dir)
+{
+    signal(SIGPIPE, SIG_IGN);
+    if (slots == 0)
+        slots = std::max(1u, std::thread::hardware_concurrency());
+    if (log_dir)
+        mkdir(log_dir, 0755);
+    worker_t worker(host, port, log_dir);
+    return worker.run(slots);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include "parameters.h"
+
+class cost_model_t;
+
+// Distributed sweep: a coordinator (-Q) holds a queue of jobs, each a trace and the simulator options to run it with,
+// and leases them over TCP to the workers (-W) of any number of nodes, which run each job as a cbp process and send
+// back its stats record (-J, lib/stats.h). The traces must be at the same path on every node, e.g. on a shared file
+// system.
+//
+// Jobs file: one job per line, "<trace> [<options>...]"; blank lines and lines starting with # are ignored. Jobs are
+// leased longest trace first, by the cost model if any (cost_model.h), else by uops if all the traces have a summary
+// (convert_trace -s), by file size otherwise, so that the longest traces do not end up alone at the tail of the sweep.
+// With a cost model, each finished job updates it, and the time left for the sweep is printed as jobs finish.
+//
+// The stats record of every finished job is appended to stats_path, with a "job" member holding its jobs file line,
+// and the job is then appended to the journal, <jobs_path>.done. A restarted coordinator skips the jobs in its journal,
+// so a sweep resumes where it stopped; a job may only be run twice if the coordinator stopped between the two appends.
+// Workers keep their running jobs across a coordinator restart, and deliver their results once reconnected.
+//
+// A job leased to a worker whose connection is lost (TCP keepalive detects dead nodes) goes back to the queue. A job
+// whose cbp process fails is retried on other workers, up to MAX_ATTEMPTS runs, and only left out of the journal.
+
+// Distributed interval simulation (-Q with -K <slices>,<warmup_instrs>[,ref]): every job is cut into slices of whole
+// epochs of its trace, as by interval simulation (interval.h), and each slice is leased as a job of its own, the job's
+// line with -K slice,<warmup_begin>,<begin>,<end>, so that the slices of one long trace run on all the nodes. Each one
+// warms up over the warmup_instrs instructions before it, or restores the state at its first instruction from the
+// snapshot catalog (CBP_SNAPSHOT_CATALOG, snapshot_catalog.h) of its node if it has it, and its stats record holds the
+// measurements of its epochs. Once all the slices of a job are in, the coordinator prints the interval simulation
+// report of the trace, and appends the stats record of the merged measurements, with a "job" member holding the job's
+// line followed by -K <slices>,<warmup_instrs>. With reference set, the job is also run whole, as is, and the report
+// gives the error of the estimate against it. The traces must be indexed (convert_trace -i), and the jobs run with the
+// epoch size of the coordinator (-E).
+struct sweep_slicing_t {
+    uint64_t max_slices;
+    uint64_t warmup_instrs;
+    bool reference;
+    sim_config_t sim_config;    // epoch size, and the sections of the report
+};
+
+// Serves the jobs of jobs_path on port until all of them are finished. Returns the number of failed jobs.
+// With slicing, the jobs are cut into slices (see sweep_slicing_t).
+int run_sweep_coordinator(uint16_t port, const char * jobs_path, const char * stats_path, cost_model_t * model = nullptr,
+                          const sweep_slicing_t * slicing = nullptr);
+
+// Runs jobs from the coordinator at host:port, slots at a time, until it has no more. Job reports go to
+// <log_dir>/<job>.log if log_dir is given, and are discarded otherwise. Returns the number of failed jobs.
+int run_sweep_worker(const char * host, uint16_t port, unsigned slots, const char * log_dir);
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sampled access heatmaps of the predictor tables (CBP_TABLE_HEATMAP), to see which packed layouts, bank arrangements
+// and prefetches would pay off. Per table, it records:
+//
+// - the lookups, tag hits and allocations of each region of its entries (<regions> equal ranges of indices), on 1 in N
+//   conditional branches, picked by a hash of the sequence number and piece as with the event trace (-V);
+// - the reuse distance of its entries, the conditional branches between two lookups of the same entry, on 1 in N
+//   entries, picked by a hash of their address (spatial sampling, as in SHARDS, Waldspurger et al., FAST 2015). Every
+//   lookup of a sampled entry is seen, so the distances are those of the whole run, not stretched by the sampling of
+//   the branches; entries shared by several tables (the banks of gtable) are one entry.
+//
+// The cost of a branch that is not sampled is a hash per lookup; the histograms are only touched by sampled ones.
+// Tables without tags have no hits or allocations. close() writes them all to a csv, in long form:
+//
+//   Table,Entries,Kind,Low,High,Lookups,Hits,Allocs
+//   Kind region: the entries [Low, High) of the table, with the sampled lookups, hits and allocations among them
+//   Kind reuse:  the reuse distances [Low, High), in conditional branches, with the lookups of sampled entries at them
+//
+// and prints a heat strip of each table, one character per region.
+class table_heatmap_t
+{
+    private:
+        static constexpr int NUM_REUSE_BINS = 40;   // log2 bins: [0,1), [1,2), [2,4) ... up to 2^38 branches
+
+        struct table_t
+        {
+            std::string name;
+            uint64_t entries;
+            bool tagged;
+            std::vector<uint64_t> lookups, hits, allocs;    // by region
+            uint64_t reuse[NUM_REUSE_BINS] = {};
+        };
+
+        std::vector<table_t> tables;
+        const char * path = nullptr;
+        uint64_t one_in_n = 0;
+        uint64_t regions = 0;
+        bool sampled = false;
+        uint64_t clock = 0;                                 // conditional branches looked up
+        std::unordered_map<uintptr_t, uint64_t> last_seen;  // clock of the last lookup of each sampled entry
+
+        uint64_t region(const table_t& t, uint64_t index) const
+        {
+            return (index * t.lookups.size()) / t.entries;
+        }
+
+        bool entry_sampled(const void * entry) const
+        {
+            return ((((uintptr_t)entry * 0x9E3779B97F4A7C15ull) >> 32) % one_in_n) == 0;
+        }
+
+        static int reuse_bin(uint64_t distance)
+        {
+            return std::min(distance ? 64 - __builtin_clzll(distance) : 0, NUM_REUSE_BINS - 1);
+        }
+
+        static uint64_t bin_low(int bin)
+        {
+            return bin ? 1ull << (bin - 1) : 0;
+        }
+
+    public:
+        // Samples 1 in n branches and entries (all of them for n <= 1), into the given number of regions per table.
+        void open(const char * _path, uint64_t n, uint64_t _regions)
+        {
+            path = _path;
+            one_in_n = (n > 1) ? n : 1;
+            regions = std::max<uint64_t>(_regions, 1);
+        }
+
+        bool enabled() const
+        {
+            return path != nullptr;
+        }
+
+        // Adds a table of the given number of entries. Returns its id.
+        int add_table(const std::string& name, uint64_t entries, bool tagged)
+        {
+            table_t t;
+            t.name = name;
+            t.entries = std::max<uint64_t>(entries, 1);
+            t.tagged = tagged;
+            const uint64_t n = std::min(regions, t.entries);
+            t.lookups.assign(n, 0);
+            t.hits.assign(n, 0);
+            t.allocs.assign(n, 0);
+            tables.push_back(std::move(t));
+            return (int)tables.size() - 1;
+        }
+
+        // Makes branch (seq_no, piece) the subject of the next lookups, recorded if it is sampled.
+        void begin(uint64_t seq_no, uint8_t piece)
+        {
+            sampled = ((((seq_no * 8 + piece) * 0x9E3779B97F4A7C15ull) >> 32) % one_in_n) == 0;
+            clock++;
+        }
+
+        // Same for the allocations of its update, which do not advance the clock.
+        void begin_update(uint64_t seq_no, uint8_t piece)
+        {
+            sampled = ((((seq_no * 8 + piece) * 0x9E3779B97F4A7C15ull) >> 32) % one_in_n) == 0;
+        }
+
+        void lookup(int id, uint64_t index, const void * entry, bool hit = false)
+        {
+            table_t& t = tables[id];
+            if (sampled)
+            {
+                const uint64_t r = region(t, index);
+                t.lookups[r]++;
+                t.hits[r] += hit;
+            }
+            if (entry_sampled(entry))
+            {
+                auto it = last_seen.try_emplace((uintptr_t)entry, clock);
+                if (!it.second)
+                {
+                    t.reuse[reuse_bin(clock - it.first->second)]++;
+                    it.first->second = clock;
+                }
+            }
+        }
+
+        void alloc(int id, uint64_t index)
+        {
+            if (sampled)
+            {
+                table_t& t = tables[id];
+                t.allocs[region(t, index)]++;
+            }
+        }
+
+        // Writes the csv and prints the heat strips. Returns false if the csv cannot be written.
+        bool close()
+        {
+            FILE * f = fopen(path, "w");
+            if (!f)
+                return false;
+            fprintf(f, "Table,Entries,Kind,Low,High,Lookups,Hits,Allocs\n");
+            for (const table_t& t : tables)
+            {
+                const uint64_t n = t.lookups.size();
+                for (uint64_t r = 0; r < n; r++)
+                    fprintf(f, "%s,%lu,region,%lu,%lu,%lu,%lu,%lu\n", t.name.c_str(), t.entries, (r * t.entries + n - 1)/n,
+                            ((r + 1) * t.entries + n - 1)/n, t.lookups[r], t.hits[r], t.allocs[r]);
+                for (int b = 0; b < NUM_REUSE_BINS; b++)
+                    if (t.reuse[b])
+                        fprintf(f, "%s,%lu,reuse,%lu,%lu,%lu,0,0\n", t.name.c_str(), t.entries, bin_low(b), bin_low(b + 1), t.reuse[b]);
+            }
+            const bool ok = (fclose(f) == 0);
+
+            static const char SHADES[] = " .:-=+*#%@";
+            printf("Table heatmaps: 1 in %lu branches and entries, %lu branches, written to %s\n", one_in_n, clock, path);
+            printf("%-12s %8s %10s %7s %7s %10s  lookups by region\n", "Table", "Entries", "Lookups", "Hits", "Allocs", "ReuseP50");
+            for (const table_t& t : tables)
+            {
+                uint64_t lookups = 0, hits = 0, allocs = 0, max_lookups = 0, reuses = 0;
+                for (uint64_t r = 0; r < t.lookups.size(); r++)
+                {
+                    lookups += t.lookups[r];
+                    hits += t.hits[r];
+                    allocs += t.allocs[r];
+                    max_lookups = std::max(max_lookups, t.lookups[r]);
+                }
+                for (const uint64_t c : t.reuse)
+                    reuses += c;
+                int median = 0;
+                for (uint64_t below = 0; (median < NUM_REUSE_BINS) && (2 * (below + t.reuse[median]) < reuses); median++)
+                    below += t.reuse[median];
+                std::string strip;
+                for (const uint64_t c : t.lookups)
+                    strip += SHADES[max_lookups ? (c * 9 + max_lookups - 1)/max_lookups : 0];
+                char ratios[2][16] = {"-", "-"};
+                if (t.tagged)
+                {
+                    snprintf(ratios[0], sizeof(ratios[0]), "%.1f%%", lookups ? 100.0*hits/lookups : 0.0);
+                    snprintf(ratios[1], sizeof(ratios[1]), "%.1f%%", lookups ? 100.0*allocs/lookups : 0.0);
+                }
+                char reuse[16] = "-";
+                if (reuses)
+                    snprintf(reuse, sizeof(reuse), "<%lu", bin_low(median + 1));
+                printf("%-12s %8lu %10lu %7s %7s %10s  |%s|\n", t.name.c_str(), t.entries, lookups, ratios[0], ratios[1], reuse,
+                       strip.c_str());
+            }
+            path = nullptr;
+            return ok;
+        }
+};
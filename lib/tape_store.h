@@ -0,0 +1,330 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "invariant.h"
+
+// Per-branch outcome tapes for replay predictors (idea.txt), within a fixed byte budget.
+//
+// Each branch owns a tape of 32-bit records: runs of identical outcomes (the outcome in bit 0, the length above it)
+// and flags (bit 31 set) that mark a point of the tape with the target of a backward jump. A head moves over the tape:
+// peek() reads the outcome under it, advance() consumes it, and rewind() moves it right after the latest flag of a
+// target, found in O(1) through a small side index of the recent flags of the tape. Writing an outcome or a flag cuts
+// the tape at the head and appends, so a replay that went wrong is recorded over from there.
+//
+// Tapes are chains of BLOCK-record blocks carved out of one arena sized by the budget. Branches map to a tape slot
+// by PC, direct-mapped, and when the arena runs out the least recently used tape is evicted whole. A loop that keeps
+// one outcome costs a single record, so full traces run in the budget at O(1) per operation.
+template <int BLOCK = 14, int FLAGS = 4>
+class tape_store_t
+{
+    static_assert(BLOCK > 0 && FLAGS > 0, "empty tape blocks or flag index");
+
+    public:
+        static constexpr int NONE = -1;
+
+    private:
+        static constexpr uint32_t NIL = UINT32_MAX;
+        static constexpr uint32_t FLAG_BIT = 1u << 31;
+        static constexpr uint32_t MAX_RUN = (1u << 30) - 1;
+
+        struct block_t
+        {
+            uint32_t next = NIL;    // next block of the tape, or of the free list
+            uint32_t owner = NIL;   // tape, NIL when free
+            uint64_t base = 0;      // position of rec[0] on the tape
+            std::array<uint32_t, BLOCK> rec;
+        };
+
+        struct flag_t
+        {
+            uint64_t target = 0;
+            uint64_t pos = 0;       // of the flag record
+            uint32_t block = NIL;
+        };
+
+        struct tape_t
+        {
+            uint64_t pc = UINT64_MAX;       // UINT64_MAX: free slot
+            uint32_t first = NIL;
+            uint32_t last = NIL;
+            uint64_t length = 0;            // records
+            uint64_t head = 0;              // record under the head, never a flag; length when past the end
+            uint32_t head_block = NIL;      // block of the head record
+            uint32_t head_off = 0;          // outcomes of the head run consumed
+            uint32_t newer = NIL;           // LRU list, the most recent first
+            uint32_t older = NIL;
+            std::array<flag_t, FLAGS> flags = {};
+            int next_flag = 0;
+        };
+
+        std::vector<block_t> blocks;
+        std::vector<tape_t> tapes;
+        uint32_t free_blocks = NIL;
+        uint32_t newest = NIL;
+        uint32_t oldest = NIL;
+        uint64_t evictions = 0;
+
+        static uint32_t flag_record(uint64_t target)
+        {
+            return FLAG_BIT | (uint32_t) ((target ^ (target >> 31)) & ~FLAG_BIT);
+        }
+
+        uint32_t& record(uint32_t b, uint64_t pos)
+        {
+            return blocks[b].rec[pos - blocks[b].base];
+        }
+
+        void unlink(uint32_t t)
+        {
+            tape_t& tp = tapes[t];
+            (tp.newer == NIL ? newest : tapes[tp.newer].older) = tp.older;
+            (tp.older == NIL ? oldest : tapes[tp.older].newer) = tp.newer;
+            tp.newer = tp.older = NIL;
+        }
+
+        void push_front(uint32_t t)
+        {
+            tapes[t].older = newest;
+            if (newest != NIL)
+                tapes[newest].newer = t;
+            newest = t;
+            if (oldest == NIL)
+                oldest = t;
+        }
+
+        void free_chain(uint32_t b)
+        {
+            while (b != NIL)
+            {
+                const uint32_t next = blocks[b].next;
+                blocks[b].owner = NIL;
+                blocks[b].next = free_blocks;
+                free_blocks = b;
+                b = next;
+            }
+        }
+
+        // empties tape t, keeping its branch
+        void clear(uint32_t t)
+        {
+            tape_t& tp = tapes[t];
+            free_chain(tp.first);
+            tp.first = tp.last = tp.head_block = NIL;
+            tp.length = tp.head = 0;
+            tp.head_off = 0;
+            tp.next_flag = 0;
+            tp.flags = {};
+        }
+
+        void evict(uint32_t t)
+        {
+            clear(t);
+            unlink(t);
+            tapes[t].pc = UINT64_MAX;
+            evictions++;
+        }
+
+        // a block for tape t, evicting the least recently used tape when the arena is full
+        uint32_t alloc_block(uint32_t t)
+        {
+            while (free_blocks == NIL)
+            {
+                if (oldest == t)
+                {
+                    // the tape alone fills the arena: it starts over
+                    clear(t);
+                    evictions++;
+                }
+                else
+                    evict(oldest);
+            }
+            const uint32_t b = free_blocks;
+            free_blocks = blocks[b].next;
+            blocks[b].next = NIL;
+            blocks[b].owner = t;
+            return b;
+        }
+
+        // cuts the tape at the head, keeping the outcomes of the head run already consumed
+        void cut(tape_t& tp)
+        {
+            if (tp.head >= tp.length)
+                return;
+            uint64_t new_length = tp.head;
+            if (tp.head_off > 0)
+            {
+                uint32_t& r = record(tp.head_block, tp.head);
+                r = (tp.head_off << 1) | (r & 1);
+                new_length = tp.head + 1;
+            }
+            free_chain(blocks[tp.head_block].next);
+            blocks[tp.head_block].next = NIL;
+            tp.last = tp.head_block;
+            tp.length = new_length;
+            tp.head = new_length;
+            tp.head_off = 0;
+        }
+
+        void append(uint32_t t, uint32_t r)
+        {
+            tape_t& tp = tapes[t];
+            if ((tp.last == NIL) || (tp.length - blocks[tp.last].base == BLOCK))
+            {
+                const uint32_t b = alloc_block(t);
+                // the allocation may have emptied the tape
+                blocks[b].base = tp.length;
+                if (tp.last == NIL)
+                    tp.first = b;
+                else
+                    blocks[tp.last].next = b;
+                tp.last = b;
+            }
+            record(tp.last, tp.length) = r;
+            tp.length++;
+            tp.head = tp.length;
+            tp.head_off = 0;
+        }
+
+        // moves the head to the record at pos in block b, or past the flags that start there
+        void seek(tape_t& tp, uint32_t b, uint64_t pos)
+        {
+            tp.head_off = 0;
+            while ((pos < tp.length) && (record(b, pos) & FLAG_BIT))
+            {
+                pos++;
+                if ((pos < tp.length) && (pos - blocks[b].base == BLOCK))
+                    b = blocks[b].next;
+            }
+            tp.head = pos;
+            tp.head_block = (pos < tp.length) ? b : NIL;
+        }
+
+    public:
+        // Tape slots are 2^log_tapes, and the blocks take the rest of budget_bytes.
+        tape_store_t(uint64_t budget_bytes, int log_tapes)
+        : tapes(1ULL << log_tapes)
+        {
+            const uint64_t tape_bytes = tapes.size() * sizeof(tape_t);
+            CBP_CHECK(budget_bytes > tape_bytes + sizeof(block_t) && "tape budget too small");
+            blocks.resize((budget_bytes - tape_bytes) / sizeof(block_t));
+            for (uint32_t b = blocks.size(); b-- > 0;)
+            {
+                blocks[b].next = free_blocks;
+                free_blocks = b;
+            }
+        }
+
+        uint64_t bytes() const
+        {
+            return tapes.size() * sizeof(tape_t) + blocks.size() * sizeof(block_t);
+        }
+
+        uint64_t num_evictions() const
+        {
+            return evictions;
+        }
+
+        // Tape of the branch at pc, or NONE.
+        int find(uint64_t pc) const
+        {
+            const uint32_t t = (pc ^ (pc >> 16)) & (tapes.size() - 1);
+            return (tapes[t].pc == pc) ? (int) t : NONE;
+        }
+
+        // Tape of the branch at pc, made the most recently used; an empty one, replacing the slot's branch, if it had
+        // none (created is then set).
+        int tape(uint64_t pc, bool& created)
+        {
+            const uint32_t t = (pc ^ (pc >> 16)) & (tapes.size() - 1);
+            created = (tapes[t].pc != pc);
+            if (created)
+            {
+                if (tapes[t].pc != UINT64_MAX)
+                    evict(t);
+                tapes[t].pc = pc;
+            }
+            else
+                unlink(t);
+            push_front(t);
+            return t;
+        }
+
+        // Outcome under the head, or NONE past the end of the tape.
+        int peek(int t) const
+        {
+            const tape_t& tp = tapes[t];
+            if (tp.head >= tp.length)
+                return NONE;
+            return blocks[tp.head_block].rec[tp.head - blocks[tp.head_block].base] & 1;
+        }
+
+        // Moves the head past the outcome peek() returned.
+        void advance(int t)
+        {
+            tape_t& tp = tapes[t];
+            CBP_CHECK(tp.head < tp.length);
+            const uint32_t r = record(tp.head_block, tp.head);
+            if (++tp.head_off < (r >> 1))
+                return;
+            uint32_t b = tp.head_block;
+            if (tp.head + 1 - blocks[b].base == BLOCK)
+                b = blocks[b].next;
+            seek(tp, b, tp.head + 1);
+        }
+
+        // Records an outcome at the head, cutting the tape there.
+        void write(int t, bool taken)
+        {
+            tape_t& tp = tapes[t];
+            cut(tp);
+            // a cut may leave the last block empty, the run to extend then ends the block before
+            if ((tp.last != NIL) && (tp.length > blocks[tp.last].base))
+            {
+                uint32_t& r = record(tp.last, tp.length - 1);
+                if (!(r & FLAG_BIT) && ((r & 1) == (uint32_t) taken) && ((r >> 1) < MAX_RUN))
+                {
+                    r += 2;
+                    return;
+                }
+            }
+            append(t, (1u << 1) | (uint32_t) taken);
+        }
+
+        // Plants a flag for target at the head, cutting the tape there.
+        void flag(int t, uint64_t target)
+        {
+            tape_t& tp = tapes[t];
+            cut(tp);
+            append(t, flag_record(target));
+            flag_t& f = tp.flags[tp.next_flag];
+            tp.next_flag = (tp.next_flag + 1) % FLAGS;
+            f.target = target;
+            f.pos = tp.length - 1;
+            f.block = tp.last;
+        }
+
+        // Moves the head right after the latest flag planted for target, if it is still on the tape.
+        bool rewind(int t, uint64_t target)
+        {
+            tape_t& tp = tapes[t];
+            for (int k = 1; k <= FLAGS; k++)
+            {
+                const flag_t& f = tp.flags[(tp.next_flag + FLAGS - k) % FLAGS];
+                if ((f.block == NIL) || (f.target != target))
+                    continue;
+                const block_t& b = blocks[f.block];
+                // a cut may have dropped the flag, and its block been reused
+                if ((b.owner != (uint32_t) t) || (f.pos >= tp.length) || (f.pos < b.base) || (f.pos - b.base >= BLOCK)
+                    || (b.rec[f.pos - b.base] != flag_record(target)))
+                    continue;
+                uint32_t nb = f.block;
+                if (f.pos + 1 - b.base == BLOCK)
+                    nb = b.next;
+                seek(tp, nb, f.pos + 1);
+                return true;
+            }
+            return false;
+        }
+};
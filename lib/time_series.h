@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bp.h"
+
+// High-resolution time series of a run (-q <file>[,<epoch_insts>]): the measurements of every epoch of epoch_insts
+// instructions (10000 by default), independent of the epochs of -E, for phase analysis at a grain the per-epoch
+// vectors of bp_t and uarchsim_t would take too much memory and output for.
+//
+// Each epoch is a row of COLUMNS counters, the per-epoch deltas of the running totals: instructions, cycles, then
+// the conditional, indirect and return branches and their mispredictions, and the cycles on the wrong path (cycles
+// are 0 in branch-only mode). Rows go to a block of up to BLOCK_EPOCHS epochs, stored by column: each value as the
+// zigzag varint of its difference from the one before it in the block, so that a steady phase costs about a byte per
+// counter and epoch, and a block decodes on its own.
+//
+// Full blocks join a single-producer/single-consumer ring of RING_BLOCKS, written to the file by a background thread,
+// as the trace of -V is (event_trace.h). Unlike its records, rows are never dropped: the simulation waits for a free
+// block when the ring is full, which at a few bytes per epoch only a stalled disk would cause. Memory stays at the
+// ring, whatever the length of the run.
+//
+// File : time_series_header_t
+//        chunks : uint32 TIME_SERIES_TRACE, uint32 length, name of the trace the next blocks are of
+//                 uint32 TIME_SERIES_BLOCK, uint32 num_epochs, COLUMNS x uint32 bytes of the column, the columns
+//
+// read by scripts/time_series.py.
+
+static constexpr char TIME_SERIES_MAGIC[8] = {'C', 'B', 'P', 'T', 'S', '1', '\0', '\0'};
+static constexpr uint32_t TIME_SERIES_TRACE = 1;
+static constexpr uint32_t TIME_SERIES_BLOCK = 2;
+
+struct time_series_header_t
+{
+    char magic[8];
+    uint32_t num_columns;
+    uint32_t block_epochs;
+    uint64_t epoch_insts;
+};
+
+class time_series_t
+{
+    public:
+        enum column_t
+        {
+            COL_INSTR,
+            COL_CYCLES,
+            COL_CONDDIR_N,
+            COL_CONDDIR_M,
+            COL_JUMPIND_N,
+            COL_JUMPIND_M,
+            COL_JUMPRET_N,
+            COL_JUMPRET_M,
+            COL_CYCLES_WP,
+            COLUMNS
+        };
+        static constexpr uint32_t BLOCK_EPOCHS = 4096;
+
+    private:
+        static constexpr uint64_t RING_BLOCKS = 8;
+
+        struct block_t
+        {
+            std::string trace;          // a TIME_SERIES_TRACE chunk if not empty
+            uint32_t num_epochs = 0;
+            uint64_t last[COLUMNS] = {};
+            std::vector<uint8_t> columns[COLUMNS];
+
+            void clear()
+            {
+                trace.clear();
+                num_epochs = 0;
+                std::fill(std::begin(last), std::end(last), 0);
+                for (std::vector<uint8_t>& c : columns)
+                    c.clear();
+            }
+        };
+
+        std::vector<block_t> ring;
+        // Blocks sealed by the simulation thread / written by the writer thread, each on its own line.
+        alignas(64) std::atomic<uint64_t> pushed{0};
+        alignas(64) std::atomic<uint64_t> written{0};
+        std::atomic<bool> stop{false};
+
+        FILE * file = nullptr;
+        std::thread writer;
+
+        // Simulation thread: the epoch being counted, and the totals at its start.
+        uint64_t epoch_insts = 0;
+        uint64_t left = 0;              // instructions to the end of the epoch
+        uint64_t start_cycle = 0;
+        branch_totals_t start_totals;
+
+        void write_block(const block_t& b)
+        {
+            if (!b.trace.empty())
+            {
+                const uint32_t head[2] = {TIME_SERIES_TRACE, (uint32_t)b.trace.size()};
+                fwrite(head, sizeof(head), 1, file);
+                fwrite(b.trace.data(), 1, b.trace.size(), file);
+                return;
+            }
+            uint32_t head[2 + COLUMNS] = {TIME_SERIES_BLOCK, b.num_epochs};
+            for (int c = 0; c < COLUMNS; c++)
+                head[2 + c] = b.columns[c].size();
+            fwrite(head, sizeof(head), 1, file);
+            for (const std::vector<uint8_t>& c : b.columns)
+                fwrite(c.data(), 1, c.size(), file);
+        }
+
+        void drain()
+        {
+            for (;;)
+            {
+                const uint64_t end = pushed.load(std::memory_order_acquire);
+                uint64_t begin = written.load(std::memory_order_relaxed);
+                if (begin == end)
+                {
+                    if (stop.load(std::memory_order_acquire) && (pushed.load(std::memory_order_acquire) == begin))
+                        return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                for (; begin != end; begin++)
+                {
+                    write_block(ring[begin % RING_BLOCKS]);
+                    written.store(begin + 1, std::memory_order_release);
+                }
+                fflush(file);
+            }
+        }
+
+        // The block being filled, the one after the last sealed.
+        block_t& current()
+        {
+            return ring[pushed.load(std::memory_order_relaxed) % RING_BLOCKS];
+        }
+
+        // Hands the block being filled to the writer, and waits for the next one to be free.
+        void seal()
+        {
+            const uint64_t p = pushed.load(std::memory_order_relaxed) + 1;
+            pushed.store(p, std::memory_order_release);
+            while (p - written.load(std::memory_order_acquire) == RING_BLOCKS)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            ring[p % RING_BLOCKS].clear();
+        }
+
+        void put(std::vector<uint8_t>& column, uint64_t& last, uint64_t value)
+        {
+            const int64_t d = (int64_t)(value - last);
+            last = value;
+            uint64_t v = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+            while (v >= 0x80)
+            {
+                column.push_back((v & 0x7F) | 0x80);
+                v >>= 7;
+            }
+            column.push_back(v);
+        }
+
+    public:
+        time_series_t() = default;
+        time_series_t(const time_series_t&) = delete;
+        time_series_t& operator=(const time_series_t&) = delete;
+
+        ~time_series_t()
+        {
+            close();
+        }
+
+        // Starts recording epochs of n instructions to path. Returns false if it cannot be written.
+        bool open(const char * path, uint64_t n)
+        {
+            file = fopen(path, "wb");
+            if (!file)
+                return false;
+            epoch_insts = left = n;
+            pushed.store(0);
+            written.store(0);
+            stop.store(false);
+            time_series_header_t header = {{}, COLUMNS, BLOCK_EPOCHS, epoch_insts};
+            std::copy(std::begin(TIME_SERIES_MAGIC), std::end(TIME_SERIES_MAGIC), header.magic);
+            fwrite(&header, sizeof(header), 1, file);
+            ring.resize(RING_BLOCKS);
+            writer = std::thread(&time_series_t::drain, this);
+            return true;
+        }
+
+        // Writes the blocks left in the ring and closes the file.
+        void close()
+        {
+            if (!file)
+                return;
+            stop.store(true, std::memory_order_release);
+            writer.join();
+            fclose(file);
+            file = nullptr;
+        }
+
+        bool enabled() const
+        {
+            return file != nullptr;
+        }
+
+        // The epochs that follow are of trace_name, from its first instruction on.
+        void begin(const char * trace_name)
+        {
+            if (!file)
+                return;
+            if (current().num_epochs > 0)
+                seal();
+            current().trace = trace_name;
+            seal();
+            left = epoch_insts;
+            start_cycle = 0;
+            start_totals = branch_totals_t();
+        }
+
+        // Counts an instruction: returns true if it ends an epoch, which end_epoch() then closes. Only called when the
+        // series is enabled.
+        bool tick()
+        {
+            return --left == 0;
+        }
+
+        // Counts n instructions at once, none of which a branch, the epochs they end seeing no more branches.
+        void skip(uint64_t n, uint64_t cycle, const branch_totals_t& t)
+        {
+            while (n >= left)
+            {
+                n -= left;
+                left = 0;
+                end_epoch(cycle, t);
+            }
+            left -= n;
+        }
+
+        // Closes the epoch that ended at cycle (0 in branch-only mode), with the totals t of the whole run so far.
+        void end_epoch(uint64_t cycle, const branch_totals_t& t)
+        {
+            block_t& b = current();
+            const uint64_t row[COLUMNS] = {epoch_insts - left, cycle - start_cycle, t.conddir_n - start_totals.conddir_n,
+                                           t.conddir_m - start_totals.conddir_m, t.jumpind_n - start_totals.jumpind_n,
+                                           t.jumpind_m - start_totals.jumpind_m, t.jumpret_n - start_totals.jumpret_n,
+                                           t.jumpret_m - start_totals.jumpret_m, t.cycles_wp - start_totals.cycles_wp};
+            for (int c = 0; c < COLUMNS; c++)
+                put(b.columns[c], b.last[c], row[c]);
+            if (++b.num_epochs == BLOCK_EPOCHS)
+                seal();
+            left = epoch_insts;
+            start_cycle = cycle;
+            start_totals = t;
+        }
+
+
+        // Closes the last, partial epoch of the trace, and hands its block to the writer.
+        void end(uint64_t cycle, const branch_totals_t& t)
+        {
+            if (!file)
+                return;
+            if (left < epoch_insts)
+                end_epoch(cycle, t);
+            if (current().num_epochs > 0)
+                seal();
+        }
+};
+
+// Process-wide, like the progress stream: opened by parseargs, fed by uarchsim_t and bp_only_sim_t.
+inline time_series_t time_series;
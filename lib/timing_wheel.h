@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "snapshot.h"
+
+// Calendar queue of events keyed by cycle.
+//
+// Events are bucketed by (cycle & mask) when scheduled, and draining a cycle only visits its own bucket. Buckets keep
+// their capacity, so steady-state operation does not allocate. Events further in the future than the number of
+// buckets simply share a bucket with nearer ones and are skipped until their cycle comes up.
+// Within a cycle, events are drained in the order they were scheduled.
+template <class T>
+class timing_wheel_t
+{
+    private:
+        struct event_t
+        {
+            uint64_t cycle;
+            T val;
+        };
+
+        std::vector<std::vector<event_t>> buckets;
+        uint64_t mask;
+        uint64_t num_events;
+
+    public:
+        timing_wheel_t(uint64_t num_buckets = 1024)
+        : num_events(0)
+        {
+            uint64_t size = 1;
+            while (size < num_buckets)
+                size <<= 1;
+            buckets.resize(size);
+            mask = size - 1;
+        }
+
+        // Drops every event, the buckets keeping their storage.
+        void clear()
+        {
+            for (std::vector<event_t>& bucket : buckets)
+                bucket.clear();
+            num_events = 0;
+        }
+
+        void schedule(uint64_t cycle, const T& val)
+        {
+            buckets[cycle & mask].push_back({cycle, val});
+            num_events++;
+        }
+
+        // Calls f(val) for every event scheduled at cycle, and removes them.
+        // Every earlier cycle is expected to have been drained already; f must not schedule new events.
+        template <class F>
+        void drain(uint64_t cycle, F&& f)
+        {
+            std::vector<event_t>& bucket = buckets[cycle & mask];
+            size_t kept = 0;
+            for (size_t i = 0; i < bucket.size(); i++)
+            {
+                if (bucket[i].cycle == cycle)
+                {
+                    f(bucket[i].val);
+                    num_events--;
+                }
+                else
+                {
+                    assert(cycle < bucket[i].cycle);
+                    bucket[kept++] = bucket[i];
+                }
+            }
+            bucket.resize(kept);
+        }
+
+        // Earliest cycle in [cycle, limit] with an event scheduled, or limit + 1 if there is none.
+        // Every cycle before cycle is expected to have been drained already.
+        uint64_t next_event(uint64_t cycle, uint64_t limit) const
+        {
+            if (num_events == 0)
+                return limit + 1;
+            if (limit - cycle >= mask)
+            {
+                // the range covers every bucket: take the earliest of all events
+                uint64_t next = limit + 1;
+                for (const std::vector<event_t>& bucket : buckets)
+                    for (const event_t& e : bucket)
+                        next = (e.cycle < next) ? e.cycle : next;
+                return next;
+            }
+            for (; cycle <= limit; cycle++)
+                for (const event_t& e : buckets[cycle & mask])
+                    if (e.cycle == cycle)
+                        return cycle;
+            return limit + 1;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.check(buckets.size(), "timing wheel size");
+            for (std::vector<event_t>& bucket : buckets)
+            {
+                uint64_t n = bucket.size();
+                s.io(n);
+                if (s.loading())
+                    bucket.resize(n);
+                for (event_t& e : bucket)
+                {
+                    s.io(e.cycle);
+                    s.io(e.val);
+                }
+            }
+            s.io(num_events);
+        }
+
+        uint64_t size() const
+        {
+            return num_events;
+        }
+
+        bool empty() const
+        {
+            return num_events == 0;
+        }
+};
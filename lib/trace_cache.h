@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "trace_reader.h"
+#include "native_trace.h"
+
+// Node-local cache of decoded traces (-Z <cache_dir>): the first process to read a .gz trace decodes it, once, into a
+// native trace (native_trace.h) in the cache directory, and every process reads the pieces from there. Native traces
+// are mmapped, so all the processes simulating the same trace share one copy of it in the page cache, and none of them
+// inflates or cracks it. With the cache directory on tmpfs (e.g. /dev/shm/cbp), the copy never touches the disk.
+//
+// An entry is named after the trace and keyed by its path, size and modification time, so a changed trace gets a new
+// entry. A lock file per entry makes the processes that want it while it is decoded wait for it instead of decoding it
+// again. Entries are never evicted: remove the directory once it is no longer needed.
+class trace_cache_t
+{
+    private:
+        static uint64_t hash_string(const std::string& s, uint64_t h = 0xcbf29ce484222325ull)
+        {
+            for (const char c : s)
+                h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+            return h;
+        }
+
+        static std::string entry_path(const char * trace_name, const char * cache_dir, const struct stat& st)
+        {
+            char real[PATH_MAX];
+            const std::string key = std::string(realpath(trace_name, real) ? real : trace_name) + "|" + std::to_string(st.st_size)
+                                    + "|" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+            std::string name(trace_name);
+            name = name.substr(name.find_last_of('/') + 1);
+            name = name.substr(0, name.find_last_of('.'));
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "-%016lx.native", hash_string(key));
+            return std::string(cache_dir) + "/" + name + suffix;
+        }
+
+    public:
+        // The native trace to read the pieces of trace_name from, decoding it into cache_dir first if needed, or an
+        // empty string if trace_name is a native trace already.
+        static std::string get(const char * trace_name, const char * cache_dir)
+        {
+            struct stat st;
+            if (native_trace_reader_t::is_native(trace_name) || stat(trace_name, &st) != 0)
+                return "";      // read as it is: a missing trace fails in TraceReader as without the cache
+            mkdir(cache_dir, 0755);
+            const std::string path = entry_path(trace_name, cache_dir, st);
+
+            // Held while decoding; whoever gets it next finds the entry done.
+            const std::string lock_path = path + ".lock";
+            const int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0)
+            {
+                fprintf(stderr, "Unable to lock the trace cache entry %s\n", lock_path.c_str());
+                exit(1);
+            }
+            if (access(path.c_str(), R_OK) != 0)
+            {
+                printf("Decoding %s into the trace cache: %s\n", trace_name, path.c_str());
+                fflush(stdout);
+                const std::string tmp = path + ".tmp";
+                {
+                    TraceReader reader(trace_name);
+                    native_trace_writer_t writer(tmp.c_str());
+                    if (!writer.good())
+                    {
+                        fprintf(stderr, "Unable to write the trace cache entry %s\n", tmp.c_str());
+                        exit(1);
+                    }
+                    db_t inst;
+                    while (reader.next(inst))
+                        writer.append(inst);
+                }
+                // only complete entries ever have the final name
+                if (rename(tmp.c_str(), path.c_str()) != 0)
+                {
+                    fprintf(stderr, "Unable to write the trace cache entry %s\n", path.c_str());
+                    exit(1);
+                }
+            }
+            flock(lock_fd, LOCK_UN);
+            close(lock_fd);
+            return path;
+        }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include "sim_common_structs.h"
+
+// Micro-op records produced by the trace readers (TraceReader, native_trace_reader_t) and consumed by the simulator.
+
+// This structure is used by CBP's simulator.
+// Adapt for your own needs.
+struct db_operand_t
+{
+    bool valid;
+    bool is_int;
+    uint64_t log_reg;
+    uint64_t value;
+
+    void print() const
+    {
+        std::cout << *this;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const db_operand_t& entry)
+    {
+        os << " (int: " << entry.is_int << ", idx: " << entry.log_reg << " val: " << std::hex << entry.value << std::dec << ") ";
+        return os;
+    }
+};
+
+// This structure is used by CBP's simulator.
+// Adapt for your own needs.
+struct db_t
+{
+    InstClass insn_class;
+    uint64_t pc;
+    bool is_taken;
+    uint64_t next_pc;
+
+    db_operand_t A;
+    db_operand_t B;
+    db_operand_t C;
+    db_operand_t D;
+
+    bool is_load;
+    bool is_store;
+    uint64_t addr;
+    uint64_t size;
+
+    bool is_last_piece;
+    // Dense id of pc, the ids numbered in the order the PCs first appear (static_ids.h), set by TraceReader::next()
+    uint32_t static_id;
+
+    friend std::ostream& operator<<(std::ostream& os, const db_t& entry)
+    {
+        os << "[PC: 0x" << std::hex << entry.pc <<std::dec << " type: "  << cInfo[static_cast<uint8_t>(entry.insn_class)];
+        if(entry.insn_class == InstClass::loadInstClass || entry.insn_class == InstClass::storeInstClass)
+        {
+            assert(entry.is_load || entry.is_store);
+            os << " ea: 0x" << std::hex << entry.addr << std::dec << " size: " << entry.size;
+        }
+        //if(insn_class == InstClass::condBranchInstClass || insn_class == InstClass::uncondDirectBranchInstClass || insn_class == InstClass::uncondIndirectBranchInstClass)
+        if(is_br(entry.insn_class))
+            os << " ( tkn:" << (entry.next_pc != entry.pc + 4) << " tar: 0x" << std::hex << entry.next_pc << ") " << std::dec;
+
+        if(entry.A.valid)
+        {
+            os << " 1st input: " << entry.A;
+        }
+
+        if(entry.B.valid)
+        {
+            os << "2nd input: " << entry.B;
+        }
+
+        if(entry.C.valid)
+        {
+            os << "3rd input: " << entry.C;
+        }
+
+        if(entry.D.valid)
+        {
+            os << " output: " << entry.D;
+        }
+
+        os << " ]" ;
+        return os;
+    }
+
+    void printInst(uint64_t fetch_cycle) const
+    {
+        std::cout << fetch_cycle<<"::uOP:: "<<*this<<std::endl;
+    }
+};
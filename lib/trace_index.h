@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Seek index of a trace, kept next to it in a sidecar file (<trace>.idx, written by convert_trace -i).
+//
+// Marks: every few trace instructions, the start of a trace instruction, as its offset in the inflated stream and the
+// numbers of trace instructions and pieces before it. Trace instruction boundaries reset all the cracking state of
+// TraceReader, so that is all it takes to resume reading at a mark.
+// Access points (gzip traces only): places where inflation can restart, as in zlib's zran example. Each is a deflate
+// block boundary in the compressed file, to the bit, with the last 32KB inflated before it, which the following
+// blocks may refer back to. Points are taken about every span bytes of inflated data; reaching a mark restarts from
+// the last point before it and inflates the rest, at most span bytes.
+// Points are only taken in the first gzip member, as traces have a single one; later members are reached by
+// inflating from the last point.
+
+struct trace_index_mark_t
+{
+    uint64_t out;           // offset in the inflated trace
+    uint64_t num_instrs;    // trace instructions before the mark
+    uint64_t num_pieces;    // pieces cracked from them
+};
+
+struct trace_index_point_t
+{
+    static constexpr uint32_t WINDOW_SIZE = 32768;
+
+    uint64_t in;            // first compressed byte holding bits of the next block
+    uint64_t out;           // offset in the inflated trace
+    uint8_t bits;           // bits of the block in byte in - 1, 0 if it starts on a byte boundary
+    std::vector<uint8_t> window;
+};
+
+class trace_index_t
+{
+    private:
+        static constexpr char MAGIC[8] = {'C', 'B', 'P', 'I', 'D', 'X', '2', '\0'};
+
+        static uint64_t file_size(const char * path)
+        {
+            struct stat st;
+            return (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+        }
+
+    public:
+        uint64_t trace_size = 0;    // size of the indexed trace file, to detect a stale index
+        uint64_t num_instrs = 0;    // trace instructions in the whole trace
+        std::vector<trace_index_mark_t> marks;
+        std::vector<trace_index_point_t> points;
+
+        static std::string path_for(const char * trace_name)
+        {
+            return std::string(trace_name) + ".idx";
+        }
+
+        // Loads the index of trace_name, if there is one and it still matches the trace.
+        bool load(const char * trace_name)
+        {
+            FILE * f = fopen(path_for(trace_name).c_str(), "rb");
+            if (!f)
+                return false;
+            char magic[sizeof(MAGIC)];
+            uint64_t num_marks = 0, num_points = 0;
+            bool ok = (fread(magic, sizeof(magic), 1, f) == 1) && !memcmp(magic, MAGIC, sizeof(magic))
+                      && (fread(&trace_size, sizeof(trace_size), 1, f) == 1) && (trace_size == file_size(trace_name))
+                      && (fread(&num_instrs, sizeof(num_instrs), 1, f) == 1)
+                      && (fread(&num_marks, sizeof(num_marks), 1, f) == 1) && (fread(&num_points, sizeof(num_points), 1, f) == 1);
+            if (ok)
+            {
+                marks.resize(num_marks);
+                ok = (fread(marks.data(), sizeof(trace_index_mark_t), num_marks, f) == num_marks);
+            }
+            points.resize(ok ? num_points : 0);
+            for (trace_index_point_t& p : points)
+            {
+                p.window.resize(trace_index_point_t::WINDOW_SIZE);
+                ok = ok && (fread(&p.in, sizeof(p.in), 1, f) == 1) && (fread(&p.out, sizeof(p.out), 1, f) == 1)
+                     && (fread(&p.bits, sizeof(p.bits), 1, f) == 1) && (fread(p.window.data(), p.window.size(), 1, f) == 1);
+            }
+            fclose(f);
+            if (!ok)
+            {
+                marks.clear();
+                points.clear();
+            }
+            return ok;
+        }
+
+        bool save(const char * trace_name)
+        {
+            FILE * f = fopen(path_for(trace_name).c_str(), "wb");
+            if (!f)
+                return false;
+            trace_size = file_size(trace_name);
+            const uint64_t num_marks = marks.size(), num_points = points.size();
+            bool ok = (fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1) && (fwrite(&trace_size, sizeof(trace_size), 1, f) == 1)
+                      && (fwrite(&num_instrs, sizeof(num_instrs), 1, f) == 1)
+                      && (fwrite(&num_marks, sizeof(num_marks), 1, f) == 1) && (fwrite(&num_points, sizeof(num_points), 1, f) == 1)
+                      && (fwrite(marks.data(), sizeof(trace_index_mark_t), num_marks, f) == num_marks);
+            for (const trace_index_point_t& p : points)
+                ok = ok && (fwrite(&p.in, sizeof(p.in), 1, f) == 1) && (fwrite(&p.out, sizeof(p.out), 1, f) == 1)
+                     && (fwrite(&p.bits, sizeof(p.bits), 1, f) == 1) && (fwrite(p.window.data(), p.window.size(), 1, f) == 1);
+            return (fclose(f) == 0) && ok;
+        }
+
+        // Inflates the whole gzip trace once to collect its access points, about every span bytes of output.
+        // Returns false if the file cannot be read or is not a valid gzip stream.
+        bool build_points(const char * trace_name, uint64_t span)
+        {
+            FILE * f = fopen(trace_name, "rb");
+            if (!f)
+                return false;
+            z_stream strm = {};
+            if (inflateInit2(&strm, 15 + 32) != Z_OK)   // gzip or zlib header
+            {
+                fclose(f);
+                return false;
+            }
+
+            std::vector<uint8_t> input(1 << 16);
+            std::vector<uint8_t> window(trace_index_point_t::WINDOW_SIZE);
+            uint64_t total_in = 0, total_out = 0, last = 0;
+            int ret = Z_OK;
+            points.clear();
+            do
+            {
+                strm.avail_in = fread(input.data(), 1, input.size(), f);
+                if (strm.avail_in == 0)
+                {
+                    ret = Z_DATA_ERROR;     // truncated
+                    break;
+                }
+                strm.next_in = input.data();
+                do
+                {
+                    if (strm.avail_out == 0)
+                    {
+                        strm.avail_out = window.size();
+                        strm.next_out = window.data();
+                    }
+                    total_in += strm.avail_in;
+                    total_out += strm.avail_out;
+                    ret = inflate(&strm, Z_BLOCK);
+                    total_in -= strm.avail_in;
+                    total_out -= strm.avail_out;
+                    if (ret != Z_OK && ret != Z_STREAM_END)
+                        break;
+
+                    // at the end of a block other than the last one
+                    if (ret == Z_OK && (strm.data_type & 128) && !(strm.data_type & 64) && (total_out - last > span))
+                    {
+                        trace_index_point_t p;
+                        p.in = total_in;
+                        p.out = total_out;
+                        p.bits = strm.data_type & 7;
+                        // the window is circular: the oldest byte is the next one to be overwritten
+                        const size_t left = strm.avail_out;
+                        p.window.resize(window.size());
+                        memcpy(p.window.data(), window.data() + window.size() - left, left);
+                        memcpy(p.window.data() + left, window.data(), window.size() - left);
+                        points.push_back(std::move(p));
+                        last = total_out;
+                    }
+                } while (ret == Z_OK && strm.avail_in != 0);
+            } while (ret == Z_OK);
+
+            inflateEnd(&strm);
+            fclose(f);
+            return ret == Z_STREAM_END;
+        }
+
+        // Last mark at or before instruction num_instrs, nullptr if there is none.
+        const trace_index_mark_t * find_mark(uint64_t num_instrs) const
+        {
+            const trace_index_mark_t * best = nullptr;
+            for (const trace_index_mark_t& m : marks)
+                if (m.num_instrs <= num_instrs)
+                    best = &m;
+            return best;
+        }
+
+        // Last access point at or before offset out of the inflated trace, nullptr to inflate from the start.
+        const trace_index_point_t * find_point(uint64_t out) const
+        {
+            const trace_index_point_t * best = nullptr;
+            for (const trace_index_point_t& p : points)
+                if (p.out <= out)
+                    best = &p;
+            return best;
+        }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "trace_reader.h"
+
+// Pipelined trace front-end: a producer thread runs the TraceReader (zlib inflation and piece cracking in
+// populateNewInstr) and hands batches of ready db_t pieces to the timing thread through a single-producer/single-consumer
+// ring of batches. Decoding thus overlaps with uarchsim_t::step on an otherwise idle core.
+//
+// The ring is lock-free: the producer only advances mProduced, the consumer only advances mConsumed, and a batch slot is
+// owned by exactly one side at any time. A batch holding fewer than BATCH_SIZE pieces marks the end of the trace.
+class trace_pipeline_t
+{
+    private:
+        static constexpr size_t BATCH_SIZE = 1024;
+        static constexpr size_t NUM_BATCHES = 16;
+
+        struct batch_t
+        {
+            db_t insts[BATCH_SIZE];
+            size_t count;
+        };
+
+        TraceReader& reader;
+        std::vector<batch_t> batches;
+
+        // Total batches published by the producer / released by the consumer, each on its own line.
+        alignas(64) std::atomic<uint64_t> mProduced;
+        alignas(64) std::atomic<uint64_t> mConsumed;
+        std::atomic<bool> mStop;
+
+        // Consumer-side state
+        batch_t * mCur;
+        size_t mCurIdx;
+
+        std::thread producer;
+
+        void produce()
+        {
+            uint64_t produced = 0;
+            while (!mStop.load(std::memory_order_relaxed))
+            {
+                // wait for a free slot
+                while (produced - mConsumed.load(std::memory_order_acquire) == NUM_BATCHES)
+                {
+                    if (mStop.load(std::memory_order_relaxed))
+                        return;
+                    std::this_thread::yield();
+                }
+
+                batch_t& batch = batches[produced % NUM_BATCHES];
+                batch.count = 0;
+                while (batch.count < BATCH_SIZE && reader.next(batch.insts[batch.count]))
+                    batch.count++;
+
+                const bool last = batch.count < BATCH_SIZE;
+                mProduced.store(++produced, std::memory_order_release);
+                if (last)
+                    return;
+            }
+        }
+
+    public:
+        trace_pipeline_t(TraceReader& reader)
+        : reader(reader), batches(NUM_BATCHES), mProduced(0), mConsumed(0), mStop(false), mCur(nullptr), mCurIdx(0)
+        {
+            // the static ids are numbered here, on the consumer's thread, which owns the dictionary
+            reader.defer_static_ids();
+            producer = std::thread(&trace_pipeline_t::produce, this);
+        }
+
+        ~trace_pipeline_t()
+        {
+            mStop.store(true, std::memory_order_relaxed);
+            producer.join();
+        }
+
+        trace_pipeline_t(const trace_pipeline_t&) = delete;
+        trace_pipeline_t& operator=(const trace_pipeline_t&) = delete;
+
+        // Points inst to the next piece, which stays valid until the following call.
+        // Returns false once the trace is done.
+        bool next(db_t *& inst)
+        {
+            if (mCur && mCurIdx == mCur->count)
+            {
+                const bool last = mCur->count < BATCH_SIZE;
+                mConsumed.store(mConsumed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                mCur = nullptr;
+                if (last)
+                    return false;
+            }
+
+            if (!mCur)
+            {
+                const uint64_t consumed = mConsumed.load(std::memory_order_relaxed);
+                while (mProduced.load(std::memory_order_acquire) == consumed)
+                    std::this_thread::yield();
+                mCur = &batches[consumed % NUM_BATCHES];
+                mCurIdx = 0;
+                if (mCur->count == 0)
+                    return false;
+            }
+
+            inst = &mCur->insts[mCurIdx++];
+            reader.assign_static_id(*inst);
+            return true;
+        }
+
+        // Points insts to the next pieces, up to max of them, consecutive in a batch and valid until the following call.
+        // Returns their number, 0 once the trace is done.
+        size_t next(db_t *& insts, size_t max)
+        {
+            if (!next(insts))
+                return 0;
+            size_t n = 1;
+            for (; (n < max) && (mCurIdx < mCur->count); n++)
+                reader.assign_static_id(mCur->insts[mCurIdx++]);
+            return n;
+        }
+};
@@ -1,3 +1,4 @@
+#pragma once
 // CBP Trace Reader
 // Author: Arthur Perais (arthur.perais@gmail.com) for CVP
 //         Saransh Jain/Rami Sheikh updated for CBP
@@ -28,15 +29,18 @@
 
    For more information, please refer to <http://unlicense.org>
 
-   This project relies on https://www.cs.unc.edu/Research/compgeom/gzstream/ (LGPL) to stream from compressed traces.
-   For ease of use, gzstream.h and gzstream.C are provided with minor modifications (include paths) with the reader.
+   Compressed traces are inflated in large blocks through zlib by gz_block_reader_t (gz_block_reader.h).
+   With a seek index next to the trace (trace_index.h), seek() jumps close to a given instruction.
+   Block traces (block_trace.h) are inflated by several threads, and carry their own seek index.
+   Static traces (static_trace.h) are gzip streams of records, decoded from a table of cracked static instructions.
    */
 
-// Compilation : Don't forget to add gzstream.C in the source list and to link with zlib (-lz).
+// Compilation : Don't forget to link with zlib (-lz).
 //
 // Usage : TraceReader reader("./my_trace.tar.gz")
-//         while(reader.readInstr())
-//           reader.mInstr.printInstr();
+//         db_t inst;
+//         while(reader.next(inst))
+//           inst.printInst(0);
 //            ...
 // Note that this is an exemple file (that was used for CVP).
 // Given the trace format below, you can write your own trace reader that
@@ -69,92 +73,64 @@
 #include <fstream>
 #include <algorithm>
 #include <iostream>
+#include <string>
 #include <vector>
+#include <iterator>
 #include <cassert>
 #include "sim_common_structs.h"
-#include "./gzstream.h"
-
-// This structure is used by CBP's simulator.
-// Adapt for your own needs.
-struct db_operand_t
+#include "trace_db.h"
+#include "native_trace.h"
+#include "static_trace.h"
+#include "./gz_block_reader.h"
+#include "trace_index.h"
+#include "static_ids.h"
+#include "phase_timer.h"
+#include "invariant.h"
+
+// Fixed-capacity vector with inline storage.
+// The trace format encodes register counts on a byte, so trace instructions never need more than a few hundred
+// entries and can be decoded without touching the heap.
+template <class T, size_t N>
+struct inline_vec_t
 {
-    bool valid;
-    bool is_int;
-    uint64_t log_reg;
-    uint64_t value;
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
 
-    void print() const
-    {
-        std::cout << *this;
-    }
+    T mData[N];
+    size_t mSize = 0;
 
-    friend std::ostream& operator<<(std::ostream& os, const db_operand_t& entry)
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    void clear() { mSize = 0; }
+
+    void push_back(const T& val)
     {
-        os << " (int: " << entry.is_int << ", idx: " << entry.log_reg << " val: " << std::hex << entry.value << std::dec << ") ";
-        return os;
+        CBP_CHECK(mSize < N);
+        mData[mSize++] = val;
     }
-};
 
-// This structure is used by CBP's simulator.
-// Adapt for your own needs.
-struct db_t
-{
-    InstClass insn_class;
-    uint64_t pc;
-    bool is_taken;
-    uint64_t next_pc;
-
-    db_operand_t A;
-    db_operand_t B;
-    db_operand_t C;
-    db_operand_t D;
+    T& operator[](size_t i) { return mData[i]; }
+    const T& operator[](size_t i) const { return mData[i]; }
+    T& at(size_t i) { CBP_CHECK(i < mSize); return mData[i]; }
+    const T& at(size_t i) const { CBP_CHECK(i < mSize); return mData[i]; }
 
-    bool is_load;
-    bool is_store;
-    uint64_t addr;
-    uint64_t size;
+    iterator begin() { return mData; }
+    iterator end() { return mData + mSize; }
+    const_iterator begin() const { return mData; }
+    const_iterator end() const { return mData + mSize; }
+    std::reverse_iterator<const_iterator> rbegin() const { return std::reverse_iterator<const_iterator>(end()); }
 
-    bool is_last_piece;
-
-    friend std::ostream& operator<<(std::ostream& os, const db_t& entry)
+    iterator erase(iterator pos)
     {
-        os << "[PC: 0x" << std::hex << entry.pc <<std::dec << " type: "  << cInfo[static_cast<uint8_t>(entry.insn_class)];
-        if(entry.insn_class == InstClass::loadInstClass || entry.insn_class == InstClass::storeInstClass)
-        {
-            assert(entry.is_load || entry.is_store);
-            os << " ea: 0x" << std::hex << entry.addr << std::dec << " size: " << entry.size;
-        }
-        //if(insn_class == InstClass::condBranchInstClass || insn_class == InstClass::uncondDirectBranchInstClass || insn_class == InstClass::uncondIndirectBranchInstClass)
-        if(is_br(entry.insn_class))
-            os << " ( tkn:" << (entry.next_pc != entry.pc + 4) << " tar: 0x" << std::hex << entry.next_pc << ") " << std::dec;
-
-        if(entry.A.valid)
-        {
-            os << " 1st input: " << entry.A;
-        }
-
-        if(entry.B.valid)
-        {
-            os << "2nd input: " << entry.B;
-        }
-
-        if(entry.C.valid)
-        {
-            os << "3rd input: " << entry.C;
-        }
-
-        if(entry.D.valid)
-        {
-            os << " output: " << entry.D;
-        }
-
-        os << " ]" ;
-        return os;
+        return erase(pos, pos + 1);
     }
 
-    void printInst(uint64_t fetch_cycle) const
+    iterator erase(iterator first, iterator last)
     {
-        std::cout << fetch_cycle<<"::uOP:: "<<*this<<std::endl;
+        iterator new_end = std::move(last, end(), first);
+        mSize = new_end - mData;
+        return first;
     }
 };
 
@@ -166,6 +142,28 @@ enum Offset
     ZeroOffset = 65
 };
 
+// Set of register ids as bits; the ids of the trace format are 0-65.
+typedef unsigned __int128 reg_mask_t;
+
+inline reg_mask_t reg_bit(uint8_t reg)
+{
+    return (reg < 128) ? ((reg_mask_t)1 << reg) : 0;
+}
+
+inline int reg_mask_count(reg_mask_t mask)
+{
+    return __builtin_popcountll((uint64_t)mask) + __builtin_popcountll((uint64_t)(mask >> 64));
+}
+
+inline void print_reg_mask(reg_mask_t mask)
+{
+    for(unsigned reg = 0; reg < 128; reg++)
+    {
+        if((mask >> reg) & 1)
+            std::cout<<", "<<reg;
+    }
+}
+
 inline bool reg_is_int(uint8_t reg_offset)
 {
     return ( (reg_offset < Offset::vecOffset) || (reg_offset == Offset::ccOffset) || (reg_offset == Offset::ZeroOffset) );
@@ -192,11 +190,15 @@ struct TraceReader
         uint8_t mBaseUpd;
         uint8_t mHasRegOffset;
         uint8_t mNumInRegs;
-        std::vector<uint8_t> mInRegs;
+        inline_vec_t<uint8_t, UINT8_MAX + 1> mInRegs;
         uint8_t mNumOutRegs;
-        std::vector<uint8_t> mOutRegs;
+        inline_vec_t<uint8_t, UINT8_MAX + 1> mOutRegs;
+        // The same register sets as bits (registers 0-127), for the base-update search
+        reg_mask_t mInRegMask;
+        reg_mask_t mOutRegMask;
         std::optional<uint8_t> mBaseUpdReg;
-        std::vector<uint64_t> mOutRegsValues;
+        // SIMD outputs carry two 64-bit values
+        inline_vec_t<uint64_t, 2 * (UINT8_MAX + 1)> mOutRegsValues;
 
         Instr()
         {
@@ -215,6 +217,7 @@ struct TraceReader
             mNumInRegs = mNumOutRegs = 0;
             mInRegs.clear();
             mOutRegs.clear();
+            mInRegMask = mOutRegMask = 0;
             mBaseUpdReg.reset();
             mOutRegsValues.clear();
         }
@@ -267,46 +270,23 @@ struct TraceReader
             {
                 return false;
             }
-            auto src_reg_ids = mInRegs;
-            std::sort(src_reg_ids.begin(), src_reg_ids.end());
-            auto src_it = std::lower_bound(src_reg_ids.begin(), src_reg_ids.end(),  Offset::vecOffset);
-            if(src_it != src_reg_ids.end())
-            {
-                src_reg_ids.erase(src_it, src_reg_ids.end());
-            }
+            // The base register is the one int GPR both read and written
+            const reg_mask_t gprs = ((reg_mask_t)1 << Offset::vecOffset) - 1;
+            const reg_mask_t overlap = mInRegMask & mOutRegMask & gprs;
+            const int overlap_size = reg_mask_count(overlap);
 
-            auto dst_reg_ids = mOutRegs;
-            std::sort(dst_reg_ids.begin(), dst_reg_ids.end());
-            auto dst_it = std::lower_bound(dst_reg_ids.begin(), dst_reg_ids.end(),  Offset::vecOffset);
-            if(dst_it != dst_reg_ids.end())
-            {
-                dst_reg_ids.erase(dst_it, dst_reg_ids.end());
-            }
-
-            std::vector<uint8_t> overlap_vec;
-            std::set_intersection(src_reg_ids.begin(), src_reg_ids.end(), dst_reg_ids.begin(), dst_reg_ids.end(), std::back_inserter(overlap_vec));
-
-            if(overlap_vec.size() > 1)
+            if(overlap_size > 1)
             {
                 std::cout<<"Load with >1 base upd! src_regs: [";
-                for(auto i:src_reg_ids)
-                {
-                    std::cout<<", "<<(uint64_t)i;
-                }
+                print_reg_mask(mInRegMask & gprs);
                 std::cout<<"], dst_regs: [";
-                for(auto i:dst_reg_ids)
-                {
-                    std::cout<<", "<<(uint64_t)i;
-                }
+                print_reg_mask(mOutRegMask & gprs);
                 std::cout<<"], overlap_vec: [";
-                for(auto i:overlap_vec)
-                {
-                    std::cout<<", "<<(uint64_t)i;
-                }
+                print_reg_mask(overlap);
                 std::cout<<"]"<<std::endl;
             }
-            assert(overlap_vec.size() <= 1);
-            const bool base_update = overlap_vec.size() == 1;
+            assert(overlap_size <= 1);
+            const bool base_update = overlap_size == 1;
             if(mBaseUpd == 1)
             {
                 assert(base_update);
@@ -314,7 +294,7 @@ struct TraceReader
             const bool true_base_update = (mBaseUpd == 1) && base_update;
             if(true_base_update)
             {
-                mBaseUpdReg.emplace(overlap_vec.at(0));
+                mBaseUpdReg.emplace(__builtin_ctzll((uint64_t)overlap));
             }
             return true_base_update;
         }
@@ -335,7 +315,8 @@ struct TraceReader
                 os << elt << " ";
             }
             os << " } OutRegs : { ";
-            for(unsigned i = 0, j = 0; i < instr.mOutRegs.size(); i++)
+            // values skipped when reading (mValues) are not shown
+            for(unsigned i = 0, j = 0; i < instr.mOutRegs.size() && !instr.mOutRegsValues.empty(); i++)
             {
                 if(!reg_is_int(instr.mOutRegs[i])) //mOutRegs[i] >= Offset::vecOffset && mOutRegs[i] != Offset::ccOffset
                 {
@@ -359,7 +340,23 @@ struct TraceReader
         }
     };
 
-    gz::igzstream * dpressed_input;
+    std::string mTraceName;
+    gz_block_reader_t * dpressed_input;
+
+    // Set instead of dpressed_input when reading a pre-cracked native trace (native_trace.h)
+    native_trace_reader_t * mNative;
+    bool mNativeNewInstr;
+
+    // Set along with dpressed_input when it carries a static trace (static_trace.h)
+    static_trace_decoder_t * mStatic;
+
+    // Whether to decode the output register values; without them, D.value is 0 and the value payloads of the trace
+    // are skipped over instead of copied.
+    bool mValues;
+
+    // PC -> dense static id of the pieces read, and whether the consumer numbers them instead of next()
+    static_ids_t mStaticIds;
+    bool mDeferStaticIds;
 
     // Buffer to hold trace instruction information
     Instr mInstr;
@@ -394,10 +391,25 @@ struct TraceReader
     uint8_t start_fp_reg;
 
     // Note that there is no check for trace existence, so modify to suit your needs.
-    TraceReader(const char * trace_name)
+    // With decoded_name, the pieces are read from that native trace of trace_name (trace_cache.h), while the sidecar
+    // files are still those of trace_name.
+    TraceReader(const char * trace_name, const char * decoded_name = nullptr, bool values = true)
+    : mTraceName(trace_name), mValues(values), mDeferStaticIds(false)
     {
-        dpressed_input = new gz::igzstream();
-        dpressed_input->open(trace_name, std::ios_base::in | std::ios_base::binary);
+        dpressed_input = nullptr;
+        mNative = nullptr;
+        mNativeNewInstr = true;
+        mStatic = nullptr;
+        if(decoded_name)
+            mNative = new native_trace_reader_t(decoded_name);
+        else if(native_trace_reader_t::is_native(trace_name))
+            mNative = new native_trace_reader_t(trace_name);
+        else
+        {
+            dpressed_input = new gz_block_reader_t(trace_name);
+            if(static_trace_decoder_t::is_static_trace(*dpressed_input))
+                mStatic = new static_trace_decoder_t(*dpressed_input, trace_name, values);
+        }
 
         mTotalPieces = 0;
         mMemPieces = 0;
@@ -413,45 +425,182 @@ struct TraceReader
     {
         if(dpressed_input)
             delete dpressed_input;
+        if(mNative)
+            delete mNative;
+        if(mStatic)
+            delete mStatic;
 
         std::cout  << " Read " << nInstr << " instrs " << std::endl;
     }
 
     // This is the main API function
     // There is no specific reason to call the other functions from without this file.
-    // Idiom is : while(instr = get_inst())
-    //              ... process instr
-    db_t  *get_inst()
+    // Fills the caller-owned inst with the next piece and returns false once the trace is done.
+    // Idiom is : db_t inst;
+    //            while(next(inst))
+    //              ... process inst
+    bool next(db_t& inst)
+    {
+        if(!nextPiece(inst))
+            return false;
+        if(!mDeferStaticIds)
+            assign_static_id(inst);
+        return true;
+    }
+
+    // Dense static-instruction ids (static_ids.h), in the order the PCs first appear in the pieces read. next() sets
+    // them, unless a consumer on another thread defers them to itself (trace_pipeline_t), as the dictionary is not
+    // shared between threads.
+    void defer_static_ids()
+    {
+        mDeferStaticIds = true;
+    }
+
+    void assign_static_id(db_t& inst)
+    {
+        inst.static_id = mStaticIds.id(inst.pc);
+    }
+
+    static_ids_t& static_ids()
+    {
+        return mStaticIds;
+    }
+
+    // next() without the static id.
+    bool nextPiece(db_t& inst)
     {
+        PHASE_SCOPE(PHASE_DECODE);
+        if(mNative || mStatic)
+            return nextNative(inst);
+
         // If we are creating several pieces from a single trace instructions and some are left to create,
         // mProcessedPieces != mTotalPieces
         if(mProcessedPieces != mTotalPieces)
         {
             //std::cout<<"Continuing with the same MacroOP"<<std::endl;
-            return populateNewInstr();
+            populateNewInstr(inst);
+            return true;
         }
         // If there is a single piece to create
         else if(readInstr())
         {
             //std::cout<<"Read New MacroOp"<<std::endl;
-            return populateNewInstr();
+            populateNewInstr(inst);
+            return true;
         }
         else
         {
             // If the trace is done
             //std::cout<<"End of sim"<<std::endl;
-            return nullptr;
+            return false;
+        }
+
+    }
+
+    // Native and static traces are already cracked, pieces are handed out as stored.
+    // Trace instructions are still counted (and progress reported) the way readInstr() does.
+    bool nextNative(db_t& inst)
+    {
+        if(mNative ? !mNative->next(inst) : !mStatic->next(*dpressed_input, inst))
+        {
+            std::cout<<"EOF"<<std::endl;
+            return false;
+        }
+
+        if(mNativeNewInstr)
+        {
+            nInstr++;
+            if(nInstr % 5000000 == 0)
+                std::cout << nInstr << " instrs " << std::endl;
+        }
+        mNativeNewInstr = inst.is_last_piece;
+        return true;
+    }
+
+    // Offset in the inflated trace of the next trace instruction, when called between two trace instructions
+    // (i.e. after a last piece). Meaningless for native traces.
+    uint64_t position() const
+    {
+        return dpressed_input ? dpressed_input->tell() : 0;
+    }
+
+    // Trace instructions read, or skipped by seek(), when called between two trace instructions.
+    uint64_t num_instrs() const
+    {
+        return nInstr;
+    }
+
+    // Whether the trace is stored as cracked pieces (native or static trace), rather than in the CBP format, whose
+    // inflated bytes between two positions are a trace of their own.
+    bool is_cracked() const
+    {
+        return mNative || mStatic;
+    }
+
+    // Fast-forwards, through the trace index (trace_index.h), to the last indexed trace instruction at or before
+    // trace instruction num_instrs, and returns the number of pieces skipped.
+    // Without a valid index, or if no mark precedes num_instrs, nothing is skipped and 0 is returned.
+    uint64_t seek(uint64_t num_instrs)
+    {
+        // a block trace (block_trace.h) is its own index
+        trace_index_mark_t block_mark;
+        const trace_index_mark_t * mark = &block_mark;
+        trace_index_t index;
+        if (!dpressed_input || !dpressed_input->seek_block(num_instrs, block_mark))
+        {
+            if (!index.load(mTraceName.c_str()) || !(mark = index.find_mark(num_instrs)))
+                return 0;
+
+            if (mNative)
+            {
+                mNative->seek(mark->num_pieces);
+                mNativeNewInstr = true;
+            }
+            else if (!dpressed_input->seek(mTraceName.c_str(), index.find_point(mark->out), mark->out))
+            {
+                std::cerr << "Unable to seek in " << mTraceName << " with its index" << std::endl;
+                exit(1);
+            }
         }
+        if (mStatic)
+        {
+            mStatic->reset();
+            mNativeNewInstr = true;
+        }
+        mTotalPieces = 0;
+        mMemPieces = 0;
+        mCrackRegIdx = 0;
+        mCrackValIdx = 0;
+        mProcessedPieces = 0;
+        mSizeFactor = 0;
+        start_fp_reg = 0;
+        nInstr = mark->num_instrs;
+        return mark->num_pieces;
+    }
 
+    // Allocating variant of next(), the caller owns (and deletes) the returned piece.
+    // Idiom is : while(instr = get_inst())
+    //              ... process instr
+    db_t  *get_inst()
+    {
+        db_t * inst = new db_t();
+        if(!next(*inst))
+        {
+            delete inst;
+            return nullptr;
+        }
+        return inst;
     }
 
-    // Creates a new object and populate it with trace information.
+    // Populates inst with trace information.
     // Subsequent calls to populateNewInstr() will take care of creating multiple pieces for a trace instruction
     // that has several outputs or 128-bit output.
-    // Number of calls is decided by mProcessedPieces from get_inst().
-    db_t *populateNewInstr()
+    // Number of calls is decided by mProcessedPieces from next().
+    void populateNewInstr(db_t& inst_ref)
     {
-        db_t * inst = new db_t();
+        // start from a clean piece, as a freshly allocated one would be
+        inst_ref = db_t();
+        db_t * inst = &inst_ref;
 
         //std::cout<<"Processing piece:"<<(uint64_t)(1+mProcessedPieces)<<" from:"<<(uint64_t)mTotalPieces<<std::endl;
         assert(mProcessedPieces < mTotalPieces);
@@ -613,7 +762,7 @@ struct TraceReader
             inst->D.is_int = reg_is_int(base_upd_reg);
             assert(inst->D.is_int);
             inst->D.log_reg = base_upd_reg;
-            inst->D.value = *mInstr.mOutRegsValues.rbegin();
+            inst->D.value = mValues ? *mInstr.mOutRegsValues.rbegin() : 0;
         }
         else if(!is_store(mInstr.mType) && mInstr.mNumOutRegs >= 1)
         {
@@ -621,7 +770,7 @@ struct TraceReader
             // Flag register is considered to be INT
             inst->D.is_int = reg_is_int(mInstr.mOutRegs.at(mCrackRegIdx));
             inst->D.log_reg = mInstr.mOutRegs[mCrackRegIdx];
-            inst->D.value = mInstr.mOutRegsValues.at(mCrackValIdx);
+            inst->D.value = mValues ? mInstr.mOutRegsValues.at(mCrackValIdx) : 0;
             // if SIMD register, we processed one more 64-bit lane.
             if(!inst->D.is_int)
                 start_fp_reg++;
@@ -661,8 +810,6 @@ struct TraceReader
             mCrackValIdx++;
             mCrackRegIdx++;
         }
-
-        return inst;
     }
 
     // Read bytes from the trace and populate a buffer object.
@@ -751,6 +898,7 @@ struct TraceReader
             uint8_t inReg;
             dpressed_input->read((char*) &inReg, sizeof(inReg));
             mInstr.mInRegs.push_back(inReg);
+            mInstr.mInRegMask |= reg_bit(inReg);
         }
 
         dpressed_input->read((char*) &mInstr.mNumOutRegs, sizeof(mInstr.mNumOutRegs));
@@ -761,6 +909,7 @@ struct TraceReader
             uint8_t outReg;
             dpressed_input->read((char*) &outReg, sizeof(outReg));
             mInstr.mOutRegs.push_back(outReg);
+            mInstr.mOutRegMask |= reg_bit(outReg);
         }
 
         // assumes 1 piece per logical register output
@@ -771,7 +920,29 @@ struct TraceReader
         uint8_t base_upd_pos_in_out_regs = UINT8_MAX;
         uint64_t base_upd_val = UINT64_MAX;
 
-        for(auto i = 0; i != mInstr.mNumOutRegs; i++)
+        // Without values, the payloads are skipped over: only the high half of a SIMD output is looked at, as it
+        // decides the pieces.
+        for(auto i = 0; i != mInstr.mNumOutRegs && !mValues; i++)
+        {
+            const bool matching_base_upd = base_update_present && mInstr.mBaseUpdReg.value() == mInstr.mOutRegs[i];
+            dpressed_input->skip(sizeof(uint64_t));
+            if(matching_base_upd)
+            {
+                assert(base_upd_pos_in_out_regs == UINT8_MAX);
+                base_upd_pos_in_out_regs = i;
+            }
+            else if(!reg_is_int(mInstr.mOutRegs[i]))
+            {
+                uint64_t hi;
+                dpressed_input->read((char*) &hi, sizeof(hi));
+                if(hi != 0)
+                {
+                    mTotalPieces++;
+                }
+            }
+        }
+
+        for(auto i = 0; i != mInstr.mNumOutRegs && mValues; i++)
         {
             uint64_t val;
 
@@ -814,7 +985,8 @@ struct TraceReader
                 mInstr.mOutRegs.erase(mInstr.mOutRegs.begin() + base_upd_pos_in_out_regs);
                 mInstr.mOutRegs.push_back(mInstr.mBaseUpdReg.value());
             }
-            mInstr.mOutRegsValues.push_back(base_upd_val);
+            if(mValues)
+                mInstr.mOutRegsValues.push_back(base_upd_val);
         }
         else
         {
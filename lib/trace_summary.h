@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <sys/stat.h>
+#include "trace_reader.h"
+
+// Per-trace facts, from a decode-only scan of the trace, kept next to it in a sidecar file (<trace>.sum, written by
+// convert_trace -s): instruction and uop counts, mix of trace instructions by InstClass, static branch counts, and the
+// code and data footprints in 64B lines. Used to size and schedule runs without simulating them: the batch driver
+// orders the traces by uops (-B) and sampled simulation (-U) reports the coverage of its units.
+//
+// The scan reads trace instructions with TraceReader::readInstr, without cracking them into pieces: readInstr already
+// knows how many pieces each instruction cracks into. Native and static traces are already cracked and are scanned by piece.
+struct trace_summary_t
+{
+    static constexpr uint64_t NUM_CLASSES = 12;     // InstClass values
+    static constexpr uint64_t LINE_BYTES = 64;
+
+    uint64_t trace_size = 0;        // size of the scanned trace file, to detect a stale summary
+    uint64_t num_instrs = 0;        // trace instructions
+    uint64_t num_uops = 0;          // pieces cracked from them, i.e. the micro-ops the simulator steps
+    uint64_t class_instrs[NUM_CLASSES] = {};
+    uint64_t static_branches = 0;       // distinct PCs of the branches of all types
+    uint64_t static_cond_branches = 0;  // distinct PCs of the conditional branches
+    uint64_t code_lines = 0;        // distinct lines of the instruction PCs
+    uint64_t data_lines = 0;        // distinct lines of the load and store effective addresses
+
+    static std::string path_for(const char * trace_name)
+    {
+        return std::string(trace_name) + ".sum";
+    }
+
+    static uint64_t file_size(const char * path)
+    {
+        struct stat st;
+        return (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+    }
+
+    // Loads the summary of trace_name, if there is one and it still matches the trace.
+    bool load(const char * trace_name)
+    {
+        FILE * f = fopen(path_for(trace_name).c_str(), "rb");
+        if (!f)
+            return false;
+        char magic[sizeof(MAGIC)];
+        trace_summary_t s;
+        const bool ok = (fread(magic, sizeof(magic), 1, f) == 1) && !memcmp(magic, MAGIC, sizeof(magic))
+                        && (fread(&s, sizeof(s), 1, f) == 1) && (s.trace_size == file_size(trace_name));
+        fclose(f);
+        if (ok)
+            *this = s;
+        return ok;
+    }
+
+    bool save(const char * trace_name) const
+    {
+        FILE * f = fopen(path_for(trace_name).c_str(), "wb");
+        if (!f)
+            return false;
+        const bool ok = (fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1) && (fwrite(this, sizeof(*this), 1, f) == 1);
+        return (fclose(f) == 0) && ok;
+    }
+
+    // Scans the whole trace.
+    void scan(const char * trace_name)
+    {
+        *this = trace_summary_t();
+        trace_size = file_size(trace_name);
+        std::unordered_set<uint64_t> branch_pcs, cond_branch_pcs, code, data;
+        auto count_instr = [&](InstClass type, uint64_t pc) {
+            class_instrs[(uint8_t)type]++;
+            code.insert(pc / LINE_BYTES);
+            if (is_br(type))
+                branch_pcs.insert(pc);
+            if (is_cond_br(type))
+                cond_branch_pcs.insert(pc);
+        };
+        auto count_data = [&](uint64_t ea, uint64_t size) {
+            for (uint64_t line = ea / LINE_BYTES; line <= (ea + (size ? size : 1) - 1) / LINE_BYTES; line++)
+                data.insert(line);
+        };
+
+        TraceReader reader(trace_name);
+        if (reader.mNative || reader.mStatic)
+        {
+            db_t inst;
+            bool first_piece = true;
+            while (reader.next(inst))
+            {
+                num_uops++;
+                // the first piece has the class of the instruction, the others may be cracked into ALU pieces
+                if (first_piece)
+                    count_instr(inst.insn_class, inst.pc);
+                if (inst.is_load || inst.is_store)
+                    count_data(inst.addr, inst.size);
+                num_instrs += inst.is_last_piece;
+                first_piece = inst.is_last_piece;
+            }
+        }
+        else
+            while (reader.readInstr())
+            {
+                num_instrs++;
+                num_uops += reader.mTotalPieces;
+                count_instr(reader.mInstr.mType, reader.mInstr.mPc);
+                if (is_mem(reader.mInstr.mType))
+                    count_data(reader.mInstr.mEffAddr, reader.mInstr.mMemSize);
+            }
+        static_branches = branch_pcs.size();
+        static_cond_branches = cond_branch_pcs.size();
+        code_lines = code.size();
+        data_lines = data.size();
+    }
+
+    // The summary of trace_name from its sidecar, or from a scan saved as the sidecar if there is none.
+    static trace_summary_t get(const char * trace_name)
+    {
+        trace_summary_t s;
+        if (!s.load(trace_name))
+        {
+            s.scan(trace_name);
+            if (!s.save(trace_name))
+                fprintf(stderr, "Unable to write the trace summary %s\n", path_for(trace_name).c_str());
+        }
+        return s;
+    }
+
+    void print(const char * trace_name) const
+    {
+        printf("Trace            = %s\n", trace_name);
+        printf("Instructions     = %lu\n", num_instrs);
+        printf("Uops             = %lu (%.3f per instruction)\n", num_uops, num_instrs ? (double)num_uops/(double)num_instrs : 0.0);
+        for (uint64_t c = 0; c < NUM_CLASSES; c++)
+            if (class_instrs[c])
+                printf("  %-14s %14lu (%6.2f%%)\n", cInfo[c], class_instrs[c], 100.0*(double)class_instrs[c]/(double)num_instrs);
+        printf("Static branches  = %lu (%lu conditional)\n", static_branches, static_cond_branches);
+        printf("Code footprint   = %lu lines (%.1f KB)\n", code_lines, (double)(code_lines * LINE_BYTES)/1024);
+        printf("Data footprint   = %lu lines (%.1f MB)\n", data_lines, (double)(data_lines * LINE_BYTES)/(1024 * 1024));
+    }
+
+    private:
+        static constexpr char MAGIC[8] = {'C', 'B', 'P', 'S', 'U', 'M', '1', '\0'};
+};
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "uarch_fanout.h"
+#include "fanout.h"
+#include "value_predictor_interface.h"
+#include "fifo.h"
+#include "cache.h"
+#include "bp.h"
+#include "cbp.h"
+#include "resource_schedule.h"
+#include "uarchsim.h"
+#include "batch.h"
+#include "plugin.h"
+#include "broadcast_ring.h"
+
+namespace {
+
+static constexpr uint64_t UARCH_FANOUT_BATCH = 4096;    // pieces per batch
+static constexpr uint64_t UARCH_FANOUT_BATCHES = 16;    // batches in the ring
+static constexpr uint64_t UARCH_FANOUT_MAX = 64;        // instances
+
+// Ring shared by the decoding parent and the workers, worker k being consumer k. The last batch ends the trace.
+using uarch_ring_t = broadcast_ring_t<db_t, UARCH_FANOUT_BATCH, UARCH_FANOUT_BATCHES, UARCH_FANOUT_MAX>;
+
+struct uarch_worker_t {
+    pid_t pid = -1;
+    int result_fd = -1;         // worker -> parent: batch_result_t
+    bool exited = false;        // reaped while the trace was read, having failed
+    bool pass = false;
+    batch_result_t result;
+};
+
+bool write_all(int fd, const void * buf, size_t size)
+{
+    const char * p = static_cast<const char *>(buf);
+    while (size)
+    {
+        const ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void * buf, size_t size)
+{
+    char * p = static_cast<char *>(buf);
+    while (size)
+    {
+        const ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Runs in the forked worker: never returns.
+void run_worker(uint64_t k, const sim_config_t& sim_config, predictor_plugin_t * plugin, const char * log_dir, uarch_ring_t * ring, int result_fd)
+{
+    const std::string log_path = log_dir ? (std::string(log_dir) + "/uarch" + std::to_string(k) + ".log") : std::string("/dev/null");
+    const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0)
+    {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+
+    // the parent feeds the batches: without it the worker would wait forever
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    if (plugin)
+        plugin->activate();
+    predictor_begin();
+    uarchsim_t sim(sim_config);
+    for (bool last = false; !last;)
+    {
+        uint64_t count;
+        const db_t * pieces = ring->acquire(k, count, last);
+        // step() only reads the piece, which the other workers read too
+        for (uint64_t i = 0; i < count; i++)
+            sim.step(const_cast<db_t *>(&pieces[i]));
+        ring->release(k);
+    }
+
+    if constexpr (VALUE_PREDICTION)
+        endPredictor();
+    predictor_end();
+    sim.output();
+    fflush(stdout);
+    std::cout.flush();
+
+    const uint64_t total_instr = sim.get_epoch_insts();
+    const batch_result_t result = {sim.get_conddir_stats(total_instr), sim.get_conddir_stats(total_instr/2)};
+    const bool written = write_all(result_fd, &result, sizeof(result));
+    close(result_fd);
+    _exit(written ? 0 : 1);
+}
+
+// Reaps the workers that died while the trace is read, so that the ring no longer waits for them.
+void reap_workers(uarch_ring_t * ring, std::vector<uarch_worker_t>& workers)
+{
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        uarch_worker_t& w = workers[k];
+        int status;
+        if (!w.exited && (waitpid(w.pid, &status, WNOHANG) == w.pid))
+        {
+            w.exited = true;
+            ring->detach(k);
+        }
+    }
+}
+
+} // namespace
+
+int run_uarch_fanout(const std::function<bool(db_t&)>& next_inst, const std::vector<sim_config_t>& configs, const std::vector<std::string>& labels,
+                     const char * log_dir, const std::vector<predictor_plugin_t *>& plugins)
+{
+    if (configs.size() > UARCH_FANOUT_MAX)
+    {
+        fprintf(stderr, "Microarchitecture fan-out (-u): at most %lu configurations, not %lu\n", UARCH_FANOUT_MAX, configs.size());
+        return configs.size();
+    }
+    uarch_ring_t * ring = uarch_ring_t::create(configs.size(), fanout_max_lag());
+    if (!ring)
+    {
+        perror("mmap");
+        return configs.size();
+    }
+
+    if (log_dir)
+        mkdir(log_dir, 0755);
+    fflush(stdout);
+    std::cout.flush();
+
+    std::vector<uarch_worker_t> workers(configs.size());
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        int result_fds[2];
+        if (pipe(result_fds) != 0)
+        {
+            perror("pipe");
+            return workers.size();
+        }
+
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(result_fds[0]);
+            run_worker(k, configs[k], plugins.empty() ? nullptr : plugins[k], log_dir, ring, result_fds[1]);
+        }
+        close(result_fds[1]);
+        if (pid < 0)
+        {
+            perror("fork");
+            return workers.size();
+        }
+        workers[k].pid = pid;
+        workers[k].result_fd = result_fds[0];
+    }
+
+    // The trace is decoded once here, straight into the ring, which the workers read in place.
+    uint64_t num_pieces = 0;
+    // A last piece that fills its batch exactly is followed by an empty batch.
+    for (uint64_t count = UARCH_FANOUT_BATCH; count == UARCH_FANOUT_BATCH;)
+    {
+        db_t * pieces = ring->next_batch([&]() { reap_workers(ring, workers); });
+        count = 0;
+        while (count < UARCH_FANOUT_BATCH && next_inst(pieces[count]))
+            count++;
+        num_pieces += count;
+        ring->publish(count, count < UARCH_FANOUT_BATCH);
+    }
+
+    int num_failed = 0;
+    for (uarch_worker_t& w : workers)
+    {
+        w.pass = read_all(w.result_fd, &w.result, sizeof(w.result));
+        close(w.result_fd);
+        int status;
+        w.pass = !w.exited && (waitpid(w.pid, &status, 0) == w.pid) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && w.pass;
+        num_failed += !w.pass;
+    }
+    uarch_ring_t::destroy(ring);
+
+    printf("UARCH FAN-OUT MODE: %lu timing simulator instances, %lu pieces decoded once\n", workers.size(), num_pieces);
+    printf("%7s %12s %12s %8s %12s %12s %10s %10s  %s\n", "Config", "Instr", "Cycles", "IPC", "NumBr", "MispBr", "MPKI", "CycWpPKI", "Options");
+    for (uint64_t k = 0; k < workers.size(); k++)
+    {
+        const uarch_worker_t& w = workers[k];
+        if (!w.pass)
+        {
+            printf("%7lu %12s %12s %8s %12s %12s %10s %10s  %s\n", k, "Fail", "", "", "", "", "", "", labels[k].c_str());
+            continue;
+        }
+        printf("%7lu %12lu %12lu %8.4f %12lu %12lu %10.4f %10.4f  %s\n", k, w.result.full.instr, w.result.full.cycles, w.result.full.ipc(),
+               w.result.full.br, w.result.full.br_mispred, w.result.full.mpki(), w.result.full.cyc_wp_pki(), labels[k].c_str());
+    }
+    return num_failed;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "trace_db.h"
+#include "parameters.h"
+
+class predictor_plugin_t;
+
+// Microarchitecture fan-out (-u): decodes the trace once and feeds its pieces to one timing simulator (uarchsim_t)
+// per configuration, e.g. window sizes, fetch constraints or cache geometries, then reports them side by side.
+//
+// next_inst yields the pieces of the trace in order. Instance k runs with configs[k], labelled labels[k]. Each
+// instance is a forked worker, so it owns its own simulator and predictor out of the global state. The decoded pieces
+// are published in batches to a ring in memory shared with all the workers (broadcast_ring.h), which read them in
+// place: a batch slot is reused once every worker has released it, the decoding running at most CBP_FANOUT_LAG batches
+// ahead of the slowest one (fanout_max_lag()). Worker reports go to <log_dir>/uarch<k>.log if log_dir is given, and
+// are discarded otherwise. With predictor plugins (plugin.h), one per instance, instance k activates the k-th in its
+// worker.
+// Returns the number of failed instances.
+int run_uarch_fanout(const std::function<bool(db_t&)>& next_inst, const std::vector<sim_config_t>& configs, const std::vector<std::string>& labels,
+                     const char * log_dir, const std::vector<predictor_plugin_t *>& plugins = {});
@@ -22,13 +22,26 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // Author: Eric Rotenberg (ericro@ncsu.edu)
 
 
+#include <array>
+#include <memory>
 #include <unordered_map>
 #include <list>
+#include <sstream>
+#include <utility>
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/ostr.h"
-//#include "cbp.h"
+#include "cbp.h"
 #include "value_predictor_interface.h"
 #include "stride_prefetcher.h"
+#include "timing_wheel.h"
+#include "store_queue.h"
+#include "window_ring.h"
+#include "parameters.h"
+#include "footprint.h"
+#include "phase_detector.h"
+#include "convergence.h"
+#include "activity_trace.h"
+#include "invariant.h"
 using namespace std;
 
 #ifndef _RISCV_UARCHSIM_H
@@ -51,7 +64,7 @@ struct window_t {
    uint64_t addr;
    uint64_t value;
    uint64_t latency;
-   window_t (uint64_t _seq_no, uint8_t _piece, uint64_t _PC, uint64_t _fetch_cycle, uint64_t _decode_cycle, uint64_t _exec_cycle, ExecuteInfo _exec_info, uint64_t _retire_cycle, uint64_t _addr, uint64_t _value, uint64_t _latency)
+   window_t (uint64_t _seq_no, uint8_t _piece, uint64_t _PC, uint64_t _fetch_cycle, uint64_t _decode_cycle, uint64_t _exec_cycle, const ExecuteInfo& _exec_info, uint64_t _retire_cycle, uint64_t _addr, uint64_t _value, uint64_t _latency)
      : seq_no(_seq_no)
      , piece(_piece)
      , PC(_PC)
@@ -81,6 +94,23 @@ struct window_t {
    {
    }
 
+   // Refills a reused window slot in place (exec_info is copy-assigned, so its storage is recycled).
+   void assign(uint64_t _seq_no, uint8_t _piece, uint64_t _PC, uint64_t _fetch_cycle, uint64_t _decode_cycle, uint64_t _exec_cycle, const ExecuteInfo& _exec_info, uint64_t _retire_cycle, uint64_t _addr, uint64_t _value, uint64_t _latency)
+   {
+      seq_no = _seq_no;
+      piece = _piece;
+      PC = _PC;
+      fetch_cycle = _fetch_cycle;
+      decode_cycle = _decode_cycle;
+      exec_cycle = _exec_cycle;
+      exec_info = _exec_info;
+      retire_cycle = _retire_cycle;
+      pred_taken = false;
+      addr = _addr;
+      value = _value;
+      latency = _latency;
+   }
+
    void update_pred_taken(bool _pred_taken)
    {
       pred_taken = _pred_taken;
@@ -88,63 +118,108 @@ struct window_t {
 
    friend std::ostream& operator<<(std::ostream& os, const window_t& entry)
    {
-       os<<"{";
-       os<<" ["<<entry.seq_no<<","<<(uint64_t)entry.piece<<"]";
-       os<<" PC:0x"<<std::hex<<entry.PC<<std::dec;
-       os<<" Class:"<<cInfo[static_cast<uint8_t>(entry.exec_info.dec_info.insn_class)];
-       os<<" TakenPopulated:"<<entry.exec_info.taken.has_value();
-       os<<" TakenVal:"<<entry.exec_info.taken.value_or(false);
-       os<<" fetch_cycle:"<<entry.fetch_cycle;
-       os<<" decode_cycle:"<<entry.decode_cycle;
-       os<<" exec_cycle:"<<entry.exec_cycle;
-       os<<" ExecInfo:"<<entry.exec_info;
-       os<<" retire_cycle:"<<entry.retire_cycle;
-       os<<"}";
+       print_window_entry(os, entry.seq_no, entry.piece, entry.PC, entry.exec_info, entry.fetch_cycle, entry.decode_cycle, entry.exec_cycle, entry.retire_cycle);
        return os;
    }
+
+   // The record of an activity event of this entry at cycle.
+   activity_record_t activity(activity_event_t type, uint64_t cycle) const
+   {
+       return activity_window_record(type, cycle, seq_no, piece, PC, exec_info, fetch_cycle, decode_cycle, exec_cycle, retire_cycle);
+   }
 };
 
-struct store_queue_t {
-   uint64_t exec_cycle; // store's execution cycle
-   uint64_t ret_cycle;  // store's commit cycle
+// Batched stepping (-k): the decode stage of uarchsim_t, run over a whole batch of pieces before any of them is
+// timed. What the timing of a uop needs from its piece and does not depend on the pipeline (the registers it reads and
+// writes, its execution lane and its fixed latency) is staged in one column per field. The timing stage has to go in
+// program order, as each uop depends on the fetch cycle and register timestamps the ones before it leave, and it reads
+// these dense columns instead of the pieces. step() stages its one piece in slot 0, so both time uops with the same code.
+struct uop_batch_t {
+   static constexpr size_t CAPACITY = 256;
+   static constexpr uint8_t NO_REG = UINT8_MAX;
+
+   // Source registers whose timestamps the uop waits for, NO_REG for none. As ever, the second and third sources only
+   // count when the first one is not the zero register.
+   uint8_t src_a[CAPACITY];
+   uint8_t src_b[CAPACITY];
+   uint8_t src_c[CAPACITY];
+   uint8_t dst[CAPACITY];        // register whose timestamp the uop sets, NO_REG for none
+   bool ldst[CAPACITY];          // on the load/store lanes rather than the ALU lanes
+   uint64_t latency[CAPACITY];   // execution latency, but for the loads
+
+   // Stages insts[0, n), n at most CAPACITY, in slots [0, n).
+   void decode(const db_t *insts, size_t n, const sim_config_t& cfg)
+   {
+      CBP_CHECK(n <= CAPACITY);
+      for (size_t k = 0; k < n; k++) {
+         const db_t& inst = insts[k];
+         CBP_CHECK(!inst.A.valid || (inst.A.log_reg < RFSIZE));
+         CBP_CHECK(!inst.B.valid || (inst.B.log_reg < RFSIZE));
+         CBP_CHECK(!inst.C.valid || (inst.C.log_reg < RFSIZE));
+         const bool a_zero = (inst.A.log_reg == RFZERO);
+         src_a[k] = (inst.A.valid && !a_zero) ? inst.A.log_reg : NO_REG;
+         src_b[k] = (inst.B.valid && !a_zero) ? inst.B.log_reg : NO_REG;
+         src_c[k] = (inst.C.valid && !a_zero) ? inst.C.log_reg : NO_REG;
+      }
+      for (size_t k = 0; k < n; k++) {
+         const db_t& inst = insts[k];
+         CBP_CHECK(!inst.D.valid || (inst.D.log_reg < RFSIZE));
+         dst[k] = (inst.D.valid && (inst.D.log_reg != RFZERO)) ? inst.D.log_reg : NO_REG;
+      }
+      for (size_t k = 0; k < n; k++) {
+         const db_t& inst = insts[k];
+         ldst[k] = inst.is_load || inst.is_store;
+         if (inst.insn_class == InstClass::fpInstClass)
+            latency[k] = cfg.FP_EXEC_LATENCY;
+         else if (inst.insn_class == InstClass::slowAluInstClass)
+            latency[k] = cfg.SLOW_ALU_EXEC_LATENCY;
+         else
+            latency[k] = cfg.DEFAULT_EXEC_LATENCY;
+      }
+   }
 };
 
-// Class for a microarchitectural simulator.
+// Class for a microarchitectural simulator, over P, a predictor type of cbp_predictor.h, as the conditional branch
+// predictor. The members are defined in uarchsim_impl.h.
 
-class uarchsim_t {
+template <class P>
+class basic_uarchsim_t {
    private:
+      const sim_config_t cfg;
+
       // Add your class member variables here to facilitate your limit study.
 
       // Modeling resources: (1) finite fetch bundle, (2) finite window, and (3) finite execution lanes.
       uint64_t num_fetched;
       uint64_t num_fetched_branch;
       //fifo_t<window_t> window;
-      std::deque<window_t> window;
+      window_ring_t<window_t> window;
       uint64_t window_capacity;
-      resource_schedule *alu_lanes;
-      resource_schedule *ldst_lanes;
+      std::unique_ptr<resource_schedule> alu_lanes;
+      std::unique_ptr<resource_schedule> ldst_lanes;
 
       // register timestamps
       uint64_t RF[RFSIZE];
 
       // store queue byte timestamps
-      unordered_map<uint64_t, store_queue_t> SQ;
+      store_queue_t SQ;
 
       std::deque<std::tuple<uint64_t/*seq_no*/, uint8_t/*piece*/, uint64_t/*decode_cycle*/>> DQ;
-      std::list<std::tuple<uint64_t/*seq_no*/, uint8_t/*piece*/, uint64_t/*agen_cycle*/>> AQ; // agen_queue
-      std::list<std::tuple<uint64_t/*seq_no*/, uint8_t/*piece*/, uint64_t/*exec_cycle*/>> EQ;
+      timing_wheel_t<std::pair<uint64_t/*seq_no*/, uint8_t/*piece*/>> AQ; // agen_queue, keyed by agen_cycle
+      timing_wheel_t<std::pair<uint64_t/*seq_no*/, uint8_t/*piece*/>> EQ; // keyed by exec_cycle
 
       // memory block timestamps
       cache_t L3;
       cache_t L2;
       cache_t L1;
+      cache_hierarchy_t data_caches;      // L1, L2, L3, for the loads: one search per access
 
       // fetch timestamp
       uint64_t fetch_cycle;
       uint64_t previous_fetch_cycle = 0;
    
       // Branch predictor.
-      bp_t BP;
+      basic_bp_t<P> BP;
 
       // Instruction cache.
       cache_t IC;
@@ -156,10 +231,26 @@ class uarchsim_t {
       uint64_t num_uop;
       uint64_t cycle;
 
-      // Instructions, cycle_count, for each epoch
-      std::vector<uint64_t> num_insts_per_epoch;
-      std::vector<uint64_t> num_cycles_per_epoch;
+      // Instructions and cycles of each epoch are in BP.epochs().
       uint64_t last_epoch_end_cycle;
+      const uint64_t epoch_size_insts;   // sampled runs end their epochs at the unit boundaries instead
+      // Memory footprint at the end of each epoch, reported with the per-epoch measurements (-E).
+      std::vector<footprint_sample_t> footprint_per_epoch;
+      footprint_sample_t sample_footprint() const;
+      void output_footprint() const;
+
+      // Sampled simulation (-U): position in the current period, and the measurements of the units so far.
+      uint64_t sample_pos = 0;
+      uint64_t num_detailed_inst = 0;
+      std::vector<epoch_row_t> sample_units;
+      // Phase-adaptive sampling (-U phase,...): the phases seen so far, whether the current interval is simulated in
+      // detail, and the phase of each measured unit (in sample_units).
+      phase_detector_t phase_detector{cfg.SAMPLE_PHASE_THRESHOLD};
+      bool phase_detailed = false;
+      std::vector<uint64_t> sample_phases;
+
+      // Early termination (-c): fed every epoch, tells when the run may stop.
+      convergence_t convergence{cfg};
 
       // CVP measurements
       uint64_t num_eligible;
@@ -173,6 +264,57 @@ class uarchsim_t {
 
       uint64_t stat_pfs_issued_to_mem = 0;
 
+      // CPI stack: each uop's retire cycle minus the one before it, charged to what held the uop back over those
+      // cycles. Its timeline is walked from the previous retire cycle: the fetch redirect that set its fetch cycle, the
+      // I$, the pipeline fill (charged as the redirect), its source operands, an execution lane, and its execution, by
+      // the level that served it for a load. The stack of a run sums to the retire cycle of its last uop.
+      enum cpi_category_t : unsigned {
+         CPI_BASE,      // fetch bandwidth, pipeline fill, operands and ALU execution
+         CPI_ICACHE,
+         CPI_BRANCH,    // a branch misprediction redirected fetch
+         CPI_WINDOW,    // fetch waited for the window to retire
+         CPI_LANES,
+         CPI_L1,        // load served by the L1$ or the SQ
+         CPI_L2,
+         CPI_L3,
+         CPI_MEMORY,
+         NUM_CPI_CATEGORIES
+      };
+      static const char * const cpi_category_names[NUM_CPI_CATEGORIES];
+      typedef std::array<uint64_t, NUM_CPI_CATEGORIES> cpi_stack_t;
+      // The stack of the current epoch, the totals of those before it, and the stack of each epoch ended, when the
+      // measurements of each epoch are kept (BP.epochs()).
+      cpi_stack_t cpi_current = {};
+      cpi_stack_t cpi_closed = {};
+      std::vector<cpi_stack_t> cpi_per_epoch;
+      unsigned cpi_fetch_reason = CPI_BASE;    // what set the current fetch cycle
+      uint64_t cpi_last_retire_cycle = 0;
+      cpi_stack_t cpi_totals() const;
+      void output_cpi_stack() const;
+
+      // Activity tracing (activity_trace.h), when LOG_LEVEL != 0 or to the file of -y: the records of a step, printed or
+      // recorded at its end if its fetch cycle falls in [LOG_START_CYCLE, LOG_END_CYCLE].
+      const bool trace_activity;
+      std::vector<activity_record_t> activity_trace;
+      void flush_activity();
+
+      // Whether to fill DQ, AQ and EQ: only for the decode, agen and execute notifications (cbp_hooks), and AQ and
+      // EQ for tracing.
+      const bool notify_decode;
+      const bool notify_agen;
+      const bool notify_execute;
+
+      // Records of the next notify_batch() call, when batching (CBP_HOOK_BATCH).
+      const bool batch_hooks;
+      std::vector<cbp_record_t> batch_fetched;
+      std::vector<cbp_record_t> batch_decoded;
+      std::vector<cbp_record_t> batch_agen;
+      std::vector<cbp_record_t> batch_resolved;
+      std::vector<cbp_record_t> batch_committed;
+      void deliver_batch(const uint64_t current_cycle);
+
+      uint8_t piece;  // piece of the current instruction, UINT8_MAX once its last piece was stepped
+
       // Helper for oracle hit/miss information
       uint64_t get_load_exec_cycle(db_t *inst) const;
 
@@ -182,20 +324,79 @@ class uarchsim_t {
       void populate_decode_info(db_t *inst); 
       const window_t& locate_entry_in_window(uint64_t seq_no, uint8_t piece) const;
       void end_current_begin_new_epoch(const bool first_epoch, const bool last_epoch, const uint64_t epoch_end_cycle);
+      // Timestamps and measurements of a new run, set by the constructor and reset().
+      void begin_run();
+      void warm(db_t *inst);
+      void drain();
+
+      // step() is compiled once per combination of the configuration flags tested on every uop, STEP_*, so that each
+      // runs without them; the constructor picks the one of the configuration. The value prediction bit is last, and
+      // only in builds with the value predictor.
+      static constexpr unsigned STEP_ICACHE = 1;            // FETCH_MODEL_ICACHE
+      static constexpr unsigned STEP_PREFETCH = 2;          // PREFETCHER_ENABLE
+      static constexpr unsigned STEP_PERFECT_CACHE = 4;     // PERFECT_CACHE
+      static constexpr unsigned STEP_WRITE_ALLOCATE = 8;    // WRITE_ALLOCATE
+      static constexpr unsigned STEP_PERFECT_BP = 16;       // PERFECT_BRANCH_PRED
+      static constexpr unsigned STEP_VP = 32;               // VP_ENABLE
+      static constexpr unsigned NUM_STEP_MODES = VALUE_PREDICTION ? 64 : 32;
+      // Steps inst, staged in slot of staged.
+      using step_fn_t = void (basic_uarchsim_t::*)(db_t *inst, size_t slot);
+      step_fn_t step_fn;
+      template <unsigned MODE>
+      void step_in_mode(db_t *inst, size_t slot);
+      uop_batch_t staged;
+      template <unsigned... MODES>
+      static step_fn_t select_step(unsigned mode, std::integer_sequence<unsigned, MODES...>);
 
    public:
-      uarchsim_t();
-      ~uarchsim_t();
+      basic_uarchsim_t(const sim_config_t& _cfg);
+      // Back to the state of a new simulator of the same configuration, for another run in the same process: the
+      // caches, the indirect predictor and the schedules keep their storage, already faulted in, rather than being
+      // allocated again. The conditional branch predictor is not reset: it is the contestant's (cbp.h).
+      void reset();
 
       //void set_funcsim(processor_t *funcsim);
       void step(db_t *inst);
-      void eval_decode(std::ostream& activity_trace, bool& activity_observed, const uint64_t current_fetch_cycle) ;
-      void eval_aq(std::ostream& activity_trace, bool& activity_observed, const uint64_t current_fetch_cycle) ;
-      void eval_exec(std::ostream& activity_trace, bool& activity_observed, const uint64_t current_fetch_cycle) ;
-      void eval_retire(std::ostream& activity_trace, bool& activity_observed, const uint64_t current_fetch_cycle) ;
+      // Batched stepping (-k): steps the n pieces of insts as n calls of step() would, each stage over a batch of them
+      // at a time (uop_batch_t).
+      // Returns the number of pieces stepped, fewer than n only if the run converged (-c) at one of them.
+      size_t step_batch(db_t *insts, size_t n);
+      // Early termination (-c): whether the run has converged, after which the pieces left are not to be stepped.
+      bool converged() const { return convergence.converged(); }
+      void eval_decode(bool& activity_observed, const uint64_t current_fetch_cycle) ;
+      void eval_aq(bool& activity_observed, const uint64_t current_fetch_cycle) ;
+      void eval_exec(bool& activity_observed, const uint64_t current_fetch_cycle) ;
+      void eval_retire(bool& activity_observed, const uint64_t current_fetch_cycle) ;
+      void eval_cycles(bool& activity_observed, const uint64_t first_cycle, const uint64_t last_cycle);
       void output();
+      // Registers the measurements of output() (valid after it) for the stats record (-J).
+      void register_stats(stats_t& st) const;
+      // Sampled simulation (-U): steps inst in detail or only warms the caches and the predictor with it, depending on
+      // where it falls in the sampling period. output_sampled() then reports the estimates from the measured units.
+      void step_sampled(db_t *inst);
+      void output_sampled();
+      // Phase-adaptive sampling (-U phase,...): steps inst in detail if its interval is of a new phase, else only
+      // warms with it. output_phased() then extrapolates the measurements of each phase to all its intervals.
+      void step_phased(db_t *inst);
+      void output_phased();
+      // Saves or restores the pipeline, caches and measurements between two steps (-S/-s).
+      void snapshot(snapshot_t& s);
+      // Conditional branch measurements over the last epochs covering target_instr_count instructions (valid after output()).
+      conddir_stats_t get_conddir_stats(const uint64_t target_instr_count) const;
+      uint64_t get_epoch_insts() const;
+      // Starts the first epoch num_insts instructions in, so that the epochs line up with those of the whole trace when
+      // the run starts in the middle of it (-K).
+      void start_in_epoch(const uint64_t num_insts);
+      // Keeps the measurements of each epoch from the current one on, for get_epoch_stats() and the stats record (-J).
+      void keep_epochs();
+      // Measurements of epochs [first_epoch, first_epoch + num_epochs), at most up to the last epoch begun.
+      epoch_stats_t get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const;
       uint64_t get_current_fetch_cycle() const;
       PredictionRequest get_value_prediction_req_for_track(uint64_t cycle, uint64_t seq_no, uint8_t piece, db_t *inst);
 };
 
+// The simulator of cbp, over the hooks of cbp.h (cbp_predictor.h), instantiated in uarchsim.cc.
+using uarchsim_t = basic_uarchsim_t<cbp_hooks_t>;
+extern template class basic_uarchsim_t<cbp_hooks_t>;
+
 #endif
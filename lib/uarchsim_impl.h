@@ -0,0 +1,1639 @@
+#pragma once
+/*
+
+Copyright (c) 2019, North Carolina State University
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. The names “North Carolina State University”, “NCSU” and any trade-name, personal name,
+trademark, trade device, service mark, symbol, image, icon, or any abbreviation, contraction or
+simulation thereof owned by North Carolina State University must not be used to endorse or promote products derived from this software without prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// Author: Eric Rotenberg (ericro@ncsu.edu)
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sstream>
+#include <numeric>
+#include <math.h>
+#include <assert.h>
+//#include "cbp.h"
+#include "value_predictor_interface.h"
+#include "trace_reader.h"
+#include "fifo.h"
+#include "cache.h"
+#include "bp.h"
+#include "cbp.h"
+#include "resource_schedule.h"
+#include "uarchsim.h"
+#include "usdt.h"
+#include "parameters.h"
+#include "snapshot.h"
+#include "phase_timer.h"
+#include "bp_impl.h"
+#include "cbp_predictor.h"
+#include "stats.h"
+#include "progress_stream.h"
+#include "time_series.h"
+#include "invariant.h"
+
+// The members of basic_uarchsim_t<P>, for the translation units instantiating it: uarchsim.cc for uarchsim_t, over the
+// hooks of cbp.h, and tools/inline_sim.cc for a predictor type of its own.
+
+template <class P>
+const char * const basic_uarchsim_t<P>::cpi_category_names[NUM_CPI_CATEGORIES] = {
+   "base", "icache", "branch", "window", "lanes", "l1", "l2", "l3", "memory"
+};
+
+//uarchsim_t::uarchsim_t():window(WINDOW_SIZE),
+template <class P>
+basic_uarchsim_t<P>::basic_uarchsim_t(const sim_config_t& _cfg)
+      :cfg(_cfg)
+      ,window(cfg.WINDOW_SIZE)
+      ,window_capacity(cfg.WINDOW_SIZE)
+      ,SQ(cfg.WINDOW_SIZE)
+      ,L3(cfg.L3_SIZE, cfg.L3_ASSOC, cfg.L3_BLOCKSIZE, cfg.L3_LATENCY, (cache_t *)NULL, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU, cfg.CACHE_SET_SAMPLING)
+      ,L2(cfg.L2_SIZE, cfg.L2_ASSOC, cfg.L2_BLOCKSIZE, cfg.L2_LATENCY, &L3, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU, cfg.CACHE_SET_SAMPLING)
+      ,L1(cfg.L1_SIZE, cfg.L1_ASSOC, cfg.L1_BLOCKSIZE, cfg.L1_LATENCY, &L2, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU)
+      ,data_caches(L1)
+      ,BP(cfg)
+      ,IC(cfg.IC_SIZE, cfg.IC_ASSOC, cfg.IC_BLOCKSIZE, 0, &L2, cfg.MAIN_MEMORY_LATENCY, cfg.CACHE_TREE_PLRU)
+      ,epoch_size_insts(cfg.SAMPLE_UNIT_INSTS ? UINT64_MAX : cfg.EPOCH_SIZE_INSTS)
+      ,trace_activity((cfg.LOG_LEVEL != 0) || activity_recorder.enabled())
+      ,notify_decode(P::hooks() & (CBP_HOOK_DECODE | CBP_HOOK_BATCH))
+      ,notify_agen((P::hooks() & (CBP_HOOK_AGEN | CBP_HOOK_BATCH)) || trace_activity)
+      ,notify_execute((P::hooks() & (CBP_HOOK_EXECUTE | CBP_HOOK_BATCH)) || trace_activity)
+      ,batch_hooks(P::hooks() & CBP_HOOK_BATCH)
+      ,piece(UINT8_MAX)
+{
+   static_assert(is_cbp_predictor<P>::value, "P lacks a hook of cbp_predictor.h");
+   CBP_CHECK(cfg.WINDOW_SIZE != 0);
+   //assert(FETCH_WIDTH);
+
+   //setup logger
+   // Set this to "spdlog::level::debug" for verbose debug prints
+   spdlog::set_level(spdlog::level::info);
+   spdlog::set_pattern("[%l]  %v");
+
+   CBP_CHECK(cfg.NUM_LDST_LANES > 0);
+   CBP_CHECK(cfg.NUM_ALU_LANES > 0);
+   if (cfg.VP_ENABLE && !VALUE_PREDICTION)
+   {
+      fprintf(stderr, "VP_ENABLE needs a build with the value predictor: make clean && make VALUE_PREDICTION=1\n");
+      exit(1);
+   }
+   // both lanes always exist, step() does not test for them
+   if (cfg.PREFETCHER_ENABLE)
+      L1.track_prefetches(NUM_RPT_ENTRIES);
+   ldst_lanes.reset(new resource_schedule(cfg.NUM_LDST_LANES));
+   alu_lanes.reset(new resource_schedule(cfg.NUM_ALU_LANES));
+
+   const unsigned mode = (cfg.FETCH_MODEL_ICACHE ? STEP_ICACHE : 0) | (cfg.PREFETCHER_ENABLE ? STEP_PREFETCH : 0)
+                       | (cfg.PERFECT_CACHE ? STEP_PERFECT_CACHE : 0) | (cfg.WRITE_ALLOCATE ? STEP_WRITE_ALLOCATE : 0)
+                       | (cfg.PERFECT_BRANCH_PRED ? STEP_PERFECT_BP : 0) | (cfg.VP_ENABLE ? STEP_VP : 0);
+   step_fn = select_step(mode, std::make_integer_sequence<unsigned, NUM_STEP_MODES>());
+
+   begin_run();
+}
+
+template <class P>
+void basic_uarchsim_t<P>::begin_run() {
+   for (int i = 0; i < RFSIZE; i++)
+      RF[i] = 0;
+
+   num_fetched = 0;
+   num_fetched_branch = 0;
+   fetch_cycle = 0;
+
+   num_inst = 0;
+   num_uop = 0;
+   cycle = 0;
+
+   cpi_current = {};
+   cpi_closed = {};
+   cpi_per_epoch.clear();
+   last_epoch_end_cycle = 0;
+   end_current_begin_new_epoch(true/*first_epoch*/, false/*last_epoch*/, 0/*epoch_end_cycle*/);
+ 
+   // CVP measurements
+   num_eligible = 0;
+   num_correct = 0;
+   num_incorrect = 0;
+
+   // stats
+   num_load = 0;
+   num_load_sqmiss = 0;
+   cycles_on_wrong_path = 0;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::reset() {
+   window.clear();
+   alu_lanes->reset();
+   ldst_lanes->reset();
+   SQ.clear();
+   DQ.clear();
+   AQ.clear();
+   EQ.clear();
+   L3.reset();
+   L2.reset();
+   L1.reset();
+   data_caches.reset();
+   IC.reset();
+   BP.reset();
+   prefetcher.reset();
+
+   previous_fetch_cycle = 0;
+   footprint_per_epoch.clear();
+   sample_pos = 0;
+   num_detailed_inst = 0;
+   sample_units.clear();
+   phase_detector = phase_detector_t(cfg.SAMPLE_PHASE_THRESHOLD);
+   phase_detailed = false;
+   sample_phases.clear();
+   convergence.reset();
+   stat_pfs_issued_to_mem = 0;
+   cpi_fetch_reason = CPI_BASE;
+   cpi_last_retire_cycle = 0;
+   activity_trace.clear();
+   batch_fetched.clear();
+   batch_decoded.clear();
+   batch_agen.clear();
+   batch_resolved.clear();
+   batch_committed.clear();
+   piece = UINT8_MAX;
+   begin_run();
+}
+
+// The decode and execute scratch records are rebuilt at each step and the activity trace is per step, so they are skipped.
+template <class P>
+void basic_uarchsim_t<P>::snapshot(snapshot_t& s) {
+   if (cfg.VP_ENABLE && !cfg.VP_PERFECT)
+      s.unsupported("the value predictor state cannot be saved");
+
+   s.io(num_fetched);
+   s.io(num_fetched_branch);
+   s.io(window);
+   s.io(*alu_lanes);
+   s.io(*ldst_lanes);
+   s.io(RF);
+   s.io(SQ);
+   s.io(DQ);
+   s.io(AQ);
+   s.io(EQ);
+   s.io(L3);
+   s.io(L2);
+   s.io(L1);
+   s.io(data_caches);
+   s.io(fetch_cycle);
+   s.io(previous_fetch_cycle);
+   s.io(BP);
+   s.io(IC);
+   s.io(prefetcher);
+   s.io(num_inst);
+   s.io(num_uop);
+   s.io(cycle);
+   s.io(footprint_per_epoch);
+   s.io(cpi_current);
+   s.io(cpi_closed);
+   s.io(cpi_per_epoch);
+   // kept as the branch measurements of each epoch are (epoch_log_t::snapshot())
+   if (s.loading() && (!BP.epochs().kept() || (cpi_per_epoch.size() != BP.epochs().size() - 1 - BP.epochs().first_kept())))
+      cpi_per_epoch.clear();
+   s.io(cpi_fetch_reason);
+   s.io(cpi_last_retire_cycle);
+   s.io(last_epoch_end_cycle);
+   s.io(num_eligible);
+   s.io(num_correct);
+   s.io(num_incorrect);
+   s.io(num_load);
+   s.io(num_load_sqmiss);
+   s.io(cycles_on_wrong_path);
+   s.io(stat_pfs_issued_to_mem);
+   s.io(piece);
+   s.io(convergence);
+
+   // Between two steps, only the fetches of the last step wait for notify_batch(), and they are still in the window.
+   assert(batch_decoded.empty() && batch_agen.empty() && batch_resolved.empty() && batch_committed.empty());
+   s.io(batch_fetched);
+   if (s.loading())
+      for (cbp_record_t& r : batch_fetched)
+         r.exec_info = &window.at(r.seq_no).exec_info;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::end_current_begin_new_epoch(const bool first_epoch, const bool last_epoch, const uint64_t epoch_end_cycle)
+{
+    if(!first_epoch)
+    {
+        // sampled runs can end an epoch before any instruction of it is fetched in detail
+        assert((epoch_end_cycle > last_epoch_end_cycle) || (cfg.SAMPLE_UNIT_INSTS && (epoch_end_cycle == last_epoch_end_cycle)));
+        // update cycles for the previous epoch
+        epoch_row_t& epoch = BP.epochs().current;
+        epoch.cycles = epoch_end_cycle - last_epoch_end_cycle;
+        if (cfg.PRINT_PER_EPOCH_STATS)
+            footprint_per_epoch.push_back(sample_footprint());
+        const branch_totals_t& e = epoch.br;
+        if (progress_stream.enabled())
+            progress_stream.epoch(BP.epochs().size() - 1, epoch.insts, epoch.cycles, e.conddir_n, e.conddir_m, e.cycles_wp);
+        CBP_PROBE5(epoch, BP.epochs().size() - 1, epoch.insts, epoch.cycles, e.conddir_n, e.conddir_m);
+        if (!last_epoch && (BP.epochs().size() == 1))
+            alloc_stats_steady(num_uop);
+    }
+
+    last_epoch_end_cycle = epoch_end_cycle;
+
+    if(!first_epoch && !last_epoch)
+        convergence.epoch(BP.epochs().current.insts, BP.epochs().current.cycles, BP.current_epoch().conddir_m, num_inst);
+
+    if(!last_epoch)
+    {
+        // begin new epoch
+        if (!first_epoch)
+        {
+            for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+                cpi_closed[c] += cpi_current[c];
+            if (BP.epochs().kept())
+                cpi_per_epoch.push_back(cpi_current);
+        }
+        cpi_current = {};
+        BP.notify_begin_new_epoch();
+    }
+}
+
+template <class P>
+footprint_sample_t basic_uarchsim_t<P>::sample_footprint() const
+{
+   footprint_sample_t f;
+   f.ckpt_live = checkpoint_footprint.live;
+   f.ckpt_bytes = checkpoint_footprint.bytes;
+   f.window = window.size();
+   f.sq_lines = SQ.size();
+   f.dq = DQ.size();
+   f.aq = AQ.size();
+   f.eq = EQ.size();
+   f.sched_depth = std::max(alu_lanes ? alu_lanes->get_depth() : 0, ldst_lanes ? ldst_lanes->get_depth() : 0);
+   f.sched_bytes = (alu_lanes ? alu_lanes->bytes() : 0) + (ldst_lanes ? ldst_lanes->bytes() : 0);
+   f.peak_rss = peak_rss_bytes();
+   return f;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::output_footprint() const
+{
+   printf("\n-----------------------------------------------SIMULATOR MEMORY FOOTPRINT PER EPOCH (At The End Of Each Epoch)-----------------------------------------------\n");
+   printf("EPOCH  CkptLive  CkptKB  Window  SQLines      DQ      AQ      EQ  SchedDepth  SchedKB   PeakRSSMB\n");
+   for (uint64_t epoch_index = 0; epoch_index < footprint_per_epoch.size(); epoch_index++)
+   {
+      const footprint_sample_t& f = footprint_per_epoch[epoch_index];
+      printf("%5lu %9lu %7lu %7lu %8lu %7lu %7lu %7lu %11lu %8lu %11.1f\n", epoch_index, f.ckpt_live, f.ckpt_bytes/1024, f.window, f.sq_lines,
+             f.dq, f.aq, f.eq, f.sched_depth, f.sched_bytes/1024, (double)f.peak_rss/(1024*1024));
+   }
+   printf("------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define MIN(a, b) (((a) > (b)) ? (b) : (a))
+
+template <class P>
+PredictionRequest basic_uarchsim_t<P>::get_value_prediction_req_for_track(uint64_t cycle, uint64_t seq_no, uint8_t piece, db_t *inst)
+{
+   PredictionRequest req;
+   req.seq_no = seq_no;
+   req.pc = inst->pc;
+   req.piece = piece;
+   req.cache_hit = HitMissInfo::Invalid;
+
+
+   switch(VPTracks(cfg.VP_TRACK)){
+   case VPTracks::ALL:
+         req.is_candidate = true;
+         break;
+   case VPTracks::LoadsOnly:
+         req.is_candidate = inst->is_load;
+         break;
+   case VPTracks::LoadsOnlyHitMiss:
+   {
+         req.is_candidate = inst->is_load;
+     
+         if(req.is_candidate)
+         {
+            req.cache_hit = HitMissInfo::Miss;
+            uint64_t exec_cycle = get_load_exec_cycle(inst);
+            switch (data_caches.lookup(exec_cycle, inst->addr).level)
+            {
+            case 1:
+               req.cache_hit = HitMissInfo::L1DHit;
+               break;
+            case 2:
+               req.cache_hit = HitMissInfo::L2Hit;
+               break;
+            case 3:
+               req.cache_hit = HitMissInfo::L3Hit;
+               break;
+            }
+         }
+         break;
+   }
+   default:
+         assert(false && "Invalid Track\n");
+         break;
+   }
+   return req;
+}
+
+template <class P>
+uint64_t basic_uarchsim_t<P>::get_load_exec_cycle(db_t *inst) const
+{
+   uint64_t exec_cycle = fetch_cycle;
+
+   // No need to re-access ICache because fetch_cycle has already been updated    
+   exec_cycle = exec_cycle + cfg.PIPELINE_FILL_LATENCY;
+
+   if (inst->A.valid) {
+      CBP_CHECK(inst->A.log_reg < RFSIZE);
+      if(inst->A.log_reg != RFZERO)
+      {
+          exec_cycle = MAX(exec_cycle, RF[inst->A.log_reg]);
+      }
+   }
+   if (inst->B.valid) {
+      CBP_CHECK(inst->B.log_reg < RFSIZE);
+      if(inst->A.log_reg != RFZERO)
+      {
+          exec_cycle = MAX(exec_cycle, RF[inst->B.log_reg]);
+      }
+   }
+   if (inst->C.valid) {
+      CBP_CHECK(inst->C.log_reg < RFSIZE);
+      if(inst->A.log_reg != RFZERO)
+      {
+          exec_cycle = MAX(exec_cycle, RF[inst->C.log_reg]);
+      }
+   }
+
+   if (ldst_lanes) exec_cycle = ldst_lanes->try_schedule(exec_cycle);
+
+   // AGEN takes 1 cycle.
+   exec_cycle = (exec_cycle + 1);
+
+   return exec_cycle;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::populate_exec_info(db_t *inst) 
+{
+    _current_execute_info.reset();
+
+    populate_decode_info(inst);
+    _current_execute_info.dec_info = _current_decode_info;
+
+    if(is_br(inst->insn_class))
+    {
+        const bool branch_taken = inst->is_taken;
+        if(!is_cond_br(inst->insn_class))
+        {
+            assert(branch_taken);
+        }
+        _current_execute_info.taken.emplace(branch_taken);
+        //_current_execute_info.taken_target.emplace(inst->next_pc);
+    }
+    _current_execute_info.next_pc = inst->next_pc;
+
+    if(inst->is_load || inst->is_store)
+    {
+        _current_execute_info.mem_va.emplace(inst->addr);
+        _current_execute_info.mem_sz.emplace(inst->size);
+    }
+
+    if (inst->D.valid)
+    {
+        CBP_CHECK(inst->D.log_reg < RFSIZE);
+        _current_execute_info.dst_reg_value.emplace(inst->D.value);
+    }
+}
+
+template <class P>
+void basic_uarchsim_t<P>::populate_decode_info(db_t *inst) 
+{
+    _current_decode_info.reset();
+    _current_decode_info.insn_class = inst->insn_class;
+    _current_decode_info.static_id = inst->static_id;
+
+    if (inst->A.valid) {
+        CBP_CHECK(inst->A.log_reg < RFSIZE);
+        _current_decode_info.src_reg_info.push_back(inst->A.log_reg);
+    }
+    if (inst->B.valid) {
+        CBP_CHECK(inst->B.log_reg < RFSIZE);
+        _current_decode_info.src_reg_info.push_back(inst->B.log_reg);
+    }
+    if (inst->C.valid) {
+        CBP_CHECK(inst->C.log_reg < RFSIZE);
+        _current_decode_info.src_reg_info.push_back(inst->C.log_reg);
+    }
+
+    // Anything to do if inst->D.log_reg != RFFLAGS
+    if (inst->D.valid)
+    {
+        CBP_CHECK(inst->D.log_reg < RFSIZE);
+        _current_decode_info.dst_reg_info.emplace(inst->D.log_reg);
+    }
+}
+
+template <class P>
+const window_t& basic_uarchsim_t<P>::locate_entry_in_window(uint64_t seq_no, uint8_t piece) const
+{
+    const window_t& window_entry = window.at(seq_no);
+    CBP_CHECK(window_entry.seq_no == seq_no);
+    CBP_CHECK(window_entry.piece == piece);
+    return window_entry;
+}
+
+
+#if 0
+template <class P>
+void basic_uarchsim_t<P>::step(db_t *inst) 
+{
+   spdlog::debug("Stepping, FC: {}",fetch_cycle);
+   inst->printInst(fetch_cycle);
+}
+#endif
+
+#if 1
+
+////////////////////////
+// Manage DQ
+////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::eval_decode(bool& activity_observed, const uint64_t current_cycle) 
+{
+   if(!DQ.empty())
+   {
+        bool process_dq = true;
+        while(process_dq)
+        {
+            auto dq_it = DQ.begin();
+            const auto [seq_no, piece, decode_cycle] = *dq_it;
+            assert(current_cycle <= decode_cycle);
+            if(current_cycle == decode_cycle)
+            {
+                const auto& window_entry = locate_entry_in_window(seq_no, piece);
+                assert(decode_cycle == window_entry.decode_cycle);
+                if (P::hooks() & CBP_HOOK_DECODE)
+                {
+                   PHASE_SCOPE(PHASE_HOOKS);
+                   P::notify_instr_decode(window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.exec_info.dec_info, current_cycle);
+                }
+                if (batch_hooks)
+                   batch_decoded.push_back({window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.pred_taken, current_cycle, &window_entry.exec_info});
+                DQ.pop_front();
+                process_dq = !DQ.empty();
+            }
+            else
+            {
+                process_dq = false;
+
+            }
+        }
+   }
+}
+
+////////////////////////
+// Manage AGEN
+////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::eval_aq(bool& activity_observed, const uint64_t current_cycle) 
+{
+   AQ.drain(current_cycle, [&](const auto& aq_entry)
+   {
+       const auto [seq_no, piece] = aq_entry;
+       const auto& window_entry = locate_entry_in_window(seq_no, piece);
+       assert(is_mem(window_entry.exec_info.dec_info.insn_class));
+       assert(current_cycle > window_entry.decode_cycle);
+       assert(current_cycle <= window_entry.exec_cycle);
+       if (P::hooks() & CBP_HOOK_AGEN)
+       {
+          PHASE_SCOPE(PHASE_HOOKS);
+          P::notify_agen_complete(window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.exec_info.dec_info, window_entry.exec_info.mem_va.value(), window_entry.exec_info.mem_sz.value(), current_cycle);
+       }
+       if (batch_hooks)
+          batch_agen.push_back({window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.pred_taken, current_cycle, &window_entry.exec_info});
+       if (trace_activity)
+          activity_trace.push_back(window_entry.activity(ACTIVITY_AGEN, current_cycle));
+       activity_observed = true;
+   });
+}
+
+
+////////////////////////
+// Manage Execute
+////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::eval_exec(bool& activity_observed, const uint64_t current_cycle) 
+{
+   EQ.drain(current_cycle, [&](const auto& eq_entry)
+   {
+       const auto [seq_no, piece] = eq_entry;
+       const auto& window_entry = locate_entry_in_window(seq_no, piece);
+       assert(window_entry.exec_cycle == current_cycle);
+       if (P::hooks() & CBP_HOOK_EXECUTE)
+       {
+          PHASE_SCOPE(PHASE_HOOKS);
+          P::notify_instr_execute_resolve(window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.pred_taken, window_entry.exec_info, current_cycle);
+       }
+       if (batch_hooks)
+          batch_resolved.push_back({window_entry.seq_no, window_entry.piece, window_entry.PC, window_entry.pred_taken, current_cycle, &window_entry.exec_info});
+       if (trace_activity)
+          activity_trace.push_back(window_entry.activity(ACTIVITY_EXECUTED, current_cycle));
+       activity_observed = true;
+   });
+}
+
+/////////////////////////////
+// Manage window: retire.
+/////////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::eval_retire(bool& activity_observed, const uint64_t current_cycle) 
+{
+   while (!window.empty() && (current_cycle >= window.front().retire_cycle)) {
+      //window_t w = window.pop();
+      const window_t& w = window.front();
+      if (trace_activity)
+         activity_trace.push_back(w.activity(ACTIVITY_RETIRED, current_cycle));
+      activity_observed = true;
+
+      if (P::hooks() & CBP_HOOK_COMMIT)
+      {
+         PHASE_SCOPE(PHASE_HOOKS);
+         P::notify_instr_commit(w.seq_no, w.piece, w.PC, w.pred_taken, w.exec_info, current_cycle);
+      }
+      // The slot keeps its contents until the next instruction is fetched into the window, after the batch.
+      if (batch_hooks)
+         batch_committed.push_back({w.seq_no, w.piece, w.PC, w.pred_taken, current_cycle, &w.exec_info});
+      if constexpr (VALUE_PREDICTION)
+         if (cfg.VP_ENABLE && !cfg.VP_PERFECT)
+            updatePredictor(w.seq_no, w.addr, w.value, w.latency);
+      //window.pop();
+      window.pop_front();
+   }
+}
+
+/////////////////////////////
+// Advance the pipe over [first_cycle, last_cycle]: evaluate decode, AGEN, execute and retire at every cycle in which
+// one of them has something due, in cycle order. The other cycles are skipped, as nothing would happen in them.
+/////////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::eval_cycles(bool& activity_observed, const uint64_t first_cycle, const uint64_t last_cycle)
+{
+   PHASE_SCOPE(PHASE_PIPE);
+   uint64_t current_cycle = first_cycle;
+   while (current_cycle <= last_cycle) {
+      uint64_t next_cycle = MIN(AQ.next_event(current_cycle, last_cycle), EQ.next_event(current_cycle, last_cycle));
+      if (!DQ.empty())
+         next_cycle = MIN(next_cycle, std::get<2>(DQ.front()));
+      if (!window.empty())
+         next_cycle = MIN(next_cycle, window.front().retire_cycle);
+      current_cycle = MAX(current_cycle, next_cycle);
+      if (current_cycle > last_cycle)
+         break;
+
+      eval_decode(activity_observed, current_cycle);
+      eval_aq(activity_observed, current_cycle);
+      eval_exec(activity_observed, current_cycle);
+      eval_retire(activity_observed, current_cycle);
+      if (batch_hooks)
+         deliver_batch(current_cycle);
+      current_cycle++;
+   }
+}
+
+// The activity of the step: to the file of -y, formatted only without it.
+template <class P>
+void basic_uarchsim_t<P>::flush_activity()
+{
+   if (activity_recorder.enabled())
+      activity_recorder.write(activity_trace);
+   else
+      print_activity(std::cout, activity_trace);
+}
+
+template <class P>
+void basic_uarchsim_t<P>::deliver_batch(const uint64_t current_cycle)
+{
+   if (batch_fetched.empty() && batch_decoded.empty() && batch_agen.empty() && batch_resolved.empty() && batch_committed.empty())
+      return;
+   const cbp_batch_t batch = {current_cycle,
+                              {batch_fetched.data(), batch_fetched.size()},
+                              {batch_decoded.data(), batch_decoded.size()},
+                              {batch_agen.data(), batch_agen.size()},
+                              {batch_resolved.data(), batch_resolved.size()},
+                              {batch_committed.data(), batch_committed.size()}};
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      P::notify_batch(batch);
+   }
+   batch_fetched.clear();
+   batch_decoded.clear();
+   batch_agen.clear();
+   batch_resolved.clear();
+   batch_committed.clear();
+}
+
+template <class P>
+template <unsigned... MODES>
+typename basic_uarchsim_t<P>::step_fn_t basic_uarchsim_t<P>::select_step(unsigned mode, std::integer_sequence<unsigned, MODES...>)
+{
+   static constexpr step_fn_t steps[] = {&basic_uarchsim_t::template step_in_mode<MODES>...};
+   assert(mode < sizeof...(MODES));
+   return steps[mode];
+}
+
+template <class P>
+void basic_uarchsim_t<P>::step(db_t *inst)
+{
+   staged.decode(inst, 1, cfg);
+   (this->*step_fn)(inst, 0);
+}
+
+template <class P>
+size_t basic_uarchsim_t<P>::step_batch(db_t *insts, size_t n)
+{
+   for (size_t first = 0; first < n; first += uop_batch_t::CAPACITY)
+   {
+      const size_t count = MIN(n - first, uop_batch_t::CAPACITY);
+      staged.decode(insts + first, count, cfg);
+      for (size_t k = 0; k < count; k++)
+      {
+         (this->*step_fn)(insts + first + k, k);
+         if (convergence.converged())
+            return first + k + 1;
+      }
+   }
+   return n;
+}
+
+template <class P>
+template <unsigned MODE>
+void basic_uarchsim_t<P>::step_in_mode(db_t *inst, size_t slot)
+{
+   PHASE_SCOPE(PHASE_STEP);
+   spdlog::debug("Stepping, FC: {}",fetch_cycle);
+   bool activity_observed = false;
+   if (trace_activity)
+      activity_trace.clear();
+
+   // Preliminary step: determine which piece of the instruction this is.
+   //static uint64_t prev_pc = 0xdeadbeef;
+   piece = (piece == UINT8_MAX) ? 0 : (piece + 1);
+   //prev_pc = inst->pc;
+
+   assert(previous_fetch_cycle <= fetch_cycle);
+   // advancing the pipe for the cycles skipped due to mispred/flush etc
+   if(previous_fetch_cycle != fetch_cycle)
+       eval_cycles(activity_observed, previous_fetch_cycle, fetch_cycle);
+
+ 
+   // CVP variables
+   uint64_t seq_no = num_uop;
+   bool predictable = (inst->D.valid && (inst->D.log_reg != RFFLAGS));
+   PredictionResult pred;
+   uint64_t latency = 0;
+   // 
+   // Schedule the instruction's execution cycle.
+   //
+   uint64_t i;
+   uint64_t addr;
+   const uint64_t cpi_fetch_cycle = fetch_cycle;
+
+   if constexpr (MODE & STEP_ICACHE)
+   {
+      const uint64_t next_fetch_cycle = IC.access(fetch_cycle, true/*read*/, inst->pc);   // Note: I-cache hit latency is "0" (above), so fetch cycle doesn't increase on hits.
+      assert(next_fetch_cycle >= fetch_cycle);
+      // advancing the pipe for the cycles skipped due to L1I$ miss
+      if(next_fetch_cycle != fetch_cycle)
+      {
+          eval_cycles(activity_observed, fetch_cycle, next_fetch_cycle);
+          fetch_cycle = next_fetch_cycle;
+      }
+   }
+
+   // Predict at fetch time
+   if constexpr (!(MODE & STEP_VP))
+   {
+      pred.speculate = false;
+   }
+   else
+   {
+      if (cfg.VP_PERFECT)
+      {
+         PredictionRequest req = get_value_prediction_req_for_track(fetch_cycle, seq_no, piece, inst);
+         pred.predicted_value = inst->D.value;
+         pred.speculate = predictable && req.is_candidate;
+         predictable &= req.is_candidate;
+      }
+      else
+      {
+         PredictionRequest req = get_value_prediction_req_for_track(fetch_cycle, seq_no, piece, inst);
+         pred = getPrediction(req);
+         speculativeUpdate(seq_no, predictable, ((predictable && pred.speculate && req.is_candidate) ? ((pred.predicted_value == inst->D.value) ? 1 : 0) : 2),
+                           inst->pc, inst->next_pc, static_cast<uint8_t>(inst->insn_class), piece,
+                           (inst->A.valid ? inst->A.log_reg : 0xDEADBEEF),
+                           (inst->B.valid ? inst->B.log_reg : 0xDEADBEEF),
+                           (inst->C.valid ? inst->C.log_reg : 0xDEADBEEF),
+                           (inst->D.valid ? inst->D.log_reg : 0xDEADBEEF));
+         // Override any predictor attempting to predict an instruction that is not candidate.
+         pred.speculate &= req.is_candidate;
+         predictable &= req.is_candidate;
+      }
+   }
+
+   const uint64_t cpi_icache_cycle = fetch_cycle;
+   uint64_t exec_cycle = fetch_cycle + cfg.PIPELINE_FILL_LATENCY;
+   const uint64_t cpi_fill_cycle = exec_cycle;
+
+   // instr src register readiness
+   if (staged.src_a[slot] != uop_batch_t::NO_REG)
+      exec_cycle = MAX(exec_cycle, RF[staged.src_a[slot]]);
+   if (staged.src_b[slot] != uop_batch_t::NO_REG)
+      exec_cycle = MAX(exec_cycle, RF[staged.src_b[slot]]);
+   if (staged.src_c[slot] != uop_batch_t::NO_REG)
+      exec_cycle = MAX(exec_cycle, RF[staged.src_c[slot]]);
+
+   const uint64_t cpi_ready_cycle = exec_cycle;
+
+   // Schedule an execution lane. -> earliest an execution lane is available
+   if (staged.ldst[slot]) {
+      exec_cycle = ldst_lanes->schedule(exec_cycle);
+   }
+   else 
+   {
+      exec_cycle = alu_lanes->schedule(exec_cycle);
+   }
+
+   const uint64_t cpi_lane_cycle = exec_cycle;
+   unsigned cpi_exec_category = CPI_BASE;
+
+   const uint64_t agen_cycle = is_mem(inst->insn_class) ? (exec_cycle + 1) : UINT64_MAX;
+
+   if (inst->is_load) {
+     
+      latency = exec_cycle; // record start of execution
+
+      // AGEN takes 1 cycle.
+      exec_cycle = (exec_cycle + 1);
+
+      // One search of the D$ levels, for both the prefetcher's training and the access.
+      cache_lookup_t found;
+      if constexpr ((MODE & STEP_PREFETCH) || !(MODE & STEP_PERFECT_CACHE))
+         found = data_caches.lookup(exec_cycle, inst->addr);
+
+      // Train the prefetcher when the load finds out its outcome in the L1D
+      if constexpr (MODE & STEP_PREFETCH)
+      {
+         // Generate prefetches ahead of time as in "Effective Hardware-Based Data Prefetching for High-Performance Processors"
+         // Instruction PC will be 4B aligned.
+         prefetcher.lookahead((inst->pc >> 2), fetch_cycle);
+
+         // Train the prefetcher 
+         const bool hit = (found.level == 1);
+         PrefetchTrainingInfo info{inst->pc >> 2, inst->addr, 0, hit};
+         prefetcher.train(info);
+      }
+
+      // Search D$ using AGEN's cycle.
+      uint64_t data_cache_cycle;
+      if constexpr (MODE & STEP_PERFECT_CACHE)
+         data_cache_cycle = exec_cycle + cfg.L1_LATENCY;
+      else
+         data_cache_cycle = data_caches.access(found, exec_cycle, inst->addr);
+
+      // Search of SQ takes 1 cycle after AGEN cycle.
+      exec_cycle = (exec_cycle + 1);
+
+      bool inc_sqmiss;
+      const uint64_t temp_cycle = SQ.load(inst->addr, inst->size, exec_cycle, data_cache_cycle, inc_sqmiss);
+
+      num_load++;                   // stat
+      num_load_sqmiss += (inc_sqmiss ? 1 : 0);      // stat
+
+      assert(temp_cycle >= exec_cycle);
+      exec_cycle = temp_cycle;
+
+      latency = (exec_cycle - latency); // end of execution minus start of execution
+      assert(latency >= 2); // 2 cycles if all bytes hit in SQ
+
+      // the level that served the load, by the latency after AGEN
+      const uint64_t mem_latency = latency - 1;
+      if (mem_latency <= cfg.L1_LATENCY)
+         cpi_exec_category = CPI_L1;
+      else if (mem_latency <= cfg.L1_LATENCY + cfg.L2_LATENCY)
+         cpi_exec_category = CPI_L2;
+      else if (mem_latency <= cfg.L1_LATENCY + cfg.L2_LATENCY + cfg.L3_LATENCY)
+         cpi_exec_category = CPI_L3;
+      else
+         cpi_exec_category = CPI_MEMORY;
+   }
+   else {
+      // The fixed execution latency of the ALU type.
+      latency = staged.latency[slot];
+
+      // Account for execution latency.
+      exec_cycle += latency;
+   }
+
+   activity_observed = true;
+
+   // Drain prefetches from PF Queue
+   // The idea is that a prefetch can go only if there is a free LDST slot "this" cycle
+   // Here, "this" means all the cycles between the previous fetch cycle and the current one since all fetched ld/st will have been
+   // scheduled and prefetch can correctly "steal" ld/st slots.
+   if constexpr (MODE & STEP_PREFETCH)
+   {
+      uint64_t tmp_previous_fetch_cycle;
+      Prefetch p;
+      bool issued;
+      while(prefetcher.issue(p, fetch_cycle))
+      {
+         tmp_previous_fetch_cycle = MAX(previous_fetch_cycle, p.cycle_generated);
+         issued = false;
+         while(tmp_previous_fetch_cycle <= fetch_cycle)
+         {
+            spdlog::debug("Issuing prefetch:{}", p);
+            uint64_t cycle_pf_exec = tmp_previous_fetch_cycle;
+
+            cycle_pf_exec = ldst_lanes->schedule(cycle_pf_exec, 0);
+
+            if(cycle_pf_exec != MAX_CYCLE)
+            {
+               L1.access(cycle_pf_exec, true, p.address, true, p.source);
+               ++stat_pfs_issued_to_mem;
+               issued = true;
+               break;
+            }
+            else
+            {
+               tmp_previous_fetch_cycle++;
+               spdlog::debug("Could not find empty LDST slot for PF this cycle, increasing");
+            }
+         }
+         
+         if(!issued)
+         {
+            prefetcher.put_back(p);
+            break;
+         }
+      }
+   }
+
+   // Update the instruction count and simulation cycle (max. completion cycle among all scheduled instructions).
+   num_uop += 1;
+   num_inst += inst->is_last_piece;
+   cycle = MAX(cycle, exec_cycle);
+
+   // Update destination register timestamp.
+   bool squash = false;
+   //if ((inst->D.log_reg != RFFLAGS) && (inst->D.log_reg != RFZERO)) 
+   if (staged.dst[slot] != uop_batch_t::NO_REG) {
+      if constexpr (MODE & STEP_VP)
+      {
+         squash = (pred.speculate && (pred.predicted_value != inst->D.value));
+         RF[staged.dst[slot]] = ((pred.speculate && (pred.predicted_value == inst->D.value)) ? fetch_cycle : exec_cycle);
+      }
+      else
+         RF[staged.dst[slot]] = exec_cycle;
+      activity_observed = true;
+   }
+
+   // Update SQ byte timestamps.
+   if (inst->is_store) {
+      uint64_t data_cache_cycle;
+      if constexpr (!(MODE & STEP_WRITE_ALLOCATE) || (MODE & STEP_PERFECT_CACHE))
+         data_cache_cycle = exec_cycle;
+      else
+         data_cache_cycle = L1.access(exec_cycle, true, inst->addr);
+
+      uint64_t ret_cycle = MAX(data_cache_cycle, (window.empty() ? 0 : window.back().retire_cycle));
+      SQ.store(inst->addr, inst->size, exec_cycle, ret_cycle);
+   }
+
+   // Every later load searches the SQ after its fetch, so stores committed by now can no longer forward.
+   SQ.release(fetch_cycle);
+
+   // CVP measurements
+   num_eligible += (predictable ? 1 : 0);
+   num_correct += ((predictable && pred.speculate && !squash) ? 1 : 0);
+   num_incorrect += ((predictable && pred.speculate && squash) ? 1 : 0);
+
+   /////////////////////////////
+   // Manage window: dispatch.
+   /////////////////////////////
+   //window.push({MAX(exec_cycle, (window.empty() ? 0 : window.peektail().retire_cycle)),
+   //            seq_no,
+   //            ((inst->is_load || inst->is_store) ? inst->addr : 0xDEADBEEF),
+   //            ((inst->D.valid && (inst->D.log_reg != RFFLAGS)) ? inst->D.value : 0xDEADBEEF),
+     //      latency});
+   //window_t (uint64_t _seq_no, uint64_t _PC, uint64_t _fetch_cycle, uint64_t _decode_cycle, uint64_t _exec_cycle, ExecuteInfo _exec_info, uint64_t _retire_cycle, uint64_t _addr, uint64_t _value, uint64_t _latency)
+   const uint64_t decode_cycle = fetch_cycle+cfg.DQ_LATENCY;
+   populate_exec_info(inst);
+   assert(fetch_cycle < exec_cycle);
+   const uint64_t predict_cycle = fetch_cycle;
+   const uint64_t retire_cycle = MAX(exec_cycle, (window.empty() ? 0 : window.back().retire_cycle));
+
+   // CPI stack: the cycles from the previous retire cycle to this one, along the timeline of the uop.
+   {
+      cpi_stack_t& stack = cpi_current;
+      uint64_t at = cpi_last_retire_cycle;
+      auto charge = [&](const unsigned category, const uint64_t until) {
+         if (until > at)
+         {
+            stack[category] += until - at;
+            at = until;
+         }
+      };
+      charge(cpi_fetch_reason, cpi_fetch_cycle);
+      charge(CPI_ICACHE, cpi_icache_cycle);
+      charge(cpi_fetch_reason, cpi_fill_cycle);
+      charge(CPI_BASE, cpi_ready_cycle);
+      charge(CPI_LANES, cpi_lane_cycle);
+      charge(cpi_exec_category, exec_cycle);
+      cpi_last_retire_cycle = at;
+   }
+
+   window.push_back(seq_no).assign(seq_no,
+               piece,
+               inst->pc,
+               fetch_cycle,
+               decode_cycle,
+               exec_cycle,
+               _current_execute_info,
+               retire_cycle,
+               ((inst->is_load || inst->is_store) ? inst->addr : 0xDEADBEEF), // addr
+               ((inst->D.valid && (inst->D.log_reg != RFFLAGS)) ? inst->D.value : 0xDEADBEEF), //value
+           latency); //latency
+   if (trace_activity)
+   {
+      activity_trace.push_back(window.back().activity(ACTIVITY_FETCHED, fetch_cycle));
+      activity_trace.push_back(activity_inst_record(fetch_cycle, window.back().seq_no, window.back().piece, *inst));
+   }
+   activity_observed = true;
+   assert(window.size() <= window_capacity);
+
+   if (P::hooks() & CBP_HOOK_FETCH)
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      P::notify_instr_fetch(seq_no, piece, inst->pc, fetch_cycle);
+   }
+   if (batch_hooks)
+      batch_fetched.push_back({seq_no, piece, inst->pc, window.back().pred_taken, fetch_cycle, &window.back().exec_info});
+
+   if (notify_decode)
+      DQ.push_back(std::make_tuple(seq_no, piece, decode_cycle));
+   if(notify_agen && is_mem(inst->insn_class))
+   {
+       AQ.schedule(agen_cycle, std::make_pair(seq_no, piece));
+       assert(AQ.size() <= window_capacity);
+   }
+   if (notify_execute)
+      EQ.schedule(exec_cycle, std::make_pair(seq_no, piece));
+
+   /////////////////////////////
+   // Manage fetch cycle.
+   /////////////////////////////
+   previous_fetch_cycle = fetch_cycle;
+   assert(window.front().retire_cycle > fetch_cycle);
+
+   const bool is_branch = is_br(inst->insn_class);
+   if (squash) // control dependency on the retire cycle of the value-mispredicted instruction
+   {            
+      num_fetched = 0;          // new fetch bundle
+      //assert(!window.empty() && (fetch_cycle < window.peektail().retire_cycle));
+      //fetch_cycle = window.peektail().retire_cycle;
+      assert(!window.empty() && (fetch_cycle < window.back().retire_cycle));
+      fetch_cycle = window.back().retire_cycle;
+      cpi_fetch_reason = CPI_BASE;
+   }
+   else if (window.size() == window_capacity) 
+   {
+      if (fetch_cycle < window.front().retire_cycle) 
+      {
+         num_fetched = 0;       // new fetch bundle
+         fetch_cycle = window.front().retire_cycle;
+         cpi_fetch_reason = CPI_WINDOW;
+      }
+   }
+   else {               // fetch bundle constraints
+       bool stop = false;
+
+       // Finite fetch bundle.
+       if (cfg.FETCH_WIDTH > 0) 
+       {
+           num_fetched += inst->is_last_piece;
+           if (num_fetched == cfg.FETCH_WIDTH)
+           {
+               stop = true;
+           }
+       }
+
+       // Finite branch throughput.
+       if ((cfg.FETCH_NUM_BRANCH > 0) && is_branch) 
+       {
+           num_fetched_branch++;
+           if (num_fetched_branch == cfg.FETCH_NUM_BRANCH)
+           {
+               stop = true;
+           }
+       }
+
+       // Indirect branch constraint.
+       if (cfg.FETCH_STOP_AT_INDIRECT && is_uncond_ind_br(inst->insn_class))
+       {
+           stop = true;
+       }
+
+       // Taken branch constraint.
+       if(cfg.FETCH_STOP_AT_TAKEN && inst->is_taken)
+       {
+           const bool taken_branch = (is_cond_br(inst->insn_class) && (inst->next_pc != (inst->pc + 4))) || is_uncond_br(inst->insn_class);
+           if(!taken_branch)
+           {
+               print_activity(std::cout, activity_trace);
+               std::cout<<std::endl;
+               std::cout<<"FailingInstr"<<*inst<<std::endl;
+           }
+           assert(taken_branch);
+           stop = true;
+       }
+
+       if (stop) 
+       {
+           // new fetch bundle
+           num_fetched = 0;
+           num_fetched_branch = 0;
+           fetch_cycle++;
+           cpi_fetch_reason = CPI_BASE;
+       }
+   }
+   // Account for the effect of a mispredicted branch on the fetch cycle.
+   // TODO:: capture taken_target
+   bool br_mispred = false;
+   checkpoint_oldest_inflight = window.empty() ? seq_no : window.front().seq_no;
+   if (!(MODE & STEP_PERFECT_BP) && BP.predict(seq_no, piece, inst->insn_class, inst->pc, inst->next_pc, predict_cycle, inst->static_id))
+   {
+       br_mispred = true;
+       // setting fetched/fetched_branch for the next cycle
+       num_fetched = 0;
+       num_fetched_branch = 0;
+       fetch_cycle = MAX(fetch_cycle, exec_cycle);
+       cpi_fetch_reason = CPI_BRANCH;
+       assert(fetch_cycle > predict_cycle);
+       cycles_on_wrong_path += (fetch_cycle - predict_cycle);
+       BP.update_cycles_on_wrong_path(fetch_cycle - predict_cycle);
+   }
+
+   if(is_branch)
+   {
+       bool predicted_taken = false;
+       if(is_cond_br(inst->insn_class))
+       {
+           predicted_taken = br_mispred ? !_current_execute_info.taken.value() : _current_execute_info.taken.value();
+       }
+       else
+       {
+           predicted_taken = true;
+           if(!_current_execute_info.taken.value())
+           {
+               std::cout<<"About to assert!"<<std::endl;
+               inst->printInst(fetch_cycle);
+           }
+           assert(_current_execute_info.taken.value());
+       }
+       window.back().update_pred_taken(predicted_taken);
+   }
+
+   spdlog::debug("Updating base_cycle to {}", MIN(fetch_cycle, prefetcher.get_oldest_pf_cycle()));
+
+   // Attempt to advance the base cycles of resource schedules.
+   // Note : We may have some prefetches to issue still that are older than the fetch cycle.
+   ldst_lanes->advance_base_cycle(MIN(fetch_cycle, prefetcher.get_oldest_pf_cycle()));
+   alu_lanes->advance_base_cycle(MIN(fetch_cycle, prefetcher.get_oldest_pf_cycle()));
+   const bool dump_activity = trace_activity && (fetch_cycle>= cfg.LOG_START_CYCLE) && (fetch_cycle<=cfg.LOG_END_CYCLE);
+   if(dump_activity && activity_observed)
+       flush_activity();
+
+   if(inst->is_last_piece)
+   {
+       piece = UINT8_MAX;
+   }
+
+   uint64_t& epoch_insts = BP.epochs().current.insts;
+   epoch_insts += inst->is_last_piece;
+   if(inst->is_last_piece && time_series.enabled() && time_series.tick())
+   {
+       time_series.end_epoch(predict_cycle, BP.totals());
+   }
+   const bool end_of_epoch = epoch_insts == epoch_size_insts;
+   if(end_of_epoch)
+   {
+       end_current_begin_new_epoch(false/*first_epoch*/, false/*last_epoch*/, predict_cycle);
+   }
+
+}
+#endif
+
+/////////////////////////////
+// Functional warming (-U): the caches and the predictor see the instruction, but none of the timing structures do.
+// The caches are accessed at cycle 0, so that the blocks brought in are available at once, and the predictor is told
+// of the fetch, decode, agen, execution and commit of the instruction right away, all at the current fetch cycle.
+/////////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::warm(db_t *inst)
+{
+   PHASE_SCOPE(PHASE_STEP);
+   assert(window.empty());
+   piece = (piece == UINT8_MAX) ? 0 : (piece + 1);
+   const uint64_t seq_no = num_uop++;
+
+   if (cfg.FETCH_MODEL_ICACHE)
+      IC.access(0, true/*read*/, inst->pc);
+   if (!cfg.PERFECT_CACHE && (inst->is_load || (inst->is_store && cfg.WRITE_ALLOCATE)))
+      L1.access(0, true/*read*/, inst->addr);
+
+   populate_exec_info(inst);
+   checkpoint_oldest_inflight = seq_no;
+   const bool br_mispred = !cfg.PERFECT_BRANCH_PRED && BP.predict(seq_no, piece, inst->insn_class, inst->pc, inst->next_pc, fetch_cycle, inst->static_id);
+   bool pred_taken = false;
+   if (is_br(inst->insn_class))
+      pred_taken = is_cond_br(inst->insn_class) ? (br_mispred != _current_execute_info.taken.value()) : true;
+
+   const ExecuteInfo& info = _current_execute_info;
+   if (P::hooks() & CBP_HOOK_ALL)
+   {
+      PHASE_SCOPE(PHASE_HOOKS);
+      if (P::hooks() & CBP_HOOK_FETCH)
+         P::notify_instr_fetch(seq_no, piece, inst->pc, fetch_cycle);
+      if (P::hooks() & CBP_HOOK_DECODE)
+         P::notify_instr_decode(seq_no, piece, inst->pc, info.dec_info, fetch_cycle);
+      if ((P::hooks() & CBP_HOOK_AGEN) && is_mem(inst->insn_class))
+         P::notify_agen_complete(seq_no, piece, inst->pc, info.dec_info, inst->addr, inst->size, fetch_cycle);
+      if (P::hooks() & CBP_HOOK_EXECUTE)
+         P::notify_instr_execute_resolve(seq_no, piece, inst->pc, pred_taken, info, fetch_cycle);
+      if (P::hooks() & CBP_HOOK_COMMIT)
+         P::notify_instr_commit(seq_no, piece, inst->pc, pred_taken, info, fetch_cycle);
+   }
+   if (batch_hooks)
+   {
+      const cbp_record_t record = {seq_no, piece, inst->pc, pred_taken, fetch_cycle, &info};
+      batch_fetched.push_back(record);
+      batch_decoded.push_back(record);
+      if (is_mem(inst->insn_class))
+         batch_agen.push_back(record);
+      batch_resolved.push_back(record);
+      batch_committed.push_back(record);
+      deliver_batch(fetch_cycle);
+   }
+
+   num_inst += inst->is_last_piece;
+   BP.epochs().current.insts += inst->is_last_piece;
+   if (inst->is_last_piece)
+      piece = UINT8_MAX;
+}
+
+/////////////////////////////
+// Runs the pipe until the instructions in flight have retired, so that the predictor sees them resolve before the
+// warmed instructions that follow. Fetch resumes in the cycle the last one retires.
+/////////////////////////////
+template <class P>
+void basic_uarchsim_t<P>::drain()
+{
+   bool activity_observed = false;
+   const uint64_t last_cycle = window.empty() ? fetch_cycle : MAX(fetch_cycle, window.back().retire_cycle);
+   eval_cycles(activity_observed, previous_fetch_cycle, last_cycle);
+   assert(window.empty());
+
+   num_fetched = 0;
+   num_fetched_branch = 0;
+   fetch_cycle = last_cycle;
+   previous_fetch_cycle = last_cycle;
+   if (ldst_lanes) ldst_lanes->advance_base_cycle(MIN(fetch_cycle, prefetcher.get_oldest_pf_cycle()));
+   if (alu_lanes) alu_lanes->advance_base_cycle(MIN(fetch_cycle, prefetcher.get_oldest_pf_cycle()));
+}
+
+// Each period is warmed, then simulated in detail from SAMPLE_WARMUP_INSTS instructions before its unit, the last
+// SAMPLE_UNIT_INSTS instructions of the period. The unit is measured as one epoch, and the rest of the period makes
+// up the epoch before it.
+template <class P>
+void basic_uarchsim_t<P>::step_sampled(db_t *inst)
+{
+   const uint64_t unit_begin = cfg.SAMPLE_PERIOD_INSTS - cfg.SAMPLE_UNIT_INSTS;
+   const uint64_t detail_begin = unit_begin - cfg.SAMPLE_WARMUP_INSTS;
+   if (sample_pos < detail_begin)
+      warm(inst);
+   else
+   {
+      step(inst);
+      num_detailed_inst += inst->is_last_piece;
+   }
+   if (!inst->is_last_piece)
+      return;
+
+   sample_pos++;
+   if ((sample_pos == unit_begin) && (unit_begin > 0))
+      end_current_begin_new_epoch(false/*first_epoch*/, false/*last_epoch*/, previous_fetch_cycle);
+   else if (sample_pos == cfg.SAMPLE_PERIOD_INSTS)
+   {
+      end_current_begin_new_epoch(false/*first_epoch*/, false/*last_epoch*/, previous_fetch_cycle);
+      sample_units.push_back(BP.epochs().previous());
+      sample_pos = 0;
+      if (detail_begin > 0)
+         drain();
+   }
+}
+
+// Mean of the per-unit values, and the half-width of its 95% confidence interval under the normal approximation.
+// Returns the half-width relative to the mean.
+inline double print_sample_estimate(const char *name, const std::vector<double>& values)
+{
+   const double n = values.size();
+   double sum = 0.0;
+   double sum_sq = 0.0;
+   for (const double v : values)
+   {
+      sum += v;
+      sum_sq += v * v;
+   }
+   const double mean = sum / n;
+   const double variance = (n > 1) ? MAX(0.0, (sum_sq - n * mean * mean) / (n - 1)) : 0.0;
+   const double half_width = 1.96 * sqrt(variance / n);
+   const double rel_half_width = (mean != 0.0) ? (half_width / mean) : 0.0;
+   printf("%-12s = %.4f +- %.4f (95%% confidence, +- %.2f%%)\n", name, mean, half_width, 100.0 * rel_half_width);
+   return rel_half_width;
+}
+
+// The partial period at the end of the trace is not measured. As in SMARTS, CPI is what gets averaged over the units,
+// which all have the same number of instructions: the mean of their IPCs would overweight the fast ones.
+template <class P>
+void basic_uarchsim_t<P>::output_sampled()
+{
+   std::vector<double> cpi, mpki, cyc_wp_pki;
+   for (const epoch_row_t& unit : sample_units)
+   {
+      const double insts = (double)unit.insts;
+      cpi.push_back((double)unit.cycles / insts);
+      mpki.push_back(1000.0 * (double)unit.br.conddir_m / insts);
+      cyc_wp_pki.push_back(1000.0 * (double)unit.br.cycles_wp / insts);
+   }
+
+   printf("\n---------------------------------SAMPLED SIMULATION (Measured Units Only, The Rest Functionally Warmed)---------------------------------\n");
+   printf("Sampling: %lu-instruction units every %lu instructions, each after %lu instructions of detailed warmup\n",
+      cfg.SAMPLE_UNIT_INSTS, cfg.SAMPLE_PERIOD_INSTS, cfg.SAMPLE_WARMUP_INSTS);
+   printf("instructions = %lu (%lu simulated in detail, %.2f%%)\n", num_inst, num_detailed_inst, 100.0 * (double)num_detailed_inst / (double)num_inst);
+   printf("units        = %lu\n", sample_units.size());
+   if (sample_units.empty())
+      printf("No unit measured: the trace is shorter than one sampling period\n");
+   else
+   {
+      const double cpi_rel_half_width = print_sample_estimate("CPI", cpi);
+      const double mean_cpi = std::accumulate(cpi.begin(), cpi.end(), 0.0) / (double)cpi.size();
+      printf("IPC          = %.4f (1/CPI, +- %.2f%%)\n", 1.0 / mean_cpi, 100.0 * cpi_rel_half_width);
+      print_sample_estimate("CondMPKI", mpki);
+      print_sample_estimate("CycWPPKI", cyc_wp_pki);
+   }
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+// Each interval of SAMPLE_PERIOD_INSTS instructions is simulated in detail if the one before it was of a phase without
+// a measurement yet: its last SAMPLE_UNIT_INSTS instructions are measured as one epoch, after SAMPLE_WARMUP_INSTS of
+// detailed warmup. Otherwise it is warmed, as one epoch. Either way it is classified at its end, so a change to a new
+// phase is caught one interval late, the interval that showed it standing for the phase until the next one is
+// measured. The first interval is always warmed, so that no phase is measured from cold caches and predictor.
+template <class P>
+void basic_uarchsim_t<P>::step_phased(db_t *inst)
+{
+   if (phase_detailed)
+   {
+      step(inst);
+      num_detailed_inst += inst->is_last_piece;
+   }
+   else
+      warm(inst);
+   if (!inst->is_last_piece)
+      return;
+
+   phase_detector.count(inst->pc, is_br(inst->insn_class));
+   sample_pos++;
+   if (phase_detailed && (sample_pos == cfg.SAMPLE_WARMUP_INSTS))
+      end_current_begin_new_epoch(false/*first_epoch*/, false/*last_epoch*/, previous_fetch_cycle);
+   else if (sample_pos == cfg.SAMPLE_PERIOD_INSTS)
+   {
+      const uint64_t phase = phase_detector.classify(sample_pos);
+      end_current_begin_new_epoch(false/*first_epoch*/, false/*last_epoch*/, previous_fetch_cycle);
+      if (phase_detailed)
+      {
+         sample_units.push_back(BP.epochs().previous());
+         sample_phases.push_back(phase);
+         phase_detector.add_measurement(phase);
+      }
+      sample_pos = 0;
+      const bool was_detailed = phase_detailed;
+      phase_detailed = !phase_detector.is_measured(phase);
+      if (was_detailed && !phase_detailed)
+         drain();
+   }
+}
+
+// A phase stands for all its intervals with the CPI, MPKI and CycWPPKI of its units together; a phase never measured
+// (seen last in the trace, or for a single interval between two others) with those of all the units. The estimates
+// are the means over the phases weighted by their instructions, the partial interval at the end included.
+template <class P>
+void basic_uarchsim_t<P>::output_phased()
+{
+   if (sample_pos > 0)
+      phase_detector.classify(sample_pos);
+   const std::vector<phase_detector_t::phase_t>& phases = phase_detector.get_phases();
+   struct measured_t
+   {
+      double insts = 0.0, cycles = 0.0, conddir_m = 0.0, cycles_wp = 0.0;
+   };
+   std::vector<measured_t> measured(phases.size() + 1);     // the last one: all the units
+   for (size_t u = 0; u < sample_units.size(); u++)
+      for (measured_t *m : {&measured[sample_phases[u]], &measured.back()})
+      {
+         const epoch_row_t& unit = sample_units[u];
+         m->insts += (double)unit.insts;
+         m->cycles += (double)unit.cycles;
+         m->conddir_m += (double)unit.br.conddir_m;
+         m->cycles_wp += (double)unit.br.cycles_wp;
+      }
+
+   printf("\n---------------------------------PHASE-ADAPTIVE SIMULATION (First Intervals of Each Phase Measured, The Rest Functionally Warmed)---------------------------------\n");
+   printf("Phases: %lu-instruction intervals, %lu-instruction units after %lu instructions of detailed warmup, signature distance <= %.2f\n",
+      cfg.SAMPLE_PERIOD_INSTS, cfg.SAMPLE_UNIT_INSTS, cfg.SAMPLE_WARMUP_INSTS, cfg.SAMPLE_PHASE_THRESHOLD);
+   printf("instructions = %lu (%lu simulated in detail, %.2f%%)\n", num_inst, num_detailed_inst, 100.0 * (double)num_detailed_inst / (double)num_inst);
+   uint64_t num_intervals = 0;
+   for (const phase_detector_t::phase_t& p : phases)
+      num_intervals += p.intervals;
+   printf("intervals    = %lu, in %lu phases, %lu units measured\n", num_intervals, phases.size(), sample_units.size());
+   if (sample_units.empty())
+      printf("No unit measured: the trace is shorter than two intervals\n");
+   else
+   {
+      printf("%5s %10s %8s %6s %8s %9s %9s\n", "phase", "intervals", "instrs", "units", "CPI", "CondMPKI", "CycWPPKI");
+      double cycles = 0.0, conddir_m = 0.0, cycles_wp = 0.0;
+      for (size_t p = 0; p < phases.size(); p++)
+      {
+         const measured_t& m = (measured[p].insts > 0.0) ? measured[p] : measured.back();
+         const double insts = (double)phases[p].insts;
+         cycles += insts * m.cycles / m.insts;
+         conddir_m += insts * m.conddir_m / m.insts;
+         cycles_wp += insts * m.cycles_wp / m.insts;
+         printf("%5lu %10lu %7.2f%% %6lu %8.4f %9.4f %9.4f%s\n", p, phases[p].intervals, 100.0 * insts / (double)num_inst, phases[p].measured,
+            m.cycles / m.insts, 1000.0 * m.conddir_m / m.insts, 1000.0 * m.cycles_wp / m.insts, (measured[p].insts > 0.0) ? "" : " (all units)");
+      }
+      printf("CPI          = %.4f\n", cycles / (double)num_inst);
+      printf("IPC          = %.4f\n", (double)num_inst / cycles);
+      printf("CondMPKI     = %.4f\n", 1000.0 * conddir_m / (double)num_inst);
+      printf("CycWPPKI     = %.4f\n", 1000.0 * cycles_wp / (double)num_inst);
+   }
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+
+
+#define KILOBYTE    (1<<10)
+#define MEGABYTE    (1<<20)
+#define SCALED_SIZE(size)   ((size/KILOBYTE >= KILOBYTE) ? (size/MEGABYTE) : (size/KILOBYTE))
+#define SCALED_UNIT(size)   ((size/KILOBYTE >= KILOBYTE) ? "MB" : "KB")
+
+
+template <class P>
+uint64_t basic_uarchsim_t<P>::get_current_fetch_cycle() const {
+    return fetch_cycle;
+}
+
+template <class P>
+conddir_stats_t basic_uarchsim_t<P>::get_conddir_stats(const uint64_t target_instr_count) const {
+    return BP.conddir_stats(target_instr_count);
+}
+
+template <class P>
+uint64_t basic_uarchsim_t<P>::get_epoch_insts() const {
+    return BP.epochs().totals().insts;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::start_in_epoch(const uint64_t num_insts) {
+    CBP_CHECK((BP.epochs().size() == 1) && (BP.epochs().current.insts == 0) && (num_insts < cfg.EPOCH_SIZE_INSTS));
+    BP.epochs().current.insts = num_insts;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::keep_epochs() {
+    BP.epochs().keep();
+}
+
+template <class P>
+epoch_stats_t basic_uarchsim_t<P>::get_epoch_stats(const uint64_t first_epoch, const uint64_t num_epochs) const {
+    return BP.get_epoch_stats(first_epoch, num_epochs);
+}
+
+template <class P>
+void basic_uarchsim_t<P>::output() 
+{
+   end_current_begin_new_epoch(false/*first_epoch*/, true/*last_epoch*/, cycle);
+   time_series.end(cycle, BP.totals());
+   //auto get_track_name = [] (uint64_t track){
+   //   static std::string track_names [] = {
+   //      "ALL",
+   //      "LoadsOnly",
+   //      "LoadsOnlyHitMiss",
+   //   };
+   //   //return track_names[static_cast<std::underlying_type<VPTracks>::type>(t)].c_str();
+   //   return track_names[track].c_str();
+   //};
+   //printf("VP_ENABLE = %d\n", (VP_ENABLE ? 1 : 0));
+   //printf("VP_PERFECT = %s\n", (VP_ENABLE ? (VP_PERFECT ? "1" : "0") : "n/a"));
+   //printf("VP_TRACK = %s\n", (VP_ENABLE ? get_track_name(VP_TRACK) : "n/a"));
+   printf("WINDOW_SIZE = %lu\n", cfg.WINDOW_SIZE);
+   printf("FETCH_WIDTH = %lu\n", cfg.FETCH_WIDTH);
+   printf("FETCH_NUM_BRANCH = %lu\n", cfg.FETCH_NUM_BRANCH);
+   printf("FETCH_STOP_AT_INDIRECT = %s\n", (cfg.FETCH_STOP_AT_INDIRECT ? "1" : "0"));
+   printf("FETCH_STOP_AT_TAKEN = %s\n", (cfg.FETCH_STOP_AT_TAKEN ? "1" : "0"));
+   printf("FETCH_MODEL_ICACHE = %s\n", (cfg.FETCH_MODEL_ICACHE ? "1" : "0"));
+   printf("PERFECT_BRANCH_PRED = %s\n", (cfg.PERFECT_BRANCH_PRED ? "1" : "0"));
+   printf("PERFECT_INDIRECT_PRED = %s\n", (cfg.PERFECT_INDIRECT_PRED ? "1" : "0"));
+   printf("PIPELINE_FILL_LATENCY = %lu\n", cfg.PIPELINE_FILL_LATENCY);
+   printf("NUM_LDST_LANES = %lu%s", cfg.NUM_LDST_LANES, ((cfg.NUM_LDST_LANES > 0) ? "\n" : " (unbounded)\n"));
+   printf("NUM_ALU_LANES = %lu%s", cfg.NUM_ALU_LANES, ((cfg.NUM_ALU_LANES > 0) ? "\n" : " (unbounded)\n"));
+   //BP.output();
+   printf("MEMORY HIERARCHY CONFIGURATION---------------------\n");
+   printf("STRIDE Prefetcher = %s\n", cfg.PREFETCHER_ENABLE ? "1" : "0");
+   printf("PERFECT_CACHE = %s\n", (cfg.PERFECT_CACHE ? "1" : "0"));
+   printf("WRITE_ALLOCATE = %s\n", (cfg.WRITE_ALLOCATE ? "1" : "0"));
+   if (cfg.CACHE_TREE_PLRU)
+      printf("Replacement: tree pseudo-LRU\n");
+   if (cfg.CACHE_SET_SAMPLING > 1)
+      printf("L2$ and L3$ set sampling: 1 in %lu sets\n", cfg.CACHE_SET_SAMPLING);
+   printf("Within-pipeline factors:\n");
+   printf("\tAGEN latency = 1 cycle\n");
+   printf("\tStore Queue (SQ): SQ size = window size, oracle memory disambiguation, store-load forwarding = 1 cycle after store's or load's agen.\n");
+   printf("\t* Note: A store searches the L1$ at commit. The store is released\n");
+   printf("\t* from the SQ and window, whether it hits or misses. Store misses\n");
+   printf("\t* are buffered until the block is allocated and the store is\n");
+   printf("\t* performed in the L1$. While buffered, conflicting loads get\n");
+   printf("\t* the store's data as they would from the SQ.\n");
+   if (cfg.FETCH_MODEL_ICACHE) {
+      printf("I$: %lu %s, %lu-way set-assoc., %luB block size\n",
+         SCALED_SIZE(cfg.IC_SIZE), SCALED_UNIT(cfg.IC_SIZE), cfg.IC_ASSOC, cfg.IC_BLOCKSIZE);
+   }
+   printf("L1$: %lu %s, %lu-way set-assoc., %luB block size, %lu-cycle search latency\n",
+      SCALED_SIZE(cfg.L1_SIZE), SCALED_UNIT(cfg.L1_SIZE), cfg.L1_ASSOC, cfg.L1_BLOCKSIZE, cfg.L1_LATENCY);
+   printf("L2$: %lu %s, %lu-way set-assoc., %luB block size, %lu-cycle search latency\n",
+      SCALED_SIZE(cfg.L2_SIZE), SCALED_UNIT(cfg.L2_SIZE), cfg.L2_ASSOC, cfg.L2_BLOCKSIZE, cfg.L2_LATENCY);
+   printf("L3$: %lu %s, %lu-way set-assoc., %luB block size, %lu-cycle search latency\n",
+      SCALED_SIZE(cfg.L3_SIZE), SCALED_UNIT(cfg.L3_SIZE), cfg.L3_ASSOC, cfg.L3_BLOCKSIZE, cfg.L3_LATENCY);
+   printf("Main Memory: %lu-cycle fixed search time\n", cfg.MAIN_MEMORY_LATENCY);
+   printf("---------------------------STORE QUEUE MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)---------------------------\n");
+   printf("Number of loads: %lu\n", num_load);
+   printf("Number of loads that miss in SQ: %lu (%.2f%%)\n", num_load_sqmiss, 100.0*(double)num_load_sqmiss/(double)num_load);
+   printf("SQ high-water mark: %lu lines of %luB\n", SQ.high_water(), SQ.line_bytes());
+   printf("Number of PFs issued to the memory system %lu\n", stat_pfs_issued_to_mem);
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+   printf("------------------------MEMORY HIERARCHY MEASUREMENTS (Full Simulation i.e. Counts Not Reset When Warmup Ends)-------------------------\n");
+   if (cfg.FETCH_MODEL_ICACHE) {
+      printf("I$:\n"); IC.stats();
+   }
+   printf("L1$:\n"); L1.stats();
+   printf("L2$:\n"); L2.stats();
+   printf("L3$:\n"); L3.stats();
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+   printf("----------------------------------------------Prefetcher (Full Simulation i.e. No Warmup)----------------------------------------------\n");
+   prefetcher.print_stats(L1.prefetch_usage(), L1.demand_misses());
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+   convergence.output();
+   printf("\n-------------------------------ILP LIMIT STUDY (Full Simulation i.e. Counts Not Reset When Warmup Ends)--------------------------------\n");
+   printf("instructions = %lu\n", num_inst);
+   printf("cycles       = %lu\n", cycle);
+   printf("CycWP        = %lu\n", cycles_on_wrong_path);
+   printf("IPC          = %.4f\n", ((double)num_inst/(double)cycle));
+   printf("\n---------------------------------------------------------------------------------------------------------------------------------------\n");
+   output_cpi_stack();
+   // Branch Prediction Measurements
+   BP.output(num_inst);
+   BP.output_periodic_info();
+   if (cfg.PRINT_PER_EPOCH_STATS)
+      output_footprint();
+   phase_timers_report(num_uop, BP.num_branches());
+   checkpoint_stragglers_report();
+}
+
+template <class P>
+typename basic_uarchsim_t<P>::cpi_stack_t basic_uarchsim_t<P>::cpi_totals() const
+{
+   cpi_stack_t totals = cpi_closed;
+   for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+      totals[c] += cpi_current[c];
+   return totals;
+}
+
+template <class P>
+void basic_uarchsim_t<P>::output_cpi_stack() const
+{
+   const cpi_stack_t totals = cpi_totals();
+   const uint64_t total_cycles = std::accumulate(totals.begin(), totals.end(), (uint64_t)0);
+   printf("\n---------------------------------------CPI STACK (Full Simulation i.e. Counts Not Reset When Warmup Ends)--------------------------------------\n");
+   printf("Category         Cycles      CPI   Share\n");
+   for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+      printf("%-8s %14lu %8.4f %6.2f%%\n", cpi_category_names[c], totals[c], (double)totals[c] / (double)num_inst,
+             100.0 * (double)totals[c] / (double)total_cycles);
+   printf("%-8s %14lu %8.4f\n", "total", total_cycles, (double)total_cycles / (double)num_inst);
+   if (cfg.PRINT_PER_EPOCH_STATS)
+   {
+      printf("\nCPI STACK PER EPOCH\n");
+      printf("EPOCH       Instr");
+      for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+         printf(" %8s", cpi_category_names[c]);
+      printf("\n");
+      const uint64_t first_epoch = BP.epochs().first_kept();
+      for (uint64_t epoch_index = first_epoch; epoch_index < BP.epochs().size(); epoch_index++)
+      {
+         const uint64_t insts = BP.epochs().epoch(epoch_index).insts;
+         const cpi_stack_t& stack = (epoch_index - first_epoch < cpi_per_epoch.size()) ? cpi_per_epoch[epoch_index - first_epoch] : cpi_current;
+         printf("%5lu %11lu", epoch_index, insts);
+         for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+            printf(" %8.4f", insts ? (double)stack[c] / (double)insts : 0.0);
+         printf("\n");
+      }
+   }
+   printf("---------------------------------------------------------------------------------------------------------------------------------------\n");
+}
+
+template <class P>
+void basic_uarchsim_t<P>::register_stats(stats_t& st) const
+{
+   st.group("config")
+     .add("window_size", cfg.WINDOW_SIZE)
+     .add("fetch_width", cfg.FETCH_WIDTH)
+     .add("fetch_num_branch", cfg.FETCH_NUM_BRANCH)
+     .add("pipeline_fill_latency", cfg.PIPELINE_FILL_LATENCY)
+     .add("num_ldst_lanes", cfg.NUM_LDST_LANES)
+     .add("num_alu_lanes", cfg.NUM_ALU_LANES)
+     .add("perfect_branch_pred", (uint64_t)cfg.PERFECT_BRANCH_PRED)
+     .add("perfect_indirect_pred", (uint64_t)cfg.PERFECT_INDIRECT_PRED)
+     .add("epoch_size_insts", epoch_size_insts);
+   if (convergence.enabled())
+      st.group("early_stop")
+        .add("truncated", (uint64_t)convergence.converged())
+        .add("stop_instr", convergence.get_stop_inst());
+   st.group("core")
+     .add("instr", num_inst)
+     .add("uops", num_uop)
+     .add("cycles", cycle)
+     .add("ipc", (double)num_inst/(double)cycle)
+     .add("cycles_wp", cycles_on_wrong_path)
+     .add("loads", num_load)
+     .add("loads_sq_miss", num_load_sqmiss)
+     .add("sq_high_water_lines", SQ.high_water())
+     .add("pfs_issued_to_mem", stat_pfs_issued_to_mem);
+   const cpi_stack_t totals = cpi_totals();
+   st.group("cpi_stack");
+   for (unsigned c = 0; c < NUM_CPI_CATEGORIES; c++)
+   {
+      st.add(cpi_category_names[c], totals[c]);
+      if (!BP.epochs().kept())
+         continue;
+      std::vector<uint64_t> per_epoch;
+      for (const cpi_stack_t& epoch : cpi_per_epoch)
+         per_epoch.push_back(epoch[c]);
+      per_epoch.push_back(cpi_current[c]);
+      st.add(std::string(cpi_category_names[c]) + "_per_epoch", per_epoch);
+   }
+   if (cfg.FETCH_MODEL_ICACHE)
+      IC.register_stats(st, "IC");
+   L1.register_stats(st, "L1");
+   L2.register_stats(st, "L2");
+   L3.register_stats(st, "L3");
+   data_caches.register_stats(st, "loads");
+   prefetcher.register_stats(st, L1.prefetch_usage(), L1.demand_misses());
+   BP.register_stats(st);
+}
+
+#undef MAX
+#undef MIN
+#undef KILOBYTE
+#undef MEGABYTE
+#undef SCALED_SIZE
+#undef SCALED_UNIT
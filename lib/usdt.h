@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+// USDT static probes (provider "cbp"), for bpftrace, perf, SystemTap or gdb to attach to a running cbp without a
+// rebuild, e.g. the host time of the predictor lookups:
+//
+//   bpftrace -e 'usdt:./cbp:cbp:predict { @t[tid] = nsecs; }
+//                usdt:./cbp:cbp:predict_done /@t[tid]/ { @ns = hist(nsecs - @t[tid]); delete(@t[tid]); }' -c './cbp ...'
+//
+// CBP_PROBEn(name, a1, ..., an) marks a probe point with n arguments, each passed as a 64-bit unsigned value. The probe
+// is a nop in the code and an ELF note (.note.stapsdt) telling the tracer its address and where each argument is, the
+// format of the probes of <sys/sdt.h>, which is written out here so that the build needs no systemtap headers. Not
+// attached, a probe costs the nop and keeping its arguments in registers or on the stack at that point. The tracer
+// attaches by replacing the nop with a breakpoint.
+//
+// The probes, with their arguments:
+//
+//   predict, predict_done       seq_no, piece, pc (and the predicted direction at predict_done), around the lookup
+//   spec_update, spec_update_done
+//                               seq_no, piece, pc, inst_class, resolve_dir, pred_dir, around the update
+//   resolve, resolve_done       seq_no, piece, pc, pred_dir, cycle, around notify_instr_execute_resolve
+//   mispredict                  seq_no, piece, pc, inst_class, next_pc of a branch bp_t::predict mispredicts
+//   cache_miss                  cache (its address), latency (of the level), addr, cycle, pf (a prefetch)
+//   epoch                       epoch, instructions, cycles, conditional branches, their mispredictions, at its end
+//
+// x86-64 ELF only, and left out with make USDT=0 (CBP_NO_USDT): elsewhere the probes compile to nothing.
+
+#if defined(__x86_64__) && defined(__ELF__) && !defined(CBP_NO_USDT)
+
+#define CBP_USDT_ARG(n) "8@%[a" #n "]"
+#define CBP_USDT_OP(n, v) [a##n] "nor"((uint64_t)(v))
+
+#define CBP_PROBE_(name, args, ...)                                                                                    \
+    __asm__ __volatile__("990: nop\n"                                                                                  \
+                         ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                                 \
+                         ".balign 4\n"                                                                                 \
+                         ".4byte 992f-991f, 994f-993f, 3\n"                                                            \
+                         "991: .asciz \"stapsdt\"\n"                                                                   \
+                         "992: .balign 4\n"                                                                            \
+                         "993: .8byte 990b\n"                                                                          \
+                         ".8byte _.stapsdt.base\n"                                                                     \
+                         ".8byte 0\n"                                                                                  \
+                         ".asciz \"cbp\"\n"                                                                            \
+                         ".asciz \"" #name "\"\n"                                                                      \
+                         ".asciz \"" args "\"\n"                                                                       \
+                         "994: .balign 4\n"                                                                            \
+                         ".popsection\n"                                                                               \
+                         ".ifndef _.stapsdt.base\n"                                                                    \
+                         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                       \
+                         ".weak _.stapsdt.base\n"                                                                      \
+                         ".hidden _.stapsdt.base\n"                                                                    \
+                         "_.stapsdt.base: .space 1\n"                                                                  \
+                         ".size _.stapsdt.base, 1\n"                                                                   \
+                         ".popsection\n"                                                                               \
+                         ".endif\n"                                                                                    \
+                         :: __VA_ARGS__)
+
+#define CBP_PROBE3(name, a1, a2, a3)                                                                                   \
+    CBP_PROBE_(name, CBP_USDT_ARG(1) " " CBP_USDT_ARG(2) " " CBP_USDT_ARG(3),                                          \
+               CBP_USDT_OP(1, a1), CBP_USDT_OP(2, a2), CBP_USDT_OP(3, a3))
+#define CBP_PROBE4(name, a1, a2, a3, a4)                                                                               \
+    CBP_PROBE_(name, CBP_USDT_ARG(1) " " CBP_USDT_ARG(2) " " CBP_USDT_ARG(3) " " CBP_USDT_ARG(4),                      \
+               CBP_USDT_OP(1, a1), CBP_USDT_OP(2, a2), CBP_USDT_OP(3, a3), CBP_USDT_OP(4, a4))
+#define CBP_PROBE5(name, a1, a2, a3, a4, a5)                                                                           \
+    CBP_PROBE_(name, CBP_USDT_ARG(1) " " CBP_USDT_ARG(2) " " CBP_USDT_ARG(3) " " CBP_USDT_ARG(4) " " CBP_USDT_ARG(5),  \
+               CBP_USDT_OP(1, a1), CBP_USDT_OP(2, a2), CBP_USDT_OP(3, a3), CBP_USDT_OP(4, a4), CBP_USDT_OP(5, a5))
+#define CBP_PROBE6(name, a1, a2, a3, a4, a5, a6)                                                                       \
+    CBP_PROBE_(name, CBP_USDT_ARG(1) " " CBP_USDT_ARG(2) " " CBP_USDT_ARG(3) " " CBP_USDT_ARG(4) " " CBP_USDT_ARG(5)   \
+               " " CBP_USDT_ARG(6),                                                                                    \
+               CBP_USDT_OP(1, a1), CBP_USDT_OP(2, a2), CBP_USDT_OP(3, a3), CBP_USDT_OP(4, a4), CBP_USDT_OP(5, a5),     \
+               CBP_USDT_OP(6, a6))
+
+#else
+
+#define CBP_PROBE3(name, a1, a2, a3) ((void)0)
+#define CBP_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#define CBP_PROBE5(name, a1, a2, a3, a4, a5) ((void)0)
+#define CBP_PROBE6(name, a1, a2, a3, a4, a5, a6) ((void)0)
+
+#endif
@@ -148,3 +148,13 @@ void beginPredictor(int argc_other, char **argv_other);
 //
 extern
 void endPredictor();
+
+//
+// The simulator only calls the value predictor in builds with it (make clean && make VALUE_PREDICTION=1), which link
+// my_value_predictor.cc. In CBP builds its calls are compiled out of the timing model, and VP_ENABLE is rejected.
+//
+#ifdef CBP_VALUE_PREDICTION
+constexpr bool VALUE_PREDICTION = true;
+#else
+constexpr bool VALUE_PREDICTION = false;
+#endif
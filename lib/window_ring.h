@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "invariant.h"
+#include "snapshot.h"
+
+// Instruction window as a power-of-two ring directly indexed by sequence number.
+//
+// Window entries always carry consecutive sequence numbers (one per micro-op), so the entry for seq_no lives in slot
+// (seq_no & mask) and lookups are O(1). Slots are reused in place rather than reconstructed, so members owning heap
+// storage (e.g. the DecodeInfo source register vector) recycle their capacity.
+template <class T>
+class window_ring_t
+{
+    private:
+        std::vector<T> slots;
+        uint64_t mask;
+        uint64_t head_seq;  // seq_no of front()
+        uint64_t count;
+
+    public:
+        window_ring_t(uint64_t capacity)
+        : head_seq(0), count(0)
+        {
+            uint64_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        // Empty again, the slots keeping their storage.
+        void clear()
+        {
+            head_seq = 0;
+            count = 0;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        uint64_t size() const
+        {
+            return count;
+        }
+
+        T& front() { assert(count); return slots[head_seq & mask]; }
+        const T& front() const { assert(count); return slots[head_seq & mask]; }
+        T& back() { assert(count); return slots[(head_seq + count - 1) & mask]; }
+        const T& back() const { assert(count); return slots[(head_seq + count - 1) & mask]; }
+
+        // Claims the slot for seq_no, which must directly follow back(), and returns it for the caller to fill.
+        T& push_back(uint64_t seq_no)
+        {
+            CBP_CHECK(count < slots.size());
+            if (count == 0)
+                head_seq = seq_no;
+            CBP_CHECK(seq_no == head_seq + count);
+            count++;
+            return slots[seq_no & mask];
+        }
+
+        void pop_front()
+        {
+            assert(count);
+            head_seq++;
+            count--;
+        }
+
+        void snapshot(snapshot_t& s)
+        {
+            s.check(slots.size(), "window size");
+            s.io(slots);
+            s.io(head_seq);
+            s.io(count);
+        }
+
+        const T& at(uint64_t seq_no) const
+        {
+            CBP_CHECK(seq_no - head_seq < count);
+            return slots[seq_no & mask];
+        }
+};
@@ -2,6 +2,8 @@
 #define _PREDICTOR_H_
 
 #include <stdlib.h>
+#include "lib/checkpoint_ring.h"
+#include "cbp_global_history.h"
 
 struct SampleHist
 {
@@ -17,11 +19,14 @@ struct SampleHist
 
 class SampleCondPredictor
 {
+        // the global histories and folded views are shared with the other predictors
+        const cbp_global_history_t& global_hist;
         SampleHist active_hist;
-        std::unordered_map<uint64_t/*key*/, SampleHist/*val*/> pred_time_histories;
+        checkpoint_ring_t<SampleHist> pred_time_histories;
     public:
 
-        SampleCondPredictor (void)
+        SampleCondPredictor (cbp_global_history_t& shared_hist)
+        : global_hist(shared_hist)
         {
         }
 
@@ -33,6 +38,25 @@ class SampleCondPredictor
         {
         }
 
+        // the shared global history is saved by the caller
+        void snapshot(snapshot_t& s)
+        {
+            s.io(active_hist);
+            s.io(pred_time_histories);
+        }
+
+        // the state without the checkpoints in flight, for the lockstep validation (-l)
+        void dump(snapshot_t& s)
+        {
+            s.io(active_hist);
+        }
+
+        // inference only (-e): there are no tables to keep, only the checkpoints of the run the snapshot is of to drop
+        void freeze()
+        {
+            pred_time_histories.clear();
+        }
+
         // sample function to get unique instruction id
         uint64_t get_unique_inst_id(uint64_t seq_no, uint8_t piece) const
         {
@@ -42,9 +66,10 @@ class SampleCondPredictor
 
         bool predict (uint64_t seq_no, uint8_t piece, uint64_t PC, const bool tage_pred)
         {
+            active_hist.ghist = global_hist.dirhist;
             active_hist.tage_pred = tage_pred;
             // checkpoint current hist
-            pred_time_histories.emplace(get_unique_inst_id(seq_no, piece), active_hist);
+            pred_time_histories.emplace(seq_no, piece) = active_hist;
             const bool pred_taken = predict_using_given_hist(seq_no, piece, PC, active_hist, true/*pred_time_predict*/);
             return pred_taken;
         }
@@ -55,21 +80,16 @@ class SampleCondPredictor
         }
 
         // AKA: speculative update
+        // global_hist is advanced by its owner, this only has to update the predictor's own histories
         void history_update (uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC)
         {
-            active_hist.ghist = active_hist.ghist << 1;
-            if(taken)
-            {
-                active_hist.ghist |= 1;
-            }
         }
 
         void update (uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC)
         {
-            const auto pred_hist_key = get_unique_inst_id(seq_no, piece);
-            const auto& pred_time_history = pred_time_histories.at(pred_hist_key);
+            const auto& pred_time_history = pred_time_histories.at(seq_no, piece);
             update(PC, resolveDir, predDir, nextPC, pred_time_history);
-            pred_time_histories.erase(pred_hist_key);
+            pred_time_histories.erase(seq_no, piece);
         }
 
         void update (uint64_t PC, bool resolveDir, bool pred_taken, uint64_t nextPC, const SampleHist& hist_to_use)
@@ -81,4 +101,4 @@ class SampleCondPredictor
 // =================
 
 #endif
-static SampleCondPredictor cond_predictor_impl;
+static SampleCondPredictor cond_predictor_impl(cbp_global_history);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include "lib/simd_dispatch.h"
+
+// Building blocks for perceptron predictors.
+//
+// Weights live in a fixed table of contiguous int8 rows selected by a hash of the PC, and inputs are encoded as +1/-1
+// int8 values rather than bits, so the dot product and the saturating training are plain loops over int8 arrays,
+// which the compiler turns into SIMD code, for AVX-512, AVX2 and the baseline of the build picked at startup
+// (lib/simd_dispatch.h), or NEON.
+
+// ROWS rows of NFEAT signed weights of WBITS bits each.
+template <int ROWS, int NFEAT, int WBITS = 8>
+class perceptron_table_t
+{
+    static_assert((ROWS & (ROWS - 1)) == 0, "the number of rows must be a power of two");
+    static_assert(WBITS >= 2 && WBITS <= 8, "weights are stored as int8");
+
+    private:
+        std::array<std::array<int8_t, NFEAT>, ROWS> W = {};
+
+    public:
+        static constexpr int WEIGHT_MAX = (1 << (WBITS - 1)) - 1;
+        static constexpr int WEIGHT_MIN = -(1 << (WBITS - 1));
+        static constexpr size_t SIZE_BITS = (size_t) ROWS * NFEAT * WBITS;
+
+        int8_t * row(uint64_t hash)
+        {
+            return W[hash & (ROWS - 1)].data();
+        }
+
+        const int8_t * row(uint64_t hash) const
+        {
+            return W[hash & (ROWS - 1)].data();
+        }
+
+        // sum of w[i] * x[i] over n weights
+        CBP_SIMD_KERNEL static int dot(const int8_t * w, const int8_t * x, int n)
+        {
+            int sum = 0;
+            for (int i = 0; i < n; i++)
+                sum += w[i] * x[i];
+            return sum;
+        }
+
+        // w[i] += step * x[i], saturated to WBITS bits; step is the signed learning rate
+        CBP_SIMD_KERNEL static void train(int8_t * w, const int8_t * x, int n, int step)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                int v = w[i] + step * x[i];
+                v = (v > WEIGHT_MAX) ? WEIGHT_MAX : v;
+                v = (v < WEIGHT_MIN) ? WEIGHT_MIN : v;
+                w[i] = (int8_t) v;
+            }
+        }
+};
+
+// Global history of N outcomes as +1 (taken) / -1 (not taken) inputs, the newest at index 0.
+// Starts all not taken, as a cleared history register would.
+template <int N>
+class pm1_history_t
+{
+    private:
+        std::array<int8_t, N> x;
+
+    public:
+        pm1_history_t()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            x.fill(-1);
+        }
+
+        void push(bool taken)
+        {
+            memmove(x.data() + 1, x.data(), N - 1);
+            x[0] = taken ? 1 : -1;
+        }
+
+        // overwrites the outcome shifted in age pushes ago
+        void set(int age, bool taken)
+        {
+            x[age] = taken ? 1 : -1;
+        }
+
+        const int8_t * data() const
+        {
+            return x.data();
+        }
+};
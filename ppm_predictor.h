@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "lib/huge_arena.h"
+
+// PPM limit-study engine: how well conditional branches can be predicted from their PC and any length of global
+// history, up to max_history outcomes, with no table geometry in the way.
+//
+// Each PC has a trie of the global histories its branch was seen with, newest outcome first: a node is a context
+// (PC, h[0..depth)) and counts the outcomes seen in it. A branch is predicted by the deepest context of its path whose
+// counter is not weak, falling back to shallower ones as PPM does, and then updated at once with its outcome (it is
+// a limit study: no delay, no wrong path), every context of the path counting it.
+//
+// The trie is path-compressed: a node carries the label of up to LABEL_MAX history bits leading to it from its
+// parent, the contexts along it having only ever been seen together, with the same counts. A new context first gets
+// a single leaf reaching LABEL_MAX bits deeper than where it left the trie, and grows by another leaf each time it is
+// seen again, so that a path only reaches max_history once its contexts recur, and an update adds at most two nodes.
+//
+// Nodes are 20 bytes, from an array of the arena (huge_arena.h) sized by the memory budget. When it is full, the least
+// recently used quarter of the nodes is pruned: a node is used whenever a descendant is, so the pruned nodes are
+// whole subtrees, cut off from their parents. The roots of the PCs are never pruned.
+class ppm_predictor_t
+{
+    private:
+        static constexpr int LABEL_MAX = 24;
+        static constexpr uint32_t NONE = 0;     // node 0 is never handed out
+
+        struct node_t
+        {
+            uint32_t child[2];      // by the history bit after the context; the free list through child[0]
+            uint32_t label;         // bit j: h[depth of the parent + 1 + j]
+            uint32_t last_use;      // update count of the last visit
+            uint8_t len;            // of the label
+            int8_t ctr;             // 3-bit signed counter, >= 0 for taken
+            uint8_t visits;         // saturating
+            uint8_t unused;
+        };
+
+        // The descent of the last prediction, kept for its update.
+        struct step_t
+        {
+            uint32_t node;
+            int depth;              // of the context of node
+        };
+
+        const int max_history;
+        node_t * nodes = nullptr;
+        uint32_t capacity = 0;
+        uint32_t next_node = 1;
+        uint32_t free_list = NONE;
+        uint32_t num_free = 0;
+        uint64_t num_prunes = 0;
+        uint64_t num_pruned = 0;
+        uint32_t clock = 0;
+
+        // PC -> root, open addressing, never shrunk.
+        std::vector<std::pair<uint64_t, uint32_t>> roots;
+        uint64_t num_roots = 0;
+
+        // Global history, newest outcome at bit pos of the ring, older ones at pos + 1, pos + 2...
+        std::vector<uint64_t> ring;
+        uint64_t ring_mask = 0;     // in bits
+        uint64_t pos = 0;
+
+        // The last prediction.
+        std::vector<step_t> path;
+        uint64_t path_pc = 0;
+        bool path_valid = false;
+        // Where the descent left the trie: from the last step, the child it would take (NONE if none) and the number
+        // of bits of its label that matched.
+        uint32_t stop_child = NONE;
+        int stop_match = 0;
+
+        // len <= LABEL_MAX bits of history from age, bit j being h[age + j].
+        uint32_t history_bits(int age, int len) const
+        {
+            if (len == 0)
+                return 0;
+            const uint64_t bit = (pos + age) & ring_mask;
+            const uint64_t w = bit >> 6, s = bit & 63;
+            uint64_t v = ring[w] >> s;
+            if (s != 0)
+                v |= ring[(w + 1) & (ring.size() - 1)] << (64 - s);
+            return (uint32_t) v & ((1u << len) - 1);
+        }
+
+        bool history_bit(int age) const
+        {
+            const uint64_t bit = (pos + age) & ring_mask;
+            return (ring[bit >> 6] >> (bit & 63)) & 1;
+        }
+
+        uint32_t new_node()
+        {
+            if ((free_list == NONE) && (next_node == capacity))
+                prune();
+            uint32_t n;
+            if (free_list != NONE)
+            {
+                n = free_list;
+                free_list = nodes[n].child[0];
+                num_free--;
+            }
+            else
+                n = next_node++;
+            nodes[n] = node_t();
+            nodes[n].last_use = clock;
+            return n;
+        }
+
+        void free_subtree(uint32_t n)
+        {
+            std::vector<uint32_t> stack = {n};
+            while (!stack.empty())
+            {
+                const uint32_t m = stack.back();
+                stack.pop_back();
+                for (uint32_t c : nodes[m].child)
+                    if (c != NONE)
+                        stack.push_back(c);
+                nodes[m].child[0] = free_list;
+                free_list = m;
+                num_free++;
+                num_pruned++;
+            }
+        }
+
+        // Frees the least recently used quarter of the nodes, at least.
+        void prune()
+        {
+            num_prunes++;
+            uint32_t oldest = clock;
+            for (uint32_t n = 1; n < next_node; n++)
+                oldest = std::min(oldest, nodes[n].last_use);
+            // last_use of the nodes in use, in 1024 buckets from the oldest
+            const uint64_t span = (uint64_t) clock - oldest + 1;
+            std::vector<uint64_t> hist(1024, 0);
+            for (uint32_t n = 1; n < next_node; n++)
+                hist[((uint64_t) (nodes[n].last_use - oldest) * 1024) / span]++;
+            uint64_t count = 0, bucket = 0;
+            while ((bucket < 1023) && ((count += hist[bucket]) < (next_node - num_free) / 4))
+                bucket++;
+            // the nodes of the branch being updated are of this clock, and stay
+            const uint32_t cutoff = (uint32_t) std::min<uint64_t>(oldest + ((bucket + 1) * span + 1023) / 1024, clock);
+
+            for (const std::pair<uint64_t, uint32_t>& root : roots)
+            {
+                if (root.second == NONE)
+                    continue;
+                std::vector<uint32_t> stack = {root.second};
+                while (!stack.empty())
+                {
+                    node_t& node = nodes[stack.back()];
+                    stack.pop_back();
+                    for (uint32_t& c : node.child)
+                    {
+                        if (c == NONE)
+                            continue;
+                        if (nodes[c].last_use < cutoff)
+                        {
+                            free_subtree(c);
+                            c = NONE;
+                        }
+                        else
+                            stack.push_back(c);
+                    }
+                }
+            }
+            if (free_list == NONE)
+            {
+                fprintf(stderr, "The PPM memory budget is too small for the roots of the branches\n");
+                exit(1);
+            }
+        }
+
+        uint32_t& root_slot(uint64_t pc)
+        {
+            if (2 * (num_roots + 1) > roots.size())
+            {
+                std::vector<std::pair<uint64_t, uint32_t>> old(roots.size() ? 2 * roots.size() : 1024, {0, NONE});
+                old.swap(roots);
+                num_roots = 0;
+                for (const std::pair<uint64_t, uint32_t>& r : old)
+                    if (r.second != NONE)
+                    {
+                        root_slot(r.first) = r.second;
+                        num_roots++;
+                    }
+            }
+            const uint64_t mask = roots.size() - 1;
+            for (uint64_t i = (pc * 0x9E3779B97F4A7C15ull) >> 40;; i++)
+            {
+                std::pair<uint64_t, uint32_t>& r = roots[i & mask];
+                if ((r.second == NONE) || (r.first == pc))
+                {
+                    r.first = pc;
+                    return r.second;
+                }
+            }
+        }
+
+        static void count(node_t& node, bool taken)
+        {
+            if (taken && (node.ctr < 3))
+                node.ctr++;
+            else if (!taken && (node.ctr > -4))
+                node.ctr--;
+            if (node.visits < 255)
+                node.visits++;
+        }
+
+        // A leaf below the context of depth, reached by history bit depth: the rest of the label from there.
+        uint32_t new_leaf(int depth, bool taken)
+        {
+            const uint32_t n = new_node();
+            nodes[n].len = (uint8_t) std::min(LABEL_MAX, max_history - depth - 1);
+            nodes[n].label = history_bits(depth + 1, nodes[n].len);
+            nodes[n].ctr = taken ? 0 : -1;
+            nodes[n].visits = 1;
+            return n;
+        }
+
+    public:
+        // budget_bytes of nodes; max_history outcomes of context at most.
+        ppm_predictor_t(uint64_t budget_bytes, int _max_history)
+        : max_history(_max_history)
+        {
+            capacity = (uint32_t) std::min<uint64_t>(budget_bytes / sizeof(node_t), UINT32_MAX);
+            if (capacity < 2)
+            {
+                fprintf(stderr, "The PPM memory budget holds no node\n");
+                exit(1);
+            }
+            nodes = huge_new_zeroed_array<node_t>(capacity);
+            uint64_t bits = 64;
+            while (bits < (uint64_t) max_history + 2 * 64)
+                bits *= 2;
+            ring.assign(bits / 64, 0);
+            ring_mask = bits - 1;
+            path.reserve(max_history + 1);
+        }
+
+        ppm_predictor_t(const ppm_predictor_t&) = delete;
+        ppm_predictor_t& operator=(const ppm_predictor_t&) = delete;
+
+        ~ppm_predictor_t()
+        {
+            huge_delete_array(nodes, capacity);
+        }
+
+        // Starts loading the root slot of pc, the first thing predict(pc) reads.
+        void prefetch(uint64_t pc) const
+        {
+            if (roots.empty())
+                return;
+            const std::pair<uint64_t, uint32_t>& r = roots[((pc * 0x9E3779B97F4A7C15ull) >> 40) & (roots.size() - 1)];
+            __builtin_prefetch(&r);
+        }
+
+        bool predict(uint64_t pc)
+        {
+            path.clear();
+            path_pc = pc;
+            path_valid = true;
+            stop_child = NONE;
+            stop_match = 0;
+            const uint32_t root = root_slot(pc);
+            if (root == NONE)
+                return false;
+            uint32_t n = root;
+            int depth = 0;
+            path.push_back({n, 0});
+            while (depth < max_history)
+            {
+                const uint32_t c = nodes[n].child[history_bit(depth)];
+                if (c == NONE)
+                    break;
+                const node_t& child = nodes[c];
+                const uint32_t diff = child.label ^ history_bits(depth + 1, child.len);
+                if (diff != 0)
+                {
+                    // inside the label: the contexts along it count as the child does
+                    stop_child = c;
+                    stop_match = __builtin_ctz(diff);
+                    break;
+                }
+                n = c;
+                depth += 1 + child.len;
+                path.push_back({n, depth});
+            }
+
+            // the deepest context with a counter that is not weak, else the deepest one
+            const node_t * pick = (stop_child != NONE) ? &nodes[stop_child] : &nodes[path.back().node];
+            if ((pick->ctr == 0) || (pick->ctr == -1))
+                for (size_t i = path.size(); i-- > 0;)
+                {
+                    const node_t& node = nodes[path[i].node];
+                    if ((node.ctr != 0) && (node.ctr != -1))
+                    {
+                        pick = &node;
+                        break;
+                    }
+                }
+            return pick->ctr >= 0;
+        }
+
+        // Counts taken in the contexts of the last predict() of pc, and grows its path.
+        void update(uint64_t pc, bool taken)
+        {
+            clock++;
+            if (!path_valid || (path_pc != pc))
+                predict(pc);
+            path_valid = false;
+
+            if (path.empty())
+            {
+                const uint32_t root = new_node();
+                count(nodes[root], taken);
+                root_slot(pc) = root;
+                num_roots++;
+                return;
+            }
+            for (const step_t& step : path)
+            {
+                count(nodes[step.node], taken);
+                nodes[step.node].last_use = clock;
+            }
+            const step_t& last = path.back();
+            if (last.depth >= max_history)
+                return;
+            const bool bit = history_bit(last.depth);
+            if (stop_child == NONE)
+            {
+                const uint32_t leaf = new_leaf(last.depth, taken);
+                nodes[last.node].child[bit] = leaf;
+                return;
+            }
+
+            // split the label of stop_child where the history leaves it
+            nodes[stop_child].last_use = clock;
+            const uint32_t split = new_node();
+            node_t& child = nodes[stop_child];
+            node_t& mid = nodes[split];
+            mid.len = (uint8_t) stop_match;
+            mid.label = child.label & ((1u << stop_match) - 1);
+            mid.ctr = child.ctr;
+            mid.visits = child.visits;
+            count(mid, taken);
+            const bool child_bit = (child.label >> stop_match) & 1;
+            mid.child[child_bit] = stop_child;
+            child.len -= stop_match + 1;
+            child.label = (child.len == 0) ? 0 : (child.label >> (stop_match + 1));
+            nodes[last.node].child[bit] = split;
+            const int mid_depth = last.depth + 1 + stop_match;
+            const uint32_t leaf = new_leaf(mid_depth, taken);
+            nodes[split].child[!child_bit] = leaf;
+        }
+
+        // Shifts the outcome of a conditional branch into the global history.
+        void push_history(bool taken)
+        {
+            pos = (pos - 1) & ring_mask;
+            uint64_t& w = ring[pos >> 6];
+            const uint64_t m = uint64_t(1) << (pos & 63);
+            w = taken ? (w | m) : (w & ~m);
+        }
+
+        uint64_t nodes_in_use() const { return next_node - 1 - num_free; }
+        uint64_t node_capacity() const { return capacity - 1; }
+        uint64_t prunes() const { return num_prunes; }
+        uint64_t pruned() const { return num_pruned; }
+        uint64_t branches() const { return num_roots; }
+        static constexpr size_t NODE_BYTES = sizeof(node_t);
+};
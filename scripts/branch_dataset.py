@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+# Reads a branch outcome dataset (cbp -x, lib/branch_dataset.h) into numpy arrays, one per column: prints a summary of
+# the branches, and with --npz saves the columns for training, the history unpacked to one 0/1 column per bit
+# (history[:, 0] the newest outcome) with --unpack. As a module, load() returns the columns.
+#
+# python3 scripts/branch_dataset.py dataset.bin
+# python3 scripts/branch_dataset.py dataset.bin --npz dataset.npz --unpack
+
+import argparse
+import struct
+import sys
+
+import numpy as np
+
+HEADER = struct.Struct('<8sIIQQ')
+COLUMN = struct.Struct('<24sQ')
+PROVIDER_NAMES = ['Bimodal', 'Tage', 'Alt', 'Loop', 'SC', 'Filter']
+DTYPES = {'pc': np.uint64}
+
+
+def load(path, unpack=False):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, num_columns, history_bits, block_rows, num_rows = HEADER.unpack_from(data)
+    if magic.rstrip(b'\0') != b'CBPDSET':
+        sys.exit(f'{path} is not a branch dataset')
+    if num_rows == 0:
+        sys.exit(f'{path} was not completed (the simulation did not end)')
+    offset = HEADER.size
+    columns = []
+    for _ in range(num_columns):
+        name, width = COLUMN.unpack_from(data, offset)
+        columns.append((name.rstrip(b'\0').decode(), width))
+        offset += COLUMN.size
+
+    parts = {name: [] for name, _ in columns}
+    while offset < len(data):
+        (rows,) = struct.unpack_from('<Q', data, offset)
+        offset += 8
+        for name, width in columns:
+            values = np.frombuffer(data, np.uint8, rows * width, offset)
+            offset += rows * width
+            if name in DTYPES:
+                parts[name].append(values.view(DTYPES[name]))
+            else:
+                parts[name].append(values.reshape(rows, width) if width > 1 else values)
+    arrays = {name: np.concatenate(chunks) for name, chunks in parts.items()}
+    if len(arrays['pc']) != num_rows:
+        sys.exit(f'{path}: {len(arrays["pc"])} rows read, {num_rows} expected')
+    if unpack:
+        arrays['history'] = np.unpackbits(arrays['history'], axis=1, bitorder='little')[:, :history_bits]
+    return arrays, history_bits
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('dataset', help='branch dataset written by cbp -x')
+    parser.add_argument('--npz', help='save the columns to this .npz file')
+    parser.add_argument('--unpack', help='one column of the history per bit', action='store_true')
+    args = parser.parse_args()
+
+    arrays, history_bits = load(args.dataset, args.unpack)
+    n = len(arrays['pc'])
+    mispredicted = arrays['taken'] != arrays['predicted']
+    print(f'{n} conditional branches, {len(np.unique(arrays["pc"]))} static, {history_bits} bits of history')
+    print(f'Taken {arrays["taken"].mean() * 100:.2f}%, mispredicted {mispredicted.mean() * 100:.3f}%')
+    for p, name in enumerate(PROVIDER_NAMES):
+        provided = arrays['provider'] == p
+        if provided.any():
+            print(f'{name:<8} {provided.sum():>12} provided, {mispredicted[provided].sum():>10} mispredicted')
+    if args.npz:
+        np.savez(args.npz, **arrays)
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# Reads a predictor event trace (cbp -V, lib/event_trace.h): prints a summary of the events by type, and with --dump
+# the records themselves, one per line, optionally only those of the branches at --pc.
+#
+# python3 scripts/event_trace.py events.bin
+# python3 scripts/event_trace.py events.bin --dump --pc 0x401a2c
+
+import argparse
+import collections
+import struct
+import sys
+
+HEADER = struct.Struct('<8sIIQ')
+RECORD = struct.Struct('<QQBBBBiiI')
+EVENT_NAMES = ['Provider', 'SCOverride', 'LoopHit', 'Alloc', 'UReset']
+PROVIDER_NAMES = ['Bimodal', 'Tage', 'Alt', 'Loop', 'SC', 'Filter']
+
+parser = argparse.ArgumentParser()
+parser.add_argument('trace', help='event trace written by cbp -V')
+parser.add_argument('--dump', help='print every record', action='store_true')
+parser.add_argument('--pc', help='only the records of this branch PC', type=lambda x: int(x, 0))
+args = parser.parse_args()
+
+with open(args.trace, 'rb') as f:
+    magic, record_size, event_mask, one_in_n = HEADER.unpack(f.read(HEADER.size))
+    if magic.rstrip(b'\0') != b'CBPEVT1' or record_size != RECORD.size:
+        sys.exit(f'{args.trace} is not an event trace of this version')
+    data = f.read()
+
+traced = [name for e, name in enumerate(EVENT_NAMES) if (event_mask >> e) & 1]
+print(f'Events traced: {", ".join(traced)}; 1 in {one_in_n} branches')
+
+counts = collections.Counter()
+providers = collections.Counter()
+alloc_banks = collections.Counter()
+branches = set()
+for seq_no, pc, kind, piece, bank, flags, arg0, arg1, _ in RECORD.iter_unpack(data[:len(data) - len(data) % RECORD.size]):
+    if args.pc is not None and pc != args.pc:
+        continue
+    name = EVENT_NAMES[kind] if kind < len(EVENT_NAMES) else f'Event{kind}'
+    counts[name] += 1
+    branches.add((seq_no, piece))
+    if name == 'Provider':
+        providers[PROVIDER_NAMES[flags] if flags < len(PROVIDER_NAMES) else flags] += 1
+    elif name == 'Alloc':
+        alloc_banks[bank] += 1
+    if args.dump:
+        print(f'{seq_no:>12} {piece} 0x{pc:x} {name:<10} bank={bank} flags={flags} arg0={arg0} arg1={arg1}')
+
+print(f'{len(branches)} branches traced')
+for name in EVENT_NAMES:
+    if counts[name]:
+        print(f'{name:<10} {counts[name]:>12}')
+if providers:
+    print('Providers: ' + ', '.join(f'{p} {n}' for p, n in providers.most_common()))
+if alloc_banks:
+    print('Allocations by bank: ' + ', '.join(f'{b}:{n}' for b, n in sorted(alloc_banks.items())))
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# Performance regression check: simulates a subset of the traces in batch mode (cbp -B), checks that the simulated
+# counts match a reference csv exactly, and reports the speedup of ExecTime against a baseline csv.
+#
+# Both csvs are in the format of trace_exec_training_list.py (and of cbp -B), matched on the Run column. The reference
+# defaults to reference_results_training_set.csv and the baseline to the reference. A run saved with --save_baseline
+# can serve as either for later runs, e.g. for traces that are not in the reference.
+# Any failed trace, trace missing from the reference, or count differing from it fails the check (exit status 1).
+#
+# python3 scripts/perf_regression.py --trace_dir traces/ --traces int_0_trace,fp_3_trace --jobs 1
+# python3 scripts/perf_regression.py --trace_dir sample_traces/ --reference sample_ref.csv --save_baseline sample_ref.csv
+
+import argparse
+import csv
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+# Simulated counts that must not change: anything derived from them (IPC, MPKI, ...) follows.
+CHECKED_COLUMNS = ['Instr', 'Cycles', 'NumBr', 'MispBr', 'CycWP',
+                   '50PercInstr', '50PercCycles', '50PercNumBr', '50PercMispBr', '50PercCycWP']
+
+repo_dir = Path(__file__).resolve().parent.parent
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--trace_dir', help='path to trace directory', required=True)
+parser.add_argument('--traces', help='comma-separated runs to simulate (default: all the traces in trace_dir)')
+parser.add_argument('--match', help='only simulate the runs matching this regular expression')
+parser.add_argument('--reference', help='csv with the expected counts', default=str(repo_dir / 'reference_results_training_set.csv'))
+parser.add_argument('--baseline', help='csv with the baseline ExecTime (default: the reference)')
+parser.add_argument('--save_baseline', help='write the results of this run to this csv')
+parser.add_argument('--jobs', help='parallel simulations; 1 gives the most stable timings', type=int, default=1)
+parser.add_argument('--cbp', help='simulator binary', default=str(repo_dir / 'cbp'))
+parser.add_argument('--cbp_args', help='extra simulator options, e.g. "-T"', default='')
+args = parser.parse_args()
+
+
+def get_trace_paths(start_path):
+    ret_list = []
+    for root, dirs, files in os.walk(start_path):
+        for my_file in files:
+            if my_file.endswith('_trace.gz'):
+                ret_list.append(os.path.join(root, my_file))
+    return sorted(ret_list)
+
+
+def run_name(trace_path):
+    return os.path.basename(trace_path).split('.')[0]
+
+
+def read_results(csv_path):
+    if not os.path.exists(csv_path):
+        print(f'{csv_path} does not exist yet: no trace has a reference')
+        return {}
+    with open(csv_path, newline='') as f:
+        return {row['Run']: row for row in csv.DictReader(f)}
+
+
+traces = get_trace_paths(args.trace_dir)
+if args.traces:
+    wanted = set(args.traces.split(','))
+    unknown = wanted - {run_name(t) for t in traces}
+    if unknown:
+        sys.exit(f'Traces not found in {args.trace_dir}: {", ".join(sorted(unknown))}')
+    traces = [t for t in traces if run_name(t) in wanted]
+if args.match:
+    traces = [t for t in traces if re.search(args.match, run_name(t))]
+if not traces:
+    sys.exit('No traces to simulate')
+
+reference = read_results(args.reference)
+baseline = read_results(args.baseline) if args.baseline else reference
+
+with tempfile.TemporaryDirectory() as tmp_dir:
+    results_csv = os.path.join(tmp_dir, 'results.csv')
+    cmd = [args.cbp] + args.cbp_args.split() + ['-B', results_csv, '-j', str(args.jobs)] + traces
+    print(f'Simulating {len(traces)} traces: {" ".join(cmd[:-len(traces)])} ...')
+    subprocess.run(cmd, stdout=subprocess.DEVNULL, check=False)
+    if not os.path.exists(results_csv):
+        sys.exit('The simulator wrote no results')
+    results = read_results(results_csv)
+    if args.save_baseline:
+        with open(results_csv) as src, open(args.save_baseline, 'w') as dst:
+            dst.write(src.read())
+
+failures = []
+speedups = []
+total_time = 0.0
+total_baseline_time = 0.0
+print(f'{"Run":<24} {"Status":<8} {"ExecTime":>10} {"Baseline":>10} {"Speedup":>8}')
+for trace in traces:
+    run = run_name(trace)
+    row = results.get(run)
+    if row is None or row['Status'] != 'Pass':
+        failures.append(f'{run}: simulation failed')
+        print(f'{run:<24} {"Fail":<8}')
+        continue
+    ref = reference.get(run)
+    if ref is None:
+        failures.append(f'{run}: not in the reference {args.reference}')
+        status = 'NoRef'
+    else:
+        diffs = [f'{col} {row[col]} != {ref[col]}' for col in CHECKED_COLUMNS if int(row[col]) != int(ref[col])]
+        if diffs:
+            failures.append(f'{run}: ' + ', '.join(diffs))
+        status = 'Drift' if diffs else 'Match'
+
+    exec_time = float(row['ExecTime'])
+    base = baseline.get(run)
+    if base is not None and float(base['ExecTime']) > 0 and exec_time > 0:
+        base_time = float(base['ExecTime'])
+        speedups.append(base_time / exec_time)
+        total_time += exec_time
+        total_baseline_time += base_time
+        print(f'{run:<24} {status:<8} {exec_time:>10.2f} {base_time:>10.2f} {speedups[-1]:>7.3f}x')
+    else:
+        print(f'{run:<24} {status:<8} {exec_time:>10.2f} {"-":>10} {"-":>8}')
+
+if speedups:
+    geomean = math.exp(sum(math.log(s) for s in speedups) / len(speedups))
+    print(f'Speedup over {len(speedups)} traces: geomean {geomean:.3f}x, total time {total_baseline_time / total_time:.3f}x')
+
+if failures:
+    print(f'\nFAILED: {len(failures)} of {len(traces)} traces')
+    for failure in failures:
+        print(f'  {failure}')
+    sys.exit(1)
+print(f'\nPASSED: the counts of all {len(traces)} traces match {args.reference}')
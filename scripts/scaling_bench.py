@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# Scaling benchmark of the batch driver (cbp -B): simulates a fixed mix of traces with 1 to N workers (-j) and for
+# several window sizes (-w), and reports per point the aggregate throughput in simulated uops per second, the slowdown
+# of a worker against the runs of the same window with the first worker count (1 by default), the host LLC miss rate
+# and the peak RSS of a worker.
+#
+# The mix is repeated so that every point simulates the same jobs, at least as many as the largest worker count: the
+# throughput then compares like for like, and the slowdown shows what the workers cost each other (memory bandwidth,
+# shared caches, SMT siblings). The LLC miss rate is of all the workers, counted by perf stat (LLC-load-misses over
+# LLC-loads), n/a where perf or the events are unavailable. Points are printed as they complete, and saved to --csv.
+#
+# python3 scripts/scaling_bench.py --traces sample_traces/int/sample_int_trace.gz,sample_traces/fp/sample_fp_trace.gz
+# python3 scripts/scaling_bench.py --traces traces/int_0_trace.gz,traces/fp_3_trace.gz --workers 1,8,16,32 --windows 1024,65536 --csv scaling.csv
+
+import argparse
+import csv
+import json
+import math
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+repo_dir = Path(__file__).resolve().parent.parent
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--traces', help='comma-separated traces of the mix', required=True)
+parser.add_argument('--workers', help='comma-separated worker counts (default: 1, 2, 4... up to the cores)')
+parser.add_argument('--windows', help='comma-separated window sizes', default='1024,4096,16384,65536')
+parser.add_argument('--csv', help='write the points to this csv')
+parser.add_argument('--cbp', help='simulator binary', default=str(repo_dir / 'cbp'))
+parser.add_argument('--cbp_args', help='extra simulator options, e.g. "-T"', default='')
+args = parser.parse_args()
+
+mix = args.traces.split(',')
+if args.workers:
+    worker_counts = [int(w) for w in args.workers.split(',')]
+else:
+    cores = os.cpu_count() or 1
+    worker_counts = [1 << i for i in range(int(math.log2(cores)) + 1)]
+    if worker_counts[-1] != cores:
+        worker_counts.append(cores)
+windows = [int(w) for w in args.windows.split(',')]
+jobs = mix * math.ceil(max(worker_counts) / len(mix))
+perf = shutil.which('perf')
+
+
+def read_perf(path):
+    counts = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.strip().split(',')
+            if len(fields) >= 3 and fields[0].isdigit():
+                counts[fields[2]] = int(fields[0])
+    return counts
+
+
+def run_point(window, workers, tmp_dir):
+    csv_path = os.path.join(tmp_dir, 'results.csv')
+    stats_path = os.path.join(tmp_dir, 'stats.jsonl')
+    perf_path = os.path.join(tmp_dir, 'perf.txt')
+    for path in (stats_path, perf_path):
+        if os.path.exists(path):
+            os.remove(path)
+    cmd = [args.cbp, '-B', csv_path, '-j', str(workers), '-w', str(window), '-J', stats_path] + args.cbp_args.split() + jobs
+    if perf:
+        cmd = [perf, 'stat', '-x,', '-o', perf_path, '-e', 'LLC-loads,LLC-load-misses'] + cmd
+    begin = time.monotonic()
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    wall = time.monotonic() - begin
+    if proc.returncode != 0:
+        sys.exit(f'{" ".join(cmd)} failed:\n{proc.stdout[-2000:]}')
+
+    with open(csv_path, newline='') as f:
+        exec_times = [float(row['ExecTime']) for row in csv.DictReader(f)]
+    with open(stats_path) as f:
+        uops = sum(json.loads(line)['core']['uops'] for line in f if line.strip())
+    peak_rss_mb = max((int(m) for m in re.findall(r'peak RSS (\d+) MB', proc.stdout)), default=0)
+    llc_miss_rate = None
+    if perf and os.path.exists(perf_path):
+        counts = read_perf(perf_path)
+        if counts.get('LLC-loads'):
+            llc_miss_rate = counts.get('LLC-load-misses', 0) / counts['LLC-loads']
+    return {'window': window, 'workers': workers, 'jobs': len(jobs), 'wall_s': wall, 'uops': uops,
+            'muops_per_s': uops / wall / 1e6, 'mean_exec_s': sum(exec_times) / len(exec_times),
+            'llc_miss_rate': llc_miss_rate, 'peak_rss_mb': peak_rss_mb}
+
+
+print(f'{len(jobs)} jobs per point ({len(mix)} traces), workers {worker_counts}, windows {windows}'
+      + ('' if perf else ', no perf: LLC miss rate n/a'))
+print(f'{"Window":>7} {"Workers":>7} {"Wall(s)":>8} {"Muops/s":>9} {"Scaling":>8} {"Slowdown":>9} {"LLC miss":>9} {"RSS(MB)":>8}')
+points = []
+with tempfile.TemporaryDirectory() as tmp_dir:
+    for window in windows:
+        single = None
+        for workers in worker_counts:
+            p = run_point(window, workers, tmp_dir)
+            if single is None:
+                single = p
+            p['scaling'] = p['muops_per_s'] / single['muops_per_s']
+            p['slowdown'] = p['mean_exec_s'] / single['mean_exec_s']
+            points.append(p)
+            llc = 'n/a' if p['llc_miss_rate'] is None else f'{p["llc_miss_rate"] * 100:.2f}%'
+            print(f'{window:>7} {workers:>7} {p["wall_s"]:>8.2f} {p["muops_per_s"]:>9.2f} {p["scaling"]:>7.2f}x'
+                  f' {p["slowdown"]:>8.2f}x {llc:>9} {p["peak_rss_mb"]:>8}', flush=True)
+
+if args.csv:
+    with open(args.csv, 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=list(points[0].keys()))
+        writer.writeheader()
+        writer.writerows(points)
+    print(f'Wrote {len(points)} points to {args.csv}')
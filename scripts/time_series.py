@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Reads a time series (cbp -q, lib/time_series.h): prints one csv row per epoch, or per --window epochs summed, with
+# the counters of the epoch and its IPC and MPKI (conditional branches). --trace keeps the epochs of the traces whose
+# name contains it.
+#
+# python3 scripts/time_series.py series.bin > series.csv
+# python3 scripts/time_series.py series.bin --window 100
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<8sIIQ')
+CHUNK = struct.Struct('<II')
+TRACE, BLOCK = 1, 2
+COLUMNS = ['instr', 'cycles', 'conddir_n', 'conddir_m', 'jumpind_n', 'jumpind_m', 'jumpret_n', 'jumpret_m', 'cycles_wp']
+
+parser = argparse.ArgumentParser()
+parser.add_argument('series', help='time series written by cbp -q')
+parser.add_argument('--window', help='epochs summed per row', type=int, default=1)
+parser.add_argument('--trace', help='only the traces whose name contains this')
+args = parser.parse_args()
+
+
+def varints(data, n):
+    values, v, shift = [], 0, 0
+    for b in data:
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            values.append(v)
+            v, shift = 0, 0
+    if len(values) != n:
+        sys.exit(f'{args.series}: corrupt block')
+    return values
+
+
+def decode_column(data, n):
+    values, last = [], 0
+    for z in varints(data, n):
+        last += (z >> 1) ^ -(z & 1)
+        values.append(last)
+    return values
+
+
+with open(args.series, 'rb') as f:
+    data = f.read()
+magic, num_columns, block_epochs, epoch_insts = HEADER.unpack_from(data)
+if magic.rstrip(b'\0') != b'CBPTS1' or num_columns != len(COLUMNS):
+    sys.exit(f'{args.series} is not a time series of this version')
+
+print('trace,epoch,' + ','.join(COLUMNS) + ',ipc,mpki')
+trace, epoch, window, pos = '', 0, None, HEADER.size
+
+
+def flush():
+    global window
+    if window is None:
+        return
+    w = dict(zip(COLUMNS, window[1:]))
+    ipc = w['instr'] / w['cycles'] if w['cycles'] else 0
+    mpki = 1000 * w['conddir_m'] / w['instr'] if w['instr'] else 0
+    print(f'{trace},{window[0]},' + ','.join(str(w[c]) for c in COLUMNS) + f',{ipc:.4f},{mpki:.4f}')
+    window = None
+
+
+while pos < len(data):
+    kind, n = CHUNK.unpack_from(data, pos)
+    pos += CHUNK.size
+    if kind == TRACE:
+        flush()
+        trace, epoch = data[pos:pos + n].decode(), 0
+        pos += n
+        continue
+    if kind != BLOCK:
+        sys.exit(f'{args.series}: corrupt chunk at {pos - CHUNK.size}')
+    sizes = struct.unpack_from(f'<{num_columns}I', data, pos)
+    pos += 4 * num_columns
+    columns = []
+    for size in sizes:
+        columns.append(decode_column(data[pos:pos + size], n))
+        pos += size
+    if args.trace is not None and args.trace not in trace:
+        epoch += n
+        continue
+    for row in zip(*columns):
+        if window is None:
+            window = [epoch] + [0] * num_columns
+        for c, v in enumerate(row):
+            window[1 + c] += v
+        epoch += 1
+        if epoch % args.window == 0:
+            flush()
+flush()
@@ -4,12 +4,11 @@
 #include <stdlib.h>
 
 #include <cstdint>
-#include <vector>
-#include <bitset>
-#include <unordered_map>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include "lib/checkpoint_ring.h"
+#include "perceptron.h"
 
 // === RL-Based Branch Predictor ===
 // Implements a lightweight perceptron-like predictor using RL-style online updates
@@ -27,17 +26,20 @@ class SampleCondPredictor
     static constexpr int8_t WEIGHT_BITS = 8;                 // Weight resolution (in bits)
     static constexpr int8_t THETA = 20;                      // Confidence threshold for training
     static constexpr int8_t LEARNING_RATE = 1;               // Weight update step
-    static constexpr int32_t MAX_TABLE_ENTRIES = 4096;       // Max number of PCs tracked
+    static constexpr int32_t MAX_TABLE_ENTRIES = 4096;       // Number of weight vectors, indexed by a hash of the PC
     static constexpr size_t MAX_BYTES = 192 * 1024;          // Memory budget: 192KB
 
     static constexpr int16_t NUM_FEATURES = HISTORY_LENGTH + 1; // +1 for bias
-    static constexpr int8_t WEIGHT_MAX = (1 << (WEIGHT_BITS - 1)) - 1;
-    static constexpr int8_t WEIGHT_MIN = -(1 << (WEIGHT_BITS - 1));
+
+    using weight_table_t = perceptron_table_t<MAX_TABLE_ENTRIES, NUM_FEATURES, WEIGHT_BITS>;
+    using history_t = pm1_history_t<HISTORY_LENGTH>;
+
+    static constexpr int8_t BIAS_INPUT = 1;
 
     // --- Internal State ---
-    std::bitset<HISTORY_LENGTH> GHR;                                // Global History Register
-    std::unordered_map<uint64_t, std::vector<int8_t>> weights;      // Per-PC weight vectors
-    std::unordered_map<uint64_t, std::bitset<HISTORY_LENGTH>> speculative_GHRs; // For rollback
+    history_t GHR;                                      // Global History Register, as +1/-1 inputs
+    weight_table_t weights;                             // Hashed weight vectors: bias, then one per history bit
+    checkpoint_ring_t<history_t> speculative_GHRs;      // Prediction-time GHR, for rollback and training
 
 public:
     SampleCondPredictor(void) {}
@@ -48,8 +50,6 @@ public:
     }
 
     void terminate() {
-        weights.clear();
-        speculative_GHRs.clear();
     }
 
     // Create a unique instruction ID from seq_no and micro-op piece
@@ -58,70 +58,59 @@ public:
         return (seq_no << 4) | (piece & 0x000F);
     }
 
+    // Hash of the PC selecting its weight vector
+    static uint64_t get_weights_idx(uint64_t PC) {
+        return PC ^ (PC >> 12);
+    }
+
+    // Compute dot product between weights and GHR-based features
+    static int get_sum(const int8_t* w, const history_t& hist) {
+        return w[0] * BIAS_INPUT + weight_table_t::dot(w + 1, hist.data(), HISTORY_LENGTH);
+    }
+
     // Predict using linear Q(s,a) = wᵀ·ϕ(s)
     bool predict(uint64_t seq_no, uint8_t piece, uint64_t PC, const bool tage_pred) {
         (void)tage_pred;
 
-        auto& w = weights[PC];
-        if (w.empty()) {
-            w.resize(NUM_FEATURES, 0);
-        }
-
-        // Compute dot product between weights and GHR-based features
-        int sum = w[0]; // bias
-        for (int i = 0; i < HISTORY_LENGTH; ++i) {
-            sum += GHR[i] ? w[i + 1] : -w[i + 1];
-        }
+        const int sum = get_sum(weights.row(get_weights_idx(PC)), GHR);
 
         // Save current GHR in case we need to rollback on misprediction
-        speculative_GHRs[get_unique_inst_id(seq_no, piece)] = GHR;
+        speculative_GHRs.emplace(seq_no, piece) = GHR;
 
         return sum >= 0; // positive score → predict taken
     }
 
     // Speculative GHR update after prediction
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC) {
-        GHR <<= 1;
-        GHR.set(0, taken);
+        GHR.push(taken);
     }
 
     // Final update after branch resolution
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC) {
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        auto& w = weights[PC];
-        if (w.empty()) w.resize(NUM_FEATURES, 0);
+        int8_t* w = weights.row(get_weights_idx(PC));
+        const history_t& pred_GHR = speculative_GHRs.at(seq_no, piece);
 
         // Restore speculative GHR if prediction was wrong
         if (resolveDir != predDir) {
-            auto it = speculative_GHRs.find(id);
-            if (it != speculative_GHRs.end()) {
-                GHR = it->second;
-                GHR <<= 1;
-                GHR.set(0, resolveDir);
-            }
+            GHR = pred_GHR;
+            GHR.push(resolveDir);
         }
 
-        speculative_GHRs.erase(id);
-
-        // Recompute sum for learning decision
-        int sum = w[0];
-        for (int i = 0; i < HISTORY_LENGTH; ++i) {
-            sum += GHR[i] ? w[i + 1] : -w[i + 1];
-        }
+        // Recompute sum for learning decision, on the GHR the branch was predicted with
+        const int sum = get_sum(w, pred_GHR);
 
         // Update weights if low confidence or incorrect prediction
         if ((resolveDir != (sum >= 0)) || std::abs(sum) <= THETA) {
-            int8_t target = resolveDir ? 1 : -1;
+            const int step = (resolveDir ? 1 : -1) * LEARNING_RATE;
 
             // Bias weight
-            w[0] = std::max(std::min((int8_t)(w[0] + LEARNING_RATE * target), WEIGHT_MAX), WEIGHT_MIN);
+            weight_table_t::train(w, &BIAS_INPUT, 1, step);
 
             // History-based weights
-            for (int i = 0; i < HISTORY_LENGTH; ++i) {
-                int8_t update = (GHR[i] ? 1 : -1) * target * LEARNING_RATE;
-                w[i + 1] = std::max(std::min((int8_t)(w[i + 1] + update), WEIGHT_MAX), WEIGHT_MIN);
-            }
+            weight_table_t::train(w + 1, pred_GHR.data(), HISTORY_LENGTH, step);
         }
+
+        speculative_GHRs.erase(seq_no, piece);
     }
 
 private:
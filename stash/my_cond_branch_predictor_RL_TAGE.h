@@ -5,13 +5,14 @@
 
 #include <cstdint>
 #include <vector>
-#include <bitset>
 #include <unordered_map>
 #include <array>
 #include <cassert>
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include "lib/checkpoint_ring.h"
+#include "lib/history_register.h"
 
 class SampleCondPredictor {
     // === Tunable Parameters ===
@@ -29,14 +30,12 @@ class SampleCondPredictor {
 
     using WeightTable = std::vector<int8_t>;
 
-    struct FoldedHistory {
-        std::bitset<GHR_MAX> full;
-        std::array<uint32_t, NUM_TABLES> folded{};
-    };
+    using history_t = history_register_t<GHR_MAX>;
 
     std::array<std::vector<int8_t>, NUM_TABLES> weight_tables; // Shared hashed weight tables
-    FoldedHistory GHR;
-    std::unordered_map<uint64_t, FoldedHistory> speculative_GHRs;
+    history_t full_GHR;
+    std::array<uint32_t, NUM_TABLES> folded_GHR{};
+    checkpoint_ring_t<history_t::checkpoint_t> speculative_GHRs;   // the folds are recomputed on rollback
 
     // Confidence counter per PC (simplified)
     std::unordered_map<uint64_t, int> confidence;
@@ -48,13 +47,11 @@ public:
         for (auto& table : weight_tables) {
             table.resize(TABLE_ENTRIES, 0);
         }
-        GHR.full.reset();
         check_memory_budget();
     }
 
     void terminate() {
         for (auto& table : weight_tables) table.clear();
-        speculative_GHRs.clear();
         confidence.clear();
     }
 
@@ -68,41 +65,38 @@ public:
 
         int total_score = 0;
         for (int i = 0; i < NUM_TABLES; ++i) {
-            uint32_t idx = (PC ^ GHR.folded[i]) & (TABLE_ENTRIES - 1);
+            uint32_t idx = (PC ^ folded_GHR[i]) & (TABLE_ENTRIES - 1);
             total_score += weight_tables[i][idx];
         }
 
-        speculative_GHRs[get_unique_inst_id(seq_no, piece)] = GHR;
+        speculative_GHRs.emplace(seq_no, piece) = full_GHR.checkpoint();
         return total_score >= 0;
     }
 
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC) {
-        GHR.full <<= 1;
-        GHR.full.set(0, taken);
+        full_GHR.push(taken);
         for (int i = 0; i < NUM_TABLES; ++i) {
             int len = HISTORY_LENGTHS[i];
-            GHR.folded[i] = fold_history(GHR.full, len);
+            folded_GHR[i] = fold_history(len);
         }
     }
 
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC) {
-        auto id = get_unique_inst_id(seq_no, piece);
-        if (speculative_GHRs.count(id)) {
+        if (speculative_GHRs.contains(seq_no, piece)) {
             if (resolveDir != predDir) {
-                GHR = speculative_GHRs[id];
-                GHR.full <<= 1;
-                GHR.full.set(0, resolveDir);
+                full_GHR.restore(speculative_GHRs.at(seq_no, piece));
+                full_GHR.push(resolveDir);
                 for (int i = 0; i < NUM_TABLES; ++i) {
-                    GHR.folded[i] = fold_history(GHR.full, HISTORY_LENGTHS[i]);
+                    folded_GHR[i] = fold_history(HISTORY_LENGTHS[i]);
                 }
             }
-            speculative_GHRs.erase(id);
+            speculative_GHRs.erase(seq_no, piece);
         }
 
         int total_score = 0;
         std::array<uint32_t, NUM_TABLES> indices;
         for (int i = 0; i < NUM_TABLES; ++i) {
-            indices[i] = (PC ^ GHR.folded[i]) & (TABLE_ENTRIES - 1);
+            indices[i] = (PC ^ folded_GHR[i]) & (TABLE_ENTRIES - 1);
             total_score += weight_tables[i][indices[i]];
         }
 
@@ -124,17 +118,17 @@ public:
     }
 
 private:
-    uint32_t fold_history(const std::bitset<GHR_MAX>& hist, int len) {
+    uint32_t fold_history(int len) {
         uint32_t result = 0;
         for (int i = 0; i < len; ++i) {
-            result ^= (hist[i] << (i % 16));
+            result ^= (full_GHR[i] << (i % 16));
         }
         return result;
     }
 
     void check_memory_budget() {
         size_t total = NUM_TABLES * TABLE_ENTRIES * sizeof(int8_t);
-        std::cout << "Memory used: " << estimated_total << "B / " << MAX_BYTES << "B" << std::endl;
+        std::cout << "Memory used: " << total << "B / " << MAX_BYTES << "B" << std::endl;
         assert(total <= MAX_BYTES && "Exceeded MAX_BYTES memory budget for predictor.");
     }
 };
@@ -4,12 +4,11 @@
 #include <stdlib.h>
 
 #include <cstdint>
-#include <vector>
-#include <bitset>
-#include <unordered_map>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include "lib/checkpoint_ring.h"
+#include "perceptron.h"
 
 /*
 IDEA:
@@ -44,16 +43,24 @@ class SampleCondPredictor
     static constexpr size_t MAX_BYTES = 192 * 1024;               // Memory budget: 192KB
 
     static constexpr uint16_t NUM_FEATURES = HISTORY_LENGTH + ID_LENGTH + 1; // +1 for bias
-    static constexpr int8_t WEIGHT_MAX = (1 << (WEIGHT_BITS - 1)) - 1;
-    static constexpr int8_t WEIGHT_MIN = -(1 << (WEIGHT_BITS - 1));
     static constexpr uint32_t NORM_HIST_VS_ID = HISTORY_LENGTH / ID_LENGTH;  // Ensure that weights from the GHR as much as the PC ones
 
+    // weight vector layout: bias, HISTORY_LENGTH history weights, ID_LENGTH PC weights
+    using weight_table_t = perceptron_table_t<MAX_TABLE_ENTRIES, NUM_FEATURES, WEIGHT_BITS>;
+    using history_t = pm1_history_t<HISTORY_LENGTH + HISTORY_LENGTH_BUFFER>;
+
+    static constexpr int8_t BIAS_INPUT = 1;
+
+    struct speculative_state_t {
+        uint8_t pred_cycle;     // absolute clock cycle of the GHR update, for rollback
+        int sum;                // raw prediction, for the weights update
+    };
+
     // --- Internal State ---
     uint8_t pred_cycle;                                             // Cyclic counter of prediction
-    std::bitset<HISTORY_LENGTH + HISTORY_LENGTH_BUFFER> GHR;        // Global History Register
-    std::unordered_map<uint64_t, std::vector<int8_t>> weights;      // Per-PC weight vectors
-    std::unordered_map<uint64_t, uint8_t> speculative_updates;      // For rollback, maps instruction ID to its absolute clock cycle
-    std::unordered_map<uint64_t, int> past_predictions;             // For weights update, store raw past predictions
+    history_t GHR;                                                  // Global History Register, as +1/-1 inputs
+    weight_table_t weights;                                         // Hashed weight vectors
+    checkpoint_ring_t<speculative_state_t> speculative_states;      // Per in-flight branch
 
 public:
     SampleCondPredictor(void) {}
@@ -61,12 +68,17 @@ public:
     void setup() {
         pred_cycle = 0;
         GHR.reset();
+        // Random weights initialization
+        for (uint32_t r = 0; r < MAX_TABLE_ENTRIES; r++) {
+            int8_t* w = weights.row(r);
+            for (uint i = 0; i < NUM_FEATURES; i++) {
+                w[i] = (rand() % 3) - 1;
+            }
+        }
         check_memory_budget(); // Ensure configuration is within 192KB
     }
 
     void terminate() {
-        weights.clear();
-        speculative_updates.clear();
     }
 
     // Create a unique instruction ID from seq_no and micro-op piece
@@ -82,36 +94,28 @@ public:
         return key % MAX_TABLE_ENTRIES;
     }
 
+    // PC bits 1..ID_LENGTH as +1/-1 inputs
+    static std::array<int8_t, ID_LENGTH> get_id_inputs(uint64_t PC) {
+        std::array<int8_t, ID_LENGTH> id;
+        for (uint i = 1; i <= ID_LENGTH; i++) {
+            id[i - 1] = ((PC >> i) & 1) ? 1 : -1;
+        }
+        return id;
+    }
+
     // Predict using linear Q(s,a) = wᵀ·ϕ(s)
     bool predict(uint64_t seq_no, uint8_t piece, uint64_t PC, bool tage_pred) {
         (void)tage_pred;
 
-        auto& w = weights[get_weights_idx(PC)];
-        // Random weights initialization
-        if (w.empty()) {
-            w.resize(NUM_FEATURES, 0);
-            w[0] = (rand() % 3) - 1;
-            for (int i = 0; i < HISTORY_LENGTH; i++) {
-                w[i + 1] = (rand() % 3) - 1;
-            }
-            for (uint i = 1; i <= ID_LENGTH; i++) {
-                bool bit = (PC >> i) & 1;
-                w[HISTORY_LENGTH + i] = (rand() % 3) - 1;
-            }
-        }
+        const int8_t* w = weights.row(get_weights_idx(PC));
 
         // Compute dot product between weights and GHR-based features
-        int sum = w[0]; // bias
-        for (int i = 0; i < HISTORY_LENGTH; i++) {
-            sum += GHR[i] ? w[i + 1] : -w[i + 1];
-        }
-        for (uint i = 1; i <= ID_LENGTH; i++) {
-            bool bit = (PC >> i) & 1;
-            sum += (bit ? w[HISTORY_LENGTH + i] : -w[HISTORY_LENGTH + i])*NORM_HIST_VS_ID;
-        }
+        int sum = w[0] * BIAS_INPUT;
+        sum += weight_table_t::dot(w + 1, GHR.data(), HISTORY_LENGTH);
+        sum += weight_table_t::dot(w + HISTORY_LENGTH + 1, get_id_inputs(PC).data(), ID_LENGTH) * NORM_HIST_VS_ID;
 
         // Save current prediction for future weights updates
-        past_predictions[get_unique_inst_id(seq_no, piece)] = sum;
+        speculative_states.emplace(seq_no, piece).sum = sum;
 
         return sum >= 0; // positive score → predict taken
     }
@@ -119,37 +123,26 @@ public:
     // Speculative GHR update after prediction
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC) {
         pred_cycle += 1;
-        GHR <<= 1;
-        GHR.set(0, taken);
+        GHR.push(taken);
 
         // Save current cycle to rollback on misprediction
-        speculative_updates[get_unique_inst_id(seq_no, piece)] = pred_cycle;
+        speculative_states.at(seq_no, piece).pred_cycle = pred_cycle;
     }
 
     // Final update after branch resolution
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC) {
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        auto& w = weights[get_weights_idx(PC)];
-        if (w.empty()) w.resize(NUM_FEATURES, 0);
+        int8_t* w = weights.row(get_weights_idx(PC));
 
         // Restore speculative GHR if prediction was wrong
-        auto it_su = speculative_updates.find(id);
-        if (it_su == speculative_updates.end()) {
-            return;
-        }
-        uint8_t delta_cycles = pred_cycle - it_su->second;
+        const speculative_state_t state = speculative_states.at(seq_no, piece);
+        speculative_states.erase(seq_no, piece);
+        uint8_t delta_cycles = pred_cycle - state.pred_cycle;
         if (resolveDir != predDir) {
             GHR.set(delta_cycles, resolveDir);
         }
-        speculative_updates.erase(id);
 
         // Recover past raw decision
-        auto it_pp = past_predictions.find(id);
-        past_predictions.erase(id);
-        if (it_pp == past_predictions.end()) {
-            return;
-        }
-        int sum = it_pp->second;
+        int sum = state.sum;
 
         // Not enough past GHR entries buffered (too many other branche seen between prediction and update), don't train
         if (delta_cycles > HISTORY_LENGTH_BUFFER) {
@@ -158,22 +151,15 @@ public:
 
         // Update weights if low confidence or incorrect prediction
         if ((resolveDir != (sum >= 0)) || std::abs(sum) <= THETA) {
-            int8_t target = resolveDir ? 1 : -1;
+            const int step = (resolveDir ? 1 : -1) * LEARNING_RATE;
 
             // Bias weight
-            w[0] = std::max(std::min((int8_t)(w[0] + LEARNING_RATE * target), WEIGHT_MAX), WEIGHT_MIN);
+            weight_table_t::train(w, &BIAS_INPUT, 1, step);
 
-            // History-based weights
-            for (uint i = 0; i < HISTORY_LENGTH; i++) {
-                int8_t update = (GHR[i + delta_cycles] ? 1 : -1) * target * LEARNING_RATE;
-                w[i + 1] = std::max(std::min((int8_t)(w[i + 1] + update), WEIGHT_MAX), WEIGHT_MIN);
-            }
+            // History-based weights, on the GHR as it was at prediction
+            weight_table_t::train(w + 1, GHR.data() + delta_cycles, HISTORY_LENGTH, step);
             // PC-based weights
-            for (uint i = 1; i <= ID_LENGTH; i++) {
-                bool bit = (PC >> i) & 1;
-                int8_t update = (bit ? 1 : -1) * target * LEARNING_RATE;
-                w[HISTORY_LENGTH + i] = std::max(std::min((int8_t)(w[HISTORY_LENGTH + i] + update), WEIGHT_MAX), WEIGHT_MIN);
-            }
+            weight_table_t::train(w + HISTORY_LENGTH + 1, get_id_inputs(PC).data(), ID_LENGTH, step);
         }
     }
 
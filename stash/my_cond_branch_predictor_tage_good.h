@@ -2,12 +2,14 @@
 #define _PREDICTOR_H_
 
 #include <vector>
-#include <deque>
-#include <map>
+#include <array>
 #include <cstdint>
 #include <cmath>
 #include <iostream>
 #include <cassert>
+#include "lib/checkpoint_ring.h"
+#include "lib/history_register.h"
+#include "lib/folded_history.h"
 
 // Configuration defines (values based on L-TAGE)
 #define NUM_TAGGED_TABLES 12 // 12 TAGE tables
@@ -57,9 +59,17 @@ private:
     std::vector<std::vector<TaggedEntry>> tagged_tables;
 
     // Global History Register (GHR)
-    std::deque<bool> ghr;
+    using ghr_t = history_register_t<MAX_HISTORY>;
+    ghr_t ghr;
     int max_hist;
 
+    // The GHR folded to the index (INDEX_FOLD) and tag (TAG_FOLD) width of each tagged table, shifted along with it
+    static constexpr int INDEX_FOLD = 0;
+    static constexpr int TAG_FOLD = 1;
+    using ghr_folds_t = folded_history_set_t<NUM_TAGGED_TABLES, 2>;
+    using folds_t = decltype(ghr_folds_t::comp);
+    ghr_folds_t ghr_folds;
+
     // Alternate prediction counter
     uint8_t use_alt_on_na;
 
@@ -69,22 +79,27 @@ private:
 
     // Speculative state tracking
     struct SpeculativeState {
-        std::deque<bool> ghr_snapshot;
+        ghr_t::checkpoint_t ghr_snapshot;  // GHR with the predicted direction shifted in
+        folds_t folds_snapshot;            // and its folds
         int provider_table;
         bool altpred;
         bool final_pred;
     };
-    std::map<uint64_t, SpeculativeState> speculative_states;
+    checkpoint_ring_t<SpeculativeState> speculative_states;
 
     // Helper functions
-    uint64_t compute_hash(uint64_t pc, const std::deque<bool>& hist, int hist_len, int out_bits) {
-        uint64_t hash = pc;
-        int bits_used = 0;
-        for (auto it = hist.rbegin(); it != hist.rend() && bits_used < hist_len; ++it) {
-            hash ^= (*it << (bits_used % out_bits));
-            bits_used++;
+    // The PC xored with the last hist_len history bits, the i-th newest at bit (i % out_bits), in O(1) from the folds
+    uint64_t compute_hash(uint64_t pc, const folds_t& folds, int table, int fold, int out_bits) {
+        return (pc ^ folds[fold][table]) & ((1ULL << out_bits) - 1);
+    }
+
+    void push_history(bool taken) {
+        std::array<unsigned, NUM_TAGGED_TABLES> out;
+        for (int i = 0; i < NUM_TAGGED_TABLES; ++i) {
+            out[i] = ghr[TAGGED_CONFIGS[i].hist_len - 1];
         }
-        return hash & ((1ULL << out_bits) - 1);
+        ghr.push(taken);
+        ghr_folds.update(taken, out);
     }
 
     // Estimate memory usage and check against budget
@@ -108,6 +123,10 @@ public:
         for (const auto& cfg : TAGGED_CONFIGS) {
             tagged_tables.emplace_back(cfg.entries(), TaggedEntry{0, 0, 0});
         }
+        for (int i = 0; i < NUM_TAGGED_TABLES; ++i) {
+            ghr_folds.init(i, INDEX_FOLD, TAGGED_CONFIGS[i].hist_len, TAGGED_CONFIGS[i].index_bits);
+            ghr_folds.init(i, TAG_FOLD, TAGGED_CONFIGS[i].hist_len, TAGGED_CONFIGS[i].tag_bits);
+        }
     }
 
     void setup() {
@@ -124,8 +143,7 @@ public:
     bool predict(uint64_t seq_no, uint8_t piece, uint64_t PC, bool tage_pred) {
         (void)tage_pred;
 
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        SpeculativeState state;
+        SpeculativeState& state = speculative_states.emplace(seq_no, piece);
 
         // Base prediction
         uint64_t base_idx = PC % base_table.size();
@@ -139,8 +157,8 @@ public:
         for (int i = NUM_TAGGED_TABLES - 1; i >= 0; --i) {
             const auto& cfg = TAGGED_CONFIGS[i];
             auto& table = tagged_tables[i];
-            uint64_t idx = compute_hash(PC, ghr, cfg.hist_len, cfg.index_bits) % table.size();
-            uint16_t tag = compute_hash(PC, ghr, cfg.hist_len, cfg.tag_bits);
+            uint64_t idx = compute_hash(PC, ghr_folds.comp, i, INDEX_FOLD, cfg.index_bits) % table.size();
+            uint16_t tag = compute_hash(PC, ghr_folds.comp, i, TAG_FOLD, cfg.tag_bits);
 
             if (table[idx].tag == tag) {
                 state.provider_table = i;
@@ -150,8 +168,8 @@ public:
                 for (int j = i - 1; j >= 0; --j) {
                     const auto& alt_cfg = TAGGED_CONFIGS[j];
                     auto& alt_table = tagged_tables[j];
-                    uint64_t alt_idx = compute_hash(PC, ghr, alt_cfg.hist_len, alt_cfg.index_bits) % alt_table.size();
-                    uint16_t alt_tag = compute_hash(PC, ghr, alt_cfg.hist_len, alt_cfg.tag_bits);
+                    uint64_t alt_idx = compute_hash(PC, ghr_folds.comp, j, INDEX_FOLD, alt_cfg.index_bits) % alt_table.size();
+                    uint16_t alt_tag = compute_hash(PC, ghr_folds.comp, j, TAG_FOLD, alt_cfg.tag_bits);
                     if (alt_table[alt_idx].tag == alt_tag) {
                         state.altpred = (alt_table[alt_idx].ctr >= 0);
                         break;
@@ -164,7 +182,7 @@ public:
         // Use altpred if weak and use_alt_on_na
         if (state.provider_table != -1) {
             auto& entry = tagged_tables[state.provider_table][
-                compute_hash(PC, ghr, TAGGED_CONFIGS[state.provider_table].hist_len,
+                compute_hash(PC, ghr_folds.comp, state.provider_table, INDEX_FOLD,
                              TAGGED_CONFIGS[state.provider_table].index_bits) %
                 tagged_tables[state.provider_table].size()];
             if (abs(entry.ctr) <= 1 && use_alt_on_na >= USE_ALT_THRESHOLD) {
@@ -172,45 +190,36 @@ public:
             }
         }
 
-        // Save state
-        state.ghr_snapshot = ghr;
-        speculative_states[id] = state;
-
         return state.final_pred;
     }
 
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC) {
         (void)PC; (void)nextPC;
         
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        auto& state = speculative_states[id];
-
-        // Speculatively update GHR with prediction
-        state.ghr_snapshot.push_back(taken);
-        if (state.ghr_snapshot.size() > MAX_HISTORY) {
-            state.ghr_snapshot.pop_front();
-        }
-        ghr = state.ghr_snapshot;
+        // Speculatively update GHR with prediction, which the snapshot includes
+        push_history(taken);
+        SpeculativeState& state = speculative_states.at(seq_no, piece);
+        state.ghr_snapshot = ghr.checkpoint();
+        state.folds_snapshot = ghr_folds.comp;
     }
 
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC) {
         (void)nextPC;
 
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        auto& state = speculative_states[id];
+        SpeculativeState& state = speculative_states.at(seq_no, piece);
 
         // Rollback GHR on misprediction
         if (predDir != resolveDir) {
-            ghr = state.ghr_snapshot;
-            ghr.push_back(resolveDir);
-            if (ghr.size() > MAX_HISTORY) ghr.pop_front();
+            ghr.restore(state.ghr_snapshot);
+            ghr_folds.comp = state.folds_snapshot;
+            push_history(resolveDir);
         }
 
         // Update usefulness and counters
         if (state.provider_table != -1) {
             auto& cfg = TAGGED_CONFIGS[state.provider_table];
             auto& table = tagged_tables[state.provider_table];
-            uint64_t idx = compute_hash(PC, state.ghr_snapshot, cfg.hist_len, cfg.index_bits) % table.size();
+            uint64_t idx = compute_hash(PC, state.folds_snapshot, state.provider_table, INDEX_FOLD, cfg.index_bits) % table.size();
             TaggedEntry& entry = table[idx];
 
             // Update prediction counter
@@ -235,9 +244,9 @@ public:
                 for (int k = state.provider_table + 1; k < NUM_TAGGED_TABLES; ++k) {
                     auto& alloc_cfg = TAGGED_CONFIGS[k];
                     auto& alloc_table = tagged_tables[k];
-                    uint64_t alloc_idx = compute_hash(PC, state.ghr_snapshot, alloc_cfg.hist_len, alloc_cfg.index_bits) % alloc_table.size();
+                    uint64_t alloc_idx = compute_hash(PC, state.folds_snapshot, k, INDEX_FOLD, alloc_cfg.index_bits) % alloc_table.size();
                     if (alloc_table[alloc_idx].u == 0) {
-                        alloc_table[alloc_idx].tag = compute_hash(PC, state.ghr_snapshot, alloc_cfg.hist_len, alloc_cfg.tag_bits);
+                        alloc_table[alloc_idx].tag = compute_hash(PC, state.folds_snapshot, k, TAG_FOLD, alloc_cfg.tag_bits);
                         alloc_table[alloc_idx].ctr = (resolveDir ? 0 : -1); // Weak correct
                         alloc_table[alloc_idx].u = 0;
                         break;
@@ -273,7 +282,7 @@ public:
             }
         }
 
-        speculative_states.erase(id);
+        speculative_states.erase(seq_no, piece);
     }
 };
 
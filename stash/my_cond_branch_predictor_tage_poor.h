@@ -3,10 +3,11 @@
 
 #include <cstdint>
 #include <vector>
-#include <deque>
-#include <unordered_map>
 #include <cassert>
 #include <algorithm>
+#include "lib/checkpoint_ring.h"
+#include "lib/history_register.h"
+#include "lib/folded_history.h"
 
 // ---- PARAMETRIC DEFINES ----
 #define NUM_TAGE_TABLES 7  // Number of tagged tables
@@ -20,6 +21,9 @@ const int TAGE_HIST_LEN[NUM_TAGE_TABLES]   = { 4, 8, 16, 32, 64, 96, 128 };
 #define TAGE_USEFUL_BITS 1     // Bits for "useful" field
 #define BIMODAL_SIZE 1024      // Size of simple bimodal predictor
 #define MAX_HISTORY_LENGTH 128 // Longest history needed
+// The history is restored at every update, which uses up MAX_HISTORY_LENGTH positions of the register: room for the
+// checkpoints of a full window (1024) of branches
+#define HISTORY_SLACK (1024 * (MAX_HISTORY_LENGTH + 1))
 
 class SampleCondPredictor
 {
@@ -29,18 +33,16 @@ public:
 
     void setup() {
         ghist_length = MAX_HISTORY_LENGTH;
-        history.clear();
+        history_fold.init(0, 0, ghist_length, 16);
         tage_tables.resize(NUM_TAGE_TABLES);
         for (int i = 0; i < NUM_TAGE_TABLES; i++) {
             tage_tables[i].assign(TAGE_TABLE_SIZE[i], TageEntry());
         }
         bimodal.assign(BIMODAL_SIZE, 0);
         clock = 0;
-        speculative_histories.clear();
     }
 
     void terminate() {
-        speculative_histories.clear();
     }
 
     uint64_t get_unique_inst_id(uint64_t seq_no, uint8_t piece) const {
@@ -71,21 +73,19 @@ public:
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC) {
         (void)PC; (void)nextPC;
         // Save speculative snapshot
-        uint64_t id = get_unique_inst_id(seq_no, piece);
-        speculative_histories[id] = history;
+        speculative_histories.emplace(seq_no, piece) = { history.checkpoint(), history_fold.comp[0][0] };
         // Push predicted outcome
-        history.push_back(taken);
-        if (history.size() > ghist_length) history.pop_front();
+        push_history(taken);
     }
 
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC) {
         (void)nextPC;
-        uint64_t id = get_unique_inst_id(seq_no, piece);
         // Rollback speculative history
-        auto it = speculative_histories.find(id);
-        if (it != speculative_histories.end()) {
-            history = it->second;
-            speculative_histories.erase(it);
+        if (speculative_histories.contains(seq_no, piece)) {
+            const auto &snap = speculative_histories.at(seq_no, piece);
+            history.restore(snap.hist);
+            history_fold.comp[0][0] = snap.fold;
+            speculative_histories.erase(seq_no, piece);
         }
         // Aging useful bits
         if (++clock % 1024 == 0) age_useful_bits();
@@ -113,8 +113,7 @@ public:
             if (predDir != resolveDir) allocate_new_entry(PC, resolveDir);
         }
         // Apply real outcome
-        history.push_back(resolveDir);
-        if (history.size() > ghist_length) history.pop_front();
+        push_history(resolveDir);
     }
 
 private:
@@ -126,14 +125,25 @@ private:
     };
     std::vector<std::vector<TageEntry>> tage_tables;
     std::vector<uint8_t> bimodal;
-    std::deque<bool> history;
+    using history_t = history_register_t<MAX_HISTORY_LENGTH, HISTORY_SLACK>;
+    history_t history;
+    folded_history_set_t<1, 1> history_fold;  // the whole history folded to 16 bits, the i-th newest at bit (i & 15)
     int ghist_length;
     uint64_t clock;
 
     int provider_table, altpred_table;
     uint64_t provider_idx, altpred_idx;
     bool pred_taken, alt_pred_taken;
-    std::unordered_map<uint64_t, std::deque<bool>> speculative_histories;
+    struct SpecHistory {
+        history_t::checkpoint_t hist;
+        unsigned fold;
+    };
+    checkpoint_ring_t<SpecHistory> speculative_histories;
+
+    void push_history(bool taken) {
+        history_fold.update(taken, { history[ghist_length - 1] });
+        history.push(taken);
+    }
 
     void find_provider(uint64_t PC) {
         provider_table = altpred_table = -1;
@@ -163,12 +173,12 @@ private:
         return (PC ^ (f>>1) ^ (PC >> (bank+2))) & ((1ULL<<TAGE_TAG_BITS[bank]) - 1);
     }
 
+    // The history xored 16 bits at a time from the oldest, the mirror image of history_fold
     uint64_t fold_history(uint64_t mod) const {
+        const unsigned f = history_fold.comp[0][0];
         uint64_t res = 0;
-        int i = 0;
-        for (bool b : history) {
-            res ^= (uint64_t(b) << (i & 15));
-            i++;
+        for (int i = 0; i < 16; i++) {
+            res |= uint64_t((f >> i) & 1) << (15 - i);
         }
         return res % mod;
     }
@@ -0,0 +1,137 @@
+/*
+    REPLAY (TAPE) BRANCH PREDICTOR, see idea.txt
+*/
+
+#ifndef _PREDICTOR_H_
+#define _PREDICTOR_H_
+
+#include <stdlib.h>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include "lib/tape_store.h"
+
+// ------------------------------------------------------------------------
+// Every branch records its outcomes on a tape. When a backward jump has passed over the branch since its last
+// occurrence, the tape is rewound to the flag planted for that jump's target the previous time, and the outcomes
+// recorded after it are replayed as predictions; the first time, the flag is planted at the head. A replayed outcome
+// that turns out wrong is recorded over. Without an outcome under the head, a 2-bit counter per PC predicts.
+//
+// The tapes are operated at update, when the outcome is known, and predict() only reads the head.
+//
+// TAPE_BUDGET: bytes for the tapes and their slots.
+// LOG_TAPES: log2 of the number of tape slots (branches with a tape).
+// JUMP_LOG: number of recent backward jumps looked up for the one that passed over a branch.
+// ------------------------------------------------------------------------
+#define TAPE_BUDGET (4 << 20)
+#define LOG_TAPES 12
+#define JUMP_LOG 64
+#define LOG_BIMODAL 14
+
+class SampleCondPredictor
+{
+    struct backward_jump_t
+    {
+        uint64_t source = 0;
+        uint64_t target = 0;
+    };
+
+    tape_store_t<> tapes;
+    std::array<backward_jump_t, JUMP_LOG> jumps;   // circular, jumps[stamp % JUMP_LOG]
+    uint64_t stamp;                                 // number of backward jumps so far
+    std::vector<uint64_t> last_seen;                // per tape, jumps stamp at the last occurrence of its branch
+    std::vector<uint8_t> bimodal;
+
+    uint64_t bimodal_index(uint64_t PC) const
+    {
+        return (PC ^ (PC >> LOG_BIMODAL)) & ((1 << LOG_BIMODAL) - 1);
+    }
+
+    // Target of the latest backward jump over PC since the given stamp, or 0.
+    uint64_t jumped_over(uint64_t PC, uint64_t since) const
+    {
+        const uint64_t oldest = (stamp > JUMP_LOG) ? (stamp - JUMP_LOG) : 0;
+        for (uint64_t s = stamp; s > std::max(since, oldest); s--)
+        {
+            const backward_jump_t& j = jumps[(s - 1) % JUMP_LOG];
+            if ((j.target <= PC) && (PC < j.source))
+                return j.target;
+        }
+        return 0;
+    }
+
+public:
+
+    SampleCondPredictor(void)
+    : tapes(TAPE_BUDGET, LOG_TAPES), stamp(0)
+    {
+    }
+
+    void setup()
+    {
+        bimodal.assign(1 << LOG_BIMODAL, 1);
+        last_seen.assign(1 << LOG_TAPES, 0);
+        std::cout << "Tape store: " << tapes.bytes() << "B" << std::endl;
+    }
+
+    void terminate()
+    {
+        std::cout << "Tape evictions: " << tapes.num_evictions() << std::endl;
+    }
+
+    bool predict(uint64_t seq_no, uint8_t piece, uint64_t PC, const bool tage_pred)
+    {
+        (void)seq_no; (void)piece; (void)tage_pred;
+        const int t = tapes.find(PC);
+        const int replay = (t == tapes.NONE) ? tapes.NONE : tapes.peek(t);
+        if (replay != tapes.NONE)
+            return replay;
+        return bimodal[bimodal_index(PC)] >= 2;
+    }
+
+    void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC)
+    {
+        (void)seq_no; (void)piece; (void)PC; (void)taken; (void)nextPC;
+    }
+
+    void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC)
+    {
+        (void)seq_no; (void)piece; (void)predDir;
+
+        uint8_t& ctr = bimodal[bimodal_index(PC)];
+        if (resolveDir && (ctr < 3))
+            ctr++;
+        else if (!resolveDir && (ctr > 0))
+            ctr--;
+
+        bool created;
+        const int t = tapes.tape(PC, created);
+        if (created)
+            last_seen[t] = stamp;
+        const uint64_t target = jumped_over(PC, last_seen[t]);
+        if ((target != 0) && !tapes.rewind(t, target))
+            tapes.flag(t, target);
+        last_seen[t] = stamp;
+
+        if (tapes.peek(t) == (int) resolveDir)
+            tapes.advance(t);
+        else
+            tapes.write(t, resolveDir);
+
+        if (resolveDir && (nextPC < PC))
+        {
+            jumps[stamp % JUMP_LOG] = { PC, nextPC };
+            stamp++;
+        }
+    }
+};
+
+// =================
+// Predictor End
+// =================
+
+static SampleCondPredictor cond_predictor_impl;
+
+#endif
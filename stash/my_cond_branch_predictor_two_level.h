@@ -6,10 +6,11 @@
 #define _PREDICTOR_H_
 
 #include <stdlib.h>
-#include <unordered_map>
 #include <vector>
 #include <cstdint>
 #include <cassert>
+#include "lib/checkpoint_ring.h"
+#include "lib/local_history.h"
 
 // ------------------------------------------------------------------------
 // Predictor Configuration Parameters:
@@ -17,12 +18,15 @@
 // HISTORY_LENGTH: Number of bits in the branch history register (k).
 // PT_SETS: Number of sets in the pattern table. Branches are grouped based on PC.
 // PT_ENTRIES: Number of entries per set, equal to 2^k.
+// BHT_SETS, BHT_WAYS: Geometry of the branch history table, tagged by PC.
 //
-// Storage required: PT_SETS * PT_ENTRIES
+// Storage required: PT_SETS * PT_ENTRIES counters, BHT_SETS * BHT_WAYS histories
 // ------------------------------------------------------------------------
 #define HISTORY_LENGTH 4       // k: number of bits in the history register
 #define PT_SETS 256            // Number of pattern table sets (grouping branches by PC)
 #define PT_ENTRIES (1 << HISTORY_LENGTH)  // Number of entries per set (2^k)
+#define BHT_SETS 1024          // Number of branch history table sets
+#define BHT_WAYS 4             // Ways per branch history table set
 
 struct SampleHist
 {
@@ -38,14 +42,14 @@ struct SampleHist
 
 class SampleCondPredictor
 {
-    // Map for storing speculative branch history checkpoints.
-    // The simulator uses a unique identifier (built from seq_no and piece) to index
-    // the history state that was used at prediction time.
-    std::unordered_map<uint64_t, SampleHist> pred_time_histories;
+    // Ring of speculative branch history checkpoints, indexed by the
+    // (seq_no, piece) of the branch, holding the history state that was
+    // used at prediction time.
+    checkpoint_ring_t<SampleHist> pred_time_histories;
     
     // Branch History Table (BHT): maps branch PC to its k-bit history register.
     // This implements the first level of the two-level predictor.
-    std::unordered_map<uint64_t, uint32_t> branch_history;
+    local_history_table_t<BHT_SETS, 2, BHT_WAYS, uint32_t> branch_history;
     
     // Pattern Table: global storage for the two-bit saturating counters.
     // It is organized as PT_SETS sets, each with PT_ENTRIES entries.
@@ -66,9 +70,8 @@ public:
         // - Default value: 1 (weakly not taken).
         pattern_table.resize(PT_SETS * PT_ENTRIES, 1);
         
-        // Clear branch history and speculative checkpoints.
-        branch_history.clear();
-        pred_time_histories.clear();
+        // Clear branch history.
+        branch_history.fill(0);
     }
 
     // Called at the end of simulation. Can be used to dump state if needed.
@@ -94,11 +97,7 @@ public:
         // For the PA predictor, the external tage_pred input is ignored.
         
         // Retrieve the branch's history register for this PC. Default to 0 if unseen.
-        uint32_t history = 0;
-        auto it = branch_history.find(PC);
-        if(it != branch_history.end()){
-            history = it->second;
-        }
+        uint32_t history = branch_history.read(PC);
         
         // Determine the pattern table set using the branch's PC.
         uint64_t set_index = PC % PT_SETS;
@@ -112,11 +111,9 @@ public:
         bool pred_taken = (counter >= 2);
         
         // Save the current history in a speculative checkpoint.
-        SampleHist cp;
+        SampleHist& cp = pred_time_histories.emplace(seq_no, piece);
         cp.ghist = history;         // save the branch history used for this prediction
         cp.tage_pred = pred_taken;  // record the prediction (for bookkeeping)
-        uint64_t unique_inst_id = get_unique_inst_id(seq_no, piece);
-        pred_time_histories.emplace(unique_inst_id, cp);
         
         return pred_taken;
     }
@@ -127,14 +124,9 @@ public:
     void history_update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool taken, uint64_t nextPC)
     {
         // Retrieve current history for the branch; default to 0.
-        uint32_t history = 0;
-        auto it = branch_history.find(PC);
-        if(it != branch_history.end()){
-            history = it->second;
-        }
+        uint32_t& history = branch_history.write(PC);
         // Shift in the new outcome (1 for taken, 0 for not taken)
         history = ((history << 1) | (taken ? 1 : 0)) & ((1 << HISTORY_LENGTH) - 1);
-        branch_history[PC] = history;
     }
 
     // Called after branch resolution to update the predictor.
@@ -142,13 +134,10 @@ public:
     // corresponding pattern table entry.
     void update(uint64_t seq_no, uint8_t piece, uint64_t PC, bool resolveDir, bool predDir, uint64_t nextPC)
     {
-        uint64_t unique_inst_id = get_unique_inst_id(seq_no, piece);
-        auto it = pred_time_histories.find(unique_inst_id);
-        assert(it != pred_time_histories.end());  // Must find the checkpoint!
-        const SampleHist& cp = it->second;
+        const SampleHist& cp = pred_time_histories.at(seq_no, piece);  // Must find the checkpoint!
         update(PC, resolveDir, predDir, nextPC, cp);
         // Remove the checkpoint once update is complete.
-        pred_time_histories.erase(unique_inst_id);
+        pred_time_histories.erase(seq_no, piece);
     }
 
     // Updates the pattern table (second-level) counter that was used for the prediction.
@@ -0,0 +1,340 @@
+// Microbenchmarks of the simulator and predictor hot paths, to catch ns/op regressions without full trace runs.
+//
+// Usage : bench [-t <trace>] [-m <min_time_ms>] [<name_filter>]
+//
+// Each benchmark repeats its body until it has run for at least the minimum time (100ms by default), five times,
+// and reports the fastest and the median repetition as one csv row on stdout:
+//     benchmark,ops,best_ns_per_op,median_ns_per_op,mops_per_sec
+// Only the benchmarks whose name contains name_filter are run. The recorded branch stream and the trace reader use
+// the trace (sample_traces/int/sample_int_trace.gz by default), which must be run from the top of the tree.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+#include "lib/trace_reader.h"
+#include "lib/cache.h"
+#include "lib/resource_schedule.h"
+#include "spdlog/spdlog.h"
+#include "spdlog/fmt/ostr.h"
+#include "lib/stride_prefetcher.h"
+#include "lib/folded_history.h"
+#include "cbp2016_tage_sc_l.h"
+
+namespace {
+
+const char * name_filter = "";
+double min_time_s = 0.1;
+
+// Keeps a result alive, so that the compiler does not drop the work producing it.
+volatile uint64_t sink;
+
+// body() does ops operations per call; it is called repeatedly, with nothing reset in between.
+template <class F>
+void run(const char * name, uint64_t ops, F&& body)
+{
+    if (!strstr(name, name_filter))
+        return;
+    using clock = std::chrono::steady_clock;
+    constexpr int REPS = 5;
+    uint64_t calls = 1;
+    std::vector<double> ns_per_op;
+    while (ns_per_op.size() < REPS)
+    {
+        const auto begin = clock::now();
+        for (uint64_t c = 0; c < calls; c++)
+            body();
+        const double elapsed = std::chrono::duration<double>(clock::now() - begin).count();
+        if (elapsed < min_time_s)
+        {
+            // too short to measure: scale up and retry, the calibration runs also warm up
+            calls *= std::max<uint64_t>(2, std::min<uint64_t>(100, (uint64_t)(1.2*min_time_s/std::max(elapsed, 1e-9))));
+            continue;
+        }
+        ns_per_op.push_back(1e9*elapsed/(calls*ops));
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    printf("%s,%lu,%.3f,%.3f,%.3f\n", name, calls*ops, ns_per_op[0], ns_per_op[REPS/2], 1e3/ns_per_op[REPS/2]);
+    fflush(stdout);
+}
+
+// The predictors are written for static storage, which starts zeroed, and do not initialize all of their state:
+// instances are built in zeroed heap memory in the same way.
+template <class T>
+struct zeroed_delete_t
+{
+    void operator()(T * p) const
+    {
+        p->~T();
+        free(p);
+    }
+};
+
+template <class T, class... Args>
+std::unique_ptr<T, zeroed_delete_t<T>> make_zeroed(Args&&... args)
+{
+    void * mem = calloc(1, sizeof(T));
+    return std::unique_ptr<T, zeroed_delete_t<T>>(new (mem) T(std::forward<Args>(args)...));
+}
+
+struct branch_t
+{
+    uint64_t pc;
+    uint64_t next_pc;
+    int br_type;        // bit 0: conditional, bit 1: indirect, as in spec_update()
+    bool taken;
+};
+
+// Conditional branches of a synthetic program: 512 static branches, biased, periodic (loops) and random.
+std::vector<branch_t> synthetic_branches(uint64_t n)
+{
+    std::mt19937_64 rng(1);
+    std::vector<branch_t> stream(n);
+    for (uint64_t k = 0; k < n; k++)
+    {
+        const uint64_t b = rng() % 512;
+        const uint64_t pc = 0x400000 + 4*b*37;
+        bool taken;
+        if (b % 4 == 0)
+            taken = (rng() % 16) != 0;              // 94% taken
+        else if (b % 4 == 1)
+            taken = (k / 512) % (b % 7 + 2) != 0;   // loop exits
+        else if (b % 4 == 2)
+            taken = rng() & 1;                      // random
+        else
+            taken = (k >> 3) & 1;                   // correlated with neighbours
+        stream[k] = {pc, taken ? pc - 64 : pc + 4, 1, taken};
+    }
+    return stream;
+}
+
+// All the branches of the first max_instrs instructions of a trace.
+std::vector<branch_t> recorded_branches(const char * trace_name, uint64_t max_instrs)
+{
+    std::vector<branch_t> stream;
+    TraceReader reader(trace_name);
+    db_t inst;
+    uint64_t num_instrs = 0;
+    while ((num_instrs < max_instrs) && reader.next(inst))
+    {
+        num_instrs += inst.is_last_piece;
+        if (!is_br(inst.insn_class))
+            continue;
+        int br_type = 0;
+        if (inst.insn_class == InstClass::condBranchInstClass)
+            br_type = 1;
+        else if ((inst.insn_class == InstClass::uncondIndirectBranchInstClass) || (inst.insn_class == InstClass::callIndirectInstClass)
+                 || (inst.insn_class == InstClass::ReturnInstClass))
+            br_type = 2;
+        stream.push_back({inst.pc, inst.next_pc, br_type, inst.is_taken});
+    }
+    return stream;
+}
+
+// predict, history update and update of each conditional branch, in a fresh predictor; the other branches only
+// advance the global history, as in cond_branch_predictor_interface.cc.
+void bench_tage(const char * name, const std::vector<branch_t>& stream)
+{
+    if (!strstr(name, name_filter) || stream.empty())
+        return;
+    auto hist = make_zeroed<cbp_global_history_t>();
+    auto tage = make_zeroed<CBP2016_TAGE_SC_L<>>(*hist);
+    tage->setup();
+    uint64_t seq_no = 0;
+    uint64_t num_cond = 0;
+    for (const branch_t& br : stream)
+        num_cond += br.br_type & 1;
+    run(name, num_cond, [&]() {
+        uint64_t mispreds = 0;
+        for (const branch_t& br : stream)
+        {
+            if (br.br_type & 1)
+            {
+                const bool pred = tage->predict(seq_no, 0, br.pc);
+                tage->history_update(seq_no, 0, br.pc, br.br_type, pred, br.taken, br.next_pc);
+                hist->update(br.pc, br.br_type, br.taken, br.next_pc);
+                tage->update(seq_no, 0, br.pc, br.taken, pred, br.next_pc);
+                mispreds += pred != br.taken;
+            }
+            else
+                hist->update(br.pc, br.br_type, br.taken, br.next_pc);
+            seq_no++;
+        }
+        sink = mispreds;
+    });
+}
+
+// The folded histories of TAGE-SC-L: 40 lengths of 3 registers.
+void bench_folded_history()
+{
+    auto folded = std::make_unique<folded_history_set_t<40, 3, 4096>>();
+    for (int i = 1; i < 40; i++)
+    {
+        const int length = 4 + (i * i * 3) / 2;
+        folded->init(i, 0, length, 10 + i % 3);
+        folded->init(i, 1, length, 8 + i % 5);
+        folded->init(i, 2, length, 7 + i % 5);
+    }
+    std::vector<uint8_t> h(4096);
+    std::mt19937_64 rng(2);
+    for (uint8_t& bit : h)
+        bit = rng() & 1;
+    constexpr uint64_t N = 4096;
+    int pt = 0;
+    run("folded_history_update", N, [&]() {
+        for (uint64_t k = 0; k < N; k++)
+            folded->update(h.data(), --pt);
+        sink = folded->comp[0][1];
+    });
+}
+
+void bench_trace_reader(const char * trace_name)
+{
+    if (!strstr("trace_reader_next", name_filter))
+        return;
+    uint64_t num_pieces = 0;
+    {
+        TraceReader reader(trace_name);
+        db_t inst;
+        while (reader.next(inst))
+            num_pieces++;
+    }
+    run("trace_reader_next", num_pieces, [&]() {
+        TraceReader reader(trace_name);
+        db_t inst;
+        uint64_t pcs = 0;
+        while (reader.next(inst))
+            pcs += inst.pc;
+        sink = pcs;
+    });
+}
+
+// Accesses to the default L1/L2/L3 hierarchy. hit_perc of the accesses go to a 32KB working set, the others stream
+// through 1GB, missing in all the levels.
+void bench_cache(const char * name, int hit_perc)
+{
+    if (!strstr(name, name_filter))
+        return;
+    const sim_config_t cfg;
+    cache_t L3(cfg.L3_SIZE, cfg.L3_ASSOC, cfg.L3_BLOCKSIZE, cfg.L3_LATENCY, nullptr, cfg.MAIN_MEMORY_LATENCY);
+    cache_t L2(cfg.L2_SIZE, cfg.L2_ASSOC, cfg.L2_BLOCKSIZE, cfg.L2_LATENCY, &L3, cfg.MAIN_MEMORY_LATENCY);
+    cache_t L1(cfg.L1_SIZE, cfg.L1_ASSOC, cfg.L1_BLOCKSIZE, cfg.L1_LATENCY, &L2, cfg.MAIN_MEMORY_LATENCY);
+    constexpr uint64_t N = 4096;
+    std::mt19937_64 rng(3);
+    std::vector<uint64_t> addrs(N);
+    uint64_t stream_addr = 1ull << 32;
+    for (uint64_t& addr : addrs)
+        addr = ((int)(rng() % 100) < hit_perc) ? 0x10000000 + (rng() % (32 << 10)) : 0;
+    uint64_t cycle = 0;
+    run(name, N, [&]() {
+        uint64_t ready = 0;
+        for (uint64_t addr : addrs)
+        {
+            if (addr == 0)
+            {
+                addr = stream_addr;
+                stream_addr = (stream_addr + 64) & ((1ull << 30) - 1);
+                addr |= 1ull << 32;
+            }
+            ready += L1.access(cycle++, true, addr);
+        }
+        sink = ready;
+    });
+}
+
+// Width-8 schedule with 6 requests per cycle, each up to 32 cycles ahead of the base cycle, so that they collide.
+void bench_resource_schedule()
+{
+    resource_schedule lanes(8);
+    std::mt19937_64 rng(4);
+    constexpr uint64_t N = 4096;
+    std::vector<uint64_t> offsets(N);
+    for (uint64_t& offset : offsets)
+        offset = rng() % 32;
+    uint64_t base = 0;
+    run("resource_schedule_contended", N, [&]() {
+        uint64_t last = 0;
+        for (uint64_t k = 0; k < N; k++)
+        {
+            last = lanes.schedule(base + offsets[k]);
+            if (k % 6 == 5)
+                lanes.advance_base_cycle(++base);
+        }
+        sink = last;
+    });
+}
+
+// Loads of 64 strided streams, one in four of them at a random address, with the generated prefetches drained.
+void bench_prefetcher()
+{
+    auto prefetcher = std::make_unique<StridePrefetcher>();
+    std::mt19937_64 rng(5);
+    constexpr uint64_t N = 4096;
+    std::vector<PrefetchTrainingInfo> loads(N);
+    std::array<uint64_t, 64> next_addr;
+    for (uint64_t s = 0; s < next_addr.size(); s++)
+        next_addr[s] = (s + 1) << 24;
+    for (PrefetchTrainingInfo& info : loads)
+    {
+        const uint64_t s = rng() % next_addr.size();
+        const bool random = (rng() % 4) == 0;
+        info = {0x1000 + s, random ? rng() % (1ull << 32) : next_addr[s], 0, random};
+        if (!random)
+            next_addr[s] += 8 * (s % 8 + 1);
+    }
+    uint64_t cycle = 0;
+    run("prefetcher_train", N, [&]() {
+        Prefetch p(0, 0, 0);
+        uint64_t issued = 0;
+        for (const PrefetchTrainingInfo& info : loads)
+        {
+            prefetcher->lookahead(info.pc, cycle);
+            prefetcher->train(info);
+            while (prefetcher->issue(p, cycle))
+                issued++;
+            cycle++;
+        }
+        sink = issued;
+    });
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    const char * trace_name = "sample_traces/int/sample_int_trace.gz";
+    int i = 1;
+    for (; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "-t"))
+            trace_name = argv[i + 1];
+        else if (!strcmp(argv[i], "-m"))
+            min_time_s = atof(argv[i + 1]) / 1000.0;
+        else
+            break;
+    }
+    if (i < argc)
+        name_filter = argv[i];
+    spdlog::set_level(spdlog::level::info);
+    // the trace reader reports its progress on std::cout: keep stdout to the results
+    std::cout.setstate(std::ios::badbit);
+
+    printf("benchmark,ops,best_ns_per_op,median_ns_per_op,mops_per_sec\n");
+    bench_tage("tage_predict_update_synthetic", synthetic_branches(1 << 16));
+    if (strstr("tage_predict_update_recorded", name_filter))
+        bench_tage("tage_predict_update_recorded", recorded_branches(trace_name, 1000000));
+    bench_folded_history();
+    bench_trace_reader(trace_name);
+    bench_cache("cache_access_hit95", 95);
+    bench_cache("cache_access_hit50", 50);
+    bench_cache("cache_access_miss", 0);
+    bench_resource_schedule();
+    bench_prefetcher();
+    return 0;
+}
@@ -0,0 +1,425 @@
+// Converts a .gz CBP trace into the pre-cracked native format (lib/native_trace.h), or with -b into a compact
+// branch-only trace (lib/branch_trace.h), or with -c into a block trace that several threads decompress
+// (lib/block_trace.h), or with -d into a static trace that stores each static instruction once (lib/static_trace.h),
+// or with -D scans the traces of a family into the static dictionary that their static traces can share,
+// or with -i writes the seek index of a trace (lib/trace_index.h), or with -s scans traces for
+// their summary (lib/trace_summary.h), or with -p picks the SimPoint simulation points of a trace (lib/simpoint.h),
+// or with -x cuts a range of instructions, or every simulation point, out of a trace into a trace of its own.
+//
+// Usage : convert_trace [-b] <trace.gz> <output>
+//         convert_trace -c <trace.gz> <output> [<instrs_per_block>[,stored]]
+//         convert_trace -d <trace> <output> [novalues] [<dictionary>]
+//         convert_trace -D <output_dir> <trace> [<trace>...]
+//         convert_trace -i <trace> [<instrs_per_mark>]
+//         convert_trace -s <trace> [<trace>...]
+//         convert_trace -p <trace> [<interval_instrs>[,<max_k>]]
+//         convert_trace -x <trace> <output> <first_instr>,<num_instrs>[,<warmup_instrs>] [native]
+//         convert_trace -x <trace> <output_prefix> simpoints[,<warmup_instrs>] [native]
+//
+// The simulator detects all these formats by their magic, so the output can be passed to cbp in place of the .gz trace.
+// Branch traces only keep what the predictor sees and are always replayed in branch-only mode (see -X).
+// The index is written next to the trace (<trace>.idx), where the simulator looks for it to fast-forward, e.g. when
+// resuming from a snapshot (-s). So is the summary (<trace>.sum), which a scan only writes if it is missing or stale,
+// and the simulation points (<trace>.simpts), which cbp -K simpoints,... simulates.
+// A subset (-x) starts with its warmup instructions, and is a gzip trace of the inflated bytes of its instructions,
+// or with native a native trace of their pieces; the trace is read from the mark of its index before the subset.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include "lib/trace_reader.h"
+#include "lib/native_trace.h"
+#include "lib/branch_trace.h"
+#include "lib/block_trace.h"
+#include "lib/static_trace.h"
+#include "lib/trace_index.h"
+#include "lib/trace_summary.h"
+#include "lib/simpoint.h"
+
+// Bytes of inflated trace between two access points: the most inflated in vain when seeking, at 32KB of index each.
+static constexpr uint64_t INDEX_SPAN = 1 << 20;
+
+static int write_index(const char * trace_name, uint64_t instrs_per_mark)
+{
+    trace_index_t index;
+    {
+        TraceReader reader(trace_name);
+        db_t inst;
+        uint64_t num_pieces = 0, num_instrs = 0;
+        while (reader.next(inst))
+        {
+            num_pieces++;
+            if (inst.is_last_piece && (++num_instrs % instrs_per_mark == 0))
+                index.marks.push_back({reader.position(), num_instrs, num_pieces});
+        }
+        index.num_instrs = num_instrs;
+    }
+    if (!native_trace_reader_t::is_native(trace_name) && !block_trace_reader_t::is_block_trace(trace_name)
+        && !index.build_points(trace_name, INDEX_SPAN))
+    {
+        fprintf(stderr, "Unable to index %s: not a valid gzip trace\n", trace_name);
+        return 1;
+    }
+    if (!index.save(trace_name))
+    {
+        fprintf(stderr, "Unable to create %s\n", trace_index_t::path_for(trace_name).c_str());
+        return 1;
+    }
+
+    printf("Wrote %lu marks and %lu access points to %s\n", index.marks.size(), index.points.size(), trace_index_t::path_for(trace_name).c_str());
+    return 0;
+}
+
+// Cuts the inflated stream of in_path into blocks of instrs_per_block trace instructions: a TraceReader finds the
+// instruction boundaries, and a second inflation of the trace supplies the bytes up to them.
+static int write_block_trace(const char * in_path, const char * out_path, uint64_t instrs_per_block, block_trace_codec_t codec)
+{
+    block_trace_writer_t writer(out_path, codec, instrs_per_block);
+    if (!writer.good())
+    {
+        fprintf(stderr, "Unable to create %s\n", out_path);
+        return 1;
+    }
+
+    gz_block_reader_t raw(in_path);
+    std::vector<char> block;
+    uint64_t num_pieces = 0, num_instrs = 0;
+    uint64_t block_pieces = 0, block_instrs = 0, block_end = 0;
+    bool ok = true;
+    auto flush = [&]() {
+        block.resize(block_end - raw.tell());
+        ok = ok && raw.read(block.data(), block.size()) && writer.append(block.data(), block.size(), block_instrs, block_pieces);
+        block_pieces = num_pieces;
+        block_instrs = num_instrs;
+    };
+    {
+        TraceReader reader(in_path);
+        db_t inst;
+        while (ok && reader.next(inst))
+        {
+            num_pieces++;
+            if (!inst.is_last_piece)
+                continue;
+            num_instrs++;
+            // bytes past the last complete instruction end the trace, as for TraceReader
+            block_end = reader.position();
+            if (num_instrs - block_instrs == instrs_per_block)
+                flush();
+        }
+    }
+    if (ok && (num_instrs > block_instrs))
+        flush();
+    if (!ok || !writer.close(num_instrs, num_pieces))
+    {
+        fprintf(stderr, "Unable to write %s\n", out_path);
+        return 1;
+    }
+
+    printf("Wrote %lu instructions in %lu blocks to %s\n", num_instrs, writer.num_blocks(), out_path);
+    return 0;
+}
+
+// Reads in_path twice: once to build the table of static instructions, and once to write their records.
+static int write_static_trace(const char * in_path, const char * out_path, bool values, const char * dict_path)
+{
+    std::shared_ptr<static_dictionary_t> dict;
+    if (dict_path && !(dict = static_dictionary_t::load(dict_path, 0)))
+    {
+        fprintf(stderr, "%s is not a static dictionary (convert_trace -D)\n", dict_path);
+        return 1;
+    }
+    static_trace_writer_t writer(out_path, values, dict.get());
+    if (!writer.good())
+    {
+        fprintf(stderr, "Unable to create %s\n", out_path);
+        return 1;
+    }
+
+    uint64_t num_instrs = 0;
+    db_t inst;
+    {
+        TraceReader reader(in_path);
+        while (reader.next(inst))
+            writer.scan(inst);
+    }
+    {
+        TraceReader reader(in_path);
+        while (reader.next(inst))
+        {
+            writer.append(inst);
+            num_instrs += inst.is_last_piece;
+        }
+    }
+    if (!writer.close())
+    {
+        fprintf(stderr, "Unable to write %s\n", out_path);
+        return 1;
+    }
+
+    if (dict)
+        printf("Wrote %lu instructions of %lu static instructions to %s, and %lu more in %s\n", num_instrs, dict->keys.size(), dict_path,
+               writer.num_statics(), out_path);
+    else
+        printf("Wrote %lu instructions of %lu static instructions to %s\n", num_instrs, writer.num_statics(), out_path);
+    return 0;
+}
+
+// Scans the traces of a family into their static dictionary, written into out_dir.
+static int write_static_dictionary(const char * out_dir, char ** traces, int num_traces)
+{
+    static_dictionary_builder_t builder;
+    db_t inst;
+    for (int t = 0; t < num_traces; t++)
+    {
+        TraceReader reader(traces[t]);
+        while (reader.next(inst))
+            builder.scan(inst);
+    }
+    const std::string path = builder.write(out_dir);
+    if (path.empty())
+    {
+        fprintf(stderr, "Unable to write the static dictionary into %s\n", out_dir);
+        return 1;
+    }
+    printf("Wrote %lu static instructions of %d traces to %s\n", builder.num_statics(), num_traces, path.c_str());
+    return 0;
+}
+
+// Writes trace instructions [first - warmup, first + count) of in_path to out_path, as a gzip trace or a native trace.
+static int write_subset(const char * in_path, const char * out_path, uint64_t first, uint64_t count, uint64_t warmup, bool native)
+{
+    const uint64_t begin = first - std::min(first, warmup);
+    const uint64_t end = first + count;
+    uint64_t num_instrs = 0, from = 0, to = 0;
+    {
+        TraceReader reader(in_path);
+        if (!native && reader.is_cracked())
+        {
+            fprintf(stderr, "%s is a native or static trace, whose subsets are native traces: add native\n", in_path);
+            return 1;
+        }
+        std::unique_ptr<native_trace_writer_t> writer(native ? new native_trace_writer_t(out_path) : nullptr);
+        if (writer && !writer->good())
+        {
+            fprintf(stderr, "Unable to create %s\n", out_path);
+            return 1;
+        }
+        reader.seek(begin);
+        num_instrs = reader.num_instrs();
+        db_t inst;
+        while ((num_instrs < begin) && reader.next(inst))
+            num_instrs += inst.is_last_piece;
+        from = reader.position();
+        while ((num_instrs < end) && reader.next(inst))
+        {
+            if (writer)
+                writer->append(inst);
+            num_instrs += inst.is_last_piece;
+        }
+        to = reader.position();
+    }
+    if (num_instrs <= begin)
+    {
+        fprintf(stderr, "%s ends at instruction %lu, before the subset\n", in_path, num_instrs);
+        return 1;
+    }
+
+    if (!native)
+    {
+        gz_block_reader_t raw(in_path);
+        trace_index_mark_t block_mark;
+        trace_index_t index;
+        bool ok = raw.seek_block(begin, block_mark) ? raw.skip(from - block_mark.out)
+                                                    : raw.seek(in_path, index.load(in_path) ? index.find_point(from) : nullptr, from);
+        gzFile out = gzopen(out_path, "wb6");
+        if (!out)
+        {
+            fprintf(stderr, "Unable to create %s\n", out_path);
+            return 1;
+        }
+        std::vector<char> buf(1 << 20);
+        for (uint64_t left = to - from; ok && (left > 0); )
+        {
+            const size_t n = std::min<uint64_t>(left, buf.size());
+            ok = raw.read(buf.data(), n) && (gzwrite(out, buf.data(), n) == (int)n);
+            left -= n;
+        }
+        if ((gzclose(out) != Z_OK) || !ok)
+        {
+            fprintf(stderr, "Unable to write %s\n", out_path);
+            return 1;
+        }
+    }
+
+    printf("Wrote instructions %lu to %lu to %s, the first %lu of them warmup\n", begin, num_instrs, out_path, first - begin);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if ((argc >= 3) && !strcmp(argv[1], "-s"))
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            trace_summary_t::get(argv[i]).print(argv[i]);
+            printf("\n");
+        }
+        return 0;
+    }
+
+    if ((argc == 3 || argc == 4) && !strcmp(argv[1], "-p"))
+    {
+        uint64_t interval_instrs = 10000000, max_k = 10;
+        if ((argc == 4) && (sscanf(argv[3], "%lu,%lu", &interval_instrs, &max_k) < 1))
+            interval_instrs = 0;
+        if ((interval_instrs == 0) || (max_k == 0))
+        {
+            printf("usage:\t%s -p <trace> [<interval_instrs>[,<max_k>]]\n", argv[0]);
+            return 1;
+        }
+        simpoint_profile_t profile;
+        profile.build(argv[2], interval_instrs, max_k);
+        if (profile.points.empty() || !profile.save(argv[2]))
+        {
+            fprintf(stderr, "Unable to write %s\n", simpoint_profile_t::path_for(argv[2]).c_str());
+            return 1;
+        }
+        profile.print(argv[2]);
+        return 0;
+    }
+
+    if ((argc == 3 || argc == 4) && !strcmp(argv[1], "-i"))
+    {
+        const uint64_t instrs_per_mark = (argc == 4) ? strtoull(argv[3], nullptr, 10) : 100000;
+        if (instrs_per_mark == 0)
+        {
+            printf("usage:\t%s -i <trace> [<instrs_per_mark>]\n", argv[0]);
+            return 1;
+        }
+        return write_index(argv[2], instrs_per_mark);
+    }
+
+    if ((argc == 4 || argc == 5) && !strcmp(argv[1], "-c"))
+    {
+        char * p = nullptr;
+        const uint64_t instrs_per_block = (argc == 5) ? strtoull(argv[4], &p, 10) : 100000;
+        const bool stored = p && !strcmp(p, ",stored");
+        if ((instrs_per_block == 0) || (p && *p && !stored))
+        {
+            printf("usage:\t%s -c <trace.gz> <output> [<instrs_per_block>[,stored]]\n", argv[0]);
+            return 1;
+        }
+        return write_block_trace(argv[2], argv[3], instrs_per_block, stored ? BLOCK_CODEC_STORED : BLOCK_CODEC_DEFLATE);
+    }
+
+    if ((argc >= 4 && argc <= 6) && !strcmp(argv[1], "-d"))
+    {
+        const bool novalues = (argc >= 5) && !strcmp(argv[4], "novalues");
+        if ((argc == 6) && !novalues)
+        {
+            printf("usage:\t%s -d <trace> <output> [novalues] [<dictionary>]\n", argv[0]);
+            return 1;
+        }
+        const char * dict_path = (argc == 6) ? argv[5] : ((argc == 5) && !novalues) ? argv[4] : nullptr;
+        return write_static_trace(argv[2], argv[3], !novalues, dict_path);
+    }
+
+    if ((argc >= 4) && !strcmp(argv[1], "-D"))
+        return write_static_dictionary(argv[2], argv + 3, argc - 3);
+
+    if ((argc == 5 || argc == 6) && !strcmp(argv[1], "-x"))
+    {
+        const bool native = (argc == 6) && !strcmp(argv[5], "native");
+        uint64_t first = 0, count = 0, warmup = 0;
+        const bool simpoints = !strncmp(argv[4], "simpoints", 9);
+        const bool valid = simpoints ? (!argv[4][9] || (sscanf(argv[4] + 9, ",%lu", &warmup) == 1))
+                                     : ((sscanf(argv[4], "%lu,%lu,%lu", &first, &count, &warmup) >= 2) && (count > 0));
+        if (!valid || ((argc == 6) && !native))
+        {
+            printf("usage:\t%s -x <trace> <output> <first_instr>,<num_instrs>[,<warmup_instrs>] [native]\n"
+                   "\t%s -x <trace> <output_prefix> simpoints[,<warmup_instrs>] [native]\n", argv[0], argv[0]);
+            return 1;
+        }
+        if (!simpoints)
+            return write_subset(argv[2], argv[3], first, count, warmup, native);
+
+        simpoint_profile_t profile;
+        if (!profile.load(argv[2]))
+        {
+            fprintf(stderr, "No simulation points for %s: convert_trace -p %s first\n", argv[2], argv[2]);
+            return 1;
+        }
+        for (size_t k = 0; k < profile.points.size(); k++)
+        {
+            const simpoint_profile_t::point_t& point = profile.points[k];
+            const std::string out_path = std::string(argv[3]) + "_" + std::to_string(k) + (native ? ".cbpn" : ".gz");
+            printf("Simulation point %lu, interval %lu, weight %.4f\n", k, point.interval, point.weight);
+            if (write_subset(argv[2], out_path.c_str(), point.interval * profile.interval_instrs, profile.interval_instrs, warmup, native))
+                return 1;
+        }
+        return 0;
+    }
+
+    const bool branch_only = (argc == 4) && !strcmp(argv[1], "-b");
+    if (argc != 3 && !branch_only)
+    {
+        printf("usage:\t%s [-b] <input .gz trace> <output native trace, or branch trace with -b>\n"
+               "\t%s -c <input .gz trace> <output block trace> [<instrs_per_block>[,stored]] to cut the trace into blocks decompressed in parallel (100000 instructions each and deflate by default)\n"
+               "\t%s -d <trace> <output static trace> [novalues] [<dictionary>] to store each static instruction once, and a short record per trace instruction (with output values unless novalues), the static instructions of a dictionary (-D) only in it\n"
+               "\t%s -D <output_dir> <trace> [<trace>...] to write the static dictionary of the traces of a family, <output_dir>/<hash>.cbpdict, that their static traces (-d) can share\n"
+               "\t%s -i <trace> [<instrs_per_mark>] to write the seek index <trace>.idx (a mark every 100000 instructions by default)\n"
+               "\t%s -s <trace> [<trace>...] to print the summary of each trace, scanned into <trace>.sum if missing\n"
+               "\t%s -p <trace> [<interval_instrs>[,<max_k>]] to write the SimPoint simulation points <trace>.simpts (10000000 instructions per interval and at most 10 clusters by default)\n"
+               "\t%s -x <trace> <output> <first_instr>,<num_instrs>[,<warmup_instrs>] [native] to cut instructions out of the trace, after <warmup_instrs> before them, into a .gz (or native) trace\n"
+               "\t%s -x <trace> <output_prefix> simpoints[,<warmup_instrs>] [native] to cut every simulation point (-p) out of the trace, into <output_prefix>_<k>.gz (or .cbpn)\n",
+               argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    const char * in_path = argv[argc - 2];
+    const char * out_path = argv[argc - 1];
+
+    if (branch_only)
+    {
+        branch_trace_writer_t writer(out_path);
+        if (!writer.good())
+        {
+            fprintf(stderr, "Unable to create %s\n", out_path);
+            return 1;
+        }
+
+        {
+            TraceReader reader(in_path);
+            db_t inst;
+            while (reader.next(inst))
+                writer.append(inst.insn_class, inst.pc, inst.next_pc, inst.is_taken, inst.is_last_piece);
+        }
+        writer.close();
+
+        printf("Wrote %lu branches to %s\n", writer.num_branches(), out_path);
+        return 0;
+    }
+
+    native_trace_writer_t writer(out_path);
+    if (!writer.good())
+    {
+        fprintf(stderr, "Unable to create %s\n", out_path);
+        return 1;
+    }
+
+    uint64_t num_pieces = 0;
+    {
+        TraceReader reader(in_path);
+        db_t inst;
+        while (reader.next(inst))
+        {
+            writer.append(inst);
+            num_pieces++;
+        }
+    }
+    writer.close();
+
+    printf("Wrote %lu pieces to %s\n", num_pieces, out_path);
+    return 0;
+}
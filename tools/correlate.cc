@@ -0,0 +1,354 @@
+// Branch-correlation analysis of the hard branches of a trace: for each of the top-N mispredicted branches of a
+// profile (cbp -H), the mutual information between its direction and every candidate history bit within long windows,
+// to tell which history types, and how long, a predictor needs for it.
+//
+// Usage : correlate [-j <jobs>] [-n <top_n>] [-w <window>] [-i <max_instrs>] [-o <results.csv>] <profile.csv> <trace>
+//
+// The trace is an instruction trace (.gz or native) or a branch trace (convert_trace -b), of which only the first
+// <max_instrs> instructions are kept (default: all); the profile is the CSV of cbp -H on it, of which the <top_n>
+// branches with the most mispredictions are analyzed (default 20). The candidate bits, at each execution of a branch:
+//
+//   global  the direction of the k-th last conditional branch, k = 1..<window> (default 1024)
+//   path    bit 2 of the PC of the k-th last branch of any kind, k = 1..<window>
+//   local   the direction of the branch at its own k-th last execution, k = 1..64
+//   imli    whether the IMLI count (taken backward conditional branches in a row, as in TAGE-SC-L, 63 at most) is k,
+//           k = 0..63
+//
+// For a bit X and the direction Y, I(X;Y) is in bits, less the bias of its estimate, and reported over H(Y), as the
+// share of the branch's uncertainty the bit alone removes. The summary gives, per branch and history type, the most
+// informative position and the reach, the furthest position with at least 5% of H(Y); -o writes a csv row for every
+// bit.
+//
+// The stream is held compressed in memory (lib/branch_stream.h), and -j threads (default: one per core) take the
+// branches in turn, each walking the whole stream for its branch. The candidate bits of 64 executions of the branch
+// are gathered as 64 rows, and transposed into one word per bit, so that the counts are popcounts of whole words:
+// plain loops of __builtin_popcountll, which the compiler turns into vector popcounts where the target has them (the
+// Makefile builds with -march=native).
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lib/branch_stream.h"
+
+namespace {
+
+enum kind_t
+{
+    KIND_GLOBAL,
+    KIND_PATH,
+    KIND_LOCAL,
+    KIND_IMLI,
+    NUM_KINDS
+};
+
+const char * const kind_names[] = {"global", "path", "local", "imli"};
+
+constexpr uint64_t LOCAL_BITS = 64;
+constexpr uint64_t IMLI_BITS = 64;
+constexpr double REACH_SHARE = 0.05;     // of H(Y), for a position to count in the reach
+
+struct target_t
+{
+    uint64_t pc;
+    uint64_t profile_execs;
+    uint64_t profile_mispreds;
+
+    // results
+    uint64_t execs = 0;
+    uint64_t taken = 0;
+    std::vector<uint64_t> ones;         // executions with the bit set, per bit
+    std::vector<uint64_t> ones_taken;   // of which taken
+};
+
+// Row layout: global, path, local, imli, each a whole number of words.
+struct layout_t
+{
+    uint64_t window;
+
+    uint64_t begin(kind_t k) const
+    {
+        switch (k)
+        {
+            case KIND_GLOBAL: return 0;
+            case KIND_PATH: return window;
+            case KIND_LOCAL: return 2 * window;
+            case KIND_IMLI: return 2 * window + LOCAL_BITS;
+            default: return 2 * window + LOCAL_BITS + IMLI_BITS;
+        }
+    }
+
+    uint64_t size(kind_t k) const
+    {
+        return begin(kind_t(k + 1)) - begin(k);
+    }
+
+    uint64_t bits() const
+    {
+        return begin(NUM_KINDS);
+    }
+
+    uint64_t words() const
+    {
+        return bits() / 64;
+    }
+};
+
+// Top branches of a profile written by cbp -H, most mispredicted first.
+std::vector<target_t> read_profile(const char * path, uint64_t top_n)
+{
+    FILE * f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open profile %s\n", path);
+        exit(1);
+    }
+    std::vector<target_t> targets;
+    char line[4096];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, "PC,Execs,Mispreds", 17))
+    {
+        fprintf(stderr, "%s is not a branch profile (cbp -H)\n", path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        target_t t;
+        if (sscanf(line, "0x%" SCNx64 ",%" SCNu64 ",%" SCNu64, &t.pc, &t.profile_execs, &t.profile_mispreds) == 3)
+            targets.push_back(t);
+    }
+    fclose(f);
+    std::stable_sort(targets.begin(), targets.end(), [](const target_t& a, const target_t& b) {
+        return a.profile_mispreds > b.profile_mispreds;
+    });
+    if ((top_n != 0) && (targets.size() > top_n))
+        targets.resize(top_n);
+    return targets;
+}
+
+// In-place transpose of a 64x64 bit matrix: bit j of word i goes to bit i of word j.
+void transpose64(uint64_t * m)
+{
+    uint64_t mask = 0x00000000FFFFFFFFull;
+    for (int s = 32; s != 0; s >>= 1, mask ^= mask << s)
+        for (int i = 0; i < 64; i = (i + s + 1) & ~s)
+        {
+            const uint64_t t = ((m[i] >> s) ^ m[i + s]) & mask;
+            m[i] ^= t << s;
+            m[i + s] ^= t;
+        }
+}
+
+// Counts of one word of 64 bits over 64 executions: cols[b] holds bit b at each execution, y the directions.
+void count_columns(const uint64_t * cols, uint64_t y, uint64_t * ones, uint64_t * ones_taken)
+{
+    for (int b = 0; b < 64; b++)
+        ones[b] += __builtin_popcountll(cols[b]);
+    for (int b = 0; b < 64; b++)
+        ones_taken[b] += __builtin_popcountll(cols[b] & y);
+}
+
+// Walks the stream and gathers the counts of one branch.
+void analyze(const branch_stream_t& stream, const layout_t& layout, target_t& t)
+{
+    const uint64_t words = layout.words();
+    const uint64_t window_words = layout.window / 64;
+    t.ones.assign(layout.bits(), 0);
+    t.ones_taken.assign(layout.bits(), 0);
+
+    // running histories, the most recent at bit 0 of word 0
+    std::vector<uint64_t> global(window_words, 0), path(window_words, 0);
+    uint64_t local = 0;
+    uint64_t imli = 0;
+    auto shift_in = [](std::vector<uint64_t>& h, uint64_t bit) {
+        for (uint64_t w = h.size() - 1; w > 0; w--)
+            h[w] = (h[w] << 1) | (h[w - 1] >> 63);
+        h[0] = (h[0] << 1) | bit;
+    };
+
+    // the rows of up to 64 executions, then their directions
+    std::vector<uint64_t> rows(64 * words, 0);
+    std::vector<uint64_t> cols(64);
+    uint64_t num_rows = 0, y = 0;
+    auto flush = [&]() {
+        for (uint64_t w = 0; w < words; w++)
+        {
+            for (uint64_t r = 0; r < 64; r++)
+                cols[r] = (r < num_rows) ? rows[r * words + w] : 0;
+            transpose64(cols.data());
+            count_columns(cols.data(), y, &t.ones[w * 64], &t.ones_taken[w * 64]);
+        }
+        num_rows = 0;
+        y = 0;
+    };
+
+    const uint64_t local_word = layout.begin(KIND_LOCAL) / 64;
+    const uint64_t imli_word = layout.begin(KIND_IMLI) / 64;
+    branch_stream_t::block_t block;
+    for (uint64_t b = 0; b < stream.num_blocks(); b++)
+    {
+        stream.decode_block(b, block);
+        for (uint64_t i = 0; i < block.count; i++)
+        {
+            const uint64_t pc = block.pc[i];
+            const bool taken = block.is_taken(i);
+            const bool conditional = block.insn_class(i) == InstClass::condBranchInstClass;
+            if (pc == t.pc && conditional)
+            {
+                uint64_t * row = &rows[num_rows * words];
+                std::copy(global.begin(), global.end(), row);
+                std::copy(path.begin(), path.end(), row + window_words);
+                row[local_word] = local;
+                row[imli_word] = uint64_t(1) << imli;
+                y |= uint64_t(taken) << num_rows;
+                t.execs++;
+                t.taken += taken;
+                local = (local << 1) | taken;
+                if (++num_rows == 64)
+                    flush();
+            }
+            if (conditional)
+            {
+                shift_in(global, taken);
+                if (block.next_pc[i] < pc)
+                    imli = taken ? std::min<uint64_t>(imli + 1, IMLI_BITS - 1) : 0;
+            }
+            shift_in(path, (pc >> 2) & 1);
+        }
+    }
+    if (num_rows)
+        flush();
+}
+
+// Entropy in bits of a binary variable of probability p.
+double entropy(double p)
+{
+    return ((p <= 0.0) || (p >= 1.0)) ? 0.0 : -p * std::log2(p) - (1 - p) * std::log2(1 - p);
+}
+
+// I(X;Y) = H(Y) - H(Y|X) from the counts of n executions, x1 with X set, y1 taken, xy1 both, less the Miller-Madow
+// bias of the estimate, 1 / (2 n ln 2) bits for two binary variables, which would otherwise credit every bit of a
+// rarely executed branch with some information.
+double mutual_information(uint64_t n, uint64_t x1, uint64_t y1, uint64_t xy1)
+{
+    if ((n == 0) || (x1 == 0) || (x1 == n))
+        return 0.0;
+    const uint64_t x0 = n - x1, xy0 = y1 - xy1;
+    double conditional = 0.0;
+    if (x1)
+        conditional += (double)x1 / n * entropy((double)xy1 / x1);
+    if (x0)
+        conditional += (double)x0 / n * entropy((double)xy0 / x0);
+    return std::max(0.0, entropy((double)y1 / n) - conditional - 1.0 / (2.0 * n * std::log(2.0)));
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned jobs = 0;
+    uint64_t top_n = 20;
+    uint64_t window = 1024;
+    uint64_t max_instrs = UINT64_MAX;
+    const char * csv_path = nullptr;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (!strcmp(argv[i], "-j"))
+            jobs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-n"))
+            top_n = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-w"))
+            window = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-i"))
+            max_instrs = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-o"))
+            csv_path = argv[i + 1];
+        else
+            break;
+    }
+    if (i + 2 != argc)
+    {
+        printf("usage:\t%s [-j <jobs>] [-n <top_n>] [-w <window>] [-i <max_instrs>] [-o <results.csv>] <profile.csv> <trace>\n", argv[0]);
+        return 0;
+    }
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    // whole words of history
+    const layout_t layout{std::max<uint64_t>(64, (window + 63) / 64 * 64)};
+
+    std::vector<target_t> targets = read_profile(argv[i], top_n);
+    if (targets.empty())
+    {
+        fprintf(stderr, "No branch in profile %s\n", argv[i]);
+        return 1;
+    }
+    const branch_stream_t stream = load_branch_stream(argv[i + 1], max_instrs);
+    printf("Loaded %s: %lu branches in %lu instructions\n", argv[i + 1], stream.num_branches(), stream.num_instrs());
+    printf("Analyzing %lu branches over %lu bits of history on %u threads\n", targets.size(), layout.bits(), jobs);
+    fflush(stdout);
+
+    std::atomic<uint64_t> next_target(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < std::min<uint64_t>(jobs, targets.size()); t++)
+        threads.emplace_back([&]() {
+            for (uint64_t k; (k = next_target++) < targets.size();)
+                analyze(stream, layout, targets[k]);
+        });
+    for (std::thread& t : threads)
+        t.join();
+
+    FILE * csv = csv_path ? fopen(csv_path, "w") : nullptr;
+    if (csv_path && !csv)
+    {
+        perror(csv_path);
+        return 1;
+    }
+    if (csv)
+        fprintf(csv, "PC,Execs,Mispreds,Entropy,Kind,Position,MI,MIShare\n");
+
+    for (const target_t& t : targets)
+    {
+        const double h = entropy(t.execs ? (double)t.taken / t.execs : 0.0);
+        printf("\n0x%lx: %lu executions (%lu mispredicted in the profile), taken %.2f%%, H %.4f bits\n", t.pc, t.execs,
+               t.profile_mispreds, t.execs ? 100.0 * t.taken / t.execs : 0.0, h);
+        if (t.execs == 0)
+        {
+            printf("  not a conditional branch of the trace\n");
+            continue;
+        }
+        for (int k = 0; k < NUM_KINDS; k++)
+        {
+            const kind_t kind = kind_t(k);
+            uint64_t best = 0, reach = 0;
+            double best_mi = -1.0;
+            for (uint64_t p = 0; p < layout.size(kind); p++)
+            {
+                const uint64_t bit = layout.begin(kind) + p;
+                const double mi = mutual_information(t.execs, t.ones[bit], t.taken, t.ones_taken[bit]);
+                // the history positions count from the last branch, the IMLI ones from a count of 0
+                const uint64_t position = (kind == KIND_IMLI) ? p : p + 1;
+                if (mi > best_mi)
+                {
+                    best_mi = mi;
+                    best = position;
+                }
+                if ((h > 0.0) && (mi >= REACH_SHARE * h))
+                    reach = position;
+                if (csv)
+                    fprintf(csv, "0x%lx,%lu,%lu,%.6f,%s,%lu,%.6f,%.6f\n", t.pc, t.execs, t.profile_mispreds, h, kind_names[k],
+                            position, mi, (h > 0.0) ? mi / h : 0.0);
+            }
+            printf("  %-6s best %4lu: %.4f bits (%5.1f%% of H), reach %lu\n", kind_names[k], best, best_mi,
+                   (h > 0.0) ? 100.0 * best_mi / h : 0.0, reach);
+        }
+    }
+    if (csv)
+        fclose(csv);
+    return 0;
+}
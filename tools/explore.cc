@@ -0,0 +1,365 @@
+// Design-space exploration of TAGE-SC-L geometries: every geometry of tools/explore_space.h whose predictorsize() fits
+// the storage budget is evaluated on the branch streams of a set of traces, held in memory (compressed, see
+// lib/branch_stream.h), by successive halving.
+// Each round runs the surviving geometries on the first <instrs> instructions of every trace and keeps the best 1 in
+// <eta> by mean MPKI, and the next round multiplies the instructions by <eta>. Configurations that are poor on short
+// prefixes are dropped early, and the survivors get the full streams.
+//
+// Usage : explore [-j <jobs>] [-b <budget_KB>] [-i <max_instrs>] [-r <first_round_instrs>] [-e <eta>] [-o <results.csv>] <trace>...
+//
+// Traces are instruction traces (.gz or native) or branch traces (convert_trace -b), of which only the first
+// <max_instrs> instructions are kept (default: all). Predictors run as in branch-only mode with no resolve delay: each
+// conditional branch is predicted and updated in order, the other branches only advance the global history. Each
+// (geometry, trace) run is a forked worker, -j at a time (default: one per core), which shares the streams of the
+// parent. The budget (default 192 KB) is of TAGE-SC-L alone: lower it to leave room for other components. -o writes
+// one csv row per round and geometry.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lib/trace_reader.h"
+#include "lib/branch_trace.h"
+#include "lib/branch_stream.h"
+#include "cbp2016_tage_sc_l.h"
+
+namespace {
+
+struct stream_t
+{
+    std::string name;
+    branch_stream_t branches;
+
+    // Branches in the first num_instrs instructions.
+    uint64_t prefix(uint64_t num_instrs) const
+    {
+        return branches.prefix(num_instrs);
+    }
+
+    uint64_t num_instrs() const
+    {
+        return branches.num_instrs();
+    }
+};
+
+int branch_type(InstClass insn_class)
+{
+    if (insn_class == InstClass::condBranchInstClass)
+        return 1;
+    if ((insn_class == InstClass::uncondIndirectBranchInstClass) || (insn_class == InstClass::callIndirectInstClass)
+        || (insn_class == InstClass::ReturnInstClass))
+        return 2;
+    return 0;
+}
+
+stream_t load_stream(const char * trace_name, uint64_t max_instrs)
+{
+    return {trace_name, load_branch_stream(trace_name, max_instrs)};
+}
+
+// The predictors are written for static storage, which starts zeroed, and do not initialize all of their state:
+// instances are built in zeroed heap memory, as in tools/bench.cc.
+template <class T>
+struct zeroed_delete_t
+{
+    void operator()(T * p) const
+    {
+        p->~T();
+        free(p);
+    }
+};
+
+template <class T, class... Args>
+std::unique_ptr<T, zeroed_delete_t<T>> make_zeroed(Args&&... args)
+{
+    void * mem = calloc(1, sizeof(T));
+    return std::unique_ptr<T, zeroed_delete_t<T>>(new (mem) T(std::forward<Args>(args)...));
+}
+
+template <class CFG>
+uint64_t storage_bits()
+{
+    auto hist = make_zeroed<cbp_global_history_t>();
+    auto tage = make_zeroed<CBP2016_TAGE_SC_L<CFG>>(*hist);
+    tage->setup();
+    // predictorsize() prints its breakdown on stderr
+    fflush(stderr);
+    const int saved = dup(STDERR_FILENO);
+    const int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+    const uint64_t bits = tage->predictorsize();
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    return bits;
+}
+
+template <class CFG>
+uint64_t mispredictions(const stream_t& s, uint64_t num_branches)
+{
+    auto hist = make_zeroed<cbp_global_history_t>();
+    auto tage = make_zeroed<CBP2016_TAGE_SC_L<CFG>>(*hist);
+    tage->setup();
+    uint64_t mispreds = 0;
+    // the stream is decoded a block at a time, into a buffer that stays in the L1 across the block's predictions
+    branch_stream_t::block_t block;
+    for (uint64_t b = 0, seq_no = 0; seq_no < num_branches; b++)
+    {
+        s.branches.decode_block(b, block);
+        for (uint64_t i = 0; (i < block.count) && (seq_no < num_branches); i++, seq_no++)
+        {
+            const uint64_t pc = block.pc[i], next_pc = block.next_pc[i];
+            const bool taken = block.is_taken(i);
+            const int br_type = branch_type(block.insn_class(i));
+            if (br_type & 1)
+            {
+                const bool pred = tage->predict(seq_no, 0, pc);
+                tage->history_update(seq_no, 0, pc, br_type, pred, taken, next_pc);
+                hist->update(pc, br_type, taken, next_pc);
+                tage->update(seq_no, 0, pc, taken, pred, next_pc);
+                mispreds += pred != taken;
+            }
+            else
+                hist->update(pc, br_type, taken, next_pc);
+        }
+    }
+    return mispreds;
+}
+
+struct geometry_t
+{
+    const char * name;
+    uint64_t (*storage_bits)();
+    uint64_t (*mispredictions)(const stream_t&, uint64_t);
+};
+
+#define EXPLORE_GEOMETRY(NAME, NHIST_, MINHIST_, MAXHIST_, LOGG_, TBITS_, LOGB_, SC_LOG_)   \
+    struct NAME##_config_t : tage_sc_l_config_t                                             \
+    {                                                                                       \
+        static constexpr int NHIST = NHIST_;                                                \
+        static constexpr int MINHIST = MINHIST_;                                            \
+        static constexpr int MAXHIST = MAXHIST_;                                            \
+        static constexpr int LOGG = LOGG_;                                                  \
+        static constexpr int TBITS = TBITS_;                                                \
+        static constexpr int LOGB = LOGB_;                                                  \
+        static constexpr int LOGBIAS = tage_sc_l_config_t::LOGBIAS + SC_LOG_;               \
+        static constexpr int LOGINB = tage_sc_l_config_t::LOGINB + SC_LOG_;                 \
+        static constexpr int LOGIMNB = tage_sc_l_config_t::LOGIMNB + SC_LOG_;               \
+        static constexpr int LOGGNB = tage_sc_l_config_t::LOGGNB + SC_LOG_;                 \
+        static constexpr int LOGPNB = tage_sc_l_config_t::LOGPNB + SC_LOG_;                 \
+        static constexpr int LOGLNB = tage_sc_l_config_t::LOGLNB + SC_LOG_;                 \
+        static constexpr int LOGSNB = tage_sc_l_config_t::LOGSNB + SC_LOG_;                 \
+        static constexpr int LOGTNB = tage_sc_l_config_t::LOGTNB + SC_LOG_;                 \
+    };
+#include "explore_space.h"
+#undef EXPLORE_GEOMETRY
+
+#define EXPLORE_GEOMETRY(NAME, ...) {#NAME, &storage_bits<NAME##_config_t>, &mispredictions<NAME##_config_t>},
+const geometry_t geometries[] = {
+#include "explore_space.h"
+};
+#undef EXPLORE_GEOMETRY
+
+struct task_t
+{
+    uint64_t geometry;
+    uint64_t stream;
+    uint64_t num_branches;
+    uint64_t mispreds = UINT64_MAX;     // UINT64_MAX if the worker failed
+};
+
+// Runs every task in a forked worker, jobs at a time.
+void run_tasks(std::vector<task_t>& tasks, const std::vector<stream_t>& streams, unsigned jobs)
+{
+    std::unordered_map<pid_t, std::pair<uint64_t, int>> running;     // task, result fd
+    uint64_t next = 0;
+    while (next < tasks.size() || !running.empty())
+    {
+        while (next < tasks.size() && running.size() < jobs)
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                perror("pipe");
+                exit(1);
+            }
+            fflush(stdout);
+            const pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[0]);
+                const task_t& t = tasks[next];
+                const uint64_t mispreds = geometries[t.geometry].mispredictions(streams[t.stream], t.num_branches);
+                _exit(write(fds[1], &mispreds, sizeof(mispreds)) == sizeof(mispreds) ? 0 : 1);
+            }
+            close(fds[1]);
+            if (pid < 0)
+            {
+                perror("fork");
+                exit(1);
+            }
+            running[pid] = {next, fds[0]};
+            next++;
+        }
+
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        const auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+        uint64_t mispreds;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && read(it->second.second, &mispreds, sizeof(mispreds)) == sizeof(mispreds))
+            tasks[it->second.first].mispreds = mispreds;
+        close(it->second.second);
+        running.erase(it);
+    }
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    unsigned jobs = 0;
+    double budget_kb = 192;
+    uint64_t max_instrs = UINT64_MAX;
+    uint64_t first_round_instrs = 0;
+    unsigned eta = 2;
+    const char * csv_path = nullptr;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (!strcmp(argv[i], "-j"))
+            jobs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-b"))
+            budget_kb = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-i"))
+            max_instrs = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-r"))
+            first_round_instrs = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-e"))
+            eta = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-o"))
+            csv_path = argv[i + 1];
+        else
+            break;
+    }
+    if (i >= argc || eta < 2)
+    {
+        printf("usage:\t%s [-j <jobs>] [-b <budget_KB>] [-i <max_instrs>] [-r <first_round_instrs>] [-e <eta>, at least 2] [-o <results.csv>] <trace>...\n", argv[0]);
+        return 0;
+    }
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<stream_t> streams;
+    uint64_t longest = 0;
+    for (; i < argc; i++)
+    {
+        streams.push_back(load_stream(argv[i], max_instrs));
+        longest = std::max(longest, streams.back().num_instrs());
+        const branch_stream_t& branches = streams.back().branches;
+        printf("Loaded %s: %lu branches in %lu instructions (%.2f bytes per branch)\n", argv[i], branches.num_branches(),
+               branches.num_instrs(), branches.num_branches() ? (double)branches.bytes() / branches.num_branches() : 0.0);
+    }
+
+    // Geometries over the budget are never run.
+    const uint64_t num_geometries = sizeof(geometries) / sizeof(geometries[0]);
+    std::vector<uint64_t> survivors;
+    std::vector<double> storage_kb(num_geometries);
+    for (uint64_t g = 0; g < num_geometries; g++)
+    {
+        storage_kb[g] = (double)geometries[g].storage_bits() / (8 * 1024);
+        if (storage_kb[g] <= budget_kb)
+            survivors.push_back(g);
+        else
+            printf("Over the %.1f KB budget: %s (%.1f KB)\n", budget_kb, geometries[g].name, storage_kb[g]);
+    }
+    if (survivors.empty())
+    {
+        fprintf(stderr, "No geometry fits the %.1f KB budget\n", budget_kb);
+        return 1;
+    }
+
+    // By default, the first round is as long as to leave the last geometry the full streams.
+    if (first_round_instrs == 0)
+    {
+        first_round_instrs = longest;
+        for (uint64_t n = survivors.size(); n > 1; n = (n + eta - 1) / eta)
+            first_round_instrs /= eta;
+        first_round_instrs = std::max<uint64_t>(first_round_instrs, 1);
+    }
+
+    FILE * csv = csv_path ? fopen(csv_path, "w") : nullptr;
+    if (csv_path && !csv)
+    {
+        perror(csv_path);
+        return 1;
+    }
+    if (csv)
+        fprintf(csv, "Round,Instr,Geometry,StorageKB,MPKI\n");
+
+    uint64_t round_instrs = first_round_instrs;
+    for (unsigned round = 0; ; round++)
+    {
+        std::vector<task_t> tasks;
+        for (const uint64_t g : survivors)
+            for (uint64_t s = 0; s < streams.size(); s++)
+                tasks.push_back({g, s, streams[s].prefix(round_instrs)});
+        run_tasks(tasks, streams, jobs);
+
+        // Mean MPKI over the traces, as the CBP score.
+        std::vector<std::pair<double, uint64_t>> ranking;
+        for (uint64_t k = 0; k < survivors.size(); k++)
+        {
+            double mpki_sum = 0.0;
+            for (uint64_t s = 0; s < streams.size(); s++)
+            {
+                const task_t& t = tasks[k * streams.size() + s];
+                const uint64_t num_instrs = streams[s].branches.instrs_before(t.num_branches);
+                mpki_sum += (t.mispreds == UINT64_MAX) ? INFINITY : num_instrs ? 1000.0 * t.mispreds / num_instrs : 0.0;
+            }
+            ranking.push_back({mpki_sum / streams.size(), survivors[k]});
+        }
+        std::stable_sort(ranking.begin(), ranking.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        const bool last = (ranking.size() == 1) || (round_instrs >= longest);
+        const uint64_t keep = last ? 1 : (ranking.size() + eta - 1) / eta;
+        printf("Round %u: %lu geometries on %lu instructions per trace, keeping %lu\n", round, ranking.size(), std::min(round_instrs, longest), keep);
+        printf("  %-20s %10s %10s\n", "Geometry", "KB", "MPKI");
+        for (uint64_t r = 0; r < ranking.size(); r++)
+        {
+            const uint64_t g = ranking[r].second;
+            printf("%s %-20s %10.1f %10.4f\n", (r < keep) ? " *" : "  ", geometries[g].name, storage_kb[g], ranking[r].first);
+            if (csv)
+                fprintf(csv, "%u,%lu,%s,%.1f,%.4f\n", round, std::min(round_instrs, longest), geometries[g].name, storage_kb[g], ranking[r].first);
+        }
+        fflush(stdout);
+
+        if (last)
+        {
+            printf("Best geometry: %s (%.1f KB, %.4f MPKI)\n", geometries[ranking[0].second].name, storage_kb[ranking[0].second], ranking[0].first);
+            break;
+        }
+        survivors.clear();
+        for (uint64_t r = 0; r < keep; r++)
+            survivors.push_back(ranking[r].second);
+        // the last geometry standing gets the full streams
+        round_instrs = ((keep == 1) || (round_instrs > longest / eta)) ? longest : round_instrs * eta;
+    }
+    if (csv)
+        fclose(csv);
+    return 0;
+}
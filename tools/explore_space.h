@@ -0,0 +1,26 @@
+// Design space of tools/explore.cc: one TAGE-SC-L geometry per line, each a configuration derived from
+// tage_sc_l_config_t (cbp2016_tage_sc_l.h) with these members overridden. Geometries are template arguments, so adding
+// one takes a rebuild (make explore), but none is instantiated twice and all of them run at full speed.
+//
+// SC_LOG is added to the log2 sizes of all the statistical corrector tables (LOGBIAS, LOGINB, LOGIMNB, LOGGNB, LOGPNB,
+// LOGLNB, LOGSNB, LOGTNB). NHIST must stay even, above BORNSUPASSOC (23) and at most 38 (the shared history folds 40
+// rows), MAXHIST below the 4K history buffer, and TBITS at most 8 for the tags of the high history lengths to fit
+// packed_gentry.
+//
+//                name        NHIST MINHIST MAXHIST LOGG TBITS LOGB SC_LOG
+EXPLORE_GEOMETRY(base,          36,     6,   3000,  10,    8,  13,    0)
+EXPLORE_GEOMETRY(logg11,        36,     6,   3000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(logg11_t6,     36,     6,   3000,  11,    6,  13,    0)
+EXPLORE_GEOMETRY(logg11_b14,    36,     6,   3000,  11,    8,  14,    0)
+EXPLORE_GEOMETRY(logg11_sc1,    36,     6,   3000,  11,    8,  13,    1)
+EXPLORE_GEOMETRY(logg12,        36,     6,   3000,  12,    8,  13,    0)
+EXPLORE_GEOMETRY(logg12_t7,     36,     6,   3000,  12,    7,  13,    0)
+EXPLORE_GEOMETRY(logg11_h2000,  36,     6,   2000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(logg11_h4000,  36,     6,   4000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(logg11_m4,     36,     4,   3000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(logg11_m8,     36,     8,   3000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(n38_logg11,    38,     6,   3000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(n30_logg11,    30,     6,   3000,  11,    8,  13,    0)
+EXPLORE_GEOMETRY(n30_logg12,    30,     6,   3000,  12,    8,  13,    0)
+EXPLORE_GEOMETRY(sc1,           36,     6,   3000,  10,    8,  13,    1)
+EXPLORE_GEOMETRY(sc2,           36,     6,   3000,  10,    8,  14,    2)
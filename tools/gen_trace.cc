@@ -0,0 +1,657 @@
+// Synthetic branch workloads, for throughput and scaling benchmarks: generates a trace of any length, deterministically
+// from a seed, out of a parameterized program model, in the .gz trace format of lib/trace_reader.h or with -b in the
+// branch trace format of lib/branch_trace.h.
+//
+// Usage : gen_trace [-b] [-i <instrs>] [-s <seed>] [-k <kernels>] [-n <branches>] [-d <depth>] [-t <trip>]
+//                   [-l <block>] [-m <footprint_KB>] [-c <correlated>] [-p <periodic>] [-e <noise>] [-x <cases>]
+//                   [-f <phase_instrs>] <output>
+//
+// The program is built from the seed alone, then interpreted for <instrs> instructions (default 100000000):
+//
+//   dispatcher  a loop that loads a kernel from a dispatch table of <kernels> entries (default 16) and calls it
+//               indirectly, following a schedule of 64 calls drawn once (and again every <phase_instrs> instructions
+//               with -f), the hottest kernels being called the most; a fraction <noise> of the calls go to a random
+//               kernel instead (default 0.02)
+//   kernels     loops nested <depth> deep (default 2) of about <trip> iterations each (default 8, some of them drawn
+//               again at each entry), with one block in each outer loop and the rest in the innermost one
+//   blocks      about <block> ALU, FP, load and store instructions (default 5), then a conditional branch over a few
+//               more: the <branches> conditional branches of the kernels (default 2000) are split among them. A
+//               fraction <correlated> of them (default 0.3) take the XOR of two outcomes in the last 16 of the global
+//               history, a fraction <periodic> (default 0.2) follow a pattern of period 2 to 16, both flipped at rate
+//               <noise>, and the others are taken with a fixed probability, mostly close to 0 or 1
+//   switches    the innermost loop of every kernel has an indirect jump through a table of <cases> cases (default 8,
+//               0 for none), picked from the last 6 conditional outcomes besides noise
+//   memory      every load and store walks a stream in a footprint of <footprint_KB> (default 1024), with a stride of
+//               8 or 64 bytes, or at random
+//
+// Every instruction has at most one output (a link register for calls), so that it is a single micro-op. Output
+// values are those a value predictor sees as constants or strides (the PC of the instruction, or the address of a
+// load), so that the trace compresses well. The same arguments always make the same trace, and the program of a seed
+// does not depend on <instrs>, so that a longer trace starts with a shorter one.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "lib/sim_common_structs.h"
+#include "lib/branch_trace.h"
+
+namespace {
+
+// splitmix64: the program and the run each draw from their own, seeded from the seed.
+struct rng_t
+{
+    uint64_t s;
+
+    uint64_t next()
+    {
+        uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t below(uint64_t n)
+    {
+        return next() % n;
+    }
+
+    // Thresholds of probabilities are compared to the high 32 bits of a draw, so that the trace does not depend on
+    // floating point.
+    static uint32_t threshold(double p)
+    {
+        return (p <= 0) ? 0 : (p >= 1) ? UINT32_MAX : (uint32_t)(p * 4294967296.0);
+    }
+
+    bool chance(uint32_t thr)
+    {
+        return (next() >> 32) < thr;
+    }
+};
+
+struct params_t
+{
+    uint64_t instrs = 100000000;
+    uint64_t seed = 1;
+    uint64_t kernels = 16;
+    uint64_t branches = 2000;
+    uint64_t depth = 2;
+    uint64_t trip = 8;
+    uint64_t block = 5;
+    uint64_t footprint_kb = 1024;
+    double correlated = 0.3;
+    double periodic = 0.2;
+    double noise = 0.02;
+    uint64_t cases = 8;
+    uint64_t phase_instrs = 0;
+    bool branch_trace = false;
+};
+
+static constexpr uint64_t CODE_BASE = 0x400000;
+static constexpr uint64_t TABLE_BASE = 0x10000000;     // dispatch table, then the jump tables
+static constexpr uint64_t DATA_BASE = 0x20000000;
+static constexpr uint64_t SCHEDULE = 64;
+static constexpr uint8_t FLAGS_REG = 64;
+static constexpr uint8_t LINK_REG = 30;
+static constexpr uint8_t TARGET_REG = 16;
+
+// SELECT loads the entry of a dispatch (arg NO_SWITCH) or switch table, which the DISPATCH or SWITCH after it jumps to.
+enum class op_kind_t : uint8_t { PLAIN, LOAD, STORE, BRANCH, LATCH, JUMP, SELECT, DISPATCH, SWITCH, RET };
+static constexpr uint32_t NO_SWITCH = UINT32_MAX;
+
+struct op_t
+{
+    InstClass insn_class;
+    op_kind_t kind;
+    uint8_t dst;            // 0xFF for none
+    uint8_t num_src;
+    uint8_t src[2];
+    uint32_t target;        // op index: taken target of a branch or a latch, or of a direct jump
+    uint32_t arg;           // site, loop, stream or switch
+};
+
+enum class site_kind_t : uint8_t { BIASED, CORRELATED, PERIODIC };
+
+struct site_t
+{
+    site_kind_t kind;
+    uint8_t tap_a, tap_b;   // CORRELATED: outcomes of the global history
+    uint8_t period;         // PERIODIC
+    uint32_t taken_thr;     // BIASED
+    uint16_t pattern;       // PERIODIC
+    uint32_t count = 0;
+};
+
+struct loop_t
+{
+    uint32_t trip;
+    bool variable;          // drawn again in [1, 2 * trip] at each entry
+    uint32_t cur_trip = 0;
+    uint32_t iter = 0;
+};
+
+struct stream_t
+{
+    uint64_t offset;
+    uint64_t stride;        // 0 for random accesses
+    uint64_t count = 0;
+};
+
+struct switch_t
+{
+    uint32_t first_case;    // in cases
+    uint32_t num_cases;
+    uint64_t table;         // address of the jump table
+};
+
+class program_t
+{
+    private:
+        const params_t& p;
+        rng_t rng;
+        uint8_t next_reg = 1;
+        uint8_t last_reg = 1;
+
+    public:
+        std::vector<op_t> code;
+        std::vector<site_t> sites;
+        std::vector<loop_t> loops;
+        std::vector<stream_t> streams;
+        std::vector<switch_t> switches;
+        std::vector<uint32_t> cases;        // op index of each case
+        std::vector<uint32_t> entries;      // op index of each kernel
+
+    private:
+        uint8_t new_reg()
+        {
+            last_reg = next_reg;
+            next_reg = (next_reg % 28) + 1;
+            return last_reg;
+        }
+
+        // A source register: one of the last few written, for dependence chains.
+        uint8_t old_reg()
+        {
+            return 1 + (last_reg + 27 - rng.below(4)) % 28;
+        }
+
+        uint32_t emit(InstClass insn_class, op_kind_t kind, uint8_t dst, uint8_t num_src, uint8_t src0 = 0, uint8_t src1 = 0,
+                      uint32_t target = 0, uint32_t arg = 0)
+        {
+            code.push_back({insn_class, kind, dst, num_src, {src0, src1}, target, arg});
+            return code.size() - 1;
+        }
+
+        void emit_alu()
+        {
+            const uint8_t src = old_reg();
+            emit(InstClass::aluInstClass, op_kind_t::PLAIN, new_reg(), 2, src, old_reg());
+        }
+
+        void emit_block_op()
+        {
+            const uint64_t r = rng.below(100);
+            if (r < 30)
+            {
+                streams.push_back({rng.below(p.footprint_kb * 1024) & ~7ULL, (r < 5) ? 0ULL : (r < 20) ? 8ULL : 64ULL});
+                if (r % 3 == 2)
+                {
+                    const uint8_t base = old_reg();
+                    emit(InstClass::storeInstClass, op_kind_t::STORE, 0xFF, 2, base, old_reg(), 0, streams.size() - 1);
+                }
+                else
+                    emit(InstClass::loadInstClass, op_kind_t::LOAD, new_reg(), 1, old_reg(), 0, 0, streams.size() - 1);
+            }
+            else if (r < 40)
+            {
+                const uint8_t dst = 32 + rng.below(32);
+                emit(InstClass::fpInstClass, op_kind_t::PLAIN, dst, 2, 32 + rng.below(32), 32 + rng.below(32));
+            }
+            else if (r < 45)
+            {
+                const uint8_t src = old_reg();
+                emit(InstClass::slowAluInstClass, op_kind_t::PLAIN, new_reg(), 2, src, old_reg());
+            }
+            else
+                emit_alu();
+        }
+
+        site_t new_site()
+        {
+            site_t s = {};
+            const double r = (rng.next() >> 11) * (1.0 / 9007199254740992.0);
+            if (r < p.correlated)
+            {
+                s.kind = site_kind_t::CORRELATED;
+                s.tap_a = 1 + rng.below(16);
+                s.tap_b = 1 + rng.below(16);
+            }
+            else if (r < p.correlated + p.periodic)
+            {
+                s.kind = site_kind_t::PERIODIC;
+                s.period = 2 + rng.below(15);
+                s.pattern = rng.next();
+            }
+            else
+            {
+                s.kind = site_kind_t::BIASED;
+                // mostly strongly biased, as most branches of real code are
+                const uint64_t b = rng.below(10);
+                const double taken = (b < 4) ? rng.below(50) / 1000.0 : (b < 8) ? 1 - rng.below(50) / 1000.0 : 0.05 + rng.below(900) / 1000.0;
+                s.taken_thr = rng_t::threshold(taken);
+            }
+            return s;
+        }
+
+        // A few instructions, then a conditional branch over one to three more.
+        void emit_block()
+        {
+            const uint64_t len = 1 + rng.below(2 * p.block);
+            for (uint64_t i = 0; i < len; i++)
+                emit_block_op();
+            const uint64_t skip = 1 + rng.below(3);
+            sites.push_back(new_site());
+            const uint32_t br = emit(InstClass::condBranchInstClass, op_kind_t::BRANCH, 0xFF, 1, FLAGS_REG);
+            code[br].target = br + 1 + skip;
+            code[br].arg = sites.size() - 1;
+            for (uint64_t i = 0; i < skip; i++)
+                emit_alu();
+        }
+
+        void emit_switch()
+        {
+            const uint8_t reg = new_reg();
+            switches.push_back({(uint32_t)cases.size(), (uint32_t)p.cases, TABLE_BASE + 8 * (p.kernels + cases.size())});
+            emit(InstClass::loadInstClass, op_kind_t::SELECT, reg, 1, old_reg(), 0, 0, switches.size() - 1);
+            emit(InstClass::uncondIndirectBranchInstClass, op_kind_t::SWITCH, 0xFF, 1, reg, 0, 0, switches.size() - 1);
+            std::vector<uint32_t> jumps;
+            for (uint64_t c = 0; c < p.cases; c++)
+            {
+                cases.push_back(code.size());
+                for (uint64_t i = 0, n = 1 + rng.below(3); i < n; i++)
+                    emit_alu();
+                jumps.push_back(emit(InstClass::uncondDirectBranchInstClass, op_kind_t::JUMP, 0xFF, 0));
+            }
+            for (uint32_t j : jumps)
+                code[j].target = code.size();
+        }
+
+        void emit_loop(uint64_t level, uint64_t blocks)
+        {
+            emit_alu();     // the loop counter
+            const uint32_t header = code.size();
+            const bool innermost = level + 1 >= p.depth;
+            for (uint64_t b = 0; b < (innermost ? blocks : 1); b++)
+            {
+                if (innermost && (p.cases > 0) && (b == blocks / 2))
+                    emit_switch();
+                emit_block();
+            }
+            if (!innermost)
+                emit_loop(level + 1, blocks);
+            const uint32_t trip = std::max<uint64_t>(1, p.trip / 2 + rng.below(p.trip + 1));
+            loops.push_back({trip, rng.below(10) < 3});
+            emit_alu();
+            emit(InstClass::condBranchInstClass, op_kind_t::LATCH, 0xFF, 1, FLAGS_REG, 0, header, loops.size() - 1);
+        }
+
+    public:
+        program_t(const params_t& params)
+        : p(params), rng{params.seed * 0xD1B54A32D192ED03ULL}
+        {
+            // dispatcher: select, load the entry of the kernel, call it, and go round
+            const uint32_t top = emit(InstClass::aluInstClass, op_kind_t::PLAIN, TARGET_REG, 1, TARGET_REG);
+            emit(InstClass::loadInstClass, op_kind_t::SELECT, TARGET_REG, 1, TARGET_REG, 0, 0, NO_SWITCH);
+            emit(InstClass::callIndirectInstClass, op_kind_t::DISPATCH, LINK_REG, 1, TARGET_REG);
+            emit_alu();
+            emit(InstClass::uncondDirectBranchInstClass, op_kind_t::JUMP, 0xFF, 0, 0, 0, top);
+
+            const uint64_t depth = std::max<uint64_t>(1, p.depth);
+            const uint64_t blocks = std::max<uint64_t>(depth, p.branches / std::max<uint64_t>(1, p.kernels));
+            for (uint64_t k = 0; k < p.kernels; k++)
+            {
+                entries.push_back(code.size());
+                emit_alu();
+                emit_alu();
+                emit_loop(0, blocks - (depth - 1));
+                emit(InstClass::ReturnInstClass, op_kind_t::RET, 0xFF, 1, LINK_REG);
+            }
+        }
+
+        uint64_t num_cond_branches() const
+        {
+            return sites.size() + loops.size();
+        }
+};
+
+// Interprets the program, and writes each instruction to the trace.
+class generator_t
+{
+    private:
+        const params_t& p;
+        program_t& prog;
+        rng_t rng;
+        uint32_t noise_thr;
+        uint64_t history = 0;       // conditional outcomes, the last one in bit 0
+        uint64_t values[66] = {};
+        std::vector<uint32_t> schedule;
+        uint64_t next_call = 0;
+        uint64_t phase_end;
+        uint32_t choice = 0;        // of the last SELECT
+        std::vector<uint32_t> stack;
+
+        gzFile mFile = nullptr;
+        branch_trace_writer_t * mBranches = nullptr;
+        std::vector<uint8_t> mOut;
+
+    public:
+        uint64_t num_instrs = 0;
+        uint64_t num_cond = 0;
+        uint64_t num_taken = 0;
+        uint64_t num_indirect = 0;
+
+    private:
+        void draw_schedule()
+        {
+            schedule.clear();
+            // the first kernels of the draw are the hottest
+            std::vector<uint32_t> order(p.kernels);
+            for (uint32_t k = 0; k < p.kernels; k++)
+                order[k] = k;
+            for (uint32_t k = p.kernels; k > 1; k--)
+                std::swap(order[k - 1], order[rng.below(k)]);
+            for (uint64_t i = 0; i < SCHEDULE; i++)
+            {
+                const uint64_t u = rng.below(1 << 16);
+                schedule.push_back(order[(u * u * p.kernels) >> 32]);
+            }
+        }
+
+        template <class T>
+        void put(const T& v)
+        {
+            mOut.insert(mOut.end(), (const uint8_t *)&v, (const uint8_t *)&v + sizeof(T));
+        }
+
+        // One instruction, in the record layout of TraceReader::readInstr.
+        void write(const op_t& op, uint64_t pc, uint64_t next_pc, bool taken, uint64_t addr)
+        {
+            if (mBranches)
+            {
+                mBranches->append(op.insn_class, pc, next_pc, taken, true);
+                return;
+            }
+            put(pc);
+            put(op.insn_class);
+            if (is_mem(op.insn_class))
+            {
+                put(addr);
+                put((uint8_t)8);        // access size
+                put((uint8_t)0);        // no base update
+                if (is_store(op.insn_class))
+                    put((uint8_t)0);    // no register offset
+            }
+            if (is_br(op.insn_class))
+            {
+                put((uint8_t)taken);
+                if (taken)
+                    put(next_pc);
+            }
+            put(op.num_src);
+            for (uint8_t i = 0; i < op.num_src; i++)
+                put(op.src[i]);
+            const bool has_dst = op.dst != 0xFF;
+            put((uint8_t)has_dst);
+            if (has_dst)
+            {
+                put(op.dst);
+                put(values[op.dst]);
+                if (op.dst >= 32 && op.dst < 64)
+                    put((uint64_t)0);   // high half, zero so that the output is a single piece
+            }
+            if (mOut.size() >= (1 << 20))
+                flush();
+        }
+
+        bool flush()
+        {
+            const bool ok = mOut.empty() || (gzwrite(mFile, mOut.data(), mOut.size()) == (int)mOut.size());
+            mOut.clear();
+            return ok;
+        }
+
+        bool outcome(site_t& s)
+        {
+            bool taken;
+            switch (s.kind)
+            {
+                case site_kind_t::CORRELATED:
+                    taken = ((history >> (s.tap_a - 1)) ^ (history >> (s.tap_b - 1))) & 1;
+                    break;
+                case site_kind_t::PERIODIC:
+                    taken = (s.pattern >> (s.count % s.period)) & 1;
+                    break;
+                default:
+                    return rng.chance(s.taken_thr);
+            }
+            s.count++;
+            return taken ^ rng.chance(noise_thr);
+        }
+
+        uint64_t address(stream_t& s)
+        {
+            const uint64_t footprint = p.footprint_kb * 1024;
+            const uint64_t off = s.stride ? (s.offset + s.count * s.stride) : (rng.next() & ~7ULL);
+            s.count++;
+            return DATA_BASE + (off % footprint);
+        }
+
+    public:
+        generator_t(const params_t& params, program_t& program)
+        : p(params), prog(program), rng{params.seed ^ 0x5DEECE66DULL}, noise_thr(rng_t::threshold(params.noise)),
+          phase_end(params.phase_instrs ? params.phase_instrs : UINT64_MAX)
+        {
+            draw_schedule();
+        }
+
+        ~generator_t()
+        {
+            delete mBranches;
+        }
+
+        bool open(const char * path)
+        {
+            if (p.branch_trace)
+            {
+                mBranches = new branch_trace_writer_t(path);
+                return mBranches->good();
+            }
+            mFile = gzopen(path, "wb1");
+            if (mFile)
+                gzbuffer(mFile, 1 << 20);
+            return mFile != nullptr;
+        }
+
+        void run()
+        {
+            uint32_t ip = 0;
+            for (; num_instrs < p.instrs; num_instrs++)
+            {
+                const op_t& op = prog.code[ip];
+                const uint64_t pc = CODE_BASE + 4 * (uint64_t)ip;
+                uint32_t next = ip + 1;
+                bool taken = false;
+                uint64_t addr = 0;
+                switch (op.kind)
+                {
+                    case op_kind_t::LOAD:
+                    case op_kind_t::STORE:
+                        addr = address(prog.streams[op.arg]);
+                        break;
+                    case op_kind_t::BRANCH:
+                    case op_kind_t::LATCH:
+                    {
+                        if (op.kind == op_kind_t::BRANCH)
+                            taken = outcome(prog.sites[op.arg]);
+                        else
+                        {
+                            loop_t& l = prog.loops[op.arg];
+                            if (l.iter == 0)
+                                l.cur_trip = l.variable ? 1 + rng.below(2 * l.trip) : l.trip;
+                            taken = ++l.iter < l.cur_trip;
+                            if (!taken)
+                                l.iter = 0;
+                        }
+                        history = (history << 1) | taken;
+                        num_cond++;
+                        num_taken += taken;
+                        if (taken)
+                            next = op.target;
+                        break;
+                    }
+                    case op_kind_t::JUMP:
+                        taken = true;
+                        next = op.target;
+                        break;
+                    case op_kind_t::SELECT:
+                        if (op.arg == NO_SWITCH)
+                        {
+                            if (num_instrs >= phase_end)
+                            {
+                                draw_schedule();
+                                phase_end += p.phase_instrs;
+                            }
+                            choice = rng.chance(noise_thr) ? rng.below(p.kernels) : schedule[next_call++ % SCHEDULE];
+                            addr = TABLE_BASE + 8 * choice;
+                        }
+                        else
+                        {
+                            const switch_t& s = prog.switches[op.arg];
+                            choice = rng.chance(noise_thr) ? rng.below(s.num_cases) : (history & 63) % s.num_cases;
+                            addr = s.table + 8 * choice;
+                        }
+                        break;
+                    case op_kind_t::DISPATCH:
+                    {
+                        stack.push_back(ip + 1);
+                        taken = true;
+                        next = prog.entries[choice];
+                        values[LINK_REG] = CODE_BASE + 4 * (uint64_t)(ip + 1);
+                        num_indirect++;
+                        break;
+                    }
+                    case op_kind_t::SWITCH:
+                    {
+                        taken = true;
+                        next = prog.cases[prog.switches[op.arg].first_case + choice];
+                        num_indirect++;
+                        break;
+                    }
+                    case op_kind_t::RET:
+                        taken = true;
+                        next = stack.back();
+                        stack.pop_back();
+                        num_indirect++;
+                        break;
+                    default:
+                        break;
+                }
+                if ((op.dst != 0xFF) && (op.kind != op_kind_t::DISPATCH))
+                    values[op.dst] = is_load(op.insn_class) ? (addr >> 3) : pc >> 2;
+                write(op, pc, CODE_BASE + 4 * (uint64_t)next, taken, addr);
+                ip = next;
+                if ((num_instrs + 1) % 100000000 == 0)
+                    printf("%lu instrs\n", num_instrs + 1);
+            }
+        }
+
+        // Returns false if any write failed.
+        bool close()
+        {
+            if (mBranches)
+            {
+                mBranches->close();
+                return true;
+            }
+            const bool ok = flush();
+            return (gzclose(mFile) == Z_OK) && ok;
+        }
+};
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    params_t p;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (!strcmp(argv[i], "-b"))
+        {
+            p.branch_trace = true;
+            i--;
+            continue;
+        }
+        if (i + 1 >= argc)
+            break;
+        const char * v = argv[i + 1];
+        if (!strcmp(argv[i], "-i"))
+            p.instrs = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-s"))
+            p.seed = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-k"))
+            p.kernels = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-n"))
+            p.branches = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-d"))
+            p.depth = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-t"))
+            p.trip = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-l"))
+            p.block = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-m"))
+            p.footprint_kb = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-c"))
+            p.correlated = atof(v);
+        else if (!strcmp(argv[i], "-p"))
+            p.periodic = atof(v);
+        else if (!strcmp(argv[i], "-e"))
+            p.noise = atof(v);
+        else if (!strcmp(argv[i], "-x"))
+            p.cases = strtoull(v, nullptr, 10);
+        else if (!strcmp(argv[i], "-f"))
+            p.phase_instrs = strtoull(v, nullptr, 10);
+        else
+            break;
+    }
+    if ((i + 1 != argc) || (p.kernels == 0) || (p.depth == 0) || (p.trip == 0) || (p.block == 0) || (p.footprint_kb == 0))
+    {
+        printf("usage:\t%s [-b] [-i <instrs>] [-s <seed>] [-k <kernels>] [-n <branches>] [-d <depth>] [-t <trip>] [-l <block>]\n"
+               "\t\t[-m <footprint_KB>] [-c <correlated>] [-p <periodic>] [-e <noise>] [-x <cases>] [-f <phase_instrs>] <output>\n"
+               "\twrites a synthetic trace of <instrs> instructions (100000000 by default), or a branch trace with -b\n", argv[0]);
+        return 1;
+    }
+    const char * out_path = argv[i];
+
+    program_t prog(p);
+    printf("Program of seed %lu: %lu kernels, %lu static instructions, %lu conditional branches, %lu switches of %lu cases, %lu KB of data\n",
+           p.seed, p.kernels, prog.code.size(), prog.num_cond_branches(), prog.switches.size(), p.cases, p.footprint_kb);
+
+    generator_t gen(p, prog);
+    if (!gen.open(out_path))
+    {
+        fprintf(stderr, "Unable to create %s\n", out_path);
+        return 1;
+    }
+    gen.run();
+    if (!gen.close())
+    {
+        fprintf(stderr, "Unable to write %s\n", out_path);
+        return 1;
+    }
+    printf("Wrote %lu instructions to %s: %lu conditional branches (%.1f%% taken), %lu indirect branches\n", gen.num_instrs,
+           out_path, gen.num_cond, gen.num_cond ? 100.0 * gen.num_taken / gen.num_cond : 0.0, gen.num_indirect);
+    return 0;
+}
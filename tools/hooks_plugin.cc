@@ -0,0 +1,71 @@
+// The predictor of cond_branch_predictor_interface.cc as a plugin (cbp_plugin.h), built by make plugin PLUGIN=<name>
+// into <name>.so, for cbp -p <name>.so: its cbp.h hooks, as they are, behind the plugin table.
+//
+// The hooks work on the globals of the predictor, so there is a single instance per process, which is all the
+// simulator creates. A stash/ variant becomes a plugin when copied over my_cond_branch_predictor.h:
+//
+//   cp stash/my_cond_branch_predictor_<variant>.h my_cond_branch_predictor.h && make plugin PLUGIN=<variant>
+
+#include "cbp_plugin.h"
+
+#ifndef CBP_PLUGIN_NAME
+#define CBP_PLUGIN_NAME "predictor"
+#endif
+
+namespace {
+
+struct linked_predictor_t
+{
+    explicit linked_predictor_t(const char *) {}
+
+    void begin() { beginCondDirPredictor(); }
+    void end() { endCondDirPredictor(); }
+    bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+    {
+        return ::get_cond_dir_prediction(seq_no, piece, pc, cycle);
+    }
+    void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+    {
+        ::spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    }
+    void notify_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+    {
+        ::notify_instr_fetch(seq_no, piece, pc, cycle);
+    }
+    void notify_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& info, uint64_t cycle)
+    {
+        ::notify_instr_decode(seq_no, piece, pc, info, cycle);
+    }
+    void notify_agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+    {
+        ::notify_agen_complete(seq_no, piece, pc, info, mem_va, mem_sz, cycle);
+    }
+    void notify_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        ::notify_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+    void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        ::notify_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+    void notify_batch(const cbp_batch_t& batch) { ::notify_batch(batch); }
+    void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+    {
+        ::notify_static_id(seq_no, piece, pc, static_id);
+    }
+    void snapshot(snapshot_t& s) { snapshot_cond_dir_predictor(s); }
+    bool freeze() { return freeze_cond_dir_predictor(); }
+    void dump(snapshot_t& s) { dump_cond_dir_predictor(s); }
+};
+
+} // namespace
+
+// As CBP_PLUGIN(), but with the hooks of the predictor, cbp_hooks, which is only known at runtime.
+extern "C" __attribute__((visibility("default"))) const cbp_plugin_t *cbp_plugin_entry(uint32_t abi_version)
+{
+    static cbp_plugin_t table = cbp_plugin_adapter<linked_predictor_t, CBP_HOOK_ALL | CBP_HOOK_BATCH | CBP_HOOK_STATIC_ID>::table(CBP_PLUGIN_NAME);
+    table.hooks = cbp_hooks;
+    // the hooks of cbp.h act on the globals of the predictor
+    table.single_instance = true;
+    return (abi_version == CBP_PLUGIN_ABI_VERSION) ? &table : nullptr;
+}
@@ -0,0 +1,85 @@
+// The timing model of cbp over the predictor of the sources in place, called straight from the model: basic_uarchsim_t
+// instantiated over direct_hooks_t, not over the plugin (-p), predictor thread (-t), lockstep (-l) and shadow (-o)
+// dispatch of cbp_hooks_t (lib/cbp_predictor.h). Built with the predictor sources and -flto, so that the prediction and
+// history update of the predictor inline into the step loop.
+//
+// Usage : inline_sim <trace>
+//
+// Prints the report of cbp <trace>, with the default configuration and none of the options.
+
+#include <cstdio>
+#include <cstdlib>
+#include "lib/uarchsim_impl.h"
+
+namespace {
+
+struct direct_hooks_t
+{
+    static uint32_t hooks() { return cbp_hooks; }
+
+    static bool get_cond_dir_prediction(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t pred_cycle)
+    {
+        return ::get_cond_dir_prediction(seq_no, piece, pc, pred_cycle);
+    }
+
+    static void spec_update(uint64_t seq_no, uint8_t piece, uint64_t pc, InstClass inst_class, bool resolve_dir, bool pred_dir, uint64_t next_pc)
+    {
+        ::spec_update(seq_no, piece, pc, inst_class, resolve_dir, pred_dir, next_pc);
+    }
+
+    static void notify_static_id(uint64_t seq_no, uint8_t piece, uint64_t pc, uint32_t static_id)
+    {
+        ::notify_static_id(seq_no, piece, pc, static_id);
+    }
+
+    static void notify_instr_fetch(uint64_t seq_no, uint8_t piece, uint64_t pc, uint64_t cycle)
+    {
+        ::notify_instr_fetch(seq_no, piece, pc, cycle);
+    }
+
+    static void notify_instr_decode(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t cycle)
+    {
+        ::notify_instr_decode(seq_no, piece, pc, dec_info, cycle);
+    }
+
+    static void notify_agen_complete(uint64_t seq_no, uint8_t piece, uint64_t pc, const DecodeInfo& dec_info, uint64_t mem_va, uint64_t mem_sz, uint64_t cycle)
+    {
+        ::notify_agen_complete(seq_no, piece, pc, dec_info, mem_va, mem_sz, cycle);
+    }
+
+    static void notify_instr_execute_resolve(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        ::notify_instr_execute_resolve(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+
+    static void notify_instr_commit(uint64_t seq_no, uint8_t piece, uint64_t pc, bool pred_dir, const ExecuteInfo& info, uint64_t cycle)
+    {
+        ::notify_instr_commit(seq_no, piece, pc, pred_dir, info, cycle);
+    }
+
+    static void notify_batch(const cbp_batch_t& batch)
+    {
+        ::notify_batch(batch);
+    }
+};
+
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <trace>\n", argv[0]);
+        exit(1);
+    }
+    const sim_config_t config;
+    TraceReader reader(argv[1], nullptr, (cbp_hooks & CBP_HOOK_VALUES) != 0);
+    basic_uarchsim_t<direct_hooks_t> sim(config);
+    beginCondDirPredictor();
+    db_t inst;
+    while (reader.next(inst) && !sim.converged())
+        sim.step(&inst);
+    endCondDirPredictor();
+    sim.output();
+    return 0;
+}
@@ -0,0 +1,198 @@
+// Miss-ratio curves of the data or instruction cache of a trace for every power-of-two geometry at once, from one pass
+// over its access stream, to pick the few geometries worth a timing run (-D, -I).
+//
+// Usage : miss_curves [-f] [-b <blocksize>] [-s <min_log2_size>,<max_log2_size>] [-a <max_assoc>] [-i <max_instrs>]
+//                     [-o <curves.csv>] <trace>
+//
+// The stream is that of the L1D$ of a warmup (uarchsim_t::warm()): the address of each load and store piece, stores
+// allocating as with WRITE_ALLOCATE, or with -f that of the I$, the PC of each piece. Prefetches are left out: the
+// curves are those of the demand accesses alone, with LRU replacement, over the first <max_instrs> instructions of the
+// trace (default: all). The geometries are all the caches of cache_t with <blocksize>-byte blocks (default 64), from
+// 2^<min_log2_size> to 2^<max_log2_size> bytes (default 10,25: 1 KB to 32 MB) and of associativity 1 to <max_assoc>
+// (default and at most 64, as in cache_t).
+//
+// Stack distances (Mattson et al.): with LRU replacement, an access to a set hits in all the caches of that set index
+// whose associativity is larger than the number of distinct blocks accessed in the set since the last access to its
+// block, so the histogram of these distances per number of sets gives the misses of every associativity at once. The
+// number of sets being a power of two, each one gets its own LRU stacks, one per set, each a contiguous array of block
+// numbers, most recent first, cut at the largest associativity of the sizes it serves: a block that falls off the end
+// misses in all of them. Accesses are mostly to the first few blocks of a stack, so the linear search finds them
+// sooner than a tree of the stack would.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "lib/trace_reader.h"
+
+namespace {
+
+constexpr uint64_t MAX_ASSOC = 64;
+
+// The LRU stacks of all the sets of one power-of-two number of sets, and the histogram of their stack distances.
+struct stacks_t
+{
+    uint64_t num_sets;
+    uint64_t depth;                     // blocks kept per set, the largest associativity it serves
+    std::vector<uint64_t> blocks;       // [set * depth + d], block number + 1, 0 for none
+    std::vector<uint64_t> distances;    // [d], d = depth for the blocks not in the stack
+
+    stacks_t(uint64_t _num_sets, uint64_t _depth)
+    : num_sets(_num_sets), depth(_depth), blocks(_num_sets * _depth, 0), distances(_depth + 1, 0)
+    {
+    }
+
+    void access(uint64_t block)
+    {
+        uint64_t * stack = &blocks[(block & (num_sets - 1)) * depth];
+        const uint64_t tag = block + 1;
+        uint64_t d = 0;
+        while ((d < depth) && (stack[d] != tag))
+            d++;
+        distances[d]++;
+        // move to front, the last block dropping out of a full stack
+        const uint64_t moved = std::min(d, depth - 1);
+        memmove(stack + 1, stack, moved * sizeof(uint64_t));
+        stack[0] = tag;
+    }
+
+    // Misses of the caches of num_sets sets and assoc ways.
+    uint64_t misses(uint64_t assoc) const
+    {
+        uint64_t m = 0;
+        for (uint64_t d = assoc; d <= depth; d++)
+            m += distances[d];
+        return m;
+    }
+};
+
+uint64_t log2_of(uint64_t x)
+{
+    uint64_t l = 0;
+    while ((1ull << l) < x)
+        l++;
+    return l;
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    bool fetch = false;
+    uint64_t blocksize = 64;
+    unsigned min_log2_size = 10, max_log2_size = 25;
+    uint64_t max_assoc = MAX_ASSOC;
+    uint64_t max_instrs = UINT64_MAX;
+    const char * csv_path = nullptr;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (!strcmp(argv[i], "-f"))
+        {
+            fetch = true;
+            i--;
+        }
+        else if (!strcmp(argv[i], "-b"))
+            blocksize = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-s"))
+        {
+            if (sscanf(argv[i + 1], "%u,%u", &min_log2_size, &max_log2_size) != 2)
+                break;
+        }
+        else if (!strcmp(argv[i], "-a"))
+            max_assoc = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-i"))
+            max_instrs = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-o"))
+            csv_path = argv[i + 1];
+        else
+            break;
+    }
+    if (i + 1 != argc)
+    {
+        printf("usage:\t%s [-f] [-b <blocksize>] [-s <min_log2_size>,<max_log2_size>] [-a <max_assoc>] [-i <max_instrs>] [-o <curves.csv>] <trace>\n",
+               argv[0]);
+        return 0;
+    }
+    const uint64_t log2_block = log2_of(blocksize);
+    if ((blocksize < 2) || ((1ull << log2_block) != blocksize) || (max_assoc < 1) || (max_assoc > MAX_ASSOC)
+        || (min_log2_size < log2_block) || (min_log2_size > max_log2_size) || (max_log2_size > 40))
+    {
+        fprintf(stderr, "Invalid geometries: the block size must be a power of two, the associativity at most %lu, and the sizes at least a block\n",
+                MAX_ASSOC);
+        return 1;
+    }
+    const uint64_t log2_max_assoc = log2_of(max_assoc + 1) - 1;    // largest power of two not above max_assoc
+
+    // One set of stacks per number of sets that some geometry has, each as deep as the largest associativity of the
+    // sizes in range at that number of sets.
+    std::vector<stacks_t> all_stacks;
+    for (uint64_t log2_sets = 0; log2_sets + log2_block <= max_log2_size; log2_sets++)
+    {
+        const uint64_t log2_depth = std::min<uint64_t>(log2_max_assoc, max_log2_size - log2_block - log2_sets);
+        if (log2_sets + log2_block + log2_depth >= min_log2_size)
+            all_stacks.emplace_back(1ull << log2_sets, 1ull << log2_depth);
+    }
+
+    uint64_t num_instrs = 0, num_accesses = 0;
+    {
+        TraceReader reader(argv[i], nullptr, false);
+        db_t inst;
+        while ((num_instrs < max_instrs) && reader.next(inst))
+        {
+            num_instrs += inst.is_last_piece;
+            if (!fetch && !inst.is_load && !inst.is_store)
+                continue;
+            const uint64_t block = (fetch ? inst.pc : inst.addr) >> log2_block;
+            for (stacks_t& stacks : all_stacks)
+                stacks.access(block);
+            num_accesses++;
+        }
+    }
+    printf("%s: %lu %s accesses in %lu instructions, %lu-byte blocks\n", argv[i], num_accesses, fetch ? "fetch" : "data",
+           num_instrs, blocksize);
+
+    FILE * csv = csv_path ? fopen(csv_path, "w") : nullptr;
+    if (csv_path && !csv)
+    {
+        perror(csv_path);
+        return 1;
+    }
+    if (csv)
+        fprintf(csv, "Size,Assoc,BlockSize,Sets,Accesses,Misses,MissRatio,MPKI\n");
+
+    printf("\nMiss ratio (%%) by size and associativity, LRU\n%8s", "size");
+    for (uint64_t log2_assoc = 0; log2_assoc <= log2_max_assoc; log2_assoc++)
+        printf(" %7lu", 1ull << log2_assoc);
+    printf("\n");
+    for (uint64_t log2_size = min_log2_size; log2_size <= max_log2_size; log2_size++)
+    {
+        const uint64_t size = 1ull << log2_size;
+        if (size >= (1ull << 20))
+            printf("%6luMB", size >> 20);
+        else
+            printf("%6luKB", size >> 10);
+        for (uint64_t log2_assoc = 0; log2_assoc <= log2_max_assoc; log2_assoc++)
+        {
+            if (log2_assoc + log2_block > log2_size)
+            {
+                printf(" %7s", "-");
+                continue;
+            }
+            const uint64_t assoc = 1ull << log2_assoc;
+            const uint64_t num_sets = size / (assoc * blocksize);
+            const auto stacks = std::find_if(all_stacks.begin(), all_stacks.end(), [&](const stacks_t& s) { return s.num_sets == num_sets; });
+            const uint64_t misses = stacks->misses(assoc);
+            const double ratio = num_accesses ? (double)misses / num_accesses : 0.0;
+            printf(" %7.3f", 100.0 * ratio);
+            if (csv)
+                fprintf(csv, "%lu,%lu,%lu,%lu,%lu,%lu,%f,%f\n", size, assoc, blocksize, num_sets, num_accesses, misses, ratio,
+                        num_instrs ? 1000.0 * misses / num_instrs : 0.0);
+        }
+        printf("\n");
+    }
+    if (csv)
+        fclose(csv);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// The PPM limit-study engine (ppm_predictor.h) as a plugin (cbp_plugin.h), built by make ppm into ppm.so, for
+//
+//   cbp -p ppm.so[,<budget_MB>[,<max_history>]]
+//
+// with a memory budget of budget_MB (default 1024) for the trie, and contexts of up to max_history (default 1024)
+// outcomes of conditional branches. Each branch is predicted from the history at its fetch, and counted in the trie at
+// once in spec_update(), with its outcome: no notify_* hook is needed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include "cbp_plugin.h"
+#include "ppm_predictor.h"
+
+namespace {
+
+struct ppm_plugin_t
+{
+    std::unique_ptr<ppm_predictor_t> ppm;
+    uint64_t budget_mb = 1024;
+    int max_history = 1024;
+
+    explicit ppm_plugin_t(const char * args)
+    {
+        if (*args && (sscanf(args, "%lu,%d", &budget_mb, &max_history) < 1 || max_history < 1))
+        {
+            fprintf(stderr, "ppm.so takes [<budget_MB>[,<max_history>]], not `%s`\n", args);
+            exit(1);
+        }
+        ppm.reset(new ppm_predictor_t(budget_mb << 20, max_history));
+    }
+
+    void begin() {}
+    void end()
+    {
+        printf("PPM: %lu branches, %lu of %lu contexts in use (%lu MB), %lu prunes of %lu contexts, contexts of up to %d outcomes\n",
+               ppm->branches(), ppm->nodes_in_use(), ppm->node_capacity(), (ppm->nodes_in_use() * ppm_predictor_t::NODE_BYTES) >> 20,
+               ppm->prunes(), ppm->pruned(), max_history);
+    }
+    bool get_cond_dir_prediction(uint64_t, uint8_t, uint64_t pc, uint64_t)
+    {
+        return ppm->predict(pc);
+    }
+    void prefetch(uint64_t pc)
+    {
+        ppm->prefetch(pc);
+    }
+    void spec_update(uint64_t, uint8_t, uint64_t pc, InstClass inst_class, bool resolve_dir, bool, uint64_t)
+    {
+        if (inst_class != InstClass::condBranchInstClass)
+            return;
+        ppm->update(pc, resolve_dir);
+        ppm->push_history(resolve_dir);
+    }
+};
+
+} // namespace
+
+CBP_PLUGIN(ppm_plugin_t, "ppm", 0)
@@ -0,0 +1,46 @@
+// Pretty-printer of the pipeline activity recorded by cbp -y (lib/activity_trace.h): prints the records as the lines
+// a run with LOG_LEVEL != 0 prints, each Fetched event with the micro-op fetched.
+//
+// Usage : print_activity <activity.bin>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "lib/activity_trace.h"
+
+int main(int argc, char ** argv)
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <activity.bin>\n", argv[0]);
+        return 0;
+    }
+    FILE * f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    activity_trace_header_t header;
+    if ((fread(&header, sizeof(header), 1, f) != 1) || strcmp(header.magic, "CBPACT1") || (header.record_size != sizeof(activity_record_t)))
+    {
+        fprintf(stderr, "%s is not an activity trace of this version\n", argv[1]);
+        return 1;
+    }
+
+    std::ios::sync_with_stdio(false);
+    activity_record_t r;
+    activity_record_t inst;
+    while (fread(&r, sizeof(r), 1, f) == 1)
+    {
+        const bool fetched = (r.type == ACTIVITY_FETCHED) && (fread(&inst, sizeof(inst), 1, f) == 1);
+        if (r.type >= ACTIVITY_INST)
+        {
+            fprintf(stderr, "Unexpected record of type %u in %s\n", r.type, argv[1]);
+            return 1;
+        }
+        print_activity(std::cout, r, fetched ? &inst : nullptr);
+    }
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,543 @@
+// Pre-screening of predictor geometries: thousands of simplified TAGE and GEHL (hashed perceptron) configurations,
+// drawn from a grid of geometries at run time, are evaluated in lockstep over the branch streams of a set of traces
+// and ranked by mean MPKI, to pick the few worth a full-fidelity run (tools/explore.cc, or cbp itself).
+//
+// Usage : screen [-j <jobs>] [-b <budget_KB>] [-i <max_instrs>] [-k tage|gehl|all] [-n <top>] [-o <results.csv>] <trace>...
+//
+// Traces are instruction traces (.gz or native) or branch traces (convert_trace -b), of which only the first
+// <max_instrs> instructions are kept (default: all). The models are the bare algorithms, the MPKI of which ranks
+// geometries rather than predicts the contestant's:
+//
+//   tage  a bimodal table and tagged tables of geometric history lengths, the longest match providing the prediction
+//         (its alternate if it is weak and not yet useful), one entry allocated above the provider on a mispredict,
+//         and the useful bits halved every 256K conditional branches
+//   gehl  one table of 6-bit weights per geometric history length (the first indexed by the PC alone), whose sum
+//         gives the direction, trained on mispredicts and low-confidence sums with O-GEHL's adaptive threshold
+//
+// Both update at once after each prediction, with no resolve delay. Every branch shifts one bit into the global
+// history: the direction of a conditional branch, a bit of the PC and target of the others.
+//
+// The streams are held compressed in memory (lib/branch_stream.h). The configurations within the budget (-b, 64 KB
+// by default) are cut into groups of at most 64 MB of state, at least one per thread, which -j threads (default: one
+// per core) take in turn. A thread walks the streams a block at a time: the block is decoded and its history bits
+// written once, then every configuration of the group runs over it, so the block and the history stay in the L1
+// while the tables of the configurations stream through. Configurations that differ only in their tables (the bimodal
+// table of tage) share their folded histories: those are updated, and the indices and tags computed, once per branch
+// for all of them. -n prints the best configurations (default 20), and -o writes a csv row for each.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lib/branch_stream.h"
+#include "lib/folded_history.h"
+
+namespace {
+
+enum model_t
+{
+    MODEL_TAGE,
+    MODEL_GEHL
+};
+
+const char * const model_names[] = {"tage", "gehl"};
+
+struct config_t
+{
+    model_t model;
+    int num_tables;     // tagged tables (tage), or weight tables including the PC-only one (gehl)
+    int min_hist;
+    int max_hist;
+    int log_size;       // entries per table
+    int tag_bits;       // tage
+    int log_bimodal;    // tage
+
+    std::string name() const
+    {
+        char s[64];
+        if (model == MODEL_TAGE)
+            snprintf(s, sizeof(s), "tage_n%d_l%d_t%d_h%d-%d_b%d", num_tables, log_size, tag_bits, min_hist, max_hist, log_bimodal);
+        else
+            snprintf(s, sizeof(s), "gehl_n%d_l%d_h%d-%d", num_tables, log_size, min_hist, max_hist);
+        return s;
+    }
+
+    uint64_t storage_bits() const
+    {
+        if (model == MODEL_TAGE)
+            return (2ULL << log_bimodal) + ((uint64_t)num_tables << log_size) * (3 + 2 + tag_bits);
+        return ((uint64_t)num_tables << log_size) * 6;
+    }
+
+    // Host memory of the model's state.
+    uint64_t state_bytes() const
+    {
+        if (model == MODEL_TAGE)
+            return (1ULL << log_bimodal) + ((uint64_t)num_tables << log_size) * 4;
+        return (uint64_t)num_tables << log_size;
+    }
+
+    // Whether c folds the same histories and computes the same indices and tags as this configuration, which then
+    // differ only in their tables (the bimodal table of tage).
+    bool same_history(const config_t& c) const
+    {
+        return (model == c.model) && (num_tables == c.num_tables) && (min_hist == c.min_hist) && (max_hist == c.max_hist)
+               && (log_size == c.log_size) && (tag_bits == c.tag_bits);
+    }
+
+    // History length of table i, geometric from min_hist to max_hist over the tables that have one.
+    int history_length(int i, int first, int last) const
+    {
+        if (last == first)
+            return max_hist;
+        return (int)(min_hist * pow((double)max_hist / min_hist, (double)(i - first) / (last - first)) + 0.5);
+    }
+};
+
+static constexpr int MAX_TABLES = 16;
+static constexpr int MAX_HIST = 4096;
+
+// History bits, newest at the lowest index: bit k of the stream is at HIST_RING - 1 - k, wrapped. A block reads
+// MAX_HIST bits back from its first branch, so the ring holds those and a block.
+static constexpr int HIST_RING = 8192;
+static_assert(HIST_RING >= MAX_HIST + (int)branch_stream_t::BLOCK, "the history ring must hold a block and the longest history");
+
+inline int hist_pt(uint64_t k)
+{
+    return (HIST_RING - 1 - (int)(k & (HIST_RING - 1))) & (HIST_RING - 1);
+}
+
+inline uint64_t pc_hash(uint64_t pc, int bits)
+{
+    return ((pc >> 2) ^ (pc >> (2 + bits))) & ((1ULL << bits) - 1);
+}
+
+// Table indices (the table number above the log_size bits) and tags of the conditional branches of a block, in order.
+// A thread has one, refilled by each history in turn for its configurations.
+struct block_indices_t
+{
+    uint32_t idx[branch_stream_t::BLOCK][MAX_TABLES];
+    uint16_t tags[branch_stream_t::BLOCK][MAX_TABLES];
+};
+
+// The folded global histories of a geometry (config_t::same_history), shared by all the configurations of a group
+// that have it: they are updated, and the indices and tags computed, once per branch. R is 3 for tage (an index and
+// two tag registers per table), 1 for gehl.
+template <int R>
+class shared_history_t
+{
+    private:
+        const int num_tables;
+        const int log_size;
+        const int tag_bits;
+        folded_history_set_t<MAX_TABLES, R, HIST_RING> folds;
+
+    public:
+        shared_history_t(const config_t& c)
+        : num_tables(c.num_tables), log_size(c.log_size), tag_bits(c.tag_bits)
+        {
+            // table 0 of gehl is indexed by the PC alone
+            const int first = (c.model == MODEL_TAGE) ? 0 : 1;
+            for (int t = first; t < num_tables; t++)
+            {
+                const int length = c.history_length(t, first, num_tables - 1);
+                folds.init(t, 0, length, log_size);
+                if constexpr (R > 1)
+                {
+                    folds.init(t, 1, length, tag_bits);
+                    folds.init(t, 2, length, tag_bits - 1);
+                }
+            }
+        }
+
+        // Fills out with the indices (and tags) of the conditional branches of the block, the k-th branch of the
+        // stream being its first, and shifts the block's history bits in.
+        void run_block(const branch_stream_t::block_t& block, const uint8_t * ring, uint64_t k, block_indices_t& out)
+        {
+            const uint32_t mask = (1u << log_size) - 1;
+            for (uint64_t i = 0, c = 0; i < block.count; i++)
+            {
+                if (block.insn_class(i) == InstClass::condBranchInstClass)
+                {
+                    const uint64_t pc = block.pc[i];
+                    const uint32_t hashed = pc_hash(pc, log_size);
+                    for (int t = 0; t < num_tables; t++)
+                    {
+                        out.idx[c][t] = ((uint32_t)t << log_size) | ((hashed ^ folds.comp[0][t]) & mask);
+                        if constexpr (R > 1)
+                            out.tags[c][t] = ((pc >> 2) ^ folds.comp[1][t] ^ (folds.comp[2][t] << 1)) & ((1u << tag_bits) - 1);
+                    }
+                    c++;
+                }
+                folds.update(ring, hist_pt(k + i));
+            }
+        }
+};
+
+class tage_t
+{
+    private:
+        struct entry_t
+        {
+            int8_t ctr;     // 3-bit signed
+            uint8_t u;      // 2-bit
+            uint16_t tag;
+        };
+
+        const config_t cfg;
+        std::vector<int8_t> bimodal;    // 2-bit signed
+        std::vector<entry_t> tables;    // table t at t << log_size
+        uint64_t conds = 0;
+        uint32_t lfsr = 1;
+
+    public:
+        using history_t = shared_history_t<3>;
+
+        uint64_t mispreds = 0;
+
+        tage_t(const config_t& c)
+        : cfg(c), bimodal(1ULL << c.log_bimodal, 0), tables((uint64_t)c.num_tables << c.log_size, entry_t{0, 0, 0})
+        {
+        }
+
+        // The c-th conditional branch of the block of in.
+        void predict_update(uint64_t pc, bool taken, const block_indices_t& in, uint64_t c)
+        {
+            const uint32_t * idx = in.idx[c];
+            const uint16_t * tags = in.tags[c];
+            int provider = -1, alt = -1;
+            for (int t = cfg.num_tables - 1; t >= 0; t--)
+                if (tables[idx[t]].tag == tags[t])
+                {
+                    if (provider < 0)
+                        provider = t;
+                    else if (alt < 0)
+                        alt = t;
+                }
+            int8_t& bim = bimodal[pc_hash(pc, cfg.log_bimodal)];
+            const bool alt_pred = (alt >= 0) ? tables[idx[alt]].ctr >= 0 : bim >= 0;
+            bool pred = alt_pred;
+            if (provider >= 0)
+            {
+                const entry_t& e = tables[idx[provider]];
+                const bool weak_new = ((e.ctr == 0) || (e.ctr == -1)) && (e.u == 0);
+                pred = weak_new ? alt_pred : e.ctr >= 0;
+            }
+            mispreds += pred != taken;
+
+            if (provider >= 0)
+            {
+                entry_t& e = tables[idx[provider]];
+                if ((e.ctr >= 0) != alt_pred)
+                    e.u = ((e.ctr >= 0) == taken) ? std::min(e.u + 1, 3) : std::max(e.u - 1, 0);
+                e.ctr = taken ? std::min(e.ctr + 1, 3) : std::max(e.ctr - 1, -4);
+            }
+            else
+                bim = taken ? std::min(bim + 1, 1) : std::max(bim - 1, -2);
+
+            if ((pred != taken) && (provider < cfg.num_tables - 1))
+            {
+                lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xD0000001u);
+                int start = provider + 1 + (lfsr & 1);
+                if (start >= cfg.num_tables)
+                    start = provider + 1;
+                bool allocated = false;
+                for (int t = start; t < cfg.num_tables && !allocated; t++)
+                    if (tables[idx[t]].u == 0)
+                    {
+                        tables[idx[t]] = {static_cast<int8_t>(taken ? 0 : -1), 0, tags[t]};
+                        allocated = true;
+                    }
+                if (!allocated)
+                    for (int t = start; t < cfg.num_tables; t++)
+                        tables[idx[t]].u -= tables[idx[t]].u > 0;
+            }
+
+            if ((++conds & ((1 << 18) - 1)) == 0)
+                for (entry_t& e : tables)
+                    e.u >>= 1;
+        }
+};
+
+class gehl_t
+{
+    private:
+        const config_t cfg;
+        std::vector<int8_t> weights;    // 6-bit signed, table t at t << log_size
+        int theta;
+        int tc = 0;
+
+    public:
+        using history_t = shared_history_t<1>;
+
+        uint64_t mispreds = 0;
+
+        gehl_t(const config_t& c)
+        : cfg(c), weights((uint64_t)c.num_tables << c.log_size, 0), theta(c.num_tables)
+        {
+        }
+
+        // The c-th conditional branch of the block of in.
+        void predict_update(uint64_t pc, bool taken, const block_indices_t& in, uint64_t c)
+        {
+            const uint32_t * idx = in.idx[c];
+            int sum = cfg.num_tables / 2;
+            for (int t = 0; t < cfg.num_tables; t++)
+                sum += 2 * weights[idx[t]] + 1;
+            const bool pred = sum >= 0;
+            mispreds += pred != taken;
+
+            if ((pred != taken) || (abs(sum) <= theta))
+            {
+                for (int t = 0; t < cfg.num_tables; t++)
+                {
+                    int8_t& w = weights[idx[t]];
+                    w = taken ? std::min(w + 1, 31) : std::max(w - 1, -32);
+                }
+                // O-GEHL: as many updates on mispredicts as on correct low-confidence sums
+                if (pred != taken)
+                {
+                    if (++tc >= 63)
+                    {
+                        theta++;
+                        tc = 0;
+                    }
+                }
+                else if (--tc <= -64)
+                {
+                    theta = std::max(theta - 1, 1);
+                    tc = 0;
+                }
+            }
+        }
+};
+
+// The geometries of the grid within the budget.
+std::vector<config_t> build_grid(bool tage, bool gehl, double budget_kb)
+{
+    std::vector<config_t> grid;
+    if (tage)
+        for (int n : {4, 6, 8, 10, 12, 14})
+            for (int log_size = 8; log_size <= 12; log_size++)
+                for (int tag_bits : {8, 10, 12})
+                    for (int min_hist : {4, 6, 8})
+                        for (int max_hist : {300, 600, 1000, 2000})
+                            for (int log_bimodal : {12, 13, 14})
+                                grid.push_back({MODEL_TAGE, n, min_hist, max_hist, log_size, tag_bits, log_bimodal});
+    if (gehl)
+        for (int n : {4, 6, 8, 12, 16})
+            for (int log_size = 9; log_size <= 13; log_size++)
+                for (int min_hist : {2, 4})
+                    for (int max_hist : {100, 200, 400, 1000, 2000})
+                        grid.push_back({MODEL_GEHL, n, min_hist, max_hist, log_size, 0, 0});
+    grid.erase(std::remove_if(grid.begin(), grid.end(), [&](const config_t& c) { return c.storage_bits() > budget_kb * 8 * 1024; }),
+               grid.end());
+    return grid;
+}
+
+inline bool history_bit(InstClass insn_class, bool taken, uint64_t pc, uint64_t next_pc)
+{
+    if (insn_class == InstClass::condBranchInstClass)
+        return taken;
+    return ((pc >> 2) ^ (next_pc >> 2)) & 1;
+}
+
+// The configurations of a group that share a history (config_t::same_history).
+template <class MODEL>
+struct history_group_t
+{
+    typename MODEL::history_t history;
+    std::vector<MODEL> models;
+    std::vector<uint64_t> ids;
+
+    history_group_t(const config_t& c)
+    : history(c)
+    {
+    }
+};
+
+// Runs the configurations [first, last) in lockstep over the stream, and adds their mispredictions to mispreds.
+void run_group(const std::vector<config_t>& configs, uint64_t first, uint64_t last, const branch_stream_t& stream,
+               std::vector<uint64_t>& mispreds)
+{
+    std::vector<history_group_t<tage_t>> tages;
+    std::vector<history_group_t<gehl_t>> gehls;
+    auto add = [&](auto& groups, uint64_t c) {
+        if (groups.empty() || !configs[groups.back().ids.back()].same_history(configs[c]))
+            groups.emplace_back(configs[c]);
+        groups.back().models.emplace_back(configs[c]);
+        groups.back().ids.push_back(c);
+    };
+    for (uint64_t c = first; c < last; c++)
+    {
+        if (configs[c].model == MODEL_TAGE)
+            add(tages, c);
+        else
+            add(gehls, c);
+    }
+
+    std::vector<uint8_t> ring(HIST_RING, 0);
+    branch_stream_t::block_t block;
+    std::unique_ptr<block_indices_t> indices(new block_indices_t);
+    uint64_t k = 0;     // branches before the block
+    auto run_block = [&](auto& groups) {
+        for (auto& g : groups)
+        {
+            g.history.run_block(block, ring.data(), k, *indices);
+            for (auto& m : g.models)
+                for (uint64_t i = 0, c = 0; i < block.count; i++)
+                    if (block.insn_class(i) == InstClass::condBranchInstClass)
+                        m.predict_update(block.pc[i], block.is_taken(i), *indices, c++);
+        }
+    };
+    for (uint64_t b = 0; b < stream.num_blocks(); b++)
+    {
+        stream.decode_block(b, block);
+        for (uint64_t i = 0; i < block.count; i++)
+            ring[hist_pt(k + i)] = history_bit(block.insn_class(i), block.is_taken(i), block.pc[i], block.next_pc[i]);
+        run_block(tages);
+        run_block(gehls);
+        k += block.count;
+    }
+    auto collect = [&](const auto& groups) {
+        for (const auto& g : groups)
+            for (uint64_t m = 0; m < g.models.size(); m++)
+                mispreds[g.ids[m]] += g.models[m].mispreds;
+    };
+    collect(tages);
+    collect(gehls);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    static constexpr uint64_t GROUP_BYTES = 64 << 20;
+    unsigned jobs = 0;
+    double budget_kb = 64;
+    uint64_t max_instrs = UINT64_MAX;
+    uint64_t top = 20;
+    bool tage = true, gehl = true;
+    const char * csv_path = nullptr;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        if (!strcmp(argv[i], "-j"))
+            jobs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "-b"))
+            budget_kb = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-i"))
+            max_instrs = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-n"))
+            top = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "-k"))
+        {
+            tage = strcmp(argv[i + 1], "gehl") != 0;
+            gehl = strcmp(argv[i + 1], "tage") != 0;
+        }
+        else if (!strcmp(argv[i], "-o"))
+            csv_path = argv[i + 1];
+        else
+            break;
+    }
+    if (i >= argc)
+    {
+        printf("usage:\t%s [-j <jobs>] [-b <budget_KB>] [-i <max_instrs>] [-k tage|gehl|all] [-n <top>] [-o <results.csv>] <trace>...\n", argv[0]);
+        return 0;
+    }
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<branch_stream_t> streams;
+    for (; i < argc; i++)
+    {
+        streams.push_back(load_branch_stream(argv[i], max_instrs));
+        printf("Loaded %s: %lu branches in %lu instructions\n", argv[i], streams.back().num_branches(), streams.back().num_instrs());
+    }
+
+    const std::vector<config_t> configs = build_grid(tage, gehl, budget_kb);
+    if (configs.empty())
+    {
+        fprintf(stderr, "No configuration fits the %.1f KB budget\n", budget_kb);
+        return 1;
+    }
+    // groups of consecutive configurations, by state size, and at least one per thread, never cutting between two
+    // that share a history (the grid lists them one after the other)
+    uint64_t total_bytes = 0;
+    for (const config_t& c : configs)
+        total_bytes += c.state_bytes();
+    const uint64_t max_group_bytes = std::min(GROUP_BYTES, (total_bytes + jobs - 1) / jobs);
+    std::vector<uint64_t> group_starts{0};
+    uint64_t group_bytes = 0;
+    for (uint64_t c = 0; c < configs.size(); c++)
+    {
+        if ((group_bytes > 0) && (group_bytes + configs[c].state_bytes() > max_group_bytes) && !configs[c - 1].same_history(configs[c]))
+        {
+            group_starts.push_back(c);
+            group_bytes = 0;
+        }
+        group_bytes += configs[c].state_bytes();
+    }
+    group_starts.push_back(configs.size());
+    const uint64_t num_groups = group_starts.size() - 1;
+    printf("Screening %lu configurations within %.1f KB, in %lu groups on %u threads\n", configs.size(), budget_kb, num_groups, jobs);
+    fflush(stdout);
+
+    // mispredictions of each configuration on each stream
+    std::vector<std::vector<uint64_t>> mispreds(streams.size(), std::vector<uint64_t>(configs.size(), 0));
+    std::atomic<uint64_t> next_task(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < jobs; t++)
+        threads.emplace_back([&]() {
+            for (uint64_t task; (task = next_task++) < num_groups * streams.size();)
+            {
+                const uint64_t g = task / streams.size(), s = task % streams.size();
+                run_group(configs, group_starts[g], group_starts[g + 1], streams[s], mispreds[s]);
+            }
+        });
+    for (std::thread& t : threads)
+        t.join();
+
+    // Mean MPKI over the traces, as the CBP score.
+    std::vector<std::pair<double, uint64_t>> ranking;
+    for (uint64_t c = 0; c < configs.size(); c++)
+    {
+        double mpki_sum = 0.0;
+        for (uint64_t s = 0; s < streams.size(); s++)
+            mpki_sum += streams[s].num_instrs() ? 1000.0 * mispreds[s][c] / streams[s].num_instrs() : 0.0;
+        ranking.push_back({mpki_sum / streams.size(), c});
+    }
+    std::stable_sort(ranking.begin(), ranking.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    printf("  %-32s %10s %10s\n", "Configuration", "KB", "MPKI");
+    for (uint64_t r = 0; r < std::min<uint64_t>(top, ranking.size()); r++)
+    {
+        const config_t& c = configs[ranking[r].second];
+        printf("  %-32s %10.1f %10.4f\n", c.name().c_str(), (double)c.storage_bits() / (8 * 1024), ranking[r].first);
+    }
+
+    if (csv_path)
+    {
+        FILE * csv = fopen(csv_path, "w");
+        if (!csv)
+        {
+            fprintf(stderr, "Unable to open %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "name,model,num_tables,log_size,tag_bits,min_hist,max_hist,log_bimodal,kb,mpki\n");
+        for (const auto& [mpki, id] : ranking)
+        {
+            const config_t& c = configs[id];
+            fprintf(csv, "%s,%s,%d,%d,%d,%d,%d,%d,%.1f,%.4f\n", c.name().c_str(), model_names[c.model], c.num_tables, c.log_size,
+                    c.tag_bits, c.min_hist, c.max_hist, c.log_bimodal, (double)c.storage_bits() / (8 * 1024), mpki);
+        }
+        fclose(csv);
+    }
+    return 0;
+}